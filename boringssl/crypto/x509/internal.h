@@ -17,6 +17,7 @@
 
 #include <openssl/base.h>
 #include <openssl/evp.h>
+#include <openssl/sha.h>
 #include <openssl/x509.h>
 
 #if defined(__cplusplus)
@@ -59,6 +60,36 @@ int x509_digest_verify_init(EVP_MD_CTX *ctx, X509_ALGOR *sigalg,
                             EVP_PKEY *pkey);
 
 
+/* Verified chain cache. */
+
+typedef struct x509_verify_cache_st X509_VERIFY_CACHE;
+
+/* x509_verify_cache_key sets |out| to the key, in its store's verified chain
+ * cache, of the verification |ctx| is set up for. It returns one on success
+ * and zero on error. */
+int x509_verify_cache_key(uint8_t out[SHA256_DIGEST_LENGTH],
+                          X509_STORE_CTX *ctx);
+
+/* x509_verify_cache_get looks up |key| in the verified chain cache of |store|.
+ * On a hit, it appends the cached certificates above the leaf to |chain|,
+ * taking a reference to each, sets |*out_last_untrusted| and returns one.
+ * Otherwise it returns zero and leaves |chain| unchanged. */
+int x509_verify_cache_get(X509_STORE *store,
+                          const uint8_t key[SHA256_DIGEST_LENGTH],
+                          STACK_OF(X509) *chain, int *out_last_untrusted);
+
+/* x509_verify_cache_add records |chain|, with |last_untrusted| untrusted
+ * certificates, as the result of the verification identified by |key| in the
+ * verified chain cache of |store|, evicting the least recently used entry if
+ * the cache is full. Allocation failures are ignored. */
+void x509_verify_cache_add(X509_STORE *store,
+                           const uint8_t key[SHA256_DIGEST_LENGTH],
+                           STACK_OF(X509) *chain, int last_untrusted);
+
+/* x509_verify_cache_free releases |cache| and all of its entries. */
+void x509_verify_cache_free(X509_VERIFY_CACHE *cache);
+
+
 #if defined(__cplusplus)
 }  /* extern C */
 #endif
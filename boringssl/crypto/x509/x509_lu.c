@@ -64,6 +64,7 @@
 #include <openssl/x509.h>
 #include <openssl/x509v3.h>
 
+#include "internal.h"
 #include "../internal.h"
 
 X509_LOOKUP *X509_LOOKUP_new(X509_LOOKUP_METHOD *method)
@@ -264,6 +265,7 @@ void X509_STORE_free(X509_STORE *vfy)
 
     if (vfy->param)
         X509_VERIFY_PARAM_free(vfy->param);
+    x509_verify_cache_free(vfy->verify_cache);
     OPENSSL_free(vfy);
 }
 
@@ -366,6 +368,10 @@ int X509_STORE_add_cert(X509_STORE *ctx, X509 *x)
 
     CRYPTO_MUTEX_unlock(&ctx->objs_lock);
 
+    /* A new trusted certificate may change the chains built from now on. */
+    if (ret)
+        X509_STORE_flush_verify_cache(ctx);
+
     return ret;
 }
 
@@ -398,6 +404,13 @@ int X509_STORE_add_crl(X509_STORE *ctx, X509_CRL *x)
 
     CRYPTO_MUTEX_unlock(&ctx->objs_lock);
 
+    /*
+     * Chains verified with CRL checking are never cached, but a flush keeps
+     * the cache from outliving any change to what the store holds.
+     */
+    if (ret)
+        X509_STORE_flush_verify_cache(ctx);
+
     return ret;
 }
 
@@ -660,29 +673,40 @@ int X509_STORE_CTX_get1_issuer(X509 **issuer, X509_STORE_CTX *ctx, X509 *x)
     return ret;
 }
 
+/*
+ * The verification parameters of the store are part of the key of its
+ * verified chain cache, but chains verified under the old ones are not going
+ * to be looked up again, so changing them flushes the cache.
+ */
+
 int X509_STORE_set_flags(X509_STORE *ctx, unsigned long flags)
 {
+    X509_STORE_flush_verify_cache(ctx);
     return X509_VERIFY_PARAM_set_flags(ctx->param, flags);
 }
 
 int X509_STORE_set_depth(X509_STORE *ctx, int depth)
 {
+    X509_STORE_flush_verify_cache(ctx);
     X509_VERIFY_PARAM_set_depth(ctx->param, depth);
     return 1;
 }
 
 int X509_STORE_set_purpose(X509_STORE *ctx, int purpose)
 {
+    X509_STORE_flush_verify_cache(ctx);
     return X509_VERIFY_PARAM_set_purpose(ctx->param, purpose);
 }
 
 int X509_STORE_set_trust(X509_STORE *ctx, int trust)
 {
+    X509_STORE_flush_verify_cache(ctx);
     return X509_VERIFY_PARAM_set_trust(ctx->param, trust);
 }
 
 int X509_STORE_set1_param(X509_STORE *ctx, X509_VERIFY_PARAM *param)
 {
+    X509_STORE_flush_verify_cache(ctx);
     return X509_VERIFY_PARAM_set1(ctx->param, param);
 }
 
@@ -23,6 +23,8 @@
 #include <openssl/evp.h>
 #include <openssl/pem.h>
 #include <openssl/x509.h>
+#include <openssl/x509_view.h>
+#include <openssl/x509v3.h>
 
 #include "../test/scoped_types.h"
 
@@ -379,6 +381,168 @@ static bool TestVerify() {
   return true;
 }
 
+// VerifyWithStore verifies |leaf| against |store| at Jan 14th, 2016 and
+// returns the resulting |X509_STORE_CTX| error, or -1 if verification failed
+// without setting one. If |host| is not NULL, the leaf must match it.
+static int VerifyWithStore(X509_STORE *store, X509 *leaf,
+                           const std::vector<X509 *> &intermediates,
+                           const char *host, int depth,
+                           int (*verify_cb)(int, X509_STORE_CTX *)) {
+  ScopedX509Stack intermediates_stack(CertsToStack(intermediates));
+  ScopedX509_STORE_CTX ctx(X509_STORE_CTX_new());
+  if (!intermediates_stack || !ctx ||
+      !X509_STORE_CTX_init(ctx.get(), store, leaf,
+                           intermediates_stack.get())) {
+    return -1;
+  }
+
+  X509_VERIFY_PARAM *param = X509_STORE_CTX_get0_param(ctx.get());
+  X509_VERIFY_PARAM_set_time(param, 1452807555 /* Jan 14th, 2016 */);
+  X509_VERIFY_PARAM_set_depth(param, depth);
+  if (host != nullptr &&
+      !X509_VERIFY_PARAM_set1_host(param, host, strlen(host))) {
+    return -1;
+  }
+  if (verify_cb != nullptr) {
+    X509_STORE_CTX_set_verify_cb(ctx.get(), verify_cb);
+  }
+
+  ERR_clear_error();
+  if (X509_verify_cert(ctx.get()) != 1) {
+    int err = X509_STORE_CTX_get_error(ctx.get());
+    return err == X509_V_OK ? -1 : err;
+  }
+  if (sk_X509_num(X509_STORE_CTX_get_chain(ctx.get())) != 3) {
+    fprintf(stderr, "Unexpected chain length.\n");
+    return -1;
+  }
+  return X509_V_OK;
+}
+
+static int AcceptAll(int ok, X509_STORE_CTX *ctx) {
+  return 1;
+}
+
+static bool ExpectCacheStats(X509_STORE *store, uint64_t hits,
+                             uint64_t misses, size_t num_entries) {
+  uint64_t got_hits, got_misses;
+  size_t got_num_entries;
+  X509_STORE_get_verify_cache_stats(store, &got_hits, &got_misses,
+                                    &got_num_entries);
+  if (got_hits != hits || got_misses != misses ||
+      got_num_entries != num_entries) {
+    fprintf(stderr,
+            "Cache stats were %d hits, %d misses, %d entries, wanted %d, %d, "
+            "%d.\n",
+            (int)got_hits, (int)got_misses, (int)got_num_entries, (int)hits,
+            (int)misses, (int)num_entries);
+    return false;
+  }
+  return true;
+}
+
+static bool TestVerifyCache() {
+  ScopedX509 root(CertFromPEM(kRootCAPEM));
+  ScopedX509 cross_signing_root(CertFromPEM(kCrossSigningRootPEM));
+  ScopedX509_STORE store(X509_STORE_new());
+  if (!root || !cross_signing_root || !store ||
+      !X509_STORE_add_cert(store.get(), root.get()) ||
+      !X509_STORE_set_verify_cache_size(store.get(), 2)) {
+    return false;
+  }
+
+  // Each verification parses the chain afresh, as a new connection would, so
+  // that nothing is remembered in the |X509| objects themselves.
+  auto verify = [&](const char *host, int depth,
+                    int (*verify_cb)(int, X509_STORE_CTX *)) -> int {
+    ScopedX509 leaf(CertFromPEM(kLeafPEM));
+    ScopedX509 intermediate(CertFromPEM(kIntermediatePEM));
+    if (!leaf || !intermediate) {
+      return -1;
+    }
+    return VerifyWithStore(store.get(), leaf.get(), {intermediate.get()},
+                           host, depth, verify_cb);
+  };
+
+  if (verify(nullptr, 16, nullptr) != X509_V_OK ||
+      !ExpectCacheStats(store.get(), 0, 1, 1) ||
+      verify(nullptr, 16, nullptr) != X509_V_OK ||
+      !ExpectCacheStats(store.get(), 1, 1, 1)) {
+    fprintf(stderr, "Repeated verification was not cached.\n");
+    return false;
+  }
+
+  // The host check is applied to cached chains.
+  if (verify("example.com", 16, nullptr) != X509_V_OK ||
+      verify("example.org", 16, nullptr) != X509_V_ERR_HOSTNAME_MISMATCH ||
+      !ExpectCacheStats(store.get(), 3, 1, 1)) {
+    fprintf(stderr, "Host check was skipped on a cached chain.\n");
+    return false;
+  }
+
+  // Verifications with a callback bypass the cache.
+  if (verify(nullptr, 16, AcceptAll) != X509_V_OK ||
+      !ExpectCacheStats(store.get(), 3, 1, 1)) {
+    fprintf(stderr, "Verification with a callback used the cache.\n");
+    return false;
+  }
+
+  // Failures are not cached.
+  ScopedX509 leaf(CertFromPEM(kLeafPEM));
+  if (!leaf ||
+      VerifyWithStore(store.get(), leaf.get(), {}, nullptr, 16, nullptr) ==
+          X509_V_OK ||
+      !ExpectCacheStats(store.get(), 3, 2, 1)) {
+    fprintf(stderr, "Failed verification was cached.\n");
+    return false;
+  }
+
+  // Different verification parameters get different entries, and the least
+  // recently used one is evicted.
+  if (verify(nullptr, 8, nullptr) != X509_V_OK ||
+      verify(nullptr, 4, nullptr) != X509_V_OK ||
+      !ExpectCacheStats(store.get(), 3, 4, 2) ||
+      verify(nullptr, 16, nullptr) != X509_V_OK ||
+      !ExpectCacheStats(store.get(), 3, 5, 2)) {
+    fprintf(stderr, "Cache eviction failed.\n");
+    return false;
+  }
+
+  // Trust settings are checked again on a hit.
+  if (!X509_add1_reject_object(
+          root.get(),
+          const_cast<ASN1_OBJECT *>(OBJ_nid2obj(NID_anyExtendedKeyUsage))) ||
+      verify(nullptr, 16, nullptr) != X509_V_ERR_CERT_REJECTED ||
+      !ExpectCacheStats(store.get(), 4, 5, 2)) {
+    fprintf(stderr, "Trust check was skipped on a cached chain.\n");
+    return false;
+  }
+  X509_reject_clear(root.get());
+
+  // Changing the store's verification parameters flushes the cache.
+  ScopedX509_VERIFY_PARAM param(X509_VERIFY_PARAM_new());
+  if (!param ||
+      !X509_STORE_set_flags(store.get(), 0) ||
+      !ExpectCacheStats(store.get(), 4, 5, 0) ||
+      verify(nullptr, 16, nullptr) != X509_V_OK ||
+      !X509_STORE_set1_param(store.get(), param.get()) ||
+      !ExpectCacheStats(store.get(), 4, 6, 0)) {
+    fprintf(stderr, "Changing parameters did not flush the cache.\n");
+    return false;
+  }
+
+  // Adding a trusted certificate flushes the cache.
+  if (verify(nullptr, 16, nullptr) != X509_V_OK ||
+      !ExpectCacheStats(store.get(), 4, 7, 1) ||
+      !X509_STORE_add_cert(store.get(), cross_signing_root.get()) ||
+      !ExpectCacheStats(store.get(), 4, 7, 0)) {
+    fprintf(stderr, "Adding a root did not flush the cache.\n");
+    return false;
+  }
+
+  return true;
+}
+
 static bool TestPSS() {
   ScopedX509 cert(CertFromPEM(kExamplePSSCert));
   if (!cert) {
@@ -457,13 +621,229 @@ static bool TestSignCtx() {
   return true;
 }
 
+// CertToDER returns the DER encoding of |cert|.
+static std::vector<uint8_t> CertToDER(X509 *cert) {
+  int len = i2d_X509(cert, nullptr);
+  if (len <= 0) {
+    return std::vector<uint8_t>();
+  }
+  std::vector<uint8_t> der(len);
+  uint8_t *ptr = der.data();
+  i2d_X509(cert, &ptr);
+  return der;
+}
+
+// ViewFieldEquals returns true if |field| holds the DER encoding of |obj|
+// under |i2d|.
+template <typename T>
+static bool ViewFieldEquals(const CBS *field, T *obj,
+                            int (*i2d)(T *, uint8_t **)) {
+  uint8_t *der = nullptr;
+  int len = i2d(obj, &der);
+  if (len < 0) {
+    return false;
+  }
+  ScopedOpenSSLBytes free_der(der);
+  return CBS_mem_equal(field, der, len);
+}
+
+// ExpectViewMatches parses |cert| as an |X509_VIEW| and checks the view
+// against the |X509| parser's results.
+static bool ExpectViewMatches(X509 *cert, X509_VIEW *out_view,
+                              std::vector<uint8_t> *out_der) {
+  *out_der = CertToDER(cert);
+  CBS cbs;
+  CBS_init(&cbs, out_der->data(), out_der->size());
+  if (!X509_VIEW_parse(out_view, &cbs) || CBS_len(&cbs) != 0) {
+    fprintf(stderr, "Failed to parse certificate view.\n");
+    return false;
+  }
+
+  if (!ViewFieldEquals(&out_view->subject, X509_get_subject_name(cert),
+                       i2d_X509_NAME) ||
+      !ViewFieldEquals(&out_view->issuer, X509_get_issuer_name(cert),
+                       i2d_X509_NAME) ||
+      !ViewFieldEquals(&out_view->spki, X509_get_X509_PUBKEY(cert),
+                       i2d_X509_PUBKEY) ||
+      !ViewFieldEquals(&out_view->signature_algorithm, cert->sig_alg,
+                       i2d_X509_ALGOR)) {
+    fprintf(stderr, "Certificate view fields did not match.\n");
+    return false;
+  }
+
+  ScopedEVP_PKEY view_key(X509_VIEW_get_pubkey(out_view));
+  ScopedEVP_PKEY key(X509_get_pubkey(cert));
+  if (!view_key || !key || EVP_PKEY_cmp(view_key.get(), key.get()) != 1) {
+    fprintf(stderr, "Certificate view public key did not match.\n");
+    return false;
+  }
+
+  if (out_view->is_ca != !!X509_check_ca(cert)) {
+    fprintf(stderr, "Certificate view CA flag did not match.\n");
+    return false;
+  }
+  return true;
+}
+
+static bool TestView() {
+  ScopedX509 root(CertFromPEM(kRootCAPEM));
+  ScopedX509 intermediate(CertFromPEM(kIntermediatePEM));
+  ScopedX509 leaf(CertFromPEM(kLeafPEM));
+  ScopedX509 pss(CertFromPEM(kExamplePSSCert));
+  if (!root || !intermediate || !leaf || !pss) {
+    return false;
+  }
+
+  X509_VIEW root_view, intermediate_view, leaf_view, pss_view;
+  std::vector<uint8_t> root_der, intermediate_der, leaf_der, pss_der;
+  if (!ExpectViewMatches(root.get(), &root_view, &root_der) ||
+      !ExpectViewMatches(intermediate.get(), &intermediate_view,
+                         &intermediate_der) ||
+      !ExpectViewMatches(leaf.get(), &leaf_view, &leaf_der) ||
+      !ExpectViewMatches(pss.get(), &pss_view, &pss_der)) {
+    return false;
+  }
+
+  // The test chain is valid from 2015-01-01 to 2100-01-01.
+  if (leaf_view.not_before != 1420070400 ||
+      leaf_view.not_after != 4102444800 ||
+      !X509_VIEW_check_time(&leaf_view, 1420070400) ||
+      X509_VIEW_check_time(&leaf_view, 1420070399) ||
+      X509_VIEW_check_time(&leaf_view, 4102444801)) {
+    fprintf(stderr, "Certificate view validity was incorrect.\n");
+    return false;
+  }
+
+  if (!root_view.is_ca || leaf_view.is_ca || leaf_view.path_len != -1 ||
+      !leaf_view.has_key_usage ||
+      leaf_view.key_usage != (KU_DIGITAL_SIGNATURE | KU_KEY_ENCIPHERMENT) ||
+      leaf_view.has_unhandled_critical_extension) {
+    fprintf(stderr, "Certificate view extensions were incorrect.\n");
+    return false;
+  }
+
+  ScopedEVP_PKEY intermediate_key(X509_VIEW_get_pubkey(&intermediate_view));
+  ScopedEVP_PKEY root_key(X509_VIEW_get_pubkey(&root_view));
+  ScopedEVP_PKEY pss_key(X509_VIEW_get_pubkey(&pss_view));
+  if (!intermediate_key || !root_key || !pss_key ||
+      !X509_VIEW_verify_signature(&leaf_view, intermediate_key.get()) ||
+      !X509_VIEW_verify_signature(&intermediate_view, root_key.get()) ||
+      !X509_VIEW_verify_signature(&pss_view, pss_key.get())) {
+    fprintf(stderr, "Could not verify certificate view.\n");
+    return false;
+  }
+  if (X509_VIEW_verify_signature(&leaf_view, root_key.get())) {
+    fprintf(stderr, "Certificate view verified with the wrong key.\n");
+    return false;
+  }
+  ERR_clear_error();
+
+  // Give a copy of the leaf some subject alternative names, so both host name
+  // paths are compared against |X509_check_host|.
+  ScopedX509 san_leaf(X509_dup(leaf.get()));
+  ScopedEVP_PKEY key(PrivateKeyFromPEM(kRSAKey));
+  ScopedOpenSSLStack<GENERAL_NAMES, GENERAL_NAME, GENERAL_NAME_free> names(
+      sk_GENERAL_NAME_new_null());
+  if (!san_leaf || !key || !names) {
+    return false;
+  }
+  for (const char *dns_name : {"*.example.org", "example.net"}) {
+    GENERAL_NAME *name = GENERAL_NAME_new();
+    ASN1_IA5STRING *str = ASN1_IA5STRING_new();
+    if (name == nullptr || str == nullptr ||
+        !ASN1_STRING_set(str, dns_name, strlen(dns_name))) {
+      GENERAL_NAME_free(name);
+      ASN1_IA5STRING_free(str);
+      return false;
+    }
+    GENERAL_NAME_set0_value(name, GEN_DNS, str);
+    if (!sk_GENERAL_NAME_push(names.get(), name)) {
+      GENERAL_NAME_free(name);
+      return false;
+    }
+  }
+  if (!X509_add1_ext_i2d(san_leaf.get(), NID_subject_alt_name, names.get(), 0,
+                         0) ||
+      !X509_sign(san_leaf.get(), key.get(), EVP_sha256())) {
+    return false;
+  }
+  X509_VIEW san_view;
+  std::vector<uint8_t> san_der;
+  if (!ExpectViewMatches(san_leaf.get(), &san_view, &san_der)) {
+    return false;
+  }
+
+  static const char *kHosts[] = {
+      "example.com", "EXAMPLE.COM", "www.example.com", ".example.com",
+      "example.org", "www.example.org", "a.b.example.org", ".example.org",
+      "example.net", "example",
+  };
+  static const unsigned kFlags[] = {
+      0,
+      X509_CHECK_FLAG_ALWAYS_CHECK_SUBJECT,
+      X509_CHECK_FLAG_NO_WILDCARDS,
+      X509_CHECK_FLAG_MULTI_LABEL_WILDCARDS,
+  };
+  for (X509 *cert : {leaf.get(), san_leaf.get()}) {
+    const X509_VIEW *view = cert == leaf.get() ? &leaf_view : &san_view;
+    for (const char *host : kHosts) {
+      for (unsigned flags : kFlags) {
+        int expected = X509_check_host(cert, host, strlen(host), flags, NULL);
+        // A length of zero means |host| is NUL-terminated.
+        if (X509_VIEW_check_host(view, host, strlen(host), flags) !=
+                expected ||
+            X509_VIEW_check_host(view, host, 0, flags) != expected) {
+          fprintf(stderr, "Certificate view check of %s (flags %u) did not "
+                  "return %d.\n", host, flags, expected);
+          return false;
+        }
+      }
+    }
+  }
+  if (X509_VIEW_check_host(&leaf_view, "example.com\0", 12, 0) != -2) {
+    fprintf(stderr, "Certificate view matched a host with a NUL.\n");
+    return false;
+  }
+
+  // Trailing data is left in the input.
+  std::vector<uint8_t> chain = leaf_der;
+  chain.insert(chain.end(), intermediate_der.begin(), intermediate_der.end());
+  CBS cbs;
+  CBS_init(&cbs, chain.data(), chain.size());
+  X509_VIEW view;
+  if (!X509_VIEW_parse(&view, &cbs) ||
+      CBS_len(&cbs) != intermediate_der.size() ||
+      !X509_VIEW_parse(&view, &cbs) ||
+      CBS_len(&cbs) != 0 ||
+      !CBS_mem_equal(&view.subject, CBS_data(&intermediate_view.subject),
+                     CBS_len(&intermediate_view.subject))) {
+    fprintf(stderr, "Failed to parse a chain of certificate views.\n");
+    return false;
+  }
+
+  // Every truncation of a certificate is rejected.
+  for (size_t i = 0; i < leaf_der.size(); i++) {
+    CBS_init(&cbs, leaf_der.data(), i);
+    if (X509_VIEW_parse(&view, &cbs)) {
+      fprintf(stderr, "Parsed certificate truncated to %u bytes.\n",
+              static_cast<unsigned>(i));
+      return false;
+    }
+  }
+  ERR_clear_error();
+
+  return true;
+}
+
 int main(int argc, char **argv) {
   CRYPTO_library_init();
 
   if (!TestVerify() ||
+      !TestVerifyCache() ||
       !TestPSS() ||
       !TestBadPSSParameters() ||
-      !TestSignCtx()) {
+      !TestSignCtx() ||
+      !TestView()) {
     return 1;
   }
 
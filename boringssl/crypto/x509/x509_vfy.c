@@ -68,6 +68,7 @@
 #include <openssl/x509.h>
 #include <openssl/x509v3.h>
 
+#include "internal.h"
 #include "vpm_int.h"
 #include "../internal.h"
 
@@ -140,12 +141,71 @@ static int check_crl_chain(X509_STORE_CTX *ctx,
                            STACK_OF(X509) *crl_path);
 
 static int internal_verify(X509_STORE_CTX *ctx);
+static int check_cert_time(X509_STORE_CTX *ctx, X509 *x);
 
 static int null_callback(int ok, X509_STORE_CTX *e)
 {
     return ok;
 }
 
+/*
+ * Only verifications that run the built-in checks without a callback can be
+ * answered from the verified chain cache: a callback may override errors or
+ * expect to see every certificate, and CRL and policy checks depend on more
+ * than the certificates and flags in the cache key.
+ */
+static int verify_cache_usable(X509_STORE_CTX *ctx)
+{
+    return ctx->ctx != NULL && ctx->ctx->verify_cache != NULL
+        && ctx->parent == NULL
+        && ctx->verify_cb == null_callback
+        && ctx->verify == internal_verify
+        && ctx->get_issuer == X509_STORE_CTX_get1_issuer
+        && ctx->check_issued == check_issued
+        && ctx->check_revocation == check_revocation
+        && !(ctx->param->flags & (X509_V_FLAG_CRL_CHECK
+                                  | X509_V_FLAG_CRL_CHECK_ALL
+                                  | X509_V_FLAG_POLICY_MASK));
+}
+
+/*
+ * Check a chain taken from the verified chain cache, which |check_trust| has
+ * found trusted: the signatures are known to be good, but everything else
+ * that does not need them is checked again, so that a hit fails where a full
+ * verification would. In particular validity periods are checked against the
+ * current time and the host, email and IP checks may differ between callers.
+ */
+static int check_cached_chain(X509_STORE_CTX *ctx)
+{
+    int n, err;
+
+    if (!check_chain_extensions(ctx))
+        return 0;
+
+    if (!check_name_constraints(ctx))
+        return 0;
+
+    if (!check_id(ctx))
+        return 0;
+
+    err = X509_chain_check_suiteb(&ctx->error_depth, NULL, ctx->chain,
+                                  ctx->param->flags);
+    if (err != X509_V_OK) {
+        ctx->error = err;
+        ctx->current_cert = sk_X509_value(ctx->chain, ctx->error_depth);
+        return 0;
+    }
+
+    for (n = sk_X509_num(ctx->chain) - 1; n >= 0; n--) {
+        X509 *xs = sk_X509_value(ctx->chain, n);
+        ctx->error_depth = n;
+        if (!check_cert_time(ctx, xs))
+            return 0;
+        ctx->current_cert = xs;
+    }
+    return 1;
+}
+
 #if 0
 static int x509_subject_cmp(X509 **a, X509 **b)
 {
@@ -196,6 +256,8 @@ int X509_verify_cert(X509_STORE_CTX *ctx)
     int num, j, retry, trust;
     int (*cb) (int xok, X509_STORE_CTX *xctx);
     STACK_OF(X509) *sktmp = NULL;
+    uint8_t cache_key[SHA256_DIGEST_LENGTH];
+    int use_cache;
     if (ctx->cert == NULL) {
         OPENSSL_PUT_ERROR(X509, X509_R_NO_CERT_SET_FOR_US_TO_VERIFY);
         return -1;
@@ -223,6 +285,29 @@ int X509_verify_cert(X509_STORE_CTX *ctx)
     X509_up_ref(ctx->cert);
     ctx->last_untrusted = 1;
 
+    use_cache = verify_cache_usable(ctx)
+        && x509_verify_cache_key(cache_key, ctx);
+    if (use_cache
+        && x509_verify_cache_get(ctx->ctx, cache_key, ctx->chain,
+                                 &ctx->last_untrusted)) {
+        trust = check_trust(ctx);
+        if (trust == X509_TRUST_REJECTED) {
+            ok = 0;
+            goto end;
+        }
+        if (trust == X509_TRUST_TRUSTED) {
+            ok = check_cached_chain(ctx);
+            goto end;
+        }
+        /*
+         * The trust settings of a certificate in the chain have changed
+         * since it was cached, so build the chain again.
+         */
+        while (sk_X509_num(ctx->chain) > 1)
+            X509_free(sk_X509_pop(ctx->chain));
+        ctx->last_untrusted = 1;
+    }
+
     /* We use a temporary STACK so we can chop and hack at it */
     if (ctx->untrusted != NULL
         && (sktmp = sk_X509_dup(ctx->untrusted)) == NULL) {
@@ -488,6 +573,10 @@ int X509_verify_cert(X509_STORE_CTX *ctx)
     if (!bad_chain && (ctx->param->flags & X509_V_FLAG_POLICY_CHECK))
         ok = ctx->check_policy(ctx);
 
+    if (ok > 0 && use_cache)
+        x509_verify_cache_add(ctx->ctx, cache_key, ctx->chain,
+                              ctx->last_untrusted);
+
  end:
     if (sktmp != NULL)
         sk_X509_free(sktmp);
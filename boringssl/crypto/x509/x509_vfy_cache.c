@@ -0,0 +1,339 @@
+/* Copyright (c) 2016, Google Inc.
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY
+ * SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION
+ * OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF OR IN
+ * CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE. */
+
+#include <openssl/x509.h>
+
+#include <string.h>
+#include <time.h>
+
+#include <openssl/err.h>
+#include <openssl/mem.h>
+#include <openssl/sha.h>
+#include <openssl/x509_vfy.h>
+
+#include "internal.h"
+#include "../internal.h"
+
+
+/* kMaxBuckets bounds the size of the bucket array of very large caches. */
+static const size_t kMaxBuckets = 1 << 16;
+
+typedef struct x509_verify_cache_entry_st {
+  uint8_t key[SHA256_DIGEST_LENGTH];
+  /* chain contains the certificates of the verified chain above the leaf,
+   * which is supplied by the caller on every verification. */
+  STACK_OF(X509) *chain;
+  int last_untrusted;
+  struct x509_verify_cache_entry_st *hash_next;
+  /* lru_prev and lru_next link the entries from the most recently used,
+   * |lru_head|, to the least recently used, |lru_tail|. */
+  struct x509_verify_cache_entry_st *lru_prev, *lru_next;
+} X509_VERIFY_CACHE_ENTRY;
+
+struct x509_verify_cache_st {
+  CRYPTO_MUTEX lock;
+  size_t max_entries;
+  size_t num_entries;
+  /* buckets is an array of |num_buckets| chains of entries, where
+   * |num_buckets| is a power of two. */
+  X509_VERIFY_CACHE_ENTRY **buckets;
+  size_t num_buckets;
+  X509_VERIFY_CACHE_ENTRY *lru_head, *lru_tail;
+  uint64_t hits, misses;
+};
+
+static void hash_u64(SHA256_CTX *sha, uint64_t v) {
+  uint8_t buf[8];
+  size_t i;
+  for (i = 0; i < sizeof(buf); i++) {
+    buf[i] = (uint8_t)(v >> (56 - 8 * i));
+  }
+  SHA256_Update(sha, buf, sizeof(buf));
+}
+
+static int hash_cert(SHA256_CTX *sha, X509 *x509) {
+  uint8_t *der = NULL;
+  int der_len = i2d_X509(x509, &der);
+  if (der_len < 0) {
+    return 0;
+  }
+  hash_u64(sha, (uint64_t)der_len);
+  SHA256_Update(sha, der, (size_t)der_len);
+  OPENSSL_free(der);
+  return 1;
+}
+
+int x509_verify_cache_key(uint8_t out[SHA256_DIGEST_LENGTH],
+                          X509_STORE_CTX *ctx) {
+  const X509_VERIFY_PARAM *param = ctx->param;
+  SHA256_CTX sha;
+  size_t i;
+
+  SHA256_Init(&sha);
+  if (!hash_cert(&sha, ctx->cert)) {
+    return 0;
+  }
+  hash_u64(&sha, sk_X509_num(ctx->untrusted));
+  for (i = 0; i < sk_X509_num(ctx->untrusted); i++) {
+    if (!hash_cert(&sha, sk_X509_value(ctx->untrusted, i))) {
+      return 0;
+    }
+  }
+
+  time_t now = (param->flags & X509_V_FLAG_USE_CHECK_TIME) ? param->check_time
+                                                           : time(NULL);
+  hash_u64(&sha, (uint64_t)param->flags);
+  hash_u64(&sha, (uint64_t)(int64_t)param->purpose);
+  hash_u64(&sha, (uint64_t)(int64_t)param->trust);
+  hash_u64(&sha, (uint64_t)(int64_t)param->depth);
+  hash_u64(&sha, (uint64_t)(int64_t)(now / X509_VERIFY_CACHE_TIME_BUCKET));
+  SHA256_Final(out, &sha);
+  return 1;
+}
+
+static X509_VERIFY_CACHE_ENTRY **bucket_for(X509_VERIFY_CACHE *cache,
+                                            const uint8_t *key) {
+  /* The key is a SHA-256 digest, so any of its bytes are well distributed. */
+  size_t h = ((size_t)key[0] << 24) | ((size_t)key[1] << 16) |
+             ((size_t)key[2] << 8) | key[3];
+  return &cache->buckets[h & (cache->num_buckets - 1)];
+}
+
+static X509_VERIFY_CACHE_ENTRY *cache_find(X509_VERIFY_CACHE *cache,
+                                           const uint8_t *key) {
+  X509_VERIFY_CACHE_ENTRY *entry;
+  for (entry = *bucket_for(cache, key); entry != NULL;
+       entry = entry->hash_next) {
+    if (memcmp(entry->key, key, SHA256_DIGEST_LENGTH) == 0) {
+      return entry;
+    }
+  }
+  return NULL;
+}
+
+static void lru_unlink(X509_VERIFY_CACHE *cache,
+                       X509_VERIFY_CACHE_ENTRY *entry) {
+  if (entry->lru_prev != NULL) {
+    entry->lru_prev->lru_next = entry->lru_next;
+  } else {
+    cache->lru_head = entry->lru_next;
+  }
+  if (entry->lru_next != NULL) {
+    entry->lru_next->lru_prev = entry->lru_prev;
+  } else {
+    cache->lru_tail = entry->lru_prev;
+  }
+  entry->lru_prev = entry->lru_next = NULL;
+}
+
+static void lru_push_head(X509_VERIFY_CACHE *cache,
+                          X509_VERIFY_CACHE_ENTRY *entry) {
+  entry->lru_prev = NULL;
+  entry->lru_next = cache->lru_head;
+  if (cache->lru_head != NULL) {
+    cache->lru_head->lru_prev = entry;
+  } else {
+    cache->lru_tail = entry;
+  }
+  cache->lru_head = entry;
+}
+
+static void entry_free(X509_VERIFY_CACHE_ENTRY *entry) {
+  sk_X509_pop_free(entry->chain, X509_free);
+  OPENSSL_free(entry);
+}
+
+/* cache_remove unlinks |entry| from |cache| and frees it. */
+static void cache_remove(X509_VERIFY_CACHE *cache,
+                         X509_VERIFY_CACHE_ENTRY *entry) {
+  X509_VERIFY_CACHE_ENTRY **next = bucket_for(cache, entry->key);
+  while (*next != entry) {
+    next = &(*next)->hash_next;
+  }
+  *next = entry->hash_next;
+  lru_unlink(cache, entry);
+  cache->num_entries--;
+  entry_free(entry);
+}
+
+static void cache_flush_locked(X509_VERIFY_CACHE *cache) {
+  while (cache->lru_tail != NULL) {
+    cache_remove(cache, cache->lru_tail);
+  }
+}
+
+static X509_VERIFY_CACHE *verify_cache_new(size_t max_entries) {
+  X509_VERIFY_CACHE *cache = OPENSSL_malloc(sizeof(X509_VERIFY_CACHE));
+  if (cache == NULL) {
+    return NULL;
+  }
+  memset(cache, 0, sizeof(X509_VERIFY_CACHE));
+
+  cache->max_entries = max_entries;
+  cache->num_buckets = 16;
+  while (cache->num_buckets < max_entries &&
+         cache->num_buckets < kMaxBuckets) {
+    cache->num_buckets <<= 1;
+  }
+  cache->buckets =
+      OPENSSL_malloc(cache->num_buckets * sizeof(X509_VERIFY_CACHE_ENTRY *));
+  if (cache->buckets == NULL) {
+    OPENSSL_free(cache);
+    return NULL;
+  }
+  memset(cache->buckets, 0,
+         cache->num_buckets * sizeof(X509_VERIFY_CACHE_ENTRY *));
+  CRYPTO_MUTEX_init(&cache->lock);
+  return cache;
+}
+
+void x509_verify_cache_free(X509_VERIFY_CACHE *cache) {
+  if (cache == NULL) {
+    return;
+  }
+  cache_flush_locked(cache);
+  CRYPTO_MUTEX_cleanup(&cache->lock);
+  OPENSSL_free(cache->buckets);
+  OPENSSL_free(cache);
+}
+
+int x509_verify_cache_get(X509_STORE *store,
+                          const uint8_t key[SHA256_DIGEST_LENGTH],
+                          STACK_OF(X509) *chain, int *out_last_untrusted) {
+  X509_VERIFY_CACHE *cache = store->verify_cache;
+  size_t num = sk_X509_num(chain);
+  size_t i;
+
+  CRYPTO_MUTEX_lock_write(&cache->lock);
+  X509_VERIFY_CACHE_ENTRY *entry = cache_find(cache, key);
+  if (entry == NULL) {
+    goto miss;
+  }
+  for (i = 0; i < sk_X509_num(entry->chain); i++) {
+    X509 *x509 = sk_X509_value(entry->chain, i);
+    if (!sk_X509_push(chain, x509)) {
+      goto miss;
+    }
+    X509_up_ref(x509);
+  }
+  lru_unlink(cache, entry);
+  lru_push_head(cache, entry);
+  cache->hits++;
+  *out_last_untrusted = entry->last_untrusted;
+  CRYPTO_MUTEX_unlock(&cache->lock);
+  return 1;
+
+miss:
+  cache->misses++;
+  CRYPTO_MUTEX_unlock(&cache->lock);
+  while (sk_X509_num(chain) > num) {
+    X509_free(sk_X509_pop(chain));
+  }
+  return 0;
+}
+
+void x509_verify_cache_add(X509_STORE *store,
+                           const uint8_t key[SHA256_DIGEST_LENGTH],
+                           STACK_OF(X509) *chain, int last_untrusted) {
+  X509_VERIFY_CACHE *cache = store->verify_cache;
+  size_t i;
+
+  X509_VERIFY_CACHE_ENTRY *entry =
+      OPENSSL_malloc(sizeof(X509_VERIFY_CACHE_ENTRY));
+  if (entry == NULL) {
+    return;
+  }
+  memset(entry, 0, sizeof(X509_VERIFY_CACHE_ENTRY));
+  memcpy(entry->key, key, SHA256_DIGEST_LENGTH);
+  entry->last_untrusted = last_untrusted;
+  entry->chain = sk_X509_new_null();
+  if (entry->chain == NULL) {
+    entry_free(entry);
+    return;
+  }
+  for (i = 1; i < sk_X509_num(chain); i++) {
+    X509 *x509 = sk_X509_value(chain, i);
+    if (!sk_X509_push(entry->chain, x509)) {
+      entry_free(entry);
+      return;
+    }
+    X509_up_ref(x509);
+  }
+
+  CRYPTO_MUTEX_lock_write(&cache->lock);
+  if (cache_find(cache, key) != NULL) {
+    /* Another thread verified the same chain concurrently. */
+    CRYPTO_MUTEX_unlock(&cache->lock);
+    entry_free(entry);
+    return;
+  }
+  while (cache->num_entries >= cache->max_entries) {
+    cache_remove(cache, cache->lru_tail);
+  }
+  X509_VERIFY_CACHE_ENTRY **bucket = bucket_for(cache, key);
+  entry->hash_next = *bucket;
+  *bucket = entry;
+  lru_push_head(cache, entry);
+  cache->num_entries++;
+  CRYPTO_MUTEX_unlock(&cache->lock);
+}
+
+int X509_STORE_set_verify_cache_size(X509_STORE *store, size_t max_entries) {
+  X509_VERIFY_CACHE *cache = NULL;
+  if (max_entries > 0) {
+    cache = verify_cache_new(max_entries);
+    if (cache == NULL) {
+      OPENSSL_PUT_ERROR(X509, ERR_R_MALLOC_FAILURE);
+      return 0;
+    }
+  }
+  x509_verify_cache_free(store->verify_cache);
+  store->verify_cache = cache;
+  return 1;
+}
+
+void X509_STORE_flush_verify_cache(X509_STORE *store) {
+  X509_VERIFY_CACHE *cache = store->verify_cache;
+  if (cache == NULL) {
+    return;
+  }
+  CRYPTO_MUTEX_lock_write(&cache->lock);
+  cache_flush_locked(cache);
+  CRYPTO_MUTEX_unlock(&cache->lock);
+}
+
+void X509_STORE_get_verify_cache_stats(X509_STORE *store, uint64_t *out_hits,
+                                       uint64_t *out_misses,
+                                       size_t *out_num_entries) {
+  X509_VERIFY_CACHE *cache = store->verify_cache;
+  uint64_t hits = 0, misses = 0;
+  size_t num_entries = 0;
+
+  if (cache != NULL) {
+    CRYPTO_MUTEX_lock_read(&cache->lock);
+    hits = cache->hits;
+    misses = cache->misses;
+    num_entries = cache->num_entries;
+    CRYPTO_MUTEX_unlock(&cache->lock);
+  }
+  if (out_hits != NULL) {
+    *out_hits = hits;
+  }
+  if (out_misses != NULL) {
+    *out_misses = misses;
+  }
+  if (out_num_entries != NULL) {
+    *out_num_entries = num_entries;
+  }
+}
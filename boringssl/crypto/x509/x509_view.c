@@ -0,0 +1,440 @@
+/* Copyright (c) 2016, Google Inc.
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY
+ * SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION
+ * OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF OR IN
+ * CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE. */
+
+#include <openssl/x509_view.h>
+
+#include <string.h>
+
+#include <openssl/bytestring.h>
+#include <openssl/digest.h>
+#include <openssl/err.h>
+#include <openssl/evp.h>
+#include <openssl/obj.h>
+#include <openssl/x509.h>
+#include <openssl/x509v3.h>
+
+#include "internal.h"
+#include "../x509v3/internal.h"
+
+
+/* kBasicConstraintsOID is 2.5.29.19. */
+static const uint8_t kBasicConstraintsOID[] = {0x55, 0x1d, 0x13};
+/* kKeyUsageOID is 2.5.29.15. */
+static const uint8_t kKeyUsageOID[] = {0x55, 0x1d, 0x0f};
+/* kSubjectAltNameOID is 2.5.29.17. */
+static const uint8_t kSubjectAltNameOID[] = {0x55, 0x1d, 0x11};
+/* kCommonNameOID is 2.5.4.3. */
+static const uint8_t kCommonNameOID[] = {0x55, 0x04, 0x03};
+
+/* kDNSNameTag is the tag of a dNSName GeneralName. */
+static const unsigned kDNSNameTag = CBS_ASN1_CONTEXT_SPECIFIC | 2;
+
+/* get_any_asn1 acts like |CBS_get_asn1| but accepts any tag and sets |*out_tag|
+ * to the one found. */
+static int get_any_asn1(CBS *cbs, CBS *out, unsigned *out_tag) {
+  size_t header_len;
+  return CBS_get_any_asn1_element(cbs, out, out_tag, &header_len) &&
+         CBS_skip(out, header_len);
+}
+
+/* parse_digits parses |len| decimal digits from |cbs| into |*out|. */
+static int parse_digits(CBS *cbs, size_t len, int *out) {
+  *out = 0;
+  for (size_t i = 0; i < len; i++) {
+    uint8_t c;
+    if (!CBS_get_u8(cbs, &c) || c < '0' || c > '9') {
+      return 0;
+    }
+    *out = *out * 10 + (c - '0');
+  }
+  return 1;
+}
+
+static int is_leap_year(int year) {
+  return (year % 4 == 0 && year % 100 != 0) || year % 400 == 0;
+}
+
+/* days_from_civil returns the number of days between 1970-01-01 and the given
+ * date in the proleptic Gregorian calendar. */
+static int64_t days_from_civil(int64_t year, int month, int day) {
+  if (month <= 2) {
+    year--;
+  }
+  int64_t era = (year >= 0 ? year : year - 399) / 400;
+  int64_t year_of_era = year - era * 400;
+  int64_t day_of_year = (153 * (month > 2 ? month - 3 : month + 9) + 2) / 5 +
+                        day - 1;
+  int64_t day_of_era = year_of_era * 365 + year_of_era / 4 -
+                       year_of_era / 100 + day_of_year;
+  return era * 146097 + day_of_era - 719468;
+}
+
+/* parse_time parses a Time, which must be a UTCTime or GeneralizedTime in the
+ * DER form of RFC 5280, section 4.1.2.5, from |cbs| and sets |*out| to the
+ * number of seconds since the POSIX epoch. */
+static int parse_time(CBS *cbs, int64_t *out) {
+  static const int kDaysInMonth[12] = {31, 28, 31, 30, 31, 30,
+                                       31, 31, 30, 31, 30, 31};
+  CBS time;
+  unsigned tag;
+  int year, month, day, hour, minute, second;
+  uint8_t zulu;
+  if (!get_any_asn1(cbs, &time, &tag)) {
+    return 0;
+  }
+  if (tag == CBS_ASN1_UTCTIME && CBS_len(&time) == 13) {
+    if (!parse_digits(&time, 2, &year)) {
+      return 0;
+    }
+    year += year >= 50 ? 1900 : 2000;
+  } else if (tag == CBS_ASN1_GENERALIZEDTIME && CBS_len(&time) == 15) {
+    if (!parse_digits(&time, 4, &year)) {
+      return 0;
+    }
+  } else {
+    return 0;
+  }
+  if (!parse_digits(&time, 2, &month) ||
+      !parse_digits(&time, 2, &day) ||
+      !parse_digits(&time, 2, &hour) ||
+      !parse_digits(&time, 2, &minute) ||
+      !parse_digits(&time, 2, &second) ||
+      !CBS_get_u8(&time, &zulu) ||
+      zulu != 'Z' ||
+      month < 1 || month > 12 ||
+      day < 1 ||
+      day > kDaysInMonth[month - 1] +
+                (month == 2 && is_leap_year(year) ? 1 : 0) ||
+      hour > 23 || minute > 59 || second > 59) {
+    return 0;
+  }
+  *out = days_from_civil(year, month, day) * 86400 + hour * 3600 +
+         minute * 60 + second;
+  return 1;
+}
+
+/* parse_bool parses a DER BOOLEAN from |cbs|. */
+static int parse_bool(CBS *cbs, int *out) {
+  CBS value;
+  uint8_t v;
+  if (!CBS_get_asn1(cbs, &value, CBS_ASN1_BOOLEAN) ||
+      !CBS_get_u8(&value, &v) ||
+      CBS_len(&value) != 0 ||
+      (v != 0x00 && v != 0xff)) {
+    return 0;
+  }
+  *out = v != 0;
+  return 1;
+}
+
+/* parse_optional_bool parses a BOOLEAN with a default of FALSE from |cbs|. */
+static int parse_optional_bool(CBS *cbs, int *out) {
+  if (!CBS_peek_asn1_tag(cbs, CBS_ASN1_BOOLEAN)) {
+    *out = 0;
+    return 1;
+  }
+  return parse_bool(cbs, out);
+}
+
+static int parse_basic_constraints(X509_VIEW *out, CBS *cbs) {
+  CBS seq;
+  if (!CBS_get_asn1(cbs, &seq, CBS_ASN1_SEQUENCE) ||
+      !parse_optional_bool(&seq, &out->is_ca)) {
+    return 0;
+  }
+  if (CBS_peek_asn1_tag(&seq, CBS_ASN1_INTEGER)) {
+    uint64_t path_len;
+    if (!CBS_get_asn1_uint64(&seq, &path_len) ||
+        path_len > INT64_MAX) {
+      return 0;
+    }
+    out->path_len = (int64_t)path_len;
+  }
+  return CBS_len(&seq) == 0;
+}
+
+static int parse_key_usage(X509_VIEW *out, CBS *cbs) {
+  CBS bits;
+  uint8_t unused, first = 0, second = 0;
+  if (!CBS_get_asn1(cbs, &bits, CBS_ASN1_BITSTRING) ||
+      !CBS_get_u8(&bits, &unused) ||
+      unused > 7 ||
+      (CBS_len(&bits) == 0 && unused != 0)) {
+    return 0;
+  }
+  /* Only the first nine bits are defined. The rest are ignored, as in
+   * |x509v3_cache_extensions|. */
+  if (CBS_len(&bits) > 0) {
+    first = CBS_data(&bits)[0];
+  }
+  if (CBS_len(&bits) > 1) {
+    second = CBS_data(&bits)[1];
+  }
+  out->has_key_usage = 1;
+  out->key_usage = first | ((uint16_t)second << 8);
+  return 1;
+}
+
+static int parse_extensions(X509_VIEW *out, CBS *cbs) {
+  int has_basic_constraints = 0, has_subject_alt_name = 0;
+  CBS extensions;
+  if (!CBS_get_asn1(cbs, &extensions, CBS_ASN1_SEQUENCE)) {
+    return 0;
+  }
+  while (CBS_len(&extensions) > 0) {
+    CBS extension, oid, value;
+    int critical, ok;
+    if (!CBS_get_asn1(&extensions, &extension, CBS_ASN1_SEQUENCE) ||
+        !CBS_get_asn1(&extension, &oid, CBS_ASN1_OBJECT) ||
+        !parse_optional_bool(&extension, &critical) ||
+        !CBS_get_asn1(&extension, &value, CBS_ASN1_OCTETSTRING) ||
+        CBS_len(&extension) != 0) {
+      return 0;
+    }
+
+    if (CBS_mem_equal(&oid, kBasicConstraintsOID,
+                      sizeof(kBasicConstraintsOID))) {
+      ok = !has_basic_constraints && parse_basic_constraints(out, &value);
+      has_basic_constraints = 1;
+    } else if (CBS_mem_equal(&oid, kKeyUsageOID, sizeof(kKeyUsageOID))) {
+      ok = !out->has_key_usage && parse_key_usage(out, &value);
+    } else if (CBS_mem_equal(&oid, kSubjectAltNameOID,
+                             sizeof(kSubjectAltNameOID))) {
+      ok = !has_subject_alt_name &&
+           CBS_get_asn1(&value, &out->subject_alt_names, CBS_ASN1_SEQUENCE);
+      has_subject_alt_name = 1;
+    } else {
+      if (critical) {
+        out->has_unhandled_critical_extension = 1;
+      }
+      continue;
+    }
+
+    if (!ok || CBS_len(&value) != 0) {
+      return 0;
+    }
+  }
+  return 1;
+}
+
+static int parse_tbs_certificate(X509_VIEW *out, CBS *cbs) {
+  CBS tbs, validity;
+  if (!CBS_get_asn1(cbs, &tbs, CBS_ASN1_SEQUENCE) ||
+      !CBS_get_optional_asn1_uint64(
+          &tbs, &out->version,
+          CBS_ASN1_CONSTRUCTED | CBS_ASN1_CONTEXT_SPECIFIC | 0, 0) ||
+      out->version > 2 ||
+      !CBS_get_asn1(&tbs, &out->serial_number, CBS_ASN1_INTEGER) ||
+      !CBS_get_asn1_element(&tbs, &out->signature_algorithm,
+                            CBS_ASN1_SEQUENCE) ||
+      !CBS_get_asn1_element(&tbs, &out->issuer, CBS_ASN1_SEQUENCE) ||
+      !CBS_get_asn1(&tbs, &validity, CBS_ASN1_SEQUENCE) ||
+      !parse_time(&validity, &out->not_before) ||
+      !parse_time(&validity, &out->not_after) ||
+      CBS_len(&validity) != 0 ||
+      !CBS_get_asn1_element(&tbs, &out->subject, CBS_ASN1_SEQUENCE) ||
+      !CBS_get_asn1_element(&tbs, &out->spki, CBS_ASN1_SEQUENCE)) {
+    return 0;
+  }
+
+  /* The issuerUniqueID and subjectUniqueID fields are skipped. */
+  if (!CBS_get_optional_asn1(&tbs, NULL, NULL,
+                             CBS_ASN1_CONTEXT_SPECIFIC | 1) ||
+      !CBS_get_optional_asn1(&tbs, NULL, NULL,
+                             CBS_ASN1_CONTEXT_SPECIFIC | 2)) {
+    return 0;
+  }
+
+  int has_extensions;
+  CBS extensions;
+  if (!CBS_get_optional_asn1(
+          &tbs, &extensions, &has_extensions,
+          CBS_ASN1_CONSTRUCTED | CBS_ASN1_CONTEXT_SPECIFIC | 3) ||
+      (has_extensions &&
+       (!parse_extensions(out, &extensions) || CBS_len(&extensions) != 0))) {
+    return 0;
+  }
+
+  return CBS_len(&tbs) == 0;
+}
+
+int X509_VIEW_parse(X509_VIEW *out, CBS *cbs) {
+  memset(out, 0, sizeof(X509_VIEW));
+  out->path_len = -1;
+
+  CBS copy = *cbs, certificate, signature_algorithm;
+  uint8_t unused_bits;
+  if (!CBS_get_asn1(&copy, &certificate, CBS_ASN1_SEQUENCE) ||
+      !CBS_get_asn1_element(&certificate, &out->tbs_certificate,
+                            CBS_ASN1_SEQUENCE)) {
+    OPENSSL_PUT_ERROR(X509, X509_R_INVALID_CERTIFICATE);
+    return 0;
+  }
+
+  CBS tbs = out->tbs_certificate;
+  if (!parse_tbs_certificate(out, &tbs) ||
+      !CBS_get_asn1_element(&certificate, &signature_algorithm,
+                            CBS_ASN1_SEQUENCE) ||
+      /* The two copies of the signature algorithm must match. See RFC 5280,
+       * section 4.1.1.2. */
+      !CBS_mem_equal(&signature_algorithm,
+                     CBS_data(&out->signature_algorithm),
+                     CBS_len(&out->signature_algorithm)) ||
+      !CBS_get_asn1(&certificate, &out->signature, CBS_ASN1_BITSTRING) ||
+      !CBS_get_u8(&out->signature, &unused_bits) ||
+      unused_bits != 0 ||
+      CBS_len(&certificate) != 0) {
+    OPENSSL_PUT_ERROR(X509, X509_R_INVALID_CERTIFICATE);
+    return 0;
+  }
+
+  *cbs = copy;
+  return 1;
+}
+
+EVP_PKEY *X509_VIEW_get_pubkey(const X509_VIEW *view) {
+  CBS spki = view->spki;
+  return EVP_parse_public_key(&spki);
+}
+
+/* verify_init sets up |ctx| to verify a signature by |pkey| with the algorithm
+ * |sigalg|, a DER-encoded AlgorithmIdentifier. Unlike
+ * |x509_digest_verify_init|, it only allocates for RSA-PSS parameters. */
+static int verify_init(EVP_MD_CTX *ctx, const CBS *sigalg, EVP_PKEY *pkey) {
+  CBS copy = *sigalg, algorithm, oid;
+  if (!CBS_get_asn1(&copy, &algorithm, CBS_ASN1_SEQUENCE) ||
+      !CBS_get_asn1(&algorithm, &oid, CBS_ASN1_OBJECT)) {
+    OPENSSL_PUT_ERROR(X509, X509_R_INVALID_CERTIFICATE);
+    return 0;
+  }
+
+  int sigalg_nid = OBJ_cbs2nid(&oid);
+  int digest_nid, pkey_nid;
+  if (!OBJ_find_sigid_algs(sigalg_nid, &digest_nid, &pkey_nid)) {
+    OPENSSL_PUT_ERROR(ASN1, ASN1_R_UNKNOWN_SIGNATURE_ALGORITHM);
+    return 0;
+  }
+
+  if (digest_nid == NID_undef) {
+    /* Algorithms with custom parameters go through the |X509_ALGOR| path. */
+    const uint8_t *der = CBS_data(sigalg);
+    X509_ALGOR *algor = d2i_X509_ALGOR(NULL, &der, CBS_len(sigalg));
+    if (algor == NULL) {
+      return 0;
+    }
+    int ret = x509_digest_verify_init(ctx, algor, pkey);
+    X509_ALGOR_free(algor);
+    return ret;
+  }
+
+  if (pkey_nid != EVP_PKEY_id(pkey)) {
+    OPENSSL_PUT_ERROR(ASN1, ASN1_R_WRONG_PUBLIC_KEY_TYPE);
+    return 0;
+  }
+
+  const EVP_MD *digest = EVP_get_digestbynid(digest_nid);
+  if (digest == NULL) {
+    OPENSSL_PUT_ERROR(ASN1, ASN1_R_UNKNOWN_MESSAGE_DIGEST_ALGORITHM);
+    return 0;
+  }
+
+  return EVP_DigestVerifyInit(ctx, NULL, digest, NULL, pkey);
+}
+
+int X509_VIEW_verify_signature(const X509_VIEW *view, EVP_PKEY *pkey) {
+  EVP_MD_CTX ctx;
+  EVP_MD_CTX_init(&ctx);
+  int ret =
+      verify_init(&ctx, &view->signature_algorithm, pkey) &&
+      EVP_DigestVerifyUpdate(&ctx, CBS_data(&view->tbs_certificate),
+                             CBS_len(&view->tbs_certificate)) &&
+      EVP_DigestVerifyFinal(&ctx, CBS_data(&view->signature),
+                            CBS_len(&view->signature));
+  EVP_MD_CTX_cleanup(&ctx);
+  return ret;
+}
+
+int X509_VIEW_check_time(const X509_VIEW *view, time_t t) {
+  return view->not_before <= (int64_t)t && (int64_t)t <= view->not_after;
+}
+
+/* check_common_names returns one if a common name in |subject|, a
+ * DER-encoded Name, matches |host|, zero if none do and -1 on error. */
+static int check_common_names(const CBS *subject, const char *host,
+                              size_t host_len, unsigned flags) {
+  CBS name = *subject, rdns;
+  if (!CBS_get_asn1(&name, &rdns, CBS_ASN1_SEQUENCE)) {
+    return -1;
+  }
+  while (CBS_len(&rdns) > 0) {
+    CBS rdn;
+    if (!CBS_get_asn1(&rdns, &rdn, CBS_ASN1_SET)) {
+      return -1;
+    }
+    while (CBS_len(&rdn) > 0) {
+      CBS attribute, type, value;
+      unsigned tag;
+      if (!CBS_get_asn1(&rdn, &attribute, CBS_ASN1_SEQUENCE) ||
+          !CBS_get_asn1(&attribute, &type, CBS_ASN1_OBJECT) ||
+          !get_any_asn1(&attribute, &value, &tag)) {
+        return -1;
+      }
+      if (!CBS_mem_equal(&type, kCommonNameOID, sizeof(kCommonNameOID)) ||
+          (tag != CBS_ASN1_UTF8STRING && tag != CBS_ASN1_PRINTABLESTRING &&
+           tag != CBS_ASN1_IA5STRING)) {
+        continue;
+      }
+      if (x509v3_dns_name_matches(CBS_data(&value), CBS_len(&value), host,
+                                  host_len, flags)) {
+        return 1;
+      }
+    }
+  }
+  return 0;
+}
+
+int X509_VIEW_check_host(const X509_VIEW *view, const char *host,
+                         size_t host_len, unsigned flags) {
+  if (host == NULL) {
+    return -2;
+  }
+  if (host_len == 0) {
+    host_len = strlen(host);
+  } else if (memchr(host, '\0', host_len) != NULL) {
+    return -2;
+  }
+
+  int has_dns_name = 0;
+  CBS names = view->subject_alt_names;
+  while (CBS_len(&names) > 0) {
+    CBS name;
+    unsigned tag;
+    if (!get_any_asn1(&names, &name, &tag)) {
+      return -1;
+    }
+    if (tag != kDNSNameTag) {
+      continue;
+    }
+    has_dns_name = 1;
+    if (x509v3_dns_name_matches(CBS_data(&name), CBS_len(&name), host,
+                                host_len, flags)) {
+      return 1;
+    }
+  }
+
+  if (has_dns_name && !(flags & X509_CHECK_FLAG_ALWAYS_CHECK_SUBJECT)) {
+    return 0;
+  }
+  return check_common_names(&view->subject, host, host_len, flags);
+}
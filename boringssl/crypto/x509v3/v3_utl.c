@@ -71,6 +71,7 @@
 #include <openssl/x509v3.h>
 
 #include "../conf/internal.h"
+#include "internal.h"
 
 static char *strip_spaces(char *name);
 static int sk_strcmp(const OPENSSL_STRING *a, const OPENSSL_STRING *b);
@@ -927,6 +928,31 @@ static int do_check_string(ASN1_STRING *a, int cmp_type, equal_fn equal,
     return rv;
 }
 
+int x509v3_dns_name_matches(const uint8_t *name, size_t name_len,
+                            const char *host, size_t host_len,
+                            unsigned flags)
+{
+    if (name_len == 0)
+        return 0;
+    /* Implicit client-side DNS sub-domain pattern (internal-only flag) */
+    flags &= ~_X509_CHECK_FLAG_DOT_SUBDOMAINS;
+    if (host_len > 1 && host[0] == '.')
+        flags |= _X509_CHECK_FLAG_DOT_SUBDOMAINS;
+    if (flags & X509_CHECK_FLAG_NO_WILDCARDS)
+        return equal_nocase(name, name_len, (const unsigned char *)host,
+                            host_len, flags);
+    return equal_wildcard(name, name_len, (const unsigned char *)host,
+                          host_len, flags);
+}
+
+static int equal_dns_name(const unsigned char *pattern, size_t pattern_len,
+                          const unsigned char *subject, size_t subject_len,
+                          unsigned int flags)
+{
+    return x509v3_dns_name_matches(pattern, pattern_len,
+                                   (const char *)subject, subject_len, flags);
+}
+
 static int do_x509_check(X509 *x, const char *chk, size_t chklen,
                          unsigned int flags, int check_type, char **peername)
 {
@@ -940,22 +966,14 @@ static int do_x509_check(X509 *x, const char *chk, size_t chklen,
     int rv = 0;
     equal_fn equal;
 
-    /* See below, this flag is internal-only */
-    flags &= ~_X509_CHECK_FLAG_DOT_SUBDOMAINS;
     if (check_type == GEN_EMAIL) {
         cnid = NID_pkcs9_emailAddress;
         alt_type = V_ASN1_IA5STRING;
         equal = equal_email;
     } else if (check_type == GEN_DNS) {
         cnid = NID_commonName;
-        /* Implicit client-side DNS sub-domain pattern */
-        if (chklen > 1 && chk[0] == '.')
-            flags |= _X509_CHECK_FLAG_DOT_SUBDOMAINS;
         alt_type = V_ASN1_IA5STRING;
-        if (flags & X509_CHECK_FLAG_NO_WILDCARDS)
-            equal = equal_nocase;
-        else
-            equal = equal_wildcard;
+        equal = equal_dns_name;
     } else {
         alt_type = V_ASN1_OCTET_STRING;
         equal = equal_case;
@@ -262,6 +262,7 @@ typedef struct x509_st X509;
 typedef struct x509_store_ctx_st X509_STORE_CTX;
 typedef struct x509_store_st X509_STORE;
 typedef struct x509_trust_st X509_TRUST;
+typedef struct x509_view_st X509_VIEW;
 
 typedef void *OPENSSL_BLOCK;
 
@@ -322,6 +322,17 @@ OPENSSL_EXPORT int SSL_read(SSL *ssl, void *buf, int num);
 /* SSL_peek behaves like |SSL_read| but does not consume any bytes returned. */
 OPENSSL_EXPORT int SSL_peek(SSL *ssl, void *buf, int num);
 
+/* SSL_read_in_place behaves like |SSL_read| but, rather than copying, sets
+ * |*out_data| to the decrypted plaintext in |ssl|'s read buffer. On success, it
+ * returns the number of bytes available at |*out_data|, which is the remainder
+ * of the current record, and consumes them. Otherwise, it returns <= 0 and the
+ * caller should pass the value into |SSL_get_error| as with |SSL_read|.
+ *
+ * The bytes at |*out_data| remain valid until the next operation on |ssl| which
+ * may read from the transport (such as |SSL_read|, |SSL_read_in_place|,
+ * |SSL_do_handshake| or |SSL_shutdown|), or until |ssl| is freed. */
+OPENSSL_EXPORT int SSL_read_in_place(SSL *ssl, const uint8_t **out_data);
+
 /* SSL_pending returns the number of bytes available in |ssl|. It does not read
  * from the transport. */
 OPENSSL_EXPORT int SSL_pending(const SSL *ssl);
@@ -354,6 +365,35 @@ OPENSSL_EXPORT int SSL_pending(const SSL *ssl);
  * https://crbug.com/466303. */
 OPENSSL_EXPORT int SSL_write(SSL *ssl, const void *buf, int num);
 
+/* SSL_max_seal_overhead returns the maximum number of bytes |SSL_seal_record|
+ * adds to a record's plaintext with |ssl|'s current write state. */
+OPENSSL_EXPORT size_t SSL_max_seal_overhead(const SSL *ssl);
+
+/* SSL_seal_prefix_len returns the number of bytes |SSL_seal_record| writes
+ * before the ciphertext of a large record with |ssl|'s current write state.
+ * Plaintext placed this far into the output buffer is sealed in place. */
+OPENSSL_EXPORT size_t SSL_seal_prefix_len(const SSL *ssl);
+
+/* SSL_seal_record seals |in_len| bytes from |in| as a single application data
+ * record and writes it to |out|, which has room for |max_out| bytes. On success,
+ * it sets |*out_len| to the number of bytes written and returns one. Otherwise,
+ * it returns zero. At most |in_len| + |SSL_max_seal_overhead| bytes are
+ * written and |in_len| must be at most |SSL3_RT_MAX_PLAIN_LENGTH|, or the
+ * limit configured with |SSL_set_max_send_fragment|.
+ *
+ * |in| and |out| may alias only if |in| is at least |SSL_seal_prefix_len| bytes
+ * past |out|. Callers which build plaintext at |out| + |SSL_seal_prefix_len|
+ * avoid any copies.
+ *
+ * Unlike |SSL_write|, this function does not write to the transport. The caller
+ * must write the output, in order, before any other operation on |ssl| which
+ * writes to the transport. It may only be called once the handshake has
+ * completed (or in False Start) and while |ssl| has no buffered output, such as
+ * a pending |SSL_write| or alert. */
+OPENSSL_EXPORT int SSL_seal_record(SSL *ssl, uint8_t *out, size_t *out_len,
+                                   size_t max_out, const uint8_t *in,
+                                   size_t in_len);
+
 /* SSL_shutdown shuts down |ssl|. On success, it completes in two stages. First,
  * it returns 0 if |ssl| completed uni-directional shutdown; close_notify has
  * been sent, but the peer's close_notify has not been received. Most callers
@@ -1639,7 +1679,26 @@ OPENSSL_EXPORT unsigned long SSL_CTX_sess_set_cache_size(SSL_CTX *ctx,
  * session cache. */
 OPENSSL_EXPORT unsigned long SSL_CTX_sess_get_cache_size(const SSL_CTX *ctx);
 
-/* SSL_CTX_sessions returns |ctx|'s internal session cache. */
+/* SSL_CTX_set_session_cache_shards splits |ctx|'s internal session cache into
+ * |num_shards| shards and returns one. Each shard has its own lock and holds
+ * the sessions whose IDs map to it, so threads which look up or add different
+ * sessions rarely contend. It returns zero if |num_shards| is zero or on
+ * allocation failure.
+ *
+ * This function flushes the cache: on success, all sessions already in it are
+ * dropped. It must not be called while |ctx| is being used by another thread.
+ *
+ * The maximum cache size is divided between the shards, as evenly as possible
+ * and without exceeding it, and each shard evicts its own least recently added
+ * session when full. Eviction order across the whole cache is therefore only
+ * approximately least recently added. Each shard holds at least one session,
+ * so if the maximum is smaller than |num_shards|, the cache may hold up to
+ * |num_shards| sessions. By default, the cache has a single shard. */
+OPENSSL_EXPORT int SSL_CTX_set_session_cache_shards(SSL_CTX *ctx,
+                                                   size_t num_shards);
+
+/* SSL_CTX_sessions returns |ctx|'s internal session cache, or NULL if it is
+ * split into more than one shard. See |SSL_CTX_set_session_cache_shards|. */
 OPENSSL_EXPORT LHASH_OF(SSL_SESSION) *SSL_CTX_sessions(SSL_CTX *ctx);
 
 /* SSL_CTX_sess_number returns the number of sessions in |ctx|'s internal
@@ -3563,6 +3622,23 @@ struct ssl_cipher_preference_list_st {
   uint8_t *in_group_flags;
 };
 
+/* ssl_session_cache_shard_st is one shard of an |SSL_CTX|'s internal session
+ * cache. See |SSL_CTX_set_session_cache_shards|. */
+struct ssl_session_cache_shard_st {
+  /* lock protects the other fields of the shard. */
+  CRYPTO_MUTEX lock;
+  LHASH_OF(SSL_SESSION) *sessions;
+  /* head and tail are the most and least recently added sessions in
+   * |sessions|. The list is terminated at either end with the address of
+   * |head| or |tail|, cast to |SSL_SESSION|. */
+  SSL_SESSION *head;
+  SSL_SESSION *tail;
+  /* handshakes_since_flush is the number of successful handshakes with
+   * sessions in this shard since the shard was last flushed of expired
+   * sessions. */
+  int handshakes_since_flush;
+};
+
 /* ssl_ctx_st (aka |SSL_CTX|) contains configuration common to several SSL
  * connections. */
 struct ssl_ctx_st {
@@ -3599,16 +3675,14 @@ struct ssl_ctx_st {
   struct ssl_cipher_preference_list_st *cipher_list_tls11;
 
   X509_STORE *cert_store;
-  LHASH_OF(SSL_SESSION) *sessions;
+  /* session_cache_shards is the internal session cache, split into
+   * |num_session_cache_shards| shards. A session is stored in the shard
+   * selected by its session ID. */
+  struct ssl_session_cache_shard_st *session_cache_shards;
+  size_t num_session_cache_shards;
   /* Most session-ids that will be cached, default is
    * SSL_SESSION_CACHE_MAX_SIZE_DEFAULT. 0 is unlimited. */
   unsigned long session_cache_size;
-  SSL_SESSION *session_cache_head;
-  SSL_SESSION *session_cache_tail;
-
-  /* handshakes_since_cache_flush is the number of successful handshakes since
-   * the last cache flush. */
-  int handshakes_since_cache_flush;
 
   /* This can have one of 2 values, ored together,
    * SSL_SESS_CACHE_CLIENT,
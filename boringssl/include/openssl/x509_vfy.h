@@ -203,6 +203,10 @@ struct x509_store_st
 	STACK_OF(X509_CRL) * (*lookup_crls)(X509_STORE_CTX *ctx, X509_NAME *nm);
 	int (*cleanup)(X509_STORE_CTX *ctx);
 
+	/* Cache of successfully verified chains, see
+	 * |X509_STORE_set_verify_cache_size| */
+	struct x509_verify_cache_st *verify_cache;
+
 	CRYPTO_refcount_t references;
 	} /* X509_STORE */;
 
@@ -452,6 +456,43 @@ OPENSSL_EXPORT void X509_STORE_set_verify_cb(X509_STORE *ctx,
 OPENSSL_EXPORT void X509_STORE_set_lookup_crls_cb(X509_STORE *ctx,
 		STACK_OF(X509_CRL)* (*cb)(X509_STORE_CTX *ctx, X509_NAME *nm));
 
+/* X509_STORE_set_verify_cache_size enables a cache of chains that
+ * |X509_verify_cert| verified successfully against |store|, holding at most
+ * |max_entries| chains, or disables it if |max_entries| is zero. Any existing
+ * cache is discarded. It returns one on success and zero on allocation
+ * failure.
+ *
+ * Entries are keyed by the encoded leaf and untrusted certificates, the
+ * verification flags, purpose, trust and depth and the verification time,
+ * rounded to |X509_VERIFY_CACHE_TIME_BUCKET| seconds. A hit skips chain
+ * building and the signature checks; trust, purpose, name constraints,
+ * validity periods and the host, email and IP checks are still applied.
+ * Verifications using a verify callback, custom store callbacks, CRL checking
+ * or policy checking are never cached. Adding a certificate or CRL to |store|
+ * or changing its verification parameters flushes the cache.
+ *
+ * This function must not be called while |store| is used by another thread. */
+OPENSSL_EXPORT int X509_STORE_set_verify_cache_size(X509_STORE *store,
+						    size_t max_entries);
+
+/* X509_STORE_flush_verify_cache removes all entries from |store|'s verified
+ * chain cache, if any. */
+OPENSSL_EXPORT void X509_STORE_flush_verify_cache(X509_STORE *store);
+
+/* X509_STORE_get_verify_cache_stats sets |*out_hits| and |*out_misses| to the
+ * number of cacheable verifications against |store| that were, and were not,
+ * answered from its verified chain cache, and |*out_num_entries| to the number
+ * of cached chains. Any of the output pointers may be NULL. */
+OPENSSL_EXPORT void X509_STORE_get_verify_cache_stats(X509_STORE *store,
+						      uint64_t *out_hits,
+						      uint64_t *out_misses,
+						      size_t *out_num_entries);
+
+/* X509_VERIFY_CACHE_TIME_BUCKET is the granularity, in seconds, of the
+ * verification time in the keys of the verified chain cache. A cached chain is
+ * verified again at least this often. */
+#define X509_VERIFY_CACHE_TIME_BUCKET 3600
+
 OPENSSL_EXPORT X509_STORE_CTX *X509_STORE_CTX_new(void);
 
 OPENSSL_EXPORT int X509_STORE_CTX_get1_issuer(X509 **issuer, X509_STORE_CTX *ctx, X509 *x);
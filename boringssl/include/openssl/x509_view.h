@@ -0,0 +1,113 @@
+/* Copyright (c) 2016, Google Inc.
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY
+ * SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION
+ * OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF OR IN
+ * CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE. */
+
+#ifndef OPENSSL_HEADER_X509_VIEW_H
+#define OPENSSL_HEADER_X509_VIEW_H
+
+#include <openssl/base.h>
+
+#include <time.h>
+
+#include <openssl/bytestring.h>
+
+#if defined(__cplusplus)
+extern "C" {
+#endif
+
+
+/* Certificate views.
+ *
+ * An |X509_VIEW| is a read-only view of a DER-encoded X.509 certificate. It is
+ * an alternative to |d2i_X509| for callers that only need to build and verify
+ * a chain and check a host name: parsing allocates nothing and every field is
+ * a |CBS| pointing into the caller's buffer, which must outlive the view.
+ * Extensions other than basic constraints, key usage and subject alternative
+ * name are skipped. */
+
+struct x509_view_st {
+  /* tbs_certificate is the TBSCertificate, including its header. These are the
+   * bytes covered by |signature|. */
+  CBS tbs_certificate;
+  /* version is the encoded version: zero for v1 through two for v3. */
+  uint64_t version;
+  /* serial_number is the contents of the serialNumber INTEGER. */
+  CBS serial_number;
+  /* signature_algorithm is the signature AlgorithmIdentifier, including its
+   * header. */
+  CBS signature_algorithm;
+  /* issuer and subject are the issuer and subject Names, including their
+   * headers. */
+  CBS issuer;
+  CBS subject;
+  /* not_before and not_after are the bounds of the validity period, in
+   * seconds since the POSIX epoch. */
+  int64_t not_before;
+  int64_t not_after;
+  /* spki is the SubjectPublicKeyInfo, including its header. */
+  CBS spki;
+  /* signature is the signature, without the BIT STRING's leading count of
+   * unused bits. */
+  CBS signature;
+
+  /* is_ca is one if the certificate has a basic constraints extension with
+   * the cA flag set and zero otherwise. */
+  int is_ca;
+  /* path_len is the pathLenConstraint of the basic constraints extension, or
+   * -1 if there is none. */
+  int64_t path_len;
+  /* has_key_usage is one if the certificate has a key usage extension, in
+   * which case |key_usage| holds its bits as |KU_*| values. */
+  int has_key_usage;
+  uint16_t key_usage;
+  /* subject_alt_names is the contents of the GeneralNames SEQUENCE of the
+   * subject alternative name extension, or empty if there is none. */
+  CBS subject_alt_names;
+  /* has_unhandled_critical_extension is one if the certificate has a critical
+   * extension other than the three above. Verifiers must reject such
+   * certificates or process the extension themselves. */
+  int has_unhandled_critical_extension;
+};
+
+/* X509_VIEW_parse parses a DER-encoded Certificate from |cbs| into |out| and
+ * advances |cbs| past it. It returns one on success and zero on error. */
+OPENSSL_EXPORT int X509_VIEW_parse(X509_VIEW *out, CBS *cbs);
+
+/* X509_VIEW_get_pubkey parses the public key of |view|. It returns a newly
+ * allocated |EVP_PKEY| or NULL on error. */
+OPENSSL_EXPORT EVP_PKEY *X509_VIEW_get_pubkey(const X509_VIEW *view);
+
+/* X509_VIEW_verify_signature checks that the signature of |view| was made by
+ * |pkey| over its TBSCertificate. It returns one if the signature is valid and
+ * zero otherwise. */
+OPENSSL_EXPORT int X509_VIEW_verify_signature(const X509_VIEW *view,
+                                              EVP_PKEY *pkey);
+
+/* X509_VIEW_check_time returns one if |t| falls within the validity period of
+ * |view| and zero otherwise. */
+OPENSSL_EXPORT int X509_VIEW_check_time(const X509_VIEW *view, time_t t);
+
+/* X509_VIEW_check_host behaves like |X509_check_host|, with the same |flags|,
+ * but does not return the matched name. If |host_len| is zero, |host| is
+ * taken to be NUL-terminated. Unlike |X509_check_host|, it only matches common
+ * names encoded as a UTF8String, PrintableString or IA5String. */
+OPENSSL_EXPORT int X509_VIEW_check_host(const X509_VIEW *view,
+                                        const char *host, size_t host_len,
+                                        unsigned flags);
+
+
+#if defined(__cplusplus)
+}  /* extern C */
+#endif
+
+#endif  /* OPENSSL_HEADER_X509_VIEW_H */
@@ -406,10 +406,7 @@ enum ssl_open_record_t dtls_open_record(
 size_t ssl_seal_prefix_len(const SSL *ssl);
 
 /* ssl_max_seal_overhead returns the maximum overhead of sealing a record with
- * |ssl|. This includes |ssl_seal_prefix_len|.
- *
- * TODO(davidben): Expose this as part of public API once the high-level
- * buffer-free APIs are available. */
+ * |ssl|. This includes |ssl_seal_prefix_len|. */
 size_t ssl_max_seal_overhead(const SSL *ssl);
 
 /* tls_seal_record seals a new record of type |type| and body |in| and writes it
@@ -987,6 +984,20 @@ enum ssl_session_result_t ssl_get_prev_session(
     SSL *ssl, SSL_SESSION **out_session, int *out_send_ticket,
     const struct ssl_early_callback_ctx *ctx);
 
+typedef struct ssl_session_cache_shard_st SSL_SESSION_CACHE_SHARD;
+
+/* ssl_session_cache_shard returns the shard of |ctx|'s internal session cache
+ * which holds sessions with ID |session_id|. */
+SSL_SESSION_CACHE_SHARD *ssl_session_cache_shard(const SSL_CTX *ctx,
+                                                 const uint8_t *session_id,
+                                                 size_t session_id_len);
+
+/* ssl_flush_session_cache_shard removes all sessions from |shard| of |ctx|'s
+ * internal session cache which have expired as of time |time|. If |time| is
+ * zero, all sessions in |shard| are removed. */
+void ssl_flush_session_cache_shard(SSL_CTX *ctx, SSL_SESSION_CACHE_SHARD *shard,
+                                   long time);
+
 STACK_OF(SSL_CIPHER) *ssl_bytes_to_cipher_list(SSL *ssl, const CBS *cbs);
 void ssl_cipher_preference_list_free(
     struct ssl_cipher_preference_list_st *cipher_list);
@@ -215,6 +215,43 @@ static int ssl_session_cmp(const SSL_SESSION *a, const SSL_SESSION *b) {
   return memcmp(a->session_id, b->session_id, a->session_id_length);
 }
 
+static void session_cache_shards_free(SSL_SESSION_CACHE_SHARD *shards,
+                                      size_t num_shards) {
+  if (shards == NULL) {
+    return;
+  }
+  for (size_t i = 0; i < num_shards; i++) {
+    CRYPTO_MUTEX_cleanup(&shards[i].lock);
+    lh_SSL_SESSION_free(shards[i].sessions);
+  }
+  OPENSSL_free(shards);
+}
+
+static SSL_SESSION_CACHE_SHARD *session_cache_shards_new(size_t num_shards) {
+  if (num_shards > SIZE_MAX / sizeof(SSL_SESSION_CACHE_SHARD)) {
+    OPENSSL_PUT_ERROR(SSL, ERR_R_OVERFLOW);
+    return NULL;
+  }
+  SSL_SESSION_CACHE_SHARD *shards =
+      OPENSSL_malloc(num_shards * sizeof(SSL_SESSION_CACHE_SHARD));
+  if (shards == NULL) {
+    OPENSSL_PUT_ERROR(SSL, ERR_R_MALLOC_FAILURE);
+    return NULL;
+  }
+  memset(shards, 0, num_shards * sizeof(SSL_SESSION_CACHE_SHARD));
+  for (size_t i = 0; i < num_shards; i++) {
+    CRYPTO_MUTEX_init(&shards[i].lock);
+  }
+  for (size_t i = 0; i < num_shards; i++) {
+    shards[i].sessions = lh_SSL_SESSION_new(ssl_session_hash, ssl_session_cmp);
+    if (shards[i].sessions == NULL) {
+      session_cache_shards_free(shards, num_shards);
+      return NULL;
+    }
+  }
+  return shards;
+}
+
 SSL_CTX *SSL_CTX_new(const SSL_METHOD *method) {
   SSL_CTX *ret = NULL;
 
@@ -254,10 +291,11 @@ SSL_CTX *SSL_CTX_new(const SSL_METHOD *method) {
     goto err;
   }
 
-  ret->sessions = lh_SSL_SESSION_new(ssl_session_hash, ssl_session_cmp);
-  if (ret->sessions == NULL) {
+  ret->session_cache_shards = session_cache_shards_new(1);
+  if (ret->session_cache_shards == NULL) {
     goto err;
   }
+  ret->num_session_cache_shards = 1;
   ret->cert_store = X509_STORE_new();
   if (ret->cert_store == NULL) {
     goto err;
@@ -327,7 +365,8 @@ void SSL_CTX_free(SSL_CTX *ctx) {
   CRYPTO_free_ex_data(&g_ex_data_class_ssl_ctx, ctx, &ctx->ex_data);
 
   CRYPTO_MUTEX_cleanup(&ctx->lock);
-  lh_SSL_SESSION_free(ctx->sessions);
+  session_cache_shards_free(ctx->session_cache_shards,
+                            ctx->num_session_cache_shards);
   X509_STORE_free(ctx->cert_store);
   ssl_cipher_preference_list_free(ctx->cipher_list);
   sk_SSL_CIPHER_free(ctx->cipher_list_by_id);
@@ -625,6 +664,25 @@ int SSL_peek(SSL *ssl, void *buf, int num) {
   return ssl_read_impl(ssl, buf, num, 1 /* peek */);
 }
 
+int SSL_read_in_place(SSL *ssl, const uint8_t **out_data) {
+  /* Peeking zero bytes processes records until application data is available
+   * without copying it out. */
+  int ret = ssl_read_impl(ssl, NULL, 0, 1 /* peek */);
+  SSL3_RECORD *rr = &ssl->s3->rrec;
+  if (ret != 0 || (ssl->shutdown & SSL_RECEIVED_SHUTDOWN) ||
+      rr->type != SSL3_RT_APPLICATION_DATA || rr->length == 0) {
+    return ret;
+  }
+
+  /* Consume the remainder of the record, but leave the read buffer in place.
+   * |ssl_read_buffer_extend_to| releases it when the next record is read. */
+  *out_data = rr->data;
+  ret = rr->length;
+  rr->data += rr->length;
+  rr->length = 0;
+  return ret;
+}
+
 int SSL_write(SSL *ssl, const void *buf, int num) {
   /* Functions which use SSL_get_error must clear the error queue on entry. */
   ERR_clear_error();
@@ -656,6 +714,48 @@ int SSL_write(SSL *ssl, const void *buf, int num) {
   return ssl->method->ssl_write_app_data(ssl, buf, num);
 }
 
+size_t SSL_max_seal_overhead(const SSL *ssl) {
+  return ssl_max_seal_overhead(ssl);
+}
+
+size_t SSL_seal_prefix_len(const SSL *ssl) {
+  return ssl_seal_prefix_len(ssl);
+}
+
+int SSL_seal_record(SSL *ssl, uint8_t *out, size_t *out_len, size_t max_out,
+                    const uint8_t *in, size_t in_len) {
+  if (ssl->handshake_func == NULL) {
+    OPENSSL_PUT_ERROR(SSL, SSL_R_UNINITIALIZED);
+    return 0;
+  }
+
+  if (ssl->shutdown & SSL_SENT_SHUTDOWN) {
+    OPENSSL_PUT_ERROR(SSL, SSL_R_PROTOCOL_IS_SHUTDOWN);
+    return 0;
+  }
+
+  /* The record must follow anything |ssl| has already queued for the
+   * transport, which the caller cannot order against. */
+  if ((SSL_in_init(ssl) && !SSL_in_false_start(ssl)) ||
+      ssl_write_buffer_is_pending(ssl) || ssl->s3->alert_dispatch) {
+    OPENSSL_PUT_ERROR(SSL, ERR_R_SHOULD_NOT_HAVE_BEEN_CALLED);
+    return 0;
+  }
+
+  if (in_len > ssl->max_send_fragment) {
+    OPENSSL_PUT_ERROR(SSL, SSL_R_DATA_LENGTH_TOO_LONG);
+    return 0;
+  }
+
+  if (SSL_IS_DTLS(ssl)) {
+    return dtls_seal_record(ssl, out, out_len, max_out,
+                            SSL3_RT_APPLICATION_DATA, in, in_len,
+                            dtls1_use_current_epoch);
+  }
+  return tls_seal_record(ssl, out, out_len, max_out, SSL3_RT_APPLICATION_DATA,
+                         in, in_len);
+}
+
 int SSL_shutdown(SSL *ssl) {
   /* Functions which use SSL_get_error must clear the error queue on entry. */
   ERR_clear_error();
@@ -1248,10 +1348,37 @@ int SSL_get_secure_renegotiation_support(const SSL *ssl) {
   return ssl->s3->send_connection_binding;
 }
 
-LHASH_OF(SSL_SESSION) *SSL_CTX_sessions(SSL_CTX *ctx) { return ctx->sessions; }
+int SSL_CTX_set_session_cache_shards(SSL_CTX *ctx, size_t num_shards) {
+  if (num_shards == 0) {
+    return 0;
+  }
+
+  SSL_SESSION_CACHE_SHARD *shards = session_cache_shards_new(num_shards);
+  if (shards == NULL) {
+    return 0;
+  }
+
+  SSL_CTX_flush_sessions(ctx, 0);
+  session_cache_shards_free(ctx->session_cache_shards,
+                            ctx->num_session_cache_shards);
+  ctx->session_cache_shards = shards;
+  ctx->num_session_cache_shards = num_shards;
+  return 1;
+}
+
+LHASH_OF(SSL_SESSION) *SSL_CTX_sessions(SSL_CTX *ctx) {
+  if (ctx->num_session_cache_shards != 1) {
+    return NULL;
+  }
+  return ctx->session_cache_shards[0].sessions;
+}
 
 size_t SSL_CTX_sess_number(const SSL_CTX *ctx) {
-  return lh_SSL_SESSION_num_items(ctx->sessions);
+  size_t ret = 0;
+  for (size_t i = 0; i < ctx->num_session_cache_shards; i++) {
+    ret += lh_SSL_SESSION_num_items(ctx->session_cache_shards[i].sessions);
+  }
+  return ret;
 }
 
 unsigned long SSL_CTX_sess_set_cache_size(SSL_CTX *ctx, unsigned long size) {
@@ -1788,18 +1915,21 @@ void ssl_update_cache(SSL *ssl, int mode) {
 
   if (use_internal_cache &&
       !(ctx->session_cache_mode & SSL_SESS_CACHE_NO_AUTO_CLEAR)) {
-    /* Automatically flush the internal session cache every 255 connections. */
+    /* Automatically flush each shard of the internal session cache every 255
+     * connections which use it. */
+    SSL_SESSION_CACHE_SHARD *shard = ssl_session_cache_shard(
+        ctx, ssl->session->session_id, ssl->session->session_id_length);
     int flush_cache = 0;
-    CRYPTO_MUTEX_lock_write(&ctx->lock);
-    ctx->handshakes_since_cache_flush++;
-    if (ctx->handshakes_since_cache_flush >= 255) {
+    CRYPTO_MUTEX_lock_write(&shard->lock);
+    shard->handshakes_since_flush++;
+    if (shard->handshakes_since_flush >= 255) {
       flush_cache = 1;
-      ctx->handshakes_since_cache_flush = 0;
+      shard->handshakes_since_flush = 0;
     }
-    CRYPTO_MUTEX_unlock(&ctx->lock);
+    CRYPTO_MUTEX_unlock(&shard->lock);
 
     if (flush_cache) {
-      SSL_CTX_flush_sessions(ctx, (unsigned long)time(NULL));
+      ssl_flush_session_cache_shard(ctx, shard, (unsigned long)time(NULL));
     }
   }
 }
@@ -155,9 +155,12 @@ static const char g_pending_session_magic = 0;
 static CRYPTO_EX_DATA_CLASS g_ex_data_class =
     CRYPTO_EX_DATA_CLASS_INIT_WITH_APP_DATA;
 
-static void SSL_SESSION_list_remove(SSL_CTX *ctx, SSL_SESSION *session);
-static void SSL_SESSION_list_add(SSL_CTX *ctx, SSL_SESSION *session);
-static int remove_session_lock(SSL_CTX *ctx, SSL_SESSION *session, int lock);
+static void SSL_SESSION_list_remove(SSL_SESSION_CACHE_SHARD *shard,
+                                    SSL_SESSION *session);
+static void SSL_SESSION_list_add(SSL_SESSION_CACHE_SHARD *shard,
+                                 SSL_SESSION *session);
+static int remove_session_lock(SSL_CTX *ctx, SSL_SESSION_CACHE_SHARD *shard,
+                               SSL_SESSION *session, int lock);
 
 SSL_SESSION *SSL_SESSION_new(void) {
   SSL_SESSION *session = OPENSSL_malloc(sizeof(SSL_SESSION));
@@ -377,13 +380,15 @@ static enum ssl_session_result_t ssl_lookup_session(
     data.session_id_length = session_id_len;
     memcpy(data.session_id, session_id, session_id_len);
 
-    CRYPTO_MUTEX_lock_read(&ssl->initial_ctx->lock);
-    session = lh_SSL_SESSION_retrieve(ssl->initial_ctx->sessions, &data);
+    SSL_SESSION_CACHE_SHARD *shard =
+        ssl_session_cache_shard(ssl->initial_ctx, session_id, session_id_len);
+    CRYPTO_MUTEX_lock_read(&shard->lock);
+    session = lh_SSL_SESSION_retrieve(shard->sessions, &data);
     if (session != NULL) {
       SSL_SESSION_up_ref(session);
     }
     /* TODO(davidben): This should probably move it to the front of the list. */
-    CRYPTO_MUTEX_unlock(&ssl->initial_ctx->lock);
+    CRYPTO_MUTEX_unlock(&shard->lock);
 
     if (session != NULL) {
       *out_session = session;
@@ -496,15 +501,35 @@ no_session:
   return ssl_session_success;
 }
 
+SSL_SESSION_CACHE_SHARD *ssl_session_cache_shard(const SSL_CTX *ctx,
+                                                 const uint8_t *session_id,
+                                                 size_t session_id_len) {
+  if (ctx->num_session_cache_shards == 1) {
+    return &ctx->session_cache_shards[0];
+  }
+
+  /* Session IDs are usually random, but hash all of it so that short or
+   * structured IDs still spread across shards. Each shard's hash table
+   * indexes by the first four bytes, so they alone must not pick the shard. */
+  uint32_t hash = 2166136261u;
+  for (size_t i = 0; i < session_id_len; i++) {
+    hash ^= session_id[i];
+    hash *= 16777619u;
+  }
+  return &ctx->session_cache_shards[hash % ctx->num_session_cache_shards];
+}
+
 int SSL_CTX_add_session(SSL_CTX *ctx, SSL_SESSION *session) {
   /* Although |session| is inserted into two structures (a doubly-linked list
    * and the hash table), |ctx| only takes one reference. */
   SSL_SESSION_up_ref(session);
 
+  SSL_SESSION_CACHE_SHARD *shard = ssl_session_cache_shard(
+      ctx, session->session_id, session->session_id_length);
   SSL_SESSION *old_session;
-  CRYPTO_MUTEX_lock_write(&ctx->lock);
-  if (!lh_SSL_SESSION_insert(ctx->sessions, &old_session, session)) {
-    CRYPTO_MUTEX_unlock(&ctx->lock);
+  CRYPTO_MUTEX_lock_write(&shard->lock);
+  if (!lh_SSL_SESSION_insert(shard->sessions, &old_session, session)) {
+    CRYPTO_MUTEX_unlock(&shard->lock);
     SSL_SESSION_free(session);
     return 0;
   }
@@ -512,53 +537,76 @@ int SSL_CTX_add_session(SSL_CTX *ctx, SSL_SESSION *session) {
   if (old_session != NULL) {
     if (old_session == session) {
       /* |session| was already in the cache. */
-      CRYPTO_MUTEX_unlock(&ctx->lock);
+      CRYPTO_MUTEX_unlock(&shard->lock);
       SSL_SESSION_free(old_session);
       return 0;
     }
 
     /* There was a session ID collision. |old_session| must be removed from
      * the linked list and released. */
-    SSL_SESSION_list_remove(ctx, old_session);
+    SSL_SESSION_list_remove(shard, old_session);
     SSL_SESSION_free(old_session);
   }
 
-  SSL_SESSION_list_add(ctx, session);
-
-  /* Enforce any cache size limits. */
-  if (SSL_CTX_sess_get_cache_size(ctx) > 0) {
-    while (SSL_CTX_sess_number(ctx) > SSL_CTX_sess_get_cache_size(ctx)) {
-      if (!remove_session_lock(ctx, ctx->session_cache_tail, 0)) {
+  SSL_SESSION_list_add(shard, session);
+
+  /* Enforce any cache size limits. The limit is divided between the shards,
+   * with the first |cache_size % num_shards| shards holding one more session
+   * than the others, so that the shard sizes add up to the limit. If the limit
+   * is smaller than the number of shards, every shard still holds one session,
+   * so the cache may exceed the limit by up to |num_shards - cache_size|
+   * sessions rather than evicting the session just added. */
+  unsigned long cache_size = SSL_CTX_sess_get_cache_size(ctx);
+  if (cache_size > 0) {
+    size_t num_shards = ctx->num_session_cache_shards;
+    size_t index = (size_t)(shard - ctx->session_cache_shards);
+    unsigned long shard_size = cache_size / num_shards;
+    if (index < cache_size % num_shards) {
+      shard_size++;
+    }
+    if (shard_size == 0) {
+      shard_size = 1;
+    }
+    while (lh_SSL_SESSION_num_items(shard->sessions) > shard_size) {
+      if (!remove_session_lock(ctx, shard, shard->tail, 0)) {
         break;
       }
     }
   }
 
-  CRYPTO_MUTEX_unlock(&ctx->lock);
+  CRYPTO_MUTEX_unlock(&shard->lock);
   return 1;
 }
 
 int SSL_CTX_remove_session(SSL_CTX *ctx, SSL_SESSION *session) {
-  return remove_session_lock(ctx, session, 1);
+  if (session == NULL) {
+    return 0;
+  }
+  return remove_session_lock(
+      ctx,
+      ssl_session_cache_shard(ctx, session->session_id,
+                              session->session_id_length),
+      session, 1);
 }
 
-static int remove_session_lock(SSL_CTX *ctx, SSL_SESSION *session, int lock) {
+static int remove_session_lock(SSL_CTX *ctx, SSL_SESSION_CACHE_SHARD *shard,
+                               SSL_SESSION *session, int lock) {
   int ret = 0;
 
   if (session != NULL && session->session_id_length != 0) {
     if (lock) {
-      CRYPTO_MUTEX_lock_write(&ctx->lock);
+      CRYPTO_MUTEX_lock_write(&shard->lock);
     }
-    SSL_SESSION *found_session = lh_SSL_SESSION_retrieve(ctx->sessions,
+    SSL_SESSION *found_session = lh_SSL_SESSION_retrieve(shard->sessions,
                                                          session);
     if (found_session == session) {
       ret = 1;
-      found_session = lh_SSL_SESSION_delete(ctx->sessions, session);
-      SSL_SESSION_list_remove(ctx, session);
+      found_session = lh_SSL_SESSION_delete(shard->sessions, session);
+      SSL_SESSION_list_remove(shard, session);
     }
 
     if (lock) {
-      CRYPTO_MUTEX_unlock(&ctx->lock);
+      CRYPTO_MUTEX_unlock(&shard->lock);
     }
 
     if (ret) {
@@ -608,8 +656,8 @@ long SSL_CTX_get_timeout(const SSL_CTX *ctx) {
 
 typedef struct timeout_param_st {
   SSL_CTX *ctx;
+  SSL_SESSION_CACHE_SHARD *shard;
   long time;
-  LHASH_OF(SSL_SESSION) *cache;
 } TIMEOUT_PARAM;
 
 static void timeout_doall_arg(SSL_SESSION *session, void *void_param) {
@@ -620,8 +668,8 @@ static void timeout_doall_arg(SSL_SESSION *session, void *void_param) {
     /* timeout */
     /* The reason we don't call SSL_CTX_remove_session() is to
      * save on locking overhead */
-    (void) lh_SSL_SESSION_delete(param->cache, session);
-    SSL_SESSION_list_remove(param->ctx, session);
+    (void) lh_SSL_SESSION_delete(param->shard->sessions, session);
+    SSL_SESSION_list_remove(param->shard, session);
     session->not_resumable = 1;
     if (param->ctx->remove_session_cb != NULL) {
       param->ctx->remove_session_cb(param->ctx, session);
@@ -630,18 +678,22 @@ static void timeout_doall_arg(SSL_SESSION *session, void *void_param) {
   }
 }
 
-void SSL_CTX_flush_sessions(SSL_CTX *ctx, long time) {
+void ssl_flush_session_cache_shard(SSL_CTX *ctx, SSL_SESSION_CACHE_SHARD *shard,
+                                   long time) {
   TIMEOUT_PARAM tp;
 
   tp.ctx = ctx;
-  tp.cache = ctx->sessions;
-  if (tp.cache == NULL) {
-    return;
-  }
+  tp.shard = shard;
   tp.time = time;
-  CRYPTO_MUTEX_lock_write(&ctx->lock);
-  lh_SSL_SESSION_doall_arg(tp.cache, timeout_doall_arg, &tp);
-  CRYPTO_MUTEX_unlock(&ctx->lock);
+  CRYPTO_MUTEX_lock_write(&shard->lock);
+  lh_SSL_SESSION_doall_arg(shard->sessions, timeout_doall_arg, &tp);
+  CRYPTO_MUTEX_unlock(&shard->lock);
+}
+
+void SSL_CTX_flush_sessions(SSL_CTX *ctx, long time) {
+  for (size_t i = 0; i < ctx->num_session_cache_shards; i++) {
+    ssl_flush_session_cache_shard(ctx, &ctx->session_cache_shards[i], time);
+  }
 }
 
 int ssl_clear_bad_session(SSL *ssl) {
@@ -654,27 +706,28 @@ int ssl_clear_bad_session(SSL *ssl) {
   return 0;
 }
 
-/* locked by SSL_CTX in the calling function */
-static void SSL_SESSION_list_remove(SSL_CTX *ctx, SSL_SESSION *session) {
+/* locked by the shard in the calling function */
+static void SSL_SESSION_list_remove(SSL_SESSION_CACHE_SHARD *shard,
+                                    SSL_SESSION *session) {
   if (session->next == NULL || session->prev == NULL) {
     return;
   }
 
-  if (session->next == (SSL_SESSION *)&ctx->session_cache_tail) {
+  if (session->next == (SSL_SESSION *)&shard->tail) {
     /* last element in list */
-    if (session->prev == (SSL_SESSION *)&ctx->session_cache_head) {
+    if (session->prev == (SSL_SESSION *)&shard->head) {
       /* only one element in list */
-      ctx->session_cache_head = NULL;
-      ctx->session_cache_tail = NULL;
+      shard->head = NULL;
+      shard->tail = NULL;
     } else {
-      ctx->session_cache_tail = session->prev;
-      session->prev->next = (SSL_SESSION *)&(ctx->session_cache_tail);
+      shard->tail = session->prev;
+      session->prev->next = (SSL_SESSION *)&(shard->tail);
     }
   } else {
-    if (session->prev == (SSL_SESSION *)&ctx->session_cache_head) {
+    if (session->prev == (SSL_SESSION *)&shard->head) {
       /* first element in list */
-      ctx->session_cache_head = session->next;
-      session->next->prev = (SSL_SESSION *)&(ctx->session_cache_head);
+      shard->head = session->next;
+      session->next->prev = (SSL_SESSION *)&(shard->head);
     } else { /* middle of list */
       session->next->prev = session->prev;
       session->prev->next = session->next;
@@ -683,21 +736,22 @@ static void SSL_SESSION_list_remove(SSL_CTX *ctx, SSL_SESSION *session) {
   session->prev = session->next = NULL;
 }
 
-static void SSL_SESSION_list_add(SSL_CTX *ctx, SSL_SESSION *session) {
+static void SSL_SESSION_list_add(SSL_SESSION_CACHE_SHARD *shard,
+                                 SSL_SESSION *session) {
   if (session->next != NULL && session->prev != NULL) {
-    SSL_SESSION_list_remove(ctx, session);
+    SSL_SESSION_list_remove(shard, session);
   }
 
-  if (ctx->session_cache_head == NULL) {
-    ctx->session_cache_head = session;
-    ctx->session_cache_tail = session;
-    session->prev = (SSL_SESSION *)&(ctx->session_cache_head);
-    session->next = (SSL_SESSION *)&(ctx->session_cache_tail);
+  if (shard->head == NULL) {
+    shard->head = session;
+    shard->tail = session;
+    session->prev = (SSL_SESSION *)&(shard->head);
+    session->next = (SSL_SESSION *)&(shard->tail);
   } else {
-    session->next = ctx->session_cache_head;
+    session->next = shard->head;
     session->next->prev = session;
-    session->prev = (SSL_SESSION *)&(ctx->session_cache_head);
-    ctx->session_cache_head = session;
+    session->prev = (SSL_SESSION *)&(shard->head);
+    shard->head = session;
   }
 }
 
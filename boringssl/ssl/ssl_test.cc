@@ -21,6 +21,11 @@
 #include <utility>
 #include <vector>
 
+#if !defined(OPENSSL_NO_THREADS)
+#include <chrono>
+#include <thread>
+#endif
+
 #include <openssl/base64.h>
 #include <openssl/bio.h>
 #include <openssl/crypto.h>
@@ -855,14 +860,17 @@ static void AppendSession(SSL_SESSION *session, void *arg) {
 static bool ExpectCache(SSL_CTX *ctx,
                         const std::vector<SSL_SESSION*> &expected) {
   // Check the linked list.
-  SSL_SESSION *ptr = ctx->session_cache_head;
+  if (ctx->num_session_cache_shards != 1) {
+    return false;
+  }
+  struct ssl_session_cache_shard_st *shard = &ctx->session_cache_shards[0];
+  SSL_SESSION *ptr = shard->head;
   for (SSL_SESSION *session : expected) {
     if (ptr != session) {
       return false;
     }
     // TODO(davidben): This is an absurd way to denote the end of the list.
-    if (ptr->next ==
-        reinterpret_cast<SSL_SESSION *>(&ctx->session_cache_tail)) {
+    if (ptr->next == reinterpret_cast<SSL_SESSION *>(&shard->tail)) {
       ptr = nullptr;
     } else {
       ptr = ptr->next;
@@ -980,6 +988,90 @@ static bool TestInternalSessionCache() {
   return true;
 }
 
+// Test that a sharded session cache behaves as expected.
+static bool TestShardedSessionCache() {
+  ScopedSSL_CTX ctx(SSL_CTX_new(TLS_method()));
+  if (!ctx) {
+    return false;
+  }
+
+  // A cache needs at least one shard.
+  if (SSL_CTX_set_session_cache_shards(ctx.get(), 0)) {
+    fprintf(stderr, "Set a session cache with no shards.\n");
+    return false;
+  }
+
+  // Changing the number of shards flushes the cache.
+  ScopedSSL_SESSION flushed = CreateTestSession(1000);
+  if (!flushed ||
+      !SSL_CTX_add_session(ctx.get(), flushed.get()) ||
+      !SSL_CTX_set_session_cache_shards(ctx.get(), 4) ||
+      SSL_CTX_sess_number(ctx.get()) != 0 ||
+      SSL_CTX_sessions(ctx.get()) != nullptr) {
+    fprintf(stderr, "Changing the number of shards did not flush.\n");
+    return false;
+  }
+
+  // The shards hold three, three, two and two sessions, which add up to the
+  // size of the cache.
+  SSL_CTX_sess_set_cache_size(ctx.get(), 10);
+  std::vector<ScopedSSL_SESSION> sessions;
+  for (int i = 0; i < 100; i++) {
+    ScopedSSL_SESSION session = CreateTestSession(i);
+    if (!session || !SSL_CTX_add_session(ctx.get(), session.get())) {
+      return false;
+    }
+    sessions.push_back(std::move(session));
+    if (SSL_CTX_sess_number(ctx.get()) > 10) {
+      fprintf(stderr, "Sharded session cache exceeded its size.\n");
+      return false;
+    }
+  }
+
+  // Every shard evicts its least recently added sessions, so the newest
+  // session is still present, and adding it again fails.
+  if (SSL_CTX_add_session(ctx.get(), sessions.back().get())) {
+    fprintf(stderr, "Newest session missing from the sharded cache.\n");
+    return false;
+  }
+
+  // Remove sessions until the cache is empty. Each removal finds the shard
+  // holding the session.
+  size_t removed = 0;
+  for (const auto &session : sessions) {
+    if (SSL_CTX_remove_session(ctx.get(), session.get())) {
+      removed++;
+    }
+  }
+  if (removed != 10 || SSL_CTX_sess_number(ctx.get()) != 0) {
+    fprintf(stderr, "Removed %u sessions from the sharded cache.\n",
+            static_cast<unsigned>(removed));
+    return false;
+  }
+
+  // With fewer cache slots than shards, every shard still holds one session,
+  // so each session added can be found until another one in its shard
+  // replaces it.
+  SSL_CTX_sess_set_cache_size(ctx.get(), 2);
+  for (int i = 0; i < 100; i++) {
+    ScopedSSL_SESSION session = CreateTestSession(i);
+    if (!session || !SSL_CTX_add_session(ctx.get(), session.get())) {
+      return false;
+    }
+    if (SSL_CTX_add_session(ctx.get(), session.get())) {
+      fprintf(stderr, "Session %d missing from the small sharded cache.\n", i);
+      return false;
+    }
+    if (SSL_CTX_sess_number(ctx.get()) > 4) {
+      fprintf(stderr, "Small sharded cache held %u sessions.\n",
+              static_cast<unsigned>(SSL_CTX_sess_number(ctx.get())));
+      return false;
+    }
+  }
+
+  return true;
+}
+
 static uint16_t EpochFromSequence(uint64_t seq) {
   return static_cast<uint16_t>(seq >> 48);
 }
@@ -1027,29 +1119,23 @@ static ScopedEVP_PKEY GetTestKey() {
       PEM_read_bio_PrivateKey(bio.get(), nullptr, nullptr, nullptr));
 }
 
-static bool TestSequenceNumber(bool dtls) {
-  ScopedSSL_CTX client_ctx(SSL_CTX_new(dtls ? DTLS_method() : TLS_method()));
-  ScopedSSL_CTX server_ctx(SSL_CTX_new(dtls ? DTLS_method() : TLS_method()));
-  if (!client_ctx || !server_ctx) {
-    return false;
-  }
-
-  ScopedX509 cert = GetTestCertificate();
-  ScopedEVP_PKEY key = GetTestKey();
-  if (!cert || !key ||
-      !SSL_CTX_use_certificate(server_ctx.get(), cert.get()) ||
-      !SSL_CTX_use_PrivateKey(server_ctx.get(), key.get())) {
-    return false;
-  }
-
-  // Create a client and server connected to each other.
-  ScopedSSL client(SSL_new(client_ctx.get())), server(SSL_new(server_ctx.get()));
+// ConnectClientAndServer creates a client of |client_ctx|, offering
+// |session| if not NULL, and a server of |server_ctx|, connected to each other
+// over a BIO pair, and drives their handshakes to completion.
+static bool ConnectClientAndServer(ScopedSSL *out_client, ScopedSSL *out_server,
+                                   SSL_CTX *client_ctx, SSL_CTX *server_ctx,
+                                   SSL_SESSION *session) {
+  ScopedSSL client(SSL_new(client_ctx)), server(SSL_new(server_ctx));
   if (!client || !server) {
     return false;
   }
   SSL_set_connect_state(client.get());
   SSL_set_accept_state(server.get());
 
+  if (session != nullptr && !SSL_set_session(client.get(), session)) {
+    return false;
+  }
+
   BIO *bio1, *bio2;
   if (!BIO_new_bio_pair(&bio1, 0, &bio2, 0)) {
     return false;
@@ -1083,6 +1169,33 @@ static bool TestSequenceNumber(bool dtls) {
     }
   }
 
+  *out_client = std::move(client);
+  *out_server = std::move(server);
+  return true;
+}
+
+static bool TestSequenceNumber(bool dtls) {
+  ScopedSSL_CTX client_ctx(SSL_CTX_new(dtls ? DTLS_method() : TLS_method()));
+  ScopedSSL_CTX server_ctx(SSL_CTX_new(dtls ? DTLS_method() : TLS_method()));
+  if (!client_ctx || !server_ctx) {
+    return false;
+  }
+
+  ScopedX509 cert = GetTestCertificate();
+  ScopedEVP_PKEY key = GetTestKey();
+  if (!cert || !key ||
+      !SSL_CTX_use_certificate(server_ctx.get(), cert.get()) ||
+      !SSL_CTX_use_PrivateKey(server_ctx.get(), key.get())) {
+    return false;
+  }
+
+  // Create a client and server connected to each other.
+  ScopedSSL client, server;
+  if (!ConnectClientAndServer(&client, &server, client_ctx.get(),
+                              server_ctx.get(), nullptr /* no session */)) {
+    return false;
+  }
+
   uint64_t client_read_seq = SSL_get_read_sequence(client.get());
   uint64_t client_write_seq = SSL_get_write_sequence(client.get());
   uint64_t server_read_seq = SSL_get_read_sequence(server.get());
@@ -1131,9 +1244,218 @@ static bool TestSequenceNumber(bool dtls) {
   return true;
 }
 
-int main() {
+// ReadInPlace reads |len| bytes from |ssl| with |SSL_read_in_place| into
+// |out|.
+static bool ReadInPlace(std::vector<uint8_t> *out, SSL *ssl, size_t len) {
+  out->clear();
+  while (out->size() < len) {
+    const uint8_t *data;
+    int ret = SSL_read_in_place(ssl, &data);
+    if (ret <= 0 || out->size() + ret > len) {
+      return false;
+    }
+    out->insert(out->end(), data, data + ret);
+  }
+  return true;
+}
+
+static bool TestInPlaceRecords(uint16_t version, const char *cipher_list) {
+  ScopedSSL_CTX client_ctx(SSL_CTX_new(TLS_method()));
+  ScopedSSL_CTX server_ctx(SSL_CTX_new(TLS_method()));
+  if (!client_ctx || !server_ctx) {
+    return false;
+  }
+
+  ScopedX509 cert = GetTestCertificate();
+  ScopedEVP_PKEY key = GetTestKey();
+  if (!cert || !key ||
+      !SSL_CTX_use_certificate(server_ctx.get(), cert.get()) ||
+      !SSL_CTX_use_PrivateKey(server_ctx.get(), key.get()) ||
+      !SSL_CTX_set_cipher_list(client_ctx.get(), cipher_list)) {
+    return false;
+  }
+  SSL_CTX_set_max_version(client_ctx.get(), version);
+  SSL_CTX_set_mode(client_ctx.get(), SSL_MODE_CBC_RECORD_SPLITTING);
+
+  ScopedSSL client, server;
+  if (!ConnectClientAndServer(&client, &server, client_ctx.get(),
+                              server_ctx.get(), nullptr /* no session */)) {
+    return false;
+  }
+
+  // Seal a record in place on the client and write it to the transport.
+  static const size_t kPlaintextLen = 1000;
+  size_t prefix_len = SSL_seal_prefix_len(client.get());
+  std::vector<uint8_t> record(
+      prefix_len + kPlaintextLen + SSL_max_seal_overhead(client.get()));
+  std::vector<uint8_t> plaintext(kPlaintextLen);
+  for (size_t i = 0; i < kPlaintextLen; i++) {
+    plaintext[i] = static_cast<uint8_t>(i);
+  }
+  memcpy(record.data() + prefix_len, plaintext.data(), kPlaintextLen);
+  size_t record_len;
+  if (!SSL_seal_record(client.get(), record.data(), &record_len, record.size(),
+                       record.data() + prefix_len, kPlaintextLen) ||
+      BIO_write(SSL_get_wbio(client.get()), record.data(), record_len) !=
+          static_cast<int>(record_len)) {
+    fprintf(stderr, "Could not seal record.\n");
+    return false;
+  }
+
+  // The server sees the plaintext in place.
+  std::vector<uint8_t> received;
+  if (!ReadInPlace(&received, server.get(), kPlaintextLen) ||
+      received != plaintext) {
+    fprintf(stderr, "Sealed record did not round-trip.\n");
+    return false;
+  }
+
+  // After a partial |SSL_read|, the remainder is returned.
+  uint8_t byte;
+  if (SSL_write(client.get(), plaintext.data(), kPlaintextLen) !=
+          static_cast<int>(kPlaintextLen) ||
+      SSL_read(server.get(), &byte, 1) != 1 ||
+      byte != plaintext[0] ||
+      !ReadInPlace(&received, server.get(), kPlaintextLen - 1) ||
+      memcmp(received.data(), plaintext.data() + 1, kPlaintextLen - 1) != 0 ||
+      SSL_pending(server.get()) != 0) {
+    fprintf(stderr, "Partial record did not round-trip.\n");
+    return false;
+  }
+
+  // close_notify is reported as with |SSL_read|.
+  SSL_shutdown(client.get());
+  const uint8_t *data;
+  int ret = SSL_read_in_place(server.get(), &data);
+  if (ret != 0 || SSL_get_error(server.get(), ret) != SSL_ERROR_ZERO_RETURN) {
+    fprintf(stderr, "close_notify was not reported.\n");
+    return false;
+  }
+
+  // Sealing is no longer possible after the client has shut down.
+  if (SSL_seal_record(client.get(), record.data(), &record_len, record.size(),
+                      record.data() + prefix_len, kPlaintextLen)) {
+    fprintf(stderr, "Sealed a record after close_notify.\n");
+    return false;
+  }
+  ERR_clear_error();
+
+  return true;
+}
+
+#if !defined(OPENSSL_NO_THREADS)
+// ResumeInThreads runs |num_threads| threads which each establish a session
+// between |client_ctx| and |server_ctx| and then resume it |num_resumptions|
+// times through the server's session cache. It sets |*out_us| to the time
+// taken, in microseconds.
+static bool ResumeInThreads(uint64_t *out_us, SSL_CTX *client_ctx,
+                            SSL_CTX *server_ctx, unsigned num_threads,
+                            unsigned num_resumptions) {
+  std::vector<char> ok(num_threads, 0);
+  std::vector<std::thread> threads;
+  auto start = std::chrono::steady_clock::now();
+  for (unsigned i = 0; i < num_threads; i++) {
+    threads.emplace_back([&ok, i, client_ctx, server_ctx, num_resumptions] {
+      ScopedSSL client, server;
+      if (!ConnectClientAndServer(&client, &server, client_ctx, server_ctx,
+                                  nullptr /* no session */)) {
+        return;
+      }
+      ScopedSSL_SESSION session(SSL_get1_session(client.get()));
+      // Shut the server down cleanly. Otherwise freeing it removes the session
+      // from the cache.
+      if (!session || SSL_shutdown(server.get()) < 0) {
+        return;
+      }
+      for (unsigned j = 0; j < num_resumptions; j++) {
+        if (!ConnectClientAndServer(&client, &server, client_ctx, server_ctx,
+                                    session.get()) ||
+            !SSL_session_reused(server.get()) ||
+            SSL_shutdown(server.get()) < 0) {
+          return;
+        }
+      }
+      ok[i] = 1;
+    });
+  }
+  for (auto &thread : threads) {
+    thread.join();
+  }
+  auto elapsed = std::chrono::steady_clock::now() - start;
+  *out_us = std::chrono::duration_cast<std::chrono::microseconds>(elapsed)
+                .count();
+
+  for (char thread_ok : ok) {
+    if (!thread_ok) {
+      fprintf(stderr, "Session resumption failed in a thread.\n");
+      return false;
+    }
+  }
+  return true;
+}
+#endif
+
+// TestSessionCacheThreads resumes sessions from several threads at once,
+// against session caches with one and with several shards. If |bench| is true,
+// it runs for longer and prints the resumption rate of each.
+static bool TestSessionCacheThreads(bool bench) {
+#if defined(OPENSSL_NO_THREADS)
+  return true;
+#else
+  const unsigned num_threads = bench ? 8 : 4;
+  const unsigned num_resumptions = bench ? 2000 : 20;
+
+  ScopedX509 cert = GetTestCertificate();
+  ScopedEVP_PKEY key = GetTestKey();
+  if (!cert || !key) {
+    return false;
+  }
+
+  for (size_t num_shards : {1, 16}) {
+    ScopedSSL_CTX client_ctx(SSL_CTX_new(TLS_method()));
+    ScopedSSL_CTX server_ctx(SSL_CTX_new(TLS_method()));
+    if (!client_ctx || !server_ctx ||
+        !SSL_CTX_use_certificate(server_ctx.get(), cert.get()) ||
+        !SSL_CTX_use_PrivateKey(server_ctx.get(), key.get()) ||
+        !SSL_CTX_set_session_cache_shards(server_ctx.get(), num_shards)) {
+      return false;
+    }
+    // Disable tickets so that resumption goes through the session cache.
+    SSL_CTX_set_options(server_ctx.get(), SSL_OP_NO_TICKET);
+
+    uint64_t us;
+    if (!ResumeInThreads(&us, client_ctx.get(), server_ctx.get(), num_threads,
+                         num_resumptions)) {
+      return false;
+    }
+    if (SSL_CTX_sess_number(server_ctx.get()) != num_threads) {
+      fprintf(stderr, "Session cache has %u sessions, wanted %u.\n",
+              static_cast<unsigned>(SSL_CTX_sess_number(server_ctx.get())),
+              num_threads);
+      return false;
+    }
+
+    if (bench) {
+      unsigned total = num_threads * num_resumptions;
+      printf("Did %u resumptions in %u threads with %u shard(s) in %lluus "
+             "(%.1f resumptions/sec)\n",
+             total, num_threads, static_cast<unsigned>(num_shards),
+             static_cast<unsigned long long>(us),
+             static_cast<double>(total) / us * 1000000);
+    }
+  }
+
+  return true;
+#endif
+}
+
+int main(int argc, char **argv) {
   CRYPTO_library_init();
 
+  // With --bench, the multi-threaded session cache test also measures
+  // resumption throughput.
+  bool bench = argc > 1 && strcmp(argv[1], "--bench") == 0;
+
   if (!TestCipherRules() ||
       !TestSSL_SESSIONEncoding(kOpenSSLSession) ||
       !TestSSL_SESSIONEncoding(kCustomSession) ||
@@ -1153,8 +1475,14 @@ int main() {
       !TestPaddingExtension() ||
       !TestClientCAList() ||
       !TestInternalSessionCache() ||
+      !TestShardedSessionCache() ||
+      !TestSessionCacheThreads(bench) ||
       !TestSequenceNumber(false /* TLS */) ||
-      !TestSequenceNumber(true /* DTLS */)) {
+      !TestSequenceNumber(true /* DTLS */) ||
+      !TestInPlaceRecords(TLS1_2_VERSION, "ECDHE-RSA-AES128-GCM-SHA256") ||
+      !TestInPlaceRecords(TLS1_2_VERSION, "ECDHE-RSA-CHACHA20-POLY1305") ||
+      // TLS 1.0 CBC ciphers split records, lengthening the seal prefix.
+      !TestInPlaceRecords(TLS1_VERSION, "ECDHE-RSA-AES128-SHA")) {
     ERR_print_errors_fp(stderr);
     return 1;
   }
@@ -18,6 +18,8 @@
 #include <vector>
 
 #include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
 
 #include <openssl/aead.h>
@@ -27,18 +29,60 @@
 #include <openssl/nid.h>
 #include <openssl/rand.h>
 #include <openssl/rsa.h>
+#include <openssl/ssl.h>
+#include <openssl/x509.h>
+#include <openssl/x509_view.h>
+#include <openssl/x509v3.h>
 
 #if defined(OPENSSL_WINDOWS)
 #pragma warning(push, 3)
 #include <windows.h>
 #pragma warning(pop)
-#elif defined(OPENSSL_APPLE)
+#else
+#include <sys/socket.h>
+#include <unistd.h>
+#if defined(OPENSSL_APPLE)
 #include <sys/time.h>
 #endif
+#endif
+
+#if !defined(OPENSSL_NO_THREADS)
+#include <thread>
+#endif
 
 #include "../crypto/test/scoped_types.h"
+#include "../ssl/test/scoped_types.h"
 #include "internal.h"
-
+#include "transport_common.h"
+
+
+// g_threads is the number of threads each benchmark is run on.
+static unsigned g_threads = 1;
+
+// g_print_json is true if results are printed as a JSON array rather than as
+// text.
+static bool g_print_json = false;
+
+// g_printed_json_result is true once a JSON result has been printed.
+static bool g_printed_json_result = false;
+
+// JSONEscape returns |str| escaped for use inside a JSON string.
+static std::string JSONEscape(const std::string &str) {
+  std::string ret;
+  for (char c : str) {
+    if (c == '"' || c == '\\') {
+      ret += '\\';
+      ret += c;
+    } else if (static_cast<unsigned char>(c) < 0x20) {
+      char buf[8];
+      snprintf(buf, sizeof(buf), "\\u%04x", static_cast<unsigned char>(c));
+      ret += buf;
+    } else {
+      ret += c;
+    }
+  }
+  return ret;
+}
 
 // TimeResults represents the results of benchmarking a function.
 struct TimeResults {
@@ -46,19 +90,53 @@ struct TimeResults {
   unsigned num_calls;
   // us is the number of microseconds that elapsed in the time period.
   unsigned us;
+  // threads is the number of threads the calls were spread over.
+  unsigned threads;
 
   void Print(const std::string &description) {
+    if (g_print_json) {
+      PrintJSON(description, 0);
+      return;
+    }
     printf("Did %u %s operations in %uus (%.1f ops/sec)\n", num_calls,
-           description.c_str(), us,
+           WithThreads(description).c_str(), us,
            (static_cast<double>(num_calls) / us) * 1000000);
   }
 
   void PrintWithBytes(const std::string &description, size_t bytes_per_call) {
+    if (g_print_json) {
+      PrintJSON(description, bytes_per_call);
+      return;
+    }
     printf("Did %u %s operations in %uus (%.1f ops/sec): %.1f MB/s\n",
-           num_calls, description.c_str(), us,
+           num_calls, WithThreads(description).c_str(), us,
            (static_cast<double>(num_calls) / us) * 1000000,
            static_cast<double>(bytes_per_call * num_calls) / us);
   }
+
+ private:
+  std::string WithThreads(const std::string &description) const {
+    if (threads <= 1) {
+      return description;
+    }
+    char buf[32];
+    snprintf(buf, sizeof(buf), " (%u threads)", threads);
+    return description + buf;
+  }
+
+  // PrintJSON prints the results as an element of the JSON array opened by
+  // |Speed|. If |bytes_per_call| is zero, it is omitted.
+  void PrintJSON(const std::string &description, size_t bytes_per_call) const {
+    printf("%s\n  {\"description\": \"%s\", \"numCalls\": %u, "
+           "\"microseconds\": %u, \"threads\": %u",
+           g_printed_json_result ? "," : "", JSONEscape(description).c_str(),
+           num_calls, us, threads);
+    if (bytes_per_call > 0) {
+      printf(", \"bytesPerCall\": %u", static_cast<unsigned>(bytes_per_call));
+    }
+    printf("}");
+    g_printed_json_result = true;
+  }
 };
 
 #if defined(OPENSSL_WINDOWS)
@@ -86,7 +164,10 @@ static uint64_t time_now() {
 }
 #endif
 
-static bool TimeFunction(TimeResults *results, std::function<bool()> func) {
+// RunTimedLoop calls |func| repeatedly for about a second on the current
+// thread and records the number of calls made.
+static bool RunTimedLoop(TimeResults *results,
+                         const std::function<bool()> &func) {
   // kTotalMS is the total amount of time that we'll aim to measure a function
   // for.
   static const uint64_t kTotalUS = 1000000;
@@ -130,21 +211,91 @@ static bool TimeFunction(TimeResults *results, std::function<bool()> func) {
   return true;
 }
 
+// TimeFunctionPerThread runs a function returned by |make_func| on each of
+// |g_threads| threads concurrently and records the total number of calls made.
+// |make_func| is called for each thread before timing starts, so state which
+// may not be shared, such as a cipher context, can be set up outside the
+// measurement. It may return an empty function to signal an error.
+static bool TimeFunctionPerThread(
+    TimeResults *results,
+    const std::function<std::function<bool()>()> &make_func) {
+  std::vector<std::function<bool()>> funcs;
+  for (unsigned i = 0; i < g_threads; i++) {
+    std::function<bool()> func = make_func();
+    if (!func) {
+      return false;
+    }
+    funcs.push_back(std::move(func));
+  }
+
+  results->threads = g_threads;
+  if (g_threads == 1) {
+    return RunTimedLoop(results, funcs[0]);
+  }
+
+#if defined(OPENSSL_NO_THREADS)
+  // |Speed| rejects thread counts above one in this configuration.
+  return false;
+#else
+  std::vector<TimeResults> thread_results(g_threads);
+  std::vector<char> ok(g_threads, 0);
+  std::vector<std::thread> threads;
+  for (unsigned i = 0; i < g_threads; i++) {
+    threads.emplace_back([&thread_results, &ok, &funcs, i] {
+      ok[i] = RunTimedLoop(&thread_results[i], funcs[i]);
+    });
+  }
+  for (auto &thread : threads) {
+    thread.join();
+  }
+
+  results->num_calls = 0;
+  results->us = 0;
+  for (unsigned i = 0; i < g_threads; i++) {
+    if (!ok[i]) {
+      return false;
+    }
+    results->num_calls += thread_results[i].num_calls;
+    if (thread_results[i].us > results->us) {
+      results->us = thread_results[i].us;
+    }
+  }
+  return true;
+#endif
+}
+
+// TimeFunction runs |func| on each of |g_threads| threads concurrently and
+// records the total number of calls made. Each thread calls its own copy of
+// |func|, so state captured by value is per-thread, while state captured by
+// reference is shared and must be safe to use concurrently.
+static bool TimeFunction(TimeResults *results, std::function<bool()> func) {
+  return TimeFunctionPerThread(results, [&func] { return func; });
+}
+
 static bool SpeedRSA(const std::string &key_name, RSA *key,
                      const std::string &selected) {
   if (!selected.empty() && key_name.find(selected) == std::string::npos) {
     return true;
   }
 
-  std::unique_ptr<uint8_t[]> sig(new uint8_t[RSA_size(key)]);
+  std::vector<uint8_t> sig(RSA_size(key));
   const uint8_t fake_sha256_hash[32] = {0};
   unsigned sig_len;
+  if (!RSA_sign(NID_sha256, fake_sha256_hash, sizeof(fake_sha256_hash),
+                sig.data(), &sig_len, key)) {
+    fprintf(stderr, "RSA_sign failed.\n");
+    ERR_print_errors_fp(stderr);
+    return false;
+  }
 
   TimeResults results;
+  // |out| is captured by value, so each thread signs into its own buffer.
+  std::vector<uint8_t> out(RSA_size(key));
   if (!TimeFunction(&results,
-                    [key, &sig, &fake_sha256_hash, &sig_len]() -> bool {
+                    [key, &fake_sha256_hash, out]() mutable -> bool {
+        unsigned out_len;
         return RSA_sign(NID_sha256, fake_sha256_hash, sizeof(fake_sha256_hash),
-                        sig.get(), &sig_len, key);
+                        out.data(), &out_len, key);
       })) {
     fprintf(stderr, "RSA_sign failed.\n");
     ERR_print_errors_fp(stderr);
@@ -155,7 +306,7 @@ static bool SpeedRSA(const std::string &key_name, RSA *key,
   if (!TimeFunction(&results,
                     [key, &fake_sha256_hash, &sig, sig_len]() -> bool {
         return RSA_verify(NID_sha256, fake_sha256_hash,
-                          sizeof(fake_sha256_hash), sig.get(), sig_len, key);
+                          sizeof(fake_sha256_hash), sig.data(), sig_len, key);
       })) {
     fprintf(stderr, "RSA_verify failed.\n");
     ERR_print_errors_fp(stderr);
@@ -172,11 +323,18 @@ static uint8_t *align(uint8_t *in, unsigned alignment) {
       ~static_cast<size_t>(alignment - 1));
 }
 
+// AEADSealState is the state |SpeedAEADChunk| seals with on each thread. The
+// legacy TLS AEADs keep cipher state in the context, so it is not shared.
+struct AEADSealState {
+  ScopedEVP_AEAD_CTX ctx;
+  std::vector<uint8_t> out_storage;
+  uint8_t *out;
+};
+
 static bool SpeedAEADChunk(const EVP_AEAD *aead, const std::string &name,
                            size_t chunk_len, size_t ad_len) {
   static const unsigned kAlignment = 16;
 
-  EVP_AEAD_CTX ctx;
   const size_t key_len = EVP_AEAD_key_length(aead);
   const size_t nonce_len = EVP_AEAD_nonce_length(aead);
   const size_t overhead_len = EVP_AEAD_max_overhead(aead);
@@ -186,31 +344,35 @@ static bool SpeedAEADChunk(const EVP_AEAD *aead, const std::string &name,
   std::unique_ptr<uint8_t[]> nonce(new uint8_t[nonce_len]);
   memset(nonce.get(), 0, nonce_len);
   std::unique_ptr<uint8_t[]> in_storage(new uint8_t[chunk_len + kAlignment]);
-  std::unique_ptr<uint8_t[]> out_storage(new uint8_t[chunk_len + overhead_len + kAlignment]);
   std::unique_ptr<uint8_t[]> ad(new uint8_t[ad_len]);
   memset(ad.get(), 0, ad_len);
 
   uint8_t *const in = align(in_storage.get(), kAlignment);
   memset(in, 0, chunk_len);
-  uint8_t *const out = align(out_storage.get(), kAlignment);
-  memset(out, 0, chunk_len + overhead_len);
-
-  if (!EVP_AEAD_CTX_init_with_direction(&ctx, aead, key.get(), key_len,
-                                        EVP_AEAD_DEFAULT_TAG_LENGTH,
-                                        evp_aead_seal)) {
-    fprintf(stderr, "Failed to create EVP_AEAD_CTX.\n");
-    ERR_print_errors_fp(stderr);
-    return false;
-  }
 
   TimeResults results;
-  if (!TimeFunction(&results, [chunk_len, overhead_len, nonce_len, ad_len, in,
-                               out, &ctx, &nonce, &ad]() -> bool {
-        size_t out_len;
+  if (!TimeFunctionPerThread(&results, [aead, chunk_len, key_len, overhead_len,
+                                        nonce_len, ad_len, in, &key, &nonce,
+                                        &ad]() -> std::function<bool()> {
+        std::shared_ptr<AEADSealState> state(new AEADSealState);
+        state->out_storage.resize(chunk_len + overhead_len + kAlignment);
+        state->out = align(state->out_storage.data(), kAlignment);
+        memset(state->out, 0, chunk_len + overhead_len);
+        if (!EVP_AEAD_CTX_init_with_direction(
+                state->ctx.get(), aead, key.get(), key_len,
+                EVP_AEAD_DEFAULT_TAG_LENGTH, evp_aead_seal)) {
+          fprintf(stderr, "Failed to create EVP_AEAD_CTX.\n");
+          return nullptr;
+        }
+
+        return [state, chunk_len, overhead_len, nonce_len, ad_len, in, &nonce,
+                &ad]() -> bool {
+          size_t out_len;
 
-        return EVP_AEAD_CTX_seal(
-            &ctx, out, &out_len, chunk_len + overhead_len, nonce.get(),
-            nonce_len, in, chunk_len, ad.get(), ad_len);
+          return EVP_AEAD_CTX_seal(
+              state->ctx.get(), state->out, &out_len, chunk_len + overhead_len,
+              nonce.get(), nonce_len, in, chunk_len, ad.get(), ad_len);
+        };
       })) {
     fprintf(stderr, "EVP_AEAD_CTX_seal failed.\n");
     ERR_print_errors_fp(stderr);
@@ -219,8 +381,6 @@ static bool SpeedAEADChunk(const EVP_AEAD *aead, const std::string &name,
 
   results.PrintWithBytes(name + " seal", chunk_len);
 
-  EVP_AEAD_CTX_cleanup(&ctx);
-
   return true;
 }
 
@@ -237,7 +397,6 @@ static bool SpeedAEAD(const EVP_AEAD *aead, const std::string &name,
 
 static bool SpeedHashChunk(const EVP_MD *md, const std::string &name,
                            size_t chunk_len) {
-  EVP_MD_CTX *ctx = EVP_MD_CTX_create();
   uint8_t scratch[8192];
 
   if (chunk_len > sizeof(scratch)) {
@@ -245,13 +404,17 @@ static bool SpeedHashChunk(const EVP_MD *md, const std::string &name,
   }
 
   TimeResults results;
-  if (!TimeFunction(&results, [ctx, md, chunk_len, &scratch]() -> bool {
-        uint8_t digest[EVP_MAX_MD_SIZE];
-        unsigned int md_len;
-
-        return EVP_DigestInit_ex(ctx, md, NULL /* ENGINE */) &&
-               EVP_DigestUpdate(ctx, scratch, chunk_len) &&
-               EVP_DigestFinal_ex(ctx, digest, &md_len);
+  if (!TimeFunctionPerThread(&results, [md, chunk_len,
+                                        &scratch]() -> std::function<bool()> {
+        std::shared_ptr<ScopedEVP_MD_CTX> ctx(new ScopedEVP_MD_CTX);
+        return [ctx, md, chunk_len, &scratch]() -> bool {
+          uint8_t digest[EVP_MAX_MD_SIZE];
+          unsigned int md_len;
+
+          return EVP_DigestInit_ex(ctx->get(), md, NULL /* ENGINE */) &&
+                 EVP_DigestUpdate(ctx->get(), scratch, chunk_len) &&
+                 EVP_DigestFinal_ex(ctx->get(), digest, &md_len);
+        };
       })) {
     fprintf(stderr, "EVP_DigestInit_ex failed.\n");
     ERR_print_errors_fp(stderr);
@@ -260,8 +423,6 @@ static bool SpeedHashChunk(const EVP_MD *md, const std::string &name,
 
   results.PrintWithBytes(name, chunk_len);
 
-  EVP_MD_CTX_destroy(ctx);
-
   return true;
 }
 static bool SpeedHash(const EVP_MD *md, const std::string &name,
@@ -282,8 +443,10 @@ static bool SpeedRandomChunk(const std::string name, size_t chunk_len) {
     return false;
   }
 
+  // |scratch| is captured by value, so each thread writes to its own copy.
+  memset(scratch, 0, sizeof(scratch));
   TimeResults results;
-  if (!TimeFunction(&results, [chunk_len, &scratch]() -> bool {
+  if (!TimeFunction(&results, [chunk_len, scratch]() mutable -> bool {
         RAND_bytes(scratch, chunk_len);
         return true;
       })) {
@@ -361,10 +524,15 @@ static bool SpeedECDSACurve(const std::string &name, int nid,
   uint8_t digest[20];
   memset(digest, 42, sizeof(digest));
   unsigned sig_len;
+  if (!ECDSA_sign(0, digest, sizeof(digest), signature, &sig_len, key.get())) {
+    return false;
+  }
 
   TimeResults results;
-  if (!TimeFunction(&results, [&key, &signature, &digest, &sig_len]() -> bool {
-        return ECDSA_sign(0, digest, sizeof(digest), signature, &sig_len,
+  if (!TimeFunction(&results, [&key, &digest]() -> bool {
+        uint8_t out[256];
+        unsigned out_len;
+        return ECDSA_sign(0, digest, sizeof(digest), out, &out_len,
                           key.get()) == 1;
       })) {
     return false;
@@ -405,9 +573,8 @@ static bool Speed25519(const std::string &selected) {
 
   TimeResults results;
 
-  uint8_t public_key[32], private_key[64];
-
-  if (!TimeFunction(&results, [&public_key, &private_key]() -> bool {
+  if (!TimeFunction(&results, []() -> bool {
+        uint8_t public_key[32], private_key[64];
         ED25519_keypair(public_key, private_key);
         return true;
       })) {
@@ -417,11 +584,15 @@ static bool Speed25519(const std::string &selected) {
   results.Print("Ed25519 key generation");
 
   static const uint8_t kMessage[] = {0, 1, 2, 3, 4, 5};
-  uint8_t signature[64];
+  uint8_t public_key[32], private_key[64], signature[64];
+  ED25519_keypair(public_key, private_key);
+  if (!ED25519_sign(signature, kMessage, sizeof(kMessage), private_key)) {
+    return false;
+  }
 
-  if (!TimeFunction(&results, [&private_key, &signature]() -> bool {
-        return ED25519_sign(signature, kMessage, sizeof(kMessage),
-                            private_key) == 1;
+  if (!TimeFunction(&results, [&private_key]() -> bool {
+        uint8_t out[64];
+        return ED25519_sign(out, kMessage, sizeof(kMessage), private_key) == 1;
       })) {
     return false;
   }
@@ -514,16 +685,599 @@ static bool SpeedSPAKE2(const std::string &selected) {
   return true;
 }
 
-bool Speed(const std::vector<std::string> &args) {
-  std::string selected;
-  if (args.size() > 1) {
-    fprintf(stderr, "Usage: bssl speed [speed test selector, i.e. 'RNG']\n");
+static ScopedEVP_PKEY NewP256Key() {
+  ScopedEC_KEY ec_key(EC_KEY_new_by_curve_name(NID_X9_62_prime256v1));
+  ScopedEVP_PKEY key(EVP_PKEY_new());
+  if (!ec_key || !key ||
+      !EC_KEY_generate_key(ec_key.get()) ||
+      !EVP_PKEY_set1_EC_KEY(key.get(), ec_key.get())) {
+    return nullptr;
+  }
+  return key;
+}
+
+// NewCert returns a certificate named |name| for |key|, issued by |issuer|,
+// whose key is |issuer_key|. If |issuer| is NULL, the certificate is
+// self-signed.
+static ScopedX509 NewCert(const char *name, EVP_PKEY *key, bool is_ca,
+                          X509 *issuer, EVP_PKEY *issuer_key) {
+  ScopedX509 cert(X509_new());
+  if (!cert ||
+      !X509_set_version(cert.get(), 2) ||
+      !ASN1_INTEGER_set(X509_get_serialNumber(cert.get()), 1) ||
+      !X509_NAME_add_entry_by_txt(X509_get_subject_name(cert.get()), "CN",
+                                  MBSTRING_UTF8,
+                                  reinterpret_cast<const uint8_t *>(name), -1,
+                                  -1, 0) ||
+      !X509_set_issuer_name(cert.get(),
+                            X509_get_subject_name(issuer != nullptr
+                                                      ? issuer
+                                                      : cert.get())) ||
+      !X509_gmtime_adj(X509_get_notBefore(cert.get()), -3600) ||
+      !X509_gmtime_adj(X509_get_notAfter(cert.get()), 86400) ||
+      !X509_set_pubkey(cert.get(), key)) {
+    return nullptr;
+  }
+  if (is_ca) {
+    X509_EXTENSION *ext =
+        X509V3_EXT_nconf_nid(nullptr, nullptr, NID_basic_constraints,
+                             const_cast<char *>("critical,CA:TRUE"));
+    bool ok = ext != nullptr && X509_add_ext(cert.get(), ext, -1);
+    X509_EXTENSION_free(ext);
+    if (!ok) {
+      return nullptr;
+    }
+  }
+  if (!X509_sign(cert.get(), issuer_key != nullptr ? issuer_key : key,
+                 EVP_sha256())) {
+    return nullptr;
+  }
+  return cert;
+}
+
+// Connection is a TLS client and server connected to each other.
+struct Connection {
+  Connection() {
+    fds[0] = fds[1] = -1;
+  }
+
+  ~Connection() {
+    client.reset();
+    server.reset();
+#if !defined(OPENSSL_WINDOWS)
+    for (int fd : fds) {
+      if (fd >= 0) {
+        close(fd);
+      }
+    }
+#endif
+  }
+
+  ScopedSSL client, server;
+  // fds, if not -1, are the ends of the socket pair |client| and |server| are
+  // connected over.
+  int fds[2];
+};
+
+// RunHandshakes drives the handshakes of |client| and |server|, whose
+// transports must be connected to each other and non-blocking, to completion.
+static bool RunHandshakes(SSL *client, SSL *server) {
+  SSL_set_connect_state(client);
+  SSL_set_accept_state(server);
+
+  for (;;) {
+    int client_ret = SSL_do_handshake(client);
+    int client_err = SSL_get_error(client, client_ret);
+    if (client_err != SSL_ERROR_NONE &&
+        client_err != SSL_ERROR_WANT_READ &&
+        client_err != SSL_ERROR_WANT_WRITE) {
+      return false;
+    }
+
+    int server_ret = SSL_do_handshake(server);
+    int server_err = SSL_get_error(server, server_ret);
+    if (server_err != SSL_ERROR_NONE &&
+        server_err != SSL_ERROR_WANT_READ &&
+        server_err != SSL_ERROR_WANT_WRITE) {
+      return false;
+    }
+
+    if (client_ret == 1 && server_ret == 1) {
+      return true;
+    }
+  }
+}
+
+// ConnectOverBIOPair returns a client of |client_ctx|, offering |session| if
+// not NULL, connected over a BIO pair to a server of |server_ctx|, once their
+// handshakes have completed. It returns NULL on error.
+static std::shared_ptr<Connection> ConnectOverBIOPair(SSL_CTX *client_ctx,
+                                                      SSL_CTX *server_ctx,
+                                                      SSL_SESSION *session) {
+  std::shared_ptr<Connection> conn(new Connection);
+  conn->client.reset(SSL_new(client_ctx));
+  conn->server.reset(SSL_new(server_ctx));
+  BIO *bio1, *bio2;
+  if (!conn->client || !conn->server ||
+      (session != nullptr && !SSL_set_session(conn->client.get(), session)) ||
+      !BIO_new_bio_pair(&bio1, 0, &bio2, 0)) {
+    return nullptr;
+  }
+  // SSL_set_bio takes ownership.
+  SSL_set_bio(conn->client.get(), bio1, bio1);
+  SSL_set_bio(conn->server.get(), bio2, bio2);
+
+  if (!RunHandshakes(conn->client.get(), conn->server.get())) {
+    return nullptr;
+  }
+  return conn;
+}
+
+#if !defined(OPENSSL_WINDOWS)
+// ConnectOverSocketPair behaves like |ConnectOverBIOPair| without a session,
+// but connects the client and server over a non-blocking socket pair.
+static std::shared_ptr<Connection> ConnectOverSocketPair(SSL_CTX *client_ctx,
+                                                         SSL_CTX *server_ctx) {
+  std::shared_ptr<Connection> conn(new Connection);
+  if (socketpair(AF_UNIX, SOCK_STREAM, 0, conn->fds) != 0) {
+    perror("socketpair");
+    return nullptr;
+  }
+  conn->client.reset(SSL_new(client_ctx));
+  conn->server.reset(SSL_new(server_ctx));
+  if (!conn->client || !conn->server ||
+      !SocketSetNonBlocking(conn->fds[0], true) ||
+      !SocketSetNonBlocking(conn->fds[1], true) ||
+      !SSL_set_fd(conn->client.get(), conn->fds[0]) ||
+      !SSL_set_fd(conn->server.get(), conn->fds[1]) ||
+      !RunHandshakes(conn->client.get(), conn->server.get())) {
+    return nullptr;
+  }
+  return conn;
+}
+#endif
+
+// DoHandshake runs a full handshake between a new client of |client_ctx| and
+// a new server of |server_ctx| over a BIO pair and checks that the client
+// verified the server's chain.
+static bool DoHandshake(SSL_CTX *client_ctx, SSL_CTX *server_ctx) {
+  std::shared_ptr<Connection> conn =
+      ConnectOverBIOPair(client_ctx, server_ctx, nullptr /* no session */);
+  return conn && SSL_get_verify_result(conn->client.get()) == X509_V_OK;
+}
+
+// SpeedHandshakeVerify measures full handshakes in which the client verifies
+// the same leaf, intermediate and root chain each time, with and without the
+// verified chain cache on the client's |X509_STORE|.
+static bool SpeedHandshakeVerify(const std::string &selected) {
+  if (!selected.empty() && selected.find("handshake") == std::string::npos) {
+    return true;
+  }
+
+  ScopedEVP_PKEY root_key = NewP256Key();
+  ScopedEVP_PKEY intermediate_key = NewP256Key();
+  ScopedEVP_PKEY leaf_key = NewP256Key();
+  if (!root_key || !intermediate_key || !leaf_key) {
     return false;
   }
-  if (args.size() > 0) {
-    selected = args[0];
+  ScopedX509 root =
+      NewCert("Root CA", root_key.get(), true, nullptr, nullptr);
+  if (!root) {
+    return false;
+  }
+  ScopedX509 intermediate = NewCert("Intermediate CA", intermediate_key.get(),
+                                    true, root.get(), root_key.get());
+  if (!intermediate) {
+    return false;
+  }
+  ScopedX509 leaf = NewCert("example.com", leaf_key.get(), false,
+                            intermediate.get(), intermediate_key.get());
+
+  ScopedSSL_CTX server_ctx(SSL_CTX_new(TLS_method()));
+  ScopedSSL_CTX client_ctx(SSL_CTX_new(TLS_method()));
+  if (!leaf || !server_ctx || !client_ctx ||
+      !SSL_CTX_use_certificate(server_ctx.get(), leaf.get()) ||
+      !SSL_CTX_use_PrivateKey(server_ctx.get(), leaf_key.get()) ||
+      !SSL_CTX_add1_chain_cert(server_ctx.get(), intermediate.get()) ||
+      !X509_STORE_add_cert(SSL_CTX_get_cert_store(client_ctx.get()),
+                           root.get())) {
+    return false;
+  }
+  SSL_CTX_set_verify(client_ctx.get(), SSL_VERIFY_PEER, nullptr);
+
+  X509_STORE *store = SSL_CTX_get_cert_store(client_ctx.get());
+  TimeResults results;
+  if (!TimeFunction(&results, [&client_ctx, &server_ctx]() -> bool {
+        return DoHandshake(client_ctx.get(), server_ctx.get());
+      })) {
+    fprintf(stderr, "TLS handshake failed.\n");
+    ERR_print_errors_fp(stderr);
+    return false;
+  }
+  results.Print("TLS handshake (chain of 3, verified)");
+
+  if (!X509_STORE_set_verify_cache_size(store, 64) ||
+      !TimeFunction(&results, [&client_ctx, &server_ctx]() -> bool {
+        return DoHandshake(client_ctx.get(), server_ctx.get());
+      })) {
+    fprintf(stderr, "TLS handshake failed.\n");
+    ERR_print_errors_fp(stderr);
+    return false;
+  }
+  results.Print("TLS handshake (chain of 3, cached)");
+
+  if (!g_print_json) {
+    uint64_t hits, misses;
+    X509_STORE_get_verify_cache_stats(store, &hits, &misses, nullptr);
+    printf("Verified chain cache: %llu hits, %llu misses\n",
+           static_cast<unsigned long long>(hits),
+           static_cast<unsigned long long>(misses));
+  }
+  return X509_STORE_set_verify_cache_size(store, 0);
+}
+
+// SpeedCertParse measures the certificate parsing a client does per
+// handshake: the server's leaf and intermediate are parsed and the leaf is
+// matched against the host name, either with |d2i_X509| or with
+// |X509_VIEW_parse|.
+static bool SpeedCertParse(const std::string &selected) {
+  if (!selected.empty() && selected.find("parse") == std::string::npos) {
+    return true;
+  }
+
+  ScopedEVP_PKEY root_key = NewP256Key();
+  ScopedEVP_PKEY intermediate_key = NewP256Key();
+  ScopedEVP_PKEY leaf_key = NewP256Key();
+  if (!root_key || !intermediate_key || !leaf_key) {
+    return false;
+  }
+  ScopedX509 root =
+      NewCert("Root CA", root_key.get(), true, nullptr, nullptr);
+  if (!root) {
+    return false;
+  }
+  ScopedX509 intermediate = NewCert("Intermediate CA", intermediate_key.get(),
+                                    true, root.get(), root_key.get());
+  if (!intermediate) {
+    return false;
+  }
+  ScopedX509 leaf = NewCert("example.com", leaf_key.get(), false,
+                            intermediate.get(), intermediate_key.get());
+  if (!leaf) {
+    return false;
+  }
+
+  std::vector<uint8_t> chain;
+  for (X509 *cert : {leaf.get(), intermediate.get()}) {
+    int len = i2d_X509(cert, nullptr);
+    if (len <= 0) {
+      return false;
+    }
+    size_t offset = chain.size();
+    chain.resize(offset + len);
+    uint8_t *ptr = chain.data() + offset;
+    i2d_X509(cert, &ptr);
+  }
+
+  static const char kHost[] = "example.com";
+  TimeResults results;
+  if (!TimeFunction(&results, [&chain]() -> bool {
+        const uint8_t *ptr = chain.data();
+        const uint8_t *end = chain.data() + chain.size();
+        ScopedX509 chain_leaf(d2i_X509(nullptr, &ptr, end - ptr));
+        ScopedX509 chain_intermediate(d2i_X509(nullptr, &ptr, end - ptr));
+        return chain_leaf && chain_intermediate && ptr == end &&
+               X509_check_host(chain_leaf.get(), kHost, strlen(kHost), 0,
+                               nullptr) == 1;
+      })) {
+    fprintf(stderr, "Certificate parsing failed.\n");
+    ERR_print_errors_fp(stderr);
+    return false;
+  }
+  results.Print("Certificate chain of 2 (d2i_X509)");
+
+  if (!TimeFunction(&results, [&chain]() -> bool {
+        CBS cbs;
+        CBS_init(&cbs, chain.data(), chain.size());
+        X509_VIEW chain_leaf, chain_intermediate;
+        return X509_VIEW_parse(&chain_leaf, &cbs) &&
+               X509_VIEW_parse(&chain_intermediate, &cbs) &&
+               CBS_len(&cbs) == 0 &&
+               X509_VIEW_check_host(&chain_leaf, kHost, strlen(kHost), 0) == 1;
+      })) {
+    fprintf(stderr, "Certificate parsing failed.\n");
+    ERR_print_errors_fp(stderr);
+    return false;
+  }
+  results.Print("Certificate chain of 2 (X509_VIEW)");
+  return true;
+}
+
+// NewServerCTX returns a new server |SSL_CTX| with a self-signed P-256
+// certificate for "example.com" which negotiates at most TLS 1.2.
+static ScopedSSL_CTX NewServerCTX() {
+  ScopedEVP_PKEY key = NewP256Key();
+  if (!key) {
+    return nullptr;
+  }
+  ScopedX509 cert = NewCert("example.com", key.get(), false, nullptr, nullptr);
+  ScopedSSL_CTX ctx(SSL_CTX_new(TLS_method()));
+  if (!cert || !ctx ||
+      !SSL_CTX_use_certificate(ctx.get(), cert.get()) ||
+      !SSL_CTX_use_PrivateKey(ctx.get(), key.get())) {
+    return nullptr;
+  }
+  SSL_CTX_set_max_version(ctx.get(), TLS1_2_VERSION);
+  return ctx;
+}
+
+// SpeedTLSHandshake measures handshakes between clients of |client_ctx| and
+// servers of |server_ctx| over a BIO pair. If |session| is not NULL, the
+// clients offer it and each handshake must resume it.
+static bool SpeedTLSHandshake(const std::string &name, SSL_CTX *client_ctx,
+                              SSL_CTX *server_ctx, SSL_SESSION *session) {
+  TimeResults results;
+  if (!TimeFunction(&results, [client_ctx, server_ctx, session]() -> bool {
+        std::shared_ptr<Connection> conn =
+            ConnectOverBIOPair(client_ctx, server_ctx, session);
+        if (!conn ||
+            (session != nullptr) != !!SSL_session_reused(conn->client.get())) {
+          return false;
+        }
+        // Shut the server down cleanly, or freeing it removes the session
+        // from the cache.
+        SSL_shutdown(conn->server.get());
+        return true;
+      })) {
+    fprintf(stderr, "%s failed.\n", name.c_str());
+    ERR_print_errors_fp(stderr);
+    return false;
+  }
+  results.Print(name);
+  return true;
+}
+
+// SpeedHandshake measures full TLS 1.2 handshakes and resumptions, through the
+// server's session cache and with session tickets, over a BIO pair.
+static bool SpeedHandshake(const std::string &selected) {
+  static const char kFull[] = "TLS 1.2 full handshake";
+  static const char kSessionID[] = "TLS 1.2 resumption handshake (session ID)";
+  static const char kTicket[] = "TLS 1.2 resumption handshake (ticket)";
+
+  ScopedSSL_CTX client_ctx(SSL_CTX_new(TLS_method()));
+  if (!client_ctx) {
+    return false;
+  }
+  SSL_CTX_set_max_version(client_ctx.get(), TLS1_2_VERSION);
+
+  if (selected.empty() || std::string(kFull).find(selected) != std::string::npos) {
+    ScopedSSL_CTX server_ctx = NewServerCTX();
+    if (!server_ctx) {
+      return false;
+    }
+    SSL_CTX_set_session_cache_mode(server_ctx.get(), SSL_SESS_CACHE_OFF);
+    SSL_CTX_set_options(server_ctx.get(), SSL_OP_NO_TICKET);
+    if (!SpeedTLSHandshake(kFull, client_ctx.get(), server_ctx.get(),
+                           nullptr /* no session */)) {
+      return false;
+    }
+  }
+
+  static const struct {
+    const char *name;
+    bool tickets;
+  } kResumptions[] = {
+      {kSessionID, false},
+      {kTicket, true},
+  };
+  for (const auto &resumption : kResumptions) {
+    if (!selected.empty() &&
+        std::string(resumption.name).find(selected) == std::string::npos) {
+      continue;
+    }
+
+    ScopedSSL_CTX server_ctx = NewServerCTX();
+    if (!server_ctx) {
+      return false;
+    }
+    if (resumption.tickets) {
+      SSL_CTX_set_session_cache_mode(server_ctx.get(), SSL_SESS_CACHE_OFF);
+    } else {
+      SSL_CTX_set_options(server_ctx.get(), SSL_OP_NO_TICKET);
+    }
+
+    std::shared_ptr<Connection> conn = ConnectOverBIOPair(
+        client_ctx.get(), server_ctx.get(), nullptr /* no session */);
+    if (!conn) {
+      fprintf(stderr, "TLS handshake failed.\n");
+      ERR_print_errors_fp(stderr);
+      return false;
+    }
+    ScopedSSL_SESSION session(SSL_get1_session(conn->client.get()));
+    SSL_shutdown(conn->server.get());
+    conn.reset();
+
+    if (!session ||
+        !SpeedTLSHandshake(resumption.name, client_ctx.get(), server_ctx.get(),
+                           session.get())) {
+      return false;
+    }
+  }
+
+  return true;
+}
+
+// TransferRecord sends |len| bytes from |buf| from |conn|'s client with
+// |SSL_write| and reads them back into |buf| on its server with |SSL_read|.
+static bool TransferRecord(Connection *conn, uint8_t *buf, size_t len) {
+  if (SSL_write(conn->client.get(), buf, len) != static_cast<int>(len)) {
+    return false;
+  }
+  size_t done = 0;
+  while (done < len) {
+    int ret = SSL_read(conn->server.get(), buf + done, len - done);
+    if (ret <= 0) {
+      return false;
+    }
+    done += ret;
+  }
+  return true;
+}
+
+// SpeedRecordSize measures sending |record_len|-byte records from clients of
+// |client_ctx| to servers of |server_ctx| over a BIO pair.
+static bool SpeedRecordSize(const std::string &name, SSL_CTX *client_ctx,
+                            SSL_CTX *server_ctx, size_t record_len) {
+  TimeResults results;
+  if (!TimeFunctionPerThread(&results, [client_ctx, server_ctx,
+                                        record_len]() -> std::function<bool()> {
+        std::shared_ptr<Connection> conn =
+            ConnectOverBIOPair(client_ctx, server_ctx, nullptr /* no session */);
+        if (!conn) {
+          return nullptr;
+        }
+        std::vector<uint8_t> buf(record_len);
+        return [conn, buf]() mutable -> bool {
+          return TransferRecord(conn.get(), buf.data(), buf.size());
+        };
+      })) {
+    fprintf(stderr, "%s record transfer failed.\n", name.c_str());
+    ERR_print_errors_fp(stderr);
+    return false;
+  }
+  results.PrintWithBytes(name, record_len);
+  return true;
+}
+
+#if !defined(OPENSSL_WINDOWS)
+// SpeedRecordInPlace measures sending maximum-size records from clients of
+// |client_ctx| to servers of |server_ctx| over a socket pair. Records are first
+// sent with |SSL_write| and copied out with |SSL_read|, then sealed in place
+// with |SSL_seal_record| and read in place with |SSL_read_in_place|.
+static bool SpeedRecordInPlace(const std::string &name, SSL_CTX *client_ctx,
+                               SSL_CTX *server_ctx) {
+  static const size_t kRecordLen = SSL3_RT_MAX_PLAIN_LENGTH;
+
+  TimeResults results;
+  if (!TimeFunctionPerThread(&results, [client_ctx,
+                                        server_ctx]() -> std::function<bool()> {
+        std::shared_ptr<Connection> conn =
+            ConnectOverSocketPair(client_ctx, server_ctx);
+        if (!conn) {
+          return nullptr;
+        }
+        std::vector<uint8_t> buf(kRecordLen);
+        return [conn, buf]() mutable -> bool {
+          return TransferRecord(conn.get(), buf.data(), buf.size());
+        };
+      })) {
+    fprintf(stderr, "%s record transfer failed.\n", name.c_str());
+    ERR_print_errors_fp(stderr);
+    return false;
+  }
+  results.PrintWithBytes(name + " (16384 bytes, socket pair)", kRecordLen);
+
+  if (!TimeFunctionPerThread(&results, [client_ctx,
+                                        server_ctx]() -> std::function<bool()> {
+        std::shared_ptr<Connection> conn =
+            ConnectOverSocketPair(client_ctx, server_ctx);
+        if (!conn) {
+          return nullptr;
+        }
+        // Lay the record out as the write buffer does, with the plaintext
+        // aligned so it is sealed in place.
+        size_t prefix_len = SSL_seal_prefix_len(conn->client.get());
+        size_t max_out =
+            prefix_len + kRecordLen + SSL_max_seal_overhead(conn->client.get());
+        std::shared_ptr<std::vector<uint8_t>> storage(
+            new std::vector<uint8_t>(max_out + 16));
+        uint8_t *record = align(storage->data() + prefix_len, 16) - prefix_len;
+        return [conn, storage, record, prefix_len, max_out]() -> bool {
+          size_t record_len;
+          if (!SSL_seal_record(conn->client.get(), record, &record_len, max_out,
+                               record + prefix_len, kRecordLen)) {
+            return false;
+          }
+          size_t written = 0;
+          while (written < record_len) {
+            ssize_t ret =
+                write(conn->fds[0], record + written, record_len - written);
+            if (ret <= 0) {
+              return false;
+            }
+            written += ret;
+          }
+          size_t done = 0;
+          while (done < kRecordLen) {
+            const uint8_t *data;
+            int ret = SSL_read_in_place(conn->server.get(), &data);
+            if (ret <= 0) {
+              return false;
+            }
+            done += ret;
+          }
+          return true;
+        };
+      })) {
+    fprintf(stderr, "%s record transfer failed.\n", name.c_str());
+    ERR_print_errors_fp(stderr);
+    return false;
   }
+  results.PrintWithBytes(name + " (16384 bytes, socket pair, in place)",
+                         kRecordLen);
+  return true;
+}
+#endif  // !OPENSSL_WINDOWS
+
+static bool SpeedRecord(const std::string &selected) {
+  static const struct {
+    const char *name;
+    const char *cipher;
+  } kCiphers[] = {
+      {"TLS record AES-128-GCM", "ECDHE-ECDSA-AES128-GCM-SHA256"},
+      {"TLS record ChaCha20-Poly1305", "ECDHE-ECDSA-CHACHA20-POLY1305"},
+  };
+  static const size_t kRecordLens[] = {16, 1350, 8192,
+                                       SSL3_RT_MAX_PLAIN_LENGTH};
+
+  ScopedSSL_CTX server_ctx;
+  for (const auto &cipher : kCiphers) {
+    if (!selected.empty() &&
+        std::string(cipher.name).find(selected) == std::string::npos) {
+      continue;
+    }
+    if (!server_ctx) {
+      server_ctx = NewServerCTX();
+      if (!server_ctx) {
+        return false;
+      }
+    }
+    ScopedSSL_CTX client_ctx(SSL_CTX_new(TLS_method()));
+    if (!client_ctx ||
+        !SSL_CTX_set_cipher_list(client_ctx.get(), cipher.cipher)) {
+      return false;
+    }
+
+    for (size_t record_len : kRecordLens) {
+      char suffix[32];
+      snprintf(suffix, sizeof(suffix), " (%u bytes)",
+               static_cast<unsigned>(record_len));
+      if (!SpeedRecordSize(cipher.name + std::string(suffix), client_ctx.get(),
+                           server_ctx.get(), record_len)) {
+        return false;
+      }
+    }
+
+#if !defined(OPENSSL_WINDOWS)
+    if (!SpeedRecordInPlace(cipher.name, client_ctx.get(), server_ctx.get())) {
+      return false;
+    }
+#endif
+  }
+  return true;
+}
 
+static bool RunSpeedTests(const std::string &selected) {
   RSA *key = RSA_private_key_from_bytes(kDERRSAPrivate2048,
                                         kDERRSAPrivate2048Len);
   if (key == NULL) {
@@ -594,9 +1348,113 @@ bool Speed(const std::vector<std::string> &args) {
       !SpeedECDH(selected) ||
       !SpeedECDSA(selected) ||
       !Speed25519(selected) ||
-      !SpeedSPAKE2(selected)) {
+      !SpeedSPAKE2(selected) ||
+      !SpeedHandshakeVerify(selected) ||
+      !SpeedCertParse(selected) ||
+      !SpeedHandshake(selected) ||
+      !SpeedRecord(selected)) {
     return false;
   }
 
   return true;
 }
+
+static const struct argument kArguments[] = {
+    {
+     "-filter", kOptionalArgument,
+     "Run only the speed tests whose names contain this string, e.g. RNG",
+    },
+    {
+     "-threads", kOptionalArgument,
+     "A comma-separated list of thread counts to run each speed test with, "
+     "e.g. 1,2,4 (default is 1)",
+    },
+    {
+     "-json", kBooleanArgument,
+     "Print the results as a JSON array",
+    },
+    {
+     "", kOptionalArgument, "",
+    },
+};
+
+// kMaxThreads is the largest thread count accepted by -threads.
+static const unsigned long kMaxThreads = 1024;
+
+// ParseThreadCounts parses |str|, a comma-separated list of thread counts,
+// into |out|. It returns true on success and false on error.
+static bool ParseThreadCounts(std::vector<unsigned> *out,
+                              const std::string &str) {
+  out->clear();
+  size_t start = 0;
+  for (;;) {
+    size_t end = str.find(',', start);
+    std::string count = str.substr(
+        start, end == std::string::npos ? std::string::npos : end - start);
+    char *endptr;
+    unsigned long n = strtoul(count.c_str(), &endptr, 10);
+    if (count.empty() || *endptr != '\0' || n == 0 || n > kMaxThreads) {
+      return false;
+    }
+    out->push_back(static_cast<unsigned>(n));
+    if (end == std::string::npos) {
+      return true;
+    }
+    start = end + 1;
+  }
+}
+
+bool Speed(const std::vector<std::string> &args) {
+  std::map<std::string, std::string> args_map;
+  std::string selected;
+  // A single argument which is not a flag is the filter, as before flags were
+  // supported.
+  if (args.size() == 1 && (args[0].empty() || args[0][0] != '-')) {
+    selected = args[0];
+  } else {
+    if (!ParseKeyValueArguments(&args_map, args, kArguments)) {
+      PrintUsage(kArguments);
+      return false;
+    }
+    if (args_map.count("-filter") != 0) {
+      selected = args_map["-filter"];
+    }
+  }
+
+  std::vector<unsigned> thread_counts(1, 1);
+  if (args_map.count("-threads") != 0 &&
+      !ParseThreadCounts(&thread_counts, args_map["-threads"])) {
+    fprintf(stderr, "Invalid thread counts: %s\n",
+            args_map["-threads"].c_str());
+    return false;
+  }
+#if defined(OPENSSL_NO_THREADS)
+  for (unsigned threads : thread_counts) {
+    if (threads != 1) {
+      fprintf(stderr, "Threads are not supported in this build.\n");
+      return false;
+    }
+  }
+#endif
+
+  g_print_json = args_map.count("-json") != 0;
+  if (g_print_json) {
+    printf("[");
+  }
+
+  bool ok = true;
+  for (unsigned threads : thread_counts) {
+    g_threads = threads;
+    if (!RunSpeedTests(selected)) {
+      ok = false;
+      break;
+    }
+  }
+
+  // Close the array even if a benchmark failed, so that the results printed
+  // so far remain valid JSON.
+  if (g_print_json) {
+    printf("\n]\n");
+  }
+  return ok;
+}
@@ -193,6 +193,13 @@ typedef int (*curl_xferinfo_callback)(void *clientp,
 #define CURL_MAX_WRITE_SIZE 16384
 #endif
 
+#ifndef CURL_MAX_READ_SIZE
+  /* The largest receive buffer size that can be set with CURLOPT_BUFFERSIZE.
+     Transfers using a receive buffer larger than CURL_MAX_WRITE_SIZE pass
+     data to the write callback in chunks of up to that size. */
+#define CURL_MAX_READ_SIZE 524288
+#endif
+
 #ifndef CURL_MAX_HTTP_HEADER
 /* The only reason to have a max limit for this is to avoid the risk of a bad
    server feeding libcurl with a never-ending header that will cause reallocs
@@ -1689,6 +1696,9 @@ typedef enum {
   /* Set TCP Fast Open */
   CINIT(TCP_FASTOPEN, LONG, 244),
 
+  /* Collect per-transfer stats, see CURLINFO_TRANSFER_STATS */
+  CINIT(INSTRUMENT, LONG, 245),
+
   CURLOPT_LASTENTRY /* the last unused */
 } CURLoption;
 
@@ -2138,6 +2148,28 @@ struct curl_tlssessioninfo {
   void *internals;
 };
 
+/* Per-transfer counters and clocks, collected when CURLOPT_INSTRUMENT is
+   enabled and asked for with CURLINFO_TRANSFER_STATS. Times are in
+   microseconds and each piece of work is only counted once: a write callback
+   called while decoding or receiving counts as write time only. */
+struct curl_transfer_stats {
+  curl_off_t recv_calls;     /* reads from the connection */
+  curl_off_t recv_bytes;     /* bytes returned by those reads */
+  curl_off_t recv_time;      /* time spent in them, TLS and HTTP/2 included */
+  curl_off_t send_calls;     /* writes to the connection */
+  curl_off_t send_bytes;     /* bytes sent by those writes */
+  curl_off_t send_time;      /* time spent in them */
+  curl_off_t tls_time;       /* the part of recv_time and send_time spent on
+                                TLS connections */
+  curl_off_t syscalls;       /* socket reads and writes done by libcurl */
+  curl_off_t decode_time;    /* content decoding */
+  curl_off_t write_calls;    /* calls to the write and header callbacks */
+  curl_off_t write_time;     /* time spent in them */
+  curl_off_t conncache_time; /* looking for a connection to reuse */
+  curl_off_t copies;         /* received data copied to another buffer */
+  curl_off_t copied_bytes;   /* bytes copied */
+};
+
 #define CURLINFO_STRING   0x100000
 #define CURLINFO_LONG     0x200000
 #define CURLINFO_DOUBLE   0x300000
@@ -2193,9 +2225,10 @@ typedef enum {
   CURLINFO_TLS_SESSION      = CURLINFO_SLIST  + 43,
   CURLINFO_ACTIVESOCKET     = CURLINFO_SOCKET + 44,
   CURLINFO_TLS_SSL_PTR      = CURLINFO_SLIST  + 45,
+  CURLINFO_TRANSFER_STATS   = CURLINFO_SLIST  + 46,
   /* Fill in new entries below here! */
 
-  CURLINFO_LASTONE          = 45
+  CURLINFO_LASTONE          = 46
 } CURLINFO;
 
 /* CURLINFO_RESPONSE_CODE is the new name for the option previously known as
@@ -2357,6 +2390,7 @@ typedef struct {
 #define CURL_VERSION_UNIX_SOCKETS (1<<19) /* Unix domain sockets support */
 #define CURL_VERSION_PSL          (1<<20) /* Mozilla's Public Suffix List, used
                                              for cookie domain verification */
+#define CURL_VERSION_BROTLI       (1<<21) /* Brotli features are present. */
 
  /*
  * NAME curl_version_info()
@@ -313,6 +313,21 @@ CURL_EXTERN CURLMcode curl_multi_socket_all(CURLM *multi_handle,
 CURL_EXTERN CURLMcode curl_multi_timeout(CURLM *multi_handle,
                                          long *milliseconds);
 
+/*
+ * Name:    curl_multi_run()
+ *
+ * Desc:    Waits at most timeout_ms milliseconds for activity on the sockets
+ *          of the multi handle or for the next timeout, and then drives the
+ *          transfers that need it. libcurl keeps track of the sockets and
+ *          timers itself, using epoll where available. See man page for
+ *          details.
+ *
+ * Returns: CURLM error code.
+ */
+CURL_EXTERN CURLMcode curl_multi_run(CURLM *multi_handle,
+                                     int timeout_ms,
+                                     int *running_handles);
+
 #undef CINIT /* re-using the same name as in curl.h */
 
 #ifdef CURL_ISOCPP
@@ -376,6 +391,12 @@ typedef enum {
   /* This is the argument passed to the server push callback */
   CINIT(PUSHDATA, OBJECTPOINT, 15),
 
+  /* This is the callback getting the stats of instrumented transfers */
+  CINIT(STATSFUNCTION, FUNCTIONPOINT, 16),
+
+  /* This is the argument passed to the stats callback */
+  CINIT(STATSDATA, OBJECTPOINT, 17),
+
   CURLMOPT_LASTENTRY /* the last unused */
 } CURLMoption;
 
@@ -428,6 +449,20 @@ typedef int (*curl_push_callback)(CURL *parent,
                                   struct curl_pushheaders *headers,
                                   void *userp);
 
+/*
+ * Name: curl_stats_callback
+ *
+ * Desc: This callback gets called when a transfer that has
+ *       CURLOPT_INSTRUMENT enabled is complete, before its CURLMSG_DONE
+ *       message is added. The stats are the same as CURLINFO_TRANSFER_STATS
+ *       returns.
+ *
+ * Returns: nothing
+ */
+typedef void (*curl_stats_callback)(CURL *easy,
+                                    const struct curl_transfer_stats *stats,
+                                    void *userp);
+
 #ifdef __cplusplus
 } /* end of extern "C" */
 #endif
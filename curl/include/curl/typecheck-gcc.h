@@ -124,6 +124,9 @@ __extension__ ({                                                              \
     if(_curl_is_slist_info(_curl_info))                                       \
       if(!_curl_is_arr((arg), struct curl_slist *))                           \
         _curl_easy_getinfo_err_curl_slist();                                  \
+    if(_curl_is_stats_info(_curl_info))                                       \
+      if(!_curl_is_arr((arg), struct curl_transfer_stats *))                  \
+        _curl_easy_getinfo_err_curl_transfer_stats();                         \
   }                                                                           \
   curl_easy_getinfo(handle, _curl_info, arg);                                 \
 })
@@ -200,6 +203,9 @@ _CURL_WARNING(_curl_easy_getinfo_err_double,
   "curl_easy_getinfo expects a pointer to double for this info")
 _CURL_WARNING(_curl_easy_getinfo_err_curl_slist,
   "curl_easy_getinfo expects a pointer to struct curl_slist * for this info")
+_CURL_WARNING(_curl_easy_getinfo_err_curl_transfer_stats,
+  "curl_easy_getinfo expects a pointer to struct curl_transfer_stats * for "
+  "this info")
 
 /* groups of curl_easy_setops options that take the same type of argument */
 
@@ -347,7 +353,11 @@ _CURL_WARNING(_curl_easy_getinfo_err_curl_slist,
 
 /* true if info expects a pointer to struct curl_slist * argument */
 #define _curl_is_slist_info(info)                                             \
-  (CURLINFO_SLIST < (info))
+  (CURLINFO_SLIST < (info) && (info) != CURLINFO_TRANSFER_STATS)
+
+/* true if info expects a pointer to struct curl_transfer_stats * argument */
+#define _curl_is_stats_info(info)                                             \
+  ((info) == CURLINFO_TRANSFER_STATS)
 
 
 /* typecheck helpers -- check whether given expression has requested type*/
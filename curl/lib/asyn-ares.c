@@ -169,6 +169,28 @@ int Curl_resolver_duphandle(void **to, void *from)
   return CURLE_OK;
 }
 
+/*
+ * Curl_resolver_pool_init()
+ *
+ * Called when a multi handle is created or a share handle starts sharing
+ * DNS. c-ares channels are per easy handle, so there is nothing to share.
+ */
+CURLcode Curl_resolver_pool_init(void **pool)
+{
+  *pool = NULL;
+  return CURLE_OK;
+}
+
+/*
+ * Curl_resolver_pool_cleanup()
+ *
+ * Counterpart of Curl_resolver_pool_init(). Does nothing here.
+ */
+void Curl_resolver_pool_cleanup(void *pool)
+{
+  (void)pool;
+}
+
 static void destroy_async_data (struct Curl_async *async);
 
 /*
@@ -58,10 +58,12 @@
 #endif
 
 #include "urldata.h"
+#include "multihandle.h"
 #include "sendf.h"
 #include "hostip.h"
 #include "hash.h"
 #include "share.h"
+#include "rawstr.h"
 #include "strerror.h"
 #include "url.h"
 #include "multiif.h"
@@ -69,6 +71,7 @@
 #include "inet_ntop.h"
 #include "curl_threads.h"
 #include "connect.h"
+#include "select.h"
 /* The last 3 #include files should be in this order */
 #include "curl_printf.h"
 #include "curl_memory.h"
@@ -149,216 +152,535 @@ static bool init_resolve_thread(struct connectdata *conn,
                                 const char *hostname, int port,
                                 const struct addrinfo *hints);
 
+/* The largest number of threads a resolver pool runs at the same time */
+#define MAX_RESOLVER_THREADS 64
 
-/* Data for synchronization between resolver thread and its parent */
-struct thread_sync_data {
-  curl_mutex_t * mtx;
-  int done;
+/* Milliseconds an idle pool thread waits for a new job before it exits */
+#define RESOLVER_IDLE_TIMEOUT 30000
 
-  char * hostname;        /* hostname to resolve, Curl_async.hostname
-                             duplicate */
+struct resolv_pool;
+
+/* States of a pool thread slot */
+#define RESOLV_THREAD_UNUSED  0
+#define RESOLV_THREAD_RUNNING 1
+#define RESOLV_THREAD_EXITED  2 /* returned, waits to be joined */
+
+/* A pool thread. Its handle stays in the pool until the thread is joined,
+   or detached when the pool is closed while it is resolving. */
+struct resolv_thread {
+  struct resolv_pool *pool;
+  curl_thread_t hnd;
+  int state; /* RESOLV_THREAD_* */
+  int busy;  /* resolving a job outside the pool mutex */
+};
+
+/* A name resolve performed by a pool thread. Connections that want the
+   same name resolved while it is pending all wait for the same job. */
+struct resolv_job {
+  struct resolv_job *next; /* next pending job in the pool */
+  struct resolv_pool *pool;
+  char *hostname;
   int port;
-  int sock_error;
-  Curl_addrinfo *res;
 #ifdef HAVE_GETADDRINFO
   struct addrinfo hints;
 #endif
-  struct thread_data *td; /* for thread-self cleanup */
+  int waiters; /* number of connections waiting for this job */
+  int running; /* a thread has started resolving */
+  int done;    /* the resolve is complete */
+  int sock_error;
+  Curl_addrinfo *res;
+};
+
+/* Resolver threads and the jobs they work on. A pool is shared by all
+   transfers using the same multi handle, or the same share handle when it
+   shares DNS. The threads are started on demand, up to
+   MAX_RESOLVER_THREADS of them. A thread that runs out of jobs waits for
+   new ones for RESOLVER_IDLE_TIMEOUT milliseconds before it exits, or until
+   the owning handle closes the pool. Threads that have exited are joined
+   when the next one is started or when the pool is closed. */
+struct resolv_pool {
+  curl_mutex_t mtx;
+  curl_cond_t work; /* signalled when a job is added or the pool closes */
+  curl_cond_t done; /* broadcast when a job is done */
+  int refcount; /* references from the owning handle, waiting connections
+                   and running threads */
+  int threads;  /* number of running threads */
+  int idle;     /* number of threads waiting for a job */
+  int closed;   /* the owning handle is gone, idle threads exit */
+  struct resolv_job *jobs; /* pending jobs, oldest first */
+  struct resolv_job *lastjob;
+  struct resolv_thread thread[MAX_RESOLVER_THREADS];
 };
 
+/* The resolver state of a connection */
 struct thread_data {
-  curl_thread_t thread_hnd;
+  struct resolv_job *job;
+  struct resolv_pool *ownpool; /* pool of this resolve only, if it has one */
   unsigned int poll_interval;
   long interval_end;
-  struct thread_sync_data tsd;
 };
 
-static struct thread_sync_data *conn_thread_sync_data(struct connectdata *conn)
+static struct resolv_pool *create_resolv_pool(void)
 {
-  return &(((struct thread_data *)conn->async.os_specific)->tsd);
+  struct resolv_pool *pool = calloc(1, sizeof(struct resolv_pool));
+
+  if(pool) {
+    Curl_mutex_init(&pool->mtx);
+    Curl_cond_init(&pool->work);
+    Curl_cond_init(&pool->done);
+    pool->refcount = 1;
+  }
+  return pool;
 }
 
-#define CONN_THREAD_SYNC_DATA(conn) &(((conn)->async.os_specific)->tsd);
+/* Drop a reference to the pool, freeing it if it was the last one */
+static void release_resolv_pool(struct resolv_pool *pool)
+{
+  int last;
+
+  Curl_mutex_acquire(&pool->mtx);
+  last = !--pool->refcount;
+  Curl_mutex_release(&pool->mtx);
+
+  if(last) {
+    DEBUGASSERT(!pool->jobs && !pool->threads);
+    Curl_cond_destroy(&pool->work);
+    Curl_cond_destroy(&pool->done);
+    Curl_mutex_destroy(&pool->mtx);
+    free(pool);
+  }
+}
 
-/* Destroy resolver thread synchronization data */
-static
-void destroy_thread_sync_data(struct thread_sync_data * tsd)
+/* Take the handles of the threads that have exited out of the pool, for the
+   caller to join once it has released the pool mutex. Called with the pool
+   mutex held. Returns the number of handles stored in 'hnds'. */
+static int reap_resolv_threads(struct resolv_pool *pool, curl_thread_t *hnds)
 {
-  if(tsd->mtx) {
-    Curl_mutex_destroy(tsd->mtx);
-    free(tsd->mtx);
+  int i;
+  int n = 0;
+
+  for(i = 0; i < MAX_RESOLVER_THREADS; i++) {
+    struct resolv_thread *t = &pool->thread[i];
+    /* a thread whose handle is not stored yet is reaped later */
+    if((t->state == RESOLV_THREAD_EXITED) && t->hnd) {
+      hnds[n++] = t->hnd;
+      t->hnd = curl_thread_t_null;
+      t->state = RESOLV_THREAD_UNUSED;
+    }
   }
+  return n;
+}
 
-  free(tsd->hostname);
+static void join_resolv_threads(curl_thread_t *hnds, int n)
+{
+  int i;
 
-  if(tsd->res)
-    Curl_freeaddrinfo(tsd->res);
+  for(i = 0; i < n; i++)
+    Curl_thread_join(&hnds[i]);
+}
 
-  memset(tsd, 0, sizeof(*tsd));
+/* Drop the owning handle's reference to the pool and stop its threads, as
+   nothing can add jobs to it anymore. Threads that are not resolving exit
+   and are joined. A thread in the middle of a resolve cannot be interrupted,
+   so it is detached instead and keeps the pool around until it is done. */
+static void close_resolv_pool(struct resolv_pool *pool)
+{
+  curl_thread_t hnds[MAX_RESOLVER_THREADS];
+  int n = 0;
+  int i;
+
+  Curl_mutex_acquire(&pool->mtx);
+  pool->closed = 1;
+  Curl_cond_broadcast(&pool->work);
+  for(i = 0; i < MAX_RESOLVER_THREADS; i++) {
+    struct resolv_thread *t = &pool->thread[i];
+    if(!t->hnd)
+      continue;
+    if((t->state == RESOLV_THREAD_RUNNING) && t->busy)
+      Curl_thread_destroy(t->hnd);
+    else {
+      hnds[n++] = t->hnd;
+      t->state = RESOLV_THREAD_UNUSED;
+    }
+    t->hnd = curl_thread_t_null;
+  }
+  Curl_mutex_release(&pool->mtx);
+
+  join_resolv_threads(hnds, n);
+
+  release_resolv_pool(pool);
 }
 
-/* Initialize resolver thread synchronization data */
-static
-int init_thread_sync_data(struct thread_data * td,
-                           const char * hostname,
-                           int port,
-                           const struct addrinfo *hints)
+static void destroy_resolv_job(struct resolv_job *job)
 {
-  struct thread_sync_data *tsd = &td->tsd;
+  free(job->hostname);
+  if(job->res)
+    Curl_freeaddrinfo(job->res);
+  free(job);
+}
 
-  memset(tsd, 0, sizeof(*tsd));
+/* Remove a job from the list of pending jobs. Called with the pool mutex
+   held. */
+static void unlink_resolv_job(struct resolv_pool *pool,
+                              struct resolv_job *job)
+{
+  struct resolv_job *prev = NULL;
+  struct resolv_job *j;
 
-  tsd->td = td;
-  tsd->port = port;
-#ifdef HAVE_GETADDRINFO
-  DEBUGASSERT(hints);
-  tsd->hints = *hints;
-#else
-  (void) hints;
-#endif
+  for(j = pool->jobs; j && j != job; j = j->next)
+    prev = j;
+  DEBUGASSERT(j);
+  if(!j)
+    return;
 
-  tsd->mtx = malloc(sizeof(curl_mutex_t));
-  if(tsd->mtx == NULL)
-    goto err_exit;
+  if(prev)
+    prev->next = job->next;
+  else
+    pool->jobs = job->next;
+  if(pool->lastjob == job)
+    pool->lastjob = prev;
+  job->next = NULL;
+}
 
-  Curl_mutex_init(tsd->mtx);
+/*
+ * resolve_job() does the actual resolve. Nothing else touches the result
+ * fields of a job while it runs.
+ */
+static void resolve_job(struct resolv_job *job)
+{
+#ifdef HAVE_GETADDRINFO
+  char service[12];
+  int rc;
 
-  tsd->sock_error = CURL_ASYNC_SUCCESS;
+  snprintf(service, sizeof(service), "%d", job->port);
 
-  /* Copying hostname string because original can be destroyed by parent
-   * thread during gethostbyname execution.
-   */
-  tsd->hostname = strdup(hostname);
-  if(!tsd->hostname)
-    goto err_exit;
+  rc = Curl_getaddrinfo_ex(job->hostname, service, &job->hints, &job->res);
 
-  return 1;
+  if(rc != 0) {
+    job->sock_error = SOCKERRNO?SOCKERRNO:rc;
+    if(job->sock_error == 0)
+      job->sock_error = RESOLVER_ENOMEM;
+  }
+#else
+  job->res = Curl_ipv4_resolve_r(job->hostname, job->port);
 
- err_exit:
-  /* Memory allocation failed */
-  destroy_thread_sync_data(tsd);
-  return 0;
+  if(!job->res) {
+    job->sock_error = SOCKERRNO;
+    if(job->sock_error == 0)
+      job->sock_error = RESOLVER_ENOMEM;
+  }
+#endif
 }
 
-static int getaddrinfo_complete(struct connectdata *conn)
+/*
+ * run_resolv_job() resolves a job that the caller has marked as running,
+ * and then marks it done. A job nobody waits for anymore is freed. Called
+ * and returns with the pool mutex held.
+ */
+static void run_resolv_job(struct resolv_pool *pool, struct resolv_job *job)
 {
-  struct thread_sync_data *tsd = conn_thread_sync_data(conn);
-  int rc;
+  Curl_mutex_release(&pool->mtx);
+  resolve_job(job);
+  Curl_mutex_acquire(&pool->mtx);
+
+  job->done = 1;
+  unlink_resolv_job(pool, job);
+  if(!job->waiters)
+    destroy_resolv_job(job);
+  else
+    Curl_cond_broadcast(&pool->done);
+}
 
-  rc = Curl_addrinfo_callback(conn, tsd->sock_error, tsd->res);
-  /* The tsd->res structure has been copied to async.dns and perhaps the DNS
-     cache.  Set our copy to NULL so destroy_thread_sync_data doesn't free it.
-  */
-  tsd->res = NULL;
+/*
+ * resolver_thread() resolves pending jobs. When there are none left it
+ * waits for new ones, and exits when none has shown up within
+ * RESOLVER_IDLE_TIMEOUT or the pool is closed. A closed pool starts no new
+ * jobs, as the connections that could wait for them are gone.
+ */
+static unsigned int CURL_STDCALL resolver_thread(void *arg)
+{
+  struct resolv_thread *self = (struct resolv_thread *)arg;
+  struct resolv_pool *pool = self->pool;
+  struct resolv_job *job;
+  struct timeval idle_start = Curl_tvnow();
+  long idle_time;
+
+  Curl_mutex_acquire(&pool->mtx);
+  for(;;) {
+    if(pool->closed)
+      break;
+    /* pick the oldest job that no thread has started on */
+    for(job = pool->jobs; job && job->running; job = job->next)
+      ;
+    if(job) {
+      job->running = 1;
+      self->busy = 1;
+      run_resolv_job(pool, job);
+      self->busy = 0;
+      idle_start = Curl_tvnow();
+      continue;
+    }
+    idle_time = Curl_tvdiff(Curl_tvnow(), idle_start);
+    if(idle_time >= RESOLVER_IDLE_TIMEOUT)
+      break;
+
+    pool->idle++;
+    Curl_cond_timedwait(&pool->work, &pool->mtx,
+                        RESOLVER_IDLE_TIMEOUT - idle_time);
+    pool->idle--;
+  }
+  pool->threads--;
+  self->state = RESOLV_THREAD_EXITED;
+  Curl_mutex_release(&pool->mtx);
 
-  return rc;
+  release_resolv_pool(pool);
+  return 0;
 }
 
+/*
+ * destroy_thread_data() stops the connection from waiting for its job. The
+ * job is freed if it was the last one waiting for it and no thread is
+ * resolving it.
+ */
+static void destroy_thread_data(struct thread_data *td)
+{
+  struct resolv_job *job = td->job;
+  struct resolv_pool *pool;
+  bool free_job = FALSE;
+
+  if(!job)
+    return;
+
+  pool = job->pool;
+  Curl_mutex_acquire(&pool->mtx);
+  if(!--job->waiters) {
+    if(job->done)
+      free_job = TRUE;
+    else if(!job->running) {
+      /* no thread has started on it, drop it */
+      unlink_resolv_job(pool, job);
+      free_job = TRUE;
+    }
+    /* else the thread resolving it frees it when done */
+  }
+  Curl_mutex_release(&pool->mtx);
+
+  if(free_job)
+    destroy_resolv_job(job);
 
-#ifdef HAVE_GETADDRINFO
+  td->job = NULL;
+  release_resolv_pool(pool);
+}
 
 /*
- * getaddrinfo_thread() resolves a name and then exits.
+ * add_resolv_job() makes the connection wait for a resolve of the given
+ * name in the pool, joining a pending job for the same name if there is
+ * one. A new job wakes up an idle pool thread, or starts another one if
+ * there are more jobs waiting to be started than idle threads. Starting a
+ * thread joins the ones that have exited.
  *
- * For builds without ARES, but with ENABLE_IPV6, create a resolver thread
- * and wait on it.
+ * Returns NULL on failure.
  */
-static unsigned int CURL_STDCALL getaddrinfo_thread (void *arg)
+static struct resolv_job *add_resolv_job(struct resolv_pool *pool,
+                                         const char *hostname, int port,
+                                         const struct addrinfo *hints)
 {
-  struct thread_sync_data *tsd = (struct thread_sync_data*)arg;
-  struct thread_data *td = tsd->td;
-  char service[12];
-  int rc;
+  struct resolv_job *newjob = calloc(1, sizeof(struct resolv_job));
+  struct resolv_job *job;
+  struct resolv_thread *thread = NULL;
+  curl_thread_t hnds[MAX_RESOLVER_THREADS];
+  int reaped = 0;
+  int queued = 0;
+  int i;
+
+  if(!newjob)
+    return NULL;
 
-  snprintf(service, sizeof(service), "%d", tsd->port);
+  /* Copying hostname string because original can be destroyed by parent
+   * thread during the resolve.
+   */
+  newjob->hostname = strdup(hostname);
+  if(!newjob->hostname) {
+    free(newjob);
+    return NULL;
+  }
+  newjob->pool = pool;
+  newjob->port = port;
+  newjob->waiters = 1;
+  newjob->sock_error = CURL_ASYNC_SUCCESS;
+#ifdef HAVE_GETADDRINFO
+  DEBUGASSERT(hints);
+  newjob->hints = *hints;
+#else
+  (void) hints;
+#endif
 
-  rc = Curl_getaddrinfo_ex(tsd->hostname, service, &tsd->hints, &tsd->res);
+  Curl_mutex_acquire(&pool->mtx);
 
-  if(rc != 0) {
-    tsd->sock_error = SOCKERRNO?SOCKERRNO:rc;
-    if(tsd->sock_error == 0)
-      tsd->sock_error = RESOLVER_ENOMEM;
+  for(job = pool->jobs; job; job = job->next) {
+    if((job->port == port) &&
+#ifdef HAVE_GETADDRINFO
+       (job->hints.ai_family == hints->ai_family) &&
+       (job->hints.ai_socktype == hints->ai_socktype) &&
+       (job->hints.ai_protocol == hints->ai_protocol) &&
+       (job->hints.ai_flags == hints->ai_flags) &&
+#endif
+       Curl_raw_equal(job->hostname, hostname))
+      break;
+    if(!job->running)
+      queued++;
   }
 
-  Curl_mutex_acquire(tsd->mtx);
-  if(tsd->done) {
-    /* too late, gotta clean up the mess */
-    Curl_mutex_release(tsd->mtx);
-    destroy_thread_sync_data(tsd);
-    free(td);
-  }
+  if(job)
+    /* the same name is already being resolved, wait for that one */
+    job->waiters++;
   else {
-    tsd->done = 1;
-    Curl_mutex_release(tsd->mtx);
+    job = newjob;
+    newjob = NULL;
+    if(pool->lastjob)
+      pool->lastjob->next = job;
+    else
+      pool->jobs = job;
+    pool->lastjob = job;
+    queued++;
+
+    if(pool->idle)
+      Curl_cond_signal(&pool->work);
+    if((queued > pool->idle) && (pool->threads < MAX_RESOLVER_THREADS)) {
+      reaped = reap_resolv_threads(pool, hnds);
+      for(i = 0; i < MAX_RESOLVER_THREADS; i++) {
+        if(pool->thread[i].state == RESOLV_THREAD_UNUSED) {
+          thread = &pool->thread[i];
+          thread->pool = pool;
+          thread->state = RESOLV_THREAD_RUNNING;
+          thread->busy = 0;
+          pool->threads++;
+          pool->refcount++; /* for the new thread */
+          break;
+        }
+      }
+    }
   }
+  pool->refcount++; /* for the waiting connection */
 
-  return 0;
-}
+  Curl_mutex_release(&pool->mtx);
+
+  if(newjob)
+    destroy_resolv_job(newjob);
 
-#else /* HAVE_GETADDRINFO */
+  join_resolv_threads(hnds, reaped);
+
+  if(thread) {
+    curl_thread_t hnd = Curl_thread_create(resolver_thread, thread);
+
+    Curl_mutex_acquire(&pool->mtx);
+    if(hnd)
+      thread->hnd = hnd;
+    else {
+      thread->state = RESOLV_THREAD_UNUSED;
+      pool->threads--;
+      pool->refcount--;
+      if(!pool->threads && !job->running) {
+        /* no thread is going to pick up the job, fall back to resolving
+           it right here */
+        job->running = 1;
+        run_resolv_job(pool, job);
+      }
+    }
+    Curl_mutex_release(&pool->mtx);
+  }
+
+  return job;
+}
 
 /*
- * gethostbyname_thread() resolves a name and then exits.
+ * dup_addrinfo() returns a copy of a Curl_addrinfo list, or NULL if out of
+ * memory.
  */
-static unsigned int CURL_STDCALL gethostbyname_thread (void *arg)
+static Curl_addrinfo *dup_addrinfo(const Curl_addrinfo *ai)
 {
-  struct thread_sync_data *tsd = (struct thread_sync_data *)arg;
-  struct thread_data *td = tsd->td;
+  Curl_addrinfo *head = NULL;
+  Curl_addrinfo **tail = &head;
+
+  for(; ai; ai = ai->ai_next) {
+    Curl_addrinfo *ca = malloc(sizeof(Curl_addrinfo));
+    if(!ca)
+      goto fail;
+    *ca = *ai;
+    ca->ai_next = NULL;
+    ca->ai_addr = NULL;
+    ca->ai_canonname = NULL;
+    *tail = ca;
+    tail = &ca->ai_next;
+
+    if(ai->ai_addr) {
+      ca->ai_addr = malloc(ai->ai_addrlen);
+      if(!ca->ai_addr)
+        goto fail;
+      memcpy(ca->ai_addr, ai->ai_addr, ai->ai_addrlen);
+    }
+    if(ai->ai_canonname) {
+      ca->ai_canonname = strdup(ai->ai_canonname);
+      if(!ca->ai_canonname)
+        goto fail;
+    }
+  }
+  return head;
 
-  tsd->res = Curl_ipv4_resolve_r(tsd->hostname, tsd->port);
+  fail:
+  Curl_freeaddrinfo(head);
+  return NULL;
+}
 
-  if(!tsd->res) {
-    tsd->sock_error = SOCKERRNO;
-    if(tsd->sock_error == 0)
-      tsd->sock_error = RESOLVER_ENOMEM;
-  }
+/* Returns TRUE if the connection's job is done */
+static bool resolv_job_done(struct thread_data *td)
+{
+  struct resolv_pool *pool = td->job->pool;
+  bool done;
 
-  Curl_mutex_acquire(tsd->mtx);
-  if(tsd->done) {
-    /* too late, gotta clean up the mess */
-    Curl_mutex_release(tsd->mtx);
-    destroy_thread_sync_data(tsd);
-    free(td);
-  }
-  else {
-    tsd->done = 1;
-    Curl_mutex_release(tsd->mtx);
-  }
+  Curl_mutex_acquire(&pool->mtx);
+  done = td->job->done ? TRUE : FALSE;
+  Curl_mutex_release(&pool->mtx);
 
-  return 0;
+  return done;
 }
 
-#endif /* HAVE_GETADDRINFO */
+static int getaddrinfo_complete(struct connectdata *conn)
+{
+  struct thread_data *td = (struct thread_data *)conn->async.os_specific;
+  struct resolv_job *job = td->job;
+  struct resolv_pool *pool = job->pool;
+  Curl_addrinfo *res;
+  int sock_error;
+
+  /* The last connection waiting for the job takes its result, the others
+     get copies. They normally find the name in the DNS cache before they
+     get here. */
+  Curl_mutex_acquire(&pool->mtx);
+  sock_error = job->sock_error;
+  if(job->waiters == 1) {
+    res = job->res;
+    job->res = NULL;
+  }
+  else
+    res = dup_addrinfo(job->res);
+  Curl_mutex_release(&pool->mtx);
+
+  return Curl_addrinfo_callback(conn, sock_error, res);
+}
 
 /*
- * destroy_async_data() cleans up async resolver data and thread handle.
+ * destroy_async_data() cleans up async resolver data.
  */
 static void destroy_async_data (struct Curl_async *async)
 {
   if(async->os_specific) {
     struct thread_data *td = (struct thread_data*) async->os_specific;
-    int done;
-
-    /*
-     * if the thread is still blocking in the resolve syscall, detach it and
-     * let the thread do the cleanup...
-     */
-    Curl_mutex_acquire(td->tsd.mtx);
-    done = td->tsd.done;
-    td->tsd.done = 1;
-    Curl_mutex_release(td->tsd.mtx);
-
-    if(!done) {
-      Curl_thread_destroy(td->thread_hnd);
-    }
-    else {
-      if(td->thread_hnd != curl_thread_t_null)
-        Curl_thread_join(&td->thread_hnd);
-
-      destroy_thread_sync_data(&td->tsd);
 
-      free(async->os_specific);
-    }
+    destroy_thread_data(td);
+    if(td->ownpool)
+      close_resolv_pool(td->ownpool);
+    free(async->os_specific);
   }
   async->os_specific = NULL;
 
@@ -367,8 +689,9 @@ static void destroy_async_data (struct Curl_async *async)
 }
 
 /*
- * init_resolve_thread() starts a new thread that performs the actual
- * resolve. This function returns before the resolve is done.
+ * init_resolve_thread() hands the resolve over to a resolver pool thread.
+ * The pool is the one of the handle the transfer shares its DNS cache
+ * with. This function returns before the resolve is done.
  *
  * Returns FALSE in case of failure, otherwise TRUE.
  */
@@ -376,7 +699,9 @@ static bool init_resolve_thread (struct connectdata *conn,
                                  const char *hostname, int port,
                                  const struct addrinfo *hints)
 {
+  struct SessionHandle *data = conn->data;
   struct thread_data *td = calloc(1, sizeof(struct thread_data));
+  struct resolv_pool *pool = NULL;
   int err = RESOLVER_ENOMEM;
 
   conn->async.os_specific = (void*) td;
@@ -387,28 +712,28 @@ static bool init_resolve_thread (struct connectdata *conn,
   conn->async.done = FALSE;
   conn->async.status = 0;
   conn->async.dns = NULL;
-  td->thread_hnd = curl_thread_t_null;
-
-  if(!init_thread_sync_data(td, hostname, port, hints))
-    goto err_exit;
 
   free(conn->async.hostname);
   conn->async.hostname = strdup(hostname);
   if(!conn->async.hostname)
     goto err_exit;
 
-#ifdef HAVE_GETADDRINFO
-  td->thread_hnd = Curl_thread_create(getaddrinfo_thread, &td->tsd);
-#else
-  td->thread_hnd = Curl_thread_create(gethostbyname_thread, &td->tsd);
-#endif
+  if(data->dns.hostcachetype == HCACHE_SHARED)
+    pool = data->share->resolver;
+  else if(data->multi)
+    pool = data->multi->resolver;
+
+  if(!pool) {
+    /* a pool of its own for this resolve only, closed once the connection
+       is done waiting for it */
+    pool = td->ownpool = create_resolv_pool();
+    if(!pool)
+      goto err_exit;
+  }
 
-  if(!td->thread_hnd) {
-#ifndef _WIN32_WCE
-    err = errno;
-#endif
+  td->job = add_resolv_job(pool, hostname, port, hints);
+  if(!td->job)
     goto err_exit;
-  }
 
   return TRUE;
 
@@ -420,6 +745,33 @@ static bool init_resolve_thread (struct connectdata *conn,
   return FALSE;
 }
 
+/*
+ * Curl_resolver_pool_init()
+ *
+ * Creates the resolver thread pool for a multi or share handle.
+ */
+CURLcode Curl_resolver_pool_init(void **pool)
+{
+  *pool = create_resolv_pool();
+  if(!*pool)
+    return CURLE_OUT_OF_MEMORY;
+  return CURLE_OK;
+}
+
+/*
+ * Curl_resolver_pool_cleanup()
+ *
+ * Releases the multi or share handle's reference to its pool, stops its
+ * threads and joins them. Only a thread that is still inside getaddrinfo()
+ * is left running, detached, as it cannot be interrupted. It keeps the pool
+ * around until its resolve is done and then exits.
+ */
+void Curl_resolver_pool_cleanup(void *pool)
+{
+  if(pool)
+    close_resolv_pool((struct resolv_pool *)pool);
+}
+
 /*
  * resolver_error() calls failf() with the appropriate message after a resolve
  * error
@@ -459,15 +811,24 @@ CURLcode Curl_resolver_wait_resolv(struct connectdata *conn,
                                    struct Curl_dns_entry **entry)
 {
   struct thread_data   *td = (struct thread_data*) conn->async.os_specific;
+  struct resolv_pool *pool;
   CURLcode result = CURLE_OK;
 
-  DEBUGASSERT(conn && td);
+  DEBUGASSERT(conn && td && td->job);
 
-  /* wait for the thread to resolve the name */
-  if(Curl_thread_join(&td->thread_hnd))
-    result = getaddrinfo_complete(conn);
-  else
-    DEBUGASSERT(0);
+  /* if no thread has started on the job yet, resolve it right here */
+  pool = td->job->pool;
+  Curl_mutex_acquire(&pool->mtx);
+  if(!td->job->running) {
+    td->job->running = 1;
+    run_resolv_job(pool, td->job);
+  }
+  /* otherwise wait for the thread to resolve the name */
+  while(!td->job->done)
+    Curl_cond_wait(&pool->done, &pool->mtx);
+  Curl_mutex_release(&pool->mtx);
+
+  result = getaddrinfo_complete(conn);
 
   conn->async.done = TRUE;
 
@@ -496,20 +857,15 @@ CURLcode Curl_resolver_is_resolved(struct connectdata *conn,
 {
   struct SessionHandle *data = conn->data;
   struct thread_data   *td = (struct thread_data*) conn->async.os_specific;
-  int done = 0;
 
   *entry = NULL;
 
-  if(!td) {
-    DEBUGASSERT(td);
+  if(!td || !td->job) {
+    DEBUGASSERT(td && td->job);
     return CURLE_COULDNT_RESOLVE_HOST;
   }
 
-  Curl_mutex_acquire(td->tsd.mtx);
-  done = td->tsd.done;
-  Curl_mutex_release(td->tsd.mtx);
-
-  if(done) {
+  if(resolv_job_done(td)) {
     getaddrinfo_complete(conn);
 
     if(!conn->async.dns) {
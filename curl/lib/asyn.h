@@ -81,6 +81,23 @@ void Curl_resolver_cleanup(void *resolver);
  */
 int Curl_resolver_duphandle(void **to, void *from);
 
+/*
+ * Curl_resolver_pool_init()
+ * Called when a multi handle is created, and when a share handle starts
+ * sharing DNS, to set up resolver state that is shared by all transfers
+ * using that handle (the 'resolver' member of Curl_multi and Curl_share).
+ * Backends without such state set the pointer to NULL.
+ */
+CURLcode Curl_resolver_pool_init(void **pool);
+
+/*
+ * Curl_resolver_pool_cleanup()
+ * Called from curl_multi_cleanup() and when a share handle stops sharing
+ * DNS or is cleaned up, to release the state set up by
+ * Curl_resolver_pool_init().
+ */
+void Curl_resolver_pool_cleanup(void *pool);
+
 /*
  * Curl_resolver_cancel().
  *
@@ -155,6 +172,8 @@ Curl_addrinfo *Curl_resolver_getaddrinfo(struct connectdata *conn,
 #define Curl_resolver_global_init() CURLE_OK
 #define Curl_resolver_global_cleanup() Curl_nop_stmt
 #define Curl_resolver_cleanup(x) Curl_nop_stmt
+#define Curl_resolver_pool_init(x) (*(x) = NULL, CURLE_OK)
+#define Curl_resolver_pool_cleanup(x) Curl_nop_stmt
 #endif
 
 #ifdef CURLRES_ASYNCH
@@ -56,6 +56,8 @@ static CURLcode bundle_create(struct SessionHandle *data,
 
   (*cb_ptr)->num_connections = 0;
   (*cb_ptr)->multiuse = BUNDLE_UNKNOWN;
+  (*cb_ptr)->idle_head = NULL;
+  (*cb_ptr)->idle_tail = NULL;
 
   (*cb_ptr)->conn_list = Curl_llist_alloc((curl_llist_dtor) conn_llist_dtor);
   if(!(*cb_ptr)->conn_list) {
@@ -90,12 +92,35 @@ static CURLcode bundle_add_conn(struct connectbundle *cb_ptr,
   return CURLE_OK;
 }
 
+/* Take a connection out of its bundle's idle list, if it is in it */
+static void bundle_unlink_idle(struct connectbundle *cb_ptr,
+                               struct connectdata *conn)
+{
+  if(!conn->bits.idle)
+    return;
+
+  if(conn->idle_prev)
+    conn->idle_prev->idle_next = conn->idle_next;
+  else
+    cb_ptr->idle_head = conn->idle_next;
+
+  if(conn->idle_next)
+    conn->idle_next->idle_prev = conn->idle_prev;
+  else
+    cb_ptr->idle_tail = conn->idle_prev;
+
+  conn->idle_prev = conn->idle_next = NULL;
+  conn->bits.idle = FALSE;
+}
+
 /* Remove a connection from a bundle */
 static int bundle_remove_conn(struct connectbundle *cb_ptr,
                               struct connectdata *conn)
 {
   struct curl_llist_element *curr;
 
+  bundle_unlink_idle(cb_ptr, conn);
+
   curr = cb_ptr->conn_list->head;
   while(curr) {
     if(curr->ptr == conn) {
@@ -265,6 +290,37 @@ void Curl_conncache_remove_conn(struct conncache *connc,
   }
 }
 
+void Curl_conncache_conn_idle(struct connectdata *conn)
+{
+  struct connectbundle *bundle = conn->bundle;
+
+  conn->inuse = FALSE;
+
+  if(!bundle)
+    return;
+
+  /* move it first in the list, the list is kept in least recently used
+     order from the tail */
+  bundle_unlink_idle(bundle, conn);
+
+  conn->idle_prev = NULL;
+  conn->idle_next = bundle->idle_head;
+  if(bundle->idle_head)
+    bundle->idle_head->idle_prev = conn;
+  else
+    bundle->idle_tail = conn;
+  bundle->idle_head = conn;
+  conn->bits.idle = TRUE;
+}
+
+void Curl_conncache_conn_busy(struct connectdata *conn)
+{
+  conn->inuse = TRUE;
+
+  if(conn->bundle)
+    bundle_unlink_idle(conn->bundle, conn);
+}
+
 /* This function iterates the entire connection cache and calls the
    function func() with the connection pointer as the first argument
    and the supplied 'param' argument as the other,
@@ -7,7 +7,7 @@
  *                            | (__| |_| |  _ <| |___
  *                             \___|\___/|_| \_\_____|
  *
- * Copyright (C) 2015, Daniel Stenberg, <daniel@haxx.se>, et al.
+ * Copyright (C) 2015, 2016, Daniel Stenberg, <daniel@haxx.se>, et al.
  * Copyright (C) 2012 - 2014, Linus Nielsen Feltzing, <linus@haxx.se>
  *
  * This software is licensed as described in the file COPYING, which
@@ -39,6 +39,8 @@ struct connectbundle {
   int multiuse;                 /* supports multi-use */
   size_t num_connections;       /* Number of connections in the bundle */
   struct curl_llist *conn_list; /* The connectdata members of the bundle */
+  struct connectdata *idle_head; /* most recently used idle connection */
+  struct connectdata *idle_tail; /* least recently used idle connection */
 };
 
 int Curl_conncache_init(struct conncache *, int size);
@@ -55,6 +57,13 @@ CURLcode Curl_conncache_add_conn(struct conncache *connc,
 void Curl_conncache_remove_conn(struct conncache *connc,
                                 struct connectdata *conn);
 
+/* mark the connection as no longer used by any transfer, which puts it first
+   in its bundle's list of idle connections */
+void Curl_conncache_conn_idle(struct connectdata *conn);
+
+/* mark the connection as used, which takes it out of the idle list */
+void Curl_conncache_conn_busy(struct connectdata *conn);
+
 void Curl_conncache_foreach(struct conncache *connc,
                             void *param,
                             int (*func)(struct connectdata *conn,
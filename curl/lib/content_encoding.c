@@ -5,7 +5,7 @@
  *                            | (__| |_| |  _ <| |___
  *                             \___|\___/|_| \_\_____|
  *
- * Copyright (C) 1998 - 2011, Daniel Stenberg, <daniel@haxx.se>, et al.
+ * Copyright (C) 1998 - 2016, Daniel Stenberg, <daniel@haxx.se>, et al.
  *
  * This software is licensed as described in the file COPYING, which
  * you should have received as part of this distribution. The terms
@@ -22,22 +22,112 @@
 
 #include "curl_setup.h"
 
-#ifdef HAVE_LIBZ
-
 #include "urldata.h"
 #include <curl/curl.h>
+#ifdef HAVE_BROTLI
+#include <brotli/decode.h>
+#endif
 #include "sendf.h"
+#include "http.h"
 #include "content_encoding.h"
+#include "progress.h"
+#include "rawstr.h"
 #include "curl_memory.h"
 
 #include "memdebug.h"
 
+/* The number of encodings we accept stacked on top of each other in one
+   response */
+#define MAX_ENCODE_STACK 5
+
+/*
+ * The body of a response is decoded by a stack of writers, one for each
+ * encoding the server says it applied. Data received from the server is
+ * passed to the top of the stack, and each writer passes what it decodes on
+ * to the one below it. The client write callback sits below the bottom
+ * writer, so with no stack at all the data goes straight to the client.
+ */
+struct contenc_writer {
+  const struct content_encoding *handler;
+  struct contenc_writer *downstream;  /* the next writer, NULL for client */
+  char *outbuf;                       /* decoded data is collected here */
+  size_t outsize;                     /* size of outbuf */
+  void *params;                       /* encoding-specific state */
+};
+
+struct content_encoding {
+  const char *name;                   /* encoding name */
+  const char *alias;                  /* alternative name, or NULL */
+  CURLcode (*init_writer)(struct connectdata *conn,
+                          struct contenc_writer *writer);
+  CURLcode (*unencode_write)(struct connectdata *conn,
+                             struct contenc_writer *writer,
+                             const char *buf, size_t nbytes);
+  void (*close_writer)(struct contenc_writer *writer);
+  size_t paramsize;                   /* size of the writer's params */
+};
+
+/*
+ * The decoders inflate into a buffer that is allocated once per transfer and
+ * that is as large as the pieces the client gets in one write callback call
+ * (see chop_write()), so each buffer full is passed on as it is, without
+ * any copying or splitting. An application that asks for a larger receive
+ * buffer with CURLOPT_BUFFERSIZE thus also gets fewer, larger pieces of
+ * decoded data.
+ */
+static CURLcode init_outbuf(struct connectdata *conn,
+                            struct contenc_writer *writer)
+{
+  struct SessionHandle *data = conn->data;
+
+  writer->outsize = CURL_MAX_WRITE_SIZE;
+  if(data->set.buffer_size > CURL_MAX_WRITE_SIZE)
+    writer->outsize = (size_t)data->set.buffer_size;
+
+  writer->outbuf = malloc(writer->outsize);
+  if(!writer->outbuf)
+    return CURLE_OUT_OF_MEMORY;
+
+  return CURLE_OK;
+}
+
+/* The identity encoding, which leaves the data as it is */
+
+static CURLcode identity_init_writer(struct connectdata *conn,
+                                     struct contenc_writer *writer)
+{
+  (void)conn;
+  (void)writer;
+  return CURLE_OK;
+}
+
+static CURLcode identity_unencode_write(struct connectdata *conn,
+                                        struct contenc_writer *writer,
+                                        const char *buf, size_t nbytes)
+{
+  return Curl_unencode_write(conn, writer->downstream, buf, nbytes);
+}
+
+static void identity_close_writer(struct contenc_writer *writer)
+{
+  (void)writer;
+}
+
+static const struct content_encoding identity_encoding = {
+  "identity",
+  "none",
+  identity_init_writer,
+  identity_unencode_write,
+  identity_close_writer,
+  0
+};
+
+#ifdef HAVE_LIBZ
+
 /* Comment this out if zlib is always going to be at least ver. 1.2.0.4
    (doing so will reduce code size slightly). */
 #define OLD_ZLIB_SUPPORT 1
 
-#define DSIZ CURL_MAX_WRITE_SIZE /* buffer size for decompressed data */
-
 #define GZIP_MAGIC_0 0x1f
 #define GZIP_MAGIC_1 0x8b
 
@@ -49,6 +139,20 @@
 #define COMMENT      0x10 /* bit 4 set: file comment present */
 #define RESERVED     0xE0 /* bits 5..7: reserved */
 
+typedef enum {
+  ZLIB_UNINIT,          /* uninitialized */
+  ZLIB_INIT,            /* initialized */
+  ZLIB_GZIP_HEADER,     /* reading gzip header */
+  ZLIB_GZIP_INFLATING,  /* inflating gzip stream */
+  ZLIB_INIT_GZIP        /* initialized in transparent gzip mode */
+} zlibInitState;
+
+/* Writer parameters for deflate and gzip */
+struct zlib_params {
+  zlibInitState zlib_init;      /* zlib init state */
+  z_stream z;                   /* State structure for zlib. */
+};
+
 static voidpf
 zalloc_cb(voidpf opaque, unsigned int items, unsigned int size)
 {
@@ -87,60 +191,53 @@ exit_zlib(z_stream *z, zlibInitState *zlib_init, CURLcode result)
 }
 
 static CURLcode
-inflate_stream(struct connectdata *conn,
-               struct SingleRequest *k)
+inflate_stream(struct connectdata *conn, struct contenc_writer *writer)
 {
+  struct zlib_params *zp = (struct zlib_params *) writer->params;
   int allow_restart = 1;
-  z_stream *z = &k->z;          /* zlib state structure */
+  z_stream *z = &zp->z;         /* zlib state structure */
   uInt nread = z->avail_in;
   Bytef *orig_in = z->next_in;
   int status;                   /* zlib status */
-  CURLcode result = CURLE_OK;   /* Curl_client_write status */
-  char *decomp;                 /* Put the decompressed data here. */
-
-  /* Dynamically allocate a buffer for decompression because it's uncommonly
-     large to hold on the stack */
-  decomp = malloc(DSIZ);
-  if(decomp == NULL) {
-    return exit_zlib(z, &k->zlib_init, CURLE_OUT_OF_MEMORY);
-  }
+  CURLcode result = CURLE_OK;   /* Curl_unencode_write status */
 
-  /* because the buffer size is fixed, iteratively decompress and transfer to
-     the client via client_write. */
+  /* because the buffer size is fixed, iteratively decompress and pass the
+     output on to the next writer, or to the client */
   for(;;) {
     /* (re)set buffer for decompressed output for every iteration */
-    z->next_out = (Bytef *)decomp;
-    z->avail_out = DSIZ;
+    z->next_out = (Bytef *) writer->outbuf;
+    z->avail_out = (uInt) writer->outsize;
 
     status = inflate(z, Z_SYNC_FLUSH);
     if(status == Z_OK || status == Z_STREAM_END) {
       allow_restart = 0;
-      if((DSIZ - z->avail_out) && (!k->ignorebody)) {
-        result = Curl_client_write(conn, CLIENTWRITE_BODY, decomp,
-                                   DSIZ - z->avail_out);
+      if(writer->outsize - z->avail_out) {
+        result = Curl_unencode_write(conn, writer->downstream, writer->outbuf,
+                                     writer->outsize - z->avail_out);
         /* if !CURLE_OK, clean up, return */
-        if(result) {
-          free(decomp);
-          return exit_zlib(z, &k->zlib_init, result);
-        }
+        if(result)
+          return exit_zlib(z, &zp->zlib_init, result);
       }
 
       /* Done? clean up, return */
       if(status == Z_STREAM_END) {
-        free(decomp);
         if(inflateEnd(z) == Z_OK)
-          return exit_zlib(z, &k->zlib_init, result);
+          return exit_zlib(z, &zp->zlib_init, result);
         else
-          return exit_zlib(z, &k->zlib_init, process_zlib_error(conn, z));
+          return exit_zlib(z, &zp->zlib_init, process_zlib_error(conn, z));
       }
 
-      /* Done with these bytes, exit */
+      /* Done with these bytes, exit. A full output buffer may mean that
+         zlib holds more output, so then go around once more. */
 
       /* status is always Z_OK at this point! */
-      if(z->avail_in == 0) {
-        free(decomp);
+      if(z->avail_in == 0 && z->avail_out)
         return result;
-      }
+    }
+    else if(status == Z_BUF_ERROR && z->avail_in == 0) {
+      /* the last round filled the buffer exactly and there was no more
+         output to get */
+      return result;
     }
     else if(allow_restart && status == Z_DATA_ERROR) {
       /* some servers seem to not generate zlib headers, so this is an attempt
@@ -148,8 +245,7 @@ inflate_stream(struct connectdata *conn,
 
       (void) inflateEnd(z);     /* don't care about the return code */
       if(inflateInit2(z, -MAX_WBITS) != Z_OK) {
-        free(decomp);
-        return exit_zlib(z, &k->zlib_init, process_zlib_error(conn, z));
+        return exit_zlib(z, &zp->zlib_init, process_zlib_error(conn, z));
       }
       z->next_in = orig_in;
       z->avail_in = nread;
@@ -157,39 +253,71 @@ inflate_stream(struct connectdata *conn,
       continue;
     }
     else {                      /* Error; exit loop, handle below */
-      free(decomp);
-      return exit_zlib(z, &k->zlib_init, process_zlib_error(conn, z));
+      return exit_zlib(z, &zp->zlib_init, process_zlib_error(conn, z));
     }
   }
   /* Will never get here */
 }
 
-CURLcode
-Curl_unencode_deflate_write(struct connectdata *conn,
-                            struct SingleRequest *k,
-                            ssize_t nread)
+static CURLcode zlib_init_writer(struct connectdata *conn,
+                                 struct contenc_writer *writer)
 {
-  z_stream *z = &k->z;          /* zlib state structure */
+  struct zlib_params *zp = (struct zlib_params *) writer->params;
+  z_stream *z = &zp->z;
 
-  /* Initialize zlib? */
-  if(k->zlib_init == ZLIB_UNINIT) {
-    memset(z, 0, sizeof(z_stream));
-    z->zalloc = (alloc_func)zalloc_cb;
-    z->zfree = (free_func)zfree_cb;
+  /* zlib itself is initialized when the first data arrives */
+  z->zalloc = (alloc_func) zalloc_cb;
+  z->zfree = (free_func) zfree_cb;
+  zp->zlib_init = ZLIB_UNINIT;
+
+  return init_outbuf(conn, writer);
+}
+
+static CURLcode deflate_unencode_write(struct connectdata *conn,
+                                       struct contenc_writer *writer,
+                                       const char *buf, size_t nbytes)
+{
+  struct zlib_params *zp = (struct zlib_params *) writer->params;
+  z_stream *z = &zp->z;         /* zlib state structure */
 
+  /* Initialize zlib? */
+  if(zp->zlib_init == ZLIB_UNINIT) {
     if(inflateInit(z) != Z_OK)
       return process_zlib_error(conn, z);
-    k->zlib_init = ZLIB_INIT;
+    zp->zlib_init = ZLIB_INIT;
   }
 
   /* Set the compressed input when this function is called */
-  z->next_in = (Bytef *)k->str;
-  z->avail_in = (uInt)nread;
+  z->next_in = (Bytef *) buf;
+  z->avail_in = (uInt) nbytes;
 
   /* Now uncompress the data */
-  return inflate_stream(conn, k);
+  return inflate_stream(conn, writer);
 }
 
+static void zlib_close_writer(struct contenc_writer *writer)
+{
+  struct zlib_params *zp = (struct zlib_params *) writer->params;
+  z_stream *z = &zp->z;
+
+#ifdef OLD_ZLIB_SUPPORT
+  /* a partial gzip header is kept in a block of its own */
+  if(zp->zlib_init == ZLIB_GZIP_HEADER)
+    Curl_safefree(z->next_in);
+#endif
+  if(zp->zlib_init != ZLIB_UNINIT)
+    (void) exit_zlib(z, &zp->zlib_init, CURLE_OK);
+}
+
+static const struct content_encoding deflate_encoding = {
+  "deflate",
+  NULL,
+  zlib_init_writer,
+  deflate_unencode_write,
+  zlib_close_writer,
+  sizeof(struct zlib_params)
+};
+
 #ifdef OLD_ZLIB_SUPPORT
 /* Skip over the gzip header */
 static enum {
@@ -274,47 +402,45 @@ static enum {
 }
 #endif
 
-CURLcode
-Curl_unencode_gzip_write(struct connectdata *conn,
-                         struct SingleRequest *k,
-                         ssize_t nread)
+
+static CURLcode gzip_unencode_write(struct connectdata *conn,
+                                    struct contenc_writer *writer,
+                                    const char *buf, size_t nbytes)
 {
-  z_stream *z = &k->z;          /* zlib state structure */
+  struct zlib_params *zp = (struct zlib_params *) writer->params;
+  z_stream *z = &zp->z;         /* zlib state structure */
+  ssize_t nread = (ssize_t) nbytes;
 
   /* Initialize zlib? */
-  if(k->zlib_init == ZLIB_UNINIT) {
-    memset(z, 0, sizeof(z_stream));
-    z->zalloc = (alloc_func)zalloc_cb;
-    z->zfree = (free_func)zfree_cb;
-
+  if(zp->zlib_init == ZLIB_UNINIT) {
     if(strcmp(zlibVersion(), "1.2.0.4") >= 0) {
       /* zlib ver. >= 1.2.0.4 supports transparent gzip decompressing */
       if(inflateInit2(z, MAX_WBITS+32) != Z_OK) {
         return process_zlib_error(conn, z);
       }
-      k->zlib_init = ZLIB_INIT_GZIP; /* Transparent gzip decompress state */
+      zp->zlib_init = ZLIB_INIT_GZIP; /* Transparent gzip decompress state */
     }
     else {
       /* we must parse the gzip header ourselves */
       if(inflateInit2(z, -MAX_WBITS) != Z_OK) {
         return process_zlib_error(conn, z);
       }
-      k->zlib_init = ZLIB_INIT;   /* Initial call state */
+      zp->zlib_init = ZLIB_INIT;   /* Initial call state */
     }
   }
 
-  if(k->zlib_init == ZLIB_INIT_GZIP) {
+  if(zp->zlib_init == ZLIB_INIT_GZIP) {
     /* Let zlib handle the gzip decompression entirely */
-    z->next_in = (Bytef *)k->str;
+    z->next_in = (Bytef *) buf;
     z->avail_in = (uInt)nread;
     /* Now uncompress the data */
-    return inflate_stream(conn, k);
+    return inflate_stream(conn, writer);
   }
 
 #ifndef OLD_ZLIB_SUPPORT
   /* Support for old zlib versions is compiled away and we are running with
      an old version, so return an error. */
-  return exit_zlib(z, &k->zlib_init, CURLE_FUNCTION_NOT_FOUND);
+  return exit_zlib(z, &zp->zlib_init, CURLE_FUNCTION_NOT_FOUND);
 
 #else
   /* This next mess is to get around the potential case where there isn't
@@ -327,41 +453,39 @@ Curl_unencode_gzip_write(struct connectdata *conn,
    * can handle the gzip header themselves.
    */
 
-  switch (k->zlib_init) {
+  switch (zp->zlib_init) {
   /* Skip over gzip header? */
   case ZLIB_INIT:
   {
     /* Initial call state */
     ssize_t hlen;
 
-    switch (check_gzip_header((unsigned char *)k->str, nread, &hlen)) {
+    switch (check_gzip_header((unsigned char *) buf, nread, &hlen)) {
     case GZIP_OK:
-      z->next_in = (Bytef *)k->str + hlen;
+      z->next_in = (Bytef *) buf + hlen;
       z->avail_in = (uInt)(nread - hlen);
-      k->zlib_init = ZLIB_GZIP_INFLATING; /* Inflating stream state */
+      zp->zlib_init = ZLIB_GZIP_INFLATING; /* Inflating stream state */
       break;
 
     case GZIP_UNDERFLOW:
-      /* We need more data so we can find the end of the gzip header.  It's
-       * possible that the memory block we malloc here will never be freed if
-       * the transfer abruptly aborts after this point.  Since it's unlikely
-       * that circumstances will be right for this code path to be followed in
-       * the first place, and it's even more unlikely for a transfer to fail
-       * immediately afterwards, it should seldom be a problem.
+      /* We need more data so we can find the end of the gzip header. The
+       * memory block we malloc here is freed when the writer is closed, if
+       * the transfer aborts before the rest of the header arrives.
        */
       z->avail_in = (uInt)nread;
       z->next_in = malloc(z->avail_in);
       if(z->next_in == NULL) {
-        return exit_zlib(z, &k->zlib_init, CURLE_OUT_OF_MEMORY);
+        return exit_zlib(z, &zp->zlib_init, CURLE_OUT_OF_MEMORY);
       }
-      memcpy(z->next_in, k->str, z->avail_in);
-      k->zlib_init = ZLIB_GZIP_HEADER;   /* Need more gzip header data state */
+      memcpy(z->next_in, buf, z->avail_in);
+      /* Need more gzip header data state */
+      zp->zlib_init = ZLIB_GZIP_HEADER;
       /* We don't have any data to inflate yet */
       return CURLE_OK;
 
     case GZIP_BAD:
     default:
-      return exit_zlib(z, &k->zlib_init, process_zlib_error(conn, z));
+      return exit_zlib(z, &zp->zlib_init, process_zlib_error(conn, z));
     }
 
   }
@@ -377,19 +501,19 @@ Curl_unencode_gzip_write(struct connectdata *conn,
     z->next_in = realloc(z->next_in, z->avail_in);
     if(z->next_in == NULL) {
       free(oldblock);
-      return exit_zlib(z, &k->zlib_init, CURLE_OUT_OF_MEMORY);
+      return exit_zlib(z, &zp->zlib_init, CURLE_OUT_OF_MEMORY);
     }
     /* Append the new block of data to the previous one */
-    memcpy(z->next_in + z->avail_in - nread, k->str, nread);
+    memcpy(z->next_in + z->avail_in - nread, buf, nread);
 
     switch (check_gzip_header(z->next_in, z->avail_in, &hlen)) {
     case GZIP_OK:
       /* This is the zlib stream data */
       free(z->next_in);
       /* Don't point into the malloced block since we just freed it */
-      z->next_in = (Bytef *)k->str + hlen + nread - z->avail_in;
+      z->next_in = (Bytef *) buf + hlen + nread - z->avail_in;
       z->avail_in = (uInt)(z->avail_in - hlen);
-      k->zlib_init = ZLIB_GZIP_INFLATING;   /* Inflating stream state */
+      zp->zlib_init = ZLIB_GZIP_INFLATING;   /* Inflating stream state */
       break;
 
     case GZIP_UNDERFLOW:
@@ -399,7 +523,7 @@ Curl_unencode_gzip_write(struct connectdata *conn,
     case GZIP_BAD:
     default:
       free(z->next_in);
-      return exit_zlib(z, &k->zlib_init, process_zlib_error(conn, z));
+      return exit_zlib(z, &zp->zlib_init, process_zlib_error(conn, z));
     }
 
   }
@@ -408,7 +532,7 @@ Curl_unencode_gzip_write(struct connectdata *conn,
   case ZLIB_GZIP_INFLATING:
   default:
     /* Inflating stream state */
-    z->next_in = (Bytef *)k->str;
+    z->next_in = (Bytef *) buf;
     z->avail_in = (uInt)nread;
     break;
   }
@@ -419,17 +543,302 @@ Curl_unencode_gzip_write(struct connectdata *conn,
   }
 
   /* We've parsed the header, now uncompress the data */
-  return inflate_stream(conn, k);
+  return inflate_stream(conn, writer);
 #endif
 }
 
-void Curl_unencode_cleanup(struct connectdata *conn)
+static const struct content_encoding gzip_encoding = {
+  "gzip",
+  "x-gzip",
+  zlib_init_writer,
+  gzip_unencode_write,
+  zlib_close_writer,
+  sizeof(struct zlib_params)
+};
+
+#endif /* HAVE_LIBZ */
+
+#ifdef HAVE_BROTLI
+
+/* Writer parameters for brotli */
+struct brotli_params {
+  BrotliDecoderState *br;       /* State structure for brotli, NULL once the
+                                   stream has ended */
+};
+
+static void *brotli_alloc_cb(void *opaque, size_t size)
+{
+  (void) opaque;
+  return malloc(size);
+}
+
+static void brotli_free_cb(void *opaque, void *ptr)
+{
+  (void) opaque;
+  free(ptr);
+}
+
+static CURLcode brotli_init_writer(struct connectdata *conn,
+                                   struct contenc_writer *writer)
+{
+  struct brotli_params *bp = (struct brotli_params *) writer->params;
+
+  bp->br = BrotliDecoderCreateInstance(brotli_alloc_cb, brotli_free_cb, NULL);
+  if(!bp->br)
+    return CURLE_OUT_OF_MEMORY;
+
+  return init_outbuf(conn, writer);
+}
+
+static CURLcode brotli_unencode_write(struct connectdata *conn,
+                                      struct contenc_writer *writer,
+                                      const char *buf, size_t nbytes)
+{
+  struct brotli_params *bp = (struct brotli_params *) writer->params;
+  const uint8_t *src = (const uint8_t *) buf;
+  size_t avail_in = nbytes;
+  BrotliDecoderResult r = BROTLI_DECODER_RESULT_NEEDS_MORE_OUTPUT;
+  CURLcode result = CURLE_OK;
+
+  if(!bp->br) {
+    failf(conn->data, "Error while processing content unencoding: "
+          "data after the end of the brotli stream");
+    return CURLE_BAD_CONTENT_ENCODING;
+  }
+
+  /* decompress into the output buffer and pass each buffer full on, until
+     all input is used and the decoder has no more output to give */
+  while((avail_in || r == BROTLI_DECODER_RESULT_NEEDS_MORE_OUTPUT) &&
+        !result) {
+    uint8_t *dst = (uint8_t *) writer->outbuf;
+    size_t avail_out = writer->outsize;
+
+    r = BrotliDecoderDecompressStream(bp->br, &avail_in, &src,
+                                      &avail_out, &dst, NULL);
+    if(avail_out != writer->outsize)
+      result = Curl_unencode_write(conn, writer->downstream, writer->outbuf,
+                                   writer->outsize - avail_out);
+
+    switch(r) {
+    case BROTLI_DECODER_RESULT_NEEDS_MORE_OUTPUT:
+    case BROTLI_DECODER_RESULT_NEEDS_MORE_INPUT:
+      break;
+    case BROTLI_DECODER_RESULT_SUCCESS:
+      BrotliDecoderDestroyInstance(bp->br);
+      bp->br = NULL;
+      if(avail_in && !result) {
+        failf(conn->data, "Error while processing content unencoding: "
+              "data after the end of the brotli stream");
+        result = CURLE_BAD_CONTENT_ENCODING;
+      }
+      return result;
+    case BROTLI_DECODER_RESULT_ERROR:
+    default:
+      failf(conn->data, "Error while processing content unencoding: %s",
+            BrotliDecoderErrorString(BrotliDecoderGetErrorCode(bp->br)));
+      return CURLE_BAD_CONTENT_ENCODING;
+    }
+  }
+
+  return result;
+}
+
+static void brotli_close_writer(struct contenc_writer *writer)
+{
+  struct brotli_params *bp = (struct brotli_params *) writer->params;
+
+  if(bp->br) {
+    BrotliDecoderDestroyInstance(bp->br);
+    bp->br = NULL;
+  }
+}
+
+static const struct content_encoding brotli_encoding = {
+  "br",
+  NULL,
+  brotli_init_writer,
+  brotli_unencode_write,
+  brotli_close_writer,
+  sizeof(struct brotli_params)
+};
+
+#endif /* HAVE_BROTLI */
+
+/* Any encoding we don't know fails the transfer on its first data */
+
+static CURLcode error_init_writer(struct connectdata *conn,
+                                  struct contenc_writer *writer)
+{
+  (void)conn;
+  (void)writer;
+  return CURLE_OK;
+}
+
+static CURLcode error_unencode_write(struct connectdata *conn,
+                                     struct contenc_writer *writer,
+                                     const char *buf, size_t nbytes)
+{
+  (void)writer;
+  (void)buf;
+  (void)nbytes;
+  failf(conn->data, "Unrecognized content encoding type. "
+        "libcurl understands " ALL_CONTENT_ENCODINGS " content encodings.");
+  return CURLE_BAD_CONTENT_ENCODING;
+}
+
+static void error_close_writer(struct contenc_writer *writer)
+{
+  (void)writer;
+}
+
+static const struct content_encoding error_encoding = {
+  NULL,
+  NULL,
+  error_init_writer,
+  error_unencode_write,
+  error_close_writer,
+  0
+};
+
+static const struct content_encoding * const encodings[] = {
+  &identity_encoding,
+#ifdef HAVE_LIBZ
+  &deflate_encoding,
+  &gzip_encoding,
+#endif
+#ifdef HAVE_BROTLI
+  &brotli_encoding,
+#endif
+  NULL
+};
+
+/* Find the handler for the encoding called 'name' of 'len' bytes */
+static const struct content_encoding *find_encoding(const char *name,
+                                                    size_t len)
+{
+  const struct content_encoding * const *cep;
+
+  for(cep = encodings; *cep; cep++) {
+    const struct content_encoding *ce = *cep;
+    if((strlen(ce->name) == len && Curl_raw_nequal(name, ce->name, len)) ||
+       (ce->alias && strlen(ce->alias) == len &&
+        Curl_raw_nequal(name, ce->alias, len)))
+      return ce;
+  }
+  return &error_encoding;
+}
+
+/* Create a writer for 'handler' on top of 'downstream' */
+static struct contenc_writer *
+new_unencoding_writer(struct connectdata *conn,
+                      const struct content_encoding *handler,
+                      struct contenc_writer *downstream)
+{
+  struct contenc_writer *writer;
+
+  /* the encoding-specific state is kept in the same block, after the
+     writer itself */
+  writer = calloc(1, sizeof(struct contenc_writer) + handler->paramsize);
+  if(!writer)
+    return NULL;
+
+  writer->handler = handler;
+  writer->downstream = downstream;
+  writer->params = (void *) (writer + 1);
+  if(handler->init_writer(conn, writer)) {
+    handler->close_writer(writer);
+    free(writer->outbuf);
+    free(writer);
+    return NULL;
+  }
+
+  return writer;
+}
+
+CURLcode Curl_build_unencoding_stack(struct connectdata *conn,
+                                     const char *enclist, bool maybechunked)
 {
   struct SessionHandle *data = conn->data;
   struct SingleRequest *k = &data->req;
-  z_stream *z = &k->z;
-  if(k->zlib_init != ZLIB_UNINIT)
-    (void) exit_zlib(z, &k->zlib_init, CURLE_OK);
+
+  do {
+    const char *name;
+    size_t namelen;
+
+    /* Find the start and length of the next encoding name in the list */
+    while(ISSPACE(*enclist) || *enclist == ',')
+      enclist++;
+
+    name = enclist;
+
+    for(namelen = 0; *enclist && *enclist != ','; enclist++)
+      if(!ISSPACE(*enclist))
+        namelen = enclist - name + 1;
+
+    /* chunked is a transfer-encoding that is dealt with before the data
+       gets here */
+    if(maybechunked && namelen == 7 && Curl_raw_nequal(name, "chunked", 7)) {
+      k->chunk = TRUE; /* chunks coming our way */
+
+      /* init our chunky engine */
+      Curl_httpchunk_init(conn);
+    }
+    else if(namelen && !data->set.http_ce_skip) {
+      struct contenc_writer *writer;
+      int depth = 0;
+
+      for(writer = k->writer_stack; writer; writer = writer->downstream)
+        depth++;
+      if(depth >= MAX_ENCODE_STACK) {
+        failf(data, "Reject response due to more than %d content encodings",
+              MAX_ENCODE_STACK);
+        return CURLE_BAD_CONTENT_ENCODING;
+      }
+
+      /* the encoding applied last is listed last, so it's the first one to
+         be undone: put its writer on top of the stack */
+      writer = new_unencoding_writer(conn, find_encoding(name, namelen),
+                                     k->writer_stack);
+      if(!writer)
+        return CURLE_OUT_OF_MEMORY;
+      k->writer_stack = writer;
+    }
+  } while(*enclist);
+
+  return CURLE_OK;
 }
 
-#endif /* HAVE_LIBZ */
+CURLcode Curl_unencode_write(struct connectdata *conn,
+                             struct contenc_writer *writer,
+                             const char *buf, size_t nbytes)
+{
+  struct pgrsmark mark;
+  CURLcode result;
+
+  if(!nbytes)
+    return CURLE_OK;
+
+  /* below the bottom writer, the data is all decoded */
+  if(!writer)
+    return Curl_client_write(conn, CLIENTWRITE_BODY, (char *) buf, nbytes);
+
+  Curl_pgrsStatStart(conn->data, &mark);
+  result = writer->handler->unencode_write(conn, writer, buf, nbytes);
+  Curl_pgrsStatStop(conn->data, &mark, STAT_DECODE, 0);
+
+  return result;
+}
+
+void Curl_unencode_cleanup(struct connectdata *conn)
+{
+  struct SingleRequest *k = &conn->data->req;
+  struct contenc_writer *writer = k->writer_stack;
+
+  while(writer) {
+    k->writer_stack = writer->downstream;
+    writer->handler->close_writer(writer);
+    free(writer->outbuf);
+    free(writer);
+    writer = k->writer_stack;
+  }
+}
@@ -7,7 +7,7 @@
  *                            | (__| |_| |  _ <| |___
  *                             \___|\___/|_| \_\_____|
  *
- * Copyright (C) 1998 - 2011, Daniel Stenberg, <daniel@haxx.se>, et al.
+ * Copyright (C) 1998 - 2016, Daniel Stenberg, <daniel@haxx.se>, et al.
  *
  * This software is licensed as described in the file COPYING, which
  * you should have received as part of this distribution. The terms
@@ -23,26 +23,32 @@
  ***************************************************************************/
 #include "curl_setup.h"
 
+struct contenc_writer;
+
 /*
  * Comma-separated list all supported Content-Encodings ('identity' is implied)
  */
-#ifdef HAVE_LIBZ
+#if defined(HAVE_LIBZ) && defined(HAVE_BROTLI)
+#define ALL_CONTENT_ENCODINGS "deflate, gzip, br"
+#elif defined(HAVE_LIBZ)
 #define ALL_CONTENT_ENCODINGS "deflate, gzip"
-/* force a cleanup */
-void Curl_unencode_cleanup(struct connectdata *conn);
+#elif defined(HAVE_BROTLI)
+#define ALL_CONTENT_ENCODINGS "br"
 #else
 #define ALL_CONTENT_ENCODINGS "identity"
-#define Curl_unencode_cleanup(x) Curl_nop_stmt
 #endif
 
-CURLcode Curl_unencode_deflate_write(struct connectdata *conn,
-                                     struct SingleRequest *req,
-                                     ssize_t nread);
+/* Set up the decoders for a comma-separated list of encodings, as found in a
+   Content-Encoding: or Transfer-Encoding: header. */
+CURLcode Curl_build_unencoding_stack(struct connectdata *conn,
+                                     const char *enclist, bool maybechunked);
 
-CURLcode
-Curl_unencode_gzip_write(struct connectdata *conn,
-                         struct SingleRequest *k,
-                         ssize_t nread);
+/* Pass received body data through the decoders and on to the client */
+CURLcode Curl_unencode_write(struct connectdata *conn,
+                             struct contenc_writer *writer,
+                             const char *buf, size_t nbytes);
 
+/* force a cleanup */
+void Curl_unencode_cleanup(struct connectdata *conn);
 
 #endif /* HEADER_CURL_CONTENT_ENCODING_H */
@@ -297,32 +297,118 @@ static void strstore(char **str, const char *newstr)
   *str = strdup(newstr);
 }
 
+/*
+ * cookie_topdomain() returns a pointer to the last two labels of the given
+ * domain name ("example.com" for "www.example.com"), or NULL if the name
+ * has no dot in it.
+ *
+ * A host name that tail-matches a cookie domain with a dot in it ends with
+ * the same two labels as that domain, so only cookies whose domains have
+ * the same top domain as the host need to be considered for a request.
+ */
+static const char *cookie_topdomain(const char *domain)
+{
+  const char *top = strrchr(domain, '.');
+
+  if(!top)
+    return NULL;
+
+  while(top > domain && top[-1] != '.')
+    top--;
+  return top;
+}
+
+/*
+ * cookiehash() returns the index of the CookieInfo hash chain that cookies
+ * for the given domain are stored in, and that is searched for requests to
+ * the given host name. The hash is case insensitive, as domain matching is.
+ */
+static size_t cookiehash(const char *domain)
+{
+  const char *top = domain ? cookie_topdomain(domain) : NULL;
+  size_t h = 5381;
+
+  if(!top)
+    return COOKIE_HASH_SIZE;
+
+  while(*top) {
+    h = (h << 5) + h + (unsigned char)Curl_raw_toupper(*top);
+    top++;
+  }
+  return h % COOKIE_HASH_SIZE;
+}
+
+/*
+ * link_cookie() adds a cookie to the end of the CookieInfo list and to the
+ * hash chain for its domain.
+ */
+static void link_cookie(struct CookieInfo *c, struct Cookie *co)
+{
+  size_t h = cookiehash(co->domain);
+
+  co->next = NULL;
+  co->prev = c->lastcookie;
+  if(c->lastcookie)
+    c->lastcookie->next = co;
+  else
+    c->cookies = co;
+  c->lastcookie = co;
+
+  co->hnext = c->hash[h];
+  c->hash[h] = co;
+
+  if(co->expires && co->expires < c->next_expiration)
+    c->next_expiration = co->expires;
+  c->numcookies++;
+}
+
+/*
+ * unlink_cookie() removes a cookie from the CookieInfo list and its hash
+ * chain. It does not free it.
+ */
+static void unlink_cookie(struct CookieInfo *c, struct Cookie *co)
+{
+  struct Cookie **pp = &c->hash[cookiehash(co->domain)];
+
+  while(*pp != co)
+    pp = &(*pp)->hnext;
+  *pp = co->hnext;
+
+  if(co->prev)
+    co->prev->next = co->next;
+  else
+    c->cookies = co->next;
+  if(co->next)
+    co->next->prev = co->prev;
+  else
+    c->lastcookie = co->prev;
+
+  c->numcookies--;
+}
+
 /*
  * remove_expired() removes expired cookies.
+ *
+ * The jar remembers the earliest expiry time of the cookies in it, so the
+ * list is only walked when at least one cookie has actually expired.
  */
 static void remove_expired(struct CookieInfo *cookies)
 {
-  struct Cookie *co, *nx, *pv;
+  struct Cookie *co, *nx;
   curl_off_t now = (curl_off_t)time(NULL);
 
-  co = cookies->cookies;
-  pv = NULL;
-  while(co) {
+  if(now <= cookies->next_expiration)
+    return;
+
+  cookies->next_expiration = CURL_OFF_T_MAX;
+  for(co = cookies->cookies; co; co = nx) {
     nx = co->next;
     if(co->expires && co->expires < now) {
-      if(co == cookies->cookies) {
-        cookies->cookies = co->next;
-      }
-      else {
-        pv->next = co->next;
-      }
-      cookies->numcookies--;
+      unlink_cookie(cookies, co);
       freecookie(co);
     }
-    else {
-      pv = co;
-    }
-    co = nx;
+    else if(co->expires && co->expires < cookies->next_expiration)
+      cookies->next_expiration = co->expires;
   }
 }
 
@@ -378,7 +464,6 @@ Curl_cookie_add(struct SessionHandle *data,
   struct Cookie *clist;
   char name[MAX_NAME];
   struct Cookie *co;
-  struct Cookie *lastc=NULL;
   time_t now = time(NULL);
   bool replace_old = FALSE;
   bool badcookie = FALSE; /* cookies are good by default. mmmmm yummy */
@@ -810,7 +895,9 @@ Curl_cookie_add(struct SessionHandle *data,
   }
 #endif
 
-  clist = c->cookies;
+  /* only cookies with the same domain can be replaced by this one, and
+     they are all in the same hash chain */
+  clist = c->hash[cookiehash(co->domain)];
   replace_old = FALSE;
   while(clist) {
     if(Curl_raw_equal(clist->name, co->name)) {
@@ -853,7 +940,10 @@ Curl_cookie_add(struct SessionHandle *data,
       }
 
       if(replace_old) {
-        co->next = clist->next; /* get the next-pointer first */
+        /* keep the old cookie's place in the list and its hash chain */
+        co->next = clist->next;
+        co->prev = clist->prev;
+        co->hnext = clist->hnext;
 
         /* then free all the old pointers */
         free(clist->name);
@@ -870,17 +960,12 @@ Curl_cookie_add(struct SessionHandle *data,
         free(co);   /* free the newly alloced memory */
         co = clist; /* point to the previous struct instead */
 
-        /* We have replaced a cookie, now skip the rest of the list but
-           make sure the 'lastc' pointer is properly set */
-        do {
-          lastc = clist;
-          clist = clist->next;
-        } while(clist);
+        if(co->expires && co->expires < c->next_expiration)
+          c->next_expiration = co->expires;
         break;
       }
     }
-    lastc = clist;
-    clist = clist->next;
+    clist = clist->hnext;
   }
 
   if(c->running)
@@ -890,14 +975,9 @@ Curl_cookie_add(struct SessionHandle *data,
           replace_old?"Replaced":"Added", co->name, co->value,
           co->domain, co->path, co->expires);
 
-  if(!replace_old) {
-    /* then make the last item point on this new one */
-    if(lastc)
-      lastc->next = co;
-    else
-      c->cookies = co;
-    c->numcookies++; /* one more cookie in the jar */
-  }
+  if(!replace_old)
+    /* add this new one to the end of the list */
+    link_cookie(c, co);
 
   return co;
 }
@@ -1045,6 +1125,9 @@ struct Cookie *Curl_cookie_getlist(struct CookieInfo *c,
   struct Cookie *mainco=NULL;
   size_t matches = 0;
   bool is_ip;
+  struct Cookie *chains[2];
+  size_t h;
+  int chain;
 
   if(!c || !c->cookies)
     return NULL; /* no cookie struct or no cookies in the struct */
@@ -1055,57 +1138,63 @@ struct Cookie *Curl_cookie_getlist(struct CookieInfo *c,
   /* check if host is an IP(v4|v6) address */
   is_ip = isip(host);
 
-  co = c->cookies;
-
-  while(co) {
-    /* only process this cookie if it is not expired or had no expire
-       date AND that if the cookie requires we're secure we must only
-       continue if we are! */
-    if((!co->expires || (co->expires > now)) &&
-       (co->secure?secure:TRUE)) {
-
-      /* now check if the domain is correct */
-      if(!co->domain ||
-         (co->tailmatch && !is_ip && tailmatch(co->domain, host)) ||
-         ((!co->tailmatch || is_ip) && Curl_raw_equal(host, co->domain)) ) {
-        /* the right part of the host matches the domain stuff in the
-           cookie data */
-
-        /* now check the left part of the path with the cookies path
-           requirement */
-        if(!co->spath || pathmatch(co->spath, path) ) {
-
-          /* and now, we know this is a match and we should create an
-             entry for the return-linked-list */
-
-          newco = malloc(sizeof(struct Cookie));
-          if(newco) {
-            /* first, copy the whole source cookie: */
-            memcpy(newco, co, sizeof(struct Cookie));
-
-            /* then modify our next */
-            newco->next = mainco;
-
-            /* point the main to us */
-            mainco = newco;
-
-            matches++;
-          }
-          else {
-            fail:
-            /* failure, clear up the allocated chain and return NULL */
-            while(mainco) {
-              co = mainco->next;
-              free(mainco);
-              mainco = co;
+  /* the only cookies that can match are the ones in the hash chain for
+     this host and the ones without a dot in their domain names */
+  h = cookiehash(host);
+  chains[0] = c->hash[h];
+  chains[1] = (h != COOKIE_HASH_SIZE) ? c->hash[COOKIE_HASH_SIZE] : NULL;
+
+  for(chain = 0; chain < 2; chain++) {
+    for(co = chains[chain]; co; co = co->hnext) {
+      /* only process this cookie if it is not expired or had no expire
+         date AND that if the cookie requires we're secure we must only
+         continue if we are! */
+      if((!co->expires || (co->expires > now)) &&
+         (co->secure?secure:TRUE)) {
+
+        /* now check if the domain is correct */
+        if(!co->domain ||
+           (co->tailmatch && !is_ip && tailmatch(co->domain, host)) ||
+           ((!co->tailmatch || is_ip) &&
+            Curl_raw_equal(host, co->domain)) ) {
+          /* the right part of the host matches the domain stuff in the
+             cookie data */
+
+          /* now check the left part of the path with the cookies path
+             requirement */
+          if(!co->spath || pathmatch(co->spath, path) ) {
+
+            /* and now, we know this is a match and we should create an
+               entry for the return-linked-list */
+
+            newco = malloc(sizeof(struct Cookie));
+            if(newco) {
+              /* first, copy the whole source cookie: */
+              memcpy(newco, co, sizeof(struct Cookie));
+
+              /* then modify our next */
+              newco->next = mainco;
+
+              /* point the main to us */
+              mainco = newco;
+
+              matches++;
+            }
+            else {
+              fail:
+              /* failure, clear up the allocated chain and return NULL */
+              while(mainco) {
+                co = mainco->next;
+                free(mainco);
+                mainco = co;
+              }
+
+              return NULL;
             }
-
-            return NULL;
           }
         }
       }
     }
-    co = co->next;
   }
 
   if(matches) {
@@ -1153,6 +1242,8 @@ void Curl_cookie_clearall(struct CookieInfo *cookies)
   if(cookies) {
     Curl_cookie_freelist(cookies->cookies, TRUE);
     cookies->cookies = NULL;
+    cookies->lastcookie = NULL;
+    memset(cookies->hash, 0, sizeof(cookies->hash));
     cookies->numcookies = 0;
   }
 }
@@ -1192,32 +1283,18 @@ void Curl_cookie_freelist(struct Cookie *co, bool cookiestoo)
  ****************************************************************************/
 void Curl_cookie_clearsess(struct CookieInfo *cookies)
 {
-  struct Cookie *first, *curr, *next, *prev = NULL;
+  struct Cookie *curr, *next;
 
   if(!cookies || !cookies->cookies)
     return;
 
-  first = curr = prev = cookies->cookies;
-
-  for(; curr; curr = next) {
+  for(curr = cookies->cookies; curr; curr = next) {
     next = curr->next;
     if(!curr->expires) {
-      if(first == curr)
-        first = next;
-
-      if(prev == curr)
-        prev = next;
-      else
-        prev->next = next;
-
+      unlink_cookie(cookies, curr);
       freecookie(curr);
-      cookies->numcookies--;
     }
-    else
-      prev = curr;
   }
-
-  cookies->cookies = first;
 }
 
 
@@ -7,7 +7,7 @@
  *                            | (__| |_| |  _ <| |___
  *                             \___|\___/|_| \_\_____|
  *
- * Copyright (C) 1998 - 2011, Daniel Stenberg, <daniel@haxx.se>, et al.
+ * Copyright (C) 1998 - 2016, Daniel Stenberg, <daniel@haxx.se>, et al.
  *
  * This software is licensed as described in the file COPYING, which
  * you should have received as part of this distribution. The terms
@@ -27,6 +27,8 @@
 
 struct Cookie {
   struct Cookie *next; /* next in the chain */
+  struct Cookie *prev; /* previous in the CookieInfo list */
+  struct Cookie *hnext; /* next in the same CookieInfo hash chain */
   char *name;        /* <this> = value */
   char *value;       /* name = <this> */
   char *path;         /* path = <this> which is in Set-Cookie: */
@@ -45,9 +47,20 @@ struct Cookie {
   bool httponly;     /* true if the httponly directive is present */
 };
 
+/* number of hash chains cookies are spread over by domain */
+#define COOKIE_HASH_SIZE 256
+
 struct CookieInfo {
-  /* linked list of cookies we know of */
+  /* linked list of cookies we know of, in the order they were added */
   struct Cookie *cookies;
+  struct Cookie *lastcookie; /* last cookie in that list */
+
+  /* the same cookies, chained on a hash of the last two labels of their
+     domain names. The extra chain at the end holds the cookies without a
+     dot in their domain names, which are checked for every host */
+  struct Cookie *hash[COOKIE_HASH_SIZE + 1];
+  curl_off_t next_expiration; /* earliest expiry time of any cookie, or
+                                 CURL_OFF_T_MAX if none expire */
 
   char *filename;  /* file we read from/write to */
   bool running;    /* state info, for cookie adding information */
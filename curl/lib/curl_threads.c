@@ -28,6 +28,11 @@
 #  ifdef HAVE_PTHREAD_H
 #    include <pthread.h>
 #  endif
+#  ifdef HAVE_SYS_TIME_H
+#    include <sys/time.h>
+#  endif
+#  include <time.h>
+#  include <errno.h>
 #elif defined(USE_THREADS_WIN32)
 #  ifdef HAVE_PROCESS_H
 #    include <process.h>
@@ -98,6 +103,29 @@ int Curl_thread_join(curl_thread_t *hnd)
   return ret;
 }
 
+int Curl_cond_timedwait(curl_cond_t *cond, curl_mutex_t *mtx, long ms)
+{
+  struct timespec ts;
+#ifdef HAVE_GETTIMEOFDAY
+  struct timeval now;
+
+  (void)gettimeofday(&now, NULL);
+  ts.tv_sec = now.tv_sec;
+  ts.tv_nsec = now.tv_usec * 1000;
+#else
+  ts.tv_sec = time(NULL);
+  ts.tv_nsec = 0;
+#endif
+  ts.tv_sec += ms / 1000;
+  ts.tv_nsec += (ms % 1000) * 1000000;
+  if(ts.tv_nsec >= 1000000000) {
+    ts.tv_sec++;
+    ts.tv_nsec -= 1000000000;
+  }
+
+  return (pthread_cond_timedwait(cond, mtx, &ts) == ETIMEDOUT);
+}
+
 #elif defined(USE_THREADS_WIN32)
 
 curl_thread_t Curl_thread_create(unsigned int (CURL_STDCALL *func) (void*),
@@ -135,4 +163,20 @@ int Curl_thread_join(curl_thread_t *hnd)
   return ret;
 }
 
+int Curl_cond_timedwait(curl_cond_t *cond, curl_mutex_t *mtx, long ms)
+{
+#if !defined(_WIN32_WINNT) || !defined(_WIN32_WINNT_VISTA) || \
+    (_WIN32_WINNT < _WIN32_WINNT_VISTA)
+  (void)cond;
+  LeaveCriticalSection(mtx);
+  Sleep(ms < 1 ? 1 : (ms > 16 ? 16 : (DWORD)ms));
+  EnterCriticalSection(mtx);
+  return 0;
+#else
+  if(SleepConditionVariableCS(cond, mtx, (DWORD)ms))
+    return 0;
+  return (GetLastError() == ERROR_TIMEOUT);
+#endif
+}
+
 #endif /* USE_THREADS_* */
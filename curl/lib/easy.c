@@ -1038,11 +1038,19 @@ CURLcode curl_easy_pause(CURL *curl, int action)
        again and then we'll get a new copy allocted and stored in
        the tempwrite variables */
     char *tempwrite = data->state.tempwrite;
+    struct connectdata *conn = data->easy_conn;
+    struct SessionHandle *owner = conn->data;
+
+    /* the client writes are done for the connection's transfer, which is
+       another one when it is multiplexed */
+    conn->data = data;
 
     data->state.tempwrite = NULL;
-    result = Curl_client_chop_write(data->easy_conn, data->state.tempwritetype,
+    result = Curl_client_chop_write(conn, data->state.tempwritetype,
                                     tempwrite, data->state.tempwritesize);
     free(tempwrite);
+
+    conn->data = owner;
   }
 
   /* if there's no error and we're not pausing both directions, we want
@@ -52,6 +52,9 @@ CURLcode Curl_initinfo(struct SessionHandle *data)
   pro->timespent = 0;
   pro->t_redirect = 0;
 
+  pro->instrument = data->set.instrument;
+  memset(&pro->stats, 0, sizeof(pro->stats));
+
   info->httpcode = 0;
   info->httpproxycode = 0;
   info->httpversion = 0;
@@ -264,6 +267,7 @@ static CURLcode getinfo_slist(struct SessionHandle *data, CURLINFO info,
 {
   union {
     struct curl_certinfo *to_certinfo;
+    struct curl_transfer_stats *to_stats;
     struct curl_slist    *to_slist;
   } ptr;
 
@@ -280,6 +284,11 @@ static CURLcode getinfo_slist(struct SessionHandle *data, CURLINFO info,
     ptr.to_certinfo = &data->info.certs;
     *param_slistp = ptr.to_slist;
     break;
+  case CURLINFO_TRANSFER_STATS:
+    /* Return a pointer to the stats struct, not an slist either */
+    ptr.to_stats = &data->progress.stats;
+    *param_slistp = ptr.to_slist;
+    break;
   case CURLINFO_TLS_SESSION:
   case CURLINFO_TLS_SSL_PTR:
     {
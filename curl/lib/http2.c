@@ -35,6 +35,8 @@
 #include "url.h"
 #include "connect.h"
 #include "strtoofft.h"
+#include "progress.h"
+#include "content_encoding.h"
 
 /* The last 3 #include files should be in this order */
 #include "curl_printf.h"
@@ -148,6 +150,7 @@ void Curl_http2_setup_req(struct SessionHandle *data)
   http->status_code = -1;
   http->pausedata = NULL;
   http->pauselen = 0;
+  http->write_result = CURLE_OK;
   http->error_code = NGHTTP2_NO_ERROR;
   http->closed = FALSE;
   http->mem = data->state.buffer;
@@ -585,6 +588,62 @@ static int on_invalid_frame_recv(nghttp2_session *session,
   return 0;
 }
 
+/*
+ * direct_ok() returns TRUE if a piece of DATA for this transfer can be
+ * passed on straight from the connection buffer. That is when
+ * readwrite_data() would do nothing more with it than count it and write it:
+ * the headers and the first piece of the body have been dealt with, nothing
+ * is buffered for the transfer that should go first, it isn't paused or held
+ * back by a receive speed limit and the data doesn't go past the expected
+ * size.
+ */
+static bool direct_ok(struct SessionHandle *data, struct HTTP *stream,
+                      size_t len)
+{
+  struct SingleRequest *k = &data->req;
+
+  return stream->bodystarted &&
+    (stream->nread_header_recvbuf == stream->header_recvbuf->size_used) &&
+    !stream->memlen && !stream->pausedata &&
+    !k->header && k->bodywrites &&
+    ((k->keepon & (KEEP_RECV|KEEP_RECV_PAUSE)) == KEEP_RECV) &&
+    !data->set.max_recv_speed && (data->mstate != CURLM_STATE_TOOFAST) &&
+    ((k->maxdownload == -1) ||
+     (k->bytecount + (curl_off_t)len <= k->maxdownload));
+}
+
+/*
+ * direct_write() passes DATA from the connection buffer through the
+ * transfer's decoders to its write callback, the same way readwrite_data()
+ * writes what Curl_read() returns. The transfer doesn't have to be the one
+ * the connection is working for right now.
+ */
+static CURLcode direct_write(struct connectdata *conn,
+                             struct SessionHandle *data,
+                             const uint8_t *mem, size_t len)
+{
+  struct SingleRequest *k = &data->req;
+  struct SessionHandle *owner = conn->data;
+  CURLcode result = CURLE_OK;
+
+  /* the client writes are done for the connection's transfer */
+  conn->data = data;
+
+  k->bodywrites++;
+  if(data->set.verbose)
+    Curl_debug(data, CURLINFO_DATA_IN, (char *)mem, len, conn);
+
+  k->bytecount += len;
+  Curl_pgrsSetDownloadCounter(data, k->bytecount);
+
+  if(!k->ignorebody)
+    result = Curl_unencode_write(conn, k->writer_stack, (const char *)mem,
+                                 len);
+
+  conn->data = owner;
+  return result;
+}
+
 static int on_data_chunk_recv(nghttp2_session *session, uint8_t flags,
                               int32_t stream_id,
                               const uint8_t *data, size_t len, void *userp)
@@ -610,8 +669,36 @@ static int on_data_chunk_recv(nghttp2_session *session, uint8_t flags,
   if(!stream)
     return NGHTTP2_ERR_CALLBACK_FAILURE;
 
+  if(stream->write_result) {
+    /* the transfer has failed to take data already, drop this */
+    nghttp2_session_consume(session, stream_id, len);
+    return 0;
+  }
+
+  if(direct_ok(data_s, stream, len)) {
+    CURLcode result = direct_write(conn, data_s, data, len);
+
+    /* the data is delivered, open up the window for more */
+    nghttp2_session_consume(session, stream_id, len);
+
+    if(result) {
+      /* the transfer gets the error the next time it reads */
+      stream->write_result = result;
+      data_s->state.drain++;
+      conn->proto.httpc.drain_total++;
+      if(conn->data != data_s)
+        Curl_expire(data_s, 1);
+    }
+    return 0;
+  }
+
   nread = MIN(stream->len, len);
   memcpy(&stream->mem[stream->memlen], data, nread);
+  Curl_pgrsStatCount(data_s, STAT_COPY, nread);
+
+  /* what is copied to the transfer's buffer counts as consumed, the rest
+     when it is picked up from the connection buffer */
+  nghttp2_session_consume(session, stream_id, nread);
 
   stream->len -= nread;
   stream->memlen += nread;
@@ -987,6 +1074,7 @@ CURLcode Curl_http2_init(struct connectdata *conn)
   if(!conn->proto.httpc.h2) {
     int rc;
     nghttp2_session_callbacks *callbacks;
+    nghttp2_option *option;
 
     conn->proto.httpc.inbuf = malloc(H2_BUFSIZE);
     if(conn->proto.httpc.inbuf == NULL)
@@ -1030,9 +1118,22 @@ CURLcode Curl_http2_init(struct connectdata *conn)
 
     nghttp2_session_callbacks_set_error_callback(callbacks, error_callback);
 
+    rc = nghttp2_option_new(&option);
+    if(rc) {
+      nghttp2_session_callbacks_del(callbacks);
+      failf(conn->data, "Couldn't initialize nghttp2 options!");
+      return CURLE_OUT_OF_MEMORY;
+    }
+
+    /* WINDOW_UPDATE frames are sent as the transfers get the data, not when
+       nghttp2 has parsed it, see on_data_chunk_recv() */
+    nghttp2_option_set_no_auto_window_update(option, 1);
+
     /* The nghttp2 session is not yet setup, do it */
-    rc = nghttp2_session_client_new(&conn->proto.httpc.h2, callbacks, conn);
+    rc = nghttp2_session_client_new2(&conn->proto.httpc.h2, callbacks, conn,
+                                     option);
 
+    nghttp2_option_del(option);
     nghttp2_session_callbacks_del(callbacks);
 
     if(rc) {
@@ -1220,6 +1321,22 @@ static ssize_t http2_handle_stream_close(struct connectdata *conn,
   return 0;
 }
 
+/*
+ * http2_write_failed() returns the error from writing data that was passed
+ * on straight from the connection buffer.
+ */
+static ssize_t http2_write_failed(struct http_conn *httpc,
+                                  struct SessionHandle *data,
+                                  struct HTTP *stream, CURLcode *err)
+{
+  DEBUGASSERT(httpc->drain_total >= data->state.drain);
+  httpc->drain_total -= data->state.drain;
+  data->state.drain = 0;
+
+  *err = stream->write_result;
+  return -1;
+}
+
 /*
  * h2_pri_spec() fills in the pri_spec struct, used by nghttp2 to send weight
  * and dependency to the peer. It also stores the updated values in the state
@@ -1296,6 +1413,9 @@ static ssize_t http2_recv(struct connectdata *conn, int sockindex,
   stream->upload_mem = NULL;
   stream->upload_len = 0;
 
+  if(stream->write_result)
+    return http2_write_failed(httpc, data, stream, err);
+
   /*
    * At this point 'stream' is just in the SessionHandle the connection
    * identifies as its owner at this time.
@@ -1327,6 +1447,7 @@ static ssize_t http2_recv(struct connectdata *conn, int sockindex,
       /* if we didn't get the same buffer this time, we must move the data to
          the beginning */
       memmove(mem, stream->mem, stream->memlen);
+      Curl_pgrsStatCount(data, STAT_COPY, stream->memlen);
       stream->len = len - stream->memlen;
       stream->mem = mem;
     }
@@ -1344,6 +1465,8 @@ static ssize_t http2_recv(struct connectdata *conn, int sockindex,
     DEBUGASSERT(httpc->pause_stream_id == stream->stream_id);
     nread = MIN(len, stream->pauselen);
     memcpy(mem, stream->pausedata, nread);
+    Curl_pgrsStatCount(data, STAT_COPY, nread);
+    nghttp2_session_consume(httpc->h2, stream->stream_id, nread);
 
     stream->pausedata += nread;
     stream->pauselen -= nread;
@@ -1357,6 +1480,12 @@ static ssize_t http2_recv(struct connectdata *conn, int sockindex,
       stream->pausedata = NULL;
       stream->pauselen = 0;
 
+      /* The rest of the DATA frame goes into the buffer after what is
+         returned now, it must not be passed on directly ahead of it */
+      stream->mem = mem;
+      stream->memlen = nread;
+      stream->len = len - nread;
+
       /* When NGHTTP2_ERR_PAUSE is returned from
          data_source_read_callback, we might not process DATA frame
          fully.  Calling nghttp2_session_mem_recv() again will
@@ -1368,6 +1497,8 @@ static ssize_t http2_recv(struct connectdata *conn, int sockindex,
         *err = result;
         return -1;
       }
+      nread = stream->memlen;
+      stream->memlen = 0;
     }
     DEBUGF(infof(data, "http2_recv: returns unpaused %zd bytes on stream %u\n",
                  nread, stream->stream_id));
@@ -1459,6 +1590,10 @@ static ssize_t http2_recv(struct connectdata *conn, int sockindex,
       return -1;
     }
   }
+  if(stream->write_result)
+    /* writing data that was passed on directly failed */
+    return http2_write_failed(httpc, data, stream, err);
+
   if(stream->memlen) {
     ssize_t retlen = stream->memlen;
     DEBUGF(infof(data, "http2_recv: returns %zd for stream %u\n",
@@ -24,6 +24,10 @@
 
 #include <curl/curl.h>
 
+#ifdef HAVE_SYS_EPOLL_H
+#include <sys/epoll.h>
+#endif
+
 #include "urldata.h"
 #include "transfer.h"
 #include "url.h"
@@ -304,10 +308,18 @@ struct Curl_multi *Curl_multi_handle(int hashsize, /* socket hash */
     return NULL;
 
   multi->type = CURL_MULTI_HANDLE;
+#ifdef HAVE_SYS_EPOLL_H
+  multi->epollfd = -1;
+#endif
+
+  Curl_wheel_init(&multi->timewheel, Curl_tvnow());
 
   if(Curl_mk_dnscache(&multi->hostcache))
     goto error;
 
+  if(Curl_resolver_pool_init(&multi->resolver))
+    goto error;
+
   if(sh_init(&multi->sockhash, hashsize))
     goto error;
 
@@ -340,6 +352,7 @@ struct Curl_multi *Curl_multi_handle(int hashsize, /* socket hash */
 
   Curl_hash_destroy(&multi->sockhash);
   Curl_hash_destroy(&multi->hostcache);
+  Curl_resolver_pool_cleanup(multi->resolver);
   Curl_conncache_destroy(&multi->conn_cache);
   Curl_close(multi->closure_handle);
   multi->closure_handle = NULL;
@@ -496,7 +509,7 @@ ConnectionDone(struct SessionHandle *data, struct connectdata *conn)
   struct connectdata *conn_candidate = NULL;
 
   /* Mark the current connection as 'unused' */
-  conn->inuse = FALSE;
+  Curl_conncache_conn_idle(conn);
 
   if(maxconnects > 0 &&
      data->state.conn_cache->num_connections > maxconnects) {
@@ -697,7 +710,7 @@ CURLMcode curl_multi_remove_handle(CURLM *multi_handle,
   }
 
   /* The timer must be shut down before data->multi is set to NULL,
-     else the timenode will remain in the splay tree after
+     else the timenode will remain in the timer wheel after
      curl_easy_cleanup is called. */
   Curl_expire(data, 0);
 
@@ -2082,6 +2095,9 @@ static CURLMcode multi_runsingle(struct Curl_multi *multi,
     }
 
     if(CURLM_STATE_COMPLETED == data->mstate) {
+      if(multi->stats_cb && data->progress.instrument)
+        multi->stats_cb(data, &data->progress.stats, multi->stats_userp);
+
       /* now fill in the Curl_message with this info */
       msg = &data->msg;
 
@@ -2107,7 +2123,7 @@ CURLMcode curl_multi_perform(CURLM *multi_handle, int *running_handles)
   struct Curl_multi *multi=(struct Curl_multi *)multi_handle;
   struct SessionHandle *data;
   CURLMcode returncode=CURLM_OK;
-  struct Curl_tree *t;
+  struct Curl_wheel_node *t;
   struct timeval now = Curl_tvnow();
 
   if(!GOOD_MULTI_HANDLE(multi))
@@ -2129,9 +2145,9 @@ CURLMcode curl_multi_perform(CURLM *multi_handle, int *running_handles)
   }
 
   /*
-   * Simply remove all expired timers from the splay since handles are dealt
+   * Simply remove all expired timers from the wheel since handles are dealt
    * with unconditionally by this function and curl_multi_timeout() requires
-   * that already passed/handled expire times are removed from the splay.
+   * that already passed/handled expire times are removed from the wheel.
    *
    * It is important that the 'now' value is set at the entry of this function
    * and not for the current time as it may have ticked a little while since
@@ -2139,7 +2155,7 @@ CURLMcode curl_multi_perform(CURLM *multi_handle, int *running_handles)
    * been handled!
    */
   do {
-    multi->timetree = Curl_splaygetbest(now, multi->timetree, &t);
+    t = Curl_wheel_getbest(&multi->timewheel, now);
     if(t)
       /* the removed may have another timeout in queue */
       (void)add_next_timeout(now, multi, t->payload);
@@ -2198,6 +2214,11 @@ CURLMcode curl_multi_cleanup(CURLM *multi_handle)
       Curl_close(multi->closure_handle);
     }
 
+#ifdef HAVE_SYS_EPOLL_H
+    if(multi->epollfd != -1)
+      close(multi->epollfd);
+#endif
+
     Curl_hash_destroy(&multi->sockhash);
     Curl_conncache_destroy(&multi->conn_cache);
     Curl_llist_destroy(multi->msglist, NULL);
@@ -2222,6 +2243,7 @@ CURLMcode curl_multi_cleanup(CURLM *multi_handle)
     }
 
     Curl_hash_destroy(&multi->hostcache);
+    Curl_resolver_pool_cleanup(multi->resolver);
 
     /* Free the blacklists by setting them to NULL */
     Curl_pipeline_set_site_blacklist(NULL, &multi->pipelining_site_bl);
@@ -2274,6 +2296,50 @@ CURLMsg *curl_multi_info_read(CURLM *multi_handle, int *msgs_in_queue)
     return NULL;
 }
 
+/*
+ * run_update() tells the event driver of curl_multi_run() that the action
+ * libcurl waits for on a socket has changed from 'prev' to 'action'. Without
+ * epoll there is nothing to do, the sockets are then found in the socket hash
+ * when it is time to wait.
+ */
+static void run_update(struct Curl_multi *multi, curl_socket_t s,
+                       int prev, int action)
+{
+#ifdef HAVE_SYS_EPOLL_H
+  if(multi->epollfd != -1) {
+    struct epoll_event ev;
+
+    memset(&ev, 0, sizeof(ev));
+    ev.data.fd = s;
+
+    if(action == CURL_POLL_REMOVE)
+      (void)epoll_ctl(multi->epollfd, EPOLL_CTL_DEL, s, &ev);
+    else {
+      int op = prev ? EPOLL_CTL_MOD : EPOLL_CTL_ADD;
+
+      if(action & CURL_POLL_IN)
+        ev.events |= EPOLLIN;
+      if(action & CURL_POLL_OUT)
+        ev.events |= EPOLLOUT;
+
+      if(epoll_ctl(multi->epollfd, op, s, &ev) &&
+         ((errno == ENOENT) || (errno == EEXIST)))
+        /* the kernel drops closed sockets by itself and a new socket may get
+           the same number, so the registration can be out of step with the
+           socket hash */
+        (void)epoll_ctl(multi->epollfd,
+                        (op == EPOLL_CTL_MOD) ? EPOLL_CTL_ADD : EPOLL_CTL_MOD,
+                        s, &ev);
+    }
+  }
+#else
+  (void)multi;
+  (void)s;
+  (void)prev;
+  (void)action;
+#endif
+}
+
 /*
  * singlesocket() checks what sockets we deal with and their "action state"
  * and if we have a different state in any of those sockets from last time we
@@ -2338,6 +2404,7 @@ static void singlesocket(struct Curl_multi *multi,
                        multi->socket_userp,
                        entry->socketp);
 
+    run_update(multi, s, entry->action, action);
     entry->action = action; /* store the current action state */
   }
 
@@ -2408,6 +2475,7 @@ static void singlesocket(struct Curl_multi *multi,
                            CURL_POLL_REMOVE,
                            multi->socket_userp,
                            entry->socketp);
+        run_update(multi, s, entry->action, CURL_POLL_REMOVE);
         sh_delentry(&multi->sockhash, s);
       }
     } /* if sockhash entry existed */
@@ -2440,6 +2508,7 @@ void Curl_multi_closed(struct connectdata *conn, curl_socket_t s)
         multi->socket_cb(conn->data, s, CURL_POLL_REMOVE,
                          multi->socket_userp,
                          entry->socketp);
+      run_update(multi, s, entry->action, CURL_POLL_REMOVE);
 
       /* now remove it from the socket hash */
       sh_delentry(&multi->sockhash, s);
@@ -2453,13 +2522,13 @@ void Curl_multi_closed(struct connectdata *conn, curl_socket_t s)
  * add_next_timeout()
  *
  * Each SessionHandle has a list of timeouts. The add_next_timeout() is called
- * when it has just been removed from the splay tree because the timeout has
+ * when it has just been removed from the timer wheel because the timeout has
  * expired. This function is then to advance in the list to pick the next
  * timeout to use (skip the already expired ones) and add this node back to
- * the splay tree again.
+ * the wheel again.
  *
- * The splay tree only has each sessionhandle as a single node and the nearest
- * timeout is used to sort it on.
+ * The wheel only has each sessionhandle as a single node and the nearest
+ * timeout is used to place it.
  */
 static CURLMcode add_next_timeout(struct timeval now,
                                   struct Curl_multi *multi,
@@ -2486,7 +2555,7 @@ static CURLMcode add_next_timeout(struct timeval now,
   e = list->head;
   if(!e) {
     /* clear the expire times within the handles that we remove from the
-       splay tree */
+       timer wheel */
     tv->tv_sec = 0;
     tv->tv_usec = 0;
   }
@@ -2497,9 +2566,8 @@ static CURLMcode add_next_timeout(struct timeval now,
     /* remove first entry from list */
     Curl_llist_remove(list, e, NULL);
 
-    /* insert this node again into the splay */
-    multi->timetree = Curl_splayinsert(*tv, multi->timetree,
-                                       &d->state.timenode);
+    /* insert this node again into the wheel */
+    Curl_wheel_add(&multi->timewheel, *tv, &d->state.timenode);
   }
   return CURLM_OK;
 }
@@ -2512,7 +2580,7 @@ static CURLMcode multi_socket(struct Curl_multi *multi,
 {
   CURLMcode result = CURLM_OK;
   struct SessionHandle *data = NULL;
-  struct Curl_tree *t;
+  struct Curl_wheel_node *t;
   struct timeval now = Curl_tvnow();
 
   if(checkall) {
@@ -2605,7 +2673,7 @@ static CURLMcode multi_socket(struct Curl_multi *multi,
 
   /*
    * The loop following here will go on as long as there are expire-times left
-   * to process in the splay and 'data' will be re-assigned for every expired
+   * to process in the wheel and 'data' will be re-assigned for every expired
    * handle we deal with.
    */
   do {
@@ -2626,7 +2694,7 @@ static CURLMcode multi_socket(struct Curl_multi *multi,
     /* Check if there's one (more) expired timer to deal with! This function
        extracts a matching node if there is one */
 
-    multi->timetree = Curl_splaygetbest(now, multi->timetree, &t);
+    t = Curl_wheel_getbest(&multi->timewheel, now);
     if(t) {
       data = t->payload; /* assign this for next loop */
       (void)add_next_timeout(now, multi, t->payload);
@@ -2664,6 +2732,12 @@ CURLMcode curl_multi_setopt(CURLM *multi_handle,
   case CURLMOPT_PUSHDATA:
     multi->push_userp = va_arg(param, void *);
     break;
+  case CURLMOPT_STATSFUNCTION:
+    multi->stats_cb = va_arg(param, curl_stats_callback);
+    break;
+  case CURLMOPT_STATSDATA:
+    multi->stats_userp = va_arg(param, void *);
+    break;
   case CURLMOPT_PIPELINING:
     multi->pipelining = va_arg(param, long);
     break;
@@ -2743,18 +2817,15 @@ CURLMcode curl_multi_socket_all(CURLM *multi_handle, int *running_handles)
 static CURLMcode multi_timeout(struct Curl_multi *multi,
                                long *timeout_ms)
 {
-  static struct timeval tv_zero = {0, 0};
+  struct timeval next;
 
-  if(multi->timetree) {
-    /* we have a tree of expire times */
+  if(Curl_wheel_next(&multi->timewheel, &next)) {
+    /* we have expire times */
     struct timeval now = Curl_tvnow();
 
-    /* splay the lowest to the bottom */
-    multi->timetree = Curl_splay(tv_zero, multi->timetree);
-
-    if(Curl_splaycomparekeys(multi->timetree->key, now) > 0) {
+    if(Curl_wheel_comparekeys(next, now) > 0) {
       /* some time left before expiration */
-      *timeout_ms = curlx_tvdiff(multi->timetree->key, now);
+      *timeout_ms = curlx_tvdiff(next, now);
       if(!*timeout_ms)
         /*
          * Since we only provide millisecond resolution on the returned value
@@ -2787,6 +2858,175 @@ CURLMcode curl_multi_timeout(CURLM *multi_handle,
   return multi_timeout(multi, timeout_ms);
 }
 
+/* the most socket events curl_multi_run() deals with in one call */
+#define RUN_MAX_EVENTS 64
+
+/*
+ * run_start() sets up the event driver the first time curl_multi_run() is
+ * used on a multi handle.
+ */
+static CURLMcode run_start(struct Curl_multi *multi, int *running_handles)
+{
+#ifdef HAVE_SYS_EPOLL_H
+#ifdef EPOLL_CLOEXEC
+  multi->epollfd = epoll_create1(EPOLL_CLOEXEC);
+#else
+  multi->epollfd = epoll_create(RUN_MAX_EVENTS);
+#endif
+  if(multi->epollfd != -1) {
+    /* register the sockets the socket hash already has */
+    struct curl_hash_iterator iter;
+    struct curl_hash_element *he;
+
+    Curl_hash_start_iterate(&multi->sockhash, &iter);
+    for(he = Curl_hash_next_element(&iter); he;
+        he = Curl_hash_next_element(&iter)) {
+      struct Curl_sh_entry *entry = he->ptr;
+      run_update(multi, entry->socket, CURL_POLL_NONE, entry->action);
+    }
+  }
+  /* if epoll can't be used, poll() it is */
+#endif
+
+  multi->run_started = TRUE;
+
+  /* drive all the transfers once, that gets all their sockets into the
+     socket hash and from then on singlesocket() keeps it updated */
+  return multi_socket(multi, TRUE, CURL_SOCKET_BAD, 0, running_handles);
+}
+
+/*
+ * run_wait() waits for socket activity for at most 'timeout_ms' milliseconds
+ * and acts on the sockets that have any. '*handled' is set to the number of
+ * sockets that had activity.
+ */
+static CURLMcode run_wait(struct Curl_multi *multi, int timeout_ms,
+                          int *handled)
+{
+  CURLMcode result = CURLM_OK;
+  int running;
+  int i;
+
+  *handled = 0;
+
+#ifdef HAVE_SYS_EPOLL_H
+  if(multi->epollfd != -1) {
+    struct epoll_event events[RUN_MAX_EVENTS];
+    int num = epoll_wait(multi->epollfd, events, RUN_MAX_EVENTS, timeout_ms);
+
+    for(i = 0; (i < num) && (result <= CURLM_OK); i++) {
+      int mask = 0;
+
+      if(events[i].events & (EPOLLIN | EPOLLHUP))
+        mask |= CURL_CSELECT_IN;
+      if(events[i].events & EPOLLOUT)
+        mask |= CURL_CSELECT_OUT;
+      if(events[i].events & EPOLLERR)
+        mask |= CURL_CSELECT_ERR;
+
+      result = multi_socket(multi, FALSE, events[i].data.fd, mask, &running);
+      (*handled)++;
+    }
+  }
+  else
+#endif
+  {
+    struct curl_hash_iterator iter;
+    struct curl_hash_element *he;
+    struct pollfd *ufds = NULL;
+    unsigned int nfds = 0;
+    int num;
+
+    /* without epoll the sockets to wait for are in the socket hash */
+    if(multi->sockhash.size) {
+      ufds = malloc(multi->sockhash.size * sizeof(struct pollfd));
+      if(!ufds)
+        return CURLM_OUT_OF_MEMORY;
+    }
+
+    Curl_hash_start_iterate(&multi->sockhash, &iter);
+    for(he = Curl_hash_next_element(&iter); he;
+        he = Curl_hash_next_element(&iter)) {
+      struct Curl_sh_entry *entry = he->ptr;
+
+      ufds[nfds].fd = entry->socket;
+      ufds[nfds].events = 0;
+      ufds[nfds].revents = 0;
+      if(entry->action & CURL_POLL_IN)
+        ufds[nfds].events |= POLLIN;
+      if(entry->action & CURL_POLL_OUT)
+        ufds[nfds].events |= POLLOUT;
+      nfds++;
+    }
+
+    num = Curl_poll(ufds, nfds, timeout_ms);
+
+    for(i = 0; (num > 0) && (i < (int)nfds) && (result <= CURLM_OK); i++) {
+      int mask = 0;
+
+      if(!ufds[i].revents)
+        continue;
+
+      if(ufds[i].revents & (POLLIN | POLLHUP))
+        mask |= CURL_CSELECT_IN;
+      if(ufds[i].revents & POLLOUT)
+        mask |= CURL_CSELECT_OUT;
+      if(ufds[i].revents & (POLLERR | POLLNVAL))
+        mask |= CURL_CSELECT_ERR;
+
+      result = multi_socket(multi, FALSE, ufds[i].fd, mask, &running);
+      (*handled)++;
+    }
+
+    free(ufds);
+  }
+
+  return result;
+}
+
+/*
+ * curl_multi_run() is an event loop for applications that don't have one of
+ * their own. Unlike with curl_multi_wait() and curl_multi_perform(), the
+ * sockets stay registered with epoll between the calls and only the
+ * transfers that have socket activity or an expired timeout are driven, so
+ * the cost of a call doesn't grow with the number of transfers.
+ */
+CURLMcode curl_multi_run(CURLM *multi_handle, int timeout_ms,
+                         int *running_handles)
+{
+  struct Curl_multi *multi=(struct Curl_multi *)multi_handle;
+  CURLMcode result;
+  long timeout_internal;
+  int running;
+  int handled;
+
+  if(!GOOD_MULTI_HANDLE(multi))
+    return CURLM_BAD_HANDLE;
+
+  if(!multi->run_started) {
+    result = run_start(multi, &running);
+    if(result > CURLM_OK)
+      return result;
+  }
+
+  /* don't wait past the next timeout, a negative timeout_ms waits only for
+     that */
+  (void)multi_timeout(multi, &timeout_internal);
+  if((timeout_internal >= 0) &&
+     ((timeout_ms < 0) || (timeout_internal < (long)timeout_ms)))
+    timeout_ms = (int)timeout_internal;
+
+  result = run_wait(multi, timeout_ms, &handled);
+
+  if(!handled && (result <= CURLM_OK))
+    /* no socket activity, so deal with the timeouts that have expired. When
+       there was activity, multi_socket() has done that already */
+    result = multi_socket(multi, FALSE, CURL_SOCKET_TIMEOUT, 0, &running);
+
+  *running_handles = multi->num_alive;
+  return result;
+}
+
 /*
  * Tell the application it should update its timers, if it subscribes to the
  * update timer callback.
@@ -2794,6 +3034,7 @@ CURLMcode curl_multi_timeout(CURLM *multi_handle,
 static int update_timer(struct Curl_multi *multi)
 {
   long timeout_ms;
+  struct timeval next;
 
   if(!multi->timer_cb)
     return 0;
@@ -2802,7 +3043,7 @@ static int update_timer(struct Curl_multi *multi)
   }
   if(timeout_ms < 0) {
     static const struct timeval none={0, 0};
-    if(Curl_splaycomparekeys(none, multi->timer_lastcall)) {
+    if(Curl_wheel_comparekeys(none, multi->timer_lastcall)) {
       multi->timer_lastcall = none;
       /* there's no timeout now but there was one previously, tell the app to
          disable it */
@@ -2811,14 +3052,14 @@ static int update_timer(struct Curl_multi *multi)
     return 0;
   }
 
-  /* When multi_timeout() is done, multi->timetree points to the node with the
-   * timeout we got the (relative) time-out time for. We can thus easily check
-   * if this is the same (fixed) time as we got in a previous call and then
-   * avoid calling the callback again. */
-  if(Curl_splaycomparekeys(multi->timetree->key, multi->timer_lastcall) == 0)
+  /* The wheel's next time is the one we got the (relative) time-out time
+   * for. We can thus easily check if this is the same (fixed) time as we got
+   * in a previous call and then avoid calling the callback again. */
+  Curl_wheel_next(&multi->timewheel, &next);
+  if(Curl_wheel_comparekeys(next, multi->timer_lastcall) == 0)
     return 0;
 
-  multi->timer_lastcall = multi->timetree->key;
+  multi->timer_lastcall = next;
 
   return multi->timer_cb((CURLM*)multi, timeout_ms, multi->timer_userp);
 }
@@ -2896,7 +3137,6 @@ void Curl_expire(struct SessionHandle *data, long milli)
 {
   struct Curl_multi *multi = data->multi;
   struct timeval *nowp = &data->state.expiretime;
-  int rc;
 
   /* this is only interesting while there is still an associated multi struct
      remaining! */
@@ -2907,14 +3147,10 @@ void Curl_expire(struct SessionHandle *data, long milli)
     /* No timeout, clear the time data. */
     if(nowp->tv_sec || nowp->tv_usec) {
       /* Since this is an cleared time, we must remove the previous entry from
-         the splay tree */
+         the timer wheel */
       struct curl_llist *list = data->state.timeoutlist;
 
-      rc = Curl_splayremovebyaddr(multi->timetree,
-                                  &data->state.timenode,
-                                  &multi->timetree);
-      if(rc)
-        infof(data, "Internal error clearing splay node = %d\n", rc);
+      Curl_wheel_remove(&multi->timewheel, &data->state.timenode);
 
       /* flush the timeout list too */
       while(list->size > 0)
@@ -2940,7 +3176,7 @@ void Curl_expire(struct SessionHandle *data, long milli)
     }
 
     if(nowp->tv_sec || nowp->tv_usec) {
-      /* This means that the struct is added as a node in the splay tree.
+      /* This means that the struct is added as a node in the timer wheel.
          Compare if the new time is earlier, and only remove-old/add-new if it
          is. */
       long diff = curlx_tvdiff(set, *nowp);
@@ -2956,23 +3192,14 @@ void Curl_expire(struct SessionHandle *data, long milli)
       multi_addtimeout(data->state.timeoutlist, nowp);
 
       /* Since this is an updated time, we must remove the previous entry from
-         the splay tree first and then re-add the new value */
-      rc = Curl_splayremovebyaddr(multi->timetree,
-                                  &data->state.timenode,
-                                  &multi->timetree);
-      if(rc)
-        infof(data, "Internal error removing splay node = %d\n", rc);
+         the timer wheel first and then re-add the new value */
+      Curl_wheel_remove(&multi->timewheel, &data->state.timenode);
     }
 
     *nowp = set;
     data->state.timenode.payload = data;
-    multi->timetree = Curl_splayinsert(*nowp,
-                                       multi->timetree,
-                                       &data->state.timenode);
+    Curl_wheel_add(&multi->timewheel, *nowp, &data->state.timenode);
   }
-#if 0
-  Curl_splayprint(multi->timetree, 0, TRUE);
-#endif
 }
 
 /*
@@ -3002,7 +3229,7 @@ void Curl_expire_latest(struct SessionHandle *data, long milli)
   }
 
   if(expire->tv_sec || expire->tv_usec) {
-    /* This means that the struct is added as a node in the splay tree.
+    /* This means that the struct is added as a node in the timer wheel.
        Compare if the new time is earlier, and only remove-old/add-new if it
          is. */
     long diff = curlx_tvdiff(set, *expire);
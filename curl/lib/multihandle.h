@@ -91,12 +91,25 @@ struct Curl_multi {
   curl_push_callback push_cb;
   void *push_userp;
 
+  /* callback function and user data pointer for the stats of instrumented
+     transfers */
+  curl_stats_callback stats_cb;
+  void *stats_userp;
+
+  /* microseconds booked in the stats of the transfers, see
+     Curl_pgrsStatStop() */
+  curl_off_t stats_booked;
+
   /* Hostname cache */
   struct curl_hash hostcache;
 
-  /* timetree points to the splay-tree of time nodes to figure out expire
+  /* resolver state shared by the transfers using this handle, such as the
+     threaded resolver's thread pool */
+  void *resolver;
+
+  /* timewheel holds the time nodes of all transfers, to figure out expire
      times of all currently set timers */
-  struct Curl_tree *timetree;
+  struct Curl_wheel timewheel;
 
   /* 'sockhash' is the lookup hash for socket descriptor => easy handles (note
      the pluralis form, there can be more than one easy handle waiting on the
@@ -147,6 +160,11 @@ struct Curl_multi {
   void *timer_userp;
   struct timeval timer_lastcall; /* the fixed time for the timeout for the
                                     previous callback */
+
+  bool run_started; /* curl_multi_run() has been used on this handle */
+#ifdef HAVE_SYS_EPOLL_H
+  int epollfd; /* the epoll instance curl_multi_run() waits on, or -1 */
+#endif
 };
 
 #endif /* HEADER_CURL_MULTIHANDLE_H */
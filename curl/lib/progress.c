@@ -25,6 +25,7 @@
 #include "urldata.h"
 #include "sendf.h"
 #include "progress.h"
+#include "multihandle.h"
 #include "curl_printf.h"
 
 /* Provide a string that is 2 + 1 + 2 + 1 + 2 = 8 letters long (plus the zero
@@ -212,6 +213,99 @@ void Curl_pgrsTime(struct SessionHandle *data, timerid timer)
   }
 }
 
+/*
+ * Curl_pgrsStatStart() and Curl_pgrsStatStop() time a piece of work for the
+ * stats of an instrumented transfer. Work timed in between, like a write
+ * callback called while decoding, is booked on its own and not counted
+ * again. That goes for work done for other transfers on the same multi
+ * handle as well, as when HTTP/2 data for them is passed on while reading.
+ */
+void Curl_pgrsStatStart(struct SessionHandle *data, struct pgrsmark *mark)
+{
+  if(!data->progress.instrument)
+    return;
+
+  mark->start = Curl_tvnow();
+  mark->booked = data->multi ? data->multi->stats_booked : 0;
+}
+
+void Curl_pgrsStatStop(struct SessionHandle *data, struct pgrsmark *mark,
+                       statid stat, ssize_t bytes)
+{
+  struct curl_transfer_stats *stats = &data->progress.stats;
+  struct timeval now;
+  curl_off_t us;
+
+  if(!data->progress.instrument)
+    return;
+
+  now = Curl_tvnow();
+  us = (curl_off_t)(now.tv_sec - mark->start.tv_sec) * 1000000 +
+    (now.tv_usec - mark->start.tv_usec);
+  if(data->multi) {
+    us -= data->multi->stats_booked - mark->booked;
+    if(us < 0)
+      us = 0;
+    data->multi->stats_booked += us;
+  }
+
+  switch(stat) {
+  case STAT_TLSRECV:
+    stats->tls_time += us;
+    /* FALLTHROUGH */
+  case STAT_RECV:
+    stats->recv_calls++;
+    if(bytes > 0)
+      stats->recv_bytes += bytes;
+    stats->recv_time += us;
+    break;
+  case STAT_TLSSEND:
+    stats->tls_time += us;
+    /* FALLTHROUGH */
+  case STAT_SEND:
+    stats->send_calls++;
+    if(bytes > 0)
+      stats->send_bytes += bytes;
+    stats->send_time += us;
+    break;
+  case STAT_DECODE:
+    stats->decode_time += us;
+    break;
+  case STAT_WRITE:
+    stats->write_calls++;
+    stats->write_time += us;
+    break;
+  case STAT_CONNCACHE:
+    stats->conncache_time += us;
+    break;
+  default:
+    break;
+  }
+}
+
+/* Count something that isn't timed in the stats of an instrumented
+   transfer */
+void Curl_pgrsStatCount(struct SessionHandle *data, statid stat,
+                        size_t bytes)
+{
+  struct curl_transfer_stats *stats = &data->progress.stats;
+
+  if(!data->progress.instrument)
+    return;
+
+  switch(stat) {
+  case STAT_SYSCALL:
+    stats->syscalls++;
+    break;
+  case STAT_COPY:
+    stats->copies++;
+    stats->copied_bytes += bytes;
+    break;
+  default:
+    break;
+  }
+}
+
 void Curl_pgrsStartNow(struct SessionHandle *data)
 {
   data->progress.speeder_c = 0; /* reset the progress meter display */
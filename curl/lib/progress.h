@@ -40,6 +40,25 @@ typedef enum {
   TIMER_LAST /* must be last */
 } timerid;
 
+/* what is counted in the per-transfer stats, see CURLOPT_INSTRUMENT */
+typedef enum {
+  STAT_RECV,      /* read from the connection */
+  STAT_TLSRECV,   /* read from a TLS connection */
+  STAT_SEND,      /* write to the connection */
+  STAT_TLSSEND,   /* write to a TLS connection */
+  STAT_DECODE,    /* content decoding */
+  STAT_WRITE,     /* write or header callback */
+  STAT_CONNCACHE, /* connection cache lookup */
+  STAT_SYSCALL,   /* socket read or write */
+  STAT_COPY       /* received data copied to another buffer */
+} statid;
+
+/* where timing a piece of work for the stats started */
+struct pgrsmark {
+  struct timeval start;
+  curl_off_t booked; /* time booked for the multi handle's transfers then */
+};
+
 int Curl_pgrsDone(struct connectdata *);
 void Curl_pgrsStartNow(struct SessionHandle *data);
 void Curl_pgrsSetDownloadSize(struct SessionHandle *data, curl_off_t size);
@@ -49,6 +68,11 @@ void Curl_pgrsSetUploadCounter(struct SessionHandle *data, curl_off_t size);
 int Curl_pgrsUpdate(struct connectdata *);
 void Curl_pgrsResetTimesSizes(struct SessionHandle *data);
 void Curl_pgrsTime(struct SessionHandle *data, timerid timer);
+void Curl_pgrsStatStart(struct SessionHandle *data, struct pgrsmark *mark);
+void Curl_pgrsStatStop(struct SessionHandle *data, struct pgrsmark *mark,
+                       statid stat, ssize_t bytes);
+void Curl_pgrsStatCount(struct SessionHandle *data, statid stat,
+                        size_t bytes);
 
 
 /* Don't show progress for sizes smaller than: */
@@ -33,6 +33,7 @@
 #include "non-ascii.h"
 #include "strerror.h"
 #include "select.h"
+#include "progress.h"
 
 /* The last 3 #include files should be in this order */
 #include "curl_printf.h"
@@ -311,8 +312,13 @@ CURLcode Curl_write(struct connectdata *conn,
   ssize_t bytes_written;
   CURLcode result = CURLE_OK;
   int num = (sockfd == conn->sock[SECONDARYSOCKET]);
+  struct pgrsmark mark;
 
+  Curl_pgrsStatStart(conn->data, &mark);
   bytes_written = conn->send[num](conn, num, mem, len, &result);
+  Curl_pgrsStatStop(conn->data, &mark,
+                    conn->ssl[num].use ? STAT_TLSSEND : STAT_SEND,
+                    bytes_written);
 
   *written = bytes_written;
   if(bytes_written >= 0)
@@ -357,6 +363,8 @@ ssize_t Curl_send_plain(struct connectdata *conn, int num,
 #endif
     bytes_written = swrite(sockfd, mem, len);
 
+  Curl_pgrsStatCount(conn->data, STAT_SYSCALL, 0);
+
   *code = CURLE_OK;
   if(-1 == bytes_written) {
     int err = SOCKERRNO;
@@ -424,6 +432,8 @@ ssize_t Curl_recv_plain(struct connectdata *conn, int num, char *buf,
 
   nread = sread(sockfd, buf, len);
 
+  Curl_pgrsStatCount(conn->data, STAT_SYSCALL, 0);
+
   *code = CURLE_OK;
   if(-1 == nread) {
     int err = SOCKERRNO;
@@ -466,6 +476,7 @@ static CURLcode pausewrite(struct SessionHandle *data,
     return CURLE_OUT_OF_MEMORY;
 
   memcpy(dupl, ptr, len);
+  Curl_pgrsStatCount(data, STAT_COPY, len);
 
   /* store this information in the state struct for later use */
   data->state.tempwrite = dupl;
@@ -483,8 +494,9 @@ static CURLcode pausewrite(struct SessionHandle *data,
 
 
 /* Curl_client_chop_write() writes chunks of data not larger than
- * CURL_MAX_WRITE_SIZE via client write callback(s) and
- * takes care of pause requests from the callbacks.
+ * CURL_MAX_WRITE_SIZE, or the receive buffer size if that is set larger,
+ * via client write callback(s) and takes care of pause requests from the
+ * callbacks.
  */
 CURLcode Curl_client_chop_write(struct connectdata *conn,
                                 int type,
@@ -494,6 +506,8 @@ CURLcode Curl_client_chop_write(struct connectdata *conn,
   struct SessionHandle *data = conn->data;
   curl_write_callback writeheader = NULL;
   curl_write_callback writebody = NULL;
+  size_t maxchunk = CURL_MAX_WRITE_SIZE;
+  struct pgrsmark mark;
 
   if(!len)
     return CURLE_OK;
@@ -518,6 +532,7 @@ CURLcode Curl_client_chop_write(struct connectdata *conn,
       return CURLE_OUT_OF_MEMORY;
     /* copy the new data to the end of the new area */
     memcpy(newptr + data->state.tempwritesize, ptr, len);
+    Curl_pgrsStatCount(data, STAT_COPY, len);
     /* update the pointer and the size */
     data->state.tempwrite = newptr;
     data->state.tempwritesize = newlen;
@@ -537,12 +552,21 @@ CURLcode Curl_client_chop_write(struct connectdata *conn,
       data->set.fwrite_header? data->set.fwrite_header: data->set.fwrite_func;
   }
 
+  /* An application asking for a larger receive buffer gets the data it
+     fills in larger chunks as well */
+  if(data->set.buffer_size > CURL_MAX_WRITE_SIZE)
+    maxchunk = (size_t)data->set.buffer_size;
+
   /* Chop data, write chunks. */
   while(len) {
-    size_t chunklen = len <= CURL_MAX_WRITE_SIZE? len: CURL_MAX_WRITE_SIZE;
+    size_t chunklen = len <= maxchunk? len: maxchunk;
 
     if(writebody) {
-      size_t wrote = writebody(ptr, 1, chunklen, data->set.out);
+      size_t wrote;
+
+      Curl_pgrsStatStart(data, &mark);
+      wrote = writebody(ptr, 1, chunklen, data->set.out);
+      Curl_pgrsStatStop(data, &mark, STAT_WRITE, 0);
 
       if(CURL_WRITEFUNC_PAUSE == wrote) {
         if(conn->handler->flags & PROTOPT_NONETWORK) {
@@ -562,7 +586,11 @@ CURLcode Curl_client_chop_write(struct connectdata *conn,
     }
 
     if(writeheader) {
-      size_t wrote = writeheader(ptr, 1, chunklen, data->set.writeheader);
+      size_t wrote;
+
+      Curl_pgrsStatStart(data, &mark);
+      wrote = writeheader(ptr, 1, chunklen, data->set.writeheader);
+      Curl_pgrsStatStop(data, &mark, STAT_WRITE, 0);
 
       if(CURL_WRITEFUNC_PAUSE == wrote)
         /* here we pass in the HEADER bit only since if this was body as well
@@ -664,6 +692,7 @@ CURLcode Curl_read(struct connectdata *conn, /* connection data */
   ssize_t nread = 0;
   size_t bytesfromsocket = 0;
   char *buffertofill = NULL;
+  struct pgrsmark mark;
 
   /* if HTTP/1 pipelining is both wanted and possible */
   bool pipelining = Curl_pipeline_wanted(conn->data->multi, CURLPIPE_HTTP1) &&
@@ -684,6 +713,7 @@ CURLcode Curl_read(struct connectdata *conn, /* connection data */
     /* Copy from our master buffer first if we have some unread data there*/
     if(bytestocopy > 0) {
       memcpy(buf, conn->master_buffer + conn->read_pos, bytestocopy);
+      Curl_pgrsStatCount(conn->data, STAT_COPY, bytestocopy);
       conn->read_pos += bytestocopy;
       conn->bits.stream_was_rewound = FALSE;
 
@@ -702,12 +732,16 @@ CURLcode Curl_read(struct connectdata *conn, /* connection data */
     buffertofill = buf;
   }
 
+  Curl_pgrsStatStart(conn->data, &mark);
   nread = conn->recv[num](conn, num, buffertofill, bytesfromsocket, &result);
+  Curl_pgrsStatStop(conn->data, &mark,
+                    conn->ssl[num].use ? STAT_TLSRECV : STAT_RECV, nread);
   if(nread < 0)
     return result;
 
   if(pipelining) {
     memcpy(buf, conn->master_buffer, nread);
+    Curl_pgrsStatCount(conn->data, STAT_COPY, nread);
     conn->buf_len = nread;
     conn->read_pos = nread;
   }
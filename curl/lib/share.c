@@ -73,6 +73,10 @@ curl_share_setopt(CURLSH *sh, CURLSHoption option, ...)
     share->specifier |= (1<<type);
     switch(type) {
     case CURL_LOCK_DATA_DNS:
+      if(!share->resolver) {
+        if(Curl_resolver_pool_init(&share->resolver))
+          res = CURLSHE_NOMEM;
+      }
       break;
 
     case CURL_LOCK_DATA_COOKIE:
@@ -90,10 +94,7 @@ curl_share_setopt(CURLSH *sh, CURLSHoption option, ...)
     case CURL_LOCK_DATA_SSL_SESSION:
 #ifdef USE_SSL
       if(!share->sslsession) {
-        share->max_ssl_sessions = 8;
-        share->sslsession = calloc(share->max_ssl_sessions,
-                                   sizeof(struct curl_ssl_session));
-        share->sessionage = 0;
+        share->sslsession = Curl_ssl_create_sessions(SHARED_SSL_SESSIONS);
         if(!share->sslsession)
           res = CURLSHE_NOMEM;
       }
@@ -116,6 +117,8 @@ curl_share_setopt(CURLSH *sh, CURLSHoption option, ...)
     share->specifier &= ~(1<<type);
     switch(type) {
     case CURL_LOCK_DATA_DNS:
+      Curl_resolver_pool_cleanup(share->resolver);
+      share->resolver = NULL;
       break;
 
     case CURL_LOCK_DATA_COOKIE:
@@ -131,7 +134,8 @@ curl_share_setopt(CURLSH *sh, CURLSHoption option, ...)
 
     case CURL_LOCK_DATA_SSL_SESSION:
 #ifdef USE_SSL
-      Curl_safefree(share->sslsession);
+      Curl_ssl_destroy_sessions(share->sslsession);
+      share->sslsession = NULL;
 #else
       res = CURLSHE_NOT_BUILT_IN;
 #endif
@@ -190,18 +194,14 @@ curl_share_cleanup(CURLSH *sh)
   }
 
   Curl_hash_destroy(&share->hostcache);
+  Curl_resolver_pool_cleanup(share->resolver);
 
 #if !defined(CURL_DISABLE_HTTP) && !defined(CURL_DISABLE_COOKIES)
   Curl_cookie_cleanup(share->cookies);
 #endif
 
 #ifdef USE_SSL
-  if(share->sslsession) {
-    size_t i;
-    for(i = 0; i < share->max_ssl_sessions; i++)
-      Curl_ssl_kill_session(&(share->sslsession[i]));
-    free(share->sslsession);
-  }
+  Curl_ssl_destroy_sessions(share->sslsession);
 #endif
 
   if(share->unlockfunc)
@@ -45,13 +45,12 @@ struct Curl_share {
   void *clientdata;
 
   struct curl_hash hostcache;
+  void *resolver; /* resolver state shared when sharing DNS */
 #if !defined(CURL_DISABLE_HTTP) && !defined(CURL_DISABLE_COOKIES)
   struct CookieInfo *cookies;
 #endif
 
-  struct curl_ssl_session *sslsession;
-  size_t max_ssl_sessions;
-  long sessionage;
+  struct curl_ssl_sessions *sslsession;
 };
 
 CURLSHcode Curl_share_lock (struct SessionHandle *, curl_lock_data,
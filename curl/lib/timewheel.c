@@ -0,0 +1,360 @@
+/***************************************************************************
+ *                                  _   _ ____  _
+ *  Project                     ___| | | |  _ \| |
+ *                             / __| | | | |_) | |
+ *                            | (__| |_| |  _ <| |___
+ *                             \___|\___/|_| \_\_____|
+ *
+ * Copyright (C) 2016, Daniel Stenberg, <daniel@haxx.se>, et al.
+ *
+ * This software is licensed as described in the file COPYING, which
+ * you should have received as part of this distribution. The terms
+ * are also available at https://curl.haxx.se/docs/copyright.html.
+ *
+ * You may opt to use, copy, modify, merge, publish, distribute and/or sell
+ * copies of the Software, and permit persons to whom the Software is
+ * furnished to do so, under the terms of the COPYING file.
+ *
+ * This software is distributed on an "AS IS" basis, WITHOUT WARRANTY OF ANY
+ * KIND, either express or implied.
+ *
+ ***************************************************************************/
+
+#include "curl_setup.h"
+
+#include "timewheel.h"
+
+/*
+ * The wheel keeps its position as a number of milliseconds ('ticks') since
+ * it was initialized. A node that expires 'delta' ticks after the current
+ * position is put on the lowest level that spans that far, in the slot that
+ * covers its tick. Whenever the position reaches the start of a slot on a
+ * higher level, the nodes of that slot are put back in the wheel and end up
+ * on a lower level. The slots on level 0 that the position moves past are
+ * moved to the list of expired nodes.
+ *
+ * Only the slots on level 0, which cover a millisecond each, are kept sorted.
+ * The nodes of a slot on a higher level are not looked at until the slot is
+ * reached, so until then the earliest of them is only known to expire no
+ * sooner than the slot begins.
+ */
+
+#define compare(i,j) Curl_wheel_comparekeys((i),(j))
+
+#define DUE_SLOT -1
+
+/* ticks from the wheel's origin to 'key', rounded down. Negative for times
+   before the origin. */
+static curl_off_t wheel_tick(struct Curl_wheel *wheel, struct timeval key)
+{
+  curl_off_t us = (curl_off_t)(key.tv_sec - wheel->origin.tv_sec) * 1000000 +
+    (key.tv_usec - wheel->origin.tv_usec);
+  if(us < 0)
+    return -1;
+  return us / 1000;
+}
+
+/* the position of the lowest bit set in a non-zero value */
+static int lowest_bit(unsigned int bits)
+{
+  int pos = 0;
+  while(!(bits & 1)) {
+    bits >>= 1;
+    pos++;
+  }
+  return pos;
+}
+
+/* the time of a tick */
+static struct timeval tick_time(struct Curl_wheel *wheel, curl_off_t tick)
+{
+  struct timeval tv = wheel->origin;
+  tv.tv_sec += (long)(tick / 1000);
+  tv.tv_usec += (long)(tick % 1000) * 1000;
+  if(tv.tv_usec >= 1000000) {
+    tv.tv_sec++;
+    tv.tv_usec -= 1000000;
+  }
+  return tv;
+}
+
+static void list_append(struct Curl_wheel_node **head,
+                        struct Curl_wheel_node **tail,
+                        struct Curl_wheel_node *node)
+{
+  node->next = NULL;
+  node->prev = *tail;
+  if(*tail)
+    (*tail)->next = node;
+  else
+    *head = node;
+  *tail = node;
+}
+
+/* put a node in a sorted list, after the nodes that expire no later than it
+   does. The search starts from the end. */
+static void sorted_insert(struct Curl_wheel_node **head,
+                          struct Curl_wheel_node **tail,
+                          struct Curl_wheel_node *node)
+{
+  struct Curl_wheel_node *prev = *tail;
+
+  while(prev && (compare(node->key, prev->key) < 0))
+    prev = prev->prev;
+
+  node->prev = prev;
+  if(prev) {
+    node->next = prev->next;
+    prev->next = node;
+  }
+  else {
+    node->next = *head;
+    *head = node;
+  }
+  if(node->next)
+    node->next->prev = node;
+  else
+    *tail = node;
+}
+
+static void wheel_insert(struct Curl_wheel *wheel,
+                         struct Curl_wheel_node *node)
+{
+  curl_off_t tick = wheel_tick(wheel, node->key);
+  curl_off_t delta = tick - wheel->now;
+  struct Curl_wheel_slot *slot;
+  int level;
+  int idx;
+
+  if(delta < 0) {
+    /* already expired */
+    sorted_insert(&wheel->due, &wheel->due_tail, node);
+    node->slot = DUE_SLOT;
+    return;
+  }
+
+  for(level = 0; level < WHEEL_LEVELS - 1; level++)
+    if(delta < ((curl_off_t)1 << (WHEEL_BITS * (level + 1))))
+      break;
+
+  if(delta >= ((curl_off_t)1 << (WHEEL_BITS * WHEEL_LEVELS)))
+    /* further ahead than the wheel spans, park it in the last slot. It gets
+       put in the right place when that slot is reached. */
+    tick = wheel->now + ((curl_off_t)1 << (WHEEL_BITS * WHEEL_LEVELS)) - 1;
+
+  idx = (int)((tick >> (WHEEL_BITS * level)) & WHEEL_MASK);
+  slot = &wheel->slots[level * WHEEL_SLOTS + idx];
+
+  if(level)
+    list_append(&slot->head, &slot->tail, node);
+  else
+    sorted_insert(&slot->head, &slot->tail, node);
+  node->slot = level * WHEEL_SLOTS + idx + 1;
+  wheel->used[level] |= 1u << idx;
+}
+
+/* take all nodes out of a slot and return them as a list */
+static struct Curl_wheel_node *slot_take(struct Curl_wheel *wheel, int level,
+                                         int idx)
+{
+  struct Curl_wheel_slot *slot = &wheel->slots[level * WHEEL_SLOTS + idx];
+  struct Curl_wheel_node *list = slot->head;
+
+  slot->head = NULL;
+  slot->tail = NULL;
+  wheel->used[level] &= ~(1u << idx);
+  return list;
+}
+
+/* move the wheel forward to the given tick */
+static void wheel_advance(struct Curl_wheel *wheel, curl_off_t tick)
+{
+  while(wheel->now < tick) {
+    int idx = (int)(wheel->now & WHEEL_MASK);
+    int level;
+
+    if(wheel->used[0] & (1u << idx)) {
+      struct Curl_wheel_node *node = slot_take(wheel, 0, idx);
+      while(node) {
+        struct Curl_wheel_node *next = node->next;
+        list_append(&wheel->due, &wheel->due_tail, node);
+        node->slot = DUE_SLOT;
+        node = next;
+      }
+    }
+
+    if(wheel->used[0])
+      wheel->now++;
+    else {
+      /* nothing on level 0, skip ahead to where the next slot on level 1
+         begins */
+      curl_off_t next = (wheel->now | WHEEL_MASK) + 1;
+
+      for(level = 1; level < WHEEL_LEVELS; level++)
+        if(wheel->used[level])
+          break;
+      if(level == WHEEL_LEVELS) {
+        /* the wheel is empty */
+        wheel->now = tick;
+        break;
+      }
+      wheel->now = (next < tick) ? next : tick;
+    }
+
+    if(wheel->now & WHEEL_MASK)
+      continue;
+
+    /* at the start of a slot on one or more of the higher levels, put the
+       nodes of those slots back in the wheel, highest level first */
+    for(level = 1; level < WHEEL_LEVELS - 1; level++)
+      if(wheel->now & (((curl_off_t)1 << (WHEEL_BITS * (level + 1))) - 1))
+        break;
+    for(; level > 0; level--) {
+      struct Curl_wheel_node *node;
+      idx = (int)((wheel->now >> (WHEEL_BITS * level)) & WHEEL_MASK);
+      node = slot_take(wheel, level, idx);
+      while(node) {
+        struct Curl_wheel_node *next = node->next;
+        wheel_insert(wheel, node);
+        node = next;
+      }
+    }
+  }
+}
+
+void Curl_wheel_init(struct Curl_wheel *wheel, struct timeval now)
+{
+  memset(wheel, 0, sizeof(*wheel));
+  wheel->origin = now;
+}
+
+/* Add a node that expires at 'key'. The node must not be in the wheel. */
+void Curl_wheel_add(struct Curl_wheel *wheel, struct timeval key,
+                    struct Curl_wheel_node *node)
+{
+  DEBUGASSERT(!node->slot);
+  node->key = key;
+  wheel_insert(wheel, node);
+}
+
+/* Remove a node from the wheel, it is fine if it isn't in it */
+void Curl_wheel_remove(struct Curl_wheel *wheel,
+                       struct Curl_wheel_node *node)
+{
+  if(!node->slot)
+    return;
+
+  if(node->slot == DUE_SLOT) {
+    if(node->prev)
+      node->prev->next = node->next;
+    else
+      wheel->due = node->next;
+    if(node->next)
+      node->next->prev = node->prev;
+    else
+      wheel->due_tail = node->prev;
+  }
+  else {
+    int num = node->slot - 1;
+    struct Curl_wheel_slot *slot = &wheel->slots[num];
+
+    if(node->prev)
+      node->prev->next = node->next;
+    else
+      slot->head = node->next;
+    if(node->next)
+      node->next->prev = node->prev;
+    else
+      slot->tail = node->prev;
+
+    if(!slot->head)
+      wheel->used[num / WHEEL_SLOTS] &= ~(1u << (num & WHEEL_MASK));
+  }
+
+  node->next = node->prev = NULL;
+  node->slot = 0;
+}
+
+/*
+ * Sets 'when' to the time the wheel needs to be looked at next: when its
+ * earliest node expires, or earlier, when the slot on a higher level that
+ * holds that node begins. When that time has come, Curl_wheel_getbest()
+ * spreads the slot out on the levels below and this gets more precise.
+ *
+ * Returns FALSE if the wheel is empty.
+ */
+bool Curl_wheel_next(struct Curl_wheel *wheel, struct timeval *when)
+{
+  bool found = FALSE;
+  int level;
+
+  if(wheel->due) {
+    *when = wheel->due->key;
+    return TRUE;
+  }
+
+  /* The first used slot of each level holds the earliest nodes of that
+     level, but a level does not necessarily end before the next one
+     begins so the levels all need a look */
+  for(level = 0; level < WHEEL_LEVELS; level++) {
+    unsigned int used = wheel->used[level];
+    struct timeval tv;
+    curl_off_t lap;
+    int start;
+    int offset;
+
+    if(!used)
+      continue;
+
+    /* On level 0 the slot of the current tick is the first one. On the
+       other levels the current slot has already been spread out on the
+       levels below, so any nodes in it belong to the next lap. */
+    lap = (wheel->now >> (WHEEL_BITS * level)) + (level ? 1 : 0);
+    start = (int)(lap & WHEEL_MASK);
+    if(start)
+      used = (used >> start) | (used << (WHEEL_SLOTS - start));
+    offset = lowest_bit(used);
+
+    if(level)
+      tv = tick_time(wheel, (lap + offset) << (WHEEL_BITS * level));
+    else
+      tv = wheel->slots[(start + offset) & WHEEL_MASK].head->key;
+
+    if(!found || (compare(tv, *when) < 0))
+      *when = tv;
+    found = TRUE;
+  }
+
+  return found;
+}
+
+/*
+ * Removes and returns a node that has expired at 'now', or returns NULL if
+ * there is none. Expired nodes are returned in the order they expired.
+ *
+ * @unittest: 1606
+ */
+struct Curl_wheel_node *Curl_wheel_getbest(struct Curl_wheel *wheel,
+                                           struct timeval now)
+{
+  struct Curl_wheel_node *node;
+  curl_off_t tick = wheel_tick(wheel, now);
+
+  if(tick > wheel->now)
+    wheel_advance(wheel, tick);
+
+  node = wheel->due;
+  if(!node) {
+    /* the nodes of the current tick may have expired within this
+       millisecond */
+    int idx = (int)(wheel->now & WHEEL_MASK);
+    node = wheel->slots[idx].head;
+    if(node && (compare(node->key, now) > 0))
+      node = NULL;
+  }
+
+  if(node)
+    Curl_wheel_remove(wheel, node);
+
+  return node;
+}
@@ -0,0 +1,78 @@
+#ifndef HEADER_CURL_TIMEWHEEL_H
+#define HEADER_CURL_TIMEWHEEL_H
+/***************************************************************************
+ *                                  _   _ ____  _
+ *  Project                     ___| | | |  _ \| |
+ *                             / __| | | | |_) | |
+ *                            | (__| |_| |  _ <| |___
+ *                             \___|\___/|_| \_\_____|
+ *
+ * Copyright (C) 2016, Daniel Stenberg, <daniel@haxx.se>, et al.
+ *
+ * This software is licensed as described in the file COPYING, which
+ * you should have received as part of this distribution. The terms
+ * are also available at https://curl.haxx.se/docs/copyright.html.
+ *
+ * You may opt to use, copy, modify, merge, publish, distribute and/or sell
+ * copies of the Software, and permit persons to whom the Software is
+ * furnished to do so, under the terms of the COPYING file.
+ *
+ * This software is distributed on an "AS IS" basis, WITHOUT WARRANTY OF ANY
+ * KIND, either express or implied.
+ *
+ ***************************************************************************/
+#include "curl_setup.h"
+
+/*
+ * A hierarchical timer wheel. Each level has WHEEL_SLOTS slots, a slot on
+ * level 0 covers one millisecond and a slot on the level above covers all
+ * the slots of the level below. Removing a node is O(1) and so is adding
+ * one, except on level 0 where it is put in order among the nodes of the
+ * same millisecond. Expired nodes are moved down the levels as time passes.
+ */
+#define WHEEL_BITS   5
+#define WHEEL_SLOTS  (1 << WHEEL_BITS)
+#define WHEEL_MASK   (WHEEL_SLOTS - 1)
+#define WHEEL_LEVELS 6 /* 2^30 milliseconds, about 12 days, ahead */
+
+struct Curl_wheel_node {
+  struct Curl_wheel_node *next;
+  struct Curl_wheel_node *prev;
+  struct timeval key;        /* when this node expires */
+  void *payload;             /* data the wheel code doesn't care about */
+  int slot;                  /* slot number + 1, 0 when not in the wheel */
+};
+
+struct Curl_wheel_slot {
+  struct Curl_wheel_node *head; /* the earliest node on level 0 */
+  struct Curl_wheel_node *tail;
+};
+
+struct Curl_wheel {
+  struct timeval origin;     /* the time of tick zero */
+  curl_off_t now;            /* the tick (millisecond) the wheel is at */
+  unsigned int used[WHEEL_LEVELS]; /* bit N set if slot N has nodes */
+  struct Curl_wheel_slot slots[WHEEL_LEVELS * WHEEL_SLOTS];
+  struct Curl_wheel_node *due;      /* expired nodes, earliest first */
+  struct Curl_wheel_node *due_tail;
+};
+
+void Curl_wheel_init(struct Curl_wheel *wheel, struct timeval now);
+
+void Curl_wheel_add(struct Curl_wheel *wheel, struct timeval key,
+                    struct Curl_wheel_node *node);
+
+void Curl_wheel_remove(struct Curl_wheel *wheel,
+                       struct Curl_wheel_node *node);
+
+bool Curl_wheel_next(struct Curl_wheel *wheel, struct timeval *when);
+
+struct Curl_wheel_node *Curl_wheel_getbest(struct Curl_wheel *wheel,
+                                           struct timeval now);
+
+#define Curl_wheel_comparekeys(i,j) ( ((i.tv_sec)  < (j.tv_sec))  ? -1 : \
+                                    ( ((i.tv_sec)  > (j.tv_sec))  ?  1 : \
+                                    ( ((i.tv_usec) < (j.tv_usec)) ? -1 : \
+                                    ( ((i.tv_usec) > (j.tv_usec)) ?  1 : 0))))
+
+#endif /* HEADER_CURL_TIMEWHEEL_H */
@@ -725,53 +725,21 @@ static CURLcode readwrite_data(struct SessionHandle *data,
             return result;
         }
         if(k->badheader < HEADER_ALLBAD) {
-          /* This switch handles various content encodings. If there's an
-             error here, be sure to check over the almost identical code
-             in http_chunks.c.
-             Make sure that ALL_CONTENT_ENCODINGS contains all the
-             encodings handled here. */
-#ifdef HAVE_LIBZ
-          switch (conn->data->set.http_ce_skip ?
-                  IDENTITY : k->auto_decoding) {
-          case IDENTITY:
-#endif
-            /* This is the default when the server sends no
-               Content-Encoding header. See Curl_readwrite_init; the
-               memset() call initializes k->auto_decoding to zero. */
-            if(!k->ignorebody) {
+          /* The body goes through the content decoders, if the server said
+             it used any encoding, and then to the client. The decoders
+             were set up when the headers were parsed. Headers are not
+             encoded. */
+          if(!k->ignorebody) {
 
 #ifndef CURL_DISABLE_POP3
-              if(conn->handler->protocol&PROTO_FAMILY_POP3)
-                result = Curl_pop3_write(conn, k->str, nread);
-              else
+            if(conn->handler->protocol&PROTO_FAMILY_POP3)
+              result = Curl_pop3_write(conn, k->str, nread);
+            else
 #endif /* CURL_DISABLE_POP3 */
 
-                result = Curl_client_write(conn, CLIENTWRITE_BODY, k->str,
+              result = Curl_unencode_write(conn, k->writer_stack, k->str,
                                            nread);
-            }
-#ifdef HAVE_LIBZ
-            break;
-
-          case DEFLATE:
-            /* Assume CLIENTWRITE_BODY; headers are not encoded. */
-            if(!k->ignorebody)
-              result = Curl_unencode_deflate_write(conn, k, nread);
-            break;
-
-          case GZIP:
-            /* Assume CLIENTWRITE_BODY; headers are not encoded. */
-            if(!k->ignorebody)
-              result = Curl_unencode_gzip_write(conn, k, nread);
-            break;
-
-          default:
-            failf (data, "Unrecognized content encoding type. "
-                   "libcurl understands `identity', `deflate' and `gzip' "
-                   "content encodings.");
-            result = CURLE_BAD_CONTENT_ENCODING;
-            break;
           }
-#endif
         }
         k->badheader = HEADER_NORMAL; /* taken care of now */
 
@@ -1332,6 +1300,23 @@ CURLcode Curl_pretransfer(struct SessionHandle *data)
   if(result)
     return result;
 
+  /* Set up the download buffer for a receive buffer size that doesn't fit
+     in the default one */
+  if(data->set.buffer_size > BUFSIZE) {
+    size_t size = (size_t)data->set.buffer_size;
+    if(data->state.recvbuffersize != size) {
+      char *newbuf = realloc(data->state.recvbuffer, size + 1);
+      if(!newbuf)
+        return CURLE_OUT_OF_MEMORY;
+      data->state.recvbuffer = newbuf;
+      data->state.recvbuffersize = size;
+    }
+  }
+  else if(data->state.recvbuffer) {
+    Curl_safefree(data->state.recvbuffer);
+    data->state.recvbuffersize = 0;
+  }
+
   data->set.followlocation=0; /* reset the location-follow counter */
   data->state.this_is_a_follow = FALSE; /* reset this */
   data->state.errorbuf = FALSE; /* no error has occurred */
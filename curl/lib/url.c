@@ -136,9 +136,6 @@ bool curl_win32_idn_to_ascii(const char *in, char **out);
 #include "memdebug.h"
 
 /* Local static prototypes */
-static struct connectdata *
-find_oldest_idle_connection_in_bundle(struct SessionHandle *data,
-                                      struct connectbundle *bundle);
 static void conn_free(struct connectdata *conn);
 static void free_fixed_hostname(struct hostname *host);
 static void signalPipeClose(struct curl_llist *pipeline, bool pipe_broke);
@@ -464,6 +461,7 @@ CURLcode Curl_close(struct SessionHandle *data)
   data->change.url = NULL;
 
   Curl_safefree(data->state.headerbuff);
+  Curl_safefree(data->state.recvbuffer);
 
   Curl_flush_cookies(data, 1);
 
@@ -2135,11 +2133,12 @@ CURLcode Curl_setopt(struct SessionHandle *data, CURLoption option,
   case CURLOPT_BUFFERSIZE:
     /*
      * The application kindly asks for a differently sized receive buffer.
-     * If it seems reasonable, we'll use it.
+     * If it seems reasonable, we'll use it. Sizes above BUFSIZE get a buffer
+     * of their own, allocated in Curl_pretransfer().
      */
     data->set.buffer_size = va_arg(param, long);
 
-    if((data->set.buffer_size> (BUFSIZE -1)) ||
+    if((data->set.buffer_size > CURL_MAX_READ_SIZE) ||
        (data->set.buffer_size < 1))
       data->set.buffer_size = 0; /* huge internal default */
 
@@ -2172,8 +2171,8 @@ CURLcode Curl_setopt(struct SessionHandle *data, CURLoption option,
         data->cookies = NULL;
 #endif
 
-      if(data->share->sslsession == data->state.session)
-        data->state.session = NULL;
+      if(data->share->sslsession == data->state.sslsessions)
+        data->state.sslsessions = NULL;
 
       data->share->dirty--;
 
@@ -2202,10 +2201,14 @@ CURLcode Curl_setopt(struct SessionHandle *data, CURLoption option,
         data->cookies = data->share->cookies;
       }
 #endif   /* CURL_DISABLE_HTTP */
+#ifdef USE_SSL
       if(data->share->sslsession) {
-        data->set.ssl.max_ssl_sessions = data->share->max_ssl_sessions;
-        data->state.session = data->share->sslsession;
+        /* use the shared session cache, first free own one if any */
+        Curl_ssl_destroy_sessions(data->state.sslsessions);
+        data->set.ssl.max_ssl_sessions = data->share->sslsession->max;
+        data->state.sslsessions = data->share->sslsession;
       }
+#endif
       Curl_share_unlock(data, CURL_LOCK_DATA_SHARE);
 
     }
@@ -2649,6 +2652,9 @@ CURLcode Curl_setopt(struct SessionHandle *data, CURLoption option,
     result = CURLE_NOT_BUILT_IN;
 #endif
     break;
+  case CURLOPT_INSTRUMENT:
+    data->set.instrument = (0 != va_arg(param, long)) ? TRUE : FALSE;
+    break;
   case CURLOPT_SSL_ENABLE_NPN:
     data->set.ssl_enable_npn = (0 != va_arg(param, long)) ? TRUE : FALSE;
     break;
@@ -3007,7 +3013,6 @@ Curl_oldest_idle_connection(struct SessionHandle *data)
 {
   struct conncache *bc = data->state.conn_cache;
   struct curl_hash_iterator iter;
-  struct curl_llist_element *curr;
   struct curl_hash_element *he;
   long highscore=-1;
   long score;
@@ -3025,55 +3030,10 @@ Curl_oldest_idle_connection(struct SessionHandle *data)
 
     bundle = he->ptr;
 
-    curr = bundle->conn_list->head;
-    while(curr) {
-      conn = curr->ptr;
-
-      if(!conn->inuse) {
-        /* Set higher score for the age passed since the connection was used */
-        score = Curl_tvdiff(now, conn->now);
-
-        if(score > highscore) {
-          highscore = score;
-          conn_candidate = conn;
-        }
-      }
-      curr = curr->next;
-    }
-
-    he = Curl_hash_next_element(&iter);
-  }
-
-  return conn_candidate;
-}
-
-/*
- * This function finds the connection in the connection
- * bundle that has been unused for the longest time.
- *
- * Returns the pointer to the oldest idle connection, or NULL if none was
- * found.
- */
-static struct connectdata *
-find_oldest_idle_connection_in_bundle(struct SessionHandle *data,
-                                      struct connectbundle *bundle)
-{
-  struct curl_llist_element *curr;
-  long highscore=-1;
-  long score;
-  struct timeval now;
-  struct connectdata *conn_candidate = NULL;
-  struct connectdata *conn;
-
-  (void)data;
-
-  now = Curl_tvnow();
-
-  curr = bundle->conn_list->head;
-  while(curr) {
-    conn = curr->ptr;
-
-    if(!conn->inuse) {
+    /* only the least recently used idle connection of each bundle can be
+       the oldest one */
+    conn = bundle->idle_tail;
+    if(conn) {
       /* Set higher score for the age passed since the connection was used */
       score = Curl_tvdiff(now, conn->now);
 
@@ -3082,7 +3042,8 @@ find_oldest_idle_connection_in_bundle(struct SessionHandle *data,
         conn_candidate = conn;
       }
     }
-    curr = curr->next;
+
+    he = Curl_hash_next_element(&iter);
   }
 
   return conn_candidate;
@@ -3158,6 +3119,71 @@ static size_t max_pipeline_length(struct Curl_multi *multi)
 }
 
 
+/* Mix a string into a reuse key. Host names, schemes and credentials are all
+   compared case insensitively in ConnectionExists(), so the string is hashed
+   case insensitively as well. */
+static unsigned int reuse_key_str(unsigned int h, const char *str)
+{
+  if(str) {
+    while(*str) {
+      h += h << 5;
+      h ^= (unsigned char)Curl_raw_toupper(*str++);
+    }
+  }
+  /* end marker, so that "ab" + "c" and "a" + "bc" differ */
+  h += h << 5;
+  return h;
+}
+
+static unsigned int reuse_key_num(unsigned int h, long num)
+{
+  h += h << 5;
+  h ^= (unsigned int)num;
+  return h;
+}
+
+/*
+ * Returns a hash of the connection settings that ConnectionExists() requires
+ * to be equal between a new connection and one it re-uses. Two connections
+ * with different keys are never re-used for each other, two with the same key
+ * still need the full check.
+ */
+static unsigned int reuse_key(struct connectdata *conn)
+{
+  unsigned int h = 5381;
+
+  h = reuse_key_num(h, conn->bits.proxy);
+  if(conn->bits.proxy) {
+    h = reuse_key_num(h, conn->proxytype);
+    h = reuse_key_num(h, conn->bits.httpproxy);
+    h = reuse_key_num(h, conn->bits.tunnel_proxy);
+    h = reuse_key_str(h, conn->proxy.name);
+    h = reuse_key_num(h, conn->port);
+  }
+  h = reuse_key_num(h, conn->bits.conn_to_host);
+  h = reuse_key_num(h, conn->bits.conn_to_port);
+
+  if(!conn->bits.httpproxy || (conn->handler->flags&PROTOPT_SSL) ||
+     conn->bits.tunnel_proxy) {
+    /* Not using a HTTP proxy in normal mode, so the host and the protocol
+       must match. The protocol family is used, since a connection that has
+       been upgraded to TLS is fine for the plain text version. */
+    h = reuse_key_num(h, (long)get_protocol_family(conn->handler->protocol));
+    h = reuse_key_str(h, conn->host.name);
+    h = reuse_key_num(h, conn->remote_port);
+    if(conn->bits.conn_to_host)
+      h = reuse_key_str(h, conn->conn_to_host.name);
+    if(conn->bits.conn_to_port)
+      h = reuse_key_num(h, conn->conn_to_port);
+    if(!(conn->handler->flags & PROTOPT_CREDSPERREQUEST)) {
+      h = reuse_key_str(h, conn->user);
+      h = reuse_key_str(h, conn->passwd);
+    }
+  }
+
+  return h;
+}
+
 /*
  * Given one filled in connection struct (named needle), this function should
  * detect if there already is one that has all the significant details
@@ -3210,6 +3236,7 @@ ConnectionExists(struct SessionHandle *data,
       max_pipeline_length(data->multi):0;
     size_t best_pipe_len = max_pipe_len;
     struct curl_llist_element *curr;
+    struct connectdata *next_idle;
     const char *hostname;
 
     if(needle->bits.conn_to_host)
@@ -3249,8 +3276,19 @@ ConnectionExists(struct SessionHandle *data,
       }
     }
 
-    curr = bundle->conn_list->head;
-    while(curr) {
+    if(!canPipeline && !data->set.pipewait) {
+      /* Only an idle connection can be used, so only those need to be
+         checked. Most recently used first, as it is the one most likely to
+         still be alive. */
+      curr = NULL;
+      next_idle = bundle->idle_head;
+    }
+    else {
+      curr = bundle->conn_list->head;
+      next_idle = NULL;
+    }
+
+    while(curr || next_idle) {
       bool match = FALSE;
       size_t pipeLen;
 
@@ -3258,8 +3296,18 @@ ConnectionExists(struct SessionHandle *data,
        * Note that if we use a HTTP proxy in normal mode (no tunneling), we
        * check connections to that proxy and not to the actual remote server.
        */
-      check = curr->ptr;
-      curr = curr->next;
+      if(curr) {
+        check = curr->ptr;
+        curr = curr->next;
+      }
+      else {
+        check = next_idle;
+        next_idle = check->idle_next;
+      }
+
+      if(check->reuse_key != needle->reuse_key)
+        /* some of the settings that must match differ */
+        continue;
 
       if(disconnect_if_dead(check, data))
         continue;
@@ -6115,6 +6163,8 @@ static CURLcode create_conn(struct SessionHandle *data,
 
   prune_dead_connections(data);
 
+  conn->reuse_key = reuse_key(conn);
+
   /*************************************************************
    * Check the current list of connections to see if we can
    * re-use an already existing one or if we have to create a
@@ -6127,8 +6177,13 @@ static CURLcode create_conn(struct SessionHandle *data,
      authentication phase). */
   if(data->set.reuse_fresh && !data->state.this_is_a_follow)
     reuse = FALSE;
-  else
+  else {
+    struct pgrsmark mark;
+
+    Curl_pgrsStatStart(data, &mark);
     reuse = ConnectionExists(data, conn, &conn_temp, &force_reuse, &waitpipe);
+    Curl_pgrsStatStop(data, &mark, STAT_CONNCACHE, 0);
+  }
 
   /* If we found a reusable connection, we may still want to
      open a new connection if we are pipelining. */
@@ -6155,8 +6210,9 @@ static CURLcode create_conn(struct SessionHandle *data,
      * just allocated before we can move along and use the previously
      * existing one.
      */
-    conn_temp->inuse = TRUE; /* mark this as being in use so that no other
-                                handle in a multi stack may nick it */
+    /* mark this as being in use so that no other handle in a multi stack
+       may nick it */
+    Curl_conncache_conn_busy(conn_temp);
     reuse_conn(conn, conn_temp);
     free(conn);          /* we don't need this anymore */
     conn = conn_temp;
@@ -6193,8 +6249,9 @@ static CURLcode create_conn(struct SessionHandle *data,
        (bundle->num_connections >= max_host_connections)) {
       struct connectdata *conn_candidate;
 
-      /* The bundle is full. Let's see if we can kill a connection. */
-      conn_candidate = find_oldest_idle_connection_in_bundle(data, bundle);
+      /* The bundle is full. Let's see if we can kill a connection, the one
+         that has been idle the longest is last in the idle list. */
+      conn_candidate = bundle->idle_tail;
 
       if(conn_candidate) {
         /* Set the connection's owner correctly, then kill it */
@@ -6464,7 +6521,8 @@ CURLcode Curl_init_do(struct SessionHandle *data, struct connectdata *conn)
 
   k->bytecount = 0;
 
-  k->buf = data->state.buffer;
+  k->buf = data->state.recvbuffer ?
+    data->state.recvbuffer : data->state.buffer;
   k->uploadbuf = data->state.uploadbuffer;
   k->hbufp = data->state.headerbuff;
   k->ignorebody=FALSE;
@@ -168,7 +168,7 @@
 #include "http_chunks.h" /* for the structs and enum stuff */
 #include "hostip.h"
 #include "hash.h"
-#include "splay.h"
+#include "timewheel.h"
 
 #include "imap.h"
 #include "pop3.h"
@@ -377,11 +377,23 @@ struct curl_ssl_session {
   void *sessionid;  /* as returned from the SSL layer */
   size_t idsize;    /* if known, otherwise 0 */
   long age;         /* just a number, the higher the more recent */
+  time_t stored;    /* when the session was added to the cache */
+  unsigned int hash; /* of the host names, ports and SSL config */
+  struct curl_ssl_session *hnext; /* next session in the same hash chain */
   int remote_port;  /* remote port */
   int conn_to_port; /* remote port for the connection (may be -1) */
   struct ssl_config_data ssl_config; /* setup for this session */
 };
 
+/* a cache of SSL sessions, used by one handle or by all the handles of a
+   share */
+struct curl_ssl_sessions {
+  struct curl_ssl_session *session; /* array of 'max' entries */
+  struct curl_ssl_session **hash;   /* 'max' chains of the entries in use */
+  size_t max;                       /* number of entries */
+  long age;                         /* number of the most recent session */
+};
+
 /* Struct used for Digest challenge-response authentication */
 struct digestdata {
 #if defined(USE_WINDOWS_SSPI)
@@ -542,6 +554,7 @@ struct ConnectBits {
                  connection */
   bool type_set;  /* type= was used in the URL */
   bool multiplex; /* connection is multiplexed */
+  bool idle; /* connection is in its bundle's list of idle connections */
 
   bool tcp_fastopen; /* use TCP Fast Open */
   bool tls_enable_npn;  /* TLS NPN extension? */
@@ -573,16 +586,6 @@ struct hostname {
 #define KEEP_SENDBITS (KEEP_SEND | KEEP_SEND_HOLD | KEEP_SEND_PAUSE)
 
 
-#ifdef HAVE_LIBZ
-typedef enum {
-  ZLIB_UNINIT,          /* uninitialized */
-  ZLIB_INIT,            /* initialized */
-  ZLIB_GZIP_HEADER,     /* reading gzip header */
-  ZLIB_GZIP_INFLATING,  /* inflating gzip stream */
-  ZLIB_INIT_GZIP        /* initialized in transparent gzip mode */
-} zlibInitState;
-#endif
-
 #ifdef CURLRES_ASYNCH
 struct Curl_async {
   char *hostname;
@@ -670,17 +673,8 @@ struct SingleRequest {
   enum expect100 exp100;        /* expect 100 continue state */
   enum upgrade101 upgr101;      /* 101 upgrade state */
 
-  int auto_decoding;            /* What content encoding. sec 3.5, RFC2616. */
-
-#define IDENTITY 0              /* No encoding */
-#define DEFLATE 1               /* zlib deflate [RFC 1950 & 1951] */
-#define GZIP 2                  /* gzip algorithm [RFC 1952] */
-
-#ifdef HAVE_LIBZ
-  zlibInitState zlib_init;      /* possible zlib init state;
-                                   undefined if Content-Encoding header. */
-  z_stream z;                   /* State structure for zlib. */
-#endif
+  /* Content unencoding stack. See sec 3.5, RFC2616. */
+  struct contenc_writer *writer_stack;
 
   time_t timeofdoc;
   long bodywrites;
@@ -870,10 +864,18 @@ struct connectdata {
                  be used by any other easy handle without careful
                  consideration (== only for pipelining). */
 
+  /* links in the bundle's list of idle connections, most recently used
+     first */
+  struct connectdata *idle_prev;
+  struct connectdata *idle_next;
+
   /**** Fields set when inited and not modified again */
   long connection_id; /* Contains a unique number to make it easier to
                          track the connections in the log output */
 
+  unsigned int reuse_key; /* hash of the settings that must be equal for a
+                             connection to be re-used, see ConnectionExists */
+
   /* 'dns_entry' is the particular host we use. This points to an entry in the
      DNS cache and it will not get pruned while locked. It gets unlocked in
      Curl_done(). This entry will be NULL if the connection is re-used as then
@@ -1177,6 +1179,9 @@ struct Progress {
   curl_off_t speeder[ CURR_TIME ];
   struct timeval speeder_time[ CURR_TIME ];
   int speeder_c;
+
+  bool instrument; /* collect 'stats' for this transfer */
+  struct curl_transfer_stats stats;
 };
 
 typedef enum {
@@ -1250,6 +1255,10 @@ struct UrlState {
   size_t headersize;   /* size of the allocation */
 
   char buffer[BUFSIZE+1]; /* download buffer */
+  char *recvbuffer; /* download buffer used instead of 'buffer' when the
+                       receive buffer size is set larger than BUFSIZE */
+  size_t recvbuffersize; /* size of 'recvbuffer', not counting the zero
+                            terminator */
   char uploadbuffer[BUFSIZE+1]; /* upload buffer */
   curl_off_t current_speed;  /* the ProgressShow() funcion sets this,
                                 bytes / second */
@@ -1262,8 +1271,7 @@ struct UrlState {
                        strdup() data.
                     */
   int first_remote_port; /* remote port of the first (not followed) request */
-  struct curl_ssl_session *session; /* array of 'max_ssl_sessions' size */
-  long sessionage;                  /* number of the most recent session */
+  struct curl_ssl_sessions *sslsessions; /* SSL session ID cache */
   char *tempwrite;      /* allocated buffer to keep data in when a write
                            callback returns to make the connection paused */
   size_t tempwritesize; /* size of the 'tempwrite' allocated buffer */
@@ -1300,7 +1308,7 @@ struct UrlState {
   ENGINE *engine;
 #endif /* USE_OPENSSL */
   struct timeval expiretime; /* set this with Curl_expire() only */
-  struct Curl_tree timenode; /* for the splay stuff */
+  struct Curl_wheel_node timenode; /* for the timer wheel */
   struct curl_llist *timeoutlist; /* list of pending timeouts */
 
   /* a place to store the most recently set FTP entrypath */
@@ -1671,6 +1679,8 @@ struct UserDefined {
   long tcp_keepintvl;    /* seconds between TCP keepalive probes */
   bool tcp_fastopen;     /* use TCP Fast Open */
 
+  bool instrument;       /* collect per-transfer stats */
+
   size_t maxconnects;  /* Max idle connections in the connection cache */
 
   bool ssl_enable_npn;      /* TLS NPN extension? */
@@ -44,6 +44,10 @@
 #include <libpsl.h>
 #endif
 
+#ifdef HAVE_BROTLI
+#include <brotli/decode.h>
+#endif
+
 #if defined(HAVE_ICONV) && defined(CURL_DOES_CONVERSIONS)
 #include <iconv.h>
 #endif
@@ -105,6 +109,18 @@ char *curl_version(void)
   left -= len;
   ptr += len;
 #endif
+#ifdef HAVE_BROTLI
+  {
+    /* the version number is 0xMMMNNNPPP, as in major, minor and patch */
+    uint32_t brotli_version = BrotliDecoderVersion();
+    len = snprintf(ptr, left, " brotli/%u.%u.%u",
+                   (unsigned int)(brotli_version >> 24),
+                   (unsigned int)((brotli_version >> 12) & 0xfff),
+                   (unsigned int)(brotli_version & 0xfff));
+    left -= len;
+    ptr += len;
+  }
+#endif
 #ifdef USE_ARES
   /* this function is only present in c-ares, not in the original ares */
   len = snprintf(ptr, left, " c-ares/%s", ares_version(NULL));
@@ -296,6 +312,9 @@ static curl_version_info_data version_info = {
 #ifdef HAVE_LIBZ
   | CURL_VERSION_LIBZ
 #endif
+#ifdef HAVE_BROTLI
+  | CURL_VERSION_BROTLI
+#endif
 #ifdef DEBUGBUILD
   | CURL_VERSION_DEBUG
 #endif
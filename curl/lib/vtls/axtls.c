@@ -259,6 +259,7 @@ static CURLcode connect_prep(struct connectdata *conn, int sockindex)
    */
 
   /* In axTLS, handshaking happens inside ssl_client_new. */
+  Curl_ssl_sessionid_lock(conn);
   if(!Curl_ssl_getsessionid(conn, (void **) &ssl_sessionid, &ssl_idsize)) {
     /* we got a session id, use it! */
     infof (data, "SSL re-using session ID\n");
@@ -267,6 +268,7 @@ static CURLcode connect_prep(struct connectdata *conn, int sockindex)
   }
   else
     ssl = ssl_client_new(ssl_ctx, conn->sock[sockindex], NULL, 0);
+  Curl_ssl_sessionid_unlock(conn);
 
   conn->ssl[sockindex].ssl = ssl;
   return CURLE_OK;
@@ -381,9 +383,11 @@ static CURLcode connect_finish(struct connectdata *conn, int sockindex)
   /* Put our freshly minted SSL session in cache */
   ssl_idsize = ssl_get_session_id_size(ssl);
   ssl_sessionid = ssl_get_session_id(ssl);
+  Curl_ssl_sessionid_lock(conn);
   if(Curl_ssl_addsessionid(conn, (void *) ssl_sessionid, ssl_idsize)
      != CURLE_OK)
     infof (data, "failed to add session to cache\n");
+  Curl_ssl_sessionid_unlock(conn);
 
   return CURLE_OK;
 }
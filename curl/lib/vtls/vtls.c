@@ -80,6 +80,12 @@
                                  (data->share->specifier &             \
                                   (1<<CURL_LOCK_DATA_SSL_SESSION)))
 
+/* sessions are not offered again once they are this many seconds old */
+#define SESSION_TTL (2*60*60)
+
+#define SESSION_EXPIRED(session, now) \
+  (((now) - (session)->stored) > SESSION_TTL)
+
 static bool safe_strequal(char* str1, char* str2)
 {
   if(str1 && str2)
@@ -330,72 +336,88 @@ Curl_ssl_connect_nonblocking(struct connectdata *conn, int sockindex,
 }
 
 /*
- * Check if there's a session ID for the given connection in the cache, and if
- * there's one suitable, it is provided. Returns TRUE when no entry matched.
+ * Lock shared SSL session data. The session ID functions below must only be
+ * called with this lock held, and the session IDs they return are only
+ * guaranteed to stay valid until it is released.
  */
-bool Curl_ssl_getsessionid(struct connectdata *conn,
-                           void **ssl_sessionid,
-                           size_t *idsize) /* set 0 if unknown */
+void Curl_ssl_sessionid_lock(struct connectdata *conn)
 {
-  struct curl_ssl_session *check;
-  struct SessionHandle *data = conn->data;
-  size_t i;
-  long *general_age;
-  bool no_match = TRUE;
-
-  *ssl_sessionid = NULL;
+  if(SSLSESSION_SHARED(conn->data))
+    Curl_share_lock(conn->data,
+                    CURL_LOCK_DATA_SSL_SESSION, CURL_LOCK_ACCESS_SINGLE);
+}
 
-  if(!conn->ssl_config.sessionid)
-    /* session ID re-use is disabled */
-    return TRUE;
+/*
+ * Unlock shared SSL session data
+ */
+void Curl_ssl_sessionid_unlock(struct connectdata *conn)
+{
+  if(SSLSESSION_SHARED(conn->data))
+    Curl_share_unlock(conn->data, CURL_LOCK_DATA_SSL_SESSION);
+}
 
-  /* Lock if shared */
-  if(SSLSESSION_SHARED(data)) {
-    Curl_share_lock(data, CURL_LOCK_DATA_SSL_SESSION, CURL_LOCK_ACCESS_SINGLE);
-    general_age = &data->share->sessionage;
-  }
-  else
-    general_age = &data->state.sessionage;
-
-  for(i = 0; i < data->set.ssl.max_ssl_sessions; i++) {
-    check = &data->state.session[i];
-    if(!check->sessionid)
-      /* not session ID means blank entry */
-      continue;
-    if(Curl_raw_equal(conn->host.name, check->name) &&
-       ((!conn->bits.conn_to_host && !check->conn_to_host) ||
-         (conn->bits.conn_to_host && check->conn_to_host &&
-           Curl_raw_equal(conn->conn_to_host.name, check->conn_to_host))) &&
-       ((!conn->bits.conn_to_port && check->conn_to_port == -1) ||
-         (conn->bits.conn_to_port && check->conn_to_port != -1 &&
-           conn->conn_to_port == check->conn_to_port)) &&
-       (conn->remote_port == check->remote_port) &&
-       Curl_ssl_config_matches(&conn->ssl_config, &check->ssl_config)) {
-      /* yes, we have a session ID! */
-      (*general_age)++;          /* increase general age */
-      check->age = *general_age; /* set this as used in this age */
-      *ssl_sessionid = check->sessionid;
-      if(idsize)
-        *idsize = check->idsize;
-      no_match = FALSE;
-      break;
-    }
-  }
+static unsigned int hash_string(unsigned int hash, const char *str)
+{
+  if(!str)
+    return hash * 33;
+  while(*str)
+    hash = hash * 33 + (unsigned char)Curl_raw_toupper(*str++);
+  return hash * 33 + 1;
+}
 
-  /* Unlock */
-  if(SSLSESSION_SHARED(data))
-    Curl_share_unlock(data, CURL_LOCK_DATA_SSL_SESSION);
+/*
+ * Returns a hash of everything a cached session must match to be used for
+ * the given connection. Names are hashed case insensitively, as that is how
+ * session_matches() compares them.
+ */
+static unsigned int session_hash(struct connectdata *conn)
+{
+  struct ssl_config_data *ssl = &conn->ssl_config;
+  unsigned int hash = 5381;
+
+  hash = hash_string(hash, conn->host.name);
+  hash = hash_string(hash, conn->bits.conn_to_host ?
+                     conn->conn_to_host.name : NULL);
+  hash = hash * 33 + (unsigned int)conn->remote_port;
+  hash = hash * 33 + (unsigned int)(conn->bits.conn_to_port ?
+                                    conn->conn_to_port : -1);
+  hash = hash * 33 + (unsigned int)ssl->version;
+  hash = hash * 33 + (ssl->verifypeer ? 1 : 0) + (ssl->verifyhost ? 2 : 0);
+  hash = hash_string(hash, ssl->CApath);
+  hash = hash_string(hash, ssl->CAfile);
+  hash = hash_string(hash, ssl->random_file);
+  hash = hash_string(hash, ssl->egdsocket);
+  return hash_string(hash, ssl->cipher_list);
+}
 
-  return no_match;
+static bool session_matches(struct connectdata *conn,
+                            struct curl_ssl_session *check)
+{
+  return Curl_raw_equal(conn->host.name, check->name) &&
+    ((!conn->bits.conn_to_host && !check->conn_to_host) ||
+     (conn->bits.conn_to_host && check->conn_to_host &&
+      Curl_raw_equal(conn->conn_to_host.name, check->conn_to_host))) &&
+    ((!conn->bits.conn_to_port && check->conn_to_port == -1) ||
+     (conn->bits.conn_to_port && check->conn_to_port != -1 &&
+      conn->conn_to_port == check->conn_to_port)) &&
+    (conn->remote_port == check->remote_port) &&
+    Curl_ssl_config_matches(&conn->ssl_config, &check->ssl_config);
 }
 
 /*
  * Kill a single session ID entry in the cache.
  */
-void Curl_ssl_kill_session(struct curl_ssl_session *session)
+static void kill_session(struct curl_ssl_sessions *cache,
+                         struct curl_ssl_session *session)
 {
   if(session->sessionid) {
     /* defensive check */
+    struct curl_ssl_session **link = &cache->hash[session->hash % cache->max];
+
+    while(*link != session)
+      link = &(*link)->hnext;
+    *link = session->hnext;
+    session->hnext = NULL;
 
     /* free the ID the SSL-layer specific way */
     curlssl_session_free(session->sessionid);
@@ -411,27 +433,59 @@ void Curl_ssl_kill_session(struct curl_ssl_session *session)
 }
 
 /*
- * Delete the given session ID from the cache.
+ * Check if there's a session ID for the given connection in the cache, and if
+ * there's one suitable, it is provided. Returns TRUE when no entry matched.
  */
-void Curl_ssl_delsessionid(struct connectdata *conn, void *ssl_sessionid)
+bool Curl_ssl_getsessionid(struct connectdata *conn,
+                           void **ssl_sessionid,
+                           size_t *idsize) /* set 0 if unknown */
 {
-  size_t i;
-  struct SessionHandle *data=conn->data;
+  struct curl_ssl_sessions *cache = conn->data->state.sslsessions;
+  struct curl_ssl_session *check;
+  unsigned int hash;
+
+  *ssl_sessionid = NULL;
+
+  if(!conn->ssl_config.sessionid || !cache)
+    /* session ID re-use is disabled */
+    return TRUE;
 
-  if(SSLSESSION_SHARED(data))
-    Curl_share_lock(data, CURL_LOCK_DATA_SSL_SESSION, CURL_LOCK_ACCESS_SINGLE);
+  hash = session_hash(conn);
+  for(check = cache->hash[hash % cache->max]; check; check = check->hnext) {
+    if((check->hash == hash) && session_matches(conn, check)) {
+      if(SESSION_EXPIRED(check, time(NULL))) {
+        kill_session(cache, check);
+        break;
+      }
+      /* yes, we have a session ID! */
+      cache->age++;            /* increase general age */
+      check->age = cache->age; /* set this as used in this age */
+      *ssl_sessionid = check->sessionid;
+      if(idsize)
+        *idsize = check->idsize;
+      return FALSE;
+    }
+  }
 
-  for(i = 0; i < data->set.ssl.max_ssl_sessions; i++) {
-    struct curl_ssl_session *check = &data->state.session[i];
+  return TRUE;
+}
 
+/*
+ * Delete the given session ID from the cache.
+ */
+void Curl_ssl_delsessionid(struct connectdata *conn, void *ssl_sessionid)
+{
+  struct curl_ssl_sessions *cache = conn->data->state.sslsessions;
+  struct curl_ssl_session *check;
+
+  /* the ID was found for this connection, so it is in its hash chain */
+  for(check = cache->hash[session_hash(conn) % cache->max]; check;
+      check = check->hnext) {
     if(check->sessionid == ssl_sessionid) {
-      Curl_ssl_kill_session(check);
+      kill_session(cache, check);
       break;
     }
   }
-
-  if(SSLSESSION_SHARED(data))
-    Curl_share_unlock(data, CURL_LOCK_DATA_SSL_SESSION);
 }
 
 /*
@@ -445,13 +499,14 @@ CURLcode Curl_ssl_addsessionid(struct connectdata *conn,
                                size_t idsize)
 {
   size_t i;
-  struct SessionHandle *data=conn->data; /* the mother of all structs */
-  struct curl_ssl_session *store = &data->state.session[0];
-  long oldest_age=data->state.session[0].age; /* zero if unused */
+  struct curl_ssl_sessions *cache = conn->data->state.sslsessions;
+  struct curl_ssl_session *store = NULL;
+  struct curl_ssl_session **chain;
+  struct ssl_config_data clone_config;
   char *clone_host;
   char *clone_conn_to_host;
   int conn_to_port;
-  long *general_age;
+  time_t now = time(NULL);
 
   /* Even though session ID re-use might be disabled, that only disables USING
      IT. We still store it here in case the re-using is again enabled for an
@@ -471,75 +526,105 @@ CURLcode Curl_ssl_addsessionid(struct connectdata *conn,
   else
     clone_conn_to_host = NULL;
 
+  memset(&clone_config, 0, sizeof(clone_config));
+  if(!Curl_clone_ssl_config(&conn->ssl_config, &clone_config)) {
+    Curl_free_ssl_config(&clone_config);
+    free(clone_host);
+    free(clone_conn_to_host);
+    return CURLE_OUT_OF_MEMORY; /* let caller free sessionid */
+  }
+
   if(conn->bits.conn_to_port)
     conn_to_port = conn->conn_to_port;
   else
     conn_to_port = -1;
 
-  /* Now we should add the session ID and the host name to the cache, (remove
-     the oldest if necessary) */
-
-  /* If using shared SSL session, lock! */
-  if(SSLSESSION_SHARED(data)) {
-    Curl_share_lock(data, CURL_LOCK_DATA_SSL_SESSION, CURL_LOCK_ACCESS_SINGLE);
-    general_age = &data->share->sessionage;
-  }
-  else {
-    general_age = &data->state.sessionage;
-  }
-
-  /* find an empty slot for us, or find the oldest */
-  for(i = 1; (i < data->set.ssl.max_ssl_sessions) &&
-        data->state.session[i].sessionid; i++) {
-    if(data->state.session[i].age < oldest_age) {
-      oldest_age = data->state.session[i].age;
-      store = &data->state.session[i];
+  /* Now we should add the session ID and the host name to the cache. Use an
+     empty or expired entry if there is one, or else replace the one that was
+     used the longest time ago. */
+  for(i = 0; i < cache->max; i++) {
+    struct curl_ssl_session *check = &cache->session[i];
+    if(!check->sessionid || SESSION_EXPIRED(check, now)) {
+      store = check;
+      break;
     }
+    if(!store || (check->age < store->age))
+      store = check;
   }
-  if(i == data->set.ssl.max_ssl_sessions)
-    /* cache is full, we must "kill" the oldest entry! */
-    Curl_ssl_kill_session(store);
-  else
-    store = &data->state.session[i]; /* use this slot */
+  kill_session(cache, store);
 
   /* now init the session struct wisely */
   store->sessionid = ssl_sessionid;
   store->idsize = idsize;
-  store->age = *general_age;    /* set current age */
-    /* free it if there's one already present */
-  free(store->name);
-  free(store->conn_to_host);
+  store->age = cache->age;    /* set current age */
+  store->stored = now;
   store->name = clone_host;               /* clone host name */
   store->conn_to_host = clone_conn_to_host; /* clone connect to host name */
   store->conn_to_port = conn_to_port; /* connect to port number */
   store->remote_port = conn->remote_port; /* port number */
+  store->ssl_config = clone_config;
 
-  /* Unlock */
-  if(SSLSESSION_SHARED(data))
-    Curl_share_unlock(data, CURL_LOCK_DATA_SSL_SESSION);
+  store->hash = session_hash(conn);
+  chain = &cache->hash[store->hash % cache->max];
+  store->hnext = *chain;
+  *chain = store;
 
-  if(!Curl_clone_ssl_config(&conn->ssl_config, &store->ssl_config)) {
-    store->sessionid = NULL; /* let caller free sessionid */
-    free(clone_host);
-    free(clone_conn_to_host);
-    return CURLE_OUT_OF_MEMORY;
+  return CURLE_OK;
+}
+
+/*
+ * Create a session ID cache with room for 'amount' sessions.
+ */
+struct curl_ssl_sessions *Curl_ssl_create_sessions(size_t amount)
+{
+  struct curl_ssl_sessions *cache;
+
+  if(!amount)
+    amount = 1;
+
+  cache = calloc(1, sizeof(struct curl_ssl_sessions));
+  if(!cache)
+    return NULL;
+
+  cache->session = calloc(amount, sizeof(struct curl_ssl_session));
+  cache->hash = calloc(amount, sizeof(struct curl_ssl_session *));
+  if(!cache->session || !cache->hash) {
+    free(cache->session);
+    free(cache->hash);
+    free(cache);
+    return NULL;
   }
+  cache->max = amount;
+  cache->age = 1; /* this is brand new */
+  return cache;
+}
 
-  return CURLE_OK;
+/*
+ * Kill all sessions in a cache and free it.
+ */
+void Curl_ssl_destroy_sessions(struct curl_ssl_sessions *cache)
+{
+  size_t i;
+
+  if(!cache)
+    return;
+
+  for(i = 0; i < cache->max; i++)
+    /* the single-killer function handles empty table slots */
+    kill_session(cache, &cache->session[i]);
+
+  free(cache->session);
+  free(cache->hash);
+  free(cache);
 }
 
 
 void Curl_ssl_close_all(struct SessionHandle *data)
 {
-  size_t i;
   /* kill the session ID cache if not shared */
-  if(data->state.session && !SSLSESSION_SHARED(data)) {
-    for(i = 0; i < data->set.ssl.max_ssl_sessions; i++)
-      /* the single-killer function handles empty table slots */
-      Curl_ssl_kill_session(&data->state.session[i]);
-
-    /* free the cache data */
-    Curl_safefree(data->state.session);
+  if(data->state.sslsessions && !SSLSESSION_SHARED(data)) {
+    Curl_ssl_destroy_sessions(data->state.sslsessions);
+    data->state.sslsessions = NULL;
   }
 
   curlssl_close_all(data);
@@ -591,20 +676,19 @@ struct curl_slist *Curl_ssl_engines_list(struct SessionHandle *data)
  */
 CURLcode Curl_ssl_initsessions(struct SessionHandle *data, size_t amount)
 {
-  struct curl_ssl_session *session;
+  struct curl_ssl_sessions *cache;
 
-  if(data->state.session)
+  if(data->state.sslsessions)
     /* this is just a precaution to prevent multiple inits */
     return CURLE_OK;
 
-  session = calloc(amount, sizeof(struct curl_ssl_session));
-  if(!session)
+  cache = Curl_ssl_create_sessions(amount);
+  if(!cache)
     return CURLE_OUT_OF_MEMORY;
 
   /* store the info in the SSL section */
-  data->set.ssl.max_ssl_sessions = amount;
-  data->state.session = session;
-  data->state.sessionage = 1; /* this is brand new */
+  data->set.ssl.max_ssl_sessions = cache->max;
+  data->state.sslsessions = cache;
   return CURLE_OK;
 }
 
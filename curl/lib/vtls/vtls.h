@@ -79,6 +79,9 @@ struct curl_slist *Curl_ssl_engines_list(struct SessionHandle *data);
 
 /* init the SSL session ID cache */
 CURLcode Curl_ssl_initsessions(struct SessionHandle *, size_t);
+/* create and destroy a session ID cache, as used by shares */
+struct curl_ssl_sessions *Curl_ssl_create_sessions(size_t amount);
+void Curl_ssl_destroy_sessions(struct curl_ssl_sessions *cache);
 size_t Curl_ssl_version(char *buffer, size_t size);
 bool Curl_ssl_data_pending(const struct connectdata *conn,
                            int connindex);
@@ -96,6 +99,10 @@ CURLcode Curl_ssl_push_certinfo(struct SessionHandle * data, int certnum,
 
 /* Functions to be used by SSL library adaptation functions */
 
+/* lock and unlock the session ID cache, the functions below that use it
+   must be called with this lock held */
+void Curl_ssl_sessionid_lock(struct connectdata *conn);
+void Curl_ssl_sessionid_unlock(struct connectdata *conn);
 /* extract a session ID */
 bool Curl_ssl_getsessionid(struct connectdata *conn,
                            void **ssl_sessionid,
@@ -104,8 +111,6 @@ bool Curl_ssl_getsessionid(struct connectdata *conn,
 CURLcode Curl_ssl_addsessionid(struct connectdata *conn,
                                void *ssl_sessionid,
                                size_t idsize);
-/* Kill a single session ID entry in the cache */
-void Curl_ssl_kill_session(struct curl_ssl_session *session);
 /* delete a session from the cache */
 void Curl_ssl_delsessionid(struct connectdata *conn, void *ssl_sessionid);
 
@@ -128,6 +133,9 @@ bool Curl_ssl_false_start(void);
 
 #define SSL_SHUTDOWN_TIMEOUT 10000 /* ms */
 
+/* number of sessions in the session ID cache of a share */
+#define SHARED_SSL_SESSIONS 64
+
 #else
 /* Set the API backend definition to none */
 #define CURL_SSL_BACKEND CURLSSLBACKEND_NONE
@@ -150,7 +158,6 @@ bool Curl_ssl_false_start(void);
 #define Curl_ssl_check_cxn(x) 0
 #define Curl_ssl_free_certinfo(x) Curl_nop_stmt
 #define Curl_ssl_connect_nonblocking(x,y,z) CURLE_NOT_BUILT_IN
-#define Curl_ssl_kill_session(x) Curl_nop_stmt
 #define Curl_ssl_random(x,y,z) ((void)x, CURLE_NOT_BUILT_IN)
 #define Curl_ssl_cert_status_request() FALSE
 #define Curl_ssl_false_start() FALSE
@@ -680,6 +680,7 @@ curl_easy_getinfo_ccsid(CURL * curl, CURLINFO info, ...)
 
       case CURLINFO_TLS_SESSION:
       case CURLINFO_TLS_SSL_PTR:
+      case CURLINFO_TRANSFER_STATS:
       case CURLINFO_SOCKET:
         break;
 
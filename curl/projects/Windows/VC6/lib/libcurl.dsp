@@ -1110,6 +1110,10 @@ SOURCE=..\..\..\..\lib\timeval.c
 # End Source File
 # Begin Source File
 
+SOURCE=..\..\..\..\lib\timewheel.c
+# End Source File
+# Begin Source File
+
 SOURCE=..\..\..\..\lib\transfer.c
 # End Source File
 # Begin Source File
@@ -1610,6 +1614,10 @@ SOURCE=..\..\..\..\lib\timeval.h
 # End Source File
 # Begin Source File
 
+SOURCE=..\..\..\..\lib\timewheel.h
+# End Source File
+# Begin Source File
+
 SOURCE=..\..\..\..\lib\transfer.h
 # End Source File
 # Begin Source File
@@ -829,7 +829,8 @@ static CURLcode operate_do(struct GlobalConfig *global,
         my_setopt(curl, CURLOPT_SEEKDATA, &input);
         my_setopt(curl, CURLOPT_SEEKFUNCTION, tool_seek_cb);
 
-        if(config->recvpersecond)
+        if(config->recvpersecond &&
+           (config->recvpersecond < CURL_MAX_WRITE_SIZE))
           /* tell libcurl to use a smaller sized buffer as it allows us to
              make better sleeps! 7.9.9 stuff! */
           my_setopt(curl, CURLOPT_BUFFERSIZE, (long)config->recvpersecond);
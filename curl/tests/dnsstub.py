@@ -0,0 +1,105 @@
+#!/usr/bin/env python
+#***************************************************************************
+#                                  _   _ ____  _
+#  Project                     ___| | | |  _ \| |
+#                             / __| | | | |_) | |
+#                            | (__| |_| |  _ <| |___
+#                             \___|\___/|_| \_\_____|
+#
+# Copyright (C) 1998 - 2016, Daniel Stenberg, <daniel@haxx.se>, et al.
+#
+# This software is licensed as described in the file COPYING, which
+# you should have received as part of this distribution. The terms
+# are also available at https://curl.haxx.se/docs/copyright.html.
+#
+# You may opt to use, copy, modify, merge, publish, distribute and/or sell
+# copies of the Software, and permit persons to whom the Software is
+# furnished to do so, under the terms of the COPYING file.
+#
+# This software is distributed on an "AS IS" basis, WITHOUT WARRANTY OF ANY
+# KIND, either express or implied.
+#
+###########################################################################
+#
+# A stub DNS server for benchmarking name resolves. It answers every A
+# query with 127.0.0.1 and every other query with an empty answer, after a
+# fixed delay that stands in for the latency of a real resolver. Queries are
+# answered concurrently, so the delay does not add up when many are sent at
+# once.
+#
+# The system resolver only talks to port 53, so to benchmark the threaded
+# resolver with lib1532, run this as root and point /etc/resolv.conf at
+# 127.0.0.1:
+#
+#   python dnsstub.py --delay 20 &
+#   ./libtest/lib1532 - example.test 100
+#
+import argparse
+import heapq
+import select
+import socket
+import struct
+import time
+
+parser = argparse.ArgumentParser(description="stub DNS server")
+parser.add_argument("--addr", action="store", default="127.0.0.1",
+                    help="address to listen on")
+parser.add_argument("--port", action="store", type=int, default=53,
+                    help="port to listen on")
+parser.add_argument("--delay", action="store", type=float, default=20.0,
+                    help="milliseconds to wait before answering")
+args = parser.parse_args()
+
+
+def answer(query):
+    """Returns the response to a query, or None if it is malformed."""
+    if len(query) < 12:
+        return None
+    (qid, qdcount) = struct.unpack(">H2xH", query[:6])
+    if qdcount != 1:
+        return None
+
+    # skip the labels of the question name
+    i = 12
+    while i < len(query) and bytearray(query[i:i + 1])[0] != 0:
+        i += bytearray(query[i:i + 1])[0] + 1
+    end = i + 5
+    if end > len(query):
+        return None
+    (qtype,) = struct.unpack(">H", query[i + 1:i + 3])
+
+    question = query[12:end]
+    if qtype == 1:
+        header = struct.pack(">HHHHHH", qid, 0x8180, 1, 1, 0, 0)
+        # a pointer to the question name, type A, class IN, TTL, address
+        record = struct.pack(">HHHIH", 0xc00c, 1, 1, 60, 4) + \
+            socket.inet_aton("127.0.0.1")
+    else:
+        header = struct.pack(">HHHHHH", qid, 0x8180, 1, 0, 0, 0)
+        record = b""
+    return header + question + record
+
+
+sock = socket.socket(socket.AF_INET, socket.SOCK_DGRAM)
+sock.bind((args.addr, args.port))
+
+pending = []  # (when, sequence, response, address), soonest first
+sequence = 0
+while True:
+    timeout = None
+    if pending:
+        timeout = max(pending[0][0] - time.time(), 0)
+    readable = select.select([sock], [], [], timeout)[0]
+
+    if readable:
+        (query, addr) = sock.recvfrom(4096)
+        response = answer(query)
+        if response is not None:
+            sequence += 1
+            heapq.heappush(pending, (time.time() + args.delay / 1000.0,
+                                     sequence, response, addr))
+
+    now = time.time()
+    while pending and pending[0][0] <= now:
+        (_, _, response, addr) = heapq.heappop(pending)
+        sock.sendto(response, addr)
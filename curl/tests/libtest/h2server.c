@@ -0,0 +1,528 @@
+/***************************************************************************
+ *                                  _   _ ____  _
+ *  Project                     ___| | | |  _ \| |
+ *                             / __| | | | |_) | |
+ *                            | (__| |_| |  _ <| |___
+ *                             \___|\___/|_| \_\_____|
+ *
+ * Copyright (C) 1998 - 2016, Daniel Stenberg, <daniel@haxx.se>, et al.
+ *
+ * This software is licensed as described in the file COPYING, which
+ * you should have received as part of this distribution. The terms
+ * are also available at https://curl.haxx.se/docs/copyright.html.
+ *
+ * You may opt to use, copy, modify, merge, publish, distribute and/or sell
+ * copies of the Software, and permit persons to whom the Software is
+ * furnished to do so, under the terms of the COPYING file.
+ *
+ * This software is distributed on an "AS IS" basis, WITHOUT WARRANTY OF ANY
+ * KIND, either express or implied.
+ *
+ ***************************************************************************/
+#include "curl_setup.h"
+#include <curl/curl.h>
+
+#ifdef HAVE_NETINET_IN_H
+#include <netinet/in.h>
+#endif
+#ifdef HAVE_ARPA_INET_H
+#include <arpa/inet.h>
+#endif
+#ifdef HAVE_FCNTL_H
+#include <fcntl.h>
+#endif
+
+#include "h2server.h"
+#include "memdebug.h"
+
+#ifndef MSG_NOSIGNAL
+#define MSG_NOSIGNAL 0
+#endif
+
+#define H2_MAX_CONNS 8
+#define H2_MAX_STREAMS 256 /* open at once, announced in SETTINGS */
+#define H2_FRAME_SIZE 16384 /* SETTINGS_MAX_FRAME_SIZE default */
+#define H2_WINDOW 65535 /* initial flow-control window */
+#define H2_INBUF (H2_FRAME_SIZE + 9)
+#define H2_OUTBUF (4 * (H2_FRAME_SIZE + 9))
+#define H2_RESERVE 256 /* output buffer space kept free for control frames */
+
+#define H2_DATA          0x0
+#define H2_HEADERS       0x1
+#define H2_RST_STREAM    0x3
+#define H2_SETTINGS      0x4
+#define H2_PING          0x6
+#define H2_GOAWAY        0x7
+#define H2_WINDOW_UPDATE 0x8
+
+#define H2_FLAG_ACK         0x1
+#define H2_FLAG_END_STREAM  0x1
+#define H2_FLAG_END_HEADERS 0x4
+
+#define H2_SETTINGS_MAX_CONCURRENT_STREAMS 0x3
+#define H2_SETTINGS_INITIAL_WINDOW_SIZE 0x4
+
+static const char preface[] = "PRI * HTTP/2.0\r\n\r\nSM\r\n\r\n";
+#define H2_PREFACE_LEN 24
+
+struct h2stream {
+  unsigned int id;
+  size_t sent;  /* body bytes sent */
+  long window;
+  bool done;    /* all sent or reset */
+};
+
+struct h2conn {
+  curl_socket_t sock;
+  unsigned char in[H2_INBUF];
+  size_t inlen;
+  unsigned char out[H2_OUTBUF];
+  size_t outlen;
+  size_t outsent;
+  bool preface;  /* client preface seen */
+  long window;   /* connection window */
+  long initial;  /* initial stream window */
+  struct h2stream streams[H2_MAX_STREAMS];
+  int nstreams;
+  int next;      /* stream to send DATA for next */
+};
+
+struct h2server {
+  curl_socket_t listener;
+  int port;
+  size_t bodysize;
+  struct h2conn *conns[H2_MAX_CONNS];
+  int nconns;
+};
+
+unsigned char h2server_byte(size_t offset)
+{
+  return (unsigned char)('a' + offset % 26);
+}
+
+static int nonblock(curl_socket_t sock)
+{
+#ifdef HAVE_FCNTL_O_NONBLOCK
+  int flags = fcntl(sock, F_GETFL, 0);
+  return fcntl(sock, F_SETFL, flags | O_NONBLOCK);
+#elif defined(HAVE_IOCTLSOCKET_FIONBIO)
+  unsigned long on = 1;
+  return ioctlsocket(sock, FIONBIO, &on);
+#else
+  (void)sock;
+  return -1;
+#endif
+}
+
+struct h2server *h2server_start(size_t bodysize)
+{
+  struct h2server *srv;
+  struct sockaddr_in addr;
+  curl_socklen_t addrlen = sizeof(addr);
+
+  srv = calloc(1, sizeof(*srv));
+  if(!srv)
+    return NULL;
+  srv->bodysize = bodysize;
+
+  srv->listener = socket(AF_INET, SOCK_STREAM, 0);
+  if(srv->listener == CURL_SOCKET_BAD) {
+    free(srv);
+    return NULL;
+  }
+
+  memset(&addr, 0, sizeof(addr));
+  addr.sin_family = AF_INET;
+  addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+  addr.sin_port = 0;
+  if(bind(srv->listener, (struct sockaddr *)&addr, sizeof(addr)) ||
+     listen(srv->listener, H2_MAX_CONNS) ||
+     getsockname(srv->listener, (struct sockaddr *)&addr, &addrlen) ||
+     nonblock(srv->listener)) {
+    sclose(srv->listener);
+    free(srv);
+    return NULL;
+  }
+  srv->port = ntohs(addr.sin_port);
+  return srv;
+}
+
+int h2server_port(struct h2server *srv)
+{
+  return srv->port;
+}
+
+int h2server_connections(struct h2server *srv)
+{
+  return srv->nconns;
+}
+
+unsigned int h2server_waitfds(struct h2server *srv, struct curl_waitfd *fds,
+                              unsigned int max)
+{
+  unsigned int n = 0;
+  int i;
+
+  if(n < max) {
+    fds[n].fd = srv->listener;
+    fds[n].events = CURL_WAIT_POLLIN;
+    fds[n].revents = 0;
+    n++;
+  }
+  for(i = 0; (i < srv->nconns) && (n < max); i++) {
+    struct h2conn *c = srv->conns[i];
+    if(c->sock == CURL_SOCKET_BAD)
+      continue;
+    fds[n].fd = c->sock;
+    fds[n].events = CURL_WAIT_POLLIN;
+    if(c->outsent < c->outlen)
+      fds[n].events |= CURL_WAIT_POLLOUT;
+    fds[n].revents = 0;
+    n++;
+  }
+  return n;
+}
+
+static unsigned int get32(const unsigned char *p)
+{
+  return ((unsigned int)p[0] << 24) | ((unsigned int)p[1] << 16) |
+    ((unsigned int)p[2] << 8) | p[3];
+}
+
+/* Appends a frame header and makes room for the payload. Returns a pointer
+   to the payload or NULL if it doesn't fit. */
+static unsigned char *frame(struct h2conn *c, int type, int flags,
+                            unsigned int id, size_t len)
+{
+  unsigned char *p;
+
+  if(c->outsent) {
+    memmove(c->out, &c->out[c->outsent], c->outlen - c->outsent);
+    c->outlen -= c->outsent;
+    c->outsent = 0;
+  }
+  if(c->outlen + 9 + len > sizeof(c->out))
+    return NULL;
+
+  p = &c->out[c->outlen];
+  p[0] = (unsigned char)(len >> 16);
+  p[1] = (unsigned char)(len >> 8);
+  p[2] = (unsigned char)len;
+  p[3] = (unsigned char)type;
+  p[4] = (unsigned char)flags;
+  p[5] = (unsigned char)((id >> 24) & 0x7f);
+  p[6] = (unsigned char)(id >> 16);
+  p[7] = (unsigned char)(id >> 8);
+  p[8] = (unsigned char)id;
+  c->outlen += 9 + len;
+  return p + 9;
+}
+
+static struct h2stream *find_stream(struct h2conn *c, unsigned int id)
+{
+  int i;
+  for(i = 0; i < c->nstreams; i++)
+    if(c->streams[i].id == id)
+      return &c->streams[i];
+  return NULL;
+}
+
+/* Answers a new request with ":status: 200" and its content-length */
+static int respond(struct h2server *srv, struct h2conn *c, unsigned int id)
+{
+  struct h2stream *s;
+  char length[32];
+  size_t llen;
+  unsigned char *p;
+  int flags = H2_FLAG_END_HEADERS;
+
+  if(find_stream(c, id))
+    return 0; /* trailers or the like, nothing to do */
+  if(c->nstreams == H2_MAX_STREAMS)
+    return -1;
+
+  snprintf(length, sizeof(length), "%lu", (unsigned long)srv->bodysize);
+  llen = strlen(length);
+  if(!srv->bodysize)
+    flags |= H2_FLAG_END_STREAM;
+
+  /* HPACK: indexed ":status: 200", then content-length (static index 28) as
+     a literal without indexing */
+  p = frame(c, H2_HEADERS, flags, id, 4 + llen);
+  if(!p)
+    return -1;
+  p[0] = 0x88;
+  p[1] = 0x0f;
+  p[2] = 28 - 15;
+  p[3] = (unsigned char)llen;
+  memcpy(&p[4], length, llen);
+
+  if(srv->bodysize) {
+    s = &c->streams[c->nstreams++];
+    s->id = id;
+    s->sent = 0;
+    s->window = c->initial;
+    s->done = FALSE;
+  }
+  return 0;
+}
+
+static int handle_frame(struct h2server *srv, struct h2conn *c,
+                        const unsigned char *hd, const unsigned char *p)
+{
+  size_t len = ((size_t)hd[0] << 16) | ((size_t)hd[1] << 8) | hd[2];
+  int type = hd[3];
+  int flags = hd[4];
+  unsigned int id = get32(&hd[5]) & 0x7fffffff;
+  struct h2stream *s;
+  unsigned char *ack;
+  size_t i;
+
+  switch(type) {
+  case H2_HEADERS:
+    return respond(srv, c, id);
+
+  case H2_SETTINGS:
+    if(flags & H2_FLAG_ACK)
+      return 0;
+    for(i = 0; i + 6 <= len; i += 6) {
+      int param = (p[i] << 8) | p[i + 1];
+      long value = (long)get32(&p[i + 2]);
+      if(param == H2_SETTINGS_INITIAL_WINDOW_SIZE) {
+        int n;
+        for(n = 0; n < c->nstreams; n++)
+          c->streams[n].window += value - c->initial;
+        c->initial = value;
+      }
+    }
+    return frame(c, H2_SETTINGS, H2_FLAG_ACK, 0, 0) ? 0 : -1;
+
+  case H2_PING:
+    if(flags & H2_FLAG_ACK)
+      return 0;
+    ack = frame(c, H2_PING, H2_FLAG_ACK, 0, len);
+    if(!ack)
+      return -1;
+    memcpy(ack, p, len);
+    return 0;
+
+  case H2_WINDOW_UPDATE:
+    if(len != 4)
+      return -1;
+    if(!id)
+      c->window += (long)(get32(p) & 0x7fffffff);
+    else {
+      s = find_stream(c, id);
+      if(s)
+        s->window += (long)(get32(p) & 0x7fffffff);
+    }
+    return 0;
+
+  case H2_RST_STREAM:
+    s = find_stream(c, id);
+    if(s)
+      s->done = TRUE;
+    return 0;
+
+  case H2_GOAWAY:
+    for(i = 0; i < (size_t)c->nstreams; i++)
+      c->streams[i].done = TRUE;
+    return 0;
+
+  case H2_DATA:
+    /* request bodies aren't expected */
+    return -1;
+
+  default:
+    /* PRIORITY, CONTINUATION and everything else is ignored */
+    return 0;
+  }
+}
+
+/* Queues DATA frames, one stream after the other, as far as the windows and
+   the output buffer allow */
+static void send_data(struct h2server *srv, struct h2conn *c)
+{
+  int idle = 0;
+  int from;
+  int to = 0;
+
+  /* forget the streams that are done, so that their slots can be used by
+     new ones */
+  for(from = 0; from < c->nstreams; from++)
+    if(!c->streams[from].done)
+      c->streams[to++] = c->streams[from];
+  c->nstreams = to;
+  if(c->next >= to)
+    c->next = 0;
+
+  while(c->nstreams && (idle < c->nstreams) && (c->window > 0)) {
+    struct h2stream *s = &c->streams[c->next];
+    size_t len = srv->bodysize - s->sent;
+    unsigned char *p;
+    size_t i;
+
+    c->next = (c->next + 1) % c->nstreams;
+    if(s->done || (s->window <= 0)) {
+      idle++;
+      continue;
+    }
+    idle = 0;
+
+    if(len > H2_FRAME_SIZE)
+      len = H2_FRAME_SIZE;
+    if(len > (size_t)s->window)
+      len = (size_t)s->window;
+    if(len > (size_t)c->window)
+      len = (size_t)c->window;
+    if(c->outlen - c->outsent + 9 + len + H2_RESERVE > sizeof(c->out))
+      break; /* keep room for control frames */
+
+    p = frame(c, H2_DATA,
+              (s->sent + len == srv->bodysize) ? H2_FLAG_END_STREAM : 0,
+              s->id, len);
+    if(!p)
+      break;
+    for(i = 0; i < len; i++)
+      p[i] = h2server_byte(s->sent + i);
+
+    s->sent += len;
+    s->window -= (long)len;
+    c->window -= (long)len;
+    if(s->sent == srv->bodysize)
+      s->done = TRUE;
+  }
+}
+
+static void conn_close(struct h2conn *c)
+{
+  if(c->sock != CURL_SOCKET_BAD) {
+    sclose(c->sock);
+    c->sock = CURL_SOCKET_BAD;
+  }
+}
+
+/* TRUE if the last socket call failed only because it would block */
+static bool again(void)
+{
+  int err = SOCKERRNO;
+  return (err == EWOULDBLOCK) || (err == EAGAIN) || (err == EINTR);
+}
+
+static int serve_conn(struct h2server *srv, struct h2conn *c)
+{
+  bool progress = TRUE;
+
+  while(progress) {
+    ssize_t n;
+    size_t used = 0;
+
+    progress = FALSE;
+    send_data(srv, c);
+
+    if(c->outsent < c->outlen) {
+      n = send(c->sock, (void *)&c->out[c->outsent], c->outlen - c->outsent,
+               MSG_NOSIGNAL);
+      if(n > 0) {
+        c->outsent += (size_t)n;
+        progress = TRUE;
+      }
+      else if(!again()) {
+        conn_close(c);
+        return 0;
+      }
+    }
+
+    n = recv(c->sock, (void *)&c->in[c->inlen], sizeof(c->in) - c->inlen,
+             0);
+    if(!n || ((n < 0) && !again())) {
+      conn_close(c);
+      return 0;
+    }
+    if(n < 0)
+      continue;
+    c->inlen += (size_t)n;
+    progress = TRUE;
+
+    if(!c->preface) {
+      if(c->inlen < H2_PREFACE_LEN)
+        continue;
+      if(memcmp(c->in, preface, H2_PREFACE_LEN))
+        return -1;
+      c->preface = TRUE;
+      used = H2_PREFACE_LEN;
+    }
+
+    while(c->inlen - used >= 9) {
+      const unsigned char *hd = &c->in[used];
+      size_t len = ((size_t)hd[0] << 16) | ((size_t)hd[1] << 8) | hd[2];
+      if(len > sizeof(c->in) - 9)
+        return -1;
+      if(c->inlen - used < 9 + len)
+        break;
+      if(handle_frame(srv, c, hd, &hd[9]))
+        return -1;
+      used += 9 + len;
+    }
+    memmove(c->in, &c->in[used], c->inlen - used);
+    c->inlen -= used;
+  }
+  return 0;
+}
+
+int h2server_serve(struct h2server *srv)
+{
+  int i;
+
+  for(;;) {
+    struct h2conn *c;
+    unsigned char *p;
+    curl_socket_t sock = accept(srv->listener, NULL, NULL);
+    if(sock == CURL_SOCKET_BAD)
+      break;
+    if((srv->nconns == H2_MAX_CONNS) || nonblock(sock)) {
+      sclose(sock);
+      return -1;
+    }
+    c = calloc(1, sizeof(*c));
+    if(!c) {
+      sclose(sock);
+      return -1;
+    }
+    c->sock = sock;
+    c->window = H2_WINDOW;
+    c->initial = H2_WINDOW;
+    /* the server preface, a SETTINGS frame with the stream limit */
+    p = frame(c, H2_SETTINGS, 0, 0, 6);
+    p[0] = 0;
+    p[1] = H2_SETTINGS_MAX_CONCURRENT_STREAMS;
+    p[2] = (H2_MAX_STREAMS >> 24) & 0xff;
+    p[3] = (H2_MAX_STREAMS >> 16) & 0xff;
+    p[4] = (H2_MAX_STREAMS >> 8) & 0xff;
+    p[5] = H2_MAX_STREAMS & 0xff;
+    srv->conns[srv->nconns++] = c;
+  }
+
+  for(i = 0; i < srv->nconns; i++) {
+    struct h2conn *c = srv->conns[i];
+    if((c->sock != CURL_SOCKET_BAD) && serve_conn(srv, c)) {
+      conn_close(c);
+      return -1;
+    }
+  }
+  return 0;
+}
+
+void h2server_stop(struct h2server *srv)
+{
+  int i;
+
+  if(!srv)
+    return;
+  for(i = 0; i < srv->nconns; i++) {
+    conn_close(srv->conns[i]);
+    free(srv->conns[i]);
+  }
+  sclose(srv->listener);
+  free(srv);
+}
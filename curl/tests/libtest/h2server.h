@@ -0,0 +1,70 @@
+#ifndef HEADER_CURL_LIBTEST_H2SERVER_H
+#define HEADER_CURL_LIBTEST_H2SERVER_H
+/***************************************************************************
+ *                                  _   _ ____  _
+ *  Project                     ___| | | |  _ \| |
+ *                             / __| | | | |_) | |
+ *                            | (__| |_| |  _ <| |___
+ *                             \___|\___/|_| \_\_____|
+ *
+ * Copyright (C) 1998 - 2016, Daniel Stenberg, <daniel@haxx.se>, et al.
+ *
+ * This software is licensed as described in the file COPYING, which
+ * you should have received as part of this distribution. The terms
+ * are also available at https://curl.haxx.se/docs/copyright.html.
+ *
+ * You may opt to use, copy, modify, merge, publish, distribute and/or sell
+ * copies of the Software, and permit persons to whom the Software is
+ * furnished to do so, under the terms of the COPYING file.
+ *
+ * This software is distributed on an "AS IS" basis, WITHOUT WARRANTY OF ANY
+ * KIND, either express or implied.
+ *
+ ***************************************************************************/
+#include "curl_setup.h"
+
+/*
+ * A minimal HTTP/2 server for libtests, run from the test's own multi loop.
+ * It takes h2c connections with prior knowledge on a port of its own and
+ * answers every request with "200" and a body of a fixed size, sent in DATA
+ * frames that respect the flow-control windows the client gives it. Each
+ * connection takes up to 256 streams at once, as it says in its SETTINGS.
+ */
+struct h2server;
+
+/*
+ * Starts listening on 127.0.0.1 at a port picked by the system. Every
+ * response body is bodysize bytes long, see h2server_byte().
+ *
+ * Returns: the server or NULL on failure.
+ */
+struct h2server *h2server_start(size_t bodysize);
+
+int h2server_port(struct h2server *srv);
+
+/*
+ * Fills in the sockets the server waits for, to be passed as extra fds to
+ * curl_multi_wait().
+ *
+ * Returns: the number of entries used, at most max.
+ */
+unsigned int h2server_waitfds(struct h2server *srv, struct curl_waitfd *fds,
+                              unsigned int max);
+
+/*
+ * Accepts connections, reads frames and sends responses as far as it can
+ * without blocking.
+ *
+ * Returns: nonzero if a client broke the protocol.
+ */
+int h2server_serve(struct h2server *srv);
+
+/* The number of connections accepted so far */
+int h2server_connections(struct h2server *srv);
+
+void h2server_stop(struct h2server *srv);
+
+/* The byte at the given offset of every response body */
+unsigned char h2server_byte(size_t offset);
+
+#endif /* HEADER_CURL_LIBTEST_H2SERVER_H */
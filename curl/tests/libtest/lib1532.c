@@ -0,0 +1,161 @@
+/***************************************************************************
+ *                                  _   _ ____  _
+ *  Project                     ___| | | |  _ \| |
+ *                             / __| | | | |_) | |
+ *                            | (__| |_| |  _ <| |___
+ *                             \___|\___/|_| \_\_____|
+ *
+ * Copyright (C) 1998 - 2016, Daniel Stenberg, <daniel@haxx.se>, et al.
+ *
+ * This software is licensed as described in the file COPYING, which
+ * you should have received as part of this distribution. The terms
+ * are also available at https://curl.haxx.se/docs/copyright.html.
+ *
+ * You may opt to use, copy, modify, merge, publish, distribute and/or sell
+ * copies of the Software, and permit persons to whom the Software is
+ * furnished to do so, under the terms of the COPYING file.
+ *
+ * This software is distributed on an "AS IS" basis, WITHOUT WARRANTY OF ANY
+ * KIND, either express or implied.
+ *
+ ***************************************************************************/
+#include "test.h"
+
+#include "testutil.h"
+#include "warnless.h"
+#include "memdebug.h"
+
+/*
+ * Runs many transfers at once in a multi handle, so that their name
+ * resolves overlap. In the test suite they all use the same host name and
+ * have to share the resolve.
+ *
+ * Given a domain name, and optionally a count, as extra arguments, each
+ * transfer instead connects to a host name of its own under that domain,
+ * which makes this a benchmark of cold resolves. tests/dnsstub.py is a stub
+ * resolver that answers for all names with a set latency:
+ *
+ *   ./lib1532 - example.test 100
+ */
+
+#define TEST_HANG_TIMEOUT 60 * 1000
+
+#define NUM_HANDLES 20
+
+/* The number of distinct names resolved by the benchmark by default */
+#define NUM_BENCH_HANDLES 100
+
+static size_t discard(char *ptr, size_t size, size_t nmemb, void *userp)
+{
+  (void)ptr;
+  (void)userp;
+  return size * nmemb;
+}
+
+int test(char *URL)
+{
+  CURL **curl = NULL;
+  CURLM *multi = NULL;
+  int still_running;
+  int num_handles = NUM_HANDLES;
+  int completed = 0;
+  int i;
+  int res = 0;
+  char target[256];
+  double lookup;
+  double slowest = 0.0;
+  struct timeval started;
+  CURLMsg *msg;
+  int msgs_left;
+
+  if(libtest_arg2)
+    num_handles = libtest_arg3 ? atoi(libtest_arg3) : NUM_BENCH_HANDLES;
+  if(num_handles <= 0) {
+    fprintf(stderr, "bad number of handles\n");
+    return TEST_ERR_USAGE;
+  }
+
+  curl = calloc((size_t)num_handles, sizeof(CURL *));
+  if(!curl)
+    return TEST_ERR_MAJOR_BAD;
+
+  start_test_timing();
+
+  global_init(CURL_GLOBAL_ALL);
+
+  multi_init(multi);
+
+  for(i = 0; i < num_handles; i++) {
+    easy_init(curl[i]);
+    if(libtest_arg2) {
+      snprintf(target, sizeof(target), "http://h%d.%s/", i, libtest_arg2);
+      easy_setopt(curl[i], CURLOPT_URL, target);
+      easy_setopt(curl[i], CURLOPT_CONNECT_ONLY, 1L);
+    }
+    else
+      easy_setopt(curl[i], CURLOPT_URL, URL);
+    easy_setopt(curl[i], CURLOPT_WRITEFUNCTION, discard);
+    multi_add_handle(multi, curl[i]);
+  }
+
+  started = tutil_tvnow();
+
+  multi_perform(multi, &still_running);
+
+  abort_on_test_timeout();
+
+  while(still_running) {
+    int num;
+    res = curl_multi_wait(multi, NULL, 0, TEST_HANG_TIMEOUT, &num);
+    if(res != CURLM_OK) {
+      printf("curl_multi_wait() returned %d\n", res);
+      res = TEST_ERR_MAJOR_BAD;
+      goto test_cleanup;
+    }
+
+    abort_on_test_timeout();
+
+    multi_perform(multi, &still_running);
+
+    abort_on_test_timeout();
+  }
+
+  while((msg = curl_multi_info_read(multi, &msgs_left)) != NULL) {
+    if(msg->msg != CURLMSG_DONE)
+      continue;
+    completed++;
+    if(!libtest_arg2 && msg->data.result) {
+      fprintf(stderr, "transfer failed: %d\n", (int)msg->data.result);
+      res = TEST_ERR_FAILURE;
+    }
+    if(!curl_easy_getinfo(msg->easy_handle, CURLINFO_NAMELOOKUP_TIME,
+                          &lookup) && lookup > slowest)
+      slowest = lookup;
+  }
+
+  if(completed != num_handles) {
+    fprintf(stderr, "%d transfers completed, expected %d\n",
+            completed, num_handles);
+    res = TEST_ERR_FAILURE;
+  }
+
+  fprintf(stderr, "%d transfers done in %ld ms, slowest name lookup "
+          "%.1f ms\n", completed, tutil_tvdiff(tutil_tvnow(), started),
+          slowest * 1000.0);
+
+test_cleanup:
+
+  /* proper cleanup sequence - type PB */
+
+  for(i = 0; i < num_handles; i++) {
+    curl_multi_remove_handle(multi, curl[i]);
+    curl_easy_cleanup(curl[i]);
+  }
+
+  curl_multi_cleanup(multi);
+  curl_global_cleanup();
+
+  free(curl);
+
+  return res;
+}
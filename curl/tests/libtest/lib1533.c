@@ -0,0 +1,157 @@
+/***************************************************************************
+ *                                  _   _ ____  _
+ *  Project                     ___| | | |  _ \| |
+ *                             / __| | | | |_) | |
+ *                            | (__| |_| |  _ <| |___
+ *                             \___|\___/|_| \_\_____|
+ *
+ * Copyright (C) 1998 - 2016, Daniel Stenberg, <daniel@haxx.se>, et al.
+ *
+ * This software is licensed as described in the file COPYING, which
+ * you should have received as part of this distribution. The terms
+ * are also available at https://curl.haxx.se/docs/copyright.html.
+ *
+ * You may opt to use, copy, modify, merge, publish, distribute and/or sell
+ * copies of the Software, and permit persons to whom the Software is
+ * furnished to do so, under the terms of the COPYING file.
+ *
+ * This software is distributed on an "AS IS" basis, WITHOUT WARRANTY OF ANY
+ * KIND, either express or implied.
+ *
+ ***************************************************************************/
+#include "test.h"
+
+#include "testutil.h"
+#include "warnless.h"
+#include "memdebug.h"
+
+/*
+ * Does a number of HTTPS transfers one after the other, each with a handle
+ * of its own and a new connection, sharing SSL session IDs through a share
+ * object. It reports how many of the handshakes offered a cached session,
+ * and fails unless all but the first connection to each name did.
+ *
+ * Given a number of transfers and a number of names as extra arguments, the
+ * transfers take turns connecting to that many different loopback
+ * addresses, so that they need as many cached sessions. This makes it a
+ * benchmark of the session cache, for example against a local server
+ * started with "openssl s_server -www -accept 4433":
+ *
+ *   ./lib1533 https://localhost:4433/ 1000 20
+ */
+
+#define NUM_TRANSFERS 10
+
+static int resumed;
+
+static size_t discard(char *ptr, size_t size, size_t nmemb, void *userp)
+{
+  (void)ptr;
+  (void)userp;
+  return size * nmemb;
+}
+
+static int count_resumes(CURL *handle, curl_infotype type, char *data,
+                         size_t size, void *userp)
+{
+  (void)handle;
+  (void)size;
+  (void)userp;
+  /* all the SSL backends say so when they offer a cached session */
+  if((type == CURLINFO_TEXT) && strstr(data, "re-using session"))
+    resumed++;
+  return 0;
+}
+
+int test(char *URL)
+{
+  CURL *curl = NULL;
+  CURLSH *share = NULL;
+  int transfers = NUM_TRANSFERS;
+  int names = 0;
+  int i;
+  int res = 0;
+  long connects;
+  long handshakes = 0;
+  char connect_to[64];
+  struct curl_slist *list = NULL;
+  struct timeval started;
+
+  if(libtest_arg2)
+    transfers = atoi(libtest_arg2);
+  if(libtest_arg3)
+    names = atoi(libtest_arg3);
+  if((transfers <= 0) || (names < 0) || (names > 254)) {
+    fprintf(stderr, "bad number of transfers or names\n");
+    return TEST_ERR_USAGE;
+  }
+
+  if(curl_global_init(CURL_GLOBAL_ALL) != CURLE_OK) {
+    fprintf(stderr, "curl_global_init() failed\n");
+    return TEST_ERR_MAJOR_BAD;
+  }
+
+  share = curl_share_init();
+  if(!share) {
+    fprintf(stderr, "curl_share_init() failed\n");
+    curl_global_cleanup();
+    return TEST_ERR_MAJOR_BAD;
+  }
+  curl_share_setopt(share, CURLSHOPT_SHARE, CURL_LOCK_DATA_SSL_SESSION);
+
+  started = tutil_tvnow();
+
+  for(i = 0; (i < transfers) && !res; i++) {
+    easy_init(curl);
+    easy_setopt(curl, CURLOPT_URL, URL);
+    easy_setopt(curl, CURLOPT_SHARE, share);
+    easy_setopt(curl, CURLOPT_SSL_VERIFYPEER, 0L);
+    easy_setopt(curl, CURLOPT_SSL_VERIFYHOST, 0L);
+    easy_setopt(curl, CURLOPT_FORBID_REUSE, 1L);
+    easy_setopt(curl, CURLOPT_TCP_NODELAY, 1L);
+    easy_setopt(curl, CURLOPT_WRITEFUNCTION, discard);
+    easy_setopt(curl, CURLOPT_DEBUGFUNCTION, count_resumes);
+    easy_setopt(curl, CURLOPT_VERBOSE, 1L);
+    if(names) {
+      snprintf(connect_to, sizeof(connect_to), "::127.0.0.%d:",
+               (i % names) + 1);
+      list = curl_slist_append(NULL, connect_to);
+      if(!list) {
+        res = TEST_ERR_MAJOR_BAD;
+        goto test_cleanup;
+      }
+      easy_setopt(curl, CURLOPT_CONNECT_TO, list);
+    }
+
+    res = curl_easy_perform(curl);
+    if(res)
+      fprintf(stderr, "transfer %d failed: %d\n", i, res);
+    else if(!curl_easy_getinfo(curl, CURLINFO_NUM_CONNECTS, &connects))
+      handshakes += connects;
+
+    curl_easy_cleanup(curl);
+    curl = NULL;
+    curl_slist_free_all(list);
+    list = NULL;
+  }
+
+  fprintf(stderr, "%d transfers in %ld ms, %ld handshakes, %d resumed "
+          "(%ld%%)\n", i, tutil_tvdiff(tutil_tvnow(), started), handshakes,
+          resumed, handshakes ? resumed * 100L / handshakes : 0L);
+
+  /* only the first connection to each name goes without a cached session */
+  if(!res && (resumed < transfers - (names ? names : 1))) {
+    fprintf(stderr, "only %d handshakes resumed a session, expected %d\n",
+            resumed, transfers - (names ? names : 1));
+    res = TEST_ERR_FAILURE;
+  }
+
+test_cleanup:
+
+  curl_easy_cleanup(curl);
+  curl_slist_free_all(list);
+  curl_share_cleanup(share);
+  curl_global_cleanup();
+
+  return res;
+}
@@ -0,0 +1,252 @@
+/***************************************************************************
+ *                                  _   _ ____  _
+ *  Project                     ___| | | |  _ \| |
+ *                             / __| | | | |_) | |
+ *                            | (__| |_| |  _ <| |___
+ *                             \___|\___/|_| \_\_____|
+ *
+ * Copyright (C) 1998 - 2016, Daniel Stenberg, <daniel@haxx.se>, et al.
+ *
+ * This software is licensed as described in the file COPYING, which
+ * you should have received as part of this distribution. The terms
+ * are also available at https://curl.haxx.se/docs/copyright.html.
+ *
+ * You may opt to use, copy, modify, merge, publish, distribute and/or sell
+ * copies of the Software, and permit persons to whom the Software is
+ * furnished to do so, under the terms of the COPYING file.
+ *
+ * This software is distributed on an "AS IS" basis, WITHOUT WARRANTY OF ANY
+ * KIND, either express or implied.
+ *
+ ***************************************************************************/
+#include "test.h"
+
+#ifdef HAVE_NETINET_IN_H
+#include <netinet/in.h>
+#endif
+#ifdef HAVE_ARPA_INET_H
+#include <arpa/inet.h>
+#endif
+#ifdef HAVE_SYS_WAIT_H
+#include <sys/wait.h>
+#endif
+#include <signal.h>
+
+#include "testutil.h"
+#include "warnless.h"
+#include "memdebug.h"
+
+/*
+ * Downloads with a receive buffer of CURL_MAX_READ_SIZE bytes and checks
+ * that the write callback never gets more than that at once, but does get
+ * more than CURL_MAX_WRITE_SIZE bytes in some call. The body is several
+ * hundred KB of numbered lines, made up here and sent by a child process
+ * that serves it on a port of its own.
+ *
+ * Given a buffer size as extra argument, URL is downloaded instead, the
+ * body is discarded and the throughput is reported, which makes this a
+ * benchmark of large downloads, for example from a local server:
+ *
+ *   ./lib1534 http://localhost:8000/1GB 524288
+ */
+
+#define BODY_LINES 4572
+#define LINE_SIZE 70 /* "00000: this is ... KB of it\n" */
+
+static long buffersize = CURL_MAX_READ_SIZE;
+static long writes;
+static size_t largest;
+static bool discard;
+static char *body;
+static size_t body_size;
+static size_t received;
+static bool corrupt;
+
+static size_t write_cb(char *ptr, size_t size, size_t nmemb, void *userp)
+{
+  size_t len = size * nmemb;
+  (void)userp;
+  writes++;
+  if(len > largest)
+    largest = len;
+  if(!discard) {
+    if((received + len > body_size) || memcmp(ptr, &body[received], len))
+      corrupt = TRUE;
+    received += len;
+  }
+  return len;
+}
+
+#ifdef HAVE_FORK
+
+/* Answers one request on the listener with the body, then waits for the
+   client to close. It runs in the child process and must not use
+   memdebug's socket functions. */
+static void serve_body(curl_socket_t listener)
+{
+  char buf[1024];
+  char header[256];
+  curl_socket_t sock = (accept)(listener, NULL, NULL);
+  int matched = 0;
+  size_t sent;
+  ssize_t n;
+
+  if(sock == CURL_SOCKET_BAD)
+    return;
+
+  /* read the request up to its "\r\n\r\n" */
+  while(matched < 4) {
+    ssize_t i;
+    n = recv(sock, buf, sizeof(buf), 0);
+    if(n <= 0)
+      return;
+    for(i = 0; (i < n) && (matched < 4); i++) {
+      if(buf[i] == "\r\n\r\n"[matched])
+        matched++;
+      else
+        matched = (buf[i] == '\r') ? 1 : 0;
+    }
+  }
+
+  snprintf(header, sizeof(header),
+           "HTTP/1.1 200 OK\r\n"
+           "Content-Length: %lu\r\n"
+           "Content-Type: text/plain\r\n"
+           "\r\n", (unsigned long)body_size);
+  if(send(sock, header, strlen(header), 0) != (ssize_t)strlen(header))
+    return;
+  for(sent = 0; sent < body_size; sent += (size_t)n) {
+    n = send(sock, &body[sent], body_size - sent, 0);
+    if(n <= 0)
+      return;
+  }
+
+  while(recv(sock, buf, sizeof(buf), 0) > 0)
+    ;
+}
+
+/* Starts the child that serves the body and sets url to it */
+static pid_t start_server(char *url, size_t urlsize)
+{
+  curl_socket_t listener;
+  struct sockaddr_in addr;
+  curl_socklen_t addrlen = sizeof(addr);
+  pid_t child;
+
+  memset(&addr, 0, sizeof(addr));
+  addr.sin_family = AF_INET;
+  addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+
+  listener = socket(AF_INET, SOCK_STREAM, 0);
+  if(listener == CURL_SOCKET_BAD)
+    return -1;
+  if(bind(listener, (struct sockaddr *)&addr, sizeof(addr)) ||
+     listen(listener, 1) ||
+     getsockname(listener, (struct sockaddr *)&addr, &addrlen)) {
+    sclose(listener);
+    return -1;
+  }
+  snprintf(url, urlsize, "http://127.0.0.1:%d/1534",
+           (int)ntohs(addr.sin_port));
+
+  fflush(stdout);
+  fflush(stderr);
+  child = fork();
+  if(!child) {
+    serve_body(listener);
+    _exit(0);
+  }
+  sclose(listener);
+  return child;
+}
+
+#endif /* HAVE_FORK */
+
+int test(char *URL)
+{
+  CURL *curl = NULL;
+  int res = 0;
+  double downloaded = 0.0;
+  long elapsed;
+  struct timeval started;
+#ifdef HAVE_FORK
+  pid_t child = -1;
+  char url[256];
+  int i;
+#endif
+
+  if(libtest_arg2) {
+    buffersize = atol(libtest_arg2);
+    discard = TRUE;
+  }
+  else {
+#ifdef HAVE_FORK
+    body_size = BODY_LINES * LINE_SIZE;
+    body = malloc(body_size + 1);
+    if(!body)
+      return TEST_ERR_MAJOR_BAD;
+    for(i = 0; i < BODY_LINES; i++)
+      snprintf(&body[i * LINE_SIZE], LINE_SIZE + 1, "%05d: this is received "
+               "with a large buffer, several hundred KB of it\n", i);
+
+    child = start_server(url, sizeof(url));
+    if(child < 0) {
+      fprintf(stderr, "starting the server failed\n");
+      free(body);
+      return TEST_ERR_MAJOR_BAD;
+    }
+    URL = url;
+#else
+    printf("system lacks necessary system function(s)");
+    return 1; /* skip test */
+#endif
+  }
+
+  global_init(CURL_GLOBAL_ALL);
+
+  easy_init(curl);
+  easy_setopt(curl, CURLOPT_URL, URL);
+  easy_setopt(curl, CURLOPT_BUFFERSIZE, buffersize);
+  easy_setopt(curl, CURLOPT_WRITEFUNCTION, write_cb);
+
+  started = tutil_tvnow();
+
+  res = curl_easy_perform(curl);
+
+  elapsed = tutil_tvdiff(tutil_tvnow(), started);
+
+  if(!res && (largest > (size_t)buffersize)) {
+    fprintf(stderr, "write callback got %ld bytes, more than %ld\n",
+            (long)largest, buffersize);
+    res = TEST_ERR_FAILURE;
+  }
+  else if(!res && !discard && (largest <= CURL_MAX_WRITE_SIZE)) {
+    fprintf(stderr, "write callback never got more than %ld bytes\n",
+            (long)largest);
+    res = TEST_ERR_FAILURE;
+  }
+  else if(!res && !discard) {
+    printf("%lu bytes received%s\n", (unsigned long)received,
+           corrupt ? ", corrupt" : "");
+  }
+
+  curl_easy_getinfo(curl, CURLINFO_SIZE_DOWNLOAD, &downloaded);
+  fprintf(stderr, "%.0f bytes in %ld ms, %ld writes of up to %ld bytes, "
+          "%.1f MB/s\n", downloaded, elapsed, writes, (long)largest,
+          elapsed ? downloaded / 1048.576 / (double)elapsed : 0.0);
+
+test_cleanup:
+
+  curl_easy_cleanup(curl);
+  curl_global_cleanup();
+
+#ifdef HAVE_FORK
+  if(child > 0) {
+    kill(child, SIGTERM);
+    waitpid(child, NULL, 0);
+  }
+#endif
+  free(body);
+
+  return res;
+}
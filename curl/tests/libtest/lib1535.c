@@ -0,0 +1,106 @@
+/***************************************************************************
+ *                                  _   _ ____  _
+ *  Project                     ___| | | |  _ \| |
+ *                             / __| | | | |_) | |
+ *                            | (__| |_| |  _ <| |___
+ *                             \___|\___/|_| \_\_____|
+ *
+ * Copyright (C) 1998 - 2016, Daniel Stenberg, <daniel@haxx.se>, et al.
+ *
+ * This software is licensed as described in the file COPYING, which
+ * you should have received as part of this distribution. The terms
+ * are also available at https://curl.haxx.se/docs/copyright.html.
+ *
+ * You may opt to use, copy, modify, merge, publish, distribute and/or sell
+ * copies of the Software, and permit persons to whom the Software is
+ * furnished to do so, under the terms of the COPYING file.
+ *
+ * This software is distributed on an "AS IS" basis, WITHOUT WARRANTY OF ANY
+ * KIND, either express or implied.
+ *
+ ***************************************************************************/
+#include "test.h"
+
+#include "testutil.h"
+#include "warnless.h"
+#include "memdebug.h"
+
+/*
+ * Downloads URL with automatic decoding of all the content encodings libcurl
+ * supports and checks that the write callback never gets more decoded data
+ * at once than the receive buffer size.
+ *
+ * Given a buffer size as extra argument, the body is discarded instead of
+ * written to stdout and the throughput is reported, which makes this a
+ * benchmark of decoding compressed downloads, for example from a local
+ * server that serves a large gzip or brotli encoded file:
+ *
+ *   ./lib1535 http://localhost:8000/1GB.gz 524288
+ */
+
+static long buffersize = CURL_MAX_WRITE_SIZE;
+static long writes;
+static size_t largest;
+static double decoded;
+static bool discard;
+
+static size_t write_cb(char *ptr, size_t size, size_t nmemb, void *userp)
+{
+  size_t len = size * nmemb;
+  (void)userp;
+  writes++;
+  decoded += (double)len;
+  if(len > largest)
+    largest = len;
+  if(!discard)
+    fwrite(ptr, size, nmemb, stdout);
+  return len;
+}
+
+int test(char *URL)
+{
+  CURL *curl = NULL;
+  int res = 0;
+  double downloaded = 0.0;
+  long elapsed;
+  struct timeval started;
+
+  if(libtest_arg2) {
+    buffersize = atol(libtest_arg2);
+    discard = TRUE;
+  }
+
+  global_init(CURL_GLOBAL_ALL);
+
+  easy_init(curl);
+  easy_setopt(curl, CURLOPT_URL, URL);
+  easy_setopt(curl, CURLOPT_ACCEPT_ENCODING, "");
+  easy_setopt(curl, CURLOPT_BUFFERSIZE, buffersize);
+  easy_setopt(curl, CURLOPT_WRITEFUNCTION, write_cb);
+
+  started = tutil_tvnow();
+
+  res = curl_easy_perform(curl);
+
+  elapsed = tutil_tvdiff(tutil_tvnow(), started);
+
+  if(!res && (largest > (size_t)buffersize)) {
+    fprintf(stderr, "write callback got %ld bytes, more than %ld\n",
+            (long)largest, buffersize);
+    res = TEST_ERR_FAILURE;
+  }
+
+  /* the download size counts the bytes before decoding */
+  curl_easy_getinfo(curl, CURLINFO_SIZE_DOWNLOAD, &downloaded);
+  fprintf(stderr, "%.0f bytes decoded from %.0f in %ld ms, %ld writes of "
+          "up to %ld bytes, %.1f MB/s\n", decoded, downloaded, elapsed,
+          writes, (long)largest,
+          elapsed ? decoded / 1048.576 / (double)elapsed : 0.0);
+
+test_cleanup:
+
+  curl_easy_cleanup(curl);
+  curl_global_cleanup();
+
+  return res;
+}
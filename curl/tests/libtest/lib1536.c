@@ -0,0 +1,106 @@
+/***************************************************************************
+ *                                  _   _ ____  _
+ *  Project                     ___| | | |  _ \| |
+ *                             / __| | | | |_) | |
+ *                            | (__| |_| |  _ <| |___
+ *                             \___|\___/|_| \_\_____|
+ *
+ * Copyright (C) 2016, Daniel Stenberg, <daniel@haxx.se>, et al.
+ *
+ * This software is licensed as described in the file COPYING, which
+ * you should have received as part of this distribution. The terms
+ * are also available at https://curl.haxx.se/docs/copyright.html.
+ *
+ * You may opt to use, copy, modify, merge, publish, distribute and/or sell
+ * copies of the Software, and permit persons to whom the Software is
+ * furnished to do so, under the terms of the COPYING file.
+ *
+ * This software is distributed on an "AS IS" basis, WITHOUT WARRANTY OF ANY
+ * KIND, either express or implied.
+ *
+ ***************************************************************************/
+#include "test.h"
+
+#include "testutil.h"
+#include "warnless.h"
+#include "memdebug.h"
+
+#define TEST_HANG_TIMEOUT 60 * 1000
+
+/*
+ * Drive transfers with curl_multi_run(), adding the second easy handle once
+ * the first one is done.
+ */
+
+int test(char *URL)
+{
+  CURL *curls[2] = { NULL, NULL };
+  CURLM *multi = NULL;
+  int still_running;
+  int added = 1;
+  int done = 0;
+  int i;
+  int res = 0;
+  CURLMsg *msg;
+
+  start_test_timing();
+
+  global_init(CURL_GLOBAL_ALL);
+
+  multi_init(multi);
+
+  for(i = 0; i < 2; i++) {
+    easy_init(curls[i]);
+    easy_setopt(curls[i], CURLOPT_URL, URL);
+    easy_setopt(curls[i], CURLOPT_HEADER, 1L);
+  }
+
+  multi_add_handle(multi, curls[0]);
+
+  do {
+    int msgs;
+
+    res = curl_multi_run(multi, TEST_HANG_TIMEOUT, &still_running);
+    if(res != CURLM_OK) {
+      printf("curl_multi_run() returned %d\n", res);
+      res = TEST_ERR_MAJOR_BAD;
+      goto test_cleanup;
+    }
+
+    abort_on_test_timeout();
+
+    while((msg = curl_multi_info_read(multi, &msgs)) != NULL) {
+      if(msg->msg != CURLMSG_DONE)
+        continue;
+      if(msg->data.result) {
+        printf("transfer %d failed: %d\n", done, (int)msg->data.result);
+        res = (int)msg->data.result;
+        goto test_cleanup;
+      }
+      done++;
+    }
+
+    if(done && (added < 2)) {
+      /* the second transfer starts on the next call */
+      multi_add_handle(multi, curls[added]);
+      added++;
+      still_running = 1;
+    }
+  } while(still_running);
+
+  if(done != 2) {
+    printf("%d transfers done, expected 2\n", done);
+    res = TEST_ERR_FAILURE;
+  }
+
+test_cleanup:
+
+  /* undocumented cleanup sequence - type UA */
+
+  curl_multi_cleanup(multi);
+  for(i = 0; i < 2; i++)
+    curl_easy_cleanup(curls[i]);
+  curl_global_cleanup();
+
+  return res;
+}
@@ -0,0 +1,140 @@
+/***************************************************************************
+ *                                  _   _ ____  _
+ *  Project                     ___| | | |  _ \| |
+ *                             / __| | | | |_) | |
+ *                            | (__| |_| |  _ <| |___
+ *                             \___|\___/|_| \_\_____|
+ *
+ * Copyright (C) 2016, Daniel Stenberg, <daniel@haxx.se>, et al.
+ *
+ * This software is licensed as described in the file COPYING, which
+ * you should have received as part of this distribution. The terms
+ * are also available at https://curl.haxx.se/docs/copyright.html.
+ *
+ * You may opt to use, copy, modify, merge, publish, distribute and/or sell
+ * copies of the Software, and permit persons to whom the Software is
+ * furnished to do so, under the terms of the COPYING file.
+ *
+ * This software is distributed on an "AS IS" basis, WITHOUT WARRANTY OF ANY
+ * KIND, either express or implied.
+ *
+ ***************************************************************************/
+#include "test.h"
+
+#include "testutil.h"
+#include "warnless.h"
+#include "memdebug.h"
+
+#define TEST_HANG_TIMEOUT 60 * 1000
+
+static int callbacks;
+static struct curl_transfer_stats cbstats;
+
+static void stats_cb(CURL *easy, const struct curl_transfer_stats *stats,
+                     void *userp)
+{
+  (void)easy;
+  (void)userp;
+  callbacks++;
+  cbstats = *stats;
+}
+
+/*
+ * Two transfers with the same handle, the first one with CURLOPT_INSTRUMENT
+ * enabled. Check that the stats make sense and that they reach the multi
+ * handle's stats callback for the first transfer only.
+ */
+
+int test(char *URL)
+{
+  CURL *curl = NULL;
+  CURLM *multi = NULL;
+  struct curl_transfer_stats *stats = NULL;
+  int still_running;
+  int i;
+  int res = 0;
+
+  start_test_timing();
+
+  global_init(CURL_GLOBAL_ALL);
+
+  multi_init(multi);
+  multi_setopt(multi, CURLMOPT_STATSFUNCTION, stats_cb);
+
+  easy_init(curl);
+  easy_setopt(curl, CURLOPT_URL, URL);
+
+  for(i = 0; i < 2; i++) {
+    easy_setopt(curl, CURLOPT_INSTRUMENT, i ? 0L : 1L);
+
+    multi_add_handle(multi, curl);
+
+    for(;;) {
+      struct timeval interval;
+      fd_set rd, wr, exc;
+      int maxfd = -99;
+
+      interval.tv_sec = 1;
+      interval.tv_usec = 0;
+
+      multi_perform(multi, &still_running);
+
+      abort_on_test_timeout();
+
+      if(!still_running)
+        break; /* done */
+
+      FD_ZERO(&rd);
+      FD_ZERO(&wr);
+      FD_ZERO(&exc);
+
+      multi_fdset(multi, &rd, &wr, &exc, &maxfd);
+
+      /* At this point, maxfd is guaranteed to be greater or equal than -1. */
+
+      select_test(maxfd+1, &rd, &wr, &exc, &interval);
+
+      abort_on_test_timeout();
+    }
+
+    res = (int)curl_easy_getinfo(curl, CURLINFO_TRANSFER_STATS, &stats);
+    if(res) {
+      printf("curl_easy_getinfo() returned %d\n", res);
+      goto test_cleanup;
+    }
+
+    if(!i) {
+      printf("callbacks: %d\n", callbacks);
+      printf("recv: %s\n", (stats->recv_calls > 0 &&
+                            stats->recv_bytes >= 12) ? "ok" : "bad");
+      printf("send: %s\n", (stats->send_calls > 0 &&
+                            stats->send_bytes > 0) ? "ok" : "bad");
+      printf("syscalls: %s\n",
+             (stats->syscalls == stats->recv_calls + stats->send_calls) ?
+             "ok" : "bad");
+      printf("tls: %s\n", stats->tls_time ? "bad" : "ok");
+      printf("write: %s\n", (stats->write_calls > 0) ? "ok" : "bad");
+      printf("getinfo: %s\n",
+             memcmp(stats, &cbstats, sizeof(cbstats)) ? "bad" : "ok");
+    }
+    else {
+      struct curl_transfer_stats zero;
+      memset(&zero, 0, sizeof(zero));
+      printf("callbacks: %d\n", callbacks);
+      printf("not instrumented: %s\n",
+             memcmp(stats, &zero, sizeof(zero)) ? "bad" : "ok");
+    }
+
+    multi_remove_handle(multi, curl);
+  }
+
+test_cleanup:
+
+  /* undocumented cleanup sequence - type UA */
+
+  curl_multi_cleanup(multi);
+  curl_easy_cleanup(curl);
+  curl_global_cleanup();
+
+  return res;
+}
@@ -0,0 +1,504 @@
+/***************************************************************************
+ *                                  _   _ ____  _
+ *  Project                     ___| | | |  _ \| |
+ *                             / __| | | | |_) | |
+ *                            | (__| |_| |  _ <| |___
+ *                             \___|\___/|_| \_\_____|
+ *
+ * Copyright (C) 1998 - 2016, Daniel Stenberg, <daniel@haxx.se>, et al.
+ *
+ * This software is licensed as described in the file COPYING, which
+ * you should have received as part of this distribution. The terms
+ * are also available at https://curl.haxx.se/docs/copyright.html.
+ *
+ * You may opt to use, copy, modify, merge, publish, distribute and/or sell
+ * copies of the Software, and permit persons to whom the Software is
+ * furnished to do so, under the terms of the COPYING file.
+ *
+ * This software is distributed on an "AS IS" basis, WITHOUT WARRANTY OF ANY
+ * KIND, either express or implied.
+ *
+ ***************************************************************************/
+#include "test.h"
+
+#ifdef HAVE_POLL_FINE
+#  ifdef HAVE_SYS_POLL_H
+#    include <sys/poll.h>
+#  elif defined(HAVE_POLL_H)
+#    include <poll.h>
+#  endif
+#endif
+
+#include "testutil.h"
+#include "warnless.h"
+#include "memdebug.h"
+
+/*
+ * Checks which idle connection a transfer picks for reuse. Three transfers
+ * run at the same time and leave three idle connections to the server. The
+ * next transfer must reuse the connection that went idle last. A transfer
+ * to another host name, connecting to the same server through
+ * CURLOPT_CONNECT_TO, has another reuse key, so it must get a new
+ * connection. That is one connection more than CURLMOPT_MAXCONNECTS
+ * allows, so the connection that has been idle the longest must be closed.
+ *
+ * Given a number of transfers and a number of busy connections as extra
+ * arguments, it instead runs that many transfers, 20 at a time, with
+ * curl_multi_socket_action(). Meanwhile, paused transfers keep the given
+ * number of other connections to the same host busy. This makes it a
+ * benchmark of connection lookups, for example against a local server:
+ *
+ *   ./lib1538 http://localhost:8000/ 50000 2000
+ */
+
+#define TEST_HANG_TIMEOUT 60 * 1000
+
+#define NUM_HANDLES 3
+
+/* The number of transfers the benchmark runs at the same time */
+#define NUM_BENCH_PARALLEL 20
+
+/* Connection ids, as told by the debug callback */
+static long idle[NUM_HANDLES + 2]; /* in the order they went idle */
+static int num_idle;
+static long reused = -1;
+static long closed = -1;
+
+/* transfers pause at their first data while this is set */
+static bool holding;
+static int held;
+
+static size_t hold_cb(char *ptr, size_t size, size_t nmemb, void *userp)
+{
+  (void)ptr;
+  (void)userp;
+  if(holding) {
+    held++;
+    return CURL_WRITEFUNC_PAUSE;
+  }
+  return size * nmemb;
+}
+
+static int debug_cb(CURL *handle, curl_infotype type, char *data,
+                    size_t size, void *userp)
+{
+  long id;
+
+  (void)handle;
+  (void)size;
+  (void)userp;
+  if(type != CURLINFO_TEXT)
+    return 0;
+
+  if((sscanf(data, "Connection #%ld", &id) == 1) &&
+     strstr(data, "left intact")) {
+    if(num_idle < (int)(sizeof(idle) / sizeof(idle[0])))
+      idle[num_idle++] = id;
+  }
+  else if(sscanf(data, "Re-using existing connection! (#%ld)", &id) == 1)
+    reused = id;
+  else if((sscanf(data, "Closing connection %ld", &id) == 1) &&
+          (closed < 0))
+    closed = id;
+  return 0;
+}
+
+/* Runs the given transfers in the multi handle until they are all done.
+   They are first all held at their first data, so that none of them can
+   reuse the connection of another. */
+static int perform(CURLM *multi, CURL **easy, int num)
+{
+  int res = 0;
+  int still_running;
+  int i;
+  CURLMsg *msg;
+  int msgs_left;
+
+  holding = TRUE;
+  held = 0;
+  for(i = 0; i < num; i++)
+    multi_add_handle(multi, easy[i]);
+
+  multi_perform(multi, &still_running);
+
+  abort_on_test_timeout();
+
+  while(still_running) {
+    int numfds;
+
+    if(holding && (held == num)) {
+      /* all connections are in use now, let the transfers finish */
+      holding = FALSE;
+      for(i = 0; i < num; i++)
+        curl_easy_pause(easy[i], CURLPAUSE_CONT);
+    }
+
+    res = curl_multi_wait(multi, NULL, 0, TEST_HANG_TIMEOUT, &numfds);
+    if(res != CURLM_OK) {
+      fprintf(stderr, "curl_multi_wait() returned %d\n", res);
+      res = TEST_ERR_MAJOR_BAD;
+      goto test_cleanup;
+    }
+
+    abort_on_test_timeout();
+
+    multi_perform(multi, &still_running);
+
+    abort_on_test_timeout();
+  }
+
+  while((msg = curl_multi_info_read(multi, &msgs_left)) != NULL) {
+    if((msg->msg == CURLMSG_DONE) && msg->data.result) {
+      fprintf(stderr, "transfer failed: %d\n", (int)msg->data.result);
+      res = TEST_ERR_FAILURE;
+    }
+  }
+
+test_cleanup:
+
+  for(i = 0; i < num; i++)
+    curl_multi_remove_handle(multi, easy[i]);
+
+  return res;
+}
+
+static int test_reuse(char *URL)
+{
+  CURL *easy[NUM_HANDLES];
+  CURLM *multi = NULL;
+  int i;
+  int res = 0;
+  long connects = -1;
+  char connect_to[256];
+  char other_url[256];
+  const char *port;
+  struct curl_slist *list = NULL;
+
+  for(i = 0; i < NUM_HANDLES; i++)
+    easy[i] = NULL;
+
+  start_test_timing();
+
+  global_init(CURL_GLOBAL_ALL);
+
+  multi_init(multi);
+  multi_setopt(multi, CURLMOPT_MAXCONNECTS, (long)NUM_HANDLES);
+
+  for(i = 0; i < NUM_HANDLES; i++) {
+    easy_init(easy[i]);
+    easy_setopt(easy[i], CURLOPT_URL, URL);
+    easy_setopt(easy[i], CURLOPT_WRITEFUNCTION, hold_cb);
+    easy_setopt(easy[i], CURLOPT_DEBUGFUNCTION, debug_cb);
+    easy_setopt(easy[i], CURLOPT_VERBOSE, 1L);
+  }
+
+  /* three connections at once */
+  res = perform(multi, easy, NUM_HANDLES);
+  if(res)
+    goto test_cleanup;
+  if(num_idle != NUM_HANDLES) {
+    fprintf(stderr, "%d idle connections, expected %d\n", num_idle,
+            NUM_HANDLES);
+    res = TEST_ERR_FAILURE;
+    goto test_cleanup;
+  }
+
+  /* the most recently used idle connection is reused */
+  res = perform(multi, easy, 1);
+  if(res)
+    goto test_cleanup;
+  if(reused != idle[NUM_HANDLES - 1]) {
+    fprintf(stderr, "reused connection %ld, expected %ld\n", reused,
+            idle[NUM_HANDLES - 1]);
+    res = TEST_ERR_FAILURE;
+    goto test_cleanup;
+  }
+
+  /* another reuse key gets a new connection, which pushes out the least
+     recently used one */
+  port = strrchr(libtest_arg2, ':');
+  if(!port) {
+    fprintf(stderr, "no port in %s\n", libtest_arg2);
+    res = TEST_ERR_USAGE;
+    goto test_cleanup;
+  }
+  snprintf(other_url, sizeof(other_url), "http://connect.to.test%s/1538",
+           port);
+  snprintf(connect_to, sizeof(connect_to), "::%s", libtest_arg2);
+  list = curl_slist_append(NULL, connect_to);
+  if(!list) {
+    res = TEST_ERR_MAJOR_BAD;
+    goto test_cleanup;
+  }
+  easy_setopt(easy[1], CURLOPT_URL, other_url);
+  easy_setopt(easy[1], CURLOPT_CONNECT_TO, list);
+  reused = -1;
+  res = perform(multi, &easy[1], 1);
+  if(res)
+    goto test_cleanup;
+  curl_easy_getinfo(easy[1], CURLINFO_NUM_CONNECTS, &connects);
+  if((reused != -1) || (connects != 1)) {
+    fprintf(stderr, "transfer with CURLOPT_CONNECT_TO reused connection "
+            "%ld\n", reused);
+    res = TEST_ERR_FAILURE;
+  }
+  else if(closed != idle[0]) {
+    fprintf(stderr, "closed connection %ld, expected %ld\n", closed,
+            idle[0]);
+    res = TEST_ERR_FAILURE;
+  }
+
+test_cleanup:
+
+  /* proper cleanup sequence - type PB */
+
+  for(i = 0; i < NUM_HANDLES; i++) {
+    curl_multi_remove_handle(multi, easy[i]);
+    curl_easy_cleanup(easy[i]);
+  }
+
+  curl_multi_cleanup(multi);
+  curl_global_cleanup();
+
+  curl_slist_free_all(list);
+
+  return res;
+}
+
+#ifdef HAVE_POLL_FINE
+
+/* The sockets curl_multi_socket_action() wants to know about */
+static struct pollfd *pfds;
+static struct pollfd *ready;
+static int num_pfds;
+static int max_pfds;
+static long timeout_ms = -1;
+static int paused;
+
+static int socket_cb(CURL *easy, curl_socket_t s, int what, void *userp,
+                     void *socketp)
+{
+  int i;
+
+  (void)easy;
+  (void)userp;
+  (void)socketp;
+
+  for(i = 0; (i < num_pfds) && (pfds[i].fd != s); i++)
+    ;
+
+  if(what == CURL_POLL_REMOVE) {
+    if(i < num_pfds)
+      pfds[i] = pfds[--num_pfds];
+    return 0;
+  }
+
+  if(i == num_pfds) {
+    if(num_pfds == max_pfds) {
+      int newmax = max_pfds ? max_pfds * 2 : 64;
+      struct pollfd *p = realloc(pfds, newmax * sizeof(struct pollfd));
+      if(!p)
+        return -1;
+      pfds = p;
+      p = realloc(ready, newmax * sizeof(struct pollfd));
+      if(!p)
+        return -1;
+      ready = p;
+      max_pfds = newmax;
+    }
+    pfds[num_pfds++].fd = s;
+  }
+
+  pfds[i].events = (short)(((what & CURL_POLL_IN) ? POLLIN : 0) |
+                           ((what & CURL_POLL_OUT) ? POLLOUT : 0));
+  pfds[i].revents = 0;
+  return 0;
+}
+
+static int timer_cb(CURLM *multi, long ms, void *userp)
+{
+  (void)multi;
+  (void)userp;
+  timeout_ms = ms;
+  return 0;
+}
+
+static size_t discard(char *ptr, size_t size, size_t nmemb, void *userp)
+{
+  (void)ptr;
+  (void)userp;
+  return size * nmemb;
+}
+
+/* The busy transfers pause at their first data, holding their connection */
+static size_t pause_cb(char *ptr, size_t size, size_t nmemb, void *userp)
+{
+  (void)ptr;
+  (void)size;
+  (void)nmemb;
+  (void)userp;
+  paused++;
+  return CURL_WRITEFUNC_PAUSE;
+}
+
+/* Waits for socket activity or a timeout and tells libcurl about it */
+static int socket_step(CURLM *multi)
+{
+  int running;
+  int num_ready = 0;
+  int rc;
+  int i;
+
+  rc = poll(pfds, (unsigned int)num_pfds,
+            (timeout_ms < 0) ? 1000 : (int)timeout_ms);
+  if(rc < 0) {
+    fprintf(stderr, "poll() failed: %d\n", SOCKERRNO);
+    return TEST_ERR_MAJOR_BAD;
+  }
+
+  if(!rc) {
+    curl_multi_socket_action(multi, CURL_SOCKET_TIMEOUT, 0, &running);
+    return 0;
+  }
+
+  /* the socket callback changes the set, act on a copy */
+  for(i = 0; i < num_pfds; i++) {
+    if(pfds[i].revents)
+      ready[num_ready++] = pfds[i];
+  }
+
+  for(i = 0; i < num_ready; i++) {
+    int mask = 0;
+    if(ready[i].revents & (POLLIN | POLLERR | POLLHUP))
+      mask |= CURL_CSELECT_IN;
+    if(ready[i].revents & POLLOUT)
+      mask |= CURL_CSELECT_OUT;
+    curl_multi_socket_action(multi, ready[i].fd, mask, &running);
+  }
+  return 0;
+}
+
+static int test_bench(char *URL, int transfers, int busy)
+{
+  CURL **easy = NULL;
+  CURLM *multi = NULL;
+  int num_handles = busy + NUM_BENCH_PARALLEL;
+  int started = 0;
+  int completed = 0;
+  int i;
+  int res = 0;
+  long elapsed;
+  struct timeval begin;
+  CURLMsg *msg;
+  int msgs_left;
+
+  easy = calloc((size_t)num_handles, sizeof(CURL *));
+  if(!easy)
+    return TEST_ERR_MAJOR_BAD;
+
+  global_init(CURL_GLOBAL_ALL);
+
+  multi_init(multi);
+  multi_setopt(multi, CURLMOPT_SOCKETFUNCTION, socket_cb);
+  multi_setopt(multi, CURLMOPT_TIMERFUNCTION, timer_cb);
+  multi_setopt(multi, CURLMOPT_MAXCONNECTS, (long)num_handles);
+
+  for(i = 0; i < num_handles; i++) {
+    easy_init(easy[i]);
+    easy_setopt(easy[i], CURLOPT_URL, URL);
+    easy_setopt(easy[i], CURLOPT_TCP_NODELAY, 1L);
+    easy_setopt(easy[i], CURLOPT_WRITEFUNCTION,
+                (i < busy) ? pause_cb : discard);
+  }
+
+  /* first get all the busy connections going */
+  for(i = 0; i < busy; i++)
+    multi_add_handle(multi, easy[i]);
+  while(paused < busy) {
+    res = socket_step(multi);
+    if(res)
+      goto test_cleanup;
+    msg = curl_multi_info_read(multi, &msgs_left);
+    if(msg) {
+      fprintf(stderr, "a busy transfer ended: %d\n",
+              (int)msg->data.result);
+      res = TEST_ERR_FAILURE;
+      goto test_cleanup;
+    }
+  }
+
+  begin = tutil_tvnow();
+
+  for(i = busy; (i < num_handles) && (started < transfers); i++, started++)
+    multi_add_handle(multi, easy[i]);
+
+  while(completed < transfers) {
+    res = socket_step(multi);
+    if(res)
+      goto test_cleanup;
+
+    while((msg = curl_multi_info_read(multi, &msgs_left)) != NULL) {
+      CURL *done = msg->easy_handle;
+      if(msg->msg != CURLMSG_DONE)
+        continue;
+      if(msg->data.result) {
+        fprintf(stderr, "transfer failed: %d\n", (int)msg->data.result);
+        res = TEST_ERR_FAILURE;
+        goto test_cleanup;
+      }
+      completed++;
+      multi_remove_handle(multi, done);
+      if(started < transfers) {
+        multi_add_handle(multi, done);
+        started++;
+      }
+    }
+  }
+
+  elapsed = tutil_tvdiff(tutil_tvnow(), begin);
+  fprintf(stderr, "%d transfers in %ld ms with %d busy connections, "
+          "%.0f transfers/s\n", completed, elapsed, busy,
+          elapsed ? completed * 1000.0 / (double)elapsed : 0.0);
+
+test_cleanup:
+
+  for(i = 0; i < num_handles; i++) {
+    curl_multi_remove_handle(multi, easy[i]);
+    curl_easy_cleanup(easy[i]);
+  }
+
+  curl_multi_cleanup(multi);
+  curl_global_cleanup();
+
+  free(easy);
+  free(pfds);
+  free(ready);
+
+  return res;
+}
+
+#endif /* HAVE_POLL_FINE */
+
+int test(char *URL)
+{
+  if(libtest_arg2 && libtest_arg3) {
+#ifdef HAVE_POLL_FINE
+    int transfers = atoi(libtest_arg2);
+    int busy = atoi(libtest_arg3);
+    if((transfers <= 0) || (busy < 0)) {
+      fprintf(stderr, "bad number of transfers or busy connections\n");
+      return TEST_ERR_USAGE;
+    }
+    return test_bench(URL, transfers, busy);
+#else
+    fprintf(stderr, "the benchmark needs poll()\n");
+    return TEST_ERR_USAGE;
+#endif
+  }
+
+  if(!libtest_arg2) {
+    fprintf(stderr, "need the server address as extra argument\n");
+    return TEST_ERR_USAGE;
+  }
+  return test_reuse(URL);
+}
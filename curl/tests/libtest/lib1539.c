@@ -0,0 +1,158 @@
+/***************************************************************************
+ *                                  _   _ ____  _
+ *  Project                     ___| | | |  _ \| |
+ *                             / __| | | | |_) | |
+ *                            | (__| |_| |  _ <| |___
+ *                             \___|\___/|_| \_\_____|
+ *
+ * Copyright (C) 1998 - 2016, Daniel Stenberg, <daniel@haxx.se>, et al.
+ *
+ * This software is licensed as described in the file COPYING, which
+ * you should have received as part of this distribution. The terms
+ * are also available at https://curl.haxx.se/docs/copyright.html.
+ *
+ * You may opt to use, copy, modify, merge, publish, distribute and/or sell
+ * copies of the Software, and permit persons to whom the Software is
+ * furnished to do so, under the terms of the COPYING file.
+ *
+ * This software is distributed on an "AS IS" basis, WITHOUT WARRANTY OF ANY
+ * KIND, either express or implied.
+ *
+ ***************************************************************************/
+#include "test.h"
+
+#include "testutil.h"
+#include "h2server.h"
+#include "warnless.h"
+#include "memdebug.h"
+
+/*
+ * Two HTTP/2 transfers, one after the other, to the test's own h2 server.
+ * The status line made up for the first response must be taken as HTTP/2,
+ * or the connection is closed as an HTTP/1.0 one and the second transfer
+ * needs a new one.
+ */
+
+#define TEST_HANG_TIMEOUT 60 * 1000
+
+#define BODY_SIZE 1000
+
+static size_t body_size;
+
+static size_t write_cb(char *ptr, size_t size, size_t nmemb, void *userp)
+{
+  (void)ptr;
+  (void)userp;
+  body_size += size * nmemb;
+  return size * nmemb;
+}
+
+static int perform(struct h2server *srv, CURLM *multi, CURL *easy)
+{
+  int res = 0;
+  int still_running;
+  CURLMsg *msg;
+  int msgs_left;
+
+  body_size = 0;
+  multi_add_handle(multi, easy);
+
+  multi_perform(multi, &still_running);
+
+  abort_on_test_timeout();
+
+  while(still_running) {
+    struct curl_waitfd fds[10];
+    unsigned int nfds = h2server_waitfds(srv, fds, 10);
+    int numfds;
+
+    res = curl_multi_wait(multi, fds, nfds, TEST_HANG_TIMEOUT, &numfds);
+    if(res != CURLM_OK) {
+      fprintf(stderr, "curl_multi_wait() returned %d\n", res);
+      res = TEST_ERR_MAJOR_BAD;
+      goto test_cleanup;
+    }
+
+    if(h2server_serve(srv)) {
+      fprintf(stderr, "h2 server failed\n");
+      res = TEST_ERR_FAILURE;
+      goto test_cleanup;
+    }
+
+    abort_on_test_timeout();
+
+    multi_perform(multi, &still_running);
+
+    abort_on_test_timeout();
+  }
+
+  while((msg = curl_multi_info_read(multi, &msgs_left)) != NULL) {
+    if((msg->msg == CURLMSG_DONE) && msg->data.result) {
+      fprintf(stderr, "transfer failed: %d\n", (int)msg->data.result);
+      res = TEST_ERR_FAILURE;
+    }
+  }
+
+test_cleanup:
+
+  curl_multi_remove_handle(multi, easy);
+
+  return res;
+}
+
+int test(char *URL)
+{
+  CURL *easy = NULL;
+  CURLM *multi = NULL;
+  struct h2server *srv;
+  char url[256];
+  int res = 0;
+  int i;
+
+  (void)URL;
+
+  start_test_timing();
+
+  srv = h2server_start(BODY_SIZE);
+  if(!srv) {
+    fprintf(stderr, "h2server_start() failed\n");
+    return TEST_ERR_MAJOR_BAD;
+  }
+  snprintf(url, sizeof(url), "http://127.0.0.1:%d/1539",
+           h2server_port(srv));
+
+  global_init(CURL_GLOBAL_ALL);
+
+  multi_init(multi);
+
+  easy_init(easy);
+  easy_setopt(easy, CURLOPT_URL, url);
+  easy_setopt(easy, CURLOPT_HTTP_VERSION,
+              (long)CURL_HTTP_VERSION_2_PRIOR_KNOWLEDGE);
+  easy_setopt(easy, CURLOPT_WRITEFUNCTION, write_cb);
+
+  for(i = 0; i < 2; i++) {
+    long code = 0;
+    long connects = -1;
+
+    res = perform(srv, multi, easy);
+    if(res)
+      goto test_cleanup;
+
+    curl_easy_getinfo(easy, CURLINFO_RESPONSE_CODE, &code);
+    curl_easy_getinfo(easy, CURLINFO_NUM_CONNECTS, &connects);
+    printf("transfer %d: %ld, %lu bytes, %ld new connections\n", i, code,
+           (unsigned long)body_size, connects);
+  }
+
+  printf("server connections: %d\n", h2server_connections(srv));
+
+test_cleanup:
+
+  curl_multi_cleanup(multi);
+  curl_easy_cleanup(easy);
+  curl_global_cleanup();
+  h2server_stop(srv);
+
+  return res;
+}
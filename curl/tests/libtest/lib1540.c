@@ -0,0 +1,195 @@
+/***************************************************************************
+ *                                  _   _ ____  _
+ *  Project                     ___| | | |  _ \| |
+ *                             / __| | | | |_) | |
+ *                            | (__| |_| |  _ <| |___
+ *                             \___|\___/|_| \_\_____|
+ *
+ * Copyright (C) 1998 - 2016, Daniel Stenberg, <daniel@haxx.se>, et al.
+ *
+ * This software is licensed as described in the file COPYING, which
+ * you should have received as part of this distribution. The terms
+ * are also available at https://curl.haxx.se/docs/copyright.html.
+ *
+ * You may opt to use, copy, modify, merge, publish, distribute and/or sell
+ * copies of the Software, and permit persons to whom the Software is
+ * furnished to do so, under the terms of the COPYING file.
+ *
+ * This software is distributed on an "AS IS" basis, WITHOUT WARRANTY OF ANY
+ * KIND, either express or implied.
+ *
+ ***************************************************************************/
+#include "test.h"
+
+#include "testutil.h"
+#include "h2server.h"
+#include "warnless.h"
+#include "memdebug.h"
+
+/*
+ * Parallel HTTP/2 transfers multiplexed over one connection to the test's
+ * own h2 server. The bodies are larger than the flow-control windows, so
+ * the server can only send them all if the transfers give the credit back
+ * as they take the data. One transfer is rate limited and another pauses
+ * at its first data for a while. Every transfer must complete with the
+ * whole body, in order.
+ */
+
+#define TEST_HANG_TIMEOUT 60 * 1000
+
+#define NUM_HANDLES 6
+#define BODY_SIZE 200000
+
+#define RATE_LIMITED 0 /* the transfer that is rate limited */
+#define PAUSED 1       /* the transfer that pauses */
+#define PAUSE_MS 100   /* for how long */
+
+struct transfer {
+  CURL *easy;
+  size_t received;
+  bool corrupt;     /* a byte did not match */
+  bool paused;
+  bool resumed;
+  struct timeval paused_at;
+};
+
+static struct transfer transfers[NUM_HANDLES];
+
+static size_t write_cb(char *ptr, size_t size, size_t nmemb, void *userp)
+{
+  struct transfer *t = userp;
+  size_t len = size * nmemb;
+  size_t i;
+
+  if((t == &transfers[PAUSED]) && !t->paused && !t->resumed) {
+    t->paused = TRUE;
+    t->paused_at = tutil_tvnow();
+    return CURL_WRITEFUNC_PAUSE;
+  }
+
+  for(i = 0; i < len; i++)
+    if((unsigned char)ptr[i] != h2server_byte(t->received + i))
+      t->corrupt = TRUE;
+  t->received += len;
+  return len;
+}
+
+int test(char *URL)
+{
+  CURLM *multi = NULL;
+  struct h2server *srv;
+  char url[256];
+  int still_running;
+  CURLMsg *msg;
+  int msgs_left;
+  int res = 0;
+  int i;
+
+  (void)URL;
+
+  for(i = 0; i < NUM_HANDLES; i++) {
+    transfers[i].easy = NULL;
+    transfers[i].received = 0;
+    transfers[i].corrupt = FALSE;
+    transfers[i].paused = FALSE;
+    transfers[i].resumed = FALSE;
+  }
+
+  start_test_timing();
+
+  srv = h2server_start(BODY_SIZE);
+  if(!srv) {
+    fprintf(stderr, "h2server_start() failed\n");
+    return TEST_ERR_MAJOR_BAD;
+  }
+  snprintf(url, sizeof(url), "http://127.0.0.1:%d/1540",
+           h2server_port(srv));
+
+  global_init(CURL_GLOBAL_ALL);
+
+  multi_init(multi);
+  multi_setopt(multi, CURLMOPT_PIPELINING, CURLPIPE_MULTIPLEX);
+
+  for(i = 0; i < NUM_HANDLES; i++) {
+    easy_init(transfers[i].easy);
+    easy_setopt(transfers[i].easy, CURLOPT_URL, url);
+    easy_setopt(transfers[i].easy, CURLOPT_HTTP_VERSION,
+                (long)CURL_HTTP_VERSION_2_PRIOR_KNOWLEDGE);
+    easy_setopt(transfers[i].easy, CURLOPT_PIPEWAIT, 1L);
+    easy_setopt(transfers[i].easy, CURLOPT_WRITEFUNCTION, write_cb);
+    easy_setopt(transfers[i].easy, CURLOPT_WRITEDATA, &transfers[i]);
+  }
+  easy_setopt(transfers[RATE_LIMITED].easy, CURLOPT_MAX_RECV_SPEED_LARGE,
+              (curl_off_t)(BODY_SIZE * 4));
+
+  for(i = 0; i < NUM_HANDLES; i++)
+    multi_add_handle(multi, transfers[i].easy);
+
+  multi_perform(multi, &still_running);
+
+  abort_on_test_timeout();
+
+  while(still_running) {
+    struct curl_waitfd fds[10];
+    unsigned int nfds = h2server_waitfds(srv, fds, 10);
+    struct transfer *t = &transfers[PAUSED];
+    int numfds;
+
+    if(t->paused &&
+       (tutil_tvdiff(tutil_tvnow(), t->paused_at) >= PAUSE_MS)) {
+      t->paused = FALSE;
+      t->resumed = TRUE;
+      curl_easy_pause(t->easy, CURLPAUSE_CONT);
+    }
+
+    /* wake up in time to resume the paused transfer */
+    res = curl_multi_wait(multi, fds, nfds, t->paused ? 10 : 1000,
+                          &numfds);
+    if(res != CURLM_OK) {
+      fprintf(stderr, "curl_multi_wait() returned %d\n", res);
+      res = TEST_ERR_MAJOR_BAD;
+      goto test_cleanup;
+    }
+
+    if(h2server_serve(srv)) {
+      fprintf(stderr, "h2 server failed\n");
+      res = TEST_ERR_FAILURE;
+      goto test_cleanup;
+    }
+
+    abort_on_test_timeout();
+
+    multi_perform(multi, &still_running);
+
+    abort_on_test_timeout();
+  }
+
+  while((msg = curl_multi_info_read(multi, &msgs_left)) != NULL) {
+    if((msg->msg == CURLMSG_DONE) && msg->data.result) {
+      fprintf(stderr, "transfer failed: %d\n", (int)msg->data.result);
+      res = TEST_ERR_FAILURE;
+    }
+  }
+
+  for(i = 0; i < NUM_HANDLES; i++) {
+    long code = 0;
+    curl_easy_getinfo(transfers[i].easy, CURLINFO_RESPONSE_CODE, &code);
+    printf("transfer %d: %ld, %lu bytes%s\n", i, code,
+           (unsigned long)transfers[i].received,
+           transfers[i].corrupt ? ", corrupt" : "");
+  }
+
+  printf("server connections: %d\n", h2server_connections(srv));
+
+test_cleanup:
+
+  for(i = 0; i < NUM_HANDLES; i++) {
+    curl_multi_remove_handle(multi, transfers[i].easy);
+    curl_easy_cleanup(transfers[i].easy);
+  }
+  curl_multi_cleanup(multi);
+  curl_global_cleanup();
+  h2server_stop(srv);
+
+  return res;
+}
@@ -0,0 +1,199 @@
+/***************************************************************************
+ *                                  _   _ ____  _
+ *  Project                     ___| | | |  _ \| |
+ *                             / __| | | | |_) | |
+ *                            | (__| |_| |  _ <| |___
+ *                             \___|\___/|_| \_\_____|
+ *
+ * Copyright (C) 1998 - 2016, Daniel Stenberg, <daniel@haxx.se>, et al.
+ *
+ * This software is licensed as described in the file COPYING, which
+ * you should have received as part of this distribution. The terms
+ * are also available at https://curl.haxx.se/docs/copyright.html.
+ *
+ * You may opt to use, copy, modify, merge, publish, distribute and/or sell
+ * copies of the Software, and permit persons to whom the Software is
+ * furnished to do so, under the terms of the COPYING file.
+ *
+ * This software is distributed on an "AS IS" basis, WITHOUT WARRANTY OF ANY
+ * KIND, either express or implied.
+ *
+ ***************************************************************************/
+#include "test.h"
+
+#include "testutil.h"
+#include "h2server.h"
+#include "warnless.h"
+#include "memdebug.h"
+
+/*
+ * Many parallel HTTP/2 transfers over one connection to the test's own h2
+ * server, more than the server takes at once, so that the rest wait for
+ * streams to finish. Every transfer must complete with the whole body.
+ *
+ * Run as "lib1541 - <transfers> [<body size>]" it is a benchmark instead
+ * and prints how long the transfers took to stderr.
+ */
+
+#define TEST_HANG_TIMEOUT 60 * 1000
+
+#define NUM_HANDLES 300
+#define BODY_SIZE 20000
+
+struct transfer {
+  CURL *easy;
+  size_t received;
+  bool corrupt;     /* a byte did not match */
+};
+
+static size_t write_cb(char *ptr, size_t size, size_t nmemb, void *userp)
+{
+  struct transfer *t = userp;
+  size_t len = size * nmemb;
+  size_t i;
+
+  for(i = 0; i < len; i++)
+    if((unsigned char)ptr[i] != h2server_byte(t->received + i))
+      t->corrupt = TRUE;
+  t->received += len;
+  return len;
+}
+
+int test(char *URL)
+{
+  CURLM *multi = NULL;
+  struct h2server *srv = NULL;
+  struct transfer *transfers = NULL;
+  char url[256];
+  int num_handles = NUM_HANDLES;
+  size_t body_size = BODY_SIZE;
+  int still_running;
+  CURLMsg *msg;
+  int msgs_left;
+  int completed = 0;
+  int failed = 0;
+  struct timeval started;
+  int res = 0;
+  int i;
+
+  (void)URL;
+
+  if(libtest_arg2) {
+    num_handles = atoi(libtest_arg2);
+    if(libtest_arg3)
+      body_size = (size_t)atol(libtest_arg3);
+    if(num_handles <= 0) {
+      fprintf(stderr, "bad number of transfers\n");
+      return TEST_ERR_MAJOR_BAD;
+    }
+  }
+
+  transfers = calloc((size_t)num_handles, sizeof(*transfers));
+  if(!transfers)
+    return TEST_ERR_MAJOR_BAD;
+
+  start_test_timing();
+
+  srv = h2server_start(body_size);
+  if(!srv) {
+    fprintf(stderr, "h2server_start() failed\n");
+    free(transfers);
+    return TEST_ERR_MAJOR_BAD;
+  }
+  snprintf(url, sizeof(url), "http://127.0.0.1:%d/1541",
+           h2server_port(srv));
+
+  global_init(CURL_GLOBAL_ALL);
+
+  multi_init(multi);
+  multi_setopt(multi, CURLMOPT_PIPELINING, CURLPIPE_MULTIPLEX);
+  multi_setopt(multi, CURLMOPT_MAX_HOST_CONNECTIONS, 1L);
+
+  for(i = 0; i < num_handles; i++) {
+    easy_init(transfers[i].easy);
+    easy_setopt(transfers[i].easy, CURLOPT_URL, url);
+    easy_setopt(transfers[i].easy, CURLOPT_HTTP_VERSION,
+                (long)CURL_HTTP_VERSION_2_PRIOR_KNOWLEDGE);
+    easy_setopt(transfers[i].easy, CURLOPT_PIPEWAIT, 1L);
+    easy_setopt(transfers[i].easy, CURLOPT_WRITEFUNCTION, write_cb);
+    easy_setopt(transfers[i].easy, CURLOPT_WRITEDATA, &transfers[i]);
+  }
+
+  started = tutil_tvnow();
+
+  for(i = 0; i < num_handles; i++)
+    multi_add_handle(multi, transfers[i].easy);
+
+  multi_perform(multi, &still_running);
+
+  abort_on_test_timeout();
+
+  while(still_running) {
+    struct curl_waitfd fds[10];
+    unsigned int nfds = h2server_waitfds(srv, fds, 10);
+    int numfds;
+
+    res = curl_multi_wait(multi, fds, nfds, 1000, &numfds);
+    if(res != CURLM_OK) {
+      fprintf(stderr, "curl_multi_wait() returned %d\n", res);
+      res = TEST_ERR_MAJOR_BAD;
+      goto test_cleanup;
+    }
+
+    if(h2server_serve(srv)) {
+      fprintf(stderr, "h2 server failed\n");
+      res = TEST_ERR_FAILURE;
+      goto test_cleanup;
+    }
+
+    abort_on_test_timeout();
+
+    multi_perform(multi, &still_running);
+
+    abort_on_test_timeout();
+  }
+
+  while((msg = curl_multi_info_read(multi, &msgs_left)) != NULL) {
+    if(msg->msg != CURLMSG_DONE)
+      continue;
+    if(msg->data.result) {
+      fprintf(stderr, "transfer failed: %d\n", (int)msg->data.result);
+      res = TEST_ERR_FAILURE;
+    }
+    completed++;
+  }
+
+  for(i = 0; i < num_handles; i++) {
+    long code = 0;
+    curl_easy_getinfo(transfers[i].easy, CURLINFO_RESPONSE_CODE, &code);
+    if((code != 200) || (transfers[i].received != body_size) ||
+       transfers[i].corrupt)
+      failed++;
+  }
+
+  if(libtest_arg2) {
+    long ms = tutil_tvdiff(tutil_tvnow(), started);
+    fprintf(stderr, "%d transfers of %lu bytes: %ld ms, %.0f transfers/s, "
+            "%d failed, %d connections\n", num_handles,
+            (unsigned long)body_size, ms,
+            ms ? num_handles * 1000.0 / (double)ms : 0.0, failed,
+            h2server_connections(srv));
+  }
+  else {
+    printf("%d transfers completed, %d failed\n", completed, failed);
+    printf("server connections: %d\n", h2server_connections(srv));
+  }
+
+test_cleanup:
+
+  for(i = 0; i < num_handles; i++) {
+    curl_multi_remove_handle(multi, transfers[i].easy);
+    curl_easy_cleanup(transfers[i].easy);
+  }
+  curl_multi_cleanup(multi);
+  curl_global_cleanup();
+  h2server_stop(srv);
+  free(transfers);
+
+  return res;
+}
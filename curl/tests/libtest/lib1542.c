@@ -0,0 +1,367 @@
+/***************************************************************************
+ *                                  _   _ ____  _
+ *  Project                     ___| | | |  _ \| |
+ *                             / __| | | | |_) | |
+ *                            | (__| |_| |  _ <| |___
+ *                             \___|\___/|_| \_\_____|
+ *
+ * Copyright (C) 1998 - 2016, Daniel Stenberg, <daniel@haxx.se>, et al.
+ *
+ * This software is licensed as described in the file COPYING, which
+ * you should have received as part of this distribution. The terms
+ * are also available at https://curl.haxx.se/docs/copyright.html.
+ *
+ * You may opt to use, copy, modify, merge, publish, distribute and/or sell
+ * copies of the Software, and permit persons to whom the Software is
+ * furnished to do so, under the terms of the COPYING file.
+ *
+ * This software is distributed on an "AS IS" basis, WITHOUT WARRANTY OF ANY
+ * KIND, either express or implied.
+ *
+ ***************************************************************************/
+#include "test.h"
+
+#ifdef HAVE_NETINET_IN_H
+#include <netinet/in.h>
+#endif
+#ifdef HAVE_ARPA_INET_H
+#include <arpa/inet.h>
+#endif
+#ifdef HAVE_SYS_RESOURCE_H
+#include <sys/resource.h>
+#endif
+#ifdef HAVE_SYS_WAIT_H
+#include <sys/wait.h>
+#endif
+#ifdef HAVE_FCNTL_H
+#include <fcntl.h>
+#endif
+#ifdef HAVE_SYS_POLL_H
+#include <sys/poll.h>
+#elif defined(HAVE_POLL_H)
+#include <poll.h>
+#endif
+#include <signal.h>
+
+#include "testutil.h"
+#include "warnless.h"
+#include "memdebug.h"
+
+/*
+ * Rounds of parallel transfers driven by curl_multi_run(), one connection
+ * each, against a child process that serves HTTP/1.1 on a port of its own.
+ * The server answers a round only once all of its requests are in, so every
+ * transfer needs a connection of its own. The first round makes the
+ * connections and the rest reuse them. Every transfer must complete and no
+ * round after the first may connect again.
+ *
+ * Run as "lib1542 - <connections> [<rounds>]" it is a benchmark instead and
+ * prints the CPU time per transfer of every round to stderr. The server
+ * works in its own process, so the time is libcurl's and the test's only.
+ */
+
+#if defined(HAVE_FORK) && defined(HAVE_POLL_FINE) && \
+  defined(HAVE_SYS_RESOURCE_H)
+
+#define TEST_HANG_TIMEOUT 60 * 1000
+
+#define NUM_HANDLES 20
+#define NUM_ROUNDS 2
+
+static const char response[] =
+  "HTTP/1.1 200 OK\r\n"
+  "Content-Length: 6\r\n"
+  "\r\n"
+  "hello\n";
+
+struct client {
+  int matched;  /* how much of a "\r\n\r\n" has been read */
+  int pending;  /* requests not answered yet */
+};
+
+static size_t write_cb(char *ptr, size_t size, size_t nmemb, void *userp)
+{
+  (void)ptr;
+  (void)userp;
+  return size * nmemb;
+}
+
+/* Serves the connections of the listener until killed, answering all the
+   requests at once when there are max of them. It runs in the child process
+   and must not use memdebug's socket functions, or the parent's memdump
+   would get the child's sockets too. */
+static void serve(curl_socket_t listener, struct pollfd *fds,
+                  struct client *clients, int max)
+{
+  int nfds = 1;
+  int waiting = 0;
+
+  fds[0].fd = listener;
+  fds[0].events = POLLIN;
+
+  for(;;) {
+    int i;
+
+    if(poll(fds, (nfds_t)nfds, -1) < 0) {
+      if(SOCKERRNO == EINTR)
+        continue;
+      return;
+    }
+
+    if(fds[0].revents & POLLIN) {
+      while(nfds <= max) {
+        curl_socket_t sock = (accept)(listener, NULL, NULL);
+        if(sock == CURL_SOCKET_BAD)
+          break;
+        fds[nfds].fd = sock;
+        fds[nfds].events = POLLIN;
+        fds[nfds].revents = 0;
+        clients[nfds].matched = 0;
+        clients[nfds].pending = 0;
+        nfds++;
+      }
+    }
+
+    for(i = 1; i < nfds; i++) {
+      char buf[1024];
+      ssize_t n;
+      ssize_t j;
+
+      if(!fds[i].revents)
+        continue;
+      n = recv(fds[i].fd, buf, sizeof(buf), 0);
+      if(n <= 0) {
+        /* closed by the client, put the last one in its place */
+        close(fds[i].fd);
+        waiting -= clients[i].pending;
+        nfds--;
+        fds[i] = fds[nfds];
+        clients[i] = clients[nfds];
+        i--;
+        continue;
+      }
+
+      /* every "\r\n\r\n" ends a request */
+      for(j = 0; j < n; j++) {
+        struct client *c = &clients[i];
+        if(buf[j] == "\r\n\r\n"[c->matched])
+          c->matched++;
+        else
+          c->matched = (buf[j] == '\r') ? 1 : 0;
+        if(c->matched == 4) {
+          c->matched = 0;
+          c->pending++;
+          waiting++;
+        }
+      }
+    }
+
+    if(waiting >= max) {
+      for(i = 1; i < nfds; i++) {
+        for(; clients[i].pending; clients[i].pending--)
+          (void)send(fds[i].fd, response, sizeof(response) - 1, 0);
+      }
+      waiting = 0;
+    }
+  }
+}
+
+/* Makes room for the sockets of the given number of connections */
+static void raise_fd_limit(int conns)
+{
+  struct rlimit rl;
+  rlim_t need = (rlim_t)conns + 100;
+
+  if(getrlimit(RLIMIT_NOFILE, &rl) || (rl.rlim_cur >= need))
+    return;
+#ifdef RLIM_INFINITY
+  if(rl.rlim_max != RLIM_INFINITY)
+#endif
+    if(rl.rlim_max < need)
+      need = rl.rlim_max;
+  rl.rlim_cur = need;
+  (void)setrlimit(RLIMIT_NOFILE, &rl);
+}
+
+/* user and system CPU time used by this process, in microseconds */
+static double cpu_us(void)
+{
+  struct rusage ru;
+
+  if(getrusage(RUSAGE_SELF, &ru))
+    return 0.0;
+  return (double)(ru.ru_utime.tv_sec + ru.ru_stime.tv_sec) * 1e6 +
+    (double)(ru.ru_utime.tv_usec + ru.ru_stime.tv_usec);
+}
+
+int test(char *URL)
+{
+  CURL **curls = NULL;
+  CURLM *multi = NULL;
+  struct pollfd *fds = NULL;
+  struct client *clients = NULL;
+  curl_socket_t listener = CURL_SOCKET_BAD;
+  struct sockaddr_in addr;
+  curl_socklen_t addrlen = sizeof(addr);
+  pid_t child = -1;
+  char url[256];
+  int num_handles = NUM_HANDLES;
+  int rounds = NUM_ROUNDS;
+  int round;
+  int res = 0;
+  int i;
+
+  (void)URL;
+
+  if(libtest_arg2) {
+    num_handles = atoi(libtest_arg2);
+    if(libtest_arg3)
+      rounds = atoi(libtest_arg3);
+    if((num_handles <= 0) || (rounds <= 0)) {
+      fprintf(stderr, "bad number of connections or rounds\n");
+      return TEST_ERR_MAJOR_BAD;
+    }
+    raise_fd_limit(num_handles);
+  }
+
+  curls = calloc((size_t)num_handles, sizeof(*curls));
+  fds = calloc((size_t)num_handles + 1, sizeof(*fds));
+  clients = calloc((size_t)num_handles + 1, sizeof(*clients));
+  if(!curls || !fds || !clients) {
+    res = TEST_ERR_MAJOR_BAD;
+    goto test_cleanup;
+  }
+
+  memset(&addr, 0, sizeof(addr));
+  addr.sin_family = AF_INET;
+  addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+  addr.sin_port = 0;
+
+  listener = socket(AF_INET, SOCK_STREAM, 0);
+  if((listener == CURL_SOCKET_BAD) ||
+     bind(listener, (struct sockaddr *)&addr, sizeof(addr)) ||
+     listen(listener, SOMAXCONN) ||
+     getsockname(listener, (struct sockaddr *)&addr, &addrlen) ||
+     (fcntl(listener, F_SETFL, fcntl(listener, F_GETFL, 0) | O_NONBLOCK) <
+      0)) {
+    fprintf(stderr, "the server socket failed: %d\n", SOCKERRNO);
+    res = TEST_ERR_MAJOR_BAD;
+    goto test_cleanup;
+  }
+  snprintf(url, sizeof(url), "http://127.0.0.1:%d/1542",
+           (int)ntohs(addr.sin_port));
+
+  fflush(stdout);
+  fflush(stderr);
+  child = fork();
+  if(!child) {
+    serve(listener, fds, clients, num_handles);
+    _exit(0);
+  }
+  if(child < 0) {
+    fprintf(stderr, "fork() failed: %d\n", errno);
+    res = TEST_ERR_MAJOR_BAD;
+    goto test_cleanup;
+  }
+  sclose(listener);
+  listener = CURL_SOCKET_BAD;
+
+  start_test_timing();
+
+  global_init(CURL_GLOBAL_ALL);
+
+  multi_init(multi);
+
+  for(i = 0; i < num_handles; i++) {
+    easy_init(curls[i]);
+    easy_setopt(curls[i], CURLOPT_URL, url);
+    easy_setopt(curls[i], CURLOPT_WRITEFUNCTION, write_cb);
+  }
+
+  for(round = 1; round <= rounds; round++) {
+    struct timeval started = tutil_tvnow();
+    double cpu = cpu_us();
+    int still_running;
+    int done = 0;
+    long connects = 0;
+    CURLMsg *msg;
+    int msgs;
+
+    for(i = 0; i < num_handles; i++)
+      multi_add_handle(multi, curls[i]);
+
+    do {
+      res = curl_multi_run(multi, 1000, &still_running);
+      if(res != CURLM_OK) {
+        fprintf(stderr, "curl_multi_run() returned %d\n", res);
+        res = TEST_ERR_MAJOR_BAD;
+        goto test_cleanup;
+      }
+
+      abort_on_test_timeout();
+
+      while((msg = curl_multi_info_read(multi, &msgs)) != NULL) {
+        if(msg->msg != CURLMSG_DONE)
+          continue;
+        if(msg->data.result) {
+          fprintf(stderr, "transfer failed: %d\n", (int)msg->data.result);
+          res = TEST_ERR_FAILURE;
+          goto test_cleanup;
+        }
+        done++;
+      }
+    } while(still_running);
+
+    cpu = cpu_us() - cpu;
+
+    for(i = 0; i < num_handles; i++) {
+      long n = 0;
+      curl_easy_getinfo(curls[i], CURLINFO_NUM_CONNECTS, &n);
+      connects += n;
+      curl_multi_remove_handle(multi, curls[i]);
+    }
+
+    if(libtest_arg2)
+      fprintf(stderr, "round %d: %d transfers, %d new connections, "
+              "%.1f us CPU per transfer, %ld ms\n", round, done,
+              (int)connects, cpu / (double)num_handles,
+              tutil_tvdiff(tutil_tvnow(), started));
+    else
+      printf("round %d: %d transfers done, %ld new connections\n", round,
+             done, connects);
+  }
+
+test_cleanup:
+
+  if(curls) {
+    for(i = 0; i < num_handles; i++) {
+      curl_multi_remove_handle(multi, curls[i]);
+      curl_easy_cleanup(curls[i]);
+    }
+  }
+  curl_multi_cleanup(multi);
+  curl_global_cleanup();
+
+  if(child > 0) {
+    kill(child, SIGTERM);
+    waitpid(child, NULL, 0);
+  }
+  if(listener != CURL_SOCKET_BAD)
+    sclose(listener);
+  free(curls);
+  free(fds);
+  free(clients);
+
+  return res;
+}
+
+#else /* HAVE_FORK && HAVE_POLL_FINE && HAVE_SYS_RESOURCE_H */
+
+int test(char *URL)
+{
+  (void)URL;
+  printf("system lacks necessary system function(s)");
+  return 1; /* skip test */
+}
+
+#endif
@@ -0,0 +1,173 @@
+/***************************************************************************
+ *                                  _   _ ____  _
+ *  Project                     ___| | | |  _ \| |
+ *                             / __| | | | |_) | |
+ *                            | (__| |_| |  _ <| |___
+ *                             \___|\___/|_| \_\_____|
+ *
+ * Copyright (C) 1998 - 2016, Daniel Stenberg, <daniel@haxx.se>, et al.
+ *
+ * This software is licensed as described in the file COPYING, which
+ * you should have received as part of this distribution. The terms
+ * are also available at http://curl.haxx.se/docs/copyright.html.
+ *
+ * You may opt to use, copy, modify, merge, publish, distribute and/or sell
+ * copies of the Software, and permit persons to whom the Software is
+ * furnished to do so, under the terms of the COPYING file.
+ *
+ * This software is distributed on an "AS IS" basis, WITHOUT WARRANTY OF ANY
+ * KIND, either express or implied.
+ *
+ ***************************************************************************/
+#include "curlcheck.h"
+
+#define ENABLE_CURLX_PRINTF
+#include "curlx.h"
+
+#include "cookie.h"
+
+#include "memdebug.h" /* LAST include file */
+
+/*
+ * Fills a cookie jar with many cookies spread over many sites and checks
+ * that the lookups done when generating request headers find exactly the
+ * cookies that belong to each host. Run as "./unit1605 - <cookies>" it
+ * also times a number of lookups in a jar of that many cookies and prints
+ * the result to stderr, as a benchmark for large jars.
+ */
+
+#if !defined(CURL_DISABLE_HTTP) && !defined(CURL_DISABLE_COOKIES)
+
+#define COOKIES_PER_SITE 10
+
+static struct CookieInfo *jar;
+
+static CURLcode unit_setup(void)
+{
+  jar = Curl_cookie_init(NULL, NULL, NULL, FALSE);
+  return jar ? CURLE_OK : CURLE_OUT_OF_MEMORY;
+}
+
+static void unit_stop(void)
+{
+  Curl_cookie_cleanup(jar);
+}
+
+/* Returns the number of cookies sent to 'host' for 'path' */
+static int sent(const char *host, const char *path)
+{
+  struct Cookie *list = Curl_cookie_getlist(jar, host, path, FALSE);
+  struct Cookie *co;
+  int count = 0;
+
+  for(co = list; co; co = co->next)
+    count++;
+  Curl_cookie_freelist(list, FALSE);
+  return count;
+}
+
+#else
+
+static CURLcode unit_setup(void)
+{
+  return CURLE_OK;
+}
+
+static void unit_stop(void)
+{
+}
+
+#endif
+
+UNITTEST_START
+#if !defined(CURL_DISABLE_HTTP) && !defined(CURL_DISABLE_COOKIES)
+  char line[128];
+  char host[64];
+  char other[64];
+  struct timeval start;
+  long elapsed;
+  int cookies = 20000;
+  int sites;
+  int lookups;
+  int i;
+
+  if(libtest_arg2) {
+    cookies = atoi(libtest_arg2);
+    abort_unless(cookies > 0, "bad number of cookies");
+  }
+  sites = (cookies + COOKIES_PER_SITE - 1) / COOKIES_PER_SITE;
+
+  /* Each site gets five cookies for the whole domain and five for its www
+     host only, one of which is for another path. */
+  for(i = 0; i < cookies; i++) {
+    int site = i / COOKIES_PER_SITE;
+    int n = i % COOKIES_PER_SITE;
+    snprintf(host, sizeof(host), "www.site%d.com", site);
+    if(n < 5)
+      snprintf(line, sizeof(line), "c%d=%d; domain=site%d.com", n, i, site);
+    else if(n == 5)
+      snprintf(line, sizeof(line), "c%d=%d; path=/other", n, i);
+    else
+      snprintf(line, sizeof(line), "c%d=%d", n, i);
+    abort_unless(Curl_cookie_add(NULL, jar, TRUE, line, host, "/"),
+                 "adding cookie failed");
+  }
+  abort_unless(jar->numcookies == cookies, "wrong number of cookies");
+
+  /* Cookies for a domain that is not a site of its own */
+  strcpy(line, "tld=1; domain=com");
+  fail_if(Curl_cookie_add(NULL, jar, TRUE, line, "www.site0.com", "/"),
+          "cookie for a top level domain accepted");
+
+  for(i = 0; i < sites; i += (sites / 7) + 1) {
+    int full = (i == sites - 1 && cookies % COOKIES_PER_SITE) ?
+      0 : COOKIES_PER_SITE;
+    if(!full)
+      continue;
+    snprintf(host, sizeof(host), "www.site%d.com", i);
+    fail_unless(sent(host, "/") == 9, "wrong cookies for the www host");
+    fail_unless(sent(host, "/other/x") == 10,
+                "wrong cookies for the www host and path");
+    snprintf(host, sizeof(host), "site%d.com", i);
+    fail_unless(sent(host, "/") == 5, "wrong cookies for the domain");
+    snprintf(host, sizeof(host), "a.b.SITE%d.com", i);
+    fail_unless(sent(host, "/") == 5, "wrong cookies for a subdomain");
+    snprintf(other, sizeof(other), "xsite%d.com", i);
+    fail_unless(sent(other, "/") == 0, "cookies sent to another site");
+  }
+  fail_unless(sent("com", "/") == 0, "cookies sent to a top level domain");
+  fail_unless(sent("localhost", "/") == 0, "cookies sent to localhost");
+
+  /* A new value replaces the old one in place */
+  strcpy(line, "c6=new");
+  abort_unless(Curl_cookie_add(NULL, jar, TRUE, line, "www.site0.com", "/"),
+               "replacing cookie failed");
+  fail_unless(jar->numcookies == cookies, "replaced cookie was added");
+
+  /* An expired cookie removes the one it replaces */
+  strcpy(line, "c7=gone; expires=Thu, 01 Jan 1970 00:00:10 GMT");
+  Curl_cookie_add(NULL, jar, TRUE, line, "www.site0.com", "/");
+  fail_unless(sent("www.site0.com", "/") == 8, "expired cookie was sent");
+  fail_unless(jar->numcookies == cookies - 1, "expired cookie was kept");
+
+  if(libtest_arg2) {
+    lookups = 10000;
+    start = curlx_tvnow();
+    for(i = 0; i < lookups; i++) {
+      struct Cookie *list;
+      snprintf(host, sizeof(host), "www.site%d.com",
+               (int)(((unsigned int)i * 2654435761U) % (unsigned int)sites));
+      list = Curl_cookie_getlist(jar, host, "/", FALSE);
+      Curl_cookie_freelist(list, FALSE);
+    }
+    elapsed = curlx_tvdiff(curlx_tvnow(), start);
+    fprintf(stderr, "%d lookups in a jar of %ld cookies: %ld ms\n", lookups,
+            jar->numcookies, elapsed);
+  }
+
+  Curl_cookie_clearsess(jar);
+  fail_unless(jar->numcookies == 0, "session cookies left after clearing");
+  fail_unless(sent("www.site1.com", "/") == 0, "cleared cookie was sent");
+#endif
+
+UNITTEST_STOP
@@ -0,0 +1,383 @@
+/***************************************************************************
+ *                                  _   _ ____  _
+ *  Project                     ___| | | |  _ \| |
+ *                             / __| | | | |_) | |
+ *                            | (__| |_| |  _ <| |___
+ *                             \___|\___/|_| \_\_____|
+ *
+ * Copyright (C) 2016, Daniel Stenberg, <daniel@haxx.se>, et al.
+ *
+ * This software is licensed as described in the file COPYING, which
+ * you should have received as part of this distribution. The terms
+ * are also available at https://curl.haxx.se/docs/copyright.html.
+ *
+ * You may opt to use, copy, modify, merge, publish, distribute and/or sell
+ * copies of the Software, and permit persons to whom the Software is
+ * furnished to do so, under the terms of the COPYING file.
+ *
+ * This software is distributed on an "AS IS" basis, WITHOUT WARRANTY OF ANY
+ * KIND, either express or implied.
+ *
+ ***************************************************************************/
+#include "curlcheck.h"
+
+#include "timewheel.h"
+#include "splay.h"
+#include "timeval.h"
+
+#include "memdebug.h" /* LAST include file */
+
+static CURLcode unit_setup(void)
+{
+  return CURLE_OK;
+}
+
+static void unit_stop(void)
+{
+
+}
+
+/* number of nodes to add to the wheel */
+#define NUM_NODES 1000
+
+static struct Curl_wheel wheel;
+static struct Curl_wheel_node nodes[NUM_NODES];
+static const struct timeval origin = {1000, 0};
+
+static struct timeval offset(long ms, long us)
+{
+  struct timeval tv = origin;
+  tv.tv_sec += ms / 1000;
+  tv.tv_usec += (ms % 1000) * 1000 + us;
+  while(tv.tv_usec >= 1000000) {
+    tv.tv_sec++;
+    tv.tv_usec -= 1000000;
+  }
+  return tv;
+}
+
+/* the node in the wheel with the earliest key, the hard way */
+static struct Curl_wheel_node *earliest(void)
+{
+  struct Curl_wheel_node *best = NULL;
+  int i;
+  for(i = 0; i < NUM_NODES; i++) {
+    if(nodes[i].slot &&
+       (!best || Curl_wheel_comparekeys(nodes[i].key, best->key) < 0))
+      best = &nodes[i];
+  }
+  return best;
+}
+
+static unsigned int rnd(void)
+{
+  static unsigned int seed = 1606;
+  seed = seed * 1103515245 + 12345;
+  return (seed >> 8) & 0xffffff;
+}
+
+/* TRUE if the wheel's next time is exactly 'tv' */
+static bool next_is(struct timeval tv)
+{
+  struct timeval when;
+  return Curl_wheel_next(&wheel, &when) &&
+    !Curl_wheel_comparekeys(when, tv);
+}
+
+/* Follows the times the wheel asks to be looked at until a node expires and
+   returns that node. NULL if that takes more than one step per level or
+   any of the times is after the earliest node. */
+static struct Curl_wheel_node *follow(void)
+{
+  struct Curl_wheel_node *first = earliest();
+  struct timeval when;
+  int steps;
+
+  for(steps = 0; first && (steps <= WHEEL_LEVELS); steps++) {
+    struct Curl_wheel_node *node;
+    if(!Curl_wheel_next(&wheel, &when) ||
+       (Curl_wheel_comparekeys(when, first->key) > 0))
+      return NULL;
+    node = Curl_wheel_getbest(&wheel, when);
+    if(node)
+      return node;
+  }
+  return NULL;
+}
+
+/* expire everything up to 'now' and check that it is what expired, in the
+   order it expired */
+static int expire(struct timeval now)
+{
+  struct Curl_wheel_node *node;
+  struct Curl_wheel_node *first;
+  struct Curl_wheel_node *prev = NULL;
+  struct timeval when;
+  int fails = 0;
+
+  while((node = Curl_wheel_getbest(&wheel, now)) != NULL) {
+    if(Curl_wheel_comparekeys(node->key, now) > 0)
+      fails++;
+    if(node->slot)
+      fails++;
+    if(prev && (Curl_wheel_comparekeys(node->key, prev->key) < 0))
+      fails++;
+    prev = node;
+  }
+
+  /* the next time is after 'now' but no later than the earliest node */
+  first = earliest();
+  if(Curl_wheel_next(&wheel, &when)) {
+    if(!first || (Curl_wheel_comparekeys(when, first->key) > 0))
+      fails++;
+    if(Curl_wheel_comparekeys(when, now) <= 0)
+      fails++;
+  }
+  else if(first)
+    fails++;
+
+  return fails;
+}
+
+/*
+ * Given a number of handles as extra argument, the test instead times the
+ * pattern of Curl_expire() calls a multi handle with that many transfers
+ * makes: the timer of a random handle is removed and set again, and every
+ * now and then time moves on a millisecond and the expired timers are set
+ * again. It is timed both with the wheel and with the splay tree:
+ *
+ *   ./unit1606 - 10000
+ */
+
+#define BENCH_OPS 2000000
+
+/* the time the benchmark has reached after 'op' operations */
+static struct timeval bench_now(long op)
+{
+  return offset(op / 100, 0);
+}
+
+/* when a timer set after 'op' operations expires */
+static struct timeval bench_key(long op)
+{
+  return offset(op / 100 + 1 + (long)(rnd() % 5000), (long)(rnd() % 1000));
+}
+
+static double bench_wheel(int handles)
+{
+  struct Curl_wheel_node *timers = calloc((size_t)handles,
+                                          sizeof(struct Curl_wheel_node));
+  struct Curl_wheel_node *node;
+  struct timeval start;
+  double secs;
+  long op;
+  int i;
+
+  if(!timers)
+    return 0.0;
+
+  Curl_wheel_init(&wheel, origin);
+  for(i = 0; i < handles; i++)
+    Curl_wheel_add(&wheel, bench_key(0), &timers[i]);
+
+  start = Curl_tvnow();
+  for(op = 0; op < BENCH_OPS; op++) {
+    node = &timers[rnd() % (unsigned int)handles];
+    Curl_wheel_remove(&wheel, node);
+    Curl_wheel_add(&wheel, bench_key(op), node);
+
+    if(!(op % 100)) {
+      struct timeval now = bench_now(op);
+      while((node = Curl_wheel_getbest(&wheel, now)) != NULL)
+        Curl_wheel_add(&wheel, bench_key(op), node);
+    }
+  }
+  secs = Curl_tvdiff_secs(Curl_tvnow(), start);
+
+  free(timers);
+  return secs * 1e9 / BENCH_OPS;
+}
+
+static double bench_splay(int handles)
+{
+  struct Curl_tree *timers = calloc((size_t)handles,
+                                    sizeof(struct Curl_tree));
+  struct Curl_tree *tree = NULL;
+  struct Curl_tree *node;
+  struct timeval start;
+  double secs;
+  long op;
+  int i;
+
+  if(!timers)
+    return 0.0;
+
+  for(i = 0; i < handles; i++) {
+    timers[i].key = bench_key(0);
+    tree = Curl_splayinsert(timers[i].key, tree, &timers[i]);
+  }
+
+  start = Curl_tvnow();
+  for(op = 0; op < BENCH_OPS; op++) {
+    node = &timers[rnd() % (unsigned int)handles];
+    Curl_splayremovebyaddr(tree, node, &tree);
+    node->key = bench_key(op);
+    tree = Curl_splayinsert(node->key, tree, node);
+
+    if(!(op % 100)) {
+      struct timeval now = bench_now(op);
+      for(;;) {
+        tree = Curl_splaygetbest(now, tree, &node);
+        if(!node)
+          break;
+        node->key = bench_key(op);
+        tree = Curl_splayinsert(node->key, tree, node);
+      }
+    }
+  }
+  secs = Curl_tvdiff_secs(Curl_tvnow(), start);
+
+  free(timers);
+  return secs * 1e9 / BENCH_OPS;
+}
+
+UNITTEST_START
+  static const long fixed[][2] = {
+    /* milliseconds, microseconds */
+    {0, 500}, {1, 0}, {1, 200}, {31, 0}, {32, 0}, {33, 999}, {1023, 0},
+    {1024, 0}, {1057, 0}, {5000, 0}, {3600000, 0}, {3600000, 1},
+    {20L * 24 * 3600000, 0}
+  };
+  struct timeval now;
+  struct timeval when;
+  int n = sizeof(fixed) / sizeof(fixed[0]);
+  int i;
+
+  if(libtest_arg2) {
+    int handles = atoi(libtest_arg2);
+    abort_unless(handles > 0, "bad number of handles");
+    fprintf(stderr, "%d handles: %.0f ns/op with the wheel, "
+            "%.0f ns/op with the splay tree\n", handles,
+            bench_wheel(handles), bench_splay(handles));
+    goto unit_test_abort;
+  }
+
+  Curl_wheel_init(&wheel, origin);
+
+  abort_unless(!Curl_wheel_next(&wheel, &when), "empty wheel has a node");
+  abort_unless(Curl_wheel_getbest(&wheel, origin) == NULL,
+               "empty wheel returned a node");
+
+  /* add in reverse order so that the first one is always replaced. The
+     next time is exact for the nodes on level 0, within 32 ms, and no later
+     than the node for the others. */
+  for(i = n - 1; i >= 0; i--) {
+    Curl_wheel_add(&wheel, offset(fixed[i][0], fixed[i][1]), &nodes[i]);
+    fail_unless(Curl_wheel_next(&wheel, &when) &&
+                (Curl_wheel_comparekeys(when, nodes[i].key) <= 0),
+                "next time after the first node");
+    if(fixed[i][0] < WHEEL_SLOTS)
+      fail_unless(next_is(nodes[i].key), "wrong next time");
+  }
+
+  /* removing the first node makes the next one first */
+  Curl_wheel_remove(&wheel, &nodes[0]);
+  fail_unless(next_is(nodes[1].key), "remove first failed");
+  Curl_wheel_remove(&wheel, &nodes[0]);
+  fail_unless(nodes[0].slot == 0, "double remove failed");
+
+  /* nothing has expired a microsecond before the first node */
+  fail_unless(Curl_wheel_getbest(&wheel, offset(0, 999)) == NULL,
+              "node expired too early");
+  fail_unless(Curl_wheel_getbest(&wheel, offset(1, 0)) == &nodes[1],
+              "node didn't expire on time");
+  fail_unless(Curl_wheel_getbest(&wheel, offset(1, 0)) == NULL,
+              "node expired too early");
+
+  /* step over the level boundaries one millisecond at a time */
+  for(i = 1; i < 1100; i++)
+    fail_if(expire(offset(i, 0)), "wrong expiry");
+  fail_unless(follow() == &nodes[9], "wrong first node");
+
+  /* jump ahead an hour, one microsecond short of the second hour node */
+  fail_if(expire(offset(3600000, 0)), "wrong expiry");
+  fail_unless(follow() == &nodes[11], "wrong first node");
+
+  /* the node further ahead than the wheel spans */
+  fail_if(expire(offset(15L * 24 * 3600000, 0)), "wrong expiry");
+  fail_unless(follow() == &nodes[12], "far node lost");
+  fail_unless(!Curl_wheel_next(&wheel, &when), "far node left");
+
+  /* nodes that have already expired when added still come out earliest
+     first */
+  now = offset(20L * 24 * 3600000 + 100, 0);
+  fail_if(expire(now), "wrong expiry");
+  Curl_wheel_add(&wheel, offset(20L * 24 * 3600000 + 90, 0), &nodes[0]);
+  Curl_wheel_add(&wheel, offset(20L * 24 * 3600000 + 50, 0), &nodes[1]);
+  Curl_wheel_add(&wheel, offset(20L * 24 * 3600000 + 70, 0), &nodes[2]);
+  Curl_wheel_add(&wheel, offset(20L * 24 * 3600000 + 50, 1), &nodes[3]);
+  fail_unless(next_is(nodes[1].key), "wrong next time");
+  fail_unless(Curl_wheel_getbest(&wheel, now) == &nodes[1],
+              "expired node out of order");
+  fail_unless(Curl_wheel_getbest(&wheel, now) == &nodes[3],
+              "expired node out of order");
+  fail_unless(Curl_wheel_getbest(&wheel, now) == &nodes[2],
+              "expired node out of order");
+  fail_unless(Curl_wheel_getbest(&wheel, now) == &nodes[0],
+              "expired node out of order");
+  fail_unless(!Curl_wheel_next(&wheel, &when), "expired node left");
+
+  /* all the nodes within a second a while ahead, added in random order.
+     They come out earliest first. */
+  memset(nodes, 0, sizeof(nodes));
+  Curl_wheel_init(&wheel, origin);
+  for(i = 0; i < NUM_NODES; i++)
+    Curl_wheel_add(&wheel, offset(100000, (long)(rnd() % 1000000)),
+                   &nodes[i]);
+  for(i = 0; i < NUM_NODES; i++) {
+    struct Curl_wheel_node *first = earliest();
+    if(follow() != first) {
+      fail("wrong first node in a full slot");
+      break;
+    }
+  }
+  fail_unless(!Curl_wheel_next(&wheel, &when), "full slot not emptied");
+
+  /* a lot of nodes added, moved and removed as time moves on */
+  memset(nodes, 0, sizeof(nodes));
+  Curl_wheel_init(&wheel, origin);
+  now = origin;
+  for(i = 0; i < 200000; i++) {
+    struct Curl_wheel_node *node = &nodes[rnd() % NUM_NODES];
+    long ms = (long)(now.tv_sec - origin.tv_sec) * 1000 +
+      (now.tv_usec - origin.tv_usec) / 1000;
+    long ahead;
+
+    switch(rnd() % 4) {
+    case 0:
+      ahead = rnd() % 50;           /* very soon */
+      break;
+    case 1:
+      ahead = rnd() % 5000;         /* seconds */
+      break;
+    case 2:
+      ahead = rnd() % 3600000;      /* up to an hour */
+      break;
+    default:
+      ahead = -1;                   /* just remove it */
+      break;
+    }
+    Curl_wheel_remove(&wheel, node);
+    if(ahead >= 0)
+      Curl_wheel_add(&wheel, offset(ms + ahead, rnd() % 1000), node);
+
+    if(!(i % 10)) {
+      now = offset(ms + rnd() % ((i % 1000) ? 20 : 100000), rnd() % 1000);
+      if(expire(now)) {
+        fail("wrong expiry with random nodes");
+        break;
+      }
+    }
+  }
+
+UNITTEST_STOP
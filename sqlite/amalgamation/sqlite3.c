@@ -198,6 +198,78 @@
 # define SQLITE_DEFAULT_WAL_AUTOCHECKPOINT  1000
 #endif
 
+/*
+** The default number of frames copied into the database file by each
+** step of a background checkpoint (see sqlite3_wal_background_checkpoint()).
+*/
+#ifndef SQLITE_DEFAULT_CHECKPOINT_BATCH
+# define SQLITE_DEFAULT_CHECKPOINT_BATCH  100
+#endif
+
+/*
+** The default maximum number of idle statements kept by the statement
+** cache of each database connection (see CHROMIUM_SQLITE_PREPARE_CACHED).
+*/
+#ifndef SQLITE_DEFAULT_STMT_CACHE_SIZE
+# define SQLITE_DEFAULT_STMT_CACHE_SIZE  16
+#endif
+
+/*
+** The maximum number of bytes of a database file that may be memory
+** mapped for reading (SQLITE_MAX_MMAP_SIZE), and the default value of
+** PRAGMA mmap_size (SQLITE_DEFAULT_MMAP_SIZE).  Memory-mapped I/O is only
+** implemented by the unix VFS, so the maximum defaults to zero on other
+** platforms.  The default of zero means that memory mapping is off unless
+** it is enabled at runtime.
+*/
+#ifndef SQLITE_MAX_MMAP_SIZE
+# if defined(__linux__) || (defined(__APPLE__) && defined(__MACH__))
+#   define SQLITE_MAX_MMAP_SIZE 0x7fff0000  /* 2147418112 */
+# else
+#   define SQLITE_MAX_MMAP_SIZE 0
+# endif
+#endif
+#ifndef SQLITE_DEFAULT_MMAP_SIZE
+# define SQLITE_DEFAULT_MMAP_SIZE 0
+#endif
+#if SQLITE_DEFAULT_MMAP_SIZE>SQLITE_MAX_MMAP_SIZE
+# undef SQLITE_DEFAULT_MMAP_SIZE
+# define SQLITE_DEFAULT_MMAP_SIZE SQLITE_MAX_MMAP_SIZE
+#endif
+
+/*
+** The maximum number of auxiliary threads that the external merge sorter
+** may use to sort and write out runs (SQLITE_MAX_WORKER_THREADS), and the
+** default value of PRAGMA threads (SQLITE_DEFAULT_WORKER_THREADS).  Worker
+** threads are only used by threadsafe builds on unix.
+**
+** SQLITE_SORTER_PMASZ is the default minimum amount of memory, in pages,
+** that the sorter accumulates before sorting it and writing it out to a
+** temporary file.  See also SQLITE_CONFIG_PMASZ.
+*/
+#ifndef SQLITE_MAX_WORKER_THREADS
+# define SQLITE_MAX_WORKER_THREADS 8
+#endif
+#ifndef SQLITE_DEFAULT_WORKER_THREADS
+# define SQLITE_DEFAULT_WORKER_THREADS 0
+#endif
+#if SQLITE_DEFAULT_WORKER_THREADS>SQLITE_MAX_WORKER_THREADS
+# undef SQLITE_DEFAULT_WORKER_THREADS
+# define SQLITE_DEFAULT_WORKER_THREADS SQLITE_MAX_WORKER_THREADS
+#endif
+#ifndef SQLITE_SORTER_PMASZ
+# define SQLITE_SORTER_PMASZ 250
+#endif
+
+/*
+** The default amount of memory, in bytes, that the process-wide shared
+** page cache for WAL databases may use.  Zero disables the shared cache.
+** See also SQLITE_CONFIG_WALCACHE.
+*/
+#ifndef SQLITE_DEFAULT_WALCACHE_SIZE
+# define SQLITE_DEFAULT_WALCACHE_SIZE 0
+#endif
+
 /*
 ** The maximum number of attached databases.  This must be between 0
 ** and 62.  The upper bound on 62 is because a 64-bit integer bitmap
@@ -1208,6 +1280,16 @@ struct sqlite3_file {
 ** fails to zero-fill short reads might seem to work.  However,
 ** failure to zero-fill short reads will eventually lead to
 ** database corruption.
+**
+** The xFetch() method, available when iVersion is 3 or greater, asks
+** the VFS for a pointer to iAmt bytes of the file starting at offset
+** iOfst, typically from a read-only memory mapping of the file.  ^If
+** the VFS is unable or unwilling to provide such a pointer it sets *pp
+** to NULL and returns SQLITE_OK, and SQLite falls back to xRead().
+** Each non-NULL pointer handed out by xFetch() is released by a
+** matching call to xUnfetch().  ^An xUnfetch() call with a NULL pointer
+** is a hint that the VFS should discard its mapping of the file, and is
+** only made when no xFetch() pointers are outstanding.
 */
 typedef struct sqlite3_io_methods sqlite3_io_methods;
 struct sqlite3_io_methods {
@@ -1230,6 +1312,9 @@ struct sqlite3_io_methods {
   void (*xShmBarrier)(sqlite3_file*);
   int (*xShmUnmap)(sqlite3_file*, int deleteFlag);
   /* Methods above are valid for version 2 */
+  int (*xFetch)(sqlite3_file*, sqlite3_int64 iOfst, int iAmt, void **pp);
+  int (*xUnfetch)(sqlite3_file*, sqlite3_int64 iOfst, void *p);
+  /* Methods above are valid for version 3 */
   /* Additional methods may be added in future releases */
 };
 
@@ -1277,6 +1362,15 @@ struct sqlite3_io_methods {
 ** Applications should not call [sqlite3_file_control()] with this
 ** opcode as doing so may disrupt the operation of the specialized VFSes
 ** that do require it.  
+**
+** The [SQLITE_FCNTL_MMAP_SIZE] file control is used to query or set the
+** maximum number of bytes of the file that the VFS may memory-map in
+** order to satisfy xFetch and xRead requests.  The argument is a pointer
+** to an [sqlite3_int64].  ^If the value pointed to is non-negative it
+** becomes the new mapping limit.  ^In either case, the previous limit is
+** written back into the integer before the call returns.  A limit of zero
+** disables memory-mapped I/O for the file.  This file control is used
+** internally to implement [PRAGMA mmap_size].
 */
 #define SQLITE_FCNTL_LOCKSTATE        1
 #define SQLITE_GET_LOCKPROXYFILE      2
@@ -1286,6 +1380,7 @@ struct sqlite3_io_methods {
 #define SQLITE_FCNTL_CHUNK_SIZE       6
 #define SQLITE_FCNTL_FILE_POINTER     7
 #define SQLITE_FCNTL_SYNC_OMITTED     8
+#define SQLITE_FCNTL_MMAP_SIZE       18
 
 
 /*
@@ -1972,6 +2067,39 @@ struct sqlite3_mem_methods {
 ** In a multi-threaded application, the application-defined logger
 ** function must be threadsafe. </dd>
 **
+** <dt>SQLITE_CONFIG_MMAP_SIZE</dt>
+** <dd> ^The SQLITE_CONFIG_MMAP_SIZE option takes two 64-bit integer
+** (sqlite3_int64) values that are the default mmap size limit (the default
+** setting for [PRAGMA mmap_size]) and the maximum allowed mmap size limit.
+** ^The default setting can be overridden by each database connection using
+** the [PRAGMA mmap_size] command.  ^The maximum allowed mmap size is
+** silently truncated if necessary so that it does not exceed the
+** compile-time maximum mmap size set by the SQLITE_MAX_MMAP_SIZE
+** compile-time option.  ^If either argument to this option is negative,
+** then that argument is changed to its compile-time default. </dd>
+**
+** <dt>SQLITE_CONFIG_PMASZ</dt>
+** <dd> ^The SQLITE_CONFIG_PMASZ option takes a single parameter which
+** is an unsigned integer and sets the minimum amount of memory, in units
+** of pages of the main database, that the external merge sorter used by
+** [CREATE INDEX] and by large ORDER BY clauses accumulates before sorting
+** it and spilling it to a temporary file.  ^If the [cache_size] of the
+** main database is larger, the cache size is used instead.  ^The default
+** minimum is set by the SQLITE_SORTER_PMASZ compile-time option, which
+** defaults to 250. </dd>
+**
+** <dt>SQLITE_CONFIG_WALCACHE</dt>
+** <dd> ^The SQLITE_CONFIG_WALCACHE option takes a single 64-bit integer
+** (sqlite3_int64) argument, the amount of memory in bytes that may be used
+** by a read-only page cache shared by all connections in the process that
+** have the same database open in [journal_mode | WAL mode].  ^While a
+** connection has no write transaction open, database pages that it reads
+** are looked up in and added to the shared cache instead of its own page
+** cache.  ^A value of zero or less disables the shared cache, which is the
+** default unless SQLite is compiled with a different
+** SQLITE_DEFAULT_WALCACHE_SIZE.  ^The current memory usage of the shared
+** cache is reported by [SQLITE_STATUS_WALCACHE_USED]. </dd>
+**
 ** </dl>
 */
 #define SQLITE_CONFIG_SINGLETHREAD  1  /* nil */
@@ -1990,6 +2118,9 @@ struct sqlite3_mem_methods {
 #define SQLITE_CONFIG_PCACHE       14  /* sqlite3_pcache_methods* */
 #define SQLITE_CONFIG_GETPCACHE    15  /* sqlite3_pcache_methods* */
 #define SQLITE_CONFIG_LOG          16  /* xFunc, void* */
+#define SQLITE_CONFIG_MMAP_SIZE    22  /* sqlite3_int64, sqlite3_int64 */
+#define SQLITE_CONFIG_PMASZ        25  /* unsigned int szPma */
+#define SQLITE_CONFIG_WALCACHE   1000  /* sqlite3_int64 nByte */
 
 /*
 ** CAPI3REF: Database Connection Configuration Options
@@ -2047,11 +2178,23 @@ struct sqlite3_mem_methods {
 ** following this call.  The second parameter may be a NULL pointer, in
 ** which case the trigger setting is not reported back. </dd>
 **
+** <dt>SQLITE_DBCONFIG_STMT_CACHE</dt>
+** <dd> ^This option sets the maximum number of idle statements kept by
+** the [statement cache] of the [database connection].
+** There should be two additional arguments.
+** The first argument is the new maximum, or a negative value to leave
+** the setting unchanged.  ^Setting it to zero disables the cache.
+** ^Idle statements beyond the new maximum are finalized immediately.
+** The second parameter is a pointer to an integer into which is written
+** the maximum following this call.  The second parameter may be a NULL
+** pointer, in which case the setting is not reported back. </dd>
+**
 ** </dl>
 */
 #define SQLITE_DBCONFIG_LOOKASIDE       1001  /* void* int int */
 #define SQLITE_DBCONFIG_ENABLE_FKEY     1002  /* int int* */
 #define SQLITE_DBCONFIG_ENABLE_TRIGGER  1003  /* int int* */
+#define SQLITE_DBCONFIG_STMT_CACHE      1004  /* int int* */
 
 
 /*
@@ -3120,6 +3263,10 @@ SQLITE_API int sqlite3_limit(sqlite3*, int id, int newVal);
 **
 ** ^(<dt>SQLITE_LIMIT_TRIGGER_DEPTH</dt>
 ** <dd>The maximum depth of recursion for triggers.</dd>)^
+**
+** ^(<dt>SQLITE_LIMIT_WORKER_THREADS</dt>
+** <dd>The maximum number of auxiliary worker threads that a single
+** [prepared statement] may start.</dd>)^
 ** </dl>
 */
 #define SQLITE_LIMIT_LENGTH                    0
@@ -3133,6 +3280,7 @@ SQLITE_API int sqlite3_limit(sqlite3*, int id, int newVal);
 #define SQLITE_LIMIT_LIKE_PATTERN_LENGTH       8
 #define SQLITE_LIMIT_VARIABLE_NUMBER           9
 #define SQLITE_LIMIT_TRIGGER_DEPTH            10
+#define SQLITE_LIMIT_WORKER_THREADS           11
 
 /*
 ** CAPI3REF: Compiling An SQL Statement
@@ -3243,6 +3391,65 @@ SQLITE_API int sqlite3_prepare16_v2(
   const void **pzTail     /* OUT: Pointer to unused portion of zSql */
 );
 
+/*
+** CAPI3REF: Prepared Statement Cache
+** KEYWORDS: {statement cache}
+**
+** ^The chromium_sqlite3_prepare() interface works like [sqlite3_prepare_v2()]
+** except that it takes an additional argument, a bitmask of zero or more of
+** the [CHROMIUM_SQLITE_PREPARE_CACHED | CHROMIUM_SQLITE_PREPARE_*] flags.
+**
+** ^(Each [database connection] has a cache of idle prepared statements, keyed
+** by SQL text.  When a statement prepared with the
+** CHROMIUM_SQLITE_PREPARE_CACHED flag is passed to [sqlite3_finalize()], it
+** is [sqlite3_reset | reset], its [sqlite3_clear_bindings | bindings are
+** cleared] and it is kept in the cache instead of being deleted.)^  ^A later
+** call to chromium_sqlite3_prepare() with the CHROMIUM_SQLITE_PREPARE_CACHED
+** flag for the same SQL statement returns the cached statement without
+** compiling the SQL again.  ^Only exactly the same text matches.  ^If the
+** cache holds no such statement, a new one is compiled.  Either way, the
+** application uses the statement exactly as one returned by
+** sqlite3_prepare_v2() and finalizes it when it is done with it.
+**
+** ^Cached statements are recompiled automatically after a schema change,
+** as for sqlite3_prepare_v2().  ^Statements that have expired are never
+** returned from the cache.
+**
+** ^The cache keeps at most 16 idle statements by default, discarding the
+** least recently used first.  ^The limit may be changed using
+** [sqlite3_db_config()] with [SQLITE_DBCONFIG_STMT_CACHE].  ^Idle
+** statements are finalized by [sqlite3_close()].  ^They are also visible
+** to [sqlite3_next_stmt()]; calling [sqlite3_finalize()] on an idle
+** statement deletes it.
+**
+** ^The number of cache hits and misses and an estimate of the compile time
+** saved are reported by [sqlite3_db_status()] with
+** [SQLITE_DBSTATUS_STMTCACHE_HIT], [SQLITE_DBSTATUS_STMTCACHE_MISS] and
+** [SQLITE_DBSTATUS_STMTCACHE_SAVED].
+*/
+SQLITE_API int chromium_sqlite3_prepare(
+  sqlite3 *db,            /* Database handle */
+  const char *zSql,       /* SQL statement, UTF-8 encoded */
+  int nByte,              /* Maximum length of zSql in bytes. */
+  unsigned int prepFlags, /* Zero or more CHROMIUM_SQLITE_PREPARE_ flags */
+  sqlite3_stmt **ppStmt,  /* OUT: Statement handle */
+  const char **pzTail     /* OUT: Pointer to unused portion of zSql */
+);
+
+/*
+** CAPI3REF: Prepare Flags
+**
+** These constants are the flags that may be passed to the prepFlags
+** argument of [chromium_sqlite3_prepare()].
+**
+** <dl>
+** <dt>CHROMIUM_SQLITE_PREPARE_CACHED</dt>
+** <dd>Look the statement up in, and return it to, the
+** [statement cache] of the database connection.</dd>
+** </dl>
+*/
+#define CHROMIUM_SQLITE_PREPARE_CACHED    0x01
+
 /*
 ** CAPI3REF: Retrieving Statement SQL
 **
@@ -6068,6 +6275,10 @@ SQLITE_API int sqlite3_status(int op, int *pCurrent, int *pHighwater, int resetF
 ** ^(<dt>SQLITE_STATUS_PARSER_STACK</dt>
 ** <dd>This parameter records the deepest parser stack.  It is only
 ** meaningful if SQLite is compiled with [YYTRACKMAXSTACKDEPTH].</dd>)^
+**
+** ^(<dt>SQLITE_STATUS_WALCACHE_USED</dt>
+** <dd>This parameter returns the number of bytes of memory used by the
+** shared WAL page cache configured using [SQLITE_CONFIG_WALCACHE].</dd>)^
 ** </dl>
 **
 ** New status parameters may be added from time to time.
@@ -6082,6 +6293,7 @@ SQLITE_API int sqlite3_status(int op, int *pCurrent, int *pHighwater, int resetF
 #define SQLITE_STATUS_PAGECACHE_SIZE       7
 #define SQLITE_STATUS_SCRATCH_SIZE         8
 #define SQLITE_STATUS_MALLOC_COUNT         9
+#define SQLITE_STATUS_WALCACHE_USED       10
 
 /*
 ** CAPI3REF: Database Connection Status
@@ -6162,7 +6374,46 @@ SQLITE_API int sqlite3_db_status(sqlite3*, int op, int *pCur, int *pHiwtr, int r
 ** and lookaside memory used by all prepared statements associated with
 ** the database connection.)^
 ** ^The highwater mark associated with SQLITE_DBSTATUS_STMT_USED is always 0.
+**
+** ^(<dt>SQLITE_DBSTATUS_WAL_SIZE</dt>
+** <dd>This parameter returns the number of frames in the [write-ahead log]
+** of the database most recently written by a transaction committed using
+** the database connection.)^  ^The highwater mark is the largest size seen.
+**
+** ^(<dt>SQLITE_DBSTATUS_CKPT_LAG</dt>
+** <dd>This parameter returns the number of frames in that write-ahead log
+** that had not yet been copied into the database file by a [checkpoint]
+** when the transaction was committed.)^  ^The highwater mark is the largest
+** lag seen.
+**
+** ^(<dt>SQLITE_DBSTATUS_CKPT_STALL</dt>
+** <dd>This parameter returns the number of milliseconds that the most
+** recent commit spent in the [sqlite3_wal_hook()] callback after the
+** transaction was written to the log.  This includes any checkpoint run
+** by [sqlite3_wal_autocheckpoint()].)^  ^The highwater mark is the longest
+** such stall.
 ** </dd>
+**
+** ^(<dt>SQLITE_DBSTATUS_STMTCACHE_HIT</dt>
+** <dd>This parameter returns the number of [chromium_sqlite3_prepare()] calls
+** with the [CHROMIUM_SQLITE_PREPARE_CACHED] flag that returned a statement
+** from the [statement cache] instead of compiling the SQL.
+** Only the high-water value is meaningful;
+** the current value is always zero.)^
+**
+** ^(<dt>SQLITE_DBSTATUS_STMTCACHE_MISS</dt>
+** <dd>This parameter returns the number of [chromium_sqlite3_prepare()] calls
+** with the [CHROMIUM_SQLITE_PREPARE_CACHED] flag that compiled a new statement.
+** Only the high-water value is meaningful;
+** the current value is always zero.)^
+**
+** ^(<dt>SQLITE_DBSTATUS_STMTCACHE_SAVED</dt>
+** <dd>This parameter returns an estimate of the number of microseconds of
+** SQL compilation avoided by the [statement cache].  Each hit counts the
+** average time taken by the compilations counted by
+** SQLITE_DBSTATUS_STMTCACHE_MISS, measured using the clock of the [VFS].
+** Only the high-water value is meaningful;
+** the current value is always zero.)^
 ** </dl>
 */
 #define SQLITE_DBSTATUS_LOOKASIDE_USED       0
@@ -6173,6 +6424,12 @@ SQLITE_API int sqlite3_db_status(sqlite3*, int op, int *pCur, int *pHiwtr, int r
 #define SQLITE_DBSTATUS_LOOKASIDE_MISS_SIZE  5
 #define SQLITE_DBSTATUS_LOOKASIDE_MISS_FULL  6
 #define SQLITE_DBSTATUS_MAX                  6   /* Largest defined DBSTATUS */
+#define SQLITE_DBSTATUS_WAL_SIZE          1000
+#define SQLITE_DBSTATUS_CKPT_LAG          1001
+#define SQLITE_DBSTATUS_CKPT_STALL        1002
+#define SQLITE_DBSTATUS_STMTCACHE_HIT     1003
+#define SQLITE_DBSTATUS_STMTCACHE_MISS    1004
+#define SQLITE_DBSTATUS_STMTCACHE_SAVED   1005
 
 
 /*
@@ -6827,6 +7084,44 @@ SQLITE_API void *sqlite3_wal_hook(
 */
 SQLITE_API int sqlite3_wal_autocheckpoint(sqlite3 *db, int N);
 
+/*
+** CAPI3REF: Configure a background checkpoint
+**
+** ^The [sqlite3_wal_background_checkpoint(D,N,B)] interface is a wrapper
+** around [sqlite3_wal_hook()] that causes any database on
+** [database connection] D to be [checkpointed] by a worker thread
+** after committing a transaction if there are N or more frames in the
+** [write-ahead log] file.  ^The commit returns without waiting for the
+** checkpoint.  ^Passing zero or a negative value as N disables automatic
+** checkpoints entirely.
+**
+** ^The worker thread runs the checkpoint using its own connection to the
+** database file, as a series of [SQLITE_CHECKPOINT_PASSIVE | passive]
+** checkpoints that each copy at most B frames into the database file.
+** ^If B is zero or negative, [SQLITE_DEFAULT_CHECKPOINT_BATCH] (100)
+** frames are copied at a time.  ^The worker never waits for readers; it
+** stops when the whole log has been copied or when readers prevent it
+** from making progress, and resumes after the next commit that finds
+** N or more frames in the log.
+**
+** ^Worker threads are only available in [threadsafe] builds on unix.
+** ^Otherwise, for databases in [locking_mode | EXCLUSIVE locking mode],
+** or if the worker thread cannot be started, the checkpoint is run
+** before the commit returns, as if by [sqlite3_wal_autocheckpoint()].
+**
+** ^The callback registered by this function replaces any existing callback
+** registered using [sqlite3_wal_hook()] or [sqlite3_wal_autocheckpoint()].
+** ^Replacing the callback, or closing the database connection, stops the
+** worker thread after any checkpoint step in progress has finished.
+**
+** ^The [wal_background_checkpoint pragma] can be used to invoke this
+** interface from SQL.  ^The size of the log, the number of frames not yet
+** checkpointed and the time spent by commits in checkpoints are reported
+** by [sqlite3_db_status()] with [SQLITE_DBSTATUS_WAL_SIZE],
+** [SQLITE_DBSTATUS_CKPT_LAG] and [SQLITE_DBSTATUS_CKPT_STALL].
+*/
+SQLITE_API int sqlite3_wal_background_checkpoint(sqlite3 *db, int N, int B);
+
 /*
 ** CAPI3REF: Checkpoint a database
 **
@@ -7603,6 +7898,8 @@ typedef struct RowSet RowSet;
 typedef struct Savepoint Savepoint;
 typedef struct Select Select;
 typedef struct SrcList SrcList;
+typedef struct StmtCache StmtCache;
+typedef struct StmtProfiler StmtProfiler;
 typedef struct StrAccum StrAccum;
 typedef struct Table Table;
 typedef struct TableLock TableLock;
@@ -7689,6 +7986,7 @@ SQLITE_PRIVATE int sqlite3BtreeOpen(
 
 SQLITE_PRIVATE int sqlite3BtreeClose(Btree*);
 SQLITE_PRIVATE int sqlite3BtreeSetCacheSize(Btree*,int);
+SQLITE_PRIVATE int sqlite3BtreeSetMmapLimit(Btree*,sqlite3_int64);
 SQLITE_PRIVATE int sqlite3BtreeSetSafetyLevel(Btree*,int,int,int);
 SQLITE_PRIVATE int sqlite3BtreeSyncDisabled(Btree*);
 SQLITE_PRIVATE int sqlite3BtreeSetPageSize(Btree *p, int nPagesize, int nReserve, int eFix);
@@ -7800,9 +8098,11 @@ SQLITE_PRIVATE sqlite3_int64 sqlite3BtreeGetCachedRowid(BtCursor*);
 
 SQLITE_PRIVATE char *sqlite3BtreeIntegrityCheck(Btree*, int *aRoot, int nRoot, int, int*);
 SQLITE_PRIVATE struct Pager *sqlite3BtreePager(Btree*);
+SQLITE_PRIVATE u32 sqlite3BtreeSeekCount(Btree*);
 
 SQLITE_PRIVATE int sqlite3BtreePutData(BtCursor*, u32 offset, u32 amt, void*);
 SQLITE_PRIVATE void sqlite3BtreeCacheOverflow(BtCursor *);
+SQLITE_PRIVATE void sqlite3BtreeCursorBulkLoad(BtCursor*, int nFill);
 SQLITE_PRIVATE void sqlite3BtreeClearCursor(BtCursor *);
 
 SQLITE_PRIVATE int sqlite3BtreeSetVersion(Btree *pBt, int iVersion);
@@ -8101,84 +8401,86 @@ typedef struct VdbeOpList VdbeOpList;
 #define OP_OpenWrite                           39
 #define OP_OpenAutoindex                       40
 #define OP_OpenEphemeral                       41
-#define OP_OpenPseudo                          42
-#define OP_Close                               43
-#define OP_SeekLt                              44
-#define OP_SeekLe                              45
-#define OP_SeekGe                              46
-#define OP_SeekGt                              47
-#define OP_Seek                                48
-#define OP_NotFound                            49
-#define OP_Found                               50
-#define OP_IsUnique                            51
-#define OP_NotExists                           52
-#define OP_Sequence                            53
-#define OP_NewRowid                            54
-#define OP_Insert                              55
-#define OP_InsertInt                           56
-#define OP_Delete                              57
-#define OP_ResetCount                          58
-#define OP_RowKey                              59
-#define OP_RowData                             60
-#define OP_Rowid                               61
-#define OP_NullRow                             62
-#define OP_Last                                63
-#define OP_Sort                                64
-#define OP_Rewind                              65
-#define OP_Prev                                66
-#define OP_Next                                67
-#define OP_IdxInsert                           70
-#define OP_IdxDelete                           71
-#define OP_IdxRowid                            72
-#define OP_IdxLT                               81
-#define OP_IdxGE                               92
-#define OP_Destroy                             95
-#define OP_Clear                               96
-#define OP_CreateIndex                         97
-#define OP_CreateTable                         98
-#define OP_ParseSchema                         99
-#define OP_LoadAnalysis                       100
-#define OP_DropTable                          101
-#define OP_DropIndex                          102
-#define OP_DropTrigger                        103
-#define OP_IntegrityCk                        104
-#define OP_RowSetAdd                          105
-#define OP_RowSetRead                         106
-#define OP_RowSetTest                         107
-#define OP_Program                            108
-#define OP_Param                              109
-#define OP_FkCounter                          110
-#define OP_FkIfZero                           111
-#define OP_MemMax                             112
-#define OP_IfPos                              113
-#define OP_IfNeg                              114
-#define OP_IfZero                             115
-#define OP_AggStep                            116
-#define OP_AggFinal                           117
-#define OP_Checkpoint                         118
-#define OP_JournalMode                        119
-#define OP_Vacuum                             120
-#define OP_IncrVacuum                         121
-#define OP_Expire                             122
-#define OP_TableLock                          123
-#define OP_VBegin                             124
-#define OP_VCreate                            125
-#define OP_VDestroy                           126
-#define OP_VOpen                              127
-#define OP_VFilter                            128
-#define OP_VColumn                            129
-#define OP_VNext                              131
-#define OP_VRename                            132
-#define OP_VUpdate                            133
-#define OP_Pagecount                          134
-#define OP_MaxPgcnt                           135
-#define OP_Trace                              136
-#define OP_Noop                               137
-#define OP_Explain                            138
-
-/* The following opcode values are never used */
-#define OP_NotUsed_139                        139
-#define OP_NotUsed_140                        140
+#define OP_SorterOpen                          42
+#define OP_OpenPseudo                          43
+#define OP_Close                               44
+#define OP_SeekLt                              45
+#define OP_SeekLe                              46
+#define OP_SeekGe                              47
+#define OP_SeekGt                              48
+#define OP_Seek                                49
+#define OP_NotFound                            50
+#define OP_Found                               51
+#define OP_SorterCompare                       52
+#define OP_IsUnique                            53
+#define OP_NotExists                           54
+#define OP_Sequence                            55
+#define OP_NewRowid                            56
+#define OP_Insert                              57
+#define OP_InsertInt                           58
+#define OP_Delete                              59
+#define OP_ResetCount                          60
+#define OP_RowKey                              61
+#define OP_RowData                             62
+#define OP_SorterData                          63
+#define OP_Rowid                               64
+#define OP_NullRow                             65
+#define OP_Last                                66
+#define OP_SorterSort                          67
+#define OP_Sort                                70
+#define OP_Rewind                              71
+#define OP_Prev                                72
+#define OP_Next                                81
+#define OP_SorterNext                          92
+#define OP_IdxInsert                           95
+#define OP_SorterInsert                        96
+#define OP_IdxDelete                           97
+#define OP_IdxRowid                            98
+#define OP_IdxLT                               99
+#define OP_IdxGE                              100
+#define OP_Destroy                            101
+#define OP_Clear                              102
+#define OP_CreateIndex                        103
+#define OP_CreateTable                        104
+#define OP_ParseSchema                        105
+#define OP_LoadAnalysis                       106
+#define OP_DropTable                          107
+#define OP_DropIndex                          108
+#define OP_DropTrigger                        109
+#define OP_IntegrityCk                        110
+#define OP_RowSetAdd                          111
+#define OP_RowSetRead                         112
+#define OP_RowSetTest                         113
+#define OP_Program                            114
+#define OP_Param                              115
+#define OP_FkCounter                          116
+#define OP_FkIfZero                           117
+#define OP_MemMax                             118
+#define OP_IfPos                              119
+#define OP_IfNeg                              120
+#define OP_IfZero                             121
+#define OP_AggStep                            122
+#define OP_AggFinal                           123
+#define OP_Checkpoint                         124
+#define OP_JournalMode                        125
+#define OP_Vacuum                             126
+#define OP_IncrVacuum                         127
+#define OP_Expire                             128
+#define OP_TableLock                          129
+#define OP_VBegin                             131
+#define OP_VCreate                            132
+#define OP_VDestroy                           133
+#define OP_VOpen                              134
+#define OP_VFilter                            135
+#define OP_VColumn                            136
+#define OP_VNext                              137
+#define OP_VRename                            138
+#define OP_VUpdate                            139
+#define OP_Pagecount                          140
+#define OP_MaxPgcnt                           146
+#define OP_Trace                              147
+#define OP_Noop                               148
+#define OP_Explain                            149
 
 
 /* Properties such as "out2" or "jump" that are specified in
@@ -8198,20 +8500,20 @@ typedef struct VdbeOpList VdbeOpList;
 /*  16 */ 0x00, 0x00, 0x00, 0x24, 0x04, 0x05, 0x04, 0x00,\
 /*  24 */ 0x00, 0x01, 0x05, 0x05, 0x00, 0x00, 0x00, 0x02,\
 /*  32 */ 0x00, 0x00, 0x00, 0x02, 0x10, 0x00, 0x00, 0x00,\
-/*  40 */ 0x00, 0x00, 0x00, 0x00, 0x11, 0x11, 0x11, 0x11,\
-/*  48 */ 0x08, 0x11, 0x11, 0x11, 0x11, 0x02, 0x02, 0x00,\
-/*  56 */ 0x00, 0x00, 0x00, 0x00, 0x00, 0x02, 0x00, 0x01,\
-/*  64 */ 0x01, 0x01, 0x01, 0x01, 0x4c, 0x4c, 0x08, 0x00,\
-/*  72 */ 0x02, 0x05, 0x05, 0x15, 0x15, 0x15, 0x15, 0x15,\
+/*  40 */ 0x00, 0x00, 0x00, 0x00, 0x00, 0x11, 0x11, 0x11,\
+/*  48 */ 0x11, 0x08, 0x11, 0x11, 0x11, 0x11, 0x11, 0x02,\
+/*  56 */ 0x02, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,\
+/*  64 */ 0x02, 0x00, 0x01, 0x01, 0x4c, 0x4c, 0x01, 0x01,\
+/*  72 */ 0x01, 0x05, 0x05, 0x15, 0x15, 0x15, 0x15, 0x15,\
 /*  80 */ 0x15, 0x01, 0x4c, 0x4c, 0x4c, 0x4c, 0x4c, 0x4c,\
-/*  88 */ 0x4c, 0x4c, 0x4c, 0x4c, 0x01, 0x24, 0x02, 0x02,\
-/*  96 */ 0x00, 0x02, 0x02, 0x00, 0x00, 0x00, 0x00, 0x00,\
-/* 104 */ 0x00, 0x0c, 0x45, 0x15, 0x01, 0x02, 0x00, 0x01,\
-/* 112 */ 0x08, 0x05, 0x05, 0x05, 0x00, 0x00, 0x00, 0x02,\
-/* 120 */ 0x00, 0x01, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,\
-/* 128 */ 0x01, 0x00, 0x02, 0x01, 0x00, 0x00, 0x02, 0x02,\
-/* 136 */ 0x00, 0x00, 0x00, 0x00, 0x00, 0x04, 0x04, 0x04,\
-/* 144 */ 0x04, 0x04,}
+/*  88 */ 0x4c, 0x4c, 0x4c, 0x4c, 0x01, 0x24, 0x02, 0x08,\
+/*  96 */ 0x08, 0x00, 0x02, 0x01, 0x01, 0x02, 0x00, 0x02,\
+/* 104 */ 0x02, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x0c,\
+/* 112 */ 0x45, 0x15, 0x01, 0x02, 0x00, 0x01, 0x08, 0x05,\
+/* 120 */ 0x05, 0x05, 0x00, 0x00, 0x00, 0x02, 0x00, 0x01,\
+/* 128 */ 0x00, 0x00, 0x02, 0x00, 0x00, 0x00, 0x00, 0x01,\
+/* 136 */ 0x00, 0x01, 0x00, 0x00, 0x02, 0x04, 0x04, 0x04,\
+/* 144 */ 0x04, 0x04, 0x02, 0x00, 0x00, 0x00,}
 
 /************** End of opcodes.h *********************************************/
 /************** Continuing where we left off in vdbe.h ***********************/
@@ -8257,6 +8559,10 @@ SQLITE_PRIVATE void sqlite3VdbeCountChanges(Vdbe*);
 SQLITE_PRIVATE sqlite3 *sqlite3VdbeDb(Vdbe*);
 SQLITE_PRIVATE void sqlite3VdbeSetSql(Vdbe*, const char *z, int n, int);
 SQLITE_PRIVATE void sqlite3VdbeSwap(Vdbe*,Vdbe*);
+SQLITE_PRIVATE void sqlite3VdbeSetCached(Vdbe*);
+SQLITE_PRIVATE Vdbe *sqlite3VdbeCacheFind(sqlite3*, const char*, int, const char**);
+SQLITE_PRIVATE void sqlite3VdbeCacheTrim(sqlite3*, int);
+SQLITE_PRIVATE int sqlite3VdbeCacheRelease(Vdbe*);
 SQLITE_PRIVATE VdbeOp *sqlite3VdbeTakeOpArray(Vdbe*, int*, int*);
 SQLITE_PRIVATE sqlite3_value *sqlite3VdbeGetValue(Vdbe*, int, u8);
 SQLITE_PRIVATE void sqlite3VdbeSetVarmask(Vdbe*, int);
@@ -8268,6 +8574,9 @@ SQLITE_PRIVATE UnpackedRecord *sqlite3VdbeRecordUnpack(KeyInfo*,int,const void*,
 SQLITE_PRIVATE void sqlite3VdbeDeleteUnpackedRecord(UnpackedRecord*);
 SQLITE_PRIVATE int sqlite3VdbeRecordCompare(int,const void*,UnpackedRecord*);
 
+typedef int (*RecordCompare)(int,const void*,UnpackedRecord*);
+SQLITE_PRIVATE RecordCompare sqlite3VdbeFindCompare(UnpackedRecord*);
+
 #ifndef SQLITE_OMIT_TRIGGER
 SQLITE_PRIVATE void sqlite3VdbeLinkSubProgram(Vdbe *, SubProgram *);
 #endif
@@ -8370,6 +8679,20 @@ typedef struct PgHdr DbPage;
 #define PAGER_JOURNALMODE_MEMORY      4   /* In-memory journal file */
 #define PAGER_JOURNALMODE_WAL         5   /* Use write-ahead logging */
 
+/*
+** Flags that make up the mask passed to sqlite3PagerAcquire().
+*/
+#define PAGER_ACQUIRE_NOCONTENT     0x01  /* Do not load data from disk */
+#define PAGER_ACQUIRE_READONLY      0x02  /* Read-only page is acceptable */
+
+/*
+** Values that may be passed as the second argument to
+** sqlite3PagerCacheStat().
+*/
+#define PAGER_STAT_HIT    0
+#define PAGER_STAT_MISS   1
+#define PAGER_STAT_READ   2
+
 /*
 ** The remainder of this file contains the declarations of the functions
 ** that make up the Pager sub-system API. See source code comments for 
@@ -8394,6 +8717,7 @@ SQLITE_PRIVATE void sqlite3PagerSetBusyhandler(Pager*, int(*)(void *), void *);
 SQLITE_PRIVATE int sqlite3PagerSetPagesize(Pager*, u32*, int);
 SQLITE_PRIVATE int sqlite3PagerMaxPageCount(Pager*, int);
 SQLITE_PRIVATE void sqlite3PagerSetCachesize(Pager*, int);
+SQLITE_PRIVATE void sqlite3PagerSetMmapLimit(Pager*, sqlite3_int64);
 SQLITE_PRIVATE void sqlite3PagerSetSafetyLevel(Pager*,int,int,int);
 SQLITE_PRIVATE int sqlite3PagerLockingMode(Pager *, int);
 SQLITE_PRIVATE int sqlite3PagerSetJournalMode(Pager *, int);
@@ -8403,7 +8727,7 @@ SQLITE_PRIVATE i64 sqlite3PagerJournalSizeLimit(Pager *, i64);
 SQLITE_PRIVATE sqlite3_backup **sqlite3PagerBackupPtr(Pager*);
 
 /* Functions used to obtain and release page references. */ 
-SQLITE_PRIVATE int sqlite3PagerAcquire(Pager *pPager, Pgno pgno, DbPage **ppPage, int clrFlag);
+SQLITE_PRIVATE int sqlite3PagerAcquire(Pager *pPager, Pgno pgno, DbPage **ppPage, int flags);
 #define sqlite3PagerGet(A,B,C) sqlite3PagerAcquire(A,B,C,0)
 SQLITE_PRIVATE DbPage *sqlite3PagerLookup(Pager *pPager, Pgno pgno);
 SQLITE_PRIVATE void sqlite3PagerRef(DbPage*);
@@ -8430,8 +8754,10 @@ SQLITE_PRIVATE int sqlite3PagerSavepoint(Pager *pPager, int op, int iSavepoint);
 SQLITE_PRIVATE int sqlite3PagerSharedLock(Pager *pPager);
 
 SQLITE_PRIVATE int sqlite3PagerCheckpoint(Pager *pPager, int, int*, int*);
+SQLITE_PRIVATE void sqlite3PagerCheckpointBatch(Pager *pPager, int);
 SQLITE_PRIVATE int sqlite3PagerWalSupported(Pager *pPager);
 SQLITE_PRIVATE int sqlite3PagerWalCallback(Pager *pPager);
+SQLITE_PRIVATE int sqlite3PagerWalBacklog(Pager *pPager);
 SQLITE_PRIVATE int sqlite3PagerOpenWal(Pager *pPager, int *pisOpen);
 SQLITE_PRIVATE int sqlite3PagerCloseWal(Pager *pPager);
 
@@ -8446,6 +8772,7 @@ SQLITE_PRIVATE const char *sqlite3PagerJournalname(Pager*);
 SQLITE_PRIVATE int sqlite3PagerNosync(Pager*);
 SQLITE_PRIVATE void *sqlite3PagerTempSpace(Pager*);
 SQLITE_PRIVATE int sqlite3PagerIsMemdb(Pager*);
+SQLITE_PRIVATE u32 sqlite3PagerCacheStat(Pager*, int);
 
 /* Functions used to truncate the database file. */
 SQLITE_PRIVATE void sqlite3PagerTruncateImage(Pager*,Pgno);
@@ -8528,6 +8855,9 @@ struct PgHdr {
 #define PGHDR_NEED_READ         0x008  /* Content is unread */
 #define PGHDR_REUSE_UNLIKELY    0x010  /* A hint that reuse is unlikely */
 #define PGHDR_DONT_WRITE        0x020  /* Do not write content to disk */
+#define PGHDR_MMAP              0x040  /* This is an mmap page object */
+#define PGHDR_SHARED            0x080  /* Content is from the shared WAL
+                                       ** page cache (also sets PGHDR_MMAP) */
 
 /* Initialize and shutdown the page cache subsystem */
 SQLITE_PRIVATE int sqlite3PcacheInitialize(void);
@@ -8889,6 +9219,8 @@ SQLITE_PRIVATE int sqlite3OsShmMap(sqlite3_file *,int,int,int,void volatile **);
 SQLITE_PRIVATE int sqlite3OsShmLock(sqlite3_file *id, int, int, int);
 SQLITE_PRIVATE void sqlite3OsShmBarrier(sqlite3_file *id);
 SQLITE_PRIVATE int sqlite3OsShmUnmap(sqlite3_file *id, int);
+SQLITE_PRIVATE int sqlite3OsFetch(sqlite3_file *id, i64, int, void **);
+SQLITE_PRIVATE int sqlite3OsUnfetch(sqlite3_file *, i64, void *);
 
 /* 
 ** Functions for accessing sqlite3_vfs methods 
@@ -9069,7 +9401,7 @@ struct Schema {
 ** The number of different kinds of things that can be limited
 ** using the sqlite3_limit() interface.
 */
-#define SQLITE_N_LIMIT (SQLITE_LIMIT_TRIGGER_DEPTH+1)
+#define SQLITE_N_LIMIT (SQLITE_LIMIT_WORKER_THREADS+1)
 
 /*
 ** Lookaside malloc is a set of fixed-size buffers that can be used
@@ -9106,6 +9438,29 @@ struct LookasideSlot {
   LookasideSlot *pNext;    /* Next buffer in the list of free buffers */
 };
 
+/*
+** The StmtCache structure holds the statements prepared with the
+** CHROMIUM_SQLITE_PREPARE_CACHED flag that the application has finalized, so
+** that a later chromium_sqlite3_prepare() of the same SQL text can return one
+** of them instead of compiling the SQL again.  The idle statements are linked
+** by Vdbe.pCacheNext and Vdbe.pCachePrev, most recently used first.
+**
+** The time spent compiling statements for the cache is measured with the
+** millisecond VFS clock.  Each hit adds the average compile time so far to
+** iSaved, the estimate reported by SQLITE_DBSTATUS_STMTCACHE_SAVED.
+*/
+struct StmtCache {
+  int nMax;               /* Maximum number of idle statements to keep */
+  int nStmt;              /* Number of idle statements in the list */
+  Vdbe *pFirst;           /* Most recently used idle statement */
+  Vdbe *pLast;            /* Least recently used idle statement */
+  int nHit;               /* Prepares satisfied from the cache */
+  int nMiss;              /* Prepares that compiled a new statement */
+  int nCompile;           /* Number of compilations timed in iCompileTime */
+  i64 iCompileTime;       /* Total time spent compiling, in ms */
+  i64 iSaved;             /* Estimated compile time saved, in us */
+};
+
 /*
 ** A hash table for function definitions.
 **
@@ -9157,6 +9512,8 @@ struct sqlite3 {
   signed char nextAutovac;      /* Autovac setting after VACUUM if >=0 */
   u8 suppressErr;               /* Do not issue error messages if true */
   int nextPagesize;             /* Pagesize after VACUUM if >0 */
+  i64 szMmap;                   /* Default mmap_size setting */
+  u8 nBulkFill;                 /* Fill factor for PRAGMA bulk_load, or 0 */
   int nTable;                   /* Number of tables in the database */
   CollSeq *pDfltColl;           /* The default collating sequence (BINARY) */
   i64 lastRowid;                /* ROWID of most recent insert (see above) */
@@ -9190,6 +9547,7 @@ struct sqlite3 {
 #ifndef SQLITE_OMIT_WAL
   int (*xWalCallback)(void *, sqlite3 *, const char *, int);
   void *pWalArg;
+  int aWalStat[3][2];           /* WAL_SIZE, CKPT_LAG and CKPT_STALL status */
 #endif
   void(*xCollNeeded)(void*,sqlite3*,int eTextRep,const char*);
   void(*xCollNeeded16)(void*,sqlite3*,int eTextRep,const void*);
@@ -9202,6 +9560,11 @@ struct sqlite3 {
     double notUsed1;            /* Spacer */
   } u1;
   Lookaside lookaside;          /* Lookaside malloc configuration */
+  StmtCache stmtCache;          /* Idle cached statements */
+#ifndef SQLITE_OMIT_STMT_PROFILE
+  int nStmtProfile;             /* Value of PRAGMA stmt_profile */
+  StmtProfiler *pStmtProfiler;  /* Statement profiles, or NULL */
+#endif
 #ifndef SQLITE_OMIT_AUTHORIZATION
   int (*xAuth)(void*,int,const char*,const char*,const char*,const char*);
                                 /* Access authorization function */
@@ -10402,6 +10765,7 @@ struct Select {
 #define SF_UsesEphemeral   0x0008  /* Uses the OpenEphemeral opcode */
 #define SF_Expanded        0x0010  /* sqlite3SelectExpand() called on this */
 #define SF_HasTypeInfo     0x0020  /* FROM subqueries have Table metadata */
+#define SF_UseSorter       0x0040  /* Sort using a sorter */
 
 
 /*
@@ -10782,6 +11146,10 @@ struct Sqlite3Config {
   int nPage;                        /* Number of pages in pPage[] */
   int mxParserStack;                /* maximum depth of the parser stack */
   int sharedCacheEnabled;           /* true if shared-cache mode enabled */
+  sqlite3_int64 szMmap;             /* mmap() space per open file */
+  sqlite3_int64 mxMmap;             /* Maximum value for szMmap */
+  u32 szPma;                        /* Minimum sorter PMA size, in pages */
+  sqlite3_int64 szWalCache;         /* Shared WAL page cache budget, in bytes */
   /* The above might be initialized to non-zero.  The following need to always
   ** initially be zero, however. */
   int isInit;                       /* True after initialization has finished */
@@ -10966,6 +11334,19 @@ SQLITE_PRIVATE int sqlite3StatusValue(int);
 SQLITE_PRIVATE void sqlite3StatusAdd(int, int);
 SQLITE_PRIVATE void sqlite3StatusSet(int, int);
 
+#ifndef SQLITE_OMIT_WAL
+SQLITE_PRIVATE   int sqlite3WalCacheInitialize(void);
+SQLITE_PRIVATE   void sqlite3WalCacheShutdown(void);
+#else
+# define sqlite3WalCacheInitialize() SQLITE_OK
+# define sqlite3WalCacheShutdown()
+#endif
+#if defined(SQLITE_ENABLE_MEMORY_MANAGEMENT) && !defined(SQLITE_OMIT_WAL)
+SQLITE_PRIVATE   int sqlite3WalCacheReleaseMemory(int);
+#else
+# define sqlite3WalCacheReleaseMemory(X) 0
+#endif
+
 #ifndef SQLITE_OMIT_FLOATING_POINT
 SQLITE_PRIVATE   int sqlite3IsNaN(double);
 #else
@@ -11429,6 +11810,18 @@ SQLITE_PRIVATE VTable *sqlite3GetVTable(sqlite3*, Table*);
 SQLITE_PRIVATE const char *sqlite3JournalModename(int);
 SQLITE_PRIVATE int sqlite3Checkpoint(sqlite3*, int, int, int*, int*);
 SQLITE_PRIVATE int sqlite3WalDefaultHook(void*,sqlite3*,const char*,int);
+SQLITE_PRIVATE void *sqlite3WalCkptCreate(sqlite3*,int,int);
+SQLITE_PRIVATE void sqlite3WalCkptDestroy(void*);
+SQLITE_PRIVATE int sqlite3WalCkptFrames(void*);
+SQLITE_PRIVATE int sqlite3WalCkptHook(void*,sqlite3*,const char*,int);
+#ifndef SQLITE_OMIT_STMT_PROFILE
+SQLITE_PRIVATE   void sqlite3StmtProfileClose(sqlite3*);
+# ifndef SQLITE_OMIT_VIRTUALTABLE
+SQLITE_PRIVATE   int sqlite3StmtProfileInit(sqlite3*);
+# endif
+#else
+# define sqlite3StmtProfileClose(X)
+#endif
 
 /* Declarations for functions in fkey.c. All of these are replaced by
 ** no-op macros if OMIT_FOREIGN_KEY is defined. In this case no foreign
@@ -11739,6 +12132,10 @@ SQLITE_PRIVATE SQLITE_WSD struct Sqlite3Config sqlite3Config = {
    0,                         /* nPage */
    0,                         /* mxParserStack */
    0,                         /* sharedCacheEnabled */
+   SQLITE_DEFAULT_MMAP_SIZE,  /* szMmap */
+   SQLITE_MAX_MMAP_SIZE,      /* mxMmap */
+   SQLITE_SORTER_PMASZ,       /* szPma */
+   SQLITE_DEFAULT_WALCACHE_SIZE, /* szWalCache */
    /* All the rest should always be initialized to zero */
    0,                         /* isInit */
    0,                         /* inProgress */
@@ -12244,6 +12641,9 @@ typedef struct VdbeOp Op;
 */
 typedef unsigned char Bool;
 
+/* Opaque type used by code in vdbesort.c */
+typedef struct VdbeSorter VdbeSorter;
+
 /*
 ** A cursor is a pointer into a single BTree within a database file.
 ** The cursor can seek to a BTree entry with a particular key, or
@@ -12294,6 +12694,7 @@ struct VdbeCursor {
   u32 *aType;           /* Type values for all entries in the record */
   u32 *aOffset;         /* Cached offsets to the start of each columns data */
   u8 *aRow;             /* Data for the current row, if all on one page */
+  VdbeSorter *pSorter;  /* Sorter object for OP_SorterOpen cursors */
 };
 typedef struct VdbeCursor VdbeCursor;
 
@@ -12464,6 +12865,49 @@ struct sqlite3_context {
   CollSeq *pColl;       /* Collating sequence */
 };
 
+#ifndef SQLITE_OMIT_STMT_PROFILE
+/*
+** While PRAGMA stmt_profile is enabled, each run of a statement is timed
+** and counted in a VdbeProfile object (see vdbeprof.c).  When the
+** statement is reset, the totals are added to the profile kept for its
+** SQL text by the database connection.
+**
+** The aStat[] array is indexed by the VDBE_PROF_* values below.  The
+** aBase[] array holds the b-tree seek count and the page cache
+** statistics (VDBE_PROF_SEEK through VDBE_PROF_READ) of all attached
+** databases at the start of the current call to sqlite3VdbeExec().
+**
+** Instructions run by trigger sub-programs are counted in aStat[] and
+** charged to the OP_Program instruction of the main program in aOp[].
+*/
+#define VDBE_PROF_ROW        0    /* Rows returned */
+#define VDBE_PROF_STEP       1    /* VDBE instructions executed */
+#define VDBE_PROF_CYCLE      2    /* Clock ticks spent in the VDBE */
+#define VDBE_PROF_SEEK       3    /* B-tree searches */
+#define VDBE_PROF_HIT        4    /* Page cache hits */
+#define VDBE_PROF_MISS       5    /* Page cache misses */
+#define VDBE_PROF_READ       6    /* Bytes read from database and WAL files */
+#define VDBE_PROF_FULLSCAN   7    /* SQLITE_STMTSTATUS_FULLSCAN_STEP */
+#define VDBE_PROF_SORT       8    /* SQLITE_STMTSTATUS_SORT */
+#define VDBE_PROF_AUTOINDEX  9    /* SQLITE_STMTSTATUS_AUTOINDEX */
+#define VDBE_PROF_N          10
+
+typedef struct VdbeOpProfile VdbeOpProfile;
+struct VdbeOpProfile {
+  u64 nExec;              /* Number of times the instruction was executed */
+  u64 nCycle;             /* Clock ticks spent executing it */
+};
+
+typedef struct VdbeProfile VdbeProfile;
+struct VdbeProfile {
+  u64 aStat[VDBE_PROF_N]; /* Totals for the current run */
+  u32 aBase[4];           /* Seek and cache totals on entry to VdbeExec() */
+  int aCounter[3];        /* Vdbe.aCounter[] at the start of the run */
+  int nOp;                /* Number of entries in aOp[] */
+  VdbeOpProfile aOp[1];   /* One entry for each instruction (Vdbe.aOp[]) */
+};
+#endif /* SQLITE_OMIT_STMT_PROFILE */
+
 /*
 ** An instance of the virtual machine.  This structure contains the complete
 ** state of the virtual machine.
@@ -12515,17 +12959,24 @@ struct Vdbe {
   u8 usesStmtJournal;     /* True if uses a statement journal */
   u8 readOnly;            /* True for read-only statements */
   u8 isPrepareV2;         /* True if prepared with prepare_v2() */
+  u8 isCached;            /* True if prepared for the stmtCache */
+  u8 inStmtCache;         /* True while idle in the db->stmtCache list */
   int nChange;            /* Number of db changes made since last reset */
   yDbMask btreeMask;      /* Bitmask of db->aDb[] entries referenced */
   yDbMask lockMask;       /* Subset of btreeMask that requires a lock */
   int iStatement;         /* Statement number (or 0 if has not opened stmt) */
   int aCounter[3];        /* Counters used by sqlite3_stmt_status() */
+#ifndef SQLITE_OMIT_STMT_PROFILE
+  VdbeProfile *pProf;     /* Counters for PRAGMA stmt_profile, or NULL */
+#endif
 #ifndef SQLITE_OMIT_TRACE
   i64 startTime;          /* Time when query started - used for profiling */
 #endif
   i64 nFkConstraint;      /* Number of imm. FK constraints this VM */
   i64 nStmtDefCons;       /* Number of def. constraints when stmt started */
   char *zSql;             /* Text of the SQL statement that generated this */
+  Vdbe *pCacheNext;       /* Next (less recently used) idle cached statement */
+  Vdbe *pCachePrev;       /* Previous idle cached statement */
   void *pFree;            /* Free this when deleting the vdbe */
 #ifdef SQLITE_DEBUG
   FILE *trace;            /* Write an execution trace here, if not NULL */
@@ -12614,12 +13065,31 @@ SQLITE_PRIVATE   void sqlite3VdbeLeave(Vdbe*);
 SQLITE_PRIVATE void sqlite3VdbeMemPrepareToChange(Vdbe*,Mem*);
 #endif
 
+#ifndef SQLITE_OMIT_STMT_PROFILE
+SQLITE_PRIVATE void sqlite3VdbeProfileBegin(Vdbe*);
+SQLITE_PRIVATE void sqlite3VdbeProfileEnter(Vdbe*);
+SQLITE_PRIVATE void sqlite3VdbeProfileLeave(Vdbe*, int);
+SQLITE_PRIVATE void sqlite3VdbeProfileEnd(Vdbe*);
+#endif
+
 #ifndef SQLITE_OMIT_FOREIGN_KEY
 SQLITE_PRIVATE int sqlite3VdbeCheckFk(Vdbe *, int);
 #else
 # define sqlite3VdbeCheckFk(p,i) 0
 #endif
 
+#ifndef SQLITE_OMIT_MERGE_SORT
+SQLITE_PRIVATE int sqlite3VdbeSorterInit(sqlite3 *, VdbeCursor *);
+SQLITE_PRIVATE void sqlite3VdbeSorterClose(sqlite3 *, VdbeCursor *);
+SQLITE_PRIVATE int sqlite3VdbeSorterWrite(sqlite3 *, const VdbeCursor *, Mem *);
+SQLITE_PRIVATE int sqlite3VdbeSorterRewind(sqlite3 *, const VdbeCursor *, int *);
+SQLITE_PRIVATE int sqlite3VdbeSorterNext(sqlite3 *, const VdbeCursor *, int *);
+SQLITE_PRIVATE int sqlite3VdbeSorterRowkey(const VdbeCursor *, Mem *);
+SQLITE_PRIVATE int sqlite3VdbeSorterCompare(const VdbeCursor *, Mem *, int *);
+#else
+# define sqlite3VdbeSorterClose(Y,Z)
+#endif
+
 SQLITE_PRIVATE int sqlite3VdbeMemTranslate(Mem*, u8);
 #ifdef SQLITE_DEBUG
 SQLITE_PRIVATE   void sqlite3VdbePrintSql(Vdbe*);
@@ -12643,8 +13113,8 @@ SQLITE_PRIVATE   int sqlite3VdbeMemExpandBlob(Mem *);
 */
 typedef struct sqlite3StatType sqlite3StatType;
 static SQLITE_WSD struct sqlite3StatType {
-  int nowValue[10];         /* Current value */
-  int mxValue[10];          /* Maximum value */
+  int nowValue[11];         /* Current value */
+  int mxValue[11];          /* Maximum value */
 } sqlite3Stat = { {0,}, {0,} };
 
 
@@ -12754,6 +13224,60 @@ SQLITE_API int sqlite3_db_status(
       break;
     }
 
+    /*
+    ** The WAL statistics are updated by doWalCallbacks() each time a
+    ** transaction is committed to a WAL database.
+    */
+    case SQLITE_DBSTATUS_WAL_SIZE:
+    case SQLITE_DBSTATUS_CKPT_LAG:
+    case SQLITE_DBSTATUS_CKPT_STALL: {
+#ifndef SQLITE_OMIT_WAL
+      int *aStat = db->aWalStat[op - SQLITE_DBSTATUS_WAL_SIZE];
+      testcase( op==SQLITE_DBSTATUS_WAL_SIZE );
+      testcase( op==SQLITE_DBSTATUS_CKPT_LAG );
+      testcase( op==SQLITE_DBSTATUS_CKPT_STALL );
+      assert( (op-SQLITE_DBSTATUS_WAL_SIZE)<ArraySize(db->aWalStat) );
+      *pCurrent = aStat[0];
+      *pHighwater = aStat[1];
+      if( resetFlag ){
+        aStat[1] = aStat[0];
+      }
+#else
+      *pCurrent = 0;
+      *pHighwater = 0;
+#endif
+      break;
+    }
+
+    /*
+    ** Statement cache counters, updated by chromium_sqlite3_prepare() when
+    ** it is called with the CHROMIUM_SQLITE_PREPARE_CACHED flag.
+    */
+    case SQLITE_DBSTATUS_STMTCACHE_HIT:
+    case SQLITE_DBSTATUS_STMTCACHE_MISS: {
+      StmtCache *pCache = &db->stmtCache;
+      int *pCount;
+      testcase( op==SQLITE_DBSTATUS_STMTCACHE_HIT );
+      testcase( op==SQLITE_DBSTATUS_STMTCACHE_MISS );
+      pCount = (op==SQLITE_DBSTATUS_STMTCACHE_HIT) ? &pCache->nHit
+                                                     : &pCache->nMiss;
+      *pCurrent = 0;
+      *pHighwater = *pCount;
+      if( resetFlag ){
+        *pCount = 0;
+      }
+      break;
+    }
+    case SQLITE_DBSTATUS_STMTCACHE_SAVED: {
+      i64 iSaved = db->stmtCache.iSaved;
+      *pCurrent = 0;
+      *pHighwater = iSaved>0x7fffffff ? 0x7fffffff : (int)iSaved;
+      if( resetFlag ){
+        db->stmtCache.iSaved = 0;
+      }
+      break;
+    }
+
     /* 
     ** Return an approximation for the amount of memory currently used
     ** by all pagers associated with the given database connection.  The
@@ -14063,6 +14587,26 @@ SQLITE_PRIVATE int sqlite3OsShmMap(
   return id->pMethods->xShmMap(id, iPage, pgsz, bExtend, pp);
 }
 
+#if SQLITE_MAX_MMAP_SIZE>0
+/* The real implementation of xFetch and xUnfetch */
+SQLITE_PRIVATE int sqlite3OsFetch(sqlite3_file *id, i64 iOff, int iAmt, void **pp){
+  DO_OS_MALLOC_TEST(id);
+  return id->pMethods->xFetch(id, iOff, iAmt, pp);
+}
+SQLITE_PRIVATE int sqlite3OsUnfetch(sqlite3_file *id, i64 iOff, void *p){
+  return id->pMethods->xUnfetch(id, iOff, p);
+}
+#else
+/* No-op stubs to use when memory-mapped I/O is disabled */
+SQLITE_PRIVATE int sqlite3OsFetch(sqlite3_file *id, i64 iOff, int iAmt, void **pp){
+  *pp = 0;
+  return SQLITE_OK;
+}
+SQLITE_PRIVATE int sqlite3OsUnfetch(sqlite3_file *id, i64 iOff, void *p){
+  return SQLITE_OK;
+}
+#endif
+
 /*
 ** The next group of routines are convenience wrappers around the
 ** VFS methods.
@@ -17727,7 +18271,11 @@ SQLITE_PRIVATE sqlite3_mutex_methods const *sqlite3DefaultMutex(void){
 */
 SQLITE_API int sqlite3_release_memory(int n){
 #ifdef SQLITE_ENABLE_MEMORY_MANAGEMENT
-  return sqlite3PcacheReleaseMemory(n);
+  int nFree = sqlite3PcacheReleaseMemory(n);
+  if( n<0 || nFree<n ){
+    nFree += sqlite3WalCacheReleaseMemory(n<0 ? -1 : n-nFree);
+  }
+  return nFree;
 #else
   /* IMPLEMENTATION-OF: R-34391-24921 The sqlite3_release_memory() routine
   ** is a no-op returning zero if SQLite is not compiled with
@@ -21695,37 +22243,37 @@ SQLITE_PRIVATE const char *sqlite3OpcodeName(int i){
      /*  39 */ "OpenWrite",
      /*  40 */ "OpenAutoindex",
      /*  41 */ "OpenEphemeral",
-     /*  42 */ "OpenPseudo",
-     /*  43 */ "Close",
-     /*  44 */ "SeekLt",
-     /*  45 */ "SeekLe",
-     /*  46 */ "SeekGe",
-     /*  47 */ "SeekGt",
-     /*  48 */ "Seek",
-     /*  49 */ "NotFound",
-     /*  50 */ "Found",
-     /*  51 */ "IsUnique",
-     /*  52 */ "NotExists",
-     /*  53 */ "Sequence",
-     /*  54 */ "NewRowid",
-     /*  55 */ "Insert",
-     /*  56 */ "InsertInt",
-     /*  57 */ "Delete",
-     /*  58 */ "ResetCount",
-     /*  59 */ "RowKey",
-     /*  60 */ "RowData",
-     /*  61 */ "Rowid",
-     /*  62 */ "NullRow",
-     /*  63 */ "Last",
-     /*  64 */ "Sort",
-     /*  65 */ "Rewind",
-     /*  66 */ "Prev",
-     /*  67 */ "Next",
+     /*  42 */ "SorterOpen",
+     /*  43 */ "OpenPseudo",
+     /*  44 */ "Close",
+     /*  45 */ "SeekLt",
+     /*  46 */ "SeekLe",
+     /*  47 */ "SeekGe",
+     /*  48 */ "SeekGt",
+     /*  49 */ "Seek",
+     /*  50 */ "NotFound",
+     /*  51 */ "Found",
+     /*  52 */ "SorterCompare",
+     /*  53 */ "IsUnique",
+     /*  54 */ "NotExists",
+     /*  55 */ "Sequence",
+     /*  56 */ "NewRowid",
+     /*  57 */ "Insert",
+     /*  58 */ "InsertInt",
+     /*  59 */ "Delete",
+     /*  60 */ "ResetCount",
+     /*  61 */ "RowKey",
+     /*  62 */ "RowData",
+     /*  63 */ "SorterData",
+     /*  64 */ "Rowid",
+     /*  65 */ "NullRow",
+     /*  66 */ "Last",
+     /*  67 */ "SorterSort",
      /*  68 */ "Or",
      /*  69 */ "And",
-     /*  70 */ "IdxInsert",
-     /*  71 */ "IdxDelete",
-     /*  72 */ "IdxRowid",
+     /*  70 */ "Sort",
+     /*  71 */ "Rewind",
+     /*  72 */ "Prev",
      /*  73 */ "IsNull",
      /*  74 */ "NotNull",
      /*  75 */ "Ne",
@@ -21734,7 +22282,7 @@ SQLITE_PRIVATE const char *sqlite3OpcodeName(int i){
      /*  78 */ "Le",
      /*  79 */ "Lt",
      /*  80 */ "Ge",
-     /*  81 */ "IdxLT",
+     /*  81 */ "Next",
      /*  82 */ "BitAnd",
      /*  83 */ "BitOr",
      /*  84 */ "ShiftLeft",
@@ -21745,60 +22293,64 @@ SQLITE_PRIVATE const char *sqlite3OpcodeName(int i){
      /*  89 */ "Divide",
      /*  90 */ "Remainder",
      /*  91 */ "Concat",
-     /*  92 */ "IdxGE",
+     /*  92 */ "SorterNext",
      /*  93 */ "BitNot",
      /*  94 */ "String8",
-     /*  95 */ "Destroy",
-     /*  96 */ "Clear",
-     /*  97 */ "CreateIndex",
-     /*  98 */ "CreateTable",
-     /*  99 */ "ParseSchema",
-     /* 100 */ "LoadAnalysis",
-     /* 101 */ "DropTable",
-     /* 102 */ "DropIndex",
-     /* 103 */ "DropTrigger",
-     /* 104 */ "IntegrityCk",
-     /* 105 */ "RowSetAdd",
-     /* 106 */ "RowSetRead",
-     /* 107 */ "RowSetTest",
-     /* 108 */ "Program",
-     /* 109 */ "Param",
-     /* 110 */ "FkCounter",
-     /* 111 */ "FkIfZero",
-     /* 112 */ "MemMax",
-     /* 113 */ "IfPos",
-     /* 114 */ "IfNeg",
-     /* 115 */ "IfZero",
-     /* 116 */ "AggStep",
-     /* 117 */ "AggFinal",
-     /* 118 */ "Checkpoint",
-     /* 119 */ "JournalMode",
-     /* 120 */ "Vacuum",
-     /* 121 */ "IncrVacuum",
-     /* 122 */ "Expire",
-     /* 123 */ "TableLock",
-     /* 124 */ "VBegin",
-     /* 125 */ "VCreate",
-     /* 126 */ "VDestroy",
-     /* 127 */ "VOpen",
-     /* 128 */ "VFilter",
-     /* 129 */ "VColumn",
+     /*  95 */ "IdxInsert",
+     /*  96 */ "SorterInsert",
+     /*  97 */ "IdxDelete",
+     /*  98 */ "IdxRowid",
+     /*  99 */ "IdxLT",
+     /* 100 */ "IdxGE",
+     /* 101 */ "Destroy",
+     /* 102 */ "Clear",
+     /* 103 */ "CreateIndex",
+     /* 104 */ "CreateTable",
+     /* 105 */ "ParseSchema",
+     /* 106 */ "LoadAnalysis",
+     /* 107 */ "DropTable",
+     /* 108 */ "DropIndex",
+     /* 109 */ "DropTrigger",
+     /* 110 */ "IntegrityCk",
+     /* 111 */ "RowSetAdd",
+     /* 112 */ "RowSetRead",
+     /* 113 */ "RowSetTest",
+     /* 114 */ "Program",
+     /* 115 */ "Param",
+     /* 116 */ "FkCounter",
+     /* 117 */ "FkIfZero",
+     /* 118 */ "MemMax",
+     /* 119 */ "IfPos",
+     /* 120 */ "IfNeg",
+     /* 121 */ "IfZero",
+     /* 122 */ "AggStep",
+     /* 123 */ "AggFinal",
+     /* 124 */ "Checkpoint",
+     /* 125 */ "JournalMode",
+     /* 126 */ "Vacuum",
+     /* 127 */ "IncrVacuum",
+     /* 128 */ "Expire",
+     /* 129 */ "TableLock",
      /* 130 */ "Real",
-     /* 131 */ "VNext",
-     /* 132 */ "VRename",
-     /* 133 */ "VUpdate",
-     /* 134 */ "Pagecount",
-     /* 135 */ "MaxPgcnt",
-     /* 136 */ "Trace",
-     /* 137 */ "Noop",
-     /* 138 */ "Explain",
-     /* 139 */ "NotUsed_139",
-     /* 140 */ "NotUsed_140",
+     /* 131 */ "VBegin",
+     /* 132 */ "VCreate",
+     /* 133 */ "VDestroy",
+     /* 134 */ "VOpen",
+     /* 135 */ "VFilter",
+     /* 136 */ "VColumn",
+     /* 137 */ "VNext",
+     /* 138 */ "VRename",
+     /* 139 */ "VUpdate",
+     /* 140 */ "Pagecount",
      /* 141 */ "ToText",
      /* 142 */ "ToBlob",
      /* 143 */ "ToNumeric",
      /* 144 */ "ToInt",
      /* 145 */ "ToReal",
+     /* 146 */ "MaxPgcnt",
+     /* 147 */ "Trace",
+     /* 148 */ "Noop",
+     /* 149 */ "Explain",
   };
   return azName[i];
 }
@@ -24056,7 +24608,7 @@ SQLITE_API int sqlite3_os_end(void){
 #include <unistd.h>
 #include <sys/time.h>
 #include <errno.h>
-#ifndef SQLITE_OMIT_WAL
+#if !defined(SQLITE_OMIT_WAL) || SQLITE_MAX_MMAP_SIZE>0
 #include <sys/mman.h>
 #endif
 
@@ -24148,6 +24700,13 @@ struct unixFile {
   const char *zPath;                  /* Name of the file */
   unixShm *pShm;                      /* Shared memory segment information */
   int szChunk;                        /* Configured by FCNTL_CHUNK_SIZE */
+#if SQLITE_MAX_MMAP_SIZE>0
+  int nFetchOut;                      /* Number of outstanding xFetch refs */
+  sqlite3_int64 mmapSize;             /* Usable size of mapping at pMapRegion */
+  sqlite3_int64 mmapSizeActual;       /* Actual size of mapping at pMapRegion */
+  sqlite3_int64 mmapSizeMax;          /* Configured FCNTL_MMAP_SIZE value */
+  void *pMapRegion;                   /* Memory mapped region */
+#endif
 #if SQLITE_ENABLE_LOCKING_STYLE
   int openFlags;                      /* The flags specified at open() */
 #endif
@@ -24424,6 +24983,10 @@ SQLITE_API int sqlite3_open_file_count = 0;
 
 /* Forward reference */
 static int openDirectory(const char*, int*);
+#if SQLITE_MAX_MMAP_SIZE>0
+static int unixMapfile(unixFile *pFd, i64 nByte);
+static void unixUnmapfile(unixFile *pFd);
+#endif
 
 /*
 ** Many system calls are accessed through pointer-to-functions so that
@@ -25881,6 +26444,9 @@ static int unixUnlock(sqlite3_file *id, int eFileLock){
 */
 static int closeUnixFile(sqlite3_file *id){
   unixFile *pFile = (unixFile*)id;
+#if SQLITE_MAX_MMAP_SIZE>0
+  unixUnmapfile(pFile);
+#endif
   if( pFile->h>=0 ){
     robust_close(pFile, pFile->h, __LINE__);
     pFile->h = -1;
@@ -27127,6 +27693,23 @@ static int unixRead(
   );
 #endif
 
+#if SQLITE_MAX_MMAP_SIZE>0
+  /* Deal with as much of this read request as possible by transfering
+  ** data from the memory mapping using memcpy().  */
+  if( offset<pFile->mmapSize ){
+    if( offset+amt <= pFile->mmapSize ){
+      memcpy(pBuf, &((u8 *)(pFile->pMapRegion))[offset], amt);
+      return SQLITE_OK;
+    }else{
+      int nCopy = (int)(pFile->mmapSize - offset);
+      memcpy(pBuf, &((u8 *)(pFile->pMapRegion))[offset], nCopy);
+      pBuf = &((u8 *)pBuf)[nCopy];
+      amt -= nCopy;
+      offset += nCopy;
+    }
+  }
+#endif
+
   got = seekAndRead(pFile, offset, pBuf, amt);
   if( got==amt ){
     return SQLITE_OK;
@@ -27512,6 +28095,17 @@ static int unixTruncate(sqlite3_file *id, i64 nByte){
     }
 #endif
 
+#if SQLITE_MAX_MMAP_SIZE>0
+    /* If the file was just truncated to a size smaller than the currently
+    ** mapped region, reduce the effective mapping size as well. SQLite will
+    ** use the mapping for pages up to pFile->mmapSize only. The mapping
+    ** itself is adjusted the next time it is used with no outstanding
+    ** xFetch references. */
+    if( nByte<pFile->mmapSize ){
+      pFile->mmapSize = nByte;
+    }
+#endif
+
     return SQLITE_OK;
   }
 }
@@ -27645,6 +28239,25 @@ static int unixFileControl(sqlite3_file *id, int op, void *pArg){
     case SQLITE_FCNTL_SYNC_OMITTED: {
       return SQLITE_OK;  /* A no-op */
     }
+#if SQLITE_MAX_MMAP_SIZE>0
+    case SQLITE_FCNTL_MMAP_SIZE: {
+      unixFile *pFile = (unixFile*)id;
+      i64 newLimit = *(i64*)pArg;
+      int rc = SQLITE_OK;
+      if( newLimit>sqlite3GlobalConfig.mxMmap ){
+        newLimit = sqlite3GlobalConfig.mxMmap;
+      }
+      *(i64*)pArg = pFile->mmapSizeMax;
+      if( newLimit>=0 && newLimit!=pFile->mmapSizeMax && pFile->nFetchOut==0 ){
+        pFile->mmapSizeMax = newLimit;
+        if( pFile->pMapRegion ){
+          unixUnmapfile(pFile);
+          rc = unixMapfile(pFile, -1);
+        }
+      }
+      return rc;
+    }
+#endif
   }
   return SQLITE_NOTFOUND;
 }
@@ -28311,6 +28924,148 @@ static int unixShmUnmap(
 # define unixShmUnmap   0
 #endif /* #ifndef SQLITE_OMIT_WAL */
 
+#if SQLITE_MAX_MMAP_SIZE>0
+/*
+** If it is currently memory mapped, unmap file pFd. There must be no
+** outstanding xFetch() references to the mapping.
+*/
+static void unixUnmapfile(unixFile *pFd){
+  assert( pFd->nFetchOut==0 );
+  if( pFd->pMapRegion ){
+    munmap(pFd->pMapRegion, pFd->mmapSizeActual);
+    pFd->pMapRegion = 0;
+    pFd->mmapSize = 0;
+    pFd->mmapSizeActual = 0;
+  }
+}
+
+/*
+** Memory map or remap the file opened by file-descriptor pFd (if the file
+** is already mapped, the existing mapping is replaced by the new). Or, if 
+** there already exists a mapping for this file, and there are still 
+** outstanding xFetch() references to it, this function is a no-op.
+**
+** If parameter nByte is non-negative, then it is the requested size of 
+** the mapping to create. Otherwise, if nByte is less than zero, then the 
+** requested size is the size of the file on disk. The actual size of the
+** created mapping is either the requested size or the value configured 
+** using SQLITE_FCNTL_MMAP_SIZE, whichever is smaller.
+**
+** SQLITE_OK is returned if no error occurs (even if the mapping is not
+** recreated as a result of outstanding references) or an SQLite error
+** code otherwise. If mmap() itself fails, the error is logged and
+** memory mapping is disabled for the file, so that all subsequent reads
+** go through xRead().
+*/
+static int unixMapfile(unixFile *pFd, i64 nByte){
+  i64 nMap = nByte;
+  void *pNew;
+
+  assert( nMap>=0 || pFd->nFetchOut==0 );
+  if( pFd->nFetchOut>0 ) return SQLITE_OK;
+
+  if( nMap<0 ){
+    struct stat statbuf;          /* Low-level file information */
+    if( osFstat(pFd->h, &statbuf) ){
+      pFd->lastErrno = errno;
+      return SQLITE_IOERR_FSTAT;
+    }
+    nMap = statbuf.st_size;
+  }
+  if( nMap>pFd->mmapSizeMax ){
+    nMap = pFd->mmapSizeMax;
+  }
+  if( nMap==pFd->mmapSize && pFd->pMapRegion ){
+    return SQLITE_OK;
+  }
+
+  unixUnmapfile(pFd);
+  if( nMap<=0 ){
+    return SQLITE_OK;
+  }
+
+  pNew = mmap(0, (size_t)nMap, PROT_READ, MAP_SHARED, pFd->h, 0);
+  if( pNew==MAP_FAILED ){
+    pFd->lastErrno = errno;
+    unixLogError(SQLITE_OK, "mmap", pFd->zPath);
+    /* If the mmap() above failed, assume that all subsequent mmap() calls
+    ** will probably fail too. Fall back to using xRead() exclusively
+    ** in this case.  */
+    pFd->mmapSizeMax = 0;
+    return SQLITE_OK;
+  }
+  pFd->pMapRegion = pNew;
+  pFd->mmapSize = pFd->mmapSizeActual = nMap;
+  return SQLITE_OK;
+}
+
+/*
+** If possible, return a pointer to a mapping of file fd starting at offset
+** iOff. The mapping must be valid for at least nAmt bytes.
+**
+** If such a pointer can be obtained, store it in *pp and return SQLITE_OK.
+** Or, if one cannot but no error occurs, set *pp to 0 and return SQLITE_OK.
+** Finally, if an error does occur, return an SQLite error code. The final
+** value of *pp is undefined in this case.
+**
+** If the requested range lies beyond the end of the current mapping, and
+** there are no outstanding references to it, the mapping is resized to
+** match the current file size first. This is how mappings follow a file
+** that has grown since it was last mapped.
+*/
+static int unixFetch(sqlite3_file *fd, i64 iOff, int nAmt, void **pp){
+  unixFile *pFd = (unixFile *)fd;   /* The underlying database file */
+  *pp = 0;
+
+  if( pFd->mmapSizeMax>0 ){
+    if( pFd->nFetchOut==0 && (pFd->pMapRegion==0 || iOff+nAmt>pFd->mmapSize) ){
+      int rc = unixMapfile(pFd, -1);
+      if( rc!=SQLITE_OK ) return rc;
+    }
+    if( iOff+nAmt<=pFd->mmapSize ){
+      *pp = &((u8 *)pFd->pMapRegion)[iOff];
+      pFd->nFetchOut++;
+    }
+  }
+  return SQLITE_OK;
+}
+
+/*
+** If the third argument is non-NULL, then this function releases a 
+** reference obtained by an earlier call to unixFetch(). The second
+** argument passed to this function must be the same as the corresponding
+** argument that was passed to the unixFetch() invocation. 
+**
+** Or, if the third argument is NULL, then this function is being called 
+** to inform the VFS layer that, according to POSIX, any existing mapping 
+** may now be invalid and should be unmapped.
+*/
+static int unixUnfetch(sqlite3_file *fd, i64 iOff, void *p){
+  unixFile *pFd = (unixFile *)fd;   /* The underlying database file */
+  UNUSED_PARAMETER(iOff);
+
+  /* If p==0 (unmap the entire file) then there must be no outstanding 
+  ** xFetch references. Or, if p!=0 (meaning it is an xFetch reference),
+  ** then there must be at least one outstanding.  */
+  assert( (p==0)==(pFd->nFetchOut==0) );
+
+  /* If p!=0, it must match the iOff value. */
+  assert( p==0 || p==&((u8 *)pFd->pMapRegion)[iOff] );
+
+  if( p ){
+    pFd->nFetchOut--;
+  }else{
+    unixUnmapfile(pFd);
+  }
+
+  assert( pFd->nFetchOut>=0 );
+  return SQLITE_OK;
+}
+#else
+# define unixFetch   0
+# define unixUnfetch 0
+#endif /* SQLITE_MAX_MMAP_SIZE>0 */
+
 /*
 ** Here ends the implementation of all sqlite3_file methods.
 **
@@ -28369,7 +29124,9 @@ static const sqlite3_io_methods METHOD = {                                   \
    unixShmMap,                 /* xShmMap */                                 \
    unixShmLock,                /* xShmLock */                                \
    unixShmBarrier,             /* xShmBarrier */                             \
-   unixShmUnmap                /* xShmUnmap */                               \
+   unixShmUnmap,               /* xShmUnmap */                               \
+   unixFetch,                  /* xFetch */                                  \
+   unixUnfetch                 /* xUnfetch */                                \
 };                                                                           \
 static const sqlite3_io_methods *FINDER##Impl(const char *z, unixFile *p){   \
   UNUSED_PARAMETER(z); UNUSED_PARAMETER(p);                                  \
@@ -28386,7 +29143,7 @@ static const sqlite3_io_methods *(*const FINDER)(const char*,unixFile *p)    \
 IOMETHODS(
   posixIoFinder,            /* Finder function name */
   posixIoMethods,           /* sqlite3_io_methods object name */
-  2,                        /* shared memory is enabled */
+  3,                        /* shared memory and mmap are enabled */
   unixClose,                /* xClose method */
   unixLock,                 /* xLock method */
   unixUnlock,               /* xUnlock method */
@@ -28658,6 +29415,9 @@ int fillInUnixFile(
   if( syncDir ){
     pNew->ctrlFlags |= UNIXFILE_DIRSYNC;
   }
+#if SQLITE_MAX_MMAP_SIZE>0
+  pNew->mmapSizeMax = sqlite3GlobalConfig.szMmap;
+#endif
 
 #if OS_VXWORKS
   pNew->pId = vxworksFindFileId(zFilename);
@@ -28998,11 +29758,11 @@ static int findCreateFileMode(
 /*
 ** Initializes a unixFile structure with zeros.
 */
-void chromium_sqlite3_initialize_unix_sqlite3_file(sqlite3_file* file) {
+SQLITE_API void chromium_sqlite3_initialize_unix_sqlite3_file(sqlite3_file* file) {
   memset(file, 0, sizeof(unixFile));
 }
 
-int chromium_sqlite3_fill_in_unix_sqlite3_file(sqlite3_vfs* vfs,
+SQLITE_API int chromium_sqlite3_fill_in_unix_sqlite3_file(sqlite3_vfs* vfs,
                                                int fd,
                                                int dirfd,
                                                sqlite3_file* file,
@@ -29020,7 +29780,7 @@ int chromium_sqlite3_fill_in_unix_sqlite3_file(sqlite3_vfs* vfs,
 ** If a reusable file descriptor is not found, and a new UnixUnusedFd cannot
 ** be allocated, SQLITE_NOMEM is returned. Otherwise, SQLITE_OK is returned.
 */
-int chromium_sqlite3_get_reusable_file_handle(sqlite3_file* file,
+SQLITE_API int chromium_sqlite3_get_reusable_file_handle(sqlite3_file* file,
                                               const char* fileName,
                                               int flags,
                                               int* fd) {
@@ -29044,7 +29804,7 @@ int chromium_sqlite3_get_reusable_file_handle(sqlite3_file* file,
 /*
 ** Marks 'fd' as the unused file descriptor for 'pFile'.
 */
-void chromium_sqlite3_update_reusable_file_handle(sqlite3_file* file,
+SQLITE_API void chromium_sqlite3_update_reusable_file_handle(sqlite3_file* file,
                                                   int fd,
                                                   int flags) {
   unixFile* unixSQLite3File = (unixFile*)file;
@@ -29057,7 +29817,7 @@ void chromium_sqlite3_update_reusable_file_handle(sqlite3_file* file,
 /*
 ** Destroys pFile's field that keeps track of the unused file descriptor.
 */
-void chromium_sqlite3_destroy_reusable_file_handle(sqlite3_file* file) {
+SQLITE_API void chromium_sqlite3_destroy_reusable_file_handle(sqlite3_file* file) {
   unixFile* unixSQLite3File = (unixFile*)file;
   sqlite3_free(unixSQLite3File->pUnused);
 }
@@ -33903,7 +34663,7 @@ SQLITE_API int sqlite3_os_end(void){
   return SQLITE_OK;
 }
 
-void chromium_sqlite3_initialize_win_sqlite3_file(sqlite3_file* file, HANDLE handle) {
+SQLITE_API void chromium_sqlite3_initialize_win_sqlite3_file(sqlite3_file* file, HANDLE handle) {
   winFile* winSQLite3File = (winFile*)file;
   memset(file, 0, sizeof(*file));
   winSQLite3File->pMethod = &winIoMethod;
@@ -36356,7 +37116,8 @@ SQLITE_PRIVATE int sqlite3RowSetTest(RowSet *pRowSet, u8 iBatch, sqlite3_int64 i
 # define sqlite3WalClose(w,x,y,z)                0
 # define sqlite3WalBeginReadTransaction(y,z)     0
 # define sqlite3WalEndReadTransaction(z)
-# define sqlite3WalRead(v,w,x,y,z)               0
+# define sqlite3WalFindFrame(x,y,z)              0
+# define sqlite3WalReadFrame(w,x,y,z)            0
 # define sqlite3WalDbsize(y)                     0
 # define sqlite3WalBeginWriteTransaction(y)      0
 # define sqlite3WalEndWriteTransaction(x)        0
@@ -36364,10 +37125,12 @@ SQLITE_PRIVATE int sqlite3RowSetTest(RowSet *pRowSet, u8 iBatch, sqlite3_int64 i
 # define sqlite3WalSavepoint(y,z)
 # define sqlite3WalSavepointUndo(y,z)            0
 # define sqlite3WalFrames(u,v,w,x,y,z)           0
-# define sqlite3WalCheckpoint(r,s,t,u,v,w,x,y,z) 0
+# define sqlite3WalCheckpoint(q,r,s,t,u,v,w,x,y,z) 0
 # define sqlite3WalCallback(z)                   0
+# define sqlite3WalBacklog(z)                    0
 # define sqlite3WalExclusiveMode(y,z)            0
 # define sqlite3WalHeapMemory(z)                 0
+# define sqlite3WalCachePageKey(x,y,z)           0
 #else
 
 #define WAL_SAVEPOINT_NDATA 4
@@ -36392,7 +37155,8 @@ SQLITE_PRIVATE int sqlite3WalBeginReadTransaction(Wal *pWal, int *);
 SQLITE_PRIVATE void sqlite3WalEndReadTransaction(Wal *pWal);
 
 /* Read a page from the write-ahead log, if it is present. */
-SQLITE_PRIVATE int sqlite3WalRead(Wal *pWal, Pgno pgno, int *pInWal, int nOut, u8 *pOut);
+SQLITE_PRIVATE int sqlite3WalFindFrame(Wal *, Pgno, u32 *);
+SQLITE_PRIVATE int sqlite3WalReadFrame(Wal *, u32, int, u8 *);
 
 /* If the WAL is not empty, return the size of the database. */
 SQLITE_PRIVATE Pgno sqlite3WalDbsize(Wal *pWal);
@@ -36422,6 +37186,7 @@ SQLITE_PRIVATE int sqlite3WalCheckpoint(
   int (*xBusy)(void*),            /* Function to call when busy */
   void *pBusyArg,                 /* Context argument for xBusyHandler */
   int sync_flags,                 /* Flags to sync db file with (or 0) */
+  int nBatch,                     /* Max frames to backfill, or 0 for all */
   int nBuf,                       /* Size of buffer nBuf */
   u8 *zBuf,                       /* Temporary buffer to use */
   int *pnLog,                     /* OUT: Number of frames in WAL */
@@ -36435,6 +37200,11 @@ SQLITE_PRIVATE int sqlite3WalCheckpoint(
 */
 SQLITE_PRIVATE int sqlite3WalCallback(Wal *pWal);
 
+/* Return the number of frames in the WAL that have not yet been copied
+** into the database file by a checkpoint.
+*/
+SQLITE_PRIVATE int sqlite3WalBacklog(Wal *pWal);
+
 /* Tell the wal layer that an EXCLUSIVE lock has been obtained (or released)
 ** by the pager layer on the database file.
 */
@@ -36446,6 +37216,33 @@ SQLITE_PRIVATE int sqlite3WalExclusiveMode(Wal *pWal, int op);
 */
 SQLITE_PRIVATE int sqlite3WalHeapMemory(Wal *pWal);
 
+/* The shared WAL page cache (see walcache.c).  Pages are identified by
+** the page number and a WalCacheKey, which is filled in for a page read
+** from frame iFrame (or from the database file if iFrame is zero) by
+** sqlite3WalCachePageKey().  That routine returns false if pages of this
+** WAL may not be shared.
+*/
+typedef struct WalCacheFile WalCacheFile;
+typedef struct WalCacheKey WalCacheKey;
+struct WalCacheKey {
+  WalCacheFile *pFile;            /* WAL file the page belongs to */
+  u32 iGeneration;                /* Incremented each time the WAL is recovered */
+  u32 iFrame;                     /* Frame read from, or 0 for the db file */
+  u32 aSalt[2];                   /* Salt values from the WAL header */
+  u32 nBackfill;                  /* Frames backfilled if iFrame==0, else 0 */
+};
+SQLITE_PRIVATE int sqlite3WalCachePageKey(Wal *pWal, u32 iFrame, WalCacheKey *pKey);
+
+SQLITE_PRIVATE WalCacheFile *sqlite3WalCacheOpen(const char *zName);
+SQLITE_PRIVATE void sqlite3WalCacheClose(WalCacheFile*);
+SQLITE_PRIVATE void sqlite3WalCacheNewGeneration(WalCacheFile*);
+SQLITE_PRIVATE u32 sqlite3WalCacheGeneration(WalCacheFile*);
+SQLITE_PRIVATE void *sqlite3WalCacheFetch(Pgno, const WalCacheKey*, int szPage);
+SQLITE_PRIVATE void *sqlite3WalCacheAlloc(Pgno, const WalCacheKey*, int szPage);
+SQLITE_PRIVATE void *sqlite3WalCacheInsert(void *pData);
+SQLITE_PRIVATE void sqlite3WalCacheDiscard(void *pData);
+SQLITE_PRIVATE void sqlite3WalCacheRelease(void *pData);
+
 #endif /* ifndef SQLITE_OMIT_WAL */
 #endif /* _WAL_H_ */
 
@@ -37096,12 +37893,17 @@ struct Pager {
   int pageSize;               /* Number of bytes in a page */
   Pgno mxPgno;                /* Maximum allowed size of the database */
   i64 journalSizeLimit;       /* Size limit for persistent journal files */
+  u8 bUseFetch;               /* True to use xFetch() */
+  int nMmapOut;               /* Number of mmap and shared pages outstanding */
+  sqlite3_int64 szMmap;       /* Desired maximum mmap size */
+  PgHdr *pMmapFreelist;       /* List of free mmap page headers (pDirty) */
   char *zFilename;            /* Name of the database file */
   char *zJournal;             /* Name of the journal file */
   int (*xBusyHandler)(void*); /* Function to call when busy */
   void *pBusyHandlerArg;      /* Context argument for xBusyHandler */
+  int nCkptBatch;             /* Max frames per checkpoint, or 0 for all */
+  u32 aStat[3];               /* Cache hits, misses and bytes read */
 #ifdef SQLITE_TEST
-  int nHit, nMiss;            /* Cache hits and missing */
   int nRead, nWrite;          /* Database pages read/written */
 #endif
   void (*xReiniter)(DbPage*); /* Call this routine when reloading pages */
@@ -37205,6 +38007,27 @@ static const unsigned char aJournalMagic[] = {
 */
 #define isOpen(pFd) ((pFd)->pMethods)
 
+/*
+** The macro USEFETCH is true if we are allowed to use the xFetch and xUnfetch
+** interfaces to access the database using memory-mapped I/O.
+*/
+#if SQLITE_MAX_MMAP_SIZE>0
+# define USEFETCH(x) ((x)->bUseFetch)
+#else
+# define USEFETCH(x) 0
+#endif
+
+/*
+** The macro PAGER_MAPPAGES is true if the pager may return read-only page
+** objects that are not part of the page cache.  These are used both for
+** memory-mapped pages and for pages from the shared WAL page cache.
+*/
+#if SQLITE_MAX_MMAP_SIZE>0 || !defined(SQLITE_OMIT_WAL)
+# define PAGER_MAPPAGES 1
+#else
+# define PAGER_MAPPAGES 0
+#endif
+
 /*
 ** Return true if this pager uses a write-ahead log instead of the usual
 ** rollback journal. Otherwise false.
@@ -39216,17 +40039,21 @@ end_playback:
 ** pPg->pData. A shared lock or greater must be held on the database
 ** file before this function is called.
 **
+** If parameter iFrame is non-zero, then it is the frame of the 
+** write-ahead log (as returned by sqlite3WalFindFrame()) that contains
+** the current version of the page. Otherwise, the page is read from the
+** database file itself.
+**
 ** If page 1 is read, then the value of Pager.dbFileVers[] is set to
 ** the value read from the database file.
 **
 ** If an IO error occurs, then the IO error is returned to the caller.
 ** Otherwise, SQLITE_OK is returned.
 */
-static int readDbPage(PgHdr *pPg){
+static int readDbPage(PgHdr *pPg, u32 iFrame){
   Pager *pPager = pPg->pPager; /* Pager object associated with page pPg */
   Pgno pgno = pPg->pgno;       /* Page number to read */
   int rc = SQLITE_OK;          /* Return code */
-  int isInWal = 0;             /* True if page is in log file */
   int pgsz = pPager->pageSize; /* Number of bytes to read */
 
   assert( pPager->eState>=PAGER_READER && !MEMDB );
@@ -39238,11 +40065,10 @@ static int readDbPage(PgHdr *pPg){
     return SQLITE_OK;
   }
 
-  if( pagerUseWal(pPager) ){
+  if( iFrame ){
     /* Try to pull the page from the write-ahead log. */
-    rc = sqlite3WalRead(pPager->pWal, pgno, &isInWal, pgsz, pPg->pData);
-  }
-  if( rc==SQLITE_OK && !isInWal ){
+    rc = sqlite3WalReadFrame(pPager->pWal, iFrame, pgsz, pPg->pData);
+  }else{
     i64 iOffset = (pgno-1)*(i64)pPager->pageSize;
     rc = sqlite3OsRead(pPager->fd, pPg->pData, pgsz, iOffset);
     if( rc==SQLITE_IOERR_SHORT_READ ){
@@ -39272,6 +40098,7 @@ static int readDbPage(PgHdr *pPg){
   }
   CODEC1(pPager, pPg->pData, pgno, 3, rc = SQLITE_NOMEM);
 
+  if( rc==SQLITE_OK ) pPager->aStat[PAGER_STAT_READ] += pgsz;
   PAGER_INCR(sqlite3_pager_readdb_count);
   PAGER_INCR(pPager->nRead);
   IOTRACE(("PGIN %p %d\n", pPager, pgno));
@@ -39326,7 +40153,11 @@ static int pagerUndoCallback(void *pCtx, Pgno iPg){
     if( sqlite3PcachePageRefcount(pPg)==1 ){
       sqlite3PcacheDrop(pPg);
     }else{
-      rc = readDbPage(pPg);
+      u32 iFrame = 0;
+      rc = sqlite3WalFindFrame(pPager->pWal, pPg->pgno, &iFrame);
+      if( rc==SQLITE_OK ){
+        rc = readDbPage(pPg, iFrame);
+      }
       if( rc==SQLITE_OK ){
         pPager->xReiniter(pPg);
       }
@@ -39461,6 +40292,7 @@ static int pagerBeginReadTransaction(Pager *pPager){
   rc = sqlite3WalBeginReadTransaction(pPager->pWal, &changed);
   if( rc!=SQLITE_OK || changed ){
     pager_reset(pPager);
+    if( USEFETCH(pPager) ) sqlite3OsUnfetch(pPager->fd, 0, 0);
   }
 
   return rc;
@@ -39724,6 +40556,192 @@ SQLITE_PRIVATE void sqlite3PagerSetCachesize(Pager *pPager, int mxPage){
   sqlite3PcacheSetCachesize(pPager->pPCache, mxPage);
 }
 
+/*
+** Invoke SQLITE_FCNTL_MMAP_SIZE based on the current value of szMmap.
+** Memory mapped reads are only used if the VFS supports xFetch (version 3
+** io methods or later) and no codec is attached to the pager, since a 
+** codec must be able to transform the page content in place. They are
+** also disabled for "PRAGMA omit_readlock" connections, as without a 
+** read lock the file may be truncated underneath the mapping.
+*/
+static void pagerFixMaplimit(Pager *pPager){
+#if SQLITE_MAX_MMAP_SIZE>0
+  sqlite3_file *fd = pPager->fd;
+  if( isOpen(fd) && fd->pMethods->iVersion>=3 ){
+    sqlite3_int64 sz;
+    pPager->bUseFetch = (pPager->szMmap>0 && !pPager->noReadlock);
+#ifdef SQLITE_HAS_CODEC
+    if( pPager->xCodec ) pPager->bUseFetch = 0;
+#endif
+    sz = pPager->szMmap;
+    sqlite3OsFileControl(pPager->fd, SQLITE_FCNTL_MMAP_SIZE, &sz);
+  }
+#endif
+}
+
+/*
+** Change the maximum size of any memory mapping made of the database file.
+*/
+SQLITE_PRIVATE void sqlite3PagerSetMmapLimit(Pager *pPager, sqlite3_int64 szMmap){
+  pPager->szMmap = szMmap;
+  pagerFixMaplimit(pPager);
+}
+
+#if PAGER_MAPPAGES
+/*
+** Release the content pData of page pgno, which was obtained from xFetch()
+** or, if flags includes PGHDR_SHARED, from the shared WAL page cache.
+*/
+static void pagerReleaseMapData(
+  Pager *pPager,                  /* Pager object */
+  Pgno pgno,                      /* Page number */
+  int flags,                      /* PGHDR_MMAP, possibly with PGHDR_SHARED */
+  void *pData                     /* Page content to release */
+){
+#ifndef SQLITE_OMIT_WAL
+  if( flags & PGHDR_SHARED ){
+    sqlite3WalCacheRelease(pData);
+    return;
+  }
+#endif
+  assert( pPager->fd->pMethods->iVersion>=3 );
+  sqlite3OsUnfetch(pPager->fd, (i64)(pgno-1)*pPager->pageSize, pData);
+}
+
+/*
+** Obtain a reference to a memory mapped page object for page number pgno. 
+** The new object will use the pointer pData, obtained from xFetch() or,
+** if flags includes PGHDR_SHARED, from the shared WAL page cache.
+** If successful, set *ppPage to point to the new page reference
+** and return SQLITE_OK. Otherwise, return an SQLite error code and set
+** *ppPage to zero.
+**
+** Page references obtained by calling this function should be released
+** by calling pagerReleaseMapPage().
+*/
+static int pagerAcquireMapPage(
+  Pager *pPager,                  /* Pager object */
+  Pgno pgno,                      /* Page number */
+  void *pData,                    /* xFetch()'d or shared data for this page */
+  int flags,                      /* PGHDR_MMAP, possibly with PGHDR_SHARED */
+  PgHdr **ppPage                  /* OUT: Acquired page object */
+){
+  PgHdr *p;                       /* Memory mapped page to return */
+
+  assert( flags==PGHDR_MMAP || flags==(PGHDR_MMAP|PGHDR_SHARED) );
+  if( pPager->pMmapFreelist ){
+    *ppPage = p = pPager->pMmapFreelist;
+    pPager->pMmapFreelist = p->pDirty;
+    p->pDirty = 0;
+    p->nRef = 1;
+    memset(p->pExtra, 0, pPager->nExtra);
+  }else{
+    *ppPage = p = (PgHdr *)sqlite3MallocZero(sizeof(PgHdr) + pPager->nExtra);
+    if( p==0 ){
+      pagerReleaseMapData(pPager, pgno, flags, pData);
+      return SQLITE_NOMEM;
+    }
+    p->pExtra = (void *)&p[1];
+    p->nRef = 1;
+    p->pPager = pPager;
+  }
+
+  assert( p->pExtra==(void *)&p[1] );
+  assert( p->pCache==0 );
+  assert( p->pPager==pPager );
+  assert( p->nRef==1 );
+
+  p->flags = (u16)flags;
+  p->pgno = pgno;
+  p->pData = pData;
+  pPager->nMmapOut++;
+
+  return SQLITE_OK;
+}
+
+/*
+** Release a reference to page pPg. pPg must have been returned by an 
+** earlier call to pagerAcquireMapPage().
+*/
+static void pagerReleaseMapPage(PgHdr *pPg){
+  Pager *pPager = pPg->pPager;
+  pPager->nMmapOut--;
+  pPg->pDirty = pPager->pMmapFreelist;
+  pPager->pMmapFreelist = pPg;
+  pagerReleaseMapData(pPager, pPg->pgno, pPg->flags, pPg->pData);
+}
+
+/*
+** Free all PgHdr objects stored in the Pager.pMmapFreelist list.
+*/
+static void pagerFreeMapHdrs(Pager *pPager){
+  PgHdr *p;
+  PgHdr *pNext;
+  for(p=pPager->pMmapFreelist; p; p=pNext){
+    pNext = p->pDirty;
+    sqlite3_free(p);
+  }
+}
+#else
+# define pagerFreeMapHdrs(x)
+#endif /* PAGER_MAPPAGES */
+
+#ifndef SQLITE_OMIT_WAL
+/*
+** Obtain a read-only reference to page pgno from the shared WAL page
+** cache.  If the page is not already cached, it is read from frame iFrame
+** of the WAL, or from the database file if iFrame is zero, and added to
+** the shared cache.  If successful, set *ppPage to the new page reference
+** and return SQLITE_OK.
+**
+** If the shared cache is not in use for this database, or if the page
+** cannot be added to it, set *ppPage to zero and return SQLITE_OK.  The
+** caller then reads the page into the private page cache as usual.  If
+** an IO error occurs, an error code is returned.
+*/
+static int pagerAcquireSharedPage(
+  Pager *pPager,                  /* Pager object */
+  Pgno pgno,                      /* Page number */
+  u32 iFrame,                     /* Frame containing page, or 0 */
+  PgHdr **ppPage                  /* OUT: Acquired page object */
+){
+  int pgsz = pPager->pageSize;    /* Number of bytes to read */
+  WalCacheKey key;                /* Shared cache key for this page */
+  void *pData;                    /* Shared page content */
+  int rc = SQLITE_OK;             /* Return code */
+
+  *ppPage = 0;
+  if( !sqlite3WalCachePageKey(pPager->pWal, iFrame, &key) ) return SQLITE_OK;
+
+  pData = sqlite3WalCacheFetch(pgno, &key, pgsz);
+  if( pData ){
+    pPager->aStat[PAGER_STAT_HIT]++;
+  }else{
+    pData = sqlite3WalCacheAlloc(pgno, &key, pgsz);
+    if( pData==0 ) return SQLITE_OK;
+    if( iFrame ){
+      rc = sqlite3WalReadFrame(pPager->pWal, iFrame, pgsz, (u8*)pData);
+    }else{
+      rc = sqlite3OsRead(pPager->fd, pData, pgsz, (pgno-1)*(i64)pgsz);
+      if( rc==SQLITE_IOERR_SHORT_READ ){
+        rc = SQLITE_OK;
+      }
+    }
+    if( rc!=SQLITE_OK ){
+      sqlite3WalCacheDiscard(pData);
+      return rc;
+    }
+    pPager->aStat[PAGER_STAT_MISS]++;
+    pPager->aStat[PAGER_STAT_READ] += pgsz;
+    PAGER_INCR(sqlite3_pager_readdb_count);
+    PAGER_INCR(pPager->nRead);
+    IOTRACE(("PGIN %p %d\n", pPager, pgno));
+    pData = sqlite3WalCacheInsert(pData);
+  }
+  return pagerAcquireMapPage(pPager, pgno, pData, PGHDR_MMAP|PGHDR_SHARED, ppPage);
+}
+#endif /* SQLITE_OMIT_WAL */
+
 /*
 ** Adjust the robustness of the database to damage due to OS crashes
 ** or power failures by changing the number of syncs()s when writing
@@ -40201,6 +41219,8 @@ SQLITE_PRIVATE int sqlite3PagerClose(Pager *pPager){
   enable_simulated_io_errors();
   PAGERTRACE(("CLOSE %d\n", PAGERID(pPager)));
   IOTRACE(("CLOSE %p\n", pPager))
+  assert( pPager->nMmapOut==0 );
+  pagerFreeMapHdrs(pPager);
   sqlite3OsClose(pPager->jfd);
   sqlite3OsClose(pPager->fd);
   sqlite3PageFree(pTmp);
@@ -40953,6 +41973,8 @@ SQLITE_PRIVATE int sqlite3PagerOpen(
   pPager->journalSizeLimit = SQLITE_DEFAULT_JOURNAL_SIZE_LIMIT;
   assert( isOpen(pPager->fd) || tempFile );
   setSectorSize(pPager);
+  pPager->szMmap = sqlite3GlobalConfig.szMmap;
+  pagerFixMaplimit(pPager);
   if( !useJournal ){
     pPager->journalMode = PAGER_JOURNALMODE_OFF;
   }else if( memDb ){
@@ -41288,6 +42310,16 @@ SQLITE_PRIVATE int sqlite3PagerSharedLock(Pager *pPager){
 
       if( memcmp(pPager->dbFileVers, dbFileVers, sizeof(dbFileVers))!=0 ){
         pager_reset(pPager);
+
+        /* Unmap the database file. It is possible that external processes
+        ** may have truncated the database file and then extended it back
+        ** to its original size while this process was not holding a lock.
+        ** In this case there may exist a Pager.pMap mapping that appears
+        ** to be the right size but is not actually valid. Avoid this
+        ** possibility by unmapping the db here. */
+        if( USEFETCH(pPager) ){
+          sqlite3OsUnfetch(pPager->fd, 0, 0);
+        }
       }
     }
 
@@ -41329,7 +42361,7 @@ SQLITE_PRIVATE int sqlite3PagerSharedLock(Pager *pPager){
 ** nothing to rollback, so this routine is a no-op.
 */ 
 static void pagerUnlockIfUnused(Pager *pPager){
-  if( (sqlite3PcacheRefCount(pPager->pPCache)==0) ){
+  if( pPager->nMmapOut==0 && (sqlite3PcacheRefCount(pPager->pPCache)==0) ){
     pagerUnlockAndRollback(pPager);
   }
 }
@@ -41356,8 +42388,9 @@ static void pagerUnlockIfUnused(Pager *pPager){
 ** actual disk read occurs. In this case the memory image of the 
 ** page is initialized to all zeros. 
 **
-** If noContent is true, it means that we do not care about the contents
-** of the page. This occurs in two seperate scenarios:
+** If the PAGER_ACQUIRE_NOCONTENT bit is set in flags, it means that we
+** do not care about the contents of the page. This occurs in two seperate
+** scenarios:
 **
 **   a) When reading a free-list leaf page from the database, and
 **
@@ -41365,14 +42398,21 @@ static void pagerUnlockIfUnused(Pager *pPager){
 **      a new page into the cache to be filled with the data read
 **      from the savepoint journal.
 **
-** If noContent is true, then the data returned is zeroed instead of
-** being read from the database. Additionally, the bits corresponding
+** If PAGER_ACQUIRE_NOCONTENT is set, then the data returned is zeroed
+** instead of being read from the database. Additionally, the bits corresponding
 ** to pgno in Pager.pInJournal (bitvec of pages already written to the
 ** journal file) and the PagerSavepoint.pInSavepoint bitvecs of any open
 ** savepoints are set. This means if the page is made writable at any
 ** point in the future, using a call to sqlite3PagerWrite(), its contents
 ** will not be journaled. This saves IO.
 **
+** If the PAGER_ACQUIRE_READONLY bit is set in flags, the caller promises
+** not to call sqlite3PagerWrite() on the returned page. In that case the
+** page may be returned as a pointer directly into a memory mapping of the
+** database file (see SQLITE_FCNTL_MMAP_SIZE) instead of being copied into
+** the page cache. Such pages are never returned for page 1, or while a
+** codec is attached to the pager.
+**
 ** The acquisition might fail for several reasons.  In all cases,
 ** an appropriate error code is returned and *ppPage is set to NULL.
 **
@@ -41388,13 +42428,37 @@ SQLITE_PRIVATE int sqlite3PagerAcquire(
   Pager *pPager,      /* The pager open on the database file */
   Pgno pgno,          /* Page number to fetch */
   DbPage **ppPage,    /* Write a pointer to the page here */
-  int noContent       /* Do not bother reading content from disk if true */
+  int flags           /* PAGER_ACQUIRE_XXX flags */
 ){
-  int rc;
-  PgHdr *pPg;
+  int rc = SQLITE_OK;
+  PgHdr *pPg = 0;
+  u32 iFrame = 0;                 /* Frame to read from WAL file */
+  const int noContent = (flags & PAGER_ACQUIRE_NOCONTENT);
+
+  /* It is acceptable to use a read-only (mmap) page for any page except
+  ** page 1 if there is no write-transaction open or the ACQUIRE_READONLY
+  ** flag was specified by the caller. And so long as the db is not a 
+  ** temporary or in-memory database.  */
+  const int bMmapOk = (pgno!=1 && USEFETCH(pPager)
+   && (pPager->eState==PAGER_READER || (flags & PAGER_ACQUIRE_READONLY))
+#ifdef SQLITE_HAS_CODEC
+   && pPager->xCodec==0
+#endif
+  );
+
+  /* Pages from the shared WAL page cache may be used under the same
+  ** conditions, except that no write-transaction may be open at all.  The
+  ** shared cache must never see frames that have not been committed.  */
+  const int bSharedOk = (pgno!=1 && pagerUseWal(pPager)
+   && pPager->eState==PAGER_READER && !pPager->noReadlock
+#ifdef SQLITE_HAS_CODEC
+   && pPager->xCodec==0
+#endif
+  );
 
   assert( pPager->eState>=PAGER_READER );
   assert( assert_pager_state(pPager) );
+  assert( noContent==0 || (bMmapOk==0 && bSharedOk==0) );
 
   if( pgno==0 ){
     return SQLITE_CORRUPT_BKPT;
@@ -41405,6 +42469,58 @@ SQLITE_PRIVATE int sqlite3PagerAcquire(
   if( pPager->errCode!=SQLITE_OK ){
     rc = pPager->errCode;
   }else{
+
+    if( (bMmapOk || bSharedOk) && pgno<=pPager->dbSize ){
+      if( pagerUseWal(pPager) ){
+        rc = sqlite3WalFindFrame(pPager->pWal, pgno, &iFrame);
+        if( rc!=SQLITE_OK ) goto pager_acquire_err;
+      }
+
+#if SQLITE_MAX_MMAP_SIZE>0
+      if( bMmapOk && iFrame==0 ){
+        void *pData = 0;
+
+        rc = sqlite3OsFetch(pPager->fd, 
+            (i64)(pgno-1) * pPager->pageSize, pPager->pageSize, &pData
+        );
+
+        if( rc==SQLITE_OK && pData ){
+          /* If a write-transaction is open, the page cache may hold a
+          ** newer version of this page than the database file. Prefer
+          ** the cached copy in that case.  */
+          if( pPager->eState>PAGER_READER ){
+            (void)sqlite3PcacheFetch(pPager->pPCache, pgno, 0, &pPg);
+          }
+          if( pPg==0 ){
+            rc = pagerAcquireMapPage(pPager, pgno, pData, PGHDR_MMAP, &pPg);
+          }else{
+            sqlite3OsUnfetch(pPager->fd, (i64)(pgno-1)*pPager->pageSize, pData);
+          }
+          if( pPg ){
+            assert( rc==SQLITE_OK );
+            pPager->aStat[PAGER_STAT_HIT]++;
+            *ppPage = pPg;
+            return SQLITE_OK;
+          }
+        }
+        if( rc!=SQLITE_OK ){
+          goto pager_acquire_err;
+        }
+      }
+#endif
+
+#ifndef SQLITE_OMIT_WAL
+      if( bSharedOk ){
+        rc = pagerAcquireSharedPage(pPager, pgno, iFrame, &pPg);
+        if( rc!=SQLITE_OK ) goto pager_acquire_err;
+        if( pPg ){
+          *ppPage = pPg;
+          return SQLITE_OK;
+        }
+      }
+#endif
+    }
+
     rc = sqlite3PcacheFetch(pPager->pPCache, pgno, 1, ppPage);
   }
 
@@ -41422,14 +42538,14 @@ SQLITE_PRIVATE int sqlite3PagerAcquire(
     /* In this case the pcache already contains an initialized copy of
     ** the page. Return without further ado.  */
     assert( pgno<=PAGER_MAX_PGNO && pgno!=PAGER_MJ_PGNO(pPager) );
-    PAGER_INCR(pPager->nHit);
+    pPager->aStat[PAGER_STAT_HIT]++;
     return SQLITE_OK;
 
   }else{
     /* The pager cache has created a new page. Its content needs to 
     ** be initialized.  */
 
-    PAGER_INCR(pPager->nMiss);
+    pPager->aStat[PAGER_STAT_MISS]++;
     pPg = *ppPage;
     pPg->pPager = pPager;
 
@@ -41464,8 +42580,12 @@ SQLITE_PRIVATE int sqlite3PagerAcquire(
       memset(pPg->pData, 0, pPager->pageSize);
       IOTRACE(("ZERO %p %d\n", pPager, pgno));
     }else{
+      if( pagerUseWal(pPager) && bMmapOk==0 && bSharedOk==0 ){
+        rc = sqlite3WalFindFrame(pPager->pWal, pgno, &iFrame);
+        if( rc!=SQLITE_OK ) goto pager_acquire_err;
+      }
       assert( pPg->pPager==pPager );
-      rc = readDbPage(pPg);
+      rc = readDbPage(pPg, iFrame);
       if( rc!=SQLITE_OK ){
         goto pager_acquire_err;
       }
@@ -41518,7 +42638,17 @@ SQLITE_PRIVATE DbPage *sqlite3PagerLookup(Pager *pPager, Pgno pgno){
 SQLITE_PRIVATE void sqlite3PagerUnref(DbPage *pPg){
   if( pPg ){
     Pager *pPager = pPg->pPager;
-    sqlite3PcacheRelease(pPg);
+#if PAGER_MAPPAGES
+    if( pPg->flags & PGHDR_MMAP ){
+      assert( pPg->nRef>0 );
+      if( --pPg->nRef==0 ){
+        pagerReleaseMapPage(pPg);
+      }
+    }else
+#endif
+    {
+      sqlite3PcacheRelease(pPg);
+    }
     pagerUnlockIfUnused(pPager);
   }
 }
@@ -41747,6 +42877,7 @@ static int pager_write(PgHdr *pPg){
        || pPager->eState==PAGER_WRITER_DBMOD
   );
   assert( assert_pager_state(pPager) );
+  assert( (pPg->flags & PGHDR_MMAP)==0 );
 
   /* If an error has been previously detected, report the same error
   ** again. This should not happen, but the check provides robustness. */
@@ -41885,6 +43016,7 @@ SQLITE_PRIVATE int sqlite3PagerWrite(DbPage *pDbPage){
   Pager *pPager = pPg->pPager;
   Pgno nPagePerSector = (pPager->sectorSize/pPager->pageSize);
 
+  assert( (pPg->flags & PGHDR_MMAP)==0 );
   assert( pPager->eState>=PAGER_WRITER_LOCKED );
   assert( pPager->eState!=PAGER_ERROR );
   assert( assert_pager_state(pPager) );
@@ -42522,8 +43654,8 @@ SQLITE_PRIVATE int *sqlite3PagerStats(Pager *pPager){
   a[3] = pPager->eState==PAGER_OPEN ? -1 : (int) pPager->dbSize;
   a[4] = pPager->eState;
   a[5] = pPager->errCode;
-  a[6] = pPager->nHit;
-  a[7] = pPager->nMiss;
+  a[6] = pPager->aStat[PAGER_STAT_HIT];
+  a[7] = pPager->aStat[PAGER_STAT_MISS];
   a[8] = 0;  /* Used to be pPager->nOvfl */
   a[9] = pPager->nRead;
   a[10] = pPager->nWrite;
@@ -42538,6 +43670,20 @@ SQLITE_PRIVATE int sqlite3PagerIsMemdb(Pager *pPager){
   return MEMDB;
 }
 
+/*
+** Return one of the running totals kept by pager pPager: the number of
+** page requests satisfied without reading from the database file or WAL
+** (PAGER_STAT_HIT), the number that were not (PAGER_STAT_MISS) and the
+** number of bytes read (PAGER_STAT_READ).  Pages served from the memory
+** mapping or the shared WAL page cache count as hits.  The totals wrap
+** around on overflow, so callers should only use the difference between
+** two values.
+*/
+SQLITE_PRIVATE u32 sqlite3PagerCacheStat(Pager *pPager, int eStat){
+  assert( eStat>=0 && eStat<ArraySize(pPager->aStat) );
+  return pPager->aStat[eStat];
+}
+
 /*
 ** Check that there are at least nSavepoint savepoints open. If there are
 ** currently less than nSavepoints open, then open one or more savepoints
@@ -42729,6 +43875,7 @@ SQLITE_PRIVATE void sqlite3PagerSetCodec(
   pPager->xCodecFree = xCodecFree;
   pPager->pCodec = pCodec;
   pagerReportSize(pPager);
+  pagerFixMaplimit(pPager);
 }
 SQLITE_PRIVATE void *sqlite3PagerGetCodec(Pager *pPager){
   return pPager->pCodec;
@@ -43096,17 +44243,34 @@ SQLITE_PRIVATE int sqlite3PagerCheckpoint(Pager *pPager, int eMode, int *pnLog,
   if( pPager->pWal ){
     rc = sqlite3WalCheckpoint(pPager->pWal, eMode,
         pPager->xBusyHandler, pPager->pBusyHandlerArg,
-        pPager->ckptSyncFlags, pPager->pageSize, (u8 *)pPager->pTmpSpace,
-        pnLog, pnCkpt
+        pPager->ckptSyncFlags, pPager->nCkptBatch, pPager->pageSize,
+        (u8 *)pPager->pTmpSpace, pnLog, pnCkpt
     );
   }
   return rc;
 }
 
+/*
+** Limit the number of frames copied into the database file by each
+** subsequent call to sqlite3PagerCheckpoint() to nBatch.  Zero or a
+** negative value removes the limit.
+*/
+SQLITE_PRIVATE void sqlite3PagerCheckpointBatch(Pager *pPager, int nBatch){
+  pPager->nCkptBatch = nBatch>0 ? nBatch : 0;
+}
+
 SQLITE_PRIVATE int sqlite3PagerWalCallback(Pager *pPager){
   return sqlite3WalCallback(pPager->pWal);
 }
 
+/*
+** Return the number of frames in the WAL file that have not yet been
+** checkpointed, or zero if the pager is not in WAL mode.
+*/
+SQLITE_PRIVATE int sqlite3PagerWalBacklog(Pager *pPager){
+  return sqlite3WalBacklog(pPager->pWal);
+}
+
 /*
 ** Return true if the underlying VFS for the given pager supports the
 ** primitives necessary for write-ahead logging.
@@ -43703,6 +44867,7 @@ struct Wal {
   WalIndexHdr hdr;           /* Wal-index header for current transaction */
   const char *zWalName;      /* Name of WAL file */
   u32 nCkpt;                 /* Checkpoint sequence counter in the wal-header */
+  WalCacheFile *pCacheFile;  /* Handle for the shared page cache, or NULL */
 #ifdef SQLITE_DEBUG
   u8 lockError;              /* True if a locking error has occurred */
 #endif
@@ -44344,6 +45509,12 @@ static int walIndexRecover(Wal *pWal){
   }
   WALTRACE(("WAL%p: recovery begin...\n", pWal));
 
+  /* Recovery may find a WAL file with the same header as one seen before
+  ** but different content, for example if the files were replaced while
+  ** the database was superlocked.  So pages cached in the shared WAL page
+  ** cache before this point must not be used again.  */
+  sqlite3WalCacheNewGeneration(pWal->pCacheFile);
+
   memset(&pWal->hdr, 0, sizeof(WalIndexHdr));
 
   rc = sqlite3OsFileSize(pWal->pWalFd, &nSize);
@@ -44561,6 +45732,9 @@ SQLITE_PRIVATE int sqlite3WalOpen(
     sqlite3OsClose(pRet->pWalFd);
     sqlite3_free(pRet);
   }else{
+    if( !bNoShm ){
+      pRet->pCacheFile = sqlite3WalCacheOpen(zWalName);
+    }
     *ppWal = pRet;
     WALTRACE(("WAL%d: opened\n", pRet));
   }
@@ -44903,6 +46077,7 @@ static int walCheckpoint(
   int (*xBusyCall)(void*),        /* Function to call when busy */
   void *pBusyArg,                 /* Context argument for xBusyHandler */
   int sync_flags,                 /* Flags for OsSync() (or 0) */
+  u32 nBatch,                     /* Max frames to backfill, or 0 for all */
   u8 *zBuf                        /* Temporary buffer to use */
 ){
   int rc;                         /* Return code */
@@ -44938,6 +46113,16 @@ static int walCheckpoint(
   */
   mxSafeFrame = pWal->hdr.mxFrame;
   mxPage = pWal->hdr.nPage;
+
+  /* If nBatch is non-zero, backfill at most nBatch frames.  Stopping short
+  ** of the end of the log is safe for the same reason as stopping at the
+  ** read-mark of an active reader: frames between nBackfill and mxFrame
+  ** are still found in the log by readers, and the log is not restarted
+  ** until all of it has been backfilled. */
+  if( nBatch && mxSafeFrame-pInfo->nBackfill>nBatch ){
+    mxSafeFrame = pInfo->nBackfill + nBatch;
+  }
+
   for(i=1; i<WAL_NREADER; i++){
     u32 y = pInfo->aReadMark[i];
     if( mxSafeFrame>y ){
@@ -45067,13 +46252,14 @@ SQLITE_PRIVATE int sqlite3WalClose(
         pWal->exclusiveMode = WAL_EXCLUSIVE_MODE;
       }
       rc = sqlite3WalCheckpoint(
-          pWal, SQLITE_CHECKPOINT_PASSIVE, 0, 0, sync_flags, nBuf, zBuf, 0, 0
+          pWal, SQLITE_CHECKPOINT_PASSIVE, 0, 0, sync_flags, 0, nBuf, zBuf, 0, 0
       );
       if( rc==SQLITE_OK ){
         isDelete = 1;
       }
     }
 
+    sqlite3WalCacheClose(pWal->pCacheFile);
     walIndexClose(pWal, isDelete);
     sqlite3OsClose(pWal->pWalFd);
     if( isDelete ){
@@ -45485,19 +46671,17 @@ SQLITE_PRIVATE void sqlite3WalEndReadTransaction(Wal *pWal){
 }
 
 /*
-** Read a page from the WAL, if it is present in the WAL and if the 
-** current read transaction is configured to use the WAL.  
+** Search the wal file for page pgno. If found, set *piRead to the frame that
+** contains the page. Otherwise, if pgno is not in the wal file, set *piRead
+** to zero.
 **
-** The *pInWal is set to 1 if the requested page is in the WAL and
-** has been loaded.  Or *pInWal is set to 0 if the page was not in 
-** the WAL and needs to be read out of the database.
+** Return SQLITE_OK if successful, or an error code if an error occurs. If an
+** error does occur, the final value of *piRead is undefined.
 */
-SQLITE_PRIVATE int sqlite3WalRead(
+SQLITE_PRIVATE int sqlite3WalFindFrame(
   Wal *pWal,                      /* WAL handle */
   Pgno pgno,                      /* Database page number to read data for */
-  int *pInWal,                    /* OUT: True if data is read from WAL */
-  int nOut,                       /* Size of buffer pOut in bytes */
-  u8 *pOut                        /* Buffer to write page data to */
+  u32 *piRead                     /* OUT: Frame number (or zero) */
 ){
   u32 iRead = 0;                  /* If !=0, WAL frame to return data from */
   u32 iLast = pWal->hdr.mxFrame;  /* Last page in WAL for this reader */
@@ -45513,7 +46697,7 @@ SQLITE_PRIVATE int sqlite3WalRead(
   ** WAL were empty.
   */
   if( iLast==0 || pWal->readLock==0 ){
-    *pInWal = 0;
+    *piRead = 0;
     return SQLITE_OK;
   }
 
@@ -45584,26 +46768,32 @@ SQLITE_PRIVATE int sqlite3WalRead(
   }
 #endif
 
-  /* If iRead is non-zero, then it is the log frame number that contains the
-  ** required page. Read and return data from the log file.
-  */
-  if( iRead ){
-    int sz;
-    i64 iOffset;
-    sz = pWal->hdr.szPage;
-    sz = (pWal->hdr.szPage&0xfe00) + ((pWal->hdr.szPage&0x0001)<<16);
-    testcase( sz<=32768 );
-    testcase( sz>=65536 );
-    iOffset = walFrameOffset(iRead, sz) + WAL_FRAME_HDRSIZE;
-    *pInWal = 1;
-    /* testcase( IS_BIG_INT(iOffset) ); // requires a 4GiB WAL */
-    return sqlite3OsRead(pWal->pWalFd, pOut, nOut, iOffset);
-  }
-
-  *pInWal = 0;
+  *piRead = iRead;
   return SQLITE_OK;
 }
 
+/*
+** Read the contents of frame iRead from the wal file into buffer pOut
+** (which is nOut bytes in size). Return SQLITE_OK if successful, or an
+** error code otherwise.
+*/
+SQLITE_PRIVATE int sqlite3WalReadFrame(
+  Wal *pWal,                      /* WAL handle */
+  u32 iRead,                      /* Frame to read */
+  int nOut,                       /* Size of buffer pOut in bytes */
+  u8 *pOut                        /* Buffer to write page data to */
+){
+  int sz;
+  i64 iOffset;
+  sz = pWal->hdr.szPage;
+  sz = (pWal->hdr.szPage&0xfe00) + ((pWal->hdr.szPage&0x0001)<<16);
+  testcase( sz<=32768 );
+  testcase( sz>=65536 );
+  iOffset = walFrameOffset(iRead, sz) + WAL_FRAME_HDRSIZE;
+  /* testcase( IS_BIG_INT(iOffset) ); // requires a 4GiB WAL */
+  return sqlite3OsRead(pWal->pWalFd, pOut, nOut, iOffset);
+}
+
 
 /* 
 ** Return the size of the database in pages (or zero, if unknown).
@@ -46015,6 +47205,7 @@ SQLITE_PRIVATE int sqlite3WalCheckpoint(
   int (*xBusy)(void*),            /* Function to call when busy */
   void *pBusyArg,                 /* Context argument for xBusyHandler */
   int sync_flags,                 /* Flags to sync db file with (or 0) */
+  int nBatch,                     /* Max frames to backfill, or 0 for all */
   int nBuf,                       /* Size of temporary buffer */
   u8 *zBuf,                       /* Temporary buffer to use */
   int *pnLog,                     /* OUT: Number of frames in WAL */
@@ -46066,7 +47257,8 @@ SQLITE_PRIVATE int sqlite3WalCheckpoint(
     if( pWal->hdr.mxFrame && walPagesize(pWal)!=nBuf ){
       rc = SQLITE_CORRUPT_BKPT;
     }else{
-      rc = walCheckpoint(pWal, eMode2, xBusy, pBusyArg, sync_flags, zBuf);
+      rc = walCheckpoint(pWal, eMode2, xBusy, pBusyArg, sync_flags,
+                         (u32)nBatch, zBuf);
     }
 
     /* If no error occurred, set the output variables. */
@@ -46108,6 +47300,20 @@ SQLITE_PRIVATE int sqlite3WalCallback(Wal *pWal){
   return (int)ret;
 }
 
+/*
+** Return the number of frames in the log, as of the current snapshot of
+** connection pWal, that have not yet been backfilled into the database
+** file.  This is only used for reporting, so no locks are taken to read
+** the backfill counter.
+*/
+SQLITE_PRIVATE int sqlite3WalBacklog(Wal *pWal){
+  u32 nBackfill;
+  if( pWal==0 || pWal->nWiData==0 || pWal->apWiData[0]==0 ) return 0;
+  nBackfill = walCkptInfo(pWal)->nBackfill;
+  if( nBackfill>=pWal->hdr.mxFrame ) return 0;
+  return (int)(pWal->hdr.mxFrame - nBackfill);
+}
+
 /*
 ** This function is called to change the WAL subsystem into or out
 ** of locking_mode=EXCLUSIVE.
@@ -46178,9 +47384,642 @@ SQLITE_PRIVATE int sqlite3WalHeapMemory(Wal *pWal){
   return (pWal && pWal->exclusiveMode==WAL_HEAPMEMORY_MODE );
 }
 
+/*
+** Fill in *pKey with the shared page cache key for a page read from
+** frame iFrame of the current snapshot, or from the database file if
+** iFrame is zero.  Return true if successful, or false if the shared
+** page cache is not in use for this WAL.
+**
+** A database page that is not in the WAL snapshot of a reader can only
+** be modified in the database file by a checkpoint, which increases
+** nBackfill, or after the WAL is restarted, which changes the salts.
+** So the salts and the value of nBackfill identify the version of a page
+** read from the database file:
+**
+**   * A connection holding WAL_READ_LOCK(0) prevents checkpoints, and
+**     nBackfill was equal to its mxFrame when the read lock was taken.
+**     It uses mxFrame, since the WAL may be restarted (resetting
+**     nBackfill to zero) while it continues to read the database file.
+**
+**   * nBackfill never exceeds the mxFrame of a connection holding any
+**     other read lock, and such a connection prevents the WAL from being
+**     restarted.  So frames backfilled while it reads cannot be for a
+**     page it reads from the database file, and the current value of
+**     nBackfill may be used.
+*/
+SQLITE_PRIVATE int sqlite3WalCachePageKey(Wal *pWal, u32 iFrame, WalCacheKey *pKey){
+  assert( pWal->readLock>=0 );
+  if( pWal->pCacheFile==0 ) return 0;
+  memset(pKey, 0, sizeof(WalCacheKey));
+  pKey->pFile = pWal->pCacheFile;
+  pKey->iGeneration = sqlite3WalCacheGeneration(pWal->pCacheFile);
+  pKey->iFrame = iFrame;
+  pKey->aSalt[0] = pWal->hdr.aSalt[0];
+  pKey->aSalt[1] = pWal->hdr.aSalt[1];
+  if( iFrame ){
+    pKey->nBackfill = 0;
+  }else if( pWal->readLock==0 ){
+    pKey->nBackfill = pWal->hdr.mxFrame;
+  }else{
+    pKey->nBackfill = walCkptInfo(pWal)->nBackfill;
+  }
+  return 1;
+}
+
 #endif /* #ifndef SQLITE_OMIT_WAL */
 
 /************** End of wal.c *************************************************/
+/************** Begin file walcache.c ****************************************/
+/*
+** 2011 August 22
+**
+** The author disclaims copyright to this source code.  In place of
+** a legal notice, here is a blessing:
+**
+**    May you do good and not evil.
+**    May you find forgiveness for yourself and forgive others.
+**    May you share freely, never taking more than you give.
+**
+*************************************************************************
+**
+** This file implements a process-wide, read-only cache of database pages
+** that is shared by all connections to the same WAL mode database file.
+**
+** Normally each connection has its own page cache, so when many
+** connections read the same database each of them holds its own copy of
+** the hot pages.  With the shared cache enabled (SQLITE_CONFIG_WALCACHE),
+** a connection that has no write transaction open looks for a page here
+** before going to disk, and the page content it returns is used directly
+** (the pager wraps it in a read-only page object, just as it does for
+** memory mapped pages).
+**
+** Within a single WAL file the content of a frame never changes once it
+** has been committed, and the content of a database page that has no
+** frame in a reader's snapshot only changes when a checkpoint copies new
+** frames into the database file.  So each cached page is identified by:
+**
+**   * the file it belongs to (the name of the WAL file),
+**   * a generation number that is incremented each time the wal-index
+**     of the file is recovered, since the WAL and database files may
+**     have been replaced when that happens,
+**   * the page number,
+**   * the WAL frame it was read from, or zero if it was read from the
+**     database file,
+**   * the two salt values from the WAL header, which change each time
+**     the WAL is restarted, and
+**   * for pages read from the database file, the number of frames that
+**     had been backfilled into the database when the page was read.
+**
+** Entries that are no longer current are never returned to a reader,
+** they simply age out of the LRU list.  There is no explicit invalidation.
+**
+** The cache is divided into WALCACHE_NSHARD shards, chosen by page
+** number, each with its own mutex, hash table, LRU list of unpinned
+** entries and an equal share of the memory budget.
+*/
+#ifndef SQLITE_OMIT_WAL
+
+
+/*
+** Number of independently locked shards the cache is divided into.
+*/
+#ifndef WALCACHE_NSHARD
+# define WALCACHE_NSHARD 16
+#endif
+
+typedef struct WalCachePage WalCachePage;
+typedef struct WalCacheShard WalCacheShard;
+
+/*
+** One of these objects is allocated for each distinct WAL file that is
+** open by one or more connections in the process.  Entries in the cache
+** refer to the file using a pointer to this object.
+*/
+struct WalCacheFile {
+  char *zName;                    /* Name of the WAL file */
+  int nRef;                       /* Number of Wal objects using this file */
+  u32 iGeneration;                /* Current generation of cached pages */
+  WalCacheFile *pNext;            /* Next file in walcache.pFileList */
+};
+
+/*
+** Each cached page is an instance of the following object.  The page
+** content follows the header, beginning at WALCACHE_DATA(p).
+**
+** An entry with nRef>0 is pinned by one or more readers.  Unpinned
+** entries are linked into the LRU list of their shard.  The most
+** recently used entry is at the head of the list.
+*/
+struct WalCachePage {
+  WalCacheKey key;                /* Identity of the cached content */
+  Pgno pgno;                      /* Page number */
+  int szPage;                     /* Size of the page content in bytes */
+  int nRef;                       /* Number of outstanding references */
+  u8 isHashed;                    /* True once inserted into apHash[] */
+  WalCachePage *pHashNext;        /* Next entry in the same hash bucket */
+  WalCachePage *pLruNext;         /* Next (older) entry in the LRU list */
+  WalCachePage *pLruPrev;         /* Previous (newer) entry in the LRU list */
+};
+
+#define WALCACHE_HDRSIZE  ROUND8(sizeof(WalCachePage))
+#define WALCACHE_DATA(p)  ((void*)&((u8*)(p))[WALCACHE_HDRSIZE])
+#define WALCACHE_PAGE(d)  ((WalCachePage*)&((u8*)(d))[-WALCACHE_HDRSIZE])
+
+/*
+** A shard of the cache.  All fields are protected by the shard mutex.
+*/
+struct WalCacheShard {
+  sqlite3_mutex *mutex;           /* Mutex protecting this shard */
+  WalCachePage **apHash;          /* Hash table of entries */
+  unsigned int nHash;             /* Number of slots in apHash[] */
+  unsigned int nPage;             /* Number of entries in apHash[] */
+  WalCachePage *pLruHead;         /* Most recently unpinned entry */
+  WalCachePage *pLruTail;         /* Least recently unpinned entry */
+  i64 nByte;                      /* Bytes allocated or reserved */
+};
+
+/*
+** Global data used by this module.  The mutex protects the list of open
+** files and the SQLITE_STATUS_WALCACHE_USED counter.  It is never held
+** while a shard mutex is being acquired.
+*/
+static SQLITE_WSD struct WalCacheGlobal {
+  sqlite3_mutex *mutex;                  /* Mutex for pFileList and status */
+  WalCacheFile *pFileList;               /* List of open files */
+  WalCacheShard aShard[WALCACHE_NSHARD]; /* The shards */
+} walcache_g;
+
+#define walcache (GLOBAL(struct WalCacheGlobal, walcache_g))
+
+/*
+** Return the hash of page pgno of file pFile.  The shard is selected
+** using the low-order bits of the hash and the hash table slot within
+** the shard using the remaining bits.
+*/
+static unsigned int walCacheHash(WalCacheFile *pFile, Pgno pgno){
+  return (unsigned int)pgno*0x9e3779b1u
+       ^ ((unsigned int)SQLITE_PTR_TO_INT(pFile)>>4);
+}
+static WalCacheShard *walCacheShard(unsigned int h){
+  return &walcache.aShard[h % WALCACHE_NSHARD];
+}
+static unsigned int walCacheSlot(WalCacheShard *pShard, unsigned int h){
+  return (h / WALCACHE_NSHARD) % pShard->nHash;
+}
+
+/*
+** Return the amount of memory each shard may use.
+*/
+static i64 walCacheShardLimit(void){
+  return sqlite3GlobalConfig.szWalCache / WALCACHE_NSHARD;
+}
+
+/*
+** Adjust the SQLITE_STATUS_WALCACHE_USED counter by nByte bytes.
+*/
+static void walCacheStatusAdd(i64 nByte){
+  sqlite3_mutex_enter(walcache.mutex);
+  sqlite3StatusAdd(SQLITE_STATUS_WALCACHE_USED, (int)nByte);
+  sqlite3_mutex_leave(walcache.mutex);
+}
+
+/*
+** Remove entry p from the LRU list of shard pShard.
+*/
+static void walCacheLruRemove(WalCacheShard *pShard, WalCachePage *p){
+  assert( sqlite3_mutex_held(pShard->mutex) );
+  if( p->pLruPrev ){
+    p->pLruPrev->pLruNext = p->pLruNext;
+  }else{
+    pShard->pLruHead = p->pLruNext;
+  }
+  if( p->pLruNext ){
+    p->pLruNext->pLruPrev = p->pLruPrev;
+  }else{
+    pShard->pLruTail = p->pLruPrev;
+  }
+  p->pLruNext = p->pLruPrev = 0;
+}
+
+/*
+** Remove unpinned entry p from the hash table and LRU list of pShard and
+** free it.  Return the number of bytes released.
+*/
+static int walCacheEvict(WalCacheShard *pShard, WalCachePage *p){
+  WalCachePage **pp;
+  unsigned int h = walCacheHash(p->key.pFile, p->pgno);
+  int nFree = WALCACHE_HDRSIZE + p->szPage;
+
+  assert( sqlite3_mutex_held(pShard->mutex) );
+  assert( p->nRef==0 && p->isHashed );
+  walCacheLruRemove(pShard, p);
+  for(pp=&pShard->apHash[walCacheSlot(pShard, h)]; *pp!=p; pp=&(*pp)->pHashNext);
+  *pp = p->pHashNext;
+  pShard->nPage--;
+  pShard->nByte -= nFree;
+  sqlite3_free(p);
+  return nFree;
+}
+
+/*
+** Evict unpinned entries from the tail of the LRU list of pShard until
+** at least nReq bytes have been released or the list is empty.  If nReq
+** is negative, all unpinned entries are evicted.  Return the number of
+** bytes released.
+*/
+static int walCacheEvictLru(WalCacheShard *pShard, i64 nReq){
+  int nFree = 0;
+  while( (nReq<0 || nFree<nReq) && pShard->pLruTail ){
+    nFree += walCacheEvict(pShard, pShard->pLruTail);
+  }
+  return nFree;
+}
+
+/*
+** Grow the hash table of pShard so that it has at least as many slots as
+** there are entries.  Failure to allocate a new table is harmless, the
+** old one continues to be used.
+**
+** The shard mutex is released while the new table is allocated, as the
+** allocation may call sqlite3_release_memory().
+*/
+static void walCacheResizeHash(WalCacheShard *pShard){
+  WalCachePage **apNew;
+  unsigned int nNew;
+  unsigned int i;
+
+  assert( sqlite3_mutex_held(pShard->mutex) );
+  nNew = pShard->nHash*2;
+  if( nNew<256 ) nNew = 256;
+
+  sqlite3_mutex_leave(pShard->mutex);
+  sqlite3BeginBenignMalloc();
+  apNew = (WalCachePage **)sqlite3_malloc(sizeof(WalCachePage *)*nNew);
+  sqlite3EndBenignMalloc();
+  sqlite3_mutex_enter(pShard->mutex);
+
+  if( apNew && nNew<=pShard->nHash ){
+    /* Another thread grew the table while the mutex was released. */
+    sqlite3_free(apNew);
+  }else if( apNew ){
+    memset(apNew, 0, sizeof(WalCachePage *)*nNew);
+    for(i=0; i<pShard->nHash; i++){
+      WalCachePage *p;
+      WalCachePage *pNext = pShard->apHash[i];
+      while( (p = pNext)!=0 ){
+        unsigned int h = walCacheHash(p->key.pFile, p->pgno);
+        pNext = p->pHashNext;
+        p->pHashNext = apNew[(h / WALCACHE_NSHARD) % nNew];
+        apNew[(h / WALCACHE_NSHARD) % nNew] = p;
+      }
+    }
+    sqlite3_free(pShard->apHash);
+    pShard->apHash = apNew;
+    pShard->nHash = nNew;
+  }
+}
+
+/*
+** Search pShard for the entry with key pKey.  Return it, or NULL if there
+** is no such entry.
+*/
+static WalCachePage *walCacheFind(
+  WalCacheShard *pShard,
+  unsigned int h,
+  Pgno pgno,
+  const WalCacheKey *pKey,
+  int szPage
+){
+  WalCachePage *p = 0;
+  assert( sqlite3_mutex_held(pShard->mutex) );
+  if( pShard->nHash ){
+    for(p=pShard->apHash[walCacheSlot(pShard, h)]; p; p=p->pHashNext){
+      if( p->pgno==pgno
+       && p->szPage==szPage
+       && memcmp(&p->key, pKey, sizeof(WalCacheKey))==0
+      ){
+        break;
+      }
+    }
+  }
+  return p;
+}
+
+/*
+** Initialize and shut down the shared WAL page cache.  These routines
+** are called by sqlite3_initialize() and sqlite3_shutdown().  Nothing is
+** allocated unless the cache is enabled.
+*/
+SQLITE_PRIVATE int sqlite3WalCacheInitialize(void){
+  int i;
+  memset(&walcache, 0, sizeof(walcache));
+  if( sqlite3GlobalConfig.szWalCache>0 && sqlite3GlobalConfig.bCoreMutex ){
+    walcache.mutex = sqlite3MutexAlloc(SQLITE_MUTEX_FAST);
+    if( walcache.mutex==0 ) return SQLITE_NOMEM;
+    for(i=0; i<WALCACHE_NSHARD; i++){
+      walcache.aShard[i].mutex = sqlite3MutexAlloc(SQLITE_MUTEX_FAST);
+      if( walcache.aShard[i].mutex==0 ){
+        sqlite3WalCacheShutdown();
+        return SQLITE_NOMEM;
+      }
+    }
+  }
+  return SQLITE_OK;
+}
+SQLITE_PRIVATE void sqlite3WalCacheShutdown(void){
+  int i;
+  assert( walcache.pFileList==0 );
+  for(i=0; i<WALCACHE_NSHARD; i++){
+    WalCacheShard *pShard = &walcache.aShard[i];
+    assert( pShard->nPage==0 );
+    sqlite3_free(pShard->apHash);
+    sqlite3_mutex_free(pShard->mutex);
+  }
+  sqlite3_mutex_free(walcache.mutex);
+  memset(&walcache, 0, sizeof(walcache));
+}
+
+/*
+** Return a handle for the WAL file zName, to be used as part of the keys
+** of pages read from it.  Return NULL if the shared cache is disabled or
+** if a malloc fails.  Each successful call must be matched by a call to
+** sqlite3WalCacheClose().
+*/
+SQLITE_PRIVATE WalCacheFile *sqlite3WalCacheOpen(const char *zName){
+  WalCacheFile *pFile;
+  WalCacheFile *pNew;
+  int nName = sqlite3Strlen30(zName);
+
+  if( sqlite3GlobalConfig.szWalCache<=0 ) return 0;
+
+  /* Allocate the new object before entering the mutex, as the allocation
+  ** may call sqlite3_release_memory(), which also uses the mutex. */
+  sqlite3BeginBenignMalloc();
+  pNew = (WalCacheFile *)sqlite3MallocZero(sizeof(WalCacheFile) + nName + 1);
+  sqlite3EndBenignMalloc();
+
+  sqlite3_mutex_enter(walcache.mutex);
+  for(pFile=walcache.pFileList; pFile; pFile=pFile->pNext){
+    if( strcmp(pFile->zName, zName)==0 ) break;
+  }
+  if( pFile==0 && pNew ){
+    pFile = pNew;
+    pNew = 0;
+    pFile->zName = (char *)&pFile[1];
+    memcpy(pFile->zName, zName, nName+1);
+    pFile->pNext = walcache.pFileList;
+    walcache.pFileList = pFile;
+  }
+  if( pFile ) pFile->nRef++;
+  sqlite3_mutex_leave(walcache.mutex);
+
+  sqlite3_free(pNew);
+  return pFile;
+}
+
+/*
+** Release a handle obtained from sqlite3WalCacheOpen().  When the last
+** handle on a file is released, all cached pages of the file are freed.
+** They cannot be pinned at this point, as only connections that have the
+** file open may hold references to its pages.
+*/
+SQLITE_PRIVATE void sqlite3WalCacheClose(WalCacheFile *pFile){
+  int bLast = 0;
+  if( pFile==0 ) return;
+
+  sqlite3_mutex_enter(walcache.mutex);
+  if( --pFile->nRef==0 ){
+    WalCacheFile **pp;
+    for(pp=&walcache.pFileList; *pp!=pFile; pp=&(*pp)->pNext);
+    *pp = pFile->pNext;
+    bLast = 1;
+  }
+  sqlite3_mutex_leave(walcache.mutex);
+
+  if( bLast ){
+    i64 nFree = 0;
+    int i;
+    for(i=0; i<WALCACHE_NSHARD; i++){
+      WalCacheShard *pShard = &walcache.aShard[i];
+      unsigned int j;
+      sqlite3_mutex_enter(pShard->mutex);
+      for(j=0; j<pShard->nHash; j++){
+        WalCachePage *p = pShard->apHash[j];
+        while( p ){
+          WalCachePage *pNext = p->pHashNext;
+          if( p->key.pFile==pFile ){
+            nFree += walCacheEvict(pShard, p);
+          }
+          p = pNext;
+        }
+      }
+      sqlite3_mutex_leave(pShard->mutex);
+    }
+    if( nFree ) walCacheStatusAdd(-nFree);
+    sqlite3_free(pFile);
+  }
+}
+
+/*
+** Start a new generation of cached pages for file pFile.  Pages cached
+** with an earlier generation are never returned by sqlite3WalCacheFetch()
+** again.  This is called when the wal-index of the file is recovered.
+**
+** The generation is read without the mutex by sqlite3WalCacheGeneration().
+** A reader that sees the old value may still find or add pages of the old
+** generation, but only while it continues to use a snapshot from before
+** the recovery.
+*/
+SQLITE_PRIVATE void sqlite3WalCacheNewGeneration(WalCacheFile *pFile){
+  if( pFile ){
+    sqlite3_mutex_enter(walcache.mutex);
+    pFile->iGeneration++;
+    sqlite3_mutex_leave(walcache.mutex);
+  }
+}
+SQLITE_PRIVATE u32 sqlite3WalCacheGeneration(WalCacheFile *pFile){
+  return pFile->iGeneration;
+}
+
+/*
+** Look up page pgno with key pKey.  If it is present, pin it and return a
+** pointer to its szPage bytes of content.  Otherwise return NULL.
+*/
+SQLITE_PRIVATE void *sqlite3WalCacheFetch(Pgno pgno, const WalCacheKey *pKey, int szPage){
+  unsigned int h = walCacheHash(pKey->pFile, pgno);
+  WalCacheShard *pShard = walCacheShard(h);
+  WalCachePage *p;
+
+  sqlite3_mutex_enter(pShard->mutex);
+  p = walCacheFind(pShard, h, pgno, pKey, szPage);
+  if( p ){
+    if( p->nRef==0 ) walCacheLruRemove(pShard, p);
+    p->nRef++;
+  }
+  sqlite3_mutex_leave(pShard->mutex);
+  return p ? WALCACHE_DATA(p) : 0;
+}
+
+/*
+** Allocate a buffer for page pgno with key pKey, making room for it by
+** evicting unpinned pages of the same shard if required.  The caller
+** fills the buffer with the page content and then passes it to either
+** sqlite3WalCacheInsert() or, if the content could not be read,
+** sqlite3WalCacheDiscard().
+**
+** NULL is returned if the page does not fit in the memory budget or if
+** a malloc fails.  The caller should then read the page into its own
+** private cache instead.
+*/
+SQLITE_PRIVATE void *sqlite3WalCacheAlloc(Pgno pgno, const WalCacheKey *pKey, int szPage){
+  unsigned int h = walCacheHash(pKey->pFile, pgno);
+  WalCacheShard *pShard = walCacheShard(h);
+  int nByte = WALCACHE_HDRSIZE + szPage;
+  i64 mxByte = walCacheShardLimit();
+  int nFree = 0;
+  WalCachePage *p = 0;
+
+  /* Reserve space for the new page within the budget of the shard. The
+  ** allocation itself is made without holding the mutex, as it may call
+  ** sqlite3_release_memory(). */
+  sqlite3_mutex_enter(pShard->mutex);
+  if( pShard->nByte+nByte>mxByte ){
+    nFree = walCacheEvictLru(pShard, pShard->nByte+nByte-mxByte);
+  }
+  if( pShard->nByte+nByte<=mxByte ){
+    pShard->nByte += nByte;
+    sqlite3_mutex_leave(pShard->mutex);
+    sqlite3BeginBenignMalloc();
+    p = (WalCachePage *)sqlite3Malloc(nByte);
+    sqlite3EndBenignMalloc();
+    if( p==0 ){
+      sqlite3_mutex_enter(pShard->mutex);
+      pShard->nByte -= nByte;
+      sqlite3_mutex_leave(pShard->mutex);
+    }
+  }else{
+    sqlite3_mutex_leave(pShard->mutex);
+  }
+
+  if( p ){
+    memset(p, 0, sizeof(WalCachePage));
+    p->key = *pKey;
+    p->pgno = pgno;
+    p->szPage = szPage;
+    p->nRef = 1;
+    nFree -= nByte;
+  }
+  if( nFree ) walCacheStatusAdd(-nFree);
+  return p ? WALCACHE_DATA(p) : 0;
+}
+
+/*
+** Free a buffer returned by sqlite3WalCacheAlloc() without adding it to
+** the cache.
+*/
+SQLITE_PRIVATE void sqlite3WalCacheDiscard(void *pData){
+  WalCachePage *p = WALCACHE_PAGE(pData);
+  unsigned int h = walCacheHash(p->key.pFile, p->pgno);
+  WalCacheShard *pShard = walCacheShard(h);
+  int nByte = WALCACHE_HDRSIZE + p->szPage;
+
+  assert( p->isHashed==0 && p->nRef==1 );
+  sqlite3_mutex_enter(pShard->mutex);
+  pShard->nByte -= nByte;
+  sqlite3_mutex_leave(pShard->mutex);
+  sqlite3_free(p);
+  walCacheStatusAdd(-nByte);
+}
+
+/*
+** Add a buffer returned by sqlite3WalCacheAlloc() and filled in by the
+** caller to the cache.  The new entry is pinned.  If another connection
+** added the same page in the meantime, the buffer is freed and the
+** existing entry is pinned and returned instead.
+*/
+SQLITE_PRIVATE void *sqlite3WalCacheInsert(void *pData){
+  WalCachePage *p = WALCACHE_PAGE(pData);
+  unsigned int h = walCacheHash(p->key.pFile, p->pgno);
+  WalCacheShard *pShard = walCacheShard(h);
+  WalCachePage *pOther;
+
+  assert( p->isHashed==0 && p->nRef==1 );
+  sqlite3_mutex_enter(pShard->mutex);
+  if( pShard->nPage>=pShard->nHash ) walCacheResizeHash(pShard);
+  pOther = walCacheFind(pShard, h, p->pgno, &p->key, p->szPage);
+  if( pOther ){
+    if( pOther->nRef==0 ) walCacheLruRemove(pShard, pOther);
+    pOther->nRef++;
+  }else{
+    if( pShard->nHash ){
+      unsigned int iSlot = walCacheSlot(pShard, h);
+      p->pHashNext = pShard->apHash[iSlot];
+      pShard->apHash[iSlot] = p;
+      p->isHashed = 1;
+      pShard->nPage++;
+    }
+  }
+  sqlite3_mutex_leave(pShard->mutex);
+
+  if( pOther ){
+    sqlite3WalCacheDiscard(pData);
+    return WALCACHE_DATA(pOther);
+  }
+  return pData;
+}
+
+/*
+** Release a reference to page content returned by sqlite3WalCacheFetch()
+** or sqlite3WalCacheInsert().
+*/
+SQLITE_PRIVATE void sqlite3WalCacheRelease(void *pData){
+  WalCachePage *p = WALCACHE_PAGE(pData);
+  unsigned int h = walCacheHash(p->key.pFile, p->pgno);
+  WalCacheShard *pShard = walCacheShard(h);
+
+  if( p->isHashed==0 ){
+    /* The hash table could not be allocated when this page was inserted,
+    ** so it was never shared.  Free it now. */
+    sqlite3WalCacheDiscard(pData);
+    return;
+  }
+  sqlite3_mutex_enter(pShard->mutex);
+  assert( p->nRef>0 );
+  if( --p->nRef==0 ){
+    p->pLruNext = pShard->pLruHead;
+    if( pShard->pLruHead ){
+      pShard->pLruHead->pLruPrev = p;
+    }else{
+      pShard->pLruTail = p;
+    }
+    pShard->pLruHead = p;
+  }
+  sqlite3_mutex_leave(pShard->mutex);
+}
+
+#ifdef SQLITE_ENABLE_MEMORY_MANAGEMENT
+/*
+** Free up to nReq bytes of memory held by unpinned pages.  Return the
+** number of bytes actually freed.  This routine is called by
+** sqlite3_release_memory().
+*/
+SQLITE_PRIVATE int sqlite3WalCacheReleaseMemory(int nReq){
+  int nFree = 0;
+  int i;
+  for(i=0; i<WALCACHE_NSHARD && (nReq<0 || nFree<nReq); i++){
+    WalCacheShard *pShard = &walcache.aShard[i];
+    sqlite3_mutex_enter(pShard->mutex);
+    nFree += walCacheEvictLru(pShard, nReq<0 ? -1 : nReq-nFree);
+    sqlite3_mutex_leave(pShard->mutex);
+  }
+  if( nFree ) walCacheStatusAdd(-nFree);
+  return nFree;
+}
+#endif /* SQLITE_ENABLE_MEMORY_MANAGEMENT */
+
+#endif /* #ifndef SQLITE_OMIT_WAL */
+
+/************** End of walcache.c ********************************************/
 /************** Begin file btmutex.c *****************************************/
 /*
 ** 2007 August 27
@@ -46549,6 +48388,7 @@ struct Btree {
   u8 locked;         /* True if db currently has pBt locked */
   int wantToLock;    /* Number of nested calls to sqlite3BtreeEnter() */
   int nBackup;       /* Number of backup operations reading this btree */
+  u32 nSeek;         /* Number of searches by cursors on this btree */
   Btree *pNext;      /* List of other sharable Btrees from the same db */
   Btree *pPrev;      /* Back pointer of the same list */
 #ifndef SQLITE_OMIT_SHARED_CACHE
@@ -46698,6 +48538,7 @@ struct BtCursor {
   u8 atLast;                /* Cursor pointing to the last entry */
   u8 validNKey;             /* True if info.nKey is valid */
   u8 eState;                /* One of the CURSOR_XXX constants (see below) */
+  u8 nBulkFill;             /* Percent of each page filled by appends, or 0 */
 #ifndef SQLITE_OMIT_INCRBLOB
   Pgno *aOverflow;          /* Cache of overflow page locations */
   u8 isIncrblobHandle;      /* True if this cursor is an incr. io handle */
@@ -48646,24 +50487,29 @@ static MemPage *btreePageFromDbPage(DbPage *pDbPage, Pgno pgno, BtShared *pBt){
 ** Get a page from the pager.  Initialize the MemPage.pBt and
 ** MemPage.aData elements if needed.
 **
-** If the noContent flag is set, it means that we do not care about
-** the content of the page at this time.  So do not go to the disk
-** to fetch the content.  Just fill in the content with zeros for now.
+** If the PAGER_ACQUIRE_NOCONTENT flag is set, it means that we do not
+** care about the content of the page at this time.  So do not go to the
+** disk to fetch the content.  Just fill in the content with zeros for now.
 ** If in the future we call sqlite3PagerWrite() on this page, that
 ** means we have started to be concerned about content and the disk
 ** read should occur at that point.
+**
+** If the PAGER_ACQUIRE_READONLY flag is set, the caller promises never to
+** write to the page, so the pager may return a memory mapped page.
 */
 static int btreeGetPage(
   BtShared *pBt,       /* The btree */
   Pgno pgno,           /* Number of the page to fetch */
   MemPage **ppPage,    /* Return the page in this parameter */
-  int noContent        /* Do not load page content if true */
+  int flags            /* PAGER_ACQUIRE_NOCONTENT or PAGER_ACQUIRE_READONLY */
 ){
   int rc;
   DbPage *pDbPage;
 
+  assert( flags==0 || flags==PAGER_ACQUIRE_NOCONTENT 
+       || flags==PAGER_ACQUIRE_READONLY );
   assert( sqlite3_mutex_held(pBt->mutex) );
-  rc = sqlite3PagerAcquire(pBt->pPager, pgno, (DbPage**)&pDbPage, noContent);
+  rc = sqlite3PagerAcquire(pBt->pPager, pgno, (DbPage**)&pDbPage, flags);
   if( rc ) return rc;
   *ppPage = btreePageFromDbPage(pDbPage, pgno, pBt);
   return SQLITE_OK;
@@ -48704,11 +50550,15 @@ SQLITE_PRIVATE u32 sqlite3BtreeLastPage(Btree *p){
 **
 ** If an error occurs, then the value *ppPage is set to is undefined. It
 ** may remain unchanged, or it may be set to an invalid value.
+**
+** If bReadonly is true, the page is only going to be read, so it may
+** be returned as a memory mapped page (see PAGER_ACQUIRE_READONLY).
 */
 static int getAndInitPage(
   BtShared *pBt,          /* The database file */
   Pgno pgno,           /* Number of the page to get */
-  MemPage **ppPage     /* Write the page pointer here */
+  MemPage **ppPage,    /* Write the page pointer here */
+  int bReadonly        /* True if a read-only (mmap) page is ok */
 ){
   int rc;
   assert( sqlite3_mutex_held(pBt->mutex) );
@@ -48716,7 +50566,7 @@ static int getAndInitPage(
   if( pgno>btreePagecount(pBt) ){
     rc = SQLITE_CORRUPT_BKPT;
   }else{
-    rc = btreeGetPage(pBt, pgno, ppPage, 0);
+    rc = btreeGetPage(pBt, pgno, ppPage, bReadonly?PAGER_ACQUIRE_READONLY:0);
     if( rc==SQLITE_OK ){
       rc = btreeInitPage(*ppPage);
       if( rc!=SQLITE_OK ){
@@ -49206,6 +51056,19 @@ SQLITE_PRIVATE int sqlite3BtreeSetCacheSize(Btree *p, int mxPage){
   return SQLITE_OK;
 }
 
+/*
+** Change the limit on the amount of the database file that may be
+** memory mapped.
+*/
+SQLITE_PRIVATE int sqlite3BtreeSetMmapLimit(Btree *p, sqlite3_int64 szMmap){
+  BtShared *pBt = p->pBt;
+  assert( sqlite3_mutex_held(p->db->mutex) );
+  sqlite3BtreeEnter(p);
+  sqlite3PagerSetMmapLimit(pBt->pPager, szMmap);
+  sqlite3BtreeLeave(p);
+  return SQLITE_OK;
+}
+
 /*
 ** Change the way data is synced to disk in order to increase or decrease
 ** how well the database resists damage due to OS crashes and power
@@ -50637,6 +52500,25 @@ SQLITE_PRIVATE void sqlite3BtreeCursorZero(BtCursor *p){
   memset(p, 0, offsetof(BtCursor, iPage));
 }
 
+/*
+** Put write cursor pCur into bulk-load mode, or take it out of bulk-load
+** mode if nFill is zero.
+**
+** In bulk-load mode, an entry appended to the right-hand end of a page
+** whose parent page points to it with the right-child pointer (as happens
+** when rowids or index keys are inserted in ascending order) is moved to
+** a new page once the page is nFill percent full. The full page is left
+** as it is instead of being rebalanced with its siblings, so that the
+** tree is built from the left, one page at a time, without rewriting
+** the pages it has already filled. See balance_bulk().
+*/
+SQLITE_PRIVATE void sqlite3BtreeCursorBulkLoad(BtCursor *pCur, int nFill){
+  assert( cursorHoldsMutex(pCur) );
+  assert( nFill==0 || (nFill>=50 && nFill<=100) );
+  assert( nFill==0 || pCur->wrFlag );
+  pCur->nBulkFill = (u8)nFill;
+}
+
 /*
 ** Set the cached rowid value of every cursor in the same database file
 ** as pCur and having the same root page number as pCur.  The value is
@@ -51046,7 +52928,9 @@ static int accessPayload(
         */
         DbPage *pDbPage;
         int a = amt;
-        rc = sqlite3PagerGet(pBt->pPager, nextPage, &pDbPage);
+        rc = sqlite3PagerAcquire(pBt->pPager, nextPage, &pDbPage,
+            (eOp==0 ? PAGER_ACQUIRE_READONLY : 0)
+        );
         if( rc==SQLITE_OK ){
           aPayload = sqlite3PagerGetData(pDbPage);
           nextPage = get4byte(aPayload);
@@ -51230,7 +53114,7 @@ static int moveToChild(BtCursor *pCur, u32 newPgno){
   if( pCur->iPage>=(BTCURSOR_MAX_DEPTH-1) ){
     return SQLITE_CORRUPT_BKPT;
   }
-  rc = getAndInitPage(pBt, newPgno, &pNewPage);
+  rc = getAndInitPage(pBt, newPgno, &pNewPage, pCur->wrFlag==0);
   if( rc ) return rc;
   pCur->apPage[i+1] = pNewPage;
   pCur->aiIdx[i+1] = 0;
@@ -51334,7 +53218,8 @@ static int moveToRoot(BtCursor *pCur){
     }
     pCur->iPage = 0;
   }else{
-    rc = getAndInitPage(pBt, pCur->pgnoRoot, &pCur->apPage[0]);
+    rc = getAndInitPage(pBt, pCur->pgnoRoot, &pCur->apPage[0],
+                        pCur->wrFlag==0);
     if( rc!=SQLITE_OK ){
       pCur->eState = CURSOR_INVALID;
       return rc;
@@ -51529,6 +53414,7 @@ SQLITE_PRIVATE int sqlite3BtreeMovetoUnpacked(
   int *pRes                /* Write search results here */
 ){
   int rc;
+  RecordCompare xRecordCompare = 0;  /* Compares cells against pIdxKey */
 
   assert( cursorHoldsMutex(pCur) );
   assert( sqlite3_mutex_held(pCur->pBtree->db->mutex) );
@@ -51550,6 +53436,7 @@ SQLITE_PRIVATE int sqlite3BtreeMovetoUnpacked(
     }
   }
 
+  pCur->pBtree->nSeek++;
   rc = moveToRoot(pCur);
   if( rc ){
     return rc;
@@ -51563,6 +53450,9 @@ SQLITE_PRIVATE int sqlite3BtreeMovetoUnpacked(
     return SQLITE_OK;
   }
   assert( pCur->apPage[0]->intKey || pIdxKey );
+  if( pIdxKey ){
+    xRecordCompare = sqlite3VdbeFindCompare(pIdxKey);
+  }
   for(;;){
     int lwr, upr;
     Pgno chldPg;
@@ -51621,13 +53511,13 @@ SQLITE_PRIVATE int sqlite3BtreeMovetoUnpacked(
           /* This branch runs if the record-size field of the cell is a
           ** single byte varint and the record fits entirely on the main
           ** b-tree page.  */
-          c = sqlite3VdbeRecordCompare(nCell, (void*)&pCell[1], pIdxKey);
+          c = xRecordCompare(nCell, (void*)&pCell[1], pIdxKey);
         }else if( !(pCell[1] & 0x80) 
           && (nCell = ((nCell&0x7f)<<7) + pCell[1])<=pPage->maxLocal
         ){
           /* The record-size field is a 2 byte varint and the record 
           ** fits entirely on the main b-tree page.  */
-          c = sqlite3VdbeRecordCompare(nCell, (void*)&pCell[2], pIdxKey);
+          c = xRecordCompare(nCell, (void*)&pCell[2], pIdxKey);
         }else{
           /* The record flows over onto one or more overflow pages. In
           ** this case the whole cell needs to be parsed, a buffer allocated
@@ -51647,7 +53537,7 @@ SQLITE_PRIVATE int sqlite3BtreeMovetoUnpacked(
             sqlite3_free(pCellKey);
             goto moveto_finish;
           }
-          c = sqlite3VdbeRecordCompare(nCell, pCellKey, pIdxKey);
+          c = xRecordCompare(nCell, pCellKey, pIdxKey);
           sqlite3_free(pCellKey);
         }
       }
@@ -52802,6 +54692,146 @@ static int balance_quick(MemPage *pParent, MemPage *pPage, u8 *pSpace){
 }
 #endif /* SQLITE_OMIT_QUICKBALANCE */
 
+/*
+** Return the number of bytes that a cursor in bulk-load mode leaves free
+** on each page it fills.
+*/
+static int bulkReserve(BtCursor *pCur){
+  assert( pCur->nBulkFill>=50 && pCur->nBulkFill<=100 );
+  return pCur->pBt->usableSize * (100 - pCur->nBulkFill) / 100;
+}
+
+/*
+** Return true if appending a cell of sz bytes to page pPage would leave
+** less than nReserve bytes of free space on it, in which case a cursor
+** in bulk-load mode appends the cell to a new page instead. Pages with
+** fewer than two cells are never considered full, as balance_bulk()
+** needs at least one cell to leave behind on the page.
+*/
+static int bulkPageFull(MemPage *pPage, int sz, int nReserve){
+  return pPage->nCell>=2 && sz+2>pPage->nFree-nReserve;
+}
+
+/*
+** Return true if the iPage'th page of cursor pCur is the right-child of
+** its parent page, or is the root page, so that balance() may pass it
+** to balance_bulk() once it overflows.
+*/
+static int bulkRightEdge(BtCursor *pCur, int iPage){
+  return pCur->pgnoRoot!=1
+      && (iPage==0 || pCur->aiIdx[iPage-1]==pCur->apPage[iPage-1]->nCell);
+}
+
+/*
+** This version of balance() is used instead of balance_quick() and
+** balance_nonroot() by cursors in bulk-load mode (see
+** sqlite3BtreeCursorBulkLoad()). It handles both table and index
+** b-trees, and both leaf and interior pages.
+**
+** pPage must have a single overflow entry which is also the right-most
+** entry on the page, and it must be the right-child of pParent. A new
+** page is allocated to the right of pPage and the overflow cell is
+** moved to it. pPage itself is not rebalanced: if it is a leaf of a
+** table b-tree, the divider cell inserted into pParent is made from the
+** largest key on pPage, as in balance_quick(). Otherwise the right-most
+** cell of pPage is removed from it and becomes the divider (and, on an
+** interior page, its child becomes the right-child of pPage), so that
+** each key is still stored exactly once.
+**
+** If the divider does not fit on pParent, or would leave less than
+** nReserve bytes free on it, it is stored as an overflow cell of pParent
+** in buffer pSpace, which must be at least pageSize bytes in size. The
+** caller balances pParent next. The caller passes zero for nReserve if
+** pParent is not itself a right-child, as balance_bulk() could not be
+** used to split it early.
+*/
+static int balance_bulk(
+  MemPage *pParent,               /* Parent page of pPage */
+  MemPage *pPage,                 /* Page with an overflow cell on the end */
+  u8 *pSpace,                     /* Space for the new divider cell */
+  int nReserve                    /* Bytes to leave free on pParent */
+){
+  BtShared *const pBt = pPage->pBt;    /* B-Tree Database */
+  MemPage *pNew = 0;                   /* Newly allocated page */
+  Pgno pgnoNew;                        /* Page number of pNew */
+  u8 *pCell = pPage->aOvfl[0].pCell;   /* Cell to move to pNew */
+  u16 szCell = cellSizePtr(pPage, pCell);
+  int szDivider;                       /* Size of divider cell in pSpace */
+  int rc;                              /* Return Code */
+
+  assert( sqlite3_mutex_held(pBt->mutex) );
+  assert( sqlite3PagerIswriteable(pParent->pDbPage) );
+  assert( pPage->nOverflow==1 && pPage->aOvfl[0].idx==pPage->nCell );
+  assert( pPage->nCell>=2 );
+  assert( pParent->nOverflow==0 );
+
+  rc = sqlite3PagerWrite(pPage->pDbPage);
+  if( rc==SQLITE_OK ){
+    rc = allocateBtreePage(pBt, &pNew, &pgnoNew, 0, 0);
+  }
+  if( rc ) return rc;
+
+  TRACE(("BALANCE: bulk append to %d from %d\n", pgnoNew, pPage->pgno));
+
+  /* Copy the overflow cell to the new page. An interior page inherits
+  ** the right-child pointer of pPage.  */
+  assert( sqlite3PagerIswriteable(pNew->pDbPage) );
+  zeroPage(pNew, pPage->aData[pPage->hdrOffset]);
+  assemblePage(pNew, 1, &pCell, &szCell);
+  if( !pPage->leaf ){
+    memcpy(&pNew->aData[pNew->hdrOffset+8],
+           &pPage->aData[pPage->hdrOffset+8], 4);
+  }
+
+  /* Create the divider cell in pSpace, leaving room for the 4-byte page
+  ** number of pPage at the start of it.  */
+  if( pPage->hasData ){
+    CellInfo info;
+    btreeParseCellPtr(pPage, findCell(pPage, pPage->nCell-1), &info);
+    szDivider = 4 + putVarint(&pSpace[4], info.nKey);
+  }else{
+    int iLast = pPage->nCell-1;
+    u8 *pLast = findCell(pPage, iLast);
+    int szLast = cellSizePtr(pPage, pLast);
+    if( pPage->leaf ){
+      memcpy(&pSpace[4], pLast, szLast);
+      szDivider = szLast + 4;
+    }else{
+      memcpy(pSpace, pLast, szLast);
+      szDivider = szLast;
+      memcpy(&pPage->aData[pPage->hdrOffset+8], pLast, 4);
+    }
+    dropCell(pPage, iLast, szLast, &rc);
+  }
+
+  /* If this is an auto-vacuum database, update the pointer map entries
+  ** for the new page and for the pages that it now holds pointers to.
+  ** Any overflow pages belonging to the divider cell are taken care of
+  ** when it is written to pParent (or, if it overflows pParent, to
+  ** whichever page it is eventually stored on).  */
+  if( ISAUTOVACUUM ){
+    ptrmapPut(pBt, pgnoNew, PTRMAP_BTREE, pParent->pgno, &rc);
+    if( rc==SQLITE_OK ){
+      rc = setChildPtrmaps(pNew);
+    }
+  }
+
+  /* Append the divider cell to pParent and make the new page its
+  ** right-child.  */
+  if( rc==SQLITE_OK && bulkPageFull(pParent, szDivider, nReserve) ){
+    put4byte(pSpace, pPage->pgno);
+    pParent->aOvfl[0].pCell = pSpace;
+    pParent->aOvfl[0].idx = pParent->nCell;
+    pParent->nOverflow = 1;
+  }else{
+    insertCell(pParent, pParent->nCell, pSpace, szDivider, 0, pPage->pgno, &rc);
+  }
+  put4byte(&pParent->aData[pParent->hdrOffset+8], pgnoNew);
+
+  releasePage(pNew);
+  return rc;
+}
+
 #if 0
 /*
 ** This function does not contribute anything to the operation of SQLite.
@@ -53029,7 +55059,7 @@ static int balance_nonroot(
   }
   pgno = get4byte(pRight);
   while( 1 ){
-    rc = getAndInitPage(pBt, pgno, &apOld[i]);
+    rc = getAndInitPage(pBt, pgno, &apOld[i], 0);
     if( rc ){
       memset(apOld, 0, (i+1)*sizeof(MemPage*));
       goto balance_cleanup;
@@ -53626,6 +55656,7 @@ static int balance(BtCursor *pCur){
   const int nMin = pCur->pBt->usableSize * 2 / 3;
   u8 aBalanceQuickSpace[13];
   u8 *pFree = 0;
+  int bBulk = 0;                 /* True after a call to balance_bulk() */
 
   TESTONLY( int balance_quick_called = 0 );
   TESTONLY( int balance_deeper_called = 0 );
@@ -53652,14 +55683,43 @@ static int balance(BtCursor *pCur){
       }else{
         break;
       }
-    }else if( pPage->nOverflow==0 && pPage->nFree<=nMin ){
+    }else if( pPage->nOverflow==0 && (pPage->nFree<=nMin || bBulk) ){
+      /* A page that has just had a divider appended to it by
+      ** balance_bulk() is left underfull. It is the page that the next
+      ** divider will be appended to.  */
       break;
     }else{
       MemPage * const pParent = pCur->apPage[iPage-1];
       int const iIdx = pCur->aiIdx[iPage-1];
 
       rc = sqlite3PagerWrite(pParent->pDbPage);
-      if( rc==SQLITE_OK ){
+      if( rc==SQLITE_OK && pCur->nBulkFill
+       && pPage->nOverflow==1
+       && pPage->aOvfl[0].idx==pPage->nCell
+       && pPage->nCell>=2
+       && pParent->pgno!=1
+       && pParent->nCell==iIdx
+      ){
+        /* The cursor is in bulk-load mode and a cell has been appended
+        ** to the right-most child of pParent. Call balance_bulk() to move
+        ** it to a new right-hand sibling of pPage. If the divider cell
+        ** overflows pParent, it is stored in the pSpace buffer until
+        ** the next iteration of the do-loop has balanced pParent, in the
+        ** same way as for balance_nonroot() below.  */
+        u8 *pSpace = sqlite3PageMalloc(pCur->pBt->pageSize);
+        if( pSpace==0 ){
+          rc = SQLITE_NOMEM;
+        }else{
+          int nReserve = bulkRightEdge(pCur, iPage-1) ? bulkReserve(pCur) : 0;
+          rc = balance_bulk(pParent, pPage, pSpace, nReserve);
+        }
+        if( pFree ){
+          sqlite3PageFree(pFree);
+        }
+        pFree = pSpace;
+        bBulk = 1;
+      }else if( rc==SQLITE_OK ){
+        bBulk = 0;
 #ifndef SQLITE_OMIT_QUICKBALANCE
         if( pPage->hasData
          && pPage->nOverflow==1
@@ -53853,7 +55913,20 @@ SQLITE_PRIVATE int sqlite3BtreeInsert(
   }else{
     assert( pPage->leaf );
   }
-  insertCell(pPage, idx, newCell, szNew, 0, 0, &rc);
+  if( pCur->nBulkFill && loc && idx==pPage->nCell
+   && bulkRightEdge(pCur, pCur->iPage)
+   && bulkPageFull(pPage, szNew, bulkReserve(pCur))
+  ){
+    /* The cursor is in bulk-load mode and the new cell is being appended
+    ** to a page that has reached its fill factor. Store it as an overflow
+    ** cell so that balance() moves it to a new page.  */
+    assert( pPage->nOverflow==0 );
+    pPage->aOvfl[0].pCell = newCell;
+    pPage->aOvfl[0].idx = (u16)idx;
+    pPage->nOverflow = 1;
+  }else{
+    insertCell(pPage, idx, newCell, szNew, 0, 0, &rc);
+  }
   assert( rc!=SQLITE_OK || pPage->nCell>0 || pPage->nOverflow>0 );
 
   /* If no error has occured and pPage has an overflow cell, call balance() 
@@ -54184,7 +56257,7 @@ static int clearDatabasePage(
     return SQLITE_CORRUPT_BKPT;
   }
 
-  rc = getAndInitPage(pBt, pgno, &pPage);
+  rc = getAndInitPage(pBt, pgno, &pPage, 0);
   if( rc ) return rc;
   for(i=0; i<pPage->nCell; i++){
     pCell = findCell(pPage, i);
@@ -54516,6 +56589,15 @@ SQLITE_PRIVATE Pager *sqlite3BtreePager(Btree *p){
   return p->pBt->pPager;
 }
 
+/*
+** Return the number of times cursors belonging to Btree p have searched
+** the b-tree from its root page for a key.  The count wraps around on
+** overflow.
+*/
+SQLITE_PRIVATE u32 sqlite3BtreeSeekCount(Btree *p){
+  return p->nSeek;
+}
+
 #ifndef SQLITE_OMIT_INTEGRITY_CHECK
 /*
 ** Append a message to the error message string.
@@ -54717,6 +56799,7 @@ static int checkTreePage(
   if( iPage==0 ) return 0;
   if( checkRef(pCheck, iPage, zParentContext) ) return 0;
   if( (rc = btreeGetPage(pBt, (Pgno)iPage, &pPage, 0))!=0 ){
+    if( rc==SQLITE_NOMEM || rc==SQLITE_IOERR_NOMEM ) pCheck->mallocFailed = 1;
     checkAppendMsg(pCheck, zContext,
        "unable to get the page. error code=%d", rc);
     return 0;
@@ -57213,6 +59296,155 @@ SQLITE_PRIVATE void sqlite3VdbeSwap(Vdbe *pA, Vdbe *pB){
   pA->zSql = pB->zSql;
   pB->zSql = zTmp;
   pB->isPrepareV2 = pA->isPrepareV2;
+  pB->isCached = pA->isCached;
+#ifndef SQLITE_OMIT_STMT_PROFILE
+  /* Discard the profile of the run that found the schema had changed.
+  ** The statement is run again from the start with the new program. */
+  sqlite3_free(pA->pProf);
+  sqlite3_free(pB->pProf);
+  pA->pProf = pB->pProf = 0;
+#endif
+}
+
+/*
+** Mark statement p as prepared with CHROMIUM_SQLITE_PREPARE_CACHED, so that
+** sqlite3_finalize() hands it to sqlite3VdbeCacheRelease().
+*/
+SQLITE_PRIVATE void sqlite3VdbeSetCached(Vdbe *p){
+  assert( p->zSql && p->isPrepareV2 );
+  p->isCached = 1;
+}
+
+/*
+** Remove idle statement p from the statement cache of its connection.
+*/
+static void vdbeCacheUnlink(Vdbe *p){
+  StmtCache *pCache = &p->db->stmtCache;
+  assert( p->inStmtCache );
+  if( p->pCachePrev ){
+    p->pCachePrev->pCacheNext = p->pCacheNext;
+  }else{
+    pCache->pFirst = p->pCacheNext;
+  }
+  if( p->pCacheNext ){
+    p->pCacheNext->pCachePrev = p->pCachePrev;
+  }else{
+    pCache->pLast = p->pCachePrev;
+  }
+  p->pCacheNext = p->pCachePrev = 0;
+  p->inStmtCache = 0;
+  pCache->nStmt--;
+}
+
+/*
+** If the SQL text zCached, saved by a statement prepared with
+** CHROMIUM_SQLITE_PREPARE_CACHED, is the first SQL statement in the nBytes
+** bytes (or nul-terminated string, if nBytes is negative) at zSql, return its
+** length.  Otherwise return 0.
+**
+** The saved text runs up to and including the ';' that ends the
+** statement, if any.  If there was no ';', the statement ran to the end
+** of its input, so zSql must end at the same point.
+*/
+static int vdbeCacheMatch(const char *zCached, const char *zSql, int nBytes){
+  int i;
+  for(i=0; zCached[i]; i++){
+    if( i==nBytes || zCached[i]!=zSql[i] ) return 0;
+  }
+  if( i>0 && zCached[i-1]==';' ) return i;
+  if( i==nBytes || zSql[i]==0 ) return i;
+  return 0;
+}
+
+/*
+** Search the statement cache of connection db for an idle statement
+** compiled from the first SQL statement in zSql.  If one is found, remove
+** it from the cache, set *pzTail to point to the end of that statement
+** in zSql and return it.  Otherwise return NULL.  Statements that have
+** expired, for example because the schema has changed, are finalized
+** as they are found.
+*/
+SQLITE_PRIVATE Vdbe *sqlite3VdbeCacheFind(
+  sqlite3 *db,              /* Database handle */
+  const char *zSql,         /* UTF-8 encoded SQL statement */
+  int nBytes,               /* Length of zSql in bytes, or -1 */
+  const char **pzTail       /* OUT: End of the statement in zSql */
+){
+  StmtCache *pCache = &db->stmtCache;
+  Vdbe *p;
+  Vdbe *pNext;
+  assert( sqlite3_mutex_held(db->mutex) );
+  for(p=pCache->pFirst; p; p=pNext){
+    int n = vdbeCacheMatch(p->zSql, zSql, nBytes);
+    pNext = p->pCacheNext;
+    if( n ){
+      vdbeCacheUnlink(p);
+      if( p->expired ){
+        sqlite3VdbeFinalize(p);
+        continue;
+      }
+      pCache->nHit++;
+      if( pCache->nCompile ){
+        pCache->iSaved += pCache->iCompileTime*1000/pCache->nCompile;
+      }
+      if( pzTail ) *pzTail = &zSql[n];
+      return p;
+    }
+  }
+  return 0;
+}
+
+/*
+** Finalize the least recently used idle statements in the statement cache
+** of connection db until no more than nKeep remain.
+*/
+SQLITE_PRIVATE void sqlite3VdbeCacheTrim(sqlite3 *db, int nKeep){
+  StmtCache *pCache = &db->stmtCache;
+  assert( sqlite3_mutex_held(db->mutex) );
+  while( pCache->nStmt>nKeep ){
+    Vdbe *p = pCache->pLast;
+    vdbeCacheUnlink(p);
+    sqlite3VdbeFinalize(p);
+  }
+}
+
+/*
+** This is called by sqlite3_finalize() for a statement prepared with
+** CHROMIUM_SQLITE_PREPARE_CACHED.  Unless the statement is already idle in the
+** cache, it is reset, its bindings are cleared and it is added to the
+** cache as the most recently used statement instead of being deleted.
+** The return value is the same as that of sqlite3VdbeFinalize().
+*/
+SQLITE_PRIVATE int sqlite3VdbeCacheRelease(Vdbe *p){
+  sqlite3 *db = p->db;
+  StmtCache *pCache = &db->stmtCache;
+  int rc = SQLITE_OK;
+  int i;
+
+  assert( p->isCached );
+  assert( sqlite3_mutex_held(db->mutex) );
+  if( p->inStmtCache ){
+    vdbeCacheUnlink(p);
+  }else if( pCache->nMax>0 && !p->expired && !p->expmask && !db->mallocFailed ){
+    rc = sqlite3VdbeReset(p);
+    sqlite3VdbeMakeReady(p, -1, 0, 0, 0, 0, 0);
+    for(i=0; i<p->nVar; i++){
+      sqlite3VdbeMemRelease(&p->aVar[i]);
+      p->aVar[i].flags = MEM_Null;
+    }
+    p->pCacheNext = pCache->pFirst;
+    if( pCache->pFirst ){
+      pCache->pFirst->pCachePrev = p;
+    }else{
+      pCache->pLast = p;
+    }
+    pCache->pFirst = p;
+    p->inStmtCache = 1;
+    pCache->nStmt++;
+    sqlite3VdbeCacheTrim(db, pCache->nMax);
+    return rc;
+  }
+  return sqlite3VdbeFinalize(p);
 }
 
 #ifdef SQLITE_DEBUG
@@ -58661,6 +60893,7 @@ SQLITE_PRIVATE void sqlite3VdbeFreeCursor(Vdbe *p, VdbeCursor *pCx){
   if( pCx==0 ){
     return;
   }
+  sqlite3VdbeSorterClose(p->db, pCx);
   if( pCx->pBt ){
     sqlite3BtreeClose(pCx->pBt);
     /* The pCx->pCursor will be close automatically, if it exists, by
@@ -59453,6 +61686,11 @@ SQLITE_PRIVATE int sqlite3VdbeReset(Vdbe *p){
 
   /* Save profiling information from this VDBE run.
   */
+#ifndef SQLITE_OMIT_STMT_PROFILE
+  if( p->pProf ){
+    sqlite3VdbeProfileEnd(p);
+  }
+#endif
 #ifdef VDBE_PROFILE
   {
     FILE *out = fopen("vdbe_profile.out", "a");
@@ -59533,6 +61771,9 @@ SQLITE_PRIVATE void sqlite3VdbeDeleteObject(sqlite3 *db, Vdbe *p){
   sqlite3DbFree(db, p->aColName);
   sqlite3DbFree(db, p->zSql);
   sqlite3DbFree(db, p->pFree);
+#ifndef SQLITE_OMIT_STMT_PROFILE
+  sqlite3_free(p->pProf);
+#endif
   sqlite3DbFree(db, p);
 }
 
@@ -60131,7 +62372,178 @@ SQLITE_PRIVATE int sqlite3VdbeRecordCompare(
   }
   return rc;
 }
- 
+
+/*
+** Read the header of record {nKey1, aKey1} as far as the serial type of
+** the first field.  Set *pType to the serial type and *pOff to the offset
+** of the first field's content and return non-zero.  Return zero if the
+** record has no first field that sqlite3VdbeRecordCompare() would look
+** at, or if the first field overruns the record (which only happens if
+** the database is corrupt).  The caller then uses the general routine.
+*/
+static int vdbeRecordFirstField(
+  int nKey1, const u8 *aKey1,   /* Left key */
+  const UnpackedRecord *pPKey2, /* Right key */
+  u32 *pType,                   /* OUT: Serial type of first field */
+  u32 *pOff                     /* OUT: Offset of first field content */
+){
+  u32 szHdr1;                   /* Size of the header in bytes */
+  u32 nHdr1;                    /* Bytes of header that are compared */
+  u32 idx1;                     /* Offset of first serial type */
+  if( nKey1<2 ) return 0;
+  idx1 = getVarint32(aKey1, szHdr1);
+  if( szHdr1<=idx1 || szHdr1>(u32)nKey1 ) return 0;
+  nHdr1 = szHdr1;
+  if( pPKey2->flags & UNPACKED_IGNORE_ROWID ) nHdr1--;
+  if( idx1>=nHdr1 ) return 0;
+  getVarint32(&aKey1[idx1], *pType);
+  if( *pType==10 || *pType==11 ) return 0;
+  if( (u64)szHdr1 + sqlite3VdbeSerialTypeLen(*pType)>(u64)nKey1 ) return 0;
+  *pOff = szHdr1;
+  return 1;
+}
+
+/*
+** Return the value pKeyInfo would give the result of comparing the first
+** fields of two keys that compare as c using the default (ASC) order.
+*/
+#define vdbeRecordFirstOrder(pKeyInfo, c) \
+  (((pKeyInfo)->nField>0 && (pKeyInfo)->aSortOrder \
+      && (pKeyInfo)->aSortOrder[0]) ? -(c) : (c))
+
+/*
+** This is a version of sqlite3VdbeRecordCompare() for use when the first
+** field of pPKey2 is an integer.  The first field of {nKey1, pKey1} is
+** compared directly from the record, without decoding the rest of the
+** header into Mem structures.  If the first fields are equal, or if the
+** first field of key1 is a real, the general routine is used instead.
+*/
+static int vdbeRecordCompareInt(
+  int nKey1, const void *pKey1, /* Left key */
+  UnpackedRecord *pPKey2        /* Right key */
+){
+  const u8 *aKey1 = (const u8*)pKey1;
+  u32 serial_type;
+  u32 d1;
+  const u8 *buf;
+  i64 v;
+  int rc;
+
+  if( !vdbeRecordFirstField(nKey1, aKey1, pPKey2, &serial_type, &d1) ){
+    return sqlite3VdbeRecordCompare(nKey1, pKey1, pPKey2);
+  }
+  buf = &aKey1[d1];
+  switch( serial_type ){
+    case 0:   /* NULL is less than any integer */
+      return vdbeRecordFirstOrder(pPKey2->pKeyInfo, -1);
+    case 1:
+      v = (signed char)buf[0];
+      break;
+    case 2:
+      v = (((signed char)buf[0])<<8) | buf[1];
+      break;
+    case 3:
+      v = (((signed char)buf[0])<<16) | (buf[1]<<8) | buf[2];
+      break;
+    case 4:
+      v = (buf[0]<<24) | (buf[1]<<16) | (buf[2]<<8) | buf[3];
+      break;
+    case 5: {
+      u64 x = (((signed char)buf[0])<<8) | buf[1];
+      u32 y = (buf[2]<<24) | (buf[3]<<16) | (buf[4]<<8) | buf[5];
+      x = (x<<32) | y;
+      v = *(i64*)&x;
+      break;
+    }
+    case 6: {
+      u64 x = (buf[0]<<24) | (buf[1]<<16) | (buf[2]<<8) | buf[3];
+      u32 y = (buf[4]<<24) | (buf[5]<<16) | (buf[6]<<8) | buf[7];
+      x = (x<<32) | y;
+      v = *(i64*)&x;
+      break;
+    }
+    case 7:   /* Compare reals using the general routine */
+      return sqlite3VdbeRecordCompare(nKey1, pKey1, pPKey2);
+    case 8:
+    case 9:
+      v = serial_type-8;
+      break;
+    default:  /* Text and blobs are greater than any integer */
+      return vdbeRecordFirstOrder(pPKey2->pKeyInfo, 1);
+  }
+  if( v==pPKey2->aMem[0].u.i ){
+    return sqlite3VdbeRecordCompare(nKey1, pKey1, pPKey2);
+  }
+  rc = v<pPKey2->aMem[0].u.i ? -1 : 1;
+  return vdbeRecordFirstOrder(pPKey2->pKeyInfo, rc);
+}
+
+/*
+** This is a version of sqlite3VdbeRecordCompare() for use when the first
+** field of pPKey2 is a string that uses the BINARY collating sequence.
+** The first field of {nKey1, pKey1} is compared using memcmp() directly
+** from the record.  If the first fields are equal, the general routine
+** is used to compare the remaining fields.
+*/
+static int vdbeRecordCompareString(
+  int nKey1, const void *pKey1, /* Left key */
+  UnpackedRecord *pPKey2        /* Right key */
+){
+  const u8 *aKey1 = (const u8*)pKey1;
+  const Mem *pMem2 = &pPKey2->aMem[0];
+  u32 serial_type;
+  u32 d1;
+  int rc;
+
+  if( !vdbeRecordFirstField(nKey1, aKey1, pPKey2, &serial_type, &d1) ){
+    return sqlite3VdbeRecordCompare(nKey1, pKey1, pPKey2);
+  }
+  if( serial_type<12 ){
+    rc = -1;              /* NULL and numbers are less than text */
+  }else if( !(serial_type & 0x01) ){
+    rc = 1;               /* Blobs are greater than text */
+  }else{
+    int n1 = (serial_type-13)/2;
+    rc = memcmp(&aKey1[d1], pMem2->z, n1<pMem2->n ? n1 : pMem2->n);
+    if( rc==0 ){
+      rc = n1 - pMem2->n;
+      if( rc==0 ){
+        return sqlite3VdbeRecordCompare(nKey1, pKey1, pPKey2);
+      }
+    }
+    rc = rc<0 ? -1 : 1;
+  }
+  return vdbeRecordFirstOrder(pPKey2->pKeyInfo, rc);
+}
+
+/*
+** Return a pointer to a function that compares keys in the same way as
+** sqlite3VdbeRecordCompare() but is faster for the right key pPKey2.
+** Integer and BINARY text first fields have specialized comparators.
+** Callers that compare one unpacked key against many records, such as
+** the b-tree descent in sqlite3BtreeMovetoUnpacked(), should call this
+** once and use the returned function for every comparison.
+*/
+SQLITE_PRIVATE RecordCompare sqlite3VdbeFindCompare(UnpackedRecord *p){
+  if( p->nField>0 && (p->flags & UNPACKED_PREFIX_SEARCH)==0 ){
+    const Mem *pMem = &p->aMem[0];
+    int flags = pMem->flags & (MEM_Null|MEM_Int|MEM_Real|MEM_Str|MEM_Blob);
+    if( flags==MEM_Int ){
+      return vdbeRecordCompareInt;
+    }
+    if( flags==MEM_Str && (pMem->flags & MEM_Zero)==0 ){
+      KeyInfo *pKeyInfo = p->pKeyInfo;
+      CollSeq *pColl = pKeyInfo->nField>0 ? pKeyInfo->aColl[0] : 0;
+      if( pColl==0
+       || (pColl->type==SQLITE_COLL_BINARY && pColl->enc==pKeyInfo->enc)
+      ){
+        return vdbeRecordCompareString;
+      }
+    }
+  }
+  return sqlite3VdbeRecordCompare;
+}
+
 
 /*
 ** pCur points at an index entry created using the OP_MakeRecord opcode.
@@ -60413,7 +62825,11 @@ SQLITE_API int sqlite3_finalize(sqlite3_stmt *pStmt){
     mutex = v->db->mutex;
 #endif
     sqlite3_mutex_enter(mutex);
-    rc = sqlite3VdbeFinalize(v);
+    if( v->isCached ){
+      rc = sqlite3VdbeCacheRelease(v);
+    }else{
+      rc = sqlite3VdbeFinalize(v);
+    }
     rc = sqlite3ApiExit(db, rc);
     sqlite3_mutex_leave(mutex);
   }
@@ -60642,9 +63058,22 @@ SQLITE_API void sqlite3_result_error_nomem(sqlite3_context *pCtx){
   pCtx->s.db->mallocFailed = 1;
 }
 
+#ifndef SQLITE_OMIT_WAL
+/*
+** Set the current value of one of the sqlite3.aWalStat[] entries reported
+** by sqlite3_db_status(), and raise its highwater mark if required.
+*/
+static void walStatSet(int *aStat, int iValue){
+  aStat[0] = iValue;
+  if( iValue>aStat[1] ) aStat[1] = iValue;
+}
+#endif
+
 /*
 ** This function is called after a transaction has been committed. It 
 ** invokes callbacks registered with sqlite3_wal_hook() as required.
+** It also records the size of the log, the number of frames not yet
+** checkpointed and the time spent in the callback, for sqlite3_db_status().
 */
 static int doWalCallbacks(sqlite3 *db){
   int rc = SQLITE_OK;
@@ -60653,9 +63082,19 @@ static int doWalCallbacks(sqlite3 *db){
   for(i=0; i<db->nDb; i++){
     Btree *pBt = db->aDb[i].pBt;
     if( pBt ){
-      int nEntry = sqlite3PagerWalCallback(sqlite3BtreePager(pBt));
+      Pager *pPager = sqlite3BtreePager(pBt);
+      int nEntry = sqlite3PagerWalCallback(pPager);
+      if( nEntry>0 ){
+        walStatSet(db->aWalStat[0], nEntry);
+        walStatSet(db->aWalStat[1], sqlite3PagerWalBacklog(pPager));
+      }
       if( db->xWalCallback && nEntry>0 && rc==SQLITE_OK ){
+        sqlite3_int64 iStart = 0;
+        sqlite3_int64 iEnd = 0;
+        sqlite3OsCurrentTimeInt64(db->pVfs, &iStart);
         rc = db->xWalCallback(db->pWalArg, db, db->aDb[i].zName, nEntry);
+        sqlite3OsCurrentTimeInt64(db->pVfs, &iEnd);
+        walStatSet(db->aWalStat[2], iEnd>iStart ? (int)(iEnd-iStart) : 0);
       }
     }
   }
@@ -60734,6 +63173,12 @@ static int sqlite3Step(Vdbe *p){
     }
 #endif
 
+#ifndef SQLITE_OMIT_STMT_PROFILE
+    if( (db->nStmtProfile || p->pProf) && !db->init.busy && !p->explain ){
+      sqlite3VdbeProfileBegin(p);
+    }
+#endif
+
     db->activeVdbeCnt++;
     if( p->readOnly==0 ) db->writeVdbeCnt++;
     p->pc = 0;
@@ -61815,6 +64260,1874 @@ SQLITE_PRIVATE char *sqlite3VdbeExpandSql(
 #endif /* #ifndef SQLITE_OMIT_TRACE */
 
 /************** End of vdbetrace.c *******************************************/
+/************** Begin file vdbesort.c ****************************************/
+/*
+** 2011 September 1
+**
+** The author disclaims copyright to this source code.  In place of
+** a legal notice, here is a blessing:
+**
+**    May you do good and not evil.
+**    May you find forgiveness for yourself and forgive others.
+**    May you share freely, never taking more than you give.
+**
+*************************************************************************
+**
+** This file contains code for the VdbeSorter object, used in concert with
+** a VdbeCursor to sort large numbers of keys (as may be required, for
+** example, by CREATE INDEX statements or by SELECT statements with
+** ORDER BY clauses that cannot be satisfied using indexes).
+**
+** Keys are accumulated in memory in a linked list.  When the list grows
+** larger than the memory budget of the sorter, it is sorted and written
+** to a temporary file as a "Packed Memory Array" (PMA).  Once all keys
+** have been added, the PMAs are merged together, SORTER_MAX_MERGE_COUNT
+** at a time, until few enough remain that they can be merged in a single
+** pass while the keys are read back by the VM.  If no PMAs were written,
+** the in-memory list is simply sorted and returned.
+**
+** A PMA consists of a varint containing the size of the PMA in bytes (not
+** including the varint itself), followed by the keys in sorted order.
+** Each key is stored as a varint containing the size of the key in bytes
+** followed by the key itself.
+**
+** If "PRAGMA threads" is set to a non-zero value, lists are sorted and
+** written to disk by worker threads while the VM continues to add keys.
+** Each worker writes its PMAs to its own temporary file.
+*/
+
+
+#ifndef SQLITE_OMIT_MERGE_SORT
+
+/*
+** Worker threads are only used by threadsafe builds on unix.
+*/
+#if SQLITE_THREADSAFE && SQLITE_OS_UNIX && SQLITE_MAX_WORKER_THREADS>0
+# define SORTER_THREADS 1
+#else
+# define SORTER_THREADS 0
+#endif
+
+/*
+** The maximum number of PMAs merged in a single pass.  This must be a
+** power of two.
+*/
+#define SORTER_MAX_MERGE_COUNT 16
+
+/*
+** Hard upper bound on the memory budget of a single sorter, in bytes.
+*/
+#define SORTER_MAX_PMASZ (1<<29)
+
+#ifndef MIN
+# define MIN(x,y) ((x)<(y)?(x):(y))
+#endif
+
+typedef struct SorterRecord SorterRecord;
+typedef struct SorterPma SorterPma;
+typedef struct SorterTask SorterTask;
+typedef struct SorterIter SorterIter;
+typedef struct SorterMerger SorterMerger;
+typedef struct FileWriter FileWriter;
+
+/*
+** A key held in memory.  The nVal bytes of key data immediately follow
+** this structure in the same allocation.  Records are allocated using
+** sqlite3Malloc() (not the lookaside allocator) so that they may be freed
+** by a worker thread.
+*/
+struct SorterRecord {
+  int nVal;                       /* Size of the key in bytes */
+  SorterRecord *pNext;            /* Next key in list */
+};
+#define SRVAL(p) ((void*)((SorterRecord*)(p) + 1))
+
+/*
+** The location of a PMA within a temporary file.
+*/
+struct SorterPma {
+  sqlite3_file *pFd;              /* File containing the PMA */
+  i64 iOff;                       /* Offset of the PMA within pFd */
+  i64 nByte;                      /* Size of the PMA, including its header */
+};
+
+/*
+** A buffered writer used to write PMAs sequentially to a temporary file.
+** Writes are aligned to multiples of the buffer size where possible.
+*/
+struct FileWriter {
+  int eFWErr;                     /* Non-zero if in an error state */
+  u8 *aBuffer;                    /* Write buffer */
+  int nBuffer;                    /* Size of aBuffer[] in bytes */
+  int iBufStart;                  /* First byte of aBuffer[] to write */
+  int iBufEnd;                    /* Last byte of aBuffer[] to write */
+  i64 iWriteOff;                  /* File offset of aBuffer[0] */
+  sqlite3_file *pFd;              /* File to write to */
+};
+
+/*
+** A task sorts a list of keys and writes it to a temporary file as a PMA.
+** There is one task for each worker thread, or a single task that is
+** always run by the calling thread if worker threads are not in use.
+**
+** While a worker thread is running (bRunning is true) the thread that
+** owns the sorter does not access the pList, aBuffer or aSpace fields of
+** the task.  The owner waits for the worker using vdbeSorterJoin()
+** before starting another job on the same task.
+*/
+struct SorterTask {
+  VdbeSorter *pSorter;            /* Sorter that owns this task */
+  char *aSpace;                   /* Space used to unpack keys */
+  int szSpace;                    /* Size of aSpace[] in bytes */
+  UnpackedRecord *pUnpacked;      /* Most recently unpacked key */
+  u8 *aBuffer;                    /* Write buffer for PMAs */
+  sqlite3_file *pFd;              /* Temporary file PMAs are written to */
+  i64 iEof;                       /* End of the last PMA queued for pFd */
+  SorterRecord *pList;            /* Keys to sort and write out */
+  i64 nList;                      /* Size of pList in PMA format */
+  i64 iOff;                       /* Offset within pFd to write pList to */
+  int rc;                         /* Error code from a worker thread */
+#if SORTER_THREADS
+  int bRunning;                   /* True while a worker thread is running */
+  pthread_t tid;                  /* The worker thread, if bRunning */
+#endif
+};
+
+/*
+** An iterator reads the keys of a single PMA in order.  pFd is set to
+** NULL once the iterator has reached the end of the PMA.
+*/
+struct SorterIter {
+  sqlite3_file *pFd;              /* File being read, or NULL at EOF */
+  i64 iReadOff;                   /* File offset of the next byte to read */
+  i64 iEof;                       /* First byte past the end of the PMA */
+  u8 *aBuffer;                    /* Read buffer */
+  int nBuffer;                    /* Size of aBuffer[] in bytes */
+  int nBufData;                   /* Bytes of valid data in aBuffer[] */
+  int iBufPos;                    /* Offset of next unread byte in aBuffer[] */
+  u8 *aAlloc;                     /* Space for keys that span buffers */
+  int nAlloc;                     /* Size of aAlloc[] in bytes */
+  u8 *aKey;                       /* Current key */
+  int nKey;                       /* Size of aKey in bytes */
+};
+
+/*
+** A merger combines the output of up to SORTER_MAX_MERGE_COUNT iterators.
+**
+** aTree[] is a tournament tree.  Each entry aTree[i] for 1<=i<nTree holds
+** the index of the iterator with the smaller current key of its two
+** children.  The children of entry i are entries 2*i and 2*i+1, except
+** that the children of entries nTree/2 and greater are the iterators
+** themselves.  So aTree[1] is always the index of the iterator with the
+** smallest current key.  An iterator at EOF compares larger than any key.
+*/
+struct SorterMerger {
+  int nTree;                      /* Number of aIter[] entries (power of 2) */
+  int *aTree;                     /* Tournament tree */
+  SorterIter *aIter;              /* Iterators being merged */
+};
+
+/*
+** Main sorter structure.  A single instance of this is allocated for
+** each sorter cursor created by the VDBE.
+*/
+struct VdbeSorter {
+  int pgsz;                       /* Page size of the main database */
+  int mnPmaSize;                  /* Minimum PMA size, in bytes */
+  int mxPmaSize;                  /* Memory budget.  0 means never spill */
+  int nMemory;                    /* Memory used by pRecord, in bytes */
+  i64 nInMemory;                  /* Size of pRecord in PMA format */
+  SorterRecord *pRecord;          /* Keys accumulated in memory */
+  KeyInfo *pKeyInfo;              /* Copy of the cursor KeyInfo, db==0 */
+  int nTask;                      /* Number of entries in aTask[] */
+  int iTask;                      /* Task to use for the next flush */
+  int bThreads;                   /* True to run tasks in worker threads */
+  SorterTask *aTask;              /* Tasks used to write PMAs */
+  int nPma;                       /* Number of entries in aPma[] */
+  int nPmaAlloc;                  /* Allocated size of aPma[] */
+  SorterPma *aPma;                /* All PMAs written so far */
+  sqlite3_file *pMergeFd;         /* File written by the last merge pass */
+  SorterMerger *pMerger;          /* Merger used to read back keys */
+};
+
+/*
+** Free the list of records passed as the only argument.
+*/
+static void vdbeSorterRecordFree(SorterRecord *pRecord){
+  SorterRecord *p;
+  SorterRecord *pNext;
+  for(p=pRecord; p; p=pNext){
+    pNext = p->pNext;
+    sqlite3_free(p);
+  }
+}
+
+/*
+** Compare key1 (buffer pKey1, size nKey1 bytes) with key2 (buffer pKey2,
+** size nKey2 bytes) and return a value less than, equal to or greater
+** than zero as key1 is smaller than, equal to or larger than key2.
+**
+** If pKey2 is NULL, then key2 is the key most recently unpacked into
+** the space belonging to task pTask.  Since the merge routines compare
+** each key against several others in turn, this saves unpacking the
+** same key repeatedly.
+*/
+static int vdbeSorterCompare(
+  SorterTask *pTask,              /* Task owning the unpacked-record space */
+  const void *pKey1, int nKey1,   /* Left side of comparison */
+  const void *pKey2, int nKey2    /* Right side of comparison */
+){
+  if( pKey2 ){
+    pTask->pUnpacked = sqlite3VdbeRecordUnpack(pTask->pSorter->pKeyInfo,
+        nKey2, pKey2, pTask->aSpace, pTask->szSpace
+    );
+    assert( pTask->pUnpacked );
+    assert( (pTask->pUnpacked->flags & UNPACKED_NEED_FREE)==0 );
+  }
+  return sqlite3VdbeRecordCompare(nKey1, pKey1, pTask->pUnpacked);
+}
+
+/*
+** Merge the two sorted lists p1 and p2 into a single list.  Set *ppOut
+** to point to the head of the merged list.
+*/
+static void vdbeSorterMerge(
+  SorterTask *pTask,              /* Task owning the unpacked-record space */
+  SorterRecord *p1,               /* First list to merge */
+  SorterRecord *p2,               /* Second list to merge */
+  SorterRecord **ppOut            /* OUT: Head of merged list */
+){
+  SorterRecord *pFinal = 0;
+  SorterRecord **pp = &pFinal;
+  void *pVal2 = p2 ? SRVAL(p2) : 0;
+
+  while( p1 && p2 ){
+    int res;
+    res = vdbeSorterCompare(pTask, SRVAL(p1), p1->nVal, pVal2, p2->nVal);
+    if( res<=0 ){
+      *pp = p1;
+      pp = &p1->pNext;
+      p1 = p1->pNext;
+      pVal2 = 0;
+    }else{
+      *pp = p2;
+      pp = &p2->pNext;
+      p2 = p2->pNext;
+      if( p2==0 ) break;
+      pVal2 = SRVAL(p2);
+    }
+  }
+  *pp = p1 ? p1 : p2;
+  *ppOut = pFinal;
+}
+
+/*
+** Sort the linked list of records headed at *ppList using a bottom-up
+** merge sort.
+*/
+static void vdbeSorterSort(SorterTask *pTask, SorterRecord **ppList){
+  int i;
+  SorterRecord *p = *ppList;
+  SorterRecord *aSlot[64];
+
+  memset(aSlot, 0, sizeof(aSlot));
+  while( p ){
+    SorterRecord *pNext = p->pNext;
+    p->pNext = 0;
+    for(i=0; aSlot[i]; i++){
+      vdbeSorterMerge(pTask, p, aSlot[i], &p);
+      aSlot[i] = 0;
+    }
+    aSlot[i] = p;
+    p = pNext;
+  }
+
+  p = 0;
+  for(i=0; i<64; i++){
+    vdbeSorterMerge(pTask, p, aSlot[i], &p);
+  }
+  *ppList = p;
+}
+
+/*
+** Initialize a FileWriter to write to file pFd, starting at offset
+** iStart, using buffer aBuffer (nBuffer bytes in size).
+*/
+static void fileWriterInit(
+  FileWriter *p,
+  sqlite3_file *pFd,
+  u8 *aBuffer,
+  int nBuffer,
+  i64 iStart
+){
+  memset(p, 0, sizeof(FileWriter));
+  p->aBuffer = aBuffer;
+  p->nBuffer = nBuffer;
+  p->iBufEnd = p->iBufStart = (int)(iStart % nBuffer);
+  p->iWriteOff = iStart - p->iBufStart;
+  p->pFd = pFd;
+}
+
+/*
+** Write nData bytes of data to the file-write object.
+*/
+static void fileWriterWrite(FileWriter *p, const u8 *pData, int nData){
+  int nRem = nData;
+  while( nRem>0 && p->eFWErr==0 ){
+    int nCopy = nRem;
+    if( nCopy>(p->nBuffer - p->iBufEnd) ){
+      nCopy = p->nBuffer - p->iBufEnd;
+    }
+    memcpy(&p->aBuffer[p->iBufEnd], &pData[nData-nRem], nCopy);
+    p->iBufEnd += nCopy;
+    if( p->iBufEnd==p->nBuffer ){
+      p->eFWErr = sqlite3OsWrite(p->pFd,
+          &p->aBuffer[p->iBufStart], p->iBufEnd - p->iBufStart,
+          p->iWriteOff + p->iBufStart
+      );
+      p->iBufStart = p->iBufEnd = 0;
+      p->iWriteOff += p->nBuffer;
+    }
+    assert( p->iBufEnd<p->nBuffer );
+    nRem -= nCopy;
+  }
+}
+
+/*
+** Write value iVal encoded as a varint to the file-write object.
+*/
+static void fileWriterWriteVarint(FileWriter *p, u64 iVal){
+  int nByte;
+  u8 aByte[10];
+  nByte = sqlite3PutVarint(aByte, iVal);
+  fileWriterWrite(p, aByte, nByte);
+}
+
+/*
+** Flush any buffered data to disk.  Set *piEof to the offset of the byte
+** immediately following the last byte written and return SQLITE_OK, or
+** return an SQLite error code if an error occurred at any point.
+*/
+static int fileWriterFinish(FileWriter *p, i64 *piEof){
+  if( p->eFWErr==0 && p->iBufEnd>p->iBufStart ){
+    p->eFWErr = sqlite3OsWrite(p->pFd,
+        &p->aBuffer[p->iBufStart], p->iBufEnd - p->iBufStart,
+        p->iWriteOff + p->iBufStart
+    );
+  }
+  *piEof = p->iWriteOff + p->iBufEnd;
+  return p->eFWErr;
+}
+
+/*
+** Sort the list of keys attached to task pTask and write it to the
+** task's temporary file at offset pTask->iOff.  The keys are freed as
+** they are written.  This function may be called from a worker thread.
+*/
+static int vdbeSorterListToPMA(SorterTask *pTask){
+  VdbeSorter *pSorter = pTask->pSorter;
+  FileWriter writer;
+  SorterRecord *p;
+  SorterRecord *pNext;
+  i64 iEof;
+  int rc;
+
+  vdbeSorterSort(pTask, &pTask->pList);
+  fileWriterInit(&writer, pTask->pFd, pTask->aBuffer, pSorter->pgsz,
+                 pTask->iOff);
+  fileWriterWriteVarint(&writer, pTask->nList);
+  for(p=pTask->pList; p; p=pNext){
+    pNext = p->pNext;
+    fileWriterWriteVarint(&writer, p->nVal);
+    fileWriterWrite(&writer, SRVAL(p), p->nVal);
+    sqlite3_free(p);
+  }
+  pTask->pList = 0;
+  rc = fileWriterFinish(&writer, &iEof);
+  assert( rc!=SQLITE_OK
+       || iEof==pTask->iOff+sqlite3VarintLen(pTask->nList)+pTask->nList );
+  return rc;
+}
+
+#if SORTER_THREADS
+/*
+** Entry point for worker threads.
+*/
+static void *vdbeSorterThreadMain(void *pCtx){
+  SorterTask *pTask = (SorterTask*)pCtx;
+  pTask->rc = vdbeSorterListToPMA(pTask);
+  return 0;
+}
+#endif
+
+/*
+** Wait for the worker thread running task pTask, if any, to finish.
+** Return the error code reported by the worker.
+*/
+static int vdbeSorterJoin(SorterTask *pTask){
+#if SORTER_THREADS
+  if( pTask->bRunning ){
+    pthread_join(pTask->tid, 0);
+    pTask->bRunning = 0;
+  }
+#endif
+  return pTask->rc;
+}
+
+/*
+** Wait for all worker threads belonging to sorter pSorter to finish.
+*/
+static int vdbeSorterJoinAll(VdbeSorter *pSorter){
+  int rc = SQLITE_OK;
+  int i;
+  for(i=0; i<pSorter->nTask; i++){
+    int rc2 = vdbeSorterJoin(&pSorter->aTask[i]);
+    if( rc==SQLITE_OK ) rc = rc2;
+  }
+  return rc;
+}
+
+/*
+** Open a temporary file for use by the sorter.
+*/
+static int vdbeSorterOpenTempFile(sqlite3 *db, sqlite3_file **ppFile){
+  int dummy;
+  return sqlite3OsOpenMalloc(db->pVfs, 0, ppFile,
+      SQLITE_OPEN_TEMP_JOURNAL |
+      SQLITE_OPEN_READWRITE    | SQLITE_OPEN_CREATE |
+      SQLITE_OPEN_EXCLUSIVE    | SQLITE_OPEN_DELETEONCLOSE, &dummy
+  );
+}
+
+/*
+** Hand the list of keys currently held in memory to the next task, which
+** sorts it and writes it out as a new PMA.  If worker threads are in use
+** the work is done in the background and this function returns as soon
+** as the thread has been started.  Otherwise, or if the thread cannot be
+** started, the work is done before returning.
+*/
+static int vdbeSorterFlush(sqlite3 *db, VdbeSorter *pSorter){
+  SorterTask *pTask;
+  SorterPma *pPma;
+  int rc;
+
+  pTask = &pSorter->aTask[pSorter->iTask];
+  pSorter->iTask = (pSorter->iTask + 1) % pSorter->nTask;
+
+  rc = vdbeSorterJoin(pTask);
+  if( rc==SQLITE_OK && pTask->pFd==0 ){
+    rc = vdbeSorterOpenTempFile(db, &pTask->pFd);
+    assert( rc!=SQLITE_OK || pTask->pFd );
+  }
+  if( rc==SQLITE_OK && pTask->aBuffer==0 ){
+    pTask->aBuffer = (u8*)sqlite3Malloc(pSorter->pgsz);
+    if( pTask->aBuffer==0 ) rc = SQLITE_NOMEM;
+  }
+  if( rc==SQLITE_OK && pSorter->nPma>=pSorter->nPmaAlloc ){
+    int nNew = pSorter->nPmaAlloc ? pSorter->nPmaAlloc*2 : 16;
+    SorterPma *aNew;
+    aNew = sqlite3DbRealloc(db, pSorter->aPma, nNew*sizeof(SorterPma));
+    if( aNew==0 ){
+      rc = SQLITE_NOMEM;
+    }else{
+      pSorter->aPma = aNew;
+      pSorter->nPmaAlloc = nNew;
+    }
+  }
+  if( rc!=SQLITE_OK ) return rc;
+
+  /* The size of the new PMA is already known, so its location can be
+  ** recorded (and space in the file reserved for it) before it is
+  ** written.  This way only the task itself touches the file contents. */
+  pPma = &pSorter->aPma[pSorter->nPma++];
+  pPma->pFd = pTask->pFd;
+  pPma->iOff = pTask->iEof;
+  pPma->nByte = sqlite3VarintLen(pSorter->nInMemory) + pSorter->nInMemory;
+  pTask->iOff = pTask->iEof;
+  pTask->iEof += pPma->nByte;
+
+  pTask->pList = pSorter->pRecord;
+  pTask->nList = pSorter->nInMemory;
+  pSorter->pRecord = 0;
+  pSorter->nInMemory = 0;
+  pSorter->nMemory = 0;
+
+#if SORTER_THREADS
+  if( pSorter->bThreads ){
+    if( pthread_create(&pTask->tid, 0, vdbeSorterThreadMain, pTask)==0 ){
+      pTask->bRunning = 1;
+      return SQLITE_OK;
+    }
+  }
+#endif
+  return vdbeSorterListToPMA(pTask);
+}
+
+/*
+** Free all memory belonging to iterator pIter and zero it.
+*/
+static void vdbeSorterIterZero(SorterIter *pIter){
+  sqlite3_free(pIter->aBuffer);
+  sqlite3_free(pIter->aAlloc);
+  memset(pIter, 0, sizeof(SorterIter));
+}
+
+/*
+** Read the next block of the PMA into the read buffer of iterator p.
+** Reads are aligned to multiples of the buffer size.
+*/
+static int vdbeSorterIterFill(SorterIter *p){
+  int nRead;
+  int rc;
+  if( p->iReadOff>=p->iEof ) return SQLITE_CORRUPT_BKPT;
+  nRead = p->nBuffer - (int)(p->iReadOff % p->nBuffer);
+  if( nRead>p->iEof - p->iReadOff ){
+    nRead = (int)(p->iEof - p->iReadOff);
+  }
+  rc = sqlite3OsRead(p->pFd, p->aBuffer, nRead, p->iReadOff);
+  p->iBufPos = 0;
+  p->nBufData = (rc==SQLITE_OK ? nRead : 0);
+  return rc;
+}
+
+/*
+** Read the next nByte bytes of data from the PMA p.  If successful, set
+** *ppOut to point to a buffer containing the data and return SQLITE_OK.
+** The buffer remains valid until the next call to this function for the
+** same iterator.
+*/
+static int vdbeSorterIterRead(SorterIter *p, int nByte, u8 **ppOut){
+  int nCopied;
+  int rc;
+
+  if( p->iBufPos==p->nBufData ){
+    rc = vdbeSorterIterFill(p);
+    if( rc!=SQLITE_OK ) return rc;
+  }
+  if( nByte<=p->nBufData-p->iBufPos ){
+    *ppOut = &p->aBuffer[p->iBufPos];
+    p->iBufPos += nByte;
+    p->iReadOff += nByte;
+    return SQLITE_OK;
+  }
+
+  /* The requested data spans more than one buffer.  Assemble it in the
+  ** aAlloc[] space. */
+  if( p->nAlloc<nByte ){
+    u8 *aNew;
+    int nNew = p->nAlloc ? p->nAlloc : 128;
+    while( nNew<nByte ) nNew = nNew*2;
+    aNew = sqlite3Realloc(p->aAlloc, nNew);
+    if( !aNew ) return SQLITE_NOMEM;
+    p->nAlloc = nNew;
+    p->aAlloc = aNew;
+  }
+  nCopied = 0;
+  while( nCopied<nByte ){
+    int nCopy;
+    if( p->iBufPos==p->nBufData ){
+      rc = vdbeSorterIterFill(p);
+      if( rc!=SQLITE_OK ) return rc;
+    }
+    nCopy = nByte - nCopied;
+    if( nCopy>p->nBufData-p->iBufPos ) nCopy = p->nBufData - p->iBufPos;
+    memcpy(&p->aAlloc[nCopied], &p->aBuffer[p->iBufPos], nCopy);
+    p->iBufPos += nCopy;
+    p->iReadOff += nCopy;
+    nCopied += nCopy;
+  }
+  *ppOut = p->aAlloc;
+  return SQLITE_OK;
+}
+
+/*
+** Read a varint from the PMA p and store its value in *pnOut.
+*/
+static int vdbeSorterIterVarint(SorterIter *p, u64 *pnOut){
+  if( p->nBufData-p->iBufPos>=9 ){
+    int n = sqlite3GetVarint(&p->aBuffer[p->iBufPos], pnOut);
+    p->iBufPos += n;
+    p->iReadOff += n;
+  }else{
+    u8 aVarint[16];
+    u8 *a;
+    int i = 0;
+    do{
+      int rc = vdbeSorterIterRead(p, 1, &a);
+      if( rc!=SQLITE_OK ) return rc;
+      aVarint[(i++)&0xf] = a[0];
+    }while( (a[0]&0x80)!=0 );
+    sqlite3GetVarint(aVarint, pnOut);
+  }
+  return SQLITE_OK;
+}
+
+/*
+** Advance iterator pIter to the next key in its PMA.  If there are no
+** more keys, zero the iterator (which sets pIter->pFd to NULL).
+*/
+static int vdbeSorterIterNext(SorterIter *pIter){
+  u64 nRec = 0;
+  int rc;
+
+  if( pIter->iReadOff>=pIter->iEof ){
+    vdbeSorterIterZero(pIter);
+    return SQLITE_OK;
+  }
+  rc = vdbeSorterIterVarint(pIter, &nRec);
+  if( rc==SQLITE_OK ){
+    pIter->nKey = (int)nRec;
+    rc = vdbeSorterIterRead(pIter, (int)nRec, &pIter->aKey);
+  }
+  return rc;
+}
+
+/*
+** Initialize iterator pIter to read the PMA described by pPma and load
+** its first key.  Set *pnByte to the size of the PMA content (the value
+** stored in the PMA header).
+*/
+static int vdbeSorterIterInit(
+  VdbeSorter *pSorter,            /* Sorter object */
+  const SorterPma *pPma,          /* PMA to read */
+  SorterIter *pIter,              /* Iterator to initialize */
+  i64 *pnByte                     /* OUT: Size of PMA content */
+){
+  u64 nByte = 0;
+  int rc;
+
+  assert( pIter->aBuffer==0 );
+  pIter->pFd = pPma->pFd;
+  pIter->iReadOff = pPma->iOff;
+  pIter->iEof = pPma->iOff + pPma->nByte;
+  pIter->nBuffer = pSorter->pgsz;
+  pIter->aBuffer = (u8*)sqlite3Malloc(pIter->nBuffer);
+  if( !pIter->aBuffer ) return SQLITE_NOMEM;
+
+  rc = vdbeSorterIterVarint(pIter, &nByte);
+  if( rc==SQLITE_OK && pIter->iReadOff+(i64)nByte!=pIter->iEof ){
+    rc = SQLITE_CORRUPT_BKPT;
+  }
+  *pnByte = (i64)nByte;
+  if( rc==SQLITE_OK ){
+    rc = vdbeSorterIterNext(pIter);
+  }
+  return rc;
+}
+
+/*
+** Recompute entry iOut of the tournament tree of merger p.
+*/
+static void vdbeSorterDoCompare(
+  VdbeSorter *pSorter,            /* Sorter object */
+  SorterMerger *p,                /* Merger object */
+  int iOut                        /* Entry of aTree[] to update */
+){
+  int i1;
+  int i2;
+  int iRes;
+  SorterIter *p1;
+  SorterIter *p2;
+
+  assert( iOut<p->nTree && iOut>0 );
+  if( iOut>=(p->nTree/2) ){
+    i1 = (iOut - p->nTree/2) * 2;
+    i2 = i1 + 1;
+  }else{
+    i1 = p->aTree[iOut*2];
+    i2 = p->aTree[iOut*2+1];
+  }
+  p1 = &p->aIter[i1];
+  p2 = &p->aIter[i2];
+
+  if( p1->pFd==0 ){
+    iRes = i2;
+  }else if( p2->pFd==0 ){
+    iRes = i1;
+  }else{
+    int res = vdbeSorterCompare(&pSorter->aTask[0],
+        p1->aKey, p1->nKey, p2->aKey, p2->nKey
+    );
+    iRes = (res<=0) ? i1 : i2;
+  }
+  p->aTree[iOut] = iRes;
+}
+
+/*
+** Free a merger object and all of its iterators.
+*/
+static void vdbeSorterMergerFree(sqlite3 *db, SorterMerger *p){
+  if( p ){
+    int i;
+    for(i=0; i<p->nTree; i++){
+      vdbeSorterIterZero(&p->aIter[i]);
+    }
+    sqlite3DbFree(db, p);
+  }
+}
+
+/*
+** Allocate a merger for the nPma PMAs in array aPma[], which must contain
+** no more than SORTER_MAX_MERGE_COUNT entries.  *ppOut is set to point to
+** the new merger even if an error occurs, so that the caller may free
+** it.  *pnByte is set to the total size of the content of the PMAs.
+*/
+static int vdbeSorterMergerInit(
+  sqlite3 *db,                    /* Database handle */
+  VdbeSorter *pSorter,            /* Sorter object */
+  const SorterPma *aPma,          /* PMAs to merge */
+  int nPma,                       /* Number of entries in aPma[] */
+  SorterMerger **ppOut,           /* OUT: New merger object */
+  i64 *pnByte                     /* OUT: Total size of PMA content */
+){
+  SorterMerger *p;
+  int rc = SQLITE_OK;
+  int nByte;
+  int N = 2;
+  int i;
+
+  assert( nPma>0 && nPma<=SORTER_MAX_MERGE_COUNT );
+  while( N<nPma ) N += N;
+  nByte = ROUND8(sizeof(SorterMerger)) + N*(sizeof(SorterIter)+sizeof(int));
+  *ppOut = p = (SorterMerger*)sqlite3DbMallocZero(db, nByte);
+  if( !p ) return SQLITE_NOMEM;
+  p->aIter = (SorterIter*)&((u8*)p)[ROUND8(sizeof(SorterMerger))];
+  p->aTree = (int*)&p->aIter[N];
+  p->nTree = N;
+
+  *pnByte = 0;
+  for(i=0; i<nPma && rc==SQLITE_OK; i++){
+    i64 nPmaByte = 0;
+    rc = vdbeSorterIterInit(pSorter, &aPma[i], &p->aIter[i], &nPmaByte);
+    *pnByte += nPmaByte;
+  }
+  for(i=N-1; rc==SQLITE_OK && i>0; i--){
+    vdbeSorterDoCompare(pSorter, p, i);
+  }
+  return rc;
+}
+
+/*
+** Advance merger p to the next key.
+*/
+static int vdbeSorterMergerNext(VdbeSorter *pSorter, SorterMerger *p){
+  int iPrev = p->aTree[1];
+  int rc;
+  int i;
+
+  rc = vdbeSorterIterNext(&p->aIter[iPrev]);
+  for(i=(p->nTree+iPrev)/2; rc==SQLITE_OK && i>0; i=i/2){
+    vdbeSorterDoCompare(pSorter, p, i);
+  }
+  return rc;
+}
+
+/*
+** Merge the PMAs of sorter pSorter in groups of SORTER_MAX_MERGE_COUNT,
+** writing the results to a new temporary file.  The files containing the
+** input PMAs are closed once the pass is complete.
+*/
+static int vdbeSorterMergePass(sqlite3 *db, VdbeSorter *pSorter){
+  sqlite3_file *pOut = 0;
+  SorterPma *aNew;
+  int nNew = 0;
+  int nAlloc;
+  u8 *aBuffer = 0;
+  i64 iOff = 0;
+  int rc;
+  int i;
+
+  nAlloc = (pSorter->nPma + SORTER_MAX_MERGE_COUNT - 1)/SORTER_MAX_MERGE_COUNT;
+  aNew = (SorterPma*)sqlite3DbMallocZero(db, nAlloc*sizeof(SorterPma));
+  if( !aNew ) return SQLITE_NOMEM;
+  rc = vdbeSorterOpenTempFile(db, &pOut);
+  if( rc==SQLITE_OK ){
+    aBuffer = (u8*)sqlite3Malloc(pSorter->pgsz);
+    if( !aBuffer ) rc = SQLITE_NOMEM;
+  }
+
+  for(i=0; rc==SQLITE_OK && i<pSorter->nPma; i+=SORTER_MAX_MERGE_COUNT){
+    SorterMerger *pMerger = 0;
+    i64 nByte = 0;
+    int n = pSorter->nPma - i;
+    if( n>SORTER_MAX_MERGE_COUNT ) n = SORTER_MAX_MERGE_COUNT;
+
+    rc = vdbeSorterMergerInit(db, pSorter, &pSorter->aPma[i], n,
+                              &pMerger, &nByte);
+    if( rc==SQLITE_OK ){
+      FileWriter writer;
+      i64 iEof = 0;
+      int rc2;
+
+      fileWriterInit(&writer, pOut, aBuffer, pSorter->pgsz, iOff);
+      fileWriterWriteVarint(&writer, nByte);
+      while( rc==SQLITE_OK ){
+        SorterIter *pIter = &pMerger->aIter[pMerger->aTree[1]];
+        if( pIter->pFd==0 ) break;
+        fileWriterWriteVarint(&writer, pIter->nKey);
+        fileWriterWrite(&writer, pIter->aKey, pIter->nKey);
+        rc = vdbeSorterMergerNext(pSorter, pMerger);
+      }
+      rc2 = fileWriterFinish(&writer, &iEof);
+      if( rc==SQLITE_OK ) rc = rc2;
+      aNew[nNew].pFd = pOut;
+      aNew[nNew].iOff = iOff;
+      aNew[nNew].nByte = iEof - iOff;
+      nNew++;
+      iOff = iEof;
+    }
+    vdbeSorterMergerFree(db, pMerger);
+  }
+  sqlite3_free(aBuffer);
+
+  if( rc==SQLITE_OK ){
+    if( pSorter->pMergeFd ){
+      sqlite3OsCloseFree(pSorter->pMergeFd);
+    }else{
+      for(i=0; i<pSorter->nTask; i++){
+        SorterTask *pTask = &pSorter->aTask[i];
+        if( pTask->pFd ){
+          sqlite3OsCloseFree(pTask->pFd);
+          pTask->pFd = 0;
+          pTask->iEof = 0;
+        }
+      }
+    }
+    pSorter->pMergeFd = pOut;
+    sqlite3DbFree(db, pSorter->aPma);
+    pSorter->aPma = aNew;
+    pSorter->nPma = nNew;
+    pSorter->nPmaAlloc = nAlloc;
+  }else{
+    if( pOut ) sqlite3OsCloseFree(pOut);
+    sqlite3DbFree(db, aNew);
+  }
+  return rc;
+}
+
+/*
+** Initialize the temporary index cursor just opened as a sorter cursor.
+*/
+SQLITE_PRIVATE int sqlite3VdbeSorterInit(sqlite3 *db, VdbeCursor *pCsr){
+  VdbeSorter *pSorter;
+  KeyInfo *pKeyInfo = pCsr->pKeyInfo;
+  int szKeyInfo;
+  int szSpace;
+  int nWorker = 0;
+  int nTask;
+  int i;
+
+  assert( pKeyInfo && pKeyInfo->nField>0 );
+#if SORTER_THREADS
+  if( sqlite3GlobalConfig.bCoreMutex ){
+    nWorker = db->aLimit[SQLITE_LIMIT_WORKER_THREADS];
+  }
+#endif
+  nTask = nWorker>0 ? nWorker : 1;
+  szKeyInfo = sizeof(KeyInfo) + (pKeyInfo->nField-1)*sizeof(CollSeq*);
+  szSpace = ROUND8(sizeof(UnpackedRecord))
+          + sizeof(Mem)*(pKeyInfo->nField+1) + 8;
+
+  pSorter = (VdbeSorter*)sqlite3DbMallocZero(db,
+      ROUND8(sizeof(VdbeSorter)) + ROUND8(nTask*sizeof(SorterTask)) + szKeyInfo
+  );
+  pCsr->pSorter = pSorter;
+  if( pSorter==0 ) return SQLITE_NOMEM;
+
+  pSorter->aTask = (SorterTask*)&((u8*)pSorter)[ROUND8(sizeof(VdbeSorter))];
+  pSorter->pKeyInfo = (KeyInfo*)&((u8*)pSorter->aTask)[
+      ROUND8(nTask*sizeof(SorterTask))
+  ];
+  memcpy(pSorter->pKeyInfo, pKeyInfo, szKeyInfo);
+  /* Keys may be compared by worker threads, which must not use the
+  ** database handle. */
+  pSorter->pKeyInfo->db = 0;
+  pSorter->nTask = nTask;
+  pSorter->bThreads = (nWorker>0);
+  pSorter->pgsz = sqlite3BtreeGetPageSize(db->aDb[0].pBt);
+  for(i=0; i<nTask; i++){
+    SorterTask *pTask = &pSorter->aTask[i];
+    pTask->pSorter = pSorter;
+    pTask->szSpace = szSpace;
+    pTask->aSpace = (char*)sqlite3Malloc(szSpace);
+    if( pTask->aSpace==0 ) return SQLITE_NOMEM;
+  }
+
+  if( !sqlite3TempInMemory(db) ){
+    i64 mxCache;
+    u32 szPma = sqlite3GlobalConfig.szPma;
+    if( szPma<1 ) szPma = 1;
+    pSorter->mnPmaSize = (int)MIN((i64)szPma*pSorter->pgsz, SORTER_MAX_PMASZ);
+    mxCache = db->aDb[0].pSchema->cache_size;
+    if( mxCache<(i64)szPma ) mxCache = szPma;
+    pSorter->mxPmaSize = (int)MIN(mxCache*pSorter->pgsz, SORTER_MAX_PMASZ);
+  }
+  return SQLITE_OK;
+}
+
+/*
+** Free any cursor components allocated by sqlite3VdbeSorterXXX routines.
+*/
+SQLITE_PRIVATE void sqlite3VdbeSorterClose(sqlite3 *db, VdbeCursor *pCsr){
+  VdbeSorter *pSorter = pCsr->pSorter;
+  if( pSorter ){
+    int i;
+    vdbeSorterJoinAll(pSorter);
+    for(i=0; i<pSorter->nTask; i++){
+      SorterTask *pTask = &pSorter->aTask[i];
+      vdbeSorterRecordFree(pTask->pList);
+      if( pTask->pFd ) sqlite3OsCloseFree(pTask->pFd);
+      sqlite3_free(pTask->aBuffer);
+      sqlite3_free(pTask->aSpace);
+    }
+    vdbeSorterMergerFree(db, pSorter->pMerger);
+    if( pSorter->pMergeFd ) sqlite3OsCloseFree(pSorter->pMergeFd);
+    vdbeSorterRecordFree(pSorter->pRecord);
+    sqlite3DbFree(db, pSorter->aPma);
+    sqlite3DbFree(db, pSorter);
+    pCsr->pSorter = 0;
+  }
+}
+
+/*
+** Add a record to the sorter.
+*/
+SQLITE_PRIVATE int sqlite3VdbeSorterWrite(sqlite3 *db, const VdbeCursor *pCsr, Mem *pVal){
+  VdbeSorter *pSorter = pCsr->pSorter;
+  SorterRecord *pNew;
+  int nReq;
+  int rc = SQLITE_OK;
+
+  assert( pSorter );
+  assert( pSorter->pMerger==0 );
+  nReq = sizeof(SorterRecord) + pVal->n;
+  pNew = (SorterRecord*)sqlite3Malloc(nReq);
+  if( pNew==0 ) return SQLITE_NOMEM;
+  memcpy(SRVAL(pNew), pVal->z, pVal->n);
+  pNew->nVal = pVal->n;
+  pNew->pNext = pSorter->pRecord;
+  pSorter->pRecord = pNew;
+  pSorter->nInMemory += sqlite3VarintLen(pVal->n) + pVal->n;
+  pSorter->nMemory += nReq;
+
+  /* See if the contents of the sorter should now be written out. They
+  ** are written out when either of the following are true:
+  **
+  **   * The total memory allocated for the in-memory list is greater
+  **     than the memory budget (mxPmaSize), or
+  **
+  **   * The total memory allocated for the in-memory list is greater
+  **     than (mnPmaSize) and sqlite3HeapNearlyFull() returns true.
+  */
+  if( pSorter->mxPmaSize>0 && (
+        (pSorter->nMemory>pSorter->mxPmaSize)
+     || (pSorter->nMemory>pSorter->mnPmaSize && sqlite3HeapNearlyFull())
+  )){
+    rc = vdbeSorterFlush(db, pSorter);
+  }
+  return rc;
+}
+
+/*
+** Once the sorter has been populated, this function is called to prepare
+** for iterating through its contents in sorted order.
+*/
+SQLITE_PRIVATE int sqlite3VdbeSorterRewind(sqlite3 *db, const VdbeCursor *pCsr, int *pbEof){
+  VdbeSorter *pSorter = pCsr->pSorter;
+  int rc = SQLITE_OK;
+  int rc2;
+  i64 nByte = 0;
+
+  assert( pSorter );
+  assert( pSorter->pMerger==0 );
+
+  /* If no data has been written to disk, then do not do so now. Instead,
+  ** sort the in-memory list.  */
+  if( pSorter->nPma==0 ){
+    vdbeSorterSort(&pSorter->aTask[0], &pSorter->pRecord);
+    *pbEof = !pSorter->pRecord;
+    return SQLITE_OK;
+  }
+
+  /* Write the current in-memory list to a PMA and wait for any worker
+  ** threads to finish. */
+  if( pSorter->pRecord ){
+    rc = vdbeSorterFlush(db, pSorter);
+  }
+  rc2 = vdbeSorterJoinAll(pSorter);
+  if( rc==SQLITE_OK ) rc = rc2;
+
+  /* Merge PMAs together until there are few enough to merge in a single
+  ** pass as the keys are read back. */
+  while( rc==SQLITE_OK && pSorter->nPma>SORTER_MAX_MERGE_COUNT ){
+    rc = vdbeSorterMergePass(db, pSorter);
+  }
+  if( rc==SQLITE_OK ){
+    rc = vdbeSorterMergerInit(db, pSorter, pSorter->aPma, pSorter->nPma,
+                              &pSorter->pMerger, &nByte);
+  }
+  if( rc==SQLITE_OK ){
+    SorterMerger *p = pSorter->pMerger;
+    *pbEof = (p->aIter[p->aTree[1]].pFd==0);
+  }
+  return rc;
+}
+
+/*
+** Advance to the next element in the sorter.
+*/
+SQLITE_PRIVATE int sqlite3VdbeSorterNext(sqlite3 *db, const VdbeCursor *pCsr, int *pbEof){
+  VdbeSorter *pSorter = pCsr->pSorter;
+  int rc = SQLITE_OK;
+
+  UNUSED_PARAMETER(db);
+  if( pSorter->pMerger ){
+    SorterMerger *p = pSorter->pMerger;
+    rc = vdbeSorterMergerNext(pSorter, p);
+    *pbEof = (p->aIter[p->aTree[1]].pFd==0);
+  }else{
+    SorterRecord *pFree = pSorter->pRecord;
+    pSorter->pRecord = pFree->pNext;
+    sqlite3_free(pFree);
+    *pbEof = !pSorter->pRecord;
+  }
+  return rc;
+}
+
+/*
+** Return a pointer to a buffer owned by the sorter that contains the
+** current key.
+*/
+static void *vdbeSorterRowkey(
+  const VdbeSorter *pSorter,      /* Sorter object */
+  int *pnKey                      /* OUT: Size of current key in bytes */
+){
+  void *pKey;
+  if( pSorter->pMerger ){
+    SorterIter *pIter;
+    pIter = &pSorter->pMerger->aIter[ pSorter->pMerger->aTree[1] ];
+    *pnKey = pIter->nKey;
+    pKey = pIter->aKey;
+  }else{
+    *pnKey = pSorter->pRecord->nVal;
+    pKey = SRVAL(pSorter->pRecord);
+  }
+  return pKey;
+}
+
+/*
+** Copy the current sorter key into the memory cell pOut.
+*/
+SQLITE_PRIVATE int sqlite3VdbeSorterRowkey(const VdbeCursor *pCsr, Mem *pOut){
+  VdbeSorter *pSorter = pCsr->pSorter;
+  void *pKey;
+  int nKey;
+
+  pKey = vdbeSorterRowkey(pSorter, &nKey);
+  if( sqlite3VdbeMemGrow(pOut, nKey, 0) ){
+    return SQLITE_NOMEM;
+  }
+  pOut->n = nKey;
+  MemSetTypeFlag(pOut, MEM_Blob);
+  memcpy(pOut->z, pKey, nKey);
+  return SQLITE_OK;
+}
+
+/*
+** Compare the key in memory cell pVal with the key that the sorter cursor
+** passed as the first argument currently points to.  For the purposes of
+** the comparison, ignore the rowid field at the end of each record.
+**
+** If an error occurs, return an SQLite error code (i.e. SQLITE_NOMEM).
+** Otherwise, set *pRes to a negative, zero or positive value if the
+** key in pVal is smaller than, equal to or larger than the current sorter
+** key.  Keys that contain NULL values never compare equal.
+*/
+SQLITE_PRIVATE int sqlite3VdbeSorterCompare(
+  const VdbeCursor *pCsr,         /* Sorter cursor */
+  Mem *pVal,                      /* Value to compare to current sorter key */
+  int *pRes                       /* OUT: Result of comparison */
+){
+  VdbeSorter *pSorter = pCsr->pSorter;
+  KeyInfo *pKeyInfo = pSorter->pKeyInfo;
+  UnpackedRecord *r2;
+  void *pKey;
+  int nKey;
+  int i;
+
+  pKey = vdbeSorterRowkey(pSorter, &nKey);
+  r2 = sqlite3VdbeRecordUnpack(pKeyInfo, nKey, pKey,
+      pSorter->aTask[0].aSpace, pSorter->aTask[0].szSpace
+  );
+  assert( r2 && (r2->flags & UNPACKED_NEED_FREE)==0 );
+  if( r2->nField>pKeyInfo->nField ) r2->nField = pKeyInfo->nField;
+  for(i=0; i<r2->nField; i++){
+    if( r2->aMem[i].flags & MEM_Null ){
+      *pRes = -1;
+      return SQLITE_OK;
+    }
+  }
+  r2->flags |= UNPACKED_PREFIX_MATCH;
+  *pRes = sqlite3VdbeRecordCompare(pVal->n, pVal->z, r2);
+  return SQLITE_OK;
+}
+
+#endif /* #ifndef SQLITE_OMIT_MERGE_SORT */
+
+/************** End of vdbesort.c ********************************************/
+/************** Begin file vdbeprof.c ****************************************/
+/*
+** 2011 September 12
+**
+** The author disclaims copyright to this source code.  In place of
+** a legal notice, here is a blessing:
+**
+**    May you do good and not evil.
+**    May you find forgiveness for yourself and forgive others.
+**    May you share freely, never taking more than you give.
+**
+*************************************************************************
+**
+** This file contains the statement profiler enabled by PRAGMA
+** stmt_profile, and the "stmt_profile" virtual table used to read the
+** profiles it records.
+**
+** While the pragma is set to a non-zero value N, each run of a statement
+** (from the first call to sqlite3_step() until the statement is reset) is
+** counted in a VdbeProfile object attached to the VM: the number of times
+** each instruction is executed and the clock ticks spent on it, rows
+** returned, b-tree searches, page cache hits and misses and bytes read
+** from the database files.  When the statement is reset, the totals are
+** added to the StmtProfile object for its SQL text, which lives until it
+** is deleted through the virtual table or the connection is closed.  At
+** most N distinct SQL statements are profiled; runs of other statements
+** are not counted once that many have been recorded.
+**
+** The page cache and b-tree counters are maintained by the pager and
+** b-tree layers for each attached database at all times.  The profiler
+** only samples them as sqlite3VdbeExec() is entered and left, so a
+** statement is charged for the work done by any statements it runs
+** itself (for example from within a user function).  In shared-cache
+** mode, the pager counters also include work done by other connections
+** that share the cache, if they run at the same time.
+**
+** The profiles are read using a virtual table:
+**
+**     CREATE VIRTUAL TABLE temp.prof USING stmt_profile;
+**     SELECT sql, runs, cycles, fullscan_steps FROM temp.prof
+**      ORDER BY cycles DESC;
+**
+** which has one row for each SQL statement.  Created with the argument
+** "opcodes", the table has one row for each instruction of each profiled
+** program instead.  Deleting a row from a statement table discards the
+** profile of that statement.
+*/
+
+#ifndef SQLITE_OMIT_STMT_PROFILE
+
+typedef struct StmtProfile StmtProfile;
+typedef struct StmtProfileOp StmtProfileOp;
+
+/*
+** One instruction of a profiled program, and its totals for all runs.
+*/
+struct StmtProfileOp {
+  u8 opcode;                  /* Copy of VdbeOp.opcode */
+  int p1, p2, p3;             /* Copies of VdbeOp.p1, p2 and p3 */
+  u64 nExec;                  /* Total VdbeOpProfile.nExec */
+  u64 nCycle;                 /* Total VdbeOpProfile.nCycle */
+};
+
+/*
+** The profile of a single SQL statement.
+**
+** If the statement is recompiled, for example because the schema has
+** changed, the per-instruction totals in aOp[] are discarded and
+** restarted for the new program the first time it is run.  The totals
+** in aStat[] are kept.
+*/
+struct StmtProfile {
+  char *zSql;                 /* SQL text (the key) */
+  int nSql;                   /* Length of zSql in bytes */
+  unsigned int iHash;         /* Hash of zSql */
+  i64 iId;                    /* Rowid of this profile in stmt_profile */
+  i64 nRun;                   /* Number of runs recorded */
+  u64 aStat[VDBE_PROF_N];     /* Totals for all runs */
+  int nOp;                    /* Number of entries in aOp[] */
+  StmtProfileOp *aOp;         /* Instructions of the most recent program */
+  StmtProfile *pNext;         /* Next profile, in order of creation */
+  StmtProfile *pHashNext;     /* Next profile in the same hash bucket */
+};
+
+/*
+** The profiles recorded by a database connection (sqlite3.pStmtProfiler).
+*/
+struct StmtProfiler {
+  int nProfile;               /* Number of profiles in the list */
+  int nHash;                  /* Number of buckets in aHash[] */
+  StmtProfile **aHash;        /* Hash table of profiles */
+  StmtProfile *pFirst;        /* Oldest profile */
+  StmtProfile *pLast;         /* Newest profile */
+  i64 iNextId;                /* Rowid for the next profile created */
+};
+
+/*
+** Hash SQL text.  Unlike the hash tables in hash.c, SQL text is case
+** sensitive, as it may contain string literals.
+*/
+static unsigned int profileHash(const char *z, int n){
+  unsigned int h = 0;
+  while( n-- > 0 ){
+    h = (h<<3) ^ h ^ (u8)*(z++);
+  }
+  return h;
+}
+
+/*
+** Return the profile of SQL statement zSql, or NULL if there is none.
+*/
+static StmtProfile *profileFind(StmtProfiler *pProfiler, const char *zSql){
+  StmtProfile *pEntry;
+  int nSql;
+  unsigned int iHash;
+  if( pProfiler==0 || pProfiler->nHash==0 ) return 0;
+  nSql = sqlite3Strlen30(zSql);
+  iHash = profileHash(zSql, nSql);
+  for(pEntry=pProfiler->aHash[iHash % pProfiler->nHash];
+      pEntry;
+      pEntry=pEntry->pHashNext
+  ){
+    if( pEntry->iHash==iHash && pEntry->nSql==nSql
+     && memcmp(pEntry->zSql, zSql, nSql)==0
+    ){
+      return pEntry;
+    }
+  }
+  return 0;
+}
+
+/*
+** Create a new profile for SQL statement zSql and add it to the
+** profiler of connection db.  Return NULL if a malloc fails.
+*/
+static StmtProfile *profileCreate(sqlite3 *db, const char *zSql){
+  StmtProfiler *pProfiler = db->pStmtProfiler;
+  StmtProfile *pEntry;
+  int nSql = sqlite3Strlen30(zSql);
+
+  if( pProfiler==0 ){
+    pProfiler = (StmtProfiler *)sqlite3MallocZero(sizeof(StmtProfiler));
+    if( pProfiler==0 ) return 0;
+    pProfiler->iNextId = 1;
+    db->pStmtProfiler = pProfiler;
+  }
+
+  /* Grow the hash table so that it has at least as many buckets as there
+  ** are profiles.  */
+  if( pProfiler->nProfile>=pProfiler->nHash ){
+    int nNew = pProfiler->nHash ? pProfiler->nHash*2 : 64;
+    StmtProfile **aNew;
+    StmtProfile *p;
+    aNew = (StmtProfile **)sqlite3MallocZero(nNew*sizeof(StmtProfile*));
+    if( aNew==0 ) return 0;
+    for(p=pProfiler->pFirst; p; p=p->pNext){
+      int iBucket = p->iHash % nNew;
+      p->pHashNext = aNew[iBucket];
+      aNew[iBucket] = p;
+    }
+    sqlite3_free(pProfiler->aHash);
+    pProfiler->aHash = aNew;
+    pProfiler->nHash = nNew;
+  }
+
+  pEntry = (StmtProfile *)sqlite3MallocZero(sizeof(StmtProfile) + nSql + 1);
+  if( pEntry==0 ) return 0;
+  pEntry->zSql = (char *)&pEntry[1];
+  memcpy(pEntry->zSql, zSql, nSql+1);
+  pEntry->nSql = nSql;
+  pEntry->iHash = profileHash(zSql, nSql);
+  pEntry->iId = pProfiler->iNextId++;
+  pEntry->pHashNext = pProfiler->aHash[pEntry->iHash % pProfiler->nHash];
+  pProfiler->aHash[pEntry->iHash % pProfiler->nHash] = pEntry;
+  if( pProfiler->pLast ){
+    pProfiler->pLast->pNext = pEntry;
+  }else{
+    pProfiler->pFirst = pEntry;
+  }
+  pProfiler->pLast = pEntry;
+  pProfiler->nProfile++;
+  return pEntry;
+}
+
+/*
+** Remove profile pEntry from the profiler of connection db and free it.
+*/
+static void profileDelete(sqlite3 *db, StmtProfile *pEntry){
+  StmtProfiler *pProfiler = db->pStmtProfiler;
+  StmtProfile **pp;
+
+  for(pp=&pProfiler->aHash[pEntry->iHash % pProfiler->nHash];
+      *pp!=pEntry;
+      pp=&(*pp)->pHashNext
+  );
+  *pp = pEntry->pHashNext;
+
+  if( pProfiler->pFirst==pEntry ){
+    pProfiler->pFirst = pEntry->pNext;
+    if( pProfiler->pLast==pEntry ) pProfiler->pLast = 0;
+  }else{
+    StmtProfile *pPrev = pProfiler->pFirst;
+    while( pPrev->pNext!=pEntry ) pPrev = pPrev->pNext;
+    pPrev->pNext = pEntry->pNext;
+    if( pProfiler->pLast==pEntry ) pProfiler->pLast = pPrev;
+  }
+  pProfiler->nProfile--;
+
+  sqlite3_free(pEntry->aOp);
+  sqlite3_free(pEntry);
+}
+
+/*
+** Free all profiles recorded by connection db.  This is called by
+** sqlite3_close().
+*/
+SQLITE_PRIVATE void sqlite3StmtProfileClose(sqlite3 *db){
+  StmtProfiler *pProfiler = db->pStmtProfiler;
+  if( pProfiler ){
+    StmtProfile *pEntry;
+    StmtProfile *pNext;
+    for(pEntry=pProfiler->pFirst; pEntry; pEntry=pNext){
+      pNext = pEntry->pNext;
+      sqlite3_free(pEntry->aOp);
+      sqlite3_free(pEntry);
+    }
+    sqlite3_free(pProfiler->aHash);
+    sqlite3_free(pProfiler);
+    db->pStmtProfiler = 0;
+  }
+}
+
+/*
+** Write the total b-tree search count and page cache statistics of all
+** databases attached to connection db to a[0] through a[3], in the order
+** of the VDBE_PROF_SEEK to VDBE_PROF_READ values.
+*/
+static void profileTotals(sqlite3 *db, u32 *a){
+  int i;
+  memset(a, 0, sizeof(u32)*4);
+  for(i=0; i<db->nDb; i++){
+    Btree *pBt = db->aDb[i].pBt;
+    if( pBt ){
+      Pager *pPager = sqlite3BtreePager(pBt);
+      a[0] += sqlite3BtreeSeekCount(pBt);
+      a[1] += sqlite3PagerCacheStat(pPager, PAGER_STAT_HIT);
+      a[2] += sqlite3PagerCacheStat(pPager, PAGER_STAT_MISS);
+      a[3] += sqlite3PagerCacheStat(pPager, PAGER_STAT_READ);
+    }
+  }
+}
+
+/*
+** This is called by sqlite3_step() when VM p starts a new run, if
+** PRAGMA stmt_profile is set or p was profiled during its last run.
+** Prepare p->pProf to count the run, or free it if the run is not to be
+** profiled.
+*/
+SQLITE_PRIVATE void sqlite3VdbeProfileBegin(Vdbe *p){
+  sqlite3 *db = p->db;
+  VdbeProfile *pProf = p->pProf;
+  int nByte = sizeof(VdbeProfile) + (p->nOp-1)*sizeof(VdbeOpProfile);
+
+  if( db->nStmtProfile==0 || p->zSql==0 || p->nOp==0
+   || (profileFind(db->pStmtProfiler, p->zSql)==0
+       && db->pStmtProfiler && db->pStmtProfiler->nProfile>=db->nStmtProfile)
+  ){
+    sqlite3_free(pProf);
+    p->pProf = 0;
+    return;
+  }
+
+  if( pProf==0 ){
+    /* If this allocation fails the run is simply not profiled. */
+    sqlite3BeginBenignMalloc();
+    pProf = (VdbeProfile *)sqlite3Malloc(nByte);
+    sqlite3EndBenignMalloc();
+    if( pProf==0 ) return;
+    p->pProf = pProf;
+  }
+  assert( sqlite3MallocSize(pProf)>=nByte );
+  memset(pProf, 0, nByte);
+  pProf->nOp = p->nOp;
+  memcpy(pProf->aCounter, p->aCounter, sizeof(pProf->aCounter));
+}
+
+/*
+** Called as sqlite3VdbeExec() starts executing VM p, which is being
+** profiled.
+*/
+SQLITE_PRIVATE void sqlite3VdbeProfileEnter(Vdbe *p){
+  profileTotals(p->db, p->pProf->aBase);
+}
+
+/*
+** Called as sqlite3VdbeExec() returns rc after executing VM p, which is
+** being profiled.  Add the b-tree and pager activity since the call to
+** sqlite3VdbeProfileEnter() to the totals for the current run.
+*/
+SQLITE_PRIVATE void sqlite3VdbeProfileLeave(Vdbe *p, int rc){
+  VdbeProfile *pProf = p->pProf;
+  u32 aNow[4];
+  int i;
+
+  profileTotals(p->db, aNow);
+  for(i=0; i<4; i++){
+    pProf->aStat[VDBE_PROF_SEEK+i] += (u32)(aNow[i] - pProf->aBase[i]);
+  }
+  if( rc==SQLITE_ROW ){
+    pProf->aStat[VDBE_PROF_ROW]++;
+  }
+}
+
+/*
+** Called by sqlite3VdbeReset() when the run of VM p that was profiled is
+** over.  Add the totals for the run to the profile of p's SQL statement.
+*/
+SQLITE_PRIVATE void sqlite3VdbeProfileEnd(Vdbe *p){
+  sqlite3 *db = p->db;
+  VdbeProfile *pProf = p->pProf;
+  StmtProfile *pEntry;
+  int i;
+
+  if( pProf->aStat[VDBE_PROF_STEP]==0 ) return;
+  assert( p->zSql && pProf->nOp==p->nOp );
+
+  sqlite3BeginBenignMalloc();
+  pEntry = profileFind(db->pStmtProfiler, p->zSql);
+  if( pEntry==0 ){
+    pEntry = profileCreate(db, p->zSql);
+  }
+
+  /* If the statement has been recompiled since it was last profiled,
+  ** start again with the instructions of the new program.  */
+  if( pEntry ){
+    int bNew = (pEntry->nOp!=p->nOp);
+    for(i=0; bNew==0 && i<p->nOp; i++){
+      StmtProfileOp *pOp = &pEntry->aOp[i];
+      bNew = (pOp->opcode!=p->aOp[i].opcode || pOp->p1!=p->aOp[i].p1
+           || pOp->p2!=p->aOp[i].p2 || pOp->p3!=p->aOp[i].p3);
+    }
+    if( bNew ){
+      StmtProfileOp *aOp;
+      aOp = (StmtProfileOp *)sqlite3MallocZero(p->nOp*sizeof(StmtProfileOp));
+      sqlite3_free(pEntry->aOp);
+      pEntry->aOp = aOp;
+      pEntry->nOp = aOp ? p->nOp : 0;
+      for(i=0; i<pEntry->nOp; i++){
+        aOp[i].opcode = p->aOp[i].opcode;
+        aOp[i].p1 = p->aOp[i].p1;
+        aOp[i].p2 = p->aOp[i].p2;
+        aOp[i].p3 = p->aOp[i].p3;
+      }
+    }
+  }
+  sqlite3EndBenignMalloc();
+
+  if( pEntry ){
+    for(i=0; i<pEntry->nOp; i++){
+      pEntry->aOp[i].nExec += pProf->aOp[i].nExec;
+      pEntry->aOp[i].nCycle += pProf->aOp[i].nCycle;
+      pProf->aStat[VDBE_PROF_CYCLE] += pProf->aOp[i].nCycle;
+    }
+
+    /* The sqlite3_stmt_status() counters may have been reset during the
+    ** run.  If so, count from zero.  */
+    for(i=0; i<3; i++){
+      int iStart = pProf->aCounter[i];
+      if( iStart>p->aCounter[i] ) iStart = 0;
+      pProf->aStat[VDBE_PROF_FULLSCAN+i] += p->aCounter[i] - iStart;
+    }
+
+    for(i=0; i<VDBE_PROF_N; i++){
+      pEntry->aStat[i] += pProf->aStat[i];
+    }
+    pEntry->nRun++;
+  }
+  pProf->aStat[VDBE_PROF_STEP] = 0;
+}
+
+#ifndef SQLITE_OMIT_VIRTUALTABLE
+
+/*
+** The stmt_profile virtual table.
+**
+** The columns of the table depend on whether it has one row for each
+** statement or one row for each instruction.  The rowid of a statement
+** row is a number that identifies the profile.  The rowid of an
+** instruction row is the row number.
+*/
+#define PROF_SCHEMA_STMT                                                    \
+  "CREATE TABLE xx("                                                        \
+  "  sql TEXT,              /* Text of SQL statement */"                    \
+  "  runs INTEGER,          /* Number of runs profiled */"                  \
+  "  rows INTEGER,          /* Rows returned */"                            \
+  "  vm_steps INTEGER,      /* VDBE instructions executed */"               \
+  "  cycles INTEGER,        /* Clock ticks spent in the VDBE */"            \
+  "  seeks INTEGER,         /* B-tree searches */"                          \
+  "  cache_hits INTEGER,    /* Page cache hits */"                          \
+  "  cache_misses INTEGER,  /* Page cache misses */"                        \
+  "  bytes_read INTEGER,    /* Bytes read from database and WAL files */"   \
+  "  fullscan_steps INTEGER,/* SQLITE_STMTSTATUS_FULLSCAN_STEP */"          \
+  "  sorts INTEGER,         /* SQLITE_STMTSTATUS_SORT */"                   \
+  "  autoindexes INTEGER    /* SQLITE_STMTSTATUS_AUTOINDEX */"              \
+  ");"
+
+#define PROF_SCHEMA_OPCODES                                                 \
+  "CREATE TABLE xx("                                                        \
+  "  sql TEXT,              /* Text of SQL statement */"                    \
+  "  addr INTEGER,          /* Address of instruction */"                   \
+  "  opcode TEXT,           /* Name of opcode */"                           \
+  "  p1 INTEGER,            /* P1 operand */"                               \
+  "  p2 INTEGER,            /* P2 operand */"                               \
+  "  p3 INTEGER,            /* P3 operand */"                               \
+  "  count INTEGER,         /* Number of times executed */"                 \
+  "  cycles INTEGER         /* Clock ticks spent executing it */"           \
+  ");"
+
+typedef struct ProfTable ProfTable;
+typedef struct ProfCursor ProfCursor;
+
+struct ProfTable {
+  sqlite3_vtab base;
+  sqlite3 *db;                    /* Connection that owns the profiles */
+  int bOpcodes;                   /* True for one row per instruction */
+};
+
+/*
+** A cursor iterates through a copy of the profiles taken by xFilter, as
+** the profiles may be changed or deleted while it is open.
+*/
+struct ProfCursor {
+  sqlite3_vtab_cursor base;
+  int nProfile;                   /* Number of profiles in aProfile[] */
+  StmtProfile *aProfile;          /* Copy of the profiles */
+  int iProfile;                   /* Current entry in aProfile[] */
+  int iOp;                        /* Current instruction (opcodes only) */
+  i64 iRowid;                     /* Rowid of current row (opcodes only) */
+};
+
+/*
+** Connect to or create a stmt_profile virtual table.
+*/
+static int profConnect(
+  sqlite3 *db,
+  void *pAux,
+  int argc, const char *const*argv,
+  sqlite3_vtab **ppVtab,
+  char **pzErr
+){
+  ProfTable *pTab;
+  int bOpcodes = 0;
+  int rc;
+
+  UNUSED_PARAMETER(pAux);
+  if( argc>4 || (argc==4 && sqlite3StrICmp(argv[3], "opcodes")!=0) ){
+    *pzErr = sqlite3_mprintf("stmt_profile: unknown argument");
+    return SQLITE_ERROR;
+  }
+  bOpcodes = (argc==4);
+
+  rc = sqlite3_declare_vtab(db,
+      bOpcodes ? PROF_SCHEMA_OPCODES : PROF_SCHEMA_STMT
+  );
+  if( rc!=SQLITE_OK ) return rc;
+
+  pTab = (ProfTable *)sqlite3_malloc(sizeof(ProfTable));
+  if( pTab==0 ) return SQLITE_NOMEM;
+  memset(pTab, 0, sizeof(ProfTable));
+  pTab->db = db;
+  pTab->bOpcodes = bOpcodes;
+  *ppVtab = &pTab->base;
+  return SQLITE_OK;
+}
+
+/*
+** Disconnect from or destroy a stmt_profile virtual table.
+*/
+static int profDisconnect(sqlite3_vtab *pVtab){
+  sqlite3_free(pVtab);
+  return SQLITE_OK;
+}
+
+/*
+** There is no way to use an index on a stmt_profile table.  Every query
+** is a full scan.
+*/
+static int profBestIndex(sqlite3_vtab *tab, sqlite3_index_info *pIdxInfo){
+  ProfTable *pTab = (ProfTable *)tab;
+  StmtProfiler *pProfiler = pTab->db->pStmtProfiler;
+  pIdxInfo->estimatedCost = pProfiler ? (double)pProfiler->nProfile : 1.0;
+  if( pTab->bOpcodes ) pIdxInfo->estimatedCost *= 50.0;
+  return SQLITE_OK;
+}
+
+/*
+** Open a new stmt_profile cursor.
+*/
+static int profOpen(sqlite3_vtab *pVTab, sqlite3_vtab_cursor **ppCursor){
+  ProfCursor *pCsr;
+  UNUSED_PARAMETER(pVTab);
+  pCsr = (ProfCursor *)sqlite3_malloc(sizeof(ProfCursor));
+  if( pCsr==0 ) return SQLITE_NOMEM;
+  memset(pCsr, 0, sizeof(ProfCursor));
+  *ppCursor = &pCsr->base;
+  return SQLITE_OK;
+}
+
+/*
+** Free the copy of the profiles held by cursor pCsr.
+*/
+static void profCursorReset(ProfCursor *pCsr){
+  int i;
+  for(i=0; i<pCsr->nProfile; i++){
+    sqlite3_free(pCsr->aProfile[i].zSql);
+    sqlite3_free(pCsr->aProfile[i].aOp);
+  }
+  sqlite3_free(pCsr->aProfile);
+  pCsr->aProfile = 0;
+  pCsr->nProfile = 0;
+  pCsr->iProfile = 0;
+  pCsr->iOp = 0;
+  pCsr->iRowid = 0;
+}
+
+/*
+** Close a stmt_profile cursor.
+*/
+static int profClose(sqlite3_vtab_cursor *pCursor){
+  ProfCursor *pCsr = (ProfCursor *)pCursor;
+  profCursorReset(pCsr);
+  sqlite3_free(pCsr);
+  return SQLITE_OK;
+}
+
+/*
+** Skip over profiles with no instructions, if this cursor iterates
+** through instructions.
+*/
+static void profSkipEmpty(ProfCursor *pCsr){
+  ProfTable *pTab = (ProfTable *)pCsr->base.pVtab;
+  if( pTab->bOpcodes ){
+    while( pCsr->iProfile<pCsr->nProfile
+        && pCsr->iOp>=pCsr->aProfile[pCsr->iProfile].nOp
+    ){
+      pCsr->iProfile++;
+      pCsr->iOp = 0;
+    }
+  }
+}
+
+/*
+** Copy the profiles recorded by the connection into the cursor and move
+** to the first row.
+*/
+static int profFilter(
+  sqlite3_vtab_cursor *pCursor,
+  int idxNum, const char *idxStr,
+  int argc, sqlite3_value **argv
+){
+  ProfCursor *pCsr = (ProfCursor *)pCursor;
+  ProfTable *pTab = (ProfTable *)pCursor->pVtab;
+  StmtProfiler *pProfiler = pTab->db->pStmtProfiler;
+  StmtProfile *pEntry;
+
+  UNUSED_PARAMETER(idxNum);
+  UNUSED_PARAMETER(idxStr);
+  UNUSED_PARAMETER(argc);
+  UNUSED_PARAMETER(argv);
+
+  profCursorReset(pCsr);
+  if( pProfiler==0 || pProfiler->nProfile==0 ) return SQLITE_OK;
+
+  pCsr->aProfile = (StmtProfile *)sqlite3_malloc(
+      pProfiler->nProfile*sizeof(StmtProfile)
+  );
+  if( pCsr->aProfile==0 ) return SQLITE_NOMEM;
+  for(pEntry=pProfiler->pFirst; pEntry; pEntry=pEntry->pNext){
+    StmtProfile *pCopy = &pCsr->aProfile[pCsr->nProfile++];
+    *pCopy = *pEntry;
+    pCopy->aOp = 0;
+    pCopy->pNext = pCopy->pHashNext = 0;
+    pCopy->zSql = sqlite3_mprintf("%s", pEntry->zSql);
+    if( pCopy->zSql==0 ) return SQLITE_NOMEM;
+    if( pTab->bOpcodes && pEntry->nOp ){
+      int nByte = pEntry->nOp*sizeof(StmtProfileOp);
+      pCopy->aOp = (StmtProfileOp *)sqlite3_malloc(nByte);
+      if( pCopy->aOp==0 ) return SQLITE_NOMEM;
+      memcpy(pCopy->aOp, pEntry->aOp, nByte);
+    }else{
+      pCopy->nOp = 0;
+    }
+  }
+  assert( pCsr->nProfile==pProfiler->nProfile );
+
+  profSkipEmpty(pCsr);
+  pCsr->iRowid = 1;
+  return SQLITE_OK;
+}
+
+/*
+** Move a stmt_profile cursor to the next row.
+*/
+static int profNext(sqlite3_vtab_cursor *pCursor){
+  ProfCursor *pCsr = (ProfCursor *)pCursor;
+  ProfTable *pTab = (ProfTable *)pCursor->pVtab;
+  if( pTab->bOpcodes ){
+    pCsr->iOp++;
+    pCsr->iRowid++;
+    profSkipEmpty(pCsr);
+  }else{
+    pCsr->iProfile++;
+  }
+  return SQLITE_OK;
+}
+
+static int profEof(sqlite3_vtab_cursor *pCursor){
+  ProfCursor *pCsr = (ProfCursor *)pCursor;
+  return pCsr->iProfile>=pCsr->nProfile;
+}
+
+static int profColumn(
+  sqlite3_vtab_cursor *pCursor,
+  sqlite3_context *ctx,
+  int i
+){
+  ProfCursor *pCsr = (ProfCursor *)pCursor;
+  ProfTable *pTab = (ProfTable *)pCursor->pVtab;
+  StmtProfile *pEntry = &pCsr->aProfile[pCsr->iProfile];
+
+  if( i==0 ){
+    sqlite3_result_text(ctx, pEntry->zSql, -1, SQLITE_TRANSIENT);
+  }else if( pTab->bOpcodes ){
+    StmtProfileOp *pOp = &pEntry->aOp[pCsr->iOp];
+    switch( i ){
+      case 1:                     /* addr */
+        sqlite3_result_int(ctx, pCsr->iOp);
+        break;
+      case 2:                     /* opcode */
+#if !defined(SQLITE_OMIT_EXPLAIN) || !defined(NDEBUG) \
+ || defined(VDBE_PROFILE) || defined(SQLITE_DEBUG)
+        sqlite3_result_text(ctx, sqlite3OpcodeName(pOp->opcode), -1,
+                            SQLITE_STATIC);
+#else
+        sqlite3_result_int(ctx, pOp->opcode);
+#endif
+        break;
+      case 3:                     /* p1 */
+        sqlite3_result_int(ctx, pOp->p1);
+        break;
+      case 4:                     /* p2 */
+        sqlite3_result_int(ctx, pOp->p2);
+        break;
+      case 5:                     /* p3 */
+        sqlite3_result_int(ctx, pOp->p3);
+        break;
+      case 6:                     /* count */
+        sqlite3_result_int64(ctx, (i64)pOp->nExec);
+        break;
+      default:                    /* cycles */
+        assert( i==7 );
+        sqlite3_result_int64(ctx, (i64)pOp->nCycle);
+        break;
+    }
+  }else if( i==1 ){               /* runs */
+    sqlite3_result_int64(ctx, pEntry->nRun);
+  }else{
+    /* The remaining columns are in the same order as aStat[]. */
+    assert( i>=2 && i<2+VDBE_PROF_N );
+    sqlite3_result_int64(ctx, (i64)pEntry->aStat[i-2]);
+  }
+  return SQLITE_OK;
+}
+
+static int profRowid(sqlite3_vtab_cursor *pCursor, sqlite_int64 *pRowid){
+  ProfCursor *pCsr = (ProfCursor *)pCursor;
+  ProfTable *pTab = (ProfTable *)pCursor->pVtab;
+  if( pTab->bOpcodes ){
+    *pRowid = pCsr->iRowid;
+  }else{
+    *pRowid = pCsr->aProfile[pCsr->iProfile].iId;
+  }
+  return SQLITE_OK;
+}
+
+/*
+** The only change that may be made to a stmt_profile table is to DELETE
+** rows from a table with one row per statement, which discards the
+** profiles of those statements.
+*/
+static int profUpdate(
+  sqlite3_vtab *pVtab,
+  int argc,
+  sqlite3_value **argv,
+  sqlite_int64 *pRowid
+){
+  ProfTable *pTab = (ProfTable *)pVtab;
+  StmtProfiler *pProfiler = pTab->db->pStmtProfiler;
+  StmtProfile *pEntry;
+  i64 iId;
+
+  UNUSED_PARAMETER(pRowid);
+  if( argc!=1 || pTab->bOpcodes ){
+    sqlite3_free(pVtab->zErrMsg);
+    pVtab->zErrMsg = sqlite3_mprintf(
+        "rows may only be deleted from a stmt_profile table"
+    );
+    return SQLITE_ERROR;
+  }
+  iId = sqlite3_value_int64(argv[0]);
+  for(pEntry=(pProfiler ? pProfiler->pFirst : 0); pEntry; pEntry=pEntry->pNext){
+    if( pEntry->iId==iId ){
+      profileDelete(pTab->db, pEntry);
+      break;
+    }
+  }
+  return SQLITE_OK;
+}
+
+/*
+** Register the stmt_profile virtual table module with connection db.
+** This is called as each connection is opened.
+*/
+SQLITE_PRIVATE int sqlite3StmtProfileInit(sqlite3 *db){
+  static sqlite3_module stmt_profile_module = {
+    0,                            /* iVersion */
+    profConnect,                  /* xCreate */
+    profConnect,                  /* xConnect */
+    profBestIndex,                /* xBestIndex */
+    profDisconnect,               /* xDisconnect */
+    profDisconnect,               /* xDestroy */
+    profOpen,                     /* xOpen - open a cursor */
+    profClose,                    /* xClose - close a cursor */
+    profFilter,                   /* xFilter - configure scan constraints */
+    profNext,                     /* xNext - advance a cursor */
+    profEof,                      /* xEof - check for end of scan */
+    profColumn,                   /* xColumn - read data */
+    profRowid,                    /* xRowid - read data */
+    profUpdate,                   /* xUpdate */
+    0,                            /* xBegin */
+    0,                            /* xSync */
+    0,                            /* xCommit */
+    0,                            /* xRollback */
+    0,                            /* xFindMethod */
+    0,                            /* xRename */
+  };
+  return sqlite3_create_module(db, "stmt_profile", &stmt_profile_module, 0);
+}
+
+#endif /* SQLITE_OMIT_VIRTUALTABLE */
+#endif /* SQLITE_OMIT_STMT_PROFILE */
+
+/************** End of vdbeprof.c ********************************************/
 /************** Begin file vdbe.c ********************************************/
 /*
 ** 2001 September 15
@@ -62369,6 +66682,39 @@ SQLITE_PRIVATE   sqlite_uint64 sqlite3Hwtime(void){ return ((sqlite_uint64)0); }
 
 #endif
 
+#ifndef SQLITE_OMIT_STMT_PROFILE
+/*
+** Return the clock used to time VDBE instructions for PRAGMA stmt_profile:
+** the CPU time-stamp counter on x86 processors, or a monotonic clock in
+** nanoseconds on other unix systems.  Where neither is available the
+** instructions are counted but not timed.
+*/
+#if defined(__GNUC__) && (defined(__i386__) || defined(__x86_64__))
+static u64 vdbeProfileClock(void){
+  unsigned int lo, hi;
+  __asm__ __volatile__ ("rdtsc" : "=a" (lo), "=d" (hi));
+  return (u64)hi << 32 | lo;
+}
+#elif defined(_MSC_VER) && (defined(_M_IX86) || defined(_M_X64))
+#include <intrin.h>
+static u64 vdbeProfileClock(void){
+  return (u64)__rdtsc();
+}
+#elif SQLITE_OS_UNIX
+static u64 vdbeProfileClock(void){
+#ifdef CLOCK_MONOTONIC
+  struct timespec sNow;
+  if( clock_gettime(CLOCK_MONOTONIC, &sNow)==0 ){
+    return (u64)sNow.tv_sec*1000000000 + sNow.tv_nsec;
+  }
+#endif
+  return 0;
+}
+#else
+# define vdbeProfileClock() ((u64)0)
+#endif
+#endif /* SQLITE_OMIT_STMT_PROFILE */
+
 /*
 ** The CHECK_FOR_INTERRUPT macro defined here looks to see if the
 ** sqlite3_interrupt() routine has been called.  If it has been, then
@@ -62472,6 +66818,11 @@ SQLITE_PRIVATE int sqlite3VdbeExec(
 #ifdef VDBE_PROFILE
   u64 start;                 /* CPU clock count at start of opcode */
   int origPc;                /* Program counter at start of opcode */
+#endif
+#ifndef SQLITE_OMIT_STMT_PROFILE
+  VdbeOpProfile *aOpProf;    /* Per-instruction counters, or NULL */
+  u64 iProfStart = 0;        /* vdbeProfileClock() at start of opcode */
+  int iProfPc = 0;           /* Instruction of main program being timed */
 #endif
   /********************************************************************
   ** Automatically generated code
@@ -62884,6 +67235,13 @@ SQLITE_PRIVATE int sqlite3VdbeExec(
 
   assert( p->magic==VDBE_MAGIC_RUN );  /* sqlite3_step() verifies this */
   sqlite3VdbeEnter(p);
+#ifndef SQLITE_OMIT_STMT_PROFILE
+  aOpProf = 0;
+  if( p->pProf ){
+    sqlite3VdbeProfileEnter(p);
+    aOpProf = p->pProf->aOp;
+  }
+#endif
   if( p->rc==SQLITE_NOMEM ){
     /* This happens if a malloc() inside a call to sqlite3_column_text() or
     ** sqlite3_column_text16() failed.  */
@@ -62917,6 +67275,20 @@ SQLITE_PRIVATE int sqlite3VdbeExec(
 #ifdef VDBE_PROFILE
     origPc = pc;
     start = sqlite3Hwtime();
+#endif
+#ifndef SQLITE_OMIT_STMT_PROFILE
+    if( aOpProf ){
+      p->pProf->aStat[VDBE_PROF_STEP]++;
+      if( p->pFrame ){
+        VdbeFrame *pFrame;
+        for(pFrame=p->pFrame; pFrame->pParent; pFrame=pFrame->pParent);
+        iProfPc = pFrame->pc;
+      }else{
+        iProfPc = pc;
+        aOpProf[pc].nExec++;
+      }
+      iProfStart = vdbeProfileClock();
+    }
 #endif
     pOp = &aOp[pc];
 
@@ -65360,7 +69732,8 @@ case OP_VerifyCookie: {
 **
 ** This instruction works just like OpenRead except that it opens the cursor
 ** in read/write mode.  For a given table, there can be one or more read-only
-** cursors or a single read/write cursor but not both.
+** cursors or a single read/write cursor but not both.  If PRAGMA bulk_load
+** is set, the cursor is opened in bulk-load mode.
 **
 ** See also OpenRead.
 */
@@ -65441,6 +69814,9 @@ case OP_OpenWrite: {
     u.aw.pCur->pCursor = 0;
     rc = SQLITE_OK;
   }
+  if( u.aw.wrFlag && db->nBulkFill && u.aw.pCur->pCursor ){
+    sqlite3BtreeCursorBulkLoad(u.aw.pCur->pCursor, db->nBulkFill);
+  }
 
   /* Set the VdbeCursor.isTable and isIndex variables. Previous versions of
   ** SQLite used to check if the root-page flags were sane at this point
@@ -65525,6 +69901,32 @@ case OP_OpenEphemeral: {
   break;
 }
 
+/* Opcode: SorterOpen P1 P2 * P4 *
+**
+** This opcode works like OP_OpenEphemeral except that it opens
+** a transient index that is specifically designed to sort large
+** tables using an external merge-sort algorithm.  Keys are added
+** using OP_SorterInsert and read back in order using OP_SorterSort,
+** OP_SorterNext and OP_SorterData.
+*/
+case OP_SorterOpen: {
+#ifndef SQLITE_OMIT_MERGE_SORT
+  VdbeCursor *pCx;
+
+  assert( pOp->p1>=0 );
+  assert( pOp->p4type==P4_KEYINFO );
+  pCx = allocateCursor(p, pOp->p1, pOp->p2, -1, 0);
+  if( pCx==0 ) goto no_mem;
+  pCx->pKeyInfo = pOp->p4.pKeyInfo;
+  pCx->pKeyInfo->enc = ENC(p->db);
+  pCx->isIndex = 1;
+  pCx->nullRow = 1;
+  rc = sqlite3VdbeSorterInit(db, pCx);
+  if( rc==SQLITE_NOMEM ) goto no_mem;
+#endif
+  break;
+}
+
 /* Opcode: OpenPseudo P1 P2 P3 * *
 **
 ** Open a new cursor that points to a fake table that contains a single
@@ -65888,6 +70290,32 @@ case OP_Found: {        /* jump, in3 */
   break;
 }
 
+/* Opcode: SorterCompare P1 P2 P3 * *
+**
+** P1 is a sorter cursor used to build a UNIQUE index and register P3
+** holds the previous key read from the sorter.  If the current sorter
+** key is equal to the key in register P3 (ignoring the trailing rowid
+** of each), fall through to the next instruction.  Otherwise, jump to
+** P2.  Keys that contain NULL values are never considered equal.
+*/
+case OP_SorterCompare: {    /* jump, in3 */
+#ifndef SQLITE_OMIT_MERGE_SORT
+  VdbeCursor *pC;
+  int res;
+
+  pC = p->apCsr[pOp->p1];
+  assert( pC!=0 && pC->pSorter!=0 );
+  pIn3 = &aMem[pOp->p3];
+  assert( pIn3->flags & MEM_Blob );
+  res = 0;
+  rc = sqlite3VdbeSorterCompare(pC, pIn3, &res);
+  if( res ){
+    pc = pOp->p2-1;
+  }
+#endif
+  break;
+}
+
 /* Opcode: IsUnique P1 P2 P3 P4 *
 **
 ** Cursor P1 is open on an index b-tree - that is to say, a btree which
@@ -66474,6 +70902,25 @@ case OP_RowData: {
   break;
 }
 
+/* Opcode: SorterData P1 P2 * * *
+**
+** Write into register P2 the current sorter data for sorter cursor P1.
+*/
+case OP_SorterData: {
+#ifndef SQLITE_OMIT_MERGE_SORT
+  VdbeCursor *pC;
+
+  pOut = &aMem[pOp->p2];
+  memAboutToChange(p, pOut);
+  pC = p->apCsr[pOp->p1];
+  assert( pC!=0 && pC->pSorter!=0 );
+  rc = sqlite3VdbeSorterRowkey(pC, pOut);
+  if( rc==SQLITE_NOMEM ) goto no_mem;
+  UPDATE_MAX_BLOBSIZE(pOut);
+#endif
+  break;
+}
+
 /* Opcode: Rowid P1 P2 * * *
 **
 ** Store in register P2 an integer which is the key of the table entry that
@@ -66580,6 +71027,37 @@ case OP_Last: {        /* jump */
 }
 
 
+/* Opcode: SorterSort P1 P2 * * *
+**
+** Sort the keys written to sorter cursor P1 using OP_SorterInsert and
+** rewind the sorter so that the next use of OP_SorterData refers to the
+** smallest key.  If the sorter is empty, jump immediately to P2.
+*/
+case OP_SorterSort: {    /* jump */
+#ifndef SQLITE_OMIT_MERGE_SORT
+  VdbeCursor *pC;
+  int res;
+
+#ifdef SQLITE_TEST
+  sqlite3_sort_count++;
+  sqlite3_search_count--;
+#endif
+  p->aCounter[SQLITE_STMTSTATUS_SORT-1]++;
+  assert( pOp->p1>=0 && pOp->p1<p->nCursor );
+  pC = p->apCsr[pOp->p1];
+  assert( pC!=0 && pC->pSorter!=0 );
+  res = 1;
+  rc = sqlite3VdbeSorterRewind(db, pC, &res);
+  if( rc==SQLITE_NOMEM ) goto no_mem;
+  pC->nullRow = (u8)res;
+  assert( pOp->p2>0 && pOp->p2<p->nOp );
+  if( res ){
+    pc = pOp->p2 - 1;
+  }
+#endif
+  break;
+}
+
 /* Opcode: Sort P1 P2 * * *
 **
 ** This opcode does exactly the same thing as OP_Rewind except that
@@ -66697,6 +71175,35 @@ case OP_Next: {        /* jump */
   break;
 }
 
+/* Opcode: SorterNext P1 P2 * * *
+**
+** Advance sorter cursor P1 to the next key.  If there are no more keys
+** then fall through to the following instruction.  Otherwise, jump
+** immediately to P2.
+*/
+case OP_SorterNext: {    /* jump */
+#ifndef SQLITE_OMIT_MERGE_SORT
+  VdbeCursor *pC;
+  int res;
+
+  CHECK_FOR_INTERRUPT;
+  assert( pOp->p1>=0 && pOp->p1<p->nCursor );
+  pC = p->apCsr[pOp->p1];
+  assert( pC!=0 && pC->pSorter!=0 );
+  res = 1;
+  rc = sqlite3VdbeSorterNext(db, pC, &res);
+  if( rc==SQLITE_NOMEM ) goto no_mem;
+  pC->nullRow = (u8)res;
+  if( res==0 ){
+    pc = pOp->p2 - 1;
+#ifdef SQLITE_TEST
+    sqlite3_search_count++;
+#endif
+  }
+#endif
+  break;
+}
+
 /* Opcode: IdxInsert P1 P2 P3 * P5
 **
 ** Register P2 holds a SQL index key made using the
@@ -66739,6 +71246,29 @@ case OP_IdxInsert: {        /* in2 */
   break;
 }
 
+/* Opcode: SorterInsert P1 P2 * * *
+**
+** Register P2 holds an SQL index key made using the MakeRecord
+** instruction.  This opcode adds the key to sorter cursor P1.
+*/
+case OP_SorterInsert: {    /* in2 */
+#ifndef SQLITE_OMIT_MERGE_SORT
+  VdbeCursor *pC;
+
+  assert( pOp->p1>=0 && pOp->p1<p->nCursor );
+  pC = p->apCsr[pOp->p1];
+  assert( pC!=0 && pC->pSorter!=0 );
+  pIn2 = &aMem[pOp->p2];
+  assert( pIn2->flags & MEM_Blob );
+  rc = ExpandBlob(pIn2);
+  if( rc==SQLITE_OK ){
+    rc = sqlite3VdbeSorterWrite(db, pC, pIn2);
+  }
+  if( rc==SQLITE_NOMEM ) goto no_mem;
+#endif
+  break;
+}
+
 /* Opcode: IdxDelete P1 P2 P3 * *
 **
 ** The content of P3 registers starting at register P2 form
@@ -68342,6 +72872,12 @@ default: {          /* This is really OP_Noop and OP_Explain */
 #endif
     }
 #endif
+#ifndef SQLITE_OMIT_STMT_PROFILE
+    if( aOpProf ){
+      aOpProf[iProfPc].nCycle += vdbeProfileClock() - iProfStart;
+      iProfStart = 0;
+    }
+#endif
 
     /* The following code adds nothing to the actual functionality
     ** of the program.  It is only here for testing and debugging.
@@ -68385,6 +72921,16 @@ vdbe_error_halt:
   ** release the mutexes on btrees that were acquired at the
   ** top. */
 vdbe_return:
+#ifndef SQLITE_OMIT_STMT_PROFILE
+  if( aOpProf ){
+    /* Instructions that jump here (OP_ResultRow, OP_Halt and errors) are
+    ** not timed by the code at the bottom of the loop. */
+    if( iProfStart ){
+      aOpProf[iProfPc].nCycle += vdbeProfileClock() - iProfStart;
+    }
+    sqlite3VdbeProfileLeave(p, rc);
+  }
+#endif
   sqlite3VdbeLeave(p);
   return rc;
 
@@ -69366,7 +73912,9 @@ static const struct sqlite3_io_methods MemJournalMethods = {
   0,                /* xShmMap */
   0,                /* xShmLock */
   0,                /* xShmBarrier */
-  0                 /* xShmUnlock */
+  0,                /* xShmUnlock */
+  0,                /* xFetch */
+  0                 /* xUnfetch */
 };
 
 /* 
@@ -76187,6 +80735,7 @@ static void attachFunc(
     sqlite3PagerLockingMode(pPager, db->dfltLockMode);
     sqlite3BtreeSecureDelete(aNew->pBt,
                              sqlite3BtreeSecureDelete(db->aDb[0].pBt,-1) );
+    sqlite3BtreeSetMmapLimit(aNew->pBt, db->szMmap);
   }
   aNew->safety_level = 3;
   aNew->zName = sqlite3DbStrDup(db, zName);
@@ -79150,10 +83699,15 @@ static void sqlite3RefillIndex(Parse *pParse, Index *pIndex, int memRootPage){
   int iTab = pParse->nTab++;     /* Btree cursor used for pTab */
   int iIdx = pParse->nTab++;     /* Btree cursor used for pIndex */
   int addr1;                     /* Address of top of loop */
+  int addr2;                     /* Address to jump to for next iteration */
   int tnum;                      /* Root page of index */
   Vdbe *v;                       /* Generate code into this virtual machine */
   KeyInfo *pKey;                 /* KeyInfo for index */
+#ifndef SQLITE_OMIT_MERGE_SORT
+  int iSorter;                   /* Cursor opened by OP_SorterOpen */
+#else
   int regIdxKey;                 /* Registers containing the index key */
+#endif
   int regRecord;                 /* Register holding assemblied index record */
   sqlite3 *db = pParse->db;      /* The database connection */
   int iDb = sqlite3SchemaToIndex(db, pIndex->pSchema);
@@ -79177,6 +83731,15 @@ static void sqlite3RefillIndex(Parse *pParse, Index *pIndex, int memRootPage){
     sqlite3VdbeAddOp2(v, OP_Clear, tnum, iDb);
   }
   pKey = sqlite3IndexKeyinfo(pParse, pIndex);
+
+#ifndef SQLITE_OMIT_MERGE_SORT
+  /* Open the sorter cursor.  The index keys are sorted before they are
+  ** inserted, so that the index is built by appending to the b-tree
+  ** instead of by inserting at random locations. */
+  iSorter = pParse->nTab++;
+  sqlite3VdbeAddOp4(v, OP_SorterOpen, iSorter, 0, 0, (char*)pKey, P4_KEYINFO);
+#endif
+
   sqlite3VdbeAddOp4(v, OP_OpenWrite, iIdx, tnum, iDb, 
                     (char *)pKey, P4_KEYINFO_HANDOFF);
   if( memRootPage>=0 ){
@@ -79185,7 +83748,33 @@ static void sqlite3RefillIndex(Parse *pParse, Index *pIndex, int memRootPage){
   sqlite3OpenTable(pParse, iTab, iDb, pTab, OP_OpenRead);
   addr1 = sqlite3VdbeAddOp2(v, OP_Rewind, iTab, 0);
   regRecord = sqlite3GetTempReg(pParse);
+
+#ifndef SQLITE_OMIT_MERGE_SORT
+  sqlite3GenerateIndexKey(pParse, pIndex, iTab, regRecord, 1);
+  sqlite3VdbeAddOp2(v, OP_SorterInsert, iSorter, regRecord);
+  sqlite3VdbeAddOp2(v, OP_Next, iTab, addr1+1);
+  sqlite3VdbeJumpHere(v, addr1);
+  addr1 = sqlite3VdbeAddOp2(v, OP_SorterSort, iSorter, 0);
+  if( pIndex->onError!=OE_None ){
+    /* Keys come out of the sorter in order, so duplicates are adjacent.
+    ** Compare each key with the previous one, which is still held in
+    ** regRecord.  The comparison is skipped for the first key. */
+    int j2 = sqlite3VdbeCurrentAddr(v) + 3;
+    sqlite3VdbeAddOp2(v, OP_Goto, 0, j2);
+    addr2 = sqlite3VdbeCurrentAddr(v);
+    sqlite3VdbeAddOp3(v, OP_SorterCompare, iSorter, j2, regRecord);
+    sqlite3HaltConstraint(
+        pParse, OE_Abort, "indexed columns are not unique", P4_STATIC
+    );
+  }else{
+    addr2 = sqlite3VdbeCurrentAddr(v);
+  }
+  sqlite3VdbeAddOp2(v, OP_SorterData, iSorter, regRecord);
+  sqlite3VdbeAddOp3(v, OP_IdxInsert, iIdx, regRecord, 1);
+  sqlite3VdbeChangeP5(v, OPFLAG_USESEEKRESULT);
+#else
   regIdxKey = sqlite3GenerateIndexKey(pParse, pIndex, iTab, regRecord, 1);
+  addr2 = addr1 + 1;
   if( pIndex->onError!=OE_None ){
     const int regRowid = regIdxKey + pIndex->nColumn;
     const int j2 = sqlite3VdbeCurrentAddr(v) + 2;
@@ -79206,11 +83795,20 @@ static void sqlite3RefillIndex(Parse *pParse, Index *pIndex, int memRootPage){
   }
   sqlite3VdbeAddOp2(v, OP_IdxInsert, iIdx, regRecord);
   sqlite3VdbeChangeP5(v, OPFLAG_USESEEKRESULT);
+#endif
   sqlite3ReleaseTempReg(pParse, regRecord);
-  sqlite3VdbeAddOp2(v, OP_Next, iTab, addr1+1);
+#ifndef SQLITE_OMIT_MERGE_SORT
+  sqlite3VdbeAddOp2(v, OP_SorterNext, iSorter, addr2);
+#else
+  sqlite3VdbeAddOp2(v, OP_Next, iTab, addr2);
+#endif
   sqlite3VdbeJumpHere(v, addr1);
+
   sqlite3VdbeAddOp1(v, OP_Close, iTab);
   sqlite3VdbeAddOp1(v, OP_Close, iIdx);
+#ifndef SQLITE_OMIT_MERGE_SORT
+  sqlite3VdbeAddOp1(v, OP_Close, iSorter);
+#endif
 }
 
 /*
@@ -88237,6 +92835,91 @@ SQLITE_PRIVATE void sqlite3Pragma(
     }
   }else
 
+  /*
+  **  PRAGMA [database.]mmap_size(N)
+  **
+  ** Used to set the maximum number of bytes of the database file that
+  ** will be accessed using memory-mapped I/O.  If N is negative, the
+  ** compile-time (or SQLITE_CONFIG_MMAP_SIZE) default is used.  If N is
+  ** zero, memory-mapped I/O is disabled.  If no database name is given,
+  ** the limit applies to all attached databases and to databases
+  ** attached later.  The first form returns the current limit, which
+  ** may be smaller than requested if it exceeds SQLITE_MAX_MMAP_SIZE.
+  */
+  if( sqlite3StrICmp(zLeft,"mmap_size")==0 ){
+    sqlite3_int64 sz;
+    int rc;
+#if SQLITE_MAX_MMAP_SIZE>0
+    assert( sqlite3SchemaMutexHeld(db, iDb, 0) );
+    if( zRight ){
+      int ii;
+      sqlite3Atoi64(zRight, &sz, sqlite3Strlen30(zRight), SQLITE_UTF8);
+      if( sz<0 ) sz = sqlite3GlobalConfig.szMmap;
+      if( pId2->n==0 ) db->szMmap = sz;
+      for(ii=db->nDb-1; ii>=0; ii--){
+        if( db->aDb[ii].pBt && (ii==iDb || pId2->n==0) ){
+          sqlite3BtreeSetMmapLimit(db->aDb[ii].pBt, sz);
+        }
+      }
+    }
+    sz = -1;
+    rc = sqlite3_file_control(db, zDb, SQLITE_FCNTL_MMAP_SIZE, &sz);
+#else
+    sz = 0;
+    rc = SQLITE_OK;
+#endif
+    if( rc==SQLITE_OK ){
+      returnSingleInt(pParse, "mmap_size", sz);
+    }else if( rc!=SQLITE_NOTFOUND ){
+      pParse->nErr++;
+      pParse->rc = rc;
+    }
+  }else
+
+  /*
+  **   PRAGMA threads
+  **   PRAGMA threads = N
+  **
+  ** Configure the maximum number of worker threads that the external
+  ** merge sorter may use to sort and write out runs in the background.
+  ** The value is clamped to SQLITE_MAX_WORKER_THREADS.  Zero means that
+  ** all sorting is done by the thread that calls sqlite3_step().
+  */
+  if( sqlite3StrICmp(zLeft, "threads")==0 ){
+    if( zRight ){
+      sqlite3_limit(db, SQLITE_LIMIT_WORKER_THREADS, sqlite3Atoi(zRight));
+    }
+    returnSingleInt(pParse, "threads",
+                    sqlite3_limit(db, SQLITE_LIMIT_WORKER_THREADS, -1));
+  }else
+
+  /*
+  **   PRAGMA bulk_load
+  **   PRAGMA bulk_load = N
+  **
+  ** While N is non-zero, tables and indexes written by this connection
+  ** are bulk-loaded: when an entry is appended to the right-hand edge of
+  ** a b-tree (as by inserts in ascending rowid order, CREATE INDEX,
+  ** INSERT INTO ... SELECT * and VACUUM), pages are filled to N percent
+  ** and a new page started, instead of being rebalanced with their
+  ** siblings.  N is clamped to the range 50 to 100.  Zero, the default,
+  ** turns bulk-loading off.
+  */
+  if( sqlite3StrICmp(zLeft, "bulk_load")==0 ){
+    if( zRight ){
+      int n = sqlite3Atoi(zRight);
+      if( n<=0 ){
+        n = 0;
+      }else if( n<50 ){
+        n = 50;
+      }else if( n>100 ){
+        n = 100;
+      }
+      db->nBulkFill = (u8)n;
+    }
+    returnSingleInt(pParse, "bulk_load", db->nBulkFill);
+  }else
+
   /*
   **   PRAGMA temp_store
   **   PRAGMA temp_store = "default"|"memory"|"file"
@@ -88921,6 +93604,27 @@ SQLITE_PRIVATE void sqlite3Pragma(
   }else
 #endif /* SQLITE_OMIT_COMPILEOPTION_DIAGS */
 
+#ifndef SQLITE_OMIT_STMT_PROFILE
+  /*
+  **   PRAGMA stmt_profile
+  **   PRAGMA stmt_profile = N
+  **
+  ** While N is non-zero, this connection records the number of times each
+  ** VDBE instruction is executed and the time it takes, along with page
+  ** cache and b-tree statistics, for up to N distinct SQL statements.
+  ** The records are read (and deleted) through the stmt_profile virtual
+  ** table.  Zero, the default, stops recording without discarding the
+  ** records already made.
+  */
+  if( sqlite3StrICmp(zLeft, "stmt_profile")==0 ){
+    if( zRight ){
+      int n = sqlite3Atoi(zRight);
+      db->nStmtProfile = n>0 ? n : 0;
+    }
+    returnSingleInt(pParse, "stmt_profile", db->nStmtProfile);
+  }else
+#endif /* SQLITE_OMIT_STMT_PROFILE */
+
 #ifndef SQLITE_OMIT_WAL
   /*
   **   PRAGMA [database.]wal_checkpoint = passive|full|restart
@@ -88964,6 +93668,23 @@ SQLITE_PRIVATE void sqlite3Pragma(
        db->xWalCallback==sqlite3WalDefaultHook ? 
            SQLITE_PTR_TO_INT(db->pWalArg) : 0);
   }else
+
+  /*
+  **   PRAGMA wal_background_checkpoint
+  **   PRAGMA wal_background_checkpoint = N
+  **
+  ** Configure a database connection to checkpoint a database on a
+  ** background thread after accumulating N frames in the log.  Or query
+  ** for the current value of N.
+  */
+  if( sqlite3StrICmp(zLeft, "wal_background_checkpoint")==0 ){
+    if( zRight ){
+      sqlite3_wal_background_checkpoint(db, sqlite3Atoi(zRight), 0);
+    }
+    returnSingleInt(pParse, "wal_background_checkpoint", 
+       db->xWalCallback==sqlite3WalCkptHook ? 
+           sqlite3WalCkptFrames(db->pWalArg) : 0);
+  }else
 #endif
 
 #if defined(SQLITE_DEBUG) || defined(SQLITE_TEST)
@@ -89838,6 +94559,73 @@ SQLITE_API int sqlite3_prepare_v2(
 }
 
 
+/*
+** Prepare a statement using the statement cache of connection db.  If
+** the cache holds an idle statement compiled from the first SQL statement
+** in zSql, return it.  Otherwise compile a new statement and mark it so
+** that sqlite3_finalize() returns it to the cache.
+*/
+static int sqlite3CachedPrepare(
+  sqlite3 *db,              /* Database handle. */
+  const char *zSql,         /* UTF-8 encoded SQL statement. */
+  int nBytes,               /* Length of zSql in bytes. */
+  sqlite3_stmt **ppStmt,    /* OUT: A pointer to the prepared statement */
+  const char **pzTail       /* OUT: End of parsed string */
+){
+  int rc = SQLITE_OK;
+  Vdbe *p;
+  assert( ppStmt!=0 );
+  *ppStmt = 0;
+  if( !sqlite3SafetyCheckOk(db) ){
+    return SQLITE_MISUSE_BKPT;
+  }
+  sqlite3_mutex_enter(db->mutex);
+  p = sqlite3VdbeCacheFind(db, zSql, nBytes, pzTail);
+  if( p ){
+    *ppStmt = (sqlite3_stmt*)p;
+  }else{
+    sqlite3_int64 iStart = 0;
+    sqlite3_int64 iEnd = 0;
+    sqlite3OsCurrentTimeInt64(db->pVfs, &iStart);
+    rc = sqlite3LockAndPrepare(db, zSql, nBytes, 1, 0, ppStmt, pzTail);
+    p = (Vdbe*)*ppStmt;
+    if( p && sqlite3_sql(*ppStmt) ){
+      StmtCache *pCache = &db->stmtCache;
+      sqlite3OsCurrentTimeInt64(db->pVfs, &iEnd);
+      sqlite3VdbeSetCached(p);
+      pCache->nMiss++;
+      if( iEnd>=iStart ){
+        pCache->nCompile++;
+        pCache->iCompileTime += iEnd - iStart;
+      }
+    }
+  }
+  sqlite3_mutex_leave(db->mutex);
+  return rc;
+}
+
+/*
+** The same as sqlite3_prepare_v2() except that it takes a mask of
+** CHROMIUM_SQLITE_PREPARE_* flags.
+*/
+SQLITE_API int chromium_sqlite3_prepare(
+  sqlite3 *db,              /* Database handle. */
+  const char *zSql,         /* UTF-8 encoded SQL statement. */
+  int nBytes,               /* Length of zSql in bytes. */
+  unsigned int prepFlags,   /* Zero or more CHROMIUM_SQLITE_PREPARE_* flags */
+  sqlite3_stmt **ppStmt,    /* OUT: A pointer to the prepared statement */
+  const char **pzTail       /* OUT: End of parsed string */
+){
+  int rc;
+  if( prepFlags & CHROMIUM_SQLITE_PREPARE_CACHED ){
+    rc = sqlite3CachedPrepare(db,zSql,nBytes,ppStmt,pzTail);
+  }else{
+    rc = sqlite3LockAndPrepare(db,zSql,nBytes,1,0,ppStmt,pzTail);
+  }
+  assert( rc==SQLITE_OK || ppStmt==0 || *ppStmt==0 );  /* VERIFY: F13021 */
+  return rc;
+}
+
 #ifndef SQLITE_OMIT_UTF16
 /*
 ** Compile the UTF-16 encoded SQL statement zSql into a statement handle.
@@ -90341,12 +95129,18 @@ static void pushOntoSorter(
   int nExpr = pOrderBy->nExpr;
   int regBase = sqlite3GetTempRange(pParse, nExpr+2);
   int regRecord = sqlite3GetTempReg(pParse);
+  int op;
   sqlite3ExprCacheClear(pParse);
   sqlite3ExprCodeExprList(pParse, pOrderBy, regBase, 0);
   sqlite3VdbeAddOp2(v, OP_Sequence, pOrderBy->iECursor, regBase+nExpr);
   sqlite3ExprCodeMove(pParse, regData, regBase+nExpr+1, 1);
   sqlite3VdbeAddOp3(v, OP_MakeRecord, regBase, nExpr + 2, regRecord);
-  sqlite3VdbeAddOp2(v, OP_IdxInsert, pOrderBy->iECursor, regRecord);
+  if( pSelect->selFlags & SF_UseSorter ){
+    op = OP_SorterInsert;
+  }else{
+    op = OP_IdxInsert;
+  }
+  sqlite3VdbeAddOp2(v, op, pOrderBy->iECursor, regRecord);
   sqlite3ReleaseTempReg(pParse, regRecord);
   sqlite3ReleaseTempRange(pParse, regBase, nExpr+2);
   if( pSelect->iLimit ){
@@ -90815,9 +95609,22 @@ static void generateSortTail(
   }else{
     regRowid = sqlite3GetTempReg(pParse);
   }
-  addr = 1 + sqlite3VdbeAddOp2(v, OP_Sort, iTab, addrBreak);
-  codeOffset(v, p, addrContinue);
-  sqlite3VdbeAddOp3(v, OP_Column, iTab, pOrderBy->nExpr + 1, regRow);
+  if( p->selFlags & SF_UseSorter ){
+    /* The sorter returns complete records.  Copy each one into a register
+    ** and use a second pseudo-table to extract the data column. */
+    int regSortOut = ++pParse->nMem;
+    int ptab2 = pParse->nTab++;
+    sqlite3VdbeAddOp3(v, OP_OpenPseudo, ptab2, regSortOut, pOrderBy->nExpr+2);
+    addr = 1 + sqlite3VdbeAddOp2(v, OP_SorterSort, iTab, addrBreak);
+    codeOffset(v, p, addrContinue);
+    sqlite3VdbeAddOp2(v, OP_SorterData, iTab, regSortOut);
+    sqlite3VdbeAddOp3(v, OP_Column, ptab2, pOrderBy->nExpr+1, regRow);
+    sqlite3VdbeChangeP5(v, OPFLAG_CLEARCACHE);
+  }else{
+    addr = 1 + sqlite3VdbeAddOp2(v, OP_Sort, iTab, addrBreak);
+    codeOffset(v, p, addrContinue);
+    sqlite3VdbeAddOp3(v, OP_Column, iTab, pOrderBy->nExpr + 1, regRow);
+  }
   switch( eDest ){
     case SRT_Table:
     case SRT_EphemTab: {
@@ -90870,7 +95677,11 @@ static void generateSortTail(
   /* The bottom of the loop
   */
   sqlite3VdbeResolveLabel(v, addrContinue);
-  sqlite3VdbeAddOp2(v, OP_Next, iTab, addr);
+  if( p->selFlags & SF_UseSorter ){
+    sqlite3VdbeAddOp2(v, OP_SorterNext, iTab, addr);
+  }else{
+    sqlite3VdbeAddOp2(v, OP_Next, iTab, addr);
+  }
   sqlite3VdbeResolveLabel(v, addrBreak);
   if( eDest==SRT_Output || eDest==SRT_Coroutine ){
     sqlite3VdbeAddOp2(v, OP_Close, pseudoTab, 0);
@@ -93821,6 +98632,16 @@ SQLITE_PRIVATE int sqlite3Select(
   iEnd = sqlite3VdbeMakeLabel(v);
   p->nSelectRow = (double)LARGEST_INT64;
   computeLimitRegisters(pParse, p, iEnd);
+#ifndef SQLITE_OMIT_MERGE_SORT
+  /* If there is no LIMIT, sort using the external merge sorter instead
+  ** of an ephemeral index.  The sorter cannot discard entries as they
+  ** are added, so it is not used if there is a LIMIT.  After an OOM
+  ** sqlite3VdbeGetOp() returns a read-only dummy, so do nothing then. */
+  if( p->iLimit==0 && addrSortIndex>=0 && !db->mallocFailed ){
+    sqlite3VdbeGetOp(v, addrSortIndex)->opcode = OP_SorterOpen;
+    p->selFlags |= SF_UseSorter;
+  }
+#endif
 
   /* Open a virtual index to use for the distinct set.
   */
@@ -107434,6 +112255,10 @@ SQLITE_API int sqlite3_initialize(void){
     sqlite3RegisterGlobalFunctions();
     if( sqlite3GlobalConfig.isPCacheInit==0 ){
       rc = sqlite3PcacheInitialize();
+      if( rc==SQLITE_OK ){
+        rc = sqlite3WalCacheInitialize();
+        if( rc!=SQLITE_OK ) sqlite3PcacheShutdown();
+      }
     }
     if( rc==SQLITE_OK ){
       sqlite3GlobalConfig.isPCacheInit = 1;
@@ -107497,6 +112322,7 @@ SQLITE_API int sqlite3_shutdown(void){
     sqlite3GlobalConfig.isInit = 0;
   }
   if( sqlite3GlobalConfig.isPCacheInit ){
+    sqlite3WalCacheShutdown();
     sqlite3PcacheShutdown();
     sqlite3GlobalConfig.isPCacheInit = 0;
   }
@@ -107671,6 +112497,30 @@ SQLITE_API int sqlite3_config(int op, ...){
       break;
     }
 
+    case SQLITE_CONFIG_MMAP_SIZE: {
+      sqlite3_int64 szMmap = va_arg(ap, sqlite3_int64);
+      sqlite3_int64 mxMmap = va_arg(ap, sqlite3_int64);
+      if( mxMmap<0 || mxMmap>SQLITE_MAX_MMAP_SIZE ){
+        mxMmap = SQLITE_MAX_MMAP_SIZE;
+      }
+      sqlite3GlobalConfig.mxMmap = mxMmap;
+      if( szMmap<0 ) szMmap = SQLITE_DEFAULT_MMAP_SIZE;
+      if( szMmap>mxMmap ) szMmap = mxMmap;
+      sqlite3GlobalConfig.szMmap = szMmap;
+      break;
+    }
+
+    case SQLITE_CONFIG_WALCACHE: {
+      sqlite3_int64 szWalCache = va_arg(ap, sqlite3_int64);
+      sqlite3GlobalConfig.szWalCache = szWalCache>0 ? szWalCache : 0;
+      break;
+    }
+
+    case SQLITE_CONFIG_PMASZ: {
+      sqlite3GlobalConfig.szPma = va_arg(ap, unsigned int);
+      break;
+    }
+
     default: {
       rc = SQLITE_ERROR;
       break;
@@ -107766,6 +112616,21 @@ SQLITE_API int sqlite3_db_config(sqlite3 *db, int op, ...){
       rc = setupLookaside(db, pBuf, sz, cnt);
       break;
     }
+    case SQLITE_DBCONFIG_STMT_CACHE: {
+      int nMax = va_arg(ap, int);
+      int *pRes = va_arg(ap, int*);
+      sqlite3_mutex_enter(db->mutex);
+      if( nMax>=0 ){
+        db->stmtCache.nMax = nMax;
+        sqlite3VdbeCacheTrim(db, nMax);
+      }
+      if( pRes ){
+        *pRes = db->stmtCache.nMax;
+      }
+      sqlite3_mutex_leave(db->mutex);
+      rc = SQLITE_OK;
+      break;
+    }
     default: {
       static const struct {
         int op;      /* The opcode */
@@ -107932,6 +112797,9 @@ SQLITE_API int sqlite3_close(sqlite3 *db){
   }
   sqlite3_mutex_enter(db->mutex);
 
+  /* Finalize the idle statements held by the statement cache. */
+  sqlite3VdbeCacheTrim(db, 0);
+
   /* Force xDestroy calls on all virtual tables */
   sqlite3ResetInternalSchema(db, -1);
 
@@ -107966,6 +112834,10 @@ SQLITE_API int sqlite3_close(sqlite3 *db){
   /* Free any outstanding Savepoint structures. */
   sqlite3CloseSavepoints(db);
 
+  /* Stop the background checkpointer, if any, before the databases it
+  ** checkpoints are closed. */
+  sqlite3_wal_hook(db, 0, 0);
+
   for(j=0; j<db->nDb; j++){
     struct Db *pDb = &db->aDb[j];
     if( pDb->pBt ){
@@ -108018,6 +112890,7 @@ SQLITE_API int sqlite3_close(sqlite3 *db){
   }
   sqlite3HashClear(&db->aModule);
 #endif
+  sqlite3StmtProfileClose(db);
 
   sqlite3Error(db, SQLITE_OK, 0); /* Deallocates any cached error strings. */
   if( db->pErr ){
@@ -108599,9 +113472,42 @@ SQLITE_API int sqlite3_wal_autocheckpoint(sqlite3 *db, int nFrame){
   return SQLITE_OK;
 }
 
+/*
+** Configure an sqlite3_wal_hook() callback to checkpoint a database on
+** a background thread after committing a transaction if there are nFrame
+** or more frames in the log file.  Each step of the checkpoint copies at
+** most nBatch frames into the database file.  Passing zero or a negative
+** value as the nFrame parameter disables automatic checkpoints entirely.
+**
+** Like sqlite3_wal_autocheckpoint(), this replaces any existing callback
+** registered using sqlite3_wal_hook().
+*/
+SQLITE_API int sqlite3_wal_background_checkpoint(sqlite3 *db, int nFrame, int nBatch){
+#ifdef SQLITE_OMIT_WAL
+  UNUSED_PARAMETER(db);
+  UNUSED_PARAMETER(nFrame);
+  UNUSED_PARAMETER(nBatch);
+#else
+  if( nFrame>0 ){
+    void *pCkpt;
+    if( nBatch<=0 ) nBatch = SQLITE_DEFAULT_CHECKPOINT_BATCH;
+    pCkpt = sqlite3WalCkptCreate(db, nFrame, nBatch);
+    if( pCkpt==0 ) return SQLITE_NOMEM;
+    sqlite3_wal_hook(db, sqlite3WalCkptHook, pCkpt);
+  }else{
+    sqlite3_wal_hook(db, 0, 0);
+  }
+#endif
+  return SQLITE_OK;
+}
+
 /*
 ** Register a callback to be invoked each time a transaction is written
 ** into the write-ahead-log by this database connection.
+**
+** If the callback being replaced is a background checkpointer registered
+** by sqlite3_wal_background_checkpoint(), its worker thread is stopped
+** and the checkpointer freed.
 */
 SQLITE_API void *sqlite3_wal_hook(
   sqlite3 *db,                    /* Attach the hook to this db handle */
@@ -108612,6 +113518,10 @@ SQLITE_API void *sqlite3_wal_hook(
   void *pRet;
   sqlite3_mutex_enter(db->mutex);
   pRet = db->pWalArg;
+  if( db->xWalCallback==sqlite3WalCkptHook ){
+    sqlite3WalCkptDestroy(pRet);
+    pRet = 0;
+  }
   db->xWalCallback = xCallback;
   db->pWalArg = pArg;
   sqlite3_mutex_leave(db->mutex);
@@ -108946,6 +113856,7 @@ static const int aHardLimit[] = {
   SQLITE_MAX_LIKE_PATTERN_LENGTH,
   SQLITE_MAX_VARIABLE_NUMBER,
   SQLITE_MAX_TRIGGER_DEPTH,
+  SQLITE_MAX_WORKER_THREADS,
 };
 
 /*
@@ -108981,6 +113892,9 @@ static const int aHardLimit[] = {
 #if SQLITE_MAX_TRIGGER_DEPTH<1
 # error SQLITE_MAX_TRIGGER_DEPTH must be at least 1
 #endif
+#if SQLITE_MAX_WORKER_THREADS<0 || SQLITE_MAX_WORKER_THREADS>50
+# error SQLITE_MAX_WORKER_THREADS must be between 0 and 50
+#endif
 
 
 /*
@@ -109014,7 +113928,8 @@ SQLITE_API int sqlite3_limit(sqlite3 *db, int limitId, int newLimit){
                                                SQLITE_MAX_LIKE_PATTERN_LENGTH );
   assert( aHardLimit[SQLITE_LIMIT_VARIABLE_NUMBER]==SQLITE_MAX_VARIABLE_NUMBER);
   assert( aHardLimit[SQLITE_LIMIT_TRIGGER_DEPTH]==SQLITE_MAX_TRIGGER_DEPTH );
-  assert( SQLITE_LIMIT_TRIGGER_DEPTH==(SQLITE_N_LIMIT-1) );
+  assert( aHardLimit[SQLITE_LIMIT_WORKER_THREADS]==SQLITE_MAX_WORKER_THREADS );
+  assert( SQLITE_LIMIT_WORKER_THREADS==(SQLITE_N_LIMIT-1) );
 
 
   if( limitId<0 || limitId>=SQLITE_N_LIMIT ){
@@ -109126,9 +114041,11 @@ static int openDatabase(
 
   assert( sizeof(db->aLimit)==sizeof(aHardLimit) );
   memcpy(db->aLimit, aHardLimit, sizeof(db->aLimit));
+  db->aLimit[SQLITE_LIMIT_WORKER_THREADS] = SQLITE_DEFAULT_WORKER_THREADS;
   db->autoCommit = 1;
   db->nextAutovac = -1;
   db->nextPagesize = 0;
+  db->szMmap = sqlite3GlobalConfig.szMmap;
   db->flags |= SQLITE_ShortColNames | SQLITE_AutoIndex | SQLITE_EnableTrigger
 #if SQLITE_DEFAULT_FILE_FORMAT<4
                  | SQLITE_LegacyFileFmt
@@ -109253,6 +114170,12 @@ static int openDatabase(
   }
 #endif
 
+#if !defined(SQLITE_OMIT_STMT_PROFILE) && !defined(SQLITE_OMIT_VIRTUALTABLE)
+  if( !db->mallocFailed && rc==SQLITE_OK ){
+    rc = sqlite3StmtProfileInit(db);
+  }
+#endif
+
   sqlite3Error(db, rc, 0);
 
   /* -DSQLITE_DEFAULT_LOCKING_MODE=1 makes EXCLUSIVE the default locking
@@ -109270,6 +114193,7 @@ static int openDatabase(
                         sqlite3GlobalConfig.nLookaside);
 
   sqlite3_wal_autocheckpoint(db, SQLITE_DEFAULT_WAL_AUTOCHECKPOINT);
+  db->stmtCache.nMax = SQLITE_DEFAULT_STMT_CACHE_SIZE;
 
 opendb_out:
   if( db ){
@@ -110248,6 +115172,315 @@ SQLITE_PRIVATE void sqlite3ConnectionClosed(sqlite3 *db){
 #endif
 
 /************** End of notify.c **********************************************/
+/************** Begin file walckpt.c *****************************************/
+/*
+** 2011 August 22
+**
+** The author disclaims copyright to this source code.  In place of
+** a legal notice, here is a blessing:
+**
+**    May you do good and not evil.
+**    May you find forgiveness for yourself and forgive others.
+**    May you share freely, never taking more than you give.
+**
+*************************************************************************
+**
+** This file contains the background checkpointer configured by
+** sqlite3_wal_background_checkpoint().
+**
+** Like the callback registered by sqlite3_wal_autocheckpoint(), the
+** background checkpointer is an sqlite3_wal_hook() callback that is
+** invoked after each commit with the number of frames in the WAL file.
+** Instead of running the checkpoint before the commit returns, it hands
+** the database to a worker thread and returns immediately.
+**
+** The worker thread opens its own private connection to the database file
+** and runs a series of PASSIVE checkpoints on it, each of which copies at
+** most nBatch frames into the database file (see walCheckpoint()).  The
+** locks required by a checkpoint are released between batches, and a
+** PASSIVE checkpoint never waits for readers, so the thread only makes
+** as much progress as the readers of the database allow.  It stops when
+** the whole WAL file has been backfilled, when a batch makes no progress
+** or when an error occurs, and then waits for the next commit.
+**
+** Worker threads are only used by threadsafe builds on unix.  Otherwise,
+** or if the thread cannot be started, the checkpoint is run synchronously
+** in the hook, exactly as sqlite3_wal_autocheckpoint() would.
+**
+** The WAL file can only be restarted by a writer once all of it has been
+** backfilled, so if transactions are committed faster than the worker
+** can copy them the WAL file keeps growing.  To bound it, once the WAL
+** holds WALCKPT_BACKSTOP times the configured number of frames the hook
+** also runs a checkpoint synchronously, stalling the writer until the
+** worker has caught up.
+*/
+
+#ifndef SQLITE_OMIT_WAL
+
+#if SQLITE_THREADSAFE && SQLITE_OS_UNIX
+# define WALCKPT_THREADS 1
+#else
+# define WALCKPT_THREADS 0
+#endif
+
+/*
+** Checkpoint synchronously once the WAL is this many times larger than
+** the size at which a background checkpoint is started.
+*/
+#define WALCKPT_BACKSTOP 4
+
+typedef struct WalCkpt WalCkpt;
+typedef struct WalCkptDb WalCkptDb;
+
+/*
+** A database file checkpointed by the worker thread.  A WalCkpt object
+** may be asked to checkpoint the main database and any attached WAL
+** databases of its connection, so it keeps a list of these.
+*/
+struct WalCkptDb {
+  char *zFile;                    /* Full path of the database file */
+  int bPending;                   /* True if a checkpoint is requested */
+  WalCkptDb *pNext;               /* Next database in WalCkpt.pDb list */
+};
+
+/*
+** The background checkpointer belonging to a single database connection.
+** A pointer to this object is the sqlite3.pWalArg of a connection whose
+** sqlite3.xWalCallback is sqlite3WalCkptHook().
+**
+** The mutex protects the pDb list and the bStop and bRunning flags.  The
+** WalCkptDb.zFile strings are not modified once the object is on the list,
+** so the worker may use them without holding the mutex.
+*/
+struct WalCkpt {
+  sqlite3_vfs *pVfs;              /* VFS used to open private connections */
+  int nFrame;                     /* Checkpoint when the WAL is this large */
+  int nBatch;                     /* Frames to copy per checkpoint step */
+  WalCkptDb *pDb;                 /* Databases known to this checkpointer */
+#if WALCKPT_THREADS
+  pthread_mutex_t mutex;          /* Mutex protecting the fields below */
+  pthread_cond_t cond;            /* Signalled when there is work or bStop */
+  pthread_t tid;                  /* The worker thread, if bRunning */
+  int bRunning;                   /* True once the worker thread is started */
+  int bStop;                      /* Set to ask the worker thread to exit */
+#endif
+};
+
+#if WALCKPT_THREADS
+/*
+** Return true if the worker thread has been asked to stop.
+*/
+static int walCkptStopping(WalCkpt *p){
+  int bStop;
+  pthread_mutex_lock(&p->mutex);
+  bStop = p->bStop;
+  pthread_mutex_unlock(&p->mutex);
+  return bStop;
+}
+
+/*
+** Checkpoint database file zFile in batches of p->nBatch frames, using a
+** private connection that is opened for the purpose and closed again
+** afterwards, so that it does not hold a lock on the database file while
+** the checkpointer is idle.
+*/
+static void walCkptRun(WalCkpt *p, const char *zFile){
+  sqlite3 *db = 0;
+  int rc;
+
+  rc = sqlite3_open_v2(zFile, &db,
+      SQLITE_OPEN_READWRITE | SQLITE_OPEN_NOMUTEX | SQLITE_OPEN_PRIVATECACHE,
+      p->pVfs->zName
+  );
+  if( rc==SQLITE_OK ){
+    /* Read the database header so that the pager opens the WAL file. */
+    rc = sqlite3_exec(db, "PRAGMA schema_version", 0, 0, 0);
+  }
+  if( rc==SQLITE_OK ){
+    int nPrev = -1;
+    sqlite3PagerCheckpointBatch(sqlite3BtreePager(db->aDb[0].pBt), p->nBatch);
+    while( !walCkptStopping(p) ){
+      int nLog = 0;
+      int nCkpt = 0;
+      rc = sqlite3_wal_checkpoint_v2(db, "main", SQLITE_CHECKPOINT_PASSIVE,
+                                     &nLog, &nCkpt);
+      if( rc!=SQLITE_OK || nCkpt>=nLog || nCkpt<=nPrev ) break;
+      nPrev = nCkpt;
+    }
+  }
+  sqlite3_close(db);
+}
+
+/*
+** Entry point for the worker thread.  Wait for databases to be marked as
+** pending, and checkpoint each of them, until asked to stop.
+*/
+static void *walCkptThreadMain(void *pCtx){
+  WalCkpt *p = (WalCkpt*)pCtx;
+  pthread_mutex_lock(&p->mutex);
+  while( !p->bStop ){
+    WalCkptDb *pDb;
+    for(pDb=p->pDb; pDb && pDb->bPending==0; pDb=pDb->pNext);
+    if( pDb==0 ){
+      pthread_cond_wait(&p->cond, &p->mutex);
+    }else{
+      pDb->bPending = 0;
+      pthread_mutex_unlock(&p->mutex);
+      walCkptRun(p, pDb->zFile);
+      pthread_mutex_lock(&p->mutex);
+    }
+  }
+  pthread_mutex_unlock(&p->mutex);
+  return 0;
+}
+
+/*
+** Ask the worker thread to checkpoint database file zFile, starting the
+** thread if it is not already running.  Return SQLITE_OK if the request
+** was queued, or an error code if the caller should run the checkpoint
+** itself.
+*/
+static int walCkptSchedule(WalCkpt *p, const char *zFile){
+  WalCkptDb *pDb;
+  int rc = SQLITE_OK;
+
+  pthread_mutex_lock(&p->mutex);
+  for(pDb=p->pDb; pDb && strcmp(pDb->zFile, zFile); pDb=pDb->pNext);
+  if( pDb==0 ){
+    int nFile = sqlite3Strlen30(zFile);
+    pDb = (WalCkptDb*)sqlite3MallocZero(sizeof(WalCkptDb) + nFile + 1);
+    if( pDb==0 ){
+      rc = SQLITE_NOMEM;
+    }else{
+      pDb->zFile = (char*)&pDb[1];
+      memcpy(pDb->zFile, zFile, nFile+1);
+      pDb->pNext = p->pDb;
+      p->pDb = pDb;
+    }
+  }
+  if( rc==SQLITE_OK && p->bRunning==0 ){
+    if( pthread_create(&p->tid, 0, walCkptThreadMain, p)==0 ){
+      p->bRunning = 1;
+    }else{
+      rc = SQLITE_ERROR;
+    }
+  }
+  if( rc==SQLITE_OK ){
+    pDb->bPending = 1;
+    pthread_cond_signal(&p->cond);
+  }
+  pthread_mutex_unlock(&p->mutex);
+  return rc;
+}
+#endif /* WALCKPT_THREADS */
+
+/*
+** Allocate a new background checkpointer for connection db.  Return a
+** pointer to it, or NULL if a malloc fails.  The object is freed by
+** sqlite3WalCkptDestroy().
+*/
+SQLITE_PRIVATE void *sqlite3WalCkptCreate(sqlite3 *db, int nFrame, int nBatch){
+  WalCkpt *p;
+  assert( nFrame>0 && nBatch>0 );
+  p = (WalCkpt*)sqlite3MallocZero(sizeof(WalCkpt));
+  if( p ){
+    p->pVfs = db->pVfs;
+    p->nFrame = nFrame;
+    p->nBatch = nBatch;
+#if WALCKPT_THREADS
+    pthread_mutex_init(&p->mutex, 0);
+    pthread_cond_init(&p->cond, 0);
+#endif
+  }
+  return (void*)p;
+}
+
+/*
+** Stop the worker thread of the background checkpointer passed as the
+** only argument, waiting for any checkpoint step that is in progress to
+** finish, and free the object.
+*/
+SQLITE_PRIVATE void sqlite3WalCkptDestroy(void *pArg){
+  WalCkpt *p = (WalCkpt*)pArg;
+  WalCkptDb *pDb;
+  WalCkptDb *pNext;
+#if WALCKPT_THREADS
+  int bRunning;
+  pthread_mutex_lock(&p->mutex);
+  p->bStop = 1;
+  bRunning = p->bRunning;
+  pthread_cond_signal(&p->cond);
+  pthread_mutex_unlock(&p->mutex);
+  if( bRunning ){
+    pthread_join(p->tid, 0);
+  }
+  pthread_cond_destroy(&p->cond);
+  pthread_mutex_destroy(&p->mutex);
+#endif
+  for(pDb=p->pDb; pDb; pDb=pNext){
+    pNext = pDb->pNext;
+    sqlite3_free(pDb);
+  }
+  sqlite3_free(p);
+}
+
+/*
+** Return the WAL size, in frames, at which the background checkpointer
+** passed as the only argument starts a checkpoint.
+*/
+SQLITE_PRIVATE int sqlite3WalCkptFrames(void *pArg){
+  return ((WalCkpt*)pArg)->nFrame;
+}
+
+/*
+** The sqlite3_wal_hook() callback registered by
+** sqlite3_wal_background_checkpoint().  If the WAL file of database zDb
+** holds at least WalCkpt.nFrame frames, schedule a checkpoint of it on
+** the worker thread.
+**
+** Databases in locking_mode=EXCLUSIVE cannot be opened by the worker's
+** private connection, so they are always checkpointed synchronously, as
+** are databases whose WAL has grown past the backstop.
+*/
+SQLITE_PRIVATE int sqlite3WalCkptHook(
+  void *pClientData,     /* Pointer to the WalCkpt object */
+  sqlite3 *db,           /* Connection */
+  const char *zDb,       /* Database */
+  int nFrame             /* Size of WAL */
+){
+  WalCkpt *p = (WalCkpt*)pClientData;
+  int rc = SQLITE_ERROR;
+
+  if( nFrame<p->nFrame ) return SQLITE_OK;
+#if WALCKPT_THREADS
+  if( nFrame/WALCKPT_BACKSTOP<p->nFrame ){
+    int iDb = sqlite3FindDbName(db, zDb);
+    Btree *pBt = iDb>=0 ? db->aDb[iDb].pBt : 0;
+    if( pBt ){
+      Pager *pPager = sqlite3BtreePager(pBt);
+      const char *zFile = sqlite3BtreeGetFilename(pBt);
+      if( zFile && zFile[0]
+       && sqlite3PagerLockingMode(pPager, PAGER_LOCKINGMODE_QUERY)
+            ==PAGER_LOCKINGMODE_NORMAL
+      ){
+        sqlite3BeginBenignMalloc();
+        rc = walCkptSchedule(p, zFile);
+        sqlite3EndBenignMalloc();
+      }
+    }
+  }
+#endif
+  if( rc!=SQLITE_OK ){
+    sqlite3BeginBenignMalloc();
+    sqlite3_wal_checkpoint(db, zDb);
+    sqlite3EndBenignMalloc();
+  }
+  return SQLITE_OK;
+}
+
+#endif /* SQLITE_OMIT_WAL */
+
+/************** End of walckpt.c *********************************************/
 /************** Begin file recover.c *****************************************/
 /*
 ** 2012 Jan 11
@@ -110904,12 +116137,18 @@ static void interiorCursorSetPage(RecoverInteriorCursor *pCursor,
   pCursor->nChildren = decodeUnsigned16(PageHeader(pPage) +
                                         kiPageCellCountOffset) + 1;
 
-  /* The maximum possible value for nChildren is:
+  /* Each child requires a 16-bit offset from an array after the header,
+   * and each child contains a 32-bit page number and at least a varint
+   * (min size of one byte).  The final child page is in the header.  So
+   * the maximum value for nChildren is:
    *   (nPageSize - kiPageInteriorHeaderBytes) /
    *      (sizeof(uint16) + sizeof(uint32) + 1) + 1
-   * Each child requires a 16-bit offset from an array after the header, and
-   * each child contains a 32-bit page number and at least a varint (min size of
-   * one byte).  The final child page is in the header.
+   */
+  /* TODO(shess): This count is very unlikely to be corrupted in
+   * isolation, so seeing this could signal to skip the page.  OTOH, I
+   * can't offhand think of how to get here unless this or the page-type
+   * byte is corrupted.  Could be an overflow page, but it would require
+   * a very large database.
    */
   nMaxChildren =
       (pCursor->nPageSize - kiPageInteriorHeaderBytes) / knMinCellLength + 1;
@@ -113010,6 +118249,15 @@ SQLITE_PRIVATE Fts3HashElem *sqlite3Fts3HashFindElem(const Fts3Hash *, const voi
 */
 #define FTS3_MERGE_COUNT 16
 
+/*
+** If automatic merging is enabled (see the 'automerge=N' command), full
+** levels are merged incrementally after each write, within the configured
+** budget, instead of as soon as they fill. A level that is not merged in
+** this way is only merged synchronously once it holds this many times
+** FTS3_MERGE_COUNT segments.
+*/
+#define FTS3_MERGE_BACKSTOP 4
+
 /*
 ** This is the maximum amount of data (in bytes) to store in the 
 ** Fts3Table.pendingTerms hash table. Normally, the hash table is
@@ -113108,12 +118356,13 @@ struct Fts3Table {
   /* Precompiled statements used by the implementation. Each of these 
   ** statements is run and reset within a single virtual table API call. 
   */
-  sqlite3_stmt *aStmt[24];
+  sqlite3_stmt *aStmt[25];
 
   char *zReadExprlist;
   char *zWriteExprlist;
 
   int nNodeSize;                  /* Soft limit for node size */
+  int nAutoMerge;                 /* Blocks to merge per write, or 0 */
   u8 bHasStat;                    /* True if %_stat table exists */
   u8 bHasDocsize;                 /* True if %_docsize table exists */
   int nPgsz;                      /* Page size for host database */
@@ -113152,6 +118401,8 @@ struct Fts3Cursor {
   char *aDoclist;                 /* List of docids for full-text queries */
   int nDoclist;                   /* Size of buffer at aDoclist */
   int eEvalmode;                  /* An FTS3_EVAL_XX constant */
+  sqlite3_int64 *aDocFilter;      /* Sorted array of docids that may match */
+  int nDocFilter;                 /* Number of entries in aDocFilter[] */
   int nRowAvg;                    /* Average size of database rows, in pages */
 
   int isMatchinfoNeeded;          /* True when aMatchinfo[] needs filling in */
@@ -113305,6 +118556,8 @@ struct Fts3SegFilter {
   int nTerm;
   int iCol;
   int flags;
+  const sqlite3_int64 *aDocid;    /* If not NULL, only return these docids */
+  int nDocid;                     /* Number of entries in aDocid[] */
 };
 
 struct Fts3SegReaderCursor {
@@ -115301,12 +120554,18 @@ static void fts3SegReaderCursorFree(Fts3SegReaderCursor *pSegcsr){
 ** is non-zero, then the returned list is in the same format as is stored 
 ** in the database without the found length specifier at the start of on-disk
 ** doclists.
+**
+** If aDocid is not NULL, it points to a sorted array of nDocid docids. Only
+** docids that are present in this array are included in the returned
+** doclist.
 */
 static int fts3TermSelect(
   Fts3Table *p,                   /* Virtual table handle */
   Fts3PhraseToken *pTok,          /* Token to query for */
   int iColumn,                    /* Column to query (or -ve for all columns) */
   int isReqPos,                   /* True to include position lists in output */
+  const sqlite3_int64 *aDocid,    /* Docid filter, or NULL */
+  int nDocid,                     /* Number of entries in aDocid[] */
   int *pnOut,                     /* OUT: Size of buffer at *ppOut */
   char **ppOut                    /* OUT: Malloced result buffer */
 ){
@@ -115326,6 +120585,8 @@ static int fts3TermSelect(
   filter.iCol = iColumn;
   filter.zTerm = pTok->z;
   filter.nTerm = pTok->n;
+  filter.aDocid = aDocid;
+  filter.nDocid = nDocid;
 
   rc = sqlite3Fts3SegReaderStart(p, pSegcsr, &filter);
   while( SQLITE_OK==rc
@@ -115387,6 +120648,40 @@ static int fts3DoclistCountDocids(int isPoslist, char *aList, int nList){
   return nDoc;
 }
 
+/*
+** Decode the bare doclist in buffer aList[] (size nList bytes), which
+** contains nDoc docids, into an array of docids allocated using
+** sqlite3_malloc(). If successful, set *paOut to point to the array and
+** *pnOut to the number of docids in it, and return SQLITE_OK. Otherwise,
+** return SQLITE_NOMEM.
+*/
+static int fts3DoclistToArray(
+  char *aList,                    /* Bare doclist */
+  int nList,                      /* Size of aList[] in bytes */
+  int nDoc,                       /* Number of docids in aList[] */
+  sqlite3_int64 **paOut,          /* OUT: Array of docids */
+  int *pnOut                      /* OUT: Number of entries in *paOut */
+){
+  sqlite3_int64 *aOut;            /* Output array */
+  char *p = aList;                /* Input cursor */
+  char *pEnd = &aList[nList];     /* Pointer to one byte after EOF */
+  sqlite3_int64 iDocid = 0;       /* Current docid */
+  int i = 0;                      /* Number of entries in aOut[] */
+
+  aOut = (sqlite3_int64 *)sqlite3_malloc(sizeof(sqlite3_int64) * nDoc);
+  if( !aOut ) return SQLITE_NOMEM;
+  while( p<pEnd && i<nDoc ){
+    sqlite3_int64 iDelta;
+    p += sqlite3Fts3GetVarint(p, &iDelta);
+    iDocid += iDelta;
+    aOut[i++] = iDocid;
+  }
+
+  *paOut = aOut;
+  *pnOut = i;
+  return SQLITE_OK;
+}
+
 /*
 ** Call sqlite3Fts3DeferToken() for each token in the expression pExpr.
 */
@@ -115533,7 +120828,11 @@ static int fts3PhraseSelect(
       rc = fts3DeferredTermSelect(pTok->pDeferred, isTermPos, &nList, &pList);
     }else{
       if( pTok->pSegcsr ){
-        rc = fts3TermSelect(p, pTok, iCol, isTermPos, &nList, &pList);
+        const sqlite3_int64 *aFilter = 0;
+        if( pCsr->eEvalmode==FTS3_EVAL_FILTER ) aFilter = pCsr->aDocFilter;
+        rc = fts3TermSelect(p, pTok, iCol, isTermPos, 
+            aFilter, pCsr->nDocFilter, &nList, &pList
+        );
       }
       pTok->bFulltext = 1;
     }
@@ -115899,7 +121198,25 @@ static int fts3EvalExpr(
             rc = fts3DeferExpression(p, p->pExpr);
             break;
           }else{
+            /* Once the first doclist has been loaded, only docids that
+            ** appear in it can match. Use them as a docid filter while
+            ** loading the doclists of the remaining expressions, so that
+            ** the entries for other docids are skipped as the segments are
+            ** read instead of being merged and then discarded.  */
+            sqlite3_int64 *aFilter = p->aDocFilter;
+            int nFilter = p->nDocFilter;
+            sqlite3_int64 *aDocid = 0;
+            if( ii>0 && nDoc>0 ){
+              rc = fts3DoclistToArray(
+                  aRet, nRet, nDoc, &aDocid, &p->nDocFilter
+              );
+              if( rc!=SQLITE_OK ) break;
+              p->aDocFilter = aDocid;
+            }
             rc = fts3EvalExpr(p, pBest->pExpr, &aNew, &nNew, 0);
+            p->aDocFilter = aFilter;
+            p->nDocFilter = nFilter;
+            sqlite3_free(aDocid);
             if( rc!=SQLITE_OK ) break;
             pBest->pExpr = 0;
             if( ii==0 ){
@@ -120103,6 +125420,7 @@ struct SegmentNode {
 #define SQL_SELECT_DOCSIZE            21
 #define SQL_SELECT_DOCTOTAL           22
 #define SQL_REPLACE_DOCTOTAL          23
+#define SQL_SELECT_FULL_LEVELS        24
 
 /*
 ** This function is used to obtain an SQLite prepared statement handle
@@ -120152,6 +125470,12 @@ static int fts3SqlStmt(
 /* 21 */  "SELECT size FROM %Q.'%q_docsize' WHERE docid=?",
 /* 22 */  "SELECT value FROM %Q.'%q_stat' WHERE id=0",
 /* 23 */  "REPLACE INTO %Q.'%q_stat' VALUES(0,?)",
+
+          /* Return the levels with at least ? segments, and their sizes. */
+/* 24 */  "SELECT level, sum(CASE WHEN start_block=0 THEN 1 "
+                                 "ELSE end_block-start_block+1 END) "
+            "FROM %Q.'%q_segdir' GROUP BY level HAVING count(*)>=? "
+            "ORDER BY level ASC",
   };
   int rc = SQLITE_OK;
   sqlite3_stmt *pStmt;
@@ -120703,7 +126027,9 @@ static int fts3SegmentMerge(Fts3Table *, int);
 **
 ** However, if there are already FTS3_MERGE_COUNT indexes at the requested
 ** level, they are merged into a single level (iLevel+1) segment and the 
-** allocated index is 0.
+** allocated index is 0. If automatic merging is enabled, full levels are
+** left for fts3IncrMerge() and are only merged here once they hold
+** FTS3_MERGE_BACKSTOP times that many indexes.
 **
 ** If successful, *piIdx is set to the allocated index slot and SQLITE_OK
 ** returned. Otherwise, an SQLite error code is returned.
@@ -120729,7 +126055,9 @@ static int fts3AllocateSegdirIdx(Fts3Table *p, int iLevel, int *piIdx){
     ** segment and allocate (newly freed) index 0 at level iLevel. Otherwise,
     ** if iNext is less than FTS3_MERGE_COUNT, allocate index iNext.
     */
-    if( iNext>=FTS3_MERGE_COUNT ){
+    int nMax = FTS3_MERGE_COUNT;
+    if( p->nAutoMerge>0 ) nMax *= FTS3_MERGE_BACKSTOP;
+    if( iNext>=nMax ){
       rc = fts3SegmentMerge(p, iLevel);
       *piIdx = 0;
     }else{
@@ -121942,6 +127270,42 @@ static void fts3ColumnFilter(
   *pnList = nList;
 }
 
+/*
+** Return the index of the first entry in sorted array aDocid[] (size
+** nDocid) at or after index iStart that is not smaller than iDocid, or
+** nDocid if there is no such entry. The entries are probed at doubling
+** distances from iStart before a binary search, so that a series of
+** calls with increasing iDocid values costs little more than a single
+** pass through the array, but a long run of entries may be skipped in
+** logarithmic time.
+*/
+static int fts3DocidSeek(
+  const sqlite3_int64 *aDocid,    /* Sorted array of docids */
+  int nDocid,                     /* Number of entries in aDocid[] */
+  int iStart,                     /* Index to begin search at */
+  sqlite3_int64 iDocid            /* Docid to search for */
+){
+  int iLo = iStart;               /* aDocid[iLo-1] is less than iDocid */
+  int iHi = iStart;               /* aDocid[iHi] is not less than iDocid */
+  int nStep = 1;
+
+  while( iHi<nDocid && aDocid[iHi]<iDocid ){
+    iLo = iHi+1;
+    iHi += nStep;
+    nStep *= 2;
+  }
+  if( iHi>nDocid ) iHi = nDocid;
+  while( iLo<iHi ){
+    int iMid = (iLo+iHi)/2;
+    if( aDocid[iMid]<iDocid ){
+      iLo = iMid+1;
+    }else{
+      iHi = iMid;
+    }
+  }
+  return iHi;
+}
+
 SQLITE_PRIVATE int sqlite3Fts3SegReaderStart(
   Fts3Table *p,                   /* Virtual table handle */
   Fts3SegReaderCursor *pCsr,      /* Cursor object */
@@ -122038,6 +127402,7 @@ SQLITE_PRIVATE int sqlite3Fts3SegReaderStep(
     }
 
     assert( isIgnoreEmpty || (isRequirePos && !isColFilter) );
+    assert( isIgnoreEmpty || pFilter->aDocid==0 );
     if( nMerge==1 && !isIgnoreEmpty ){
       pCsr->aDoclist = apSegment[0]->aDoclist;
       pCsr->nDoclist = apSegment[0]->nDoclist;
@@ -122045,6 +127410,7 @@ SQLITE_PRIVATE int sqlite3Fts3SegReaderStep(
     }else{
       int nDoclist = 0;           /* Size of doclist */
       sqlite3_int64 iPrev = 0;    /* Previous docid stored in doclist */
+      int iFilter = 0;            /* Current index in pFilter->aDocid[] */
 
       /* The current term of the first nMerge entries in the array
       ** of Fts3SegReader objects is the same. The doclists must be merged
@@ -122060,6 +127426,32 @@ SQLITE_PRIVATE int sqlite3Fts3SegReaderStep(
         int nList;
         int nByte;
         sqlite3_int64 iDocid = apSegment[0]->iDocid;
+
+        /* If there is a docid filter, advance it to the first entry that is
+        ** not smaller than iDocid. Once the filter is exhausted the rest of
+        ** each doclist can be ignored. If the filter entry is larger than
+        ** iDocid, skip each segment's doclist forward to it without
+        ** merging the docids in between.  */
+        if( pFilter->aDocid ){
+          sqlite3_int64 iNext;
+          iFilter = fts3DocidSeek(pFilter->aDocid, pFilter->nDocid, 
+              iFilter, iDocid
+          );
+          if( iFilter>=pFilter->nDocid ) break;
+          iNext = pFilter->aDocid[iFilter];
+          if( iNext>iDocid ){
+            for(i=0; i<nMerge; i++){
+              Fts3SegReader *pSeg = apSegment[i];
+              if( pSeg->pOffsetList==0 || pSeg->iDocid>=iNext ) break;
+              do {
+                fts3SegReaderNextDocid(pSeg, 0, 0);
+              }while( pSeg->pOffsetList && pSeg->iDocid<iNext );
+            }
+            fts3SegReaderSort(apSegment, nMerge, i, fts3SegReaderDoclistCmp);
+            continue;
+          }
+        }
+
         fts3SegReaderNextDocid(apSegment[0], &pList, &nList);
         j = 1;
         while( j<nMerge
@@ -122197,11 +127589,60 @@ static int fts3SegmentMerge(Fts3Table *p, int iLevel){
 }
 
 
+/*
+** Merge full levels, that is levels with FTS3_MERGE_COUNT or more segments,
+** each into a single segment of the next level. Levels are merged lowest
+** first, so that the cost of merging a level is always paid by the writes
+** that filled it, and the new segment may in turn fill the next level.
+**
+** Up to nBlock blocks of segment data are merged. If isStrict is true, a
+** level is only merged if it fits in what remains of this budget, so that
+** large levels are left for an explicit 'merge=N' command or, eventually,
+** the synchronous merge in fts3AllocateSegdirIdx(). Otherwise, merging
+** continues until at least nBlock blocks have been merged or there are no
+** full levels left.
+*/
+static int fts3IncrMerge(Fts3Table *p, int nBlock, int isStrict){
+  int rc = SQLITE_OK;
+  int nRem = nBlock;              /* Blocks left in budget */
+
+  while( rc==SQLITE_OK && nRem>0 ){
+    sqlite3_stmt *pStmt;
+    int iLevel = -1;              /* Level to merge, or -1 */
+    int nSize = 0;                /* Size of level iLevel in blocks */
+
+    rc = fts3SqlStmt(p, SQL_SELECT_FULL_LEVELS, &pStmt, 0);
+    if( rc!=SQLITE_OK ) break;
+    sqlite3_bind_int(pStmt, 1, FTS3_MERGE_COUNT);
+    while( SQLITE_ROW==sqlite3_step(pStmt) ){
+      nSize = sqlite3_column_int(pStmt, 1);
+      if( !isStrict || nSize<=nRem ){
+        iLevel = sqlite3_column_int(pStmt, 0);
+        break;
+      }
+    }
+    rc = sqlite3_reset(pStmt);
+    if( rc!=SQLITE_OK || iLevel<0 ) break;
+
+    rc = fts3SegmentMerge(p, iLevel);
+    nRem -= nSize;
+  }
+
+  return rc;
+}
+
 /* 
-** Flush the contents of pendingTerms to a level 0 segment.
+** Flush the contents of pendingTerms to a level 0 segment. If automatic
+** merging is enabled and a segment was written, spend the configured
+** budget merging full levels.
 */
 SQLITE_PRIVATE int sqlite3Fts3PendingTermsFlush(Fts3Table *p){
-  return fts3SegmentMerge(p, FTS3_SEGCURSOR_PENDING);
+  int isFlush = (fts3HashCount(&p->pendingTerms)>0);
+  int rc = fts3SegmentMerge(p, FTS3_SEGCURSOR_PENDING);
+  if( rc==SQLITE_OK && isFlush && p->nAutoMerge>0 ){
+    rc = fts3IncrMerge(p, p->nAutoMerge, 1);
+  }
+  return rc;
 }
 
 /*
@@ -122357,8 +127798,20 @@ static void fts3UpdateDocTotals(
 **
 **   "INSERT INTO tbl(tbl) VALUES(<expr>)"
 **
-** Argument pVal contains the result of <expr>. Currently the only 
-** meaningful value to insert is the text 'optimize'.
+** Argument pVal contains the result of <expr>. The following values are
+** meaningful:
+**
+**   'optimize'     Merge all segments into a single segment.
+**
+**   'automerge=N'  Instead of merging a level as soon as it fills, merge
+**                  up to N blocks of full levels after each segment is
+**                  written. Setting N to 0 restores the default behaviour.
+**                  This setting applies to the current connection only.
+**
+**   'merge=N'      Merge full levels until at least N blocks have been
+**                  merged. This is intended to be run when the database
+**                  is idle, or from a second connection, to do the work
+**                  deferred by 'automerge=N'.
 */
 static int fts3SpecialInsert(Fts3Table *p, sqlite3_value *pVal){
   int rc;                         /* Return Code */
@@ -122374,6 +127827,21 @@ static int fts3SpecialInsert(Fts3Table *p, sqlite3_value *pVal){
     }else{
       sqlite3Fts3PendingTermsClear(p);
     }
+  }else if( nVal>10 && 0==sqlite3_strnicmp(zVal, "automerge=", 10) ){
+    int nBlock = atoi(&zVal[10]);
+    if( nBlock<0 ){
+      rc = SQLITE_ERROR;
+    }else{
+      p->nAutoMerge = nBlock;
+      rc = SQLITE_OK;
+    }
+  }else if( nVal>6 && 0==sqlite3_strnicmp(zVal, "merge=", 6) ){
+    int nBlock = atoi(&zVal[6]);
+    if( nBlock<=0 ){
+      rc = SQLITE_ERROR;
+    }else{
+      rc = fts3IncrMerge(p, nBlock, 0);
+    }
 #ifdef SQLITE_TEST
   }else if( nVal>9 && 0==sqlite3_strnicmp(zVal, "nodesize=", 9) ){
     p->nNodeSize = atoi(&zVal[9]);
@@ -127535,6 +133003,11 @@ SQLITE_API int sqlite3_extension_init(
 **
 **   * An implementation of the LIKE operator that uses ICU to 
 **     provide case-independent matching.
+**
+** LIKE, upper() and lower() check whether their UTF-8 arguments are
+** plain ASCII first.  If they are, the ASCII case mapping gives the same
+** answer as ICU, so the work is done directly on the UTF-8 bytes without
+** calling into ICU or converting the text to UTF-16.
 */
 
 #if !defined(SQLITE_CORE) || defined(SQLITE_ENABLE_ICU)
@@ -127545,6 +133018,10 @@ SQLITE_API int sqlite3_extension_init(
 #include <unicode/ustring.h>
 #include <unicode/ucol.h>
 
+#if defined(__SSE2__) && defined(__GNUC__)
+# include <emmintrin.h>
+# define ICU_USE_SSE2 1
+#endif
 
 #ifndef SQLITE_CORE
   SQLITE_EXTENSION_INIT1
@@ -127566,6 +133043,132 @@ static void xFree(void *p){
   sqlite3_free(p);
 }
 
+/*
+** Return true if the n bytes at z are all 7-bit ASCII characters other
+** than 0x00.  Such text is handled by the ASCII fast paths below, on
+** which ICU case folding and case mapping (in the default locale) agree
+** with the simple mapping of 'A'-'Z' to 'a'-'z'.
+*/
+static int icuIsAscii(const uint8_t *z, int n){
+  int i = 0;
+#ifdef ICU_USE_SSE2
+  const __m128i vZero = _mm_setzero_si128();
+  for(; i+16<=n; i+=16){
+    __m128i v = _mm_loadu_si128((const __m128i*)&z[i]);
+    if( _mm_movemask_epi8(_mm_or_si128(v, _mm_cmpeq_epi8(v, vZero))) ){
+      return 0;
+    }
+  }
+#else
+  for(; i+8<=n; i+=8){
+    /* Test 8 bytes at a time for a set high bit or a zero byte. */
+    uint64_t w;
+    memcpy(&w, &z[i], 8);
+    if( (w | ((w - 0x0101010101010101ULL) & ~w)) & 0x8080808080808080ULL ){
+      return 0;
+    }
+  }
+#endif
+  for(; i<n; i++){
+    if( z[i]==0 || z[i]>=0x80 ) return 0;
+  }
+  return 1;
+}
+
+#define icuAsciiFold(c) ((c)>='A' && (c)<='Z' ? (c)+0x20 : (c))
+
+/*
+** Return a pointer to the first byte in the range z..zEnd-1 that is
+** equal to the lower-case ASCII character c when folded to lower case,
+** or zEnd if there is no such byte.
+*/
+static const uint8_t *icuAsciiFind(
+  const uint8_t *z,          /* Start of range to search */
+  const uint8_t *zEnd,       /* First byte past the end of the range */
+  uint8_t c                  /* Character to look for, already folded */
+){
+  uint8_t cUpper = (c>='a' && c<='z') ? c-0x20 : c;
+#ifdef ICU_USE_SSE2
+  const __m128i vLower = _mm_set1_epi8((char)c);
+  const __m128i vUpper = _mm_set1_epi8((char)cUpper);
+  while( zEnd-z>=16 ){
+    __m128i v = _mm_loadu_si128((const __m128i*)z);
+    int m = _mm_movemask_epi8(
+        _mm_or_si128(_mm_cmpeq_epi8(v, vLower), _mm_cmpeq_epi8(v, vUpper))
+    );
+    if( m ) return &z[__builtin_ctz(m)];
+    z += 16;
+  }
+#endif
+  while( z<zEnd && *z!=c && *z!=cUpper ) z++;
+  return z;
+}
+
+/*
+** This is the version of icuLikeCompare() used when the pattern, the
+** string and the escape character are all ASCII.  The string is the
+** zEnd-zString bytes at zString.
+**
+** When a "%" is followed by an ordinary character, only the positions
+** in the string at which that character appears can begin a match, so
+** icuAsciiFind() is used to skip directly from one to the next instead
+** of trying the rest of the pattern at every position.  This makes
+** patterns like '%term%' a scan of the string rather than a sequence
+** of failed comparisons.
+*/
+static int icuAsciiLikeCompare(
+  const uint8_t *zPattern,   /* LIKE pattern */
+  const uint8_t *zString,    /* The string to compare against */
+  const uint8_t *zEnd,       /* First byte past the end of zString */
+  const int cEsc             /* The escape character, or 0 */
+){
+  int prevEscape = 0;     /* True if the previous character was cEsc */
+  uint8_t c;
+
+  while( (c = *(zPattern++))!=0 ){
+    if( !prevEscape && c=='%' ){
+      while( (c=*zPattern)=='%' || c=='_' ){
+        if( c=='_' ){
+          if( zString==zEnd ) return 0;
+          zString++;
+        }
+        zPattern++;
+      }
+      if( c==0 ) return 1;
+
+      if( c!=cEsc ){
+        c = icuAsciiFold(c);
+        while( (zString = icuAsciiFind(zString, zEnd, c))<zEnd ){
+          if( icuAsciiLikeCompare(zPattern, zString, zEnd, cEsc) ) return 1;
+          zString++;
+        }
+        return 0;
+      }
+      while( zString<zEnd ){
+        if( icuAsciiLikeCompare(zPattern, zString, zEnd, cEsc) ) return 1;
+        zString++;
+      }
+      return 0;
+
+    }else if( !prevEscape && c=='_' ){
+      if( zString==zEnd ) return 0;
+      zString++;
+
+    }else if( !prevEscape && c==cEsc ){
+      prevEscape = 1;
+
+    }else{
+      if( zString==zEnd || icuAsciiFold(*zString)!=icuAsciiFold(c) ){
+        return 0;
+      }
+      zString++;
+      prevEscape = 0;
+    }
+  }
+
+  return zString==zEnd;
+}
+
 /*
 ** Compare two UTF-8 strings for equality where the first string is
 ** a "LIKE" expression. Return true (1) if they are the same and 
@@ -127697,7 +133300,13 @@ static void icuLikeFunc(
   }
 
   if( zA && zB ){
-    sqlite3_result_int(context, icuLikeCompare(zA, zB, uEsc));
+    int nA = sqlite3_value_bytes(argv[0]);
+    int nB = sqlite3_value_bytes(argv[1]);
+    if( uEsc<0x80 && icuIsAscii(zA, nA) && icuIsAscii(zB, nB) ){
+      sqlite3_result_int(context, icuAsciiLikeCompare(zA, zB, &zB[nB], uEsc));
+    }else{
+      sqlite3_result_int(context, icuLikeCompare(zA, zB, uEsc));
+    }
   }
 }
 
@@ -127870,6 +133479,53 @@ static void icuCaseFunc16(sqlite3_context *p, int nArg, sqlite3_value **apArg){
   sqlite3_result_text16(p, zOutput, -1, xFree);
 }
 
+/*
+** The version of upper() and lower() registered for UTF-8.  If the input
+** is ASCII and no locale is specified, the result is computed directly
+** from the UTF-8 text.  Otherwise, icuCaseFunc16() is used.
+*/
+static void icuCaseFunc8(sqlite3_context *p, int nArg, sqlite3_value **apArg){
+  const uint8_t *zInput;
+  const char *zLocale = 0;
+
+  assert(nArg==1 || nArg==2);
+  if( nArg==2 ){
+    zLocale = (const char *)sqlite3_value_text(apArg[1]);
+  }
+
+  zInput = sqlite3_value_text(apArg[0]);
+  if( !zInput ){
+    return;
+  }
+
+  if( zLocale==0 || zLocale[0]==0 ){
+    int nInput = sqlite3_value_bytes(apArg[0]);
+    if( icuIsAscii(zInput, nInput) ){
+      char *zOutput = sqlite3_malloc(nInput+1);
+      int i;
+      if( !zOutput ){
+        sqlite3_result_error_nomem(p);
+        return;
+      }
+      if( sqlite3_user_data(p) ){
+        for(i=0; i<nInput; i++){
+          uint8_t c = zInput[i];
+          zOutput[i] = (c>='a' && c<='z') ? c-0x20 : c;
+        }
+      }else{
+        for(i=0; i<nInput; i++){
+          zOutput[i] = icuAsciiFold(zInput[i]);
+        }
+      }
+      zOutput[nInput] = 0;
+      sqlite3_result_text(p, zOutput, nInput, xFree);
+      return;
+    }
+  }
+
+  icuCaseFunc16(p, nArg, apArg);
+}
+
 /*
 ** Collation sequence destructor function. The pCtx argument points to
 ** a UCollator structure previously allocated using ucol_open().
@@ -127969,10 +133625,10 @@ SQLITE_PRIVATE int sqlite3IcuInit(sqlite3 *db){
     {"upper",  1, SQLITE_UTF16, (void*)1, icuCaseFunc16},
     {"upper",  2, SQLITE_UTF16, (void*)1, icuCaseFunc16},
 
-    {"lower",  1, SQLITE_UTF8,         0, icuCaseFunc16},
-    {"lower",  2, SQLITE_UTF8,         0, icuCaseFunc16},
-    {"upper",  1, SQLITE_UTF8,  (void*)1, icuCaseFunc16},
-    {"upper",  2, SQLITE_UTF8,  (void*)1, icuCaseFunc16},
+    {"lower",  1, SQLITE_UTF8,         0, icuCaseFunc8},
+    {"lower",  2, SQLITE_UTF8,         0, icuCaseFunc8},
+    {"upper",  1, SQLITE_UTF8,  (void*)1, icuCaseFunc8},
+    {"upper",  2, SQLITE_UTF8,  (void*)1, icuCaseFunc8},
 
     {"like",   2, SQLITE_UTF8,         0, icuLikeFunc},
     {"like",   3, SQLITE_UTF8,         0, icuLikeFunc},
@@ -665,6 +665,16 @@ struct sqlite3_file {
 ** fails to zero-fill short reads might seem to work.  However,
 ** failure to zero-fill short reads will eventually lead to
 ** database corruption.
+**
+** The xFetch() method, available when iVersion is 3 or greater, asks
+** the VFS for a pointer to iAmt bytes of the file starting at offset
+** iOfst, typically from a read-only memory mapping of the file.  ^If
+** the VFS is unable or unwilling to provide such a pointer it sets *pp
+** to NULL and returns SQLITE_OK, and SQLite falls back to xRead().
+** Each non-NULL pointer handed out by xFetch() is released by a
+** matching call to xUnfetch().  ^An xUnfetch() call with a NULL pointer
+** is a hint that the VFS should discard its mapping of the file, and is
+** only made when no xFetch() pointers are outstanding.
 */
 typedef struct sqlite3_io_methods sqlite3_io_methods;
 struct sqlite3_io_methods {
@@ -687,6 +697,9 @@ struct sqlite3_io_methods {
   void (*xShmBarrier)(sqlite3_file*);
   int (*xShmUnmap)(sqlite3_file*, int deleteFlag);
   /* Methods above are valid for version 2 */
+  int (*xFetch)(sqlite3_file*, sqlite3_int64 iOfst, int iAmt, void **pp);
+  int (*xUnfetch)(sqlite3_file*, sqlite3_int64 iOfst, void *p);
+  /* Methods above are valid for version 3 */
   /* Additional methods may be added in future releases */
 };
 
@@ -734,6 +747,15 @@ struct sqlite3_io_methods {
 ** Applications should not call [sqlite3_file_control()] with this
 ** opcode as doing so may disrupt the operation of the specialized VFSes
 ** that do require it.  
+**
+** The [SQLITE_FCNTL_MMAP_SIZE] file control is used to query or set the
+** maximum number of bytes of the file that the VFS may memory-map in
+** order to satisfy xFetch and xRead requests.  The argument is a pointer
+** to an [sqlite3_int64].  ^If the value pointed to is non-negative it
+** becomes the new mapping limit.  ^In either case, the previous limit is
+** written back into the integer before the call returns.  A limit of zero
+** disables memory-mapped I/O for the file.  This file control is used
+** internally to implement [PRAGMA mmap_size].
 */
 #define SQLITE_FCNTL_LOCKSTATE        1
 #define SQLITE_GET_LOCKPROXYFILE      2
@@ -743,6 +765,7 @@ struct sqlite3_io_methods {
 #define SQLITE_FCNTL_CHUNK_SIZE       6
 #define SQLITE_FCNTL_FILE_POINTER     7
 #define SQLITE_FCNTL_SYNC_OMITTED     8
+#define SQLITE_FCNTL_MMAP_SIZE       18
 
 
 /*
@@ -1429,6 +1452,39 @@ struct sqlite3_mem_methods {
 ** In a multi-threaded application, the application-defined logger
 ** function must be threadsafe. </dd>
 **
+** <dt>SQLITE_CONFIG_MMAP_SIZE</dt>
+** <dd> ^The SQLITE_CONFIG_MMAP_SIZE option takes two 64-bit integer
+** (sqlite3_int64) values that are the default mmap size limit (the default
+** setting for [PRAGMA mmap_size]) and the maximum allowed mmap size limit.
+** ^The default setting can be overridden by each database connection using
+** the [PRAGMA mmap_size] command.  ^The maximum allowed mmap size is
+** silently truncated if necessary so that it does not exceed the
+** compile-time maximum mmap size set by the SQLITE_MAX_MMAP_SIZE
+** compile-time option.  ^If either argument to this option is negative,
+** then that argument is changed to its compile-time default. </dd>
+**
+** <dt>SQLITE_CONFIG_PMASZ</dt>
+** <dd> ^The SQLITE_CONFIG_PMASZ option takes a single parameter which
+** is an unsigned integer and sets the minimum amount of memory, in units
+** of pages of the main database, that the external merge sorter used by
+** [CREATE INDEX] and by large ORDER BY clauses accumulates before sorting
+** it and spilling it to a temporary file.  ^If the [cache_size] of the
+** main database is larger, the cache size is used instead.  ^The default
+** minimum is set by the SQLITE_SORTER_PMASZ compile-time option, which
+** defaults to 250. </dd>
+**
+** <dt>SQLITE_CONFIG_WALCACHE</dt>
+** <dd> ^The SQLITE_CONFIG_WALCACHE option takes a single 64-bit integer
+** (sqlite3_int64) argument, the amount of memory in bytes that may be used
+** by a read-only page cache shared by all connections in the process that
+** have the same database open in [journal_mode | WAL mode].  ^While a
+** connection has no write transaction open, database pages that it reads
+** are looked up in and added to the shared cache instead of its own page
+** cache.  ^A value of zero or less disables the shared cache, which is the
+** default unless SQLite is compiled with a different
+** SQLITE_DEFAULT_WALCACHE_SIZE.  ^The current memory usage of the shared
+** cache is reported by [SQLITE_STATUS_WALCACHE_USED]. </dd>
+**
 ** </dl>
 */
 #define SQLITE_CONFIG_SINGLETHREAD  1  /* nil */
@@ -1447,6 +1503,9 @@ struct sqlite3_mem_methods {
 #define SQLITE_CONFIG_PCACHE       14  /* sqlite3_pcache_methods* */
 #define SQLITE_CONFIG_GETPCACHE    15  /* sqlite3_pcache_methods* */
 #define SQLITE_CONFIG_LOG          16  /* xFunc, void* */
+#define SQLITE_CONFIG_MMAP_SIZE    22  /* sqlite3_int64, sqlite3_int64 */
+#define SQLITE_CONFIG_PMASZ        25  /* unsigned int szPma */
+#define SQLITE_CONFIG_WALCACHE   1000  /* sqlite3_int64 nByte */
 
 /*
 ** CAPI3REF: Database Connection Configuration Options
@@ -1504,11 +1563,23 @@ struct sqlite3_mem_methods {
 ** following this call.  The second parameter may be a NULL pointer, in
 ** which case the trigger setting is not reported back. </dd>
 **
+** <dt>SQLITE_DBCONFIG_STMT_CACHE</dt>
+** <dd> ^This option sets the maximum number of idle statements kept by
+** the [statement cache] of the [database connection].
+** There should be two additional arguments.
+** The first argument is the new maximum, or a negative value to leave
+** the setting unchanged.  ^Setting it to zero disables the cache.
+** ^Idle statements beyond the new maximum are finalized immediately.
+** The second parameter is a pointer to an integer into which is written
+** the maximum following this call.  The second parameter may be a NULL
+** pointer, in which case the setting is not reported back. </dd>
+**
 ** </dl>
 */
 #define SQLITE_DBCONFIG_LOOKASIDE       1001  /* void* int int */
 #define SQLITE_DBCONFIG_ENABLE_FKEY     1002  /* int int* */
 #define SQLITE_DBCONFIG_ENABLE_TRIGGER  1003  /* int int* */
+#define SQLITE_DBCONFIG_STMT_CACHE      1004  /* int int* */
 
 
 /*
@@ -2577,6 +2648,10 @@ SQLITE_API int sqlite3_limit(sqlite3*, int id, int newVal);
 **
 ** ^(<dt>SQLITE_LIMIT_TRIGGER_DEPTH</dt>
 ** <dd>The maximum depth of recursion for triggers.</dd>)^
+**
+** ^(<dt>SQLITE_LIMIT_WORKER_THREADS</dt>
+** <dd>The maximum number of auxiliary worker threads that a single
+** [prepared statement] may start.</dd>)^
 ** </dl>
 */
 #define SQLITE_LIMIT_LENGTH                    0
@@ -2590,6 +2665,7 @@ SQLITE_API int sqlite3_limit(sqlite3*, int id, int newVal);
 #define SQLITE_LIMIT_LIKE_PATTERN_LENGTH       8
 #define SQLITE_LIMIT_VARIABLE_NUMBER           9
 #define SQLITE_LIMIT_TRIGGER_DEPTH            10
+#define SQLITE_LIMIT_WORKER_THREADS           11
 
 /*
 ** CAPI3REF: Compiling An SQL Statement
@@ -2700,6 +2776,65 @@ SQLITE_API int sqlite3_prepare16_v2(
   const void **pzTail     /* OUT: Pointer to unused portion of zSql */
 );
 
+/*
+** CAPI3REF: Prepared Statement Cache
+** KEYWORDS: {statement cache}
+**
+** ^The chromium_sqlite3_prepare() interface works like [sqlite3_prepare_v2()]
+** except that it takes an additional argument, a bitmask of zero or more of
+** the [CHROMIUM_SQLITE_PREPARE_CACHED | CHROMIUM_SQLITE_PREPARE_*] flags.
+**
+** ^(Each [database connection] has a cache of idle prepared statements, keyed
+** by SQL text.  When a statement prepared with the
+** CHROMIUM_SQLITE_PREPARE_CACHED flag is passed to [sqlite3_finalize()], it
+** is [sqlite3_reset | reset], its [sqlite3_clear_bindings | bindings are
+** cleared] and it is kept in the cache instead of being deleted.)^  ^A later
+** call to chromium_sqlite3_prepare() with the CHROMIUM_SQLITE_PREPARE_CACHED
+** flag for the same SQL statement returns the cached statement without
+** compiling the SQL again.  ^Only exactly the same text matches.  ^If the
+** cache holds no such statement, a new one is compiled.  Either way, the
+** application uses the statement exactly as one returned by
+** sqlite3_prepare_v2() and finalizes it when it is done with it.
+**
+** ^Cached statements are recompiled automatically after a schema change,
+** as for sqlite3_prepare_v2().  ^Statements that have expired are never
+** returned from the cache.
+**
+** ^The cache keeps at most 16 idle statements by default, discarding the
+** least recently used first.  ^The limit may be changed using
+** [sqlite3_db_config()] with [SQLITE_DBCONFIG_STMT_CACHE].  ^Idle
+** statements are finalized by [sqlite3_close()].  ^They are also visible
+** to [sqlite3_next_stmt()]; calling [sqlite3_finalize()] on an idle
+** statement deletes it.
+**
+** ^The number of cache hits and misses and an estimate of the compile time
+** saved are reported by [sqlite3_db_status()] with
+** [SQLITE_DBSTATUS_STMTCACHE_HIT], [SQLITE_DBSTATUS_STMTCACHE_MISS] and
+** [SQLITE_DBSTATUS_STMTCACHE_SAVED].
+*/
+SQLITE_API int chromium_sqlite3_prepare(
+  sqlite3 *db,            /* Database handle */
+  const char *zSql,       /* SQL statement, UTF-8 encoded */
+  int nByte,              /* Maximum length of zSql in bytes. */
+  unsigned int prepFlags, /* Zero or more CHROMIUM_SQLITE_PREPARE_ flags */
+  sqlite3_stmt **ppStmt,  /* OUT: Statement handle */
+  const char **pzTail     /* OUT: Pointer to unused portion of zSql */
+);
+
+/*
+** CAPI3REF: Prepare Flags
+**
+** These constants are the flags that may be passed to the prepFlags
+** argument of [chromium_sqlite3_prepare()].
+**
+** <dl>
+** <dt>CHROMIUM_SQLITE_PREPARE_CACHED</dt>
+** <dd>Look the statement up in, and return it to, the
+** [statement cache] of the database connection.</dd>
+** </dl>
+*/
+#define CHROMIUM_SQLITE_PREPARE_CACHED    0x01
+
 /*
 ** CAPI3REF: Retrieving Statement SQL
 **
@@ -5525,6 +5660,10 @@ SQLITE_API int sqlite3_status(int op, int *pCurrent, int *pHighwater, int resetF
 ** ^(<dt>SQLITE_STATUS_PARSER_STACK</dt>
 ** <dd>This parameter records the deepest parser stack.  It is only
 ** meaningful if SQLite is compiled with [YYTRACKMAXSTACKDEPTH].</dd>)^
+**
+** ^(<dt>SQLITE_STATUS_WALCACHE_USED</dt>
+** <dd>This parameter returns the number of bytes of memory used by the
+** shared WAL page cache configured using [SQLITE_CONFIG_WALCACHE].</dd>)^
 ** </dl>
 **
 ** New status parameters may be added from time to time.
@@ -5539,6 +5678,7 @@ SQLITE_API int sqlite3_status(int op, int *pCurrent, int *pHighwater, int resetF
 #define SQLITE_STATUS_PAGECACHE_SIZE       7
 #define SQLITE_STATUS_SCRATCH_SIZE         8
 #define SQLITE_STATUS_MALLOC_COUNT         9
+#define SQLITE_STATUS_WALCACHE_USED       10
 
 /*
 ** CAPI3REF: Database Connection Status
@@ -5619,7 +5759,46 @@ SQLITE_API int sqlite3_db_status(sqlite3*, int op, int *pCur, int *pHiwtr, int r
 ** and lookaside memory used by all prepared statements associated with
 ** the database connection.)^
 ** ^The highwater mark associated with SQLITE_DBSTATUS_STMT_USED is always 0.
+**
+** ^(<dt>SQLITE_DBSTATUS_WAL_SIZE</dt>
+** <dd>This parameter returns the number of frames in the [write-ahead log]
+** of the database most recently written by a transaction committed using
+** the database connection.)^  ^The highwater mark is the largest size seen.
+**
+** ^(<dt>SQLITE_DBSTATUS_CKPT_LAG</dt>
+** <dd>This parameter returns the number of frames in that write-ahead log
+** that had not yet been copied into the database file by a [checkpoint]
+** when the transaction was committed.)^  ^The highwater mark is the largest
+** lag seen.
+**
+** ^(<dt>SQLITE_DBSTATUS_CKPT_STALL</dt>
+** <dd>This parameter returns the number of milliseconds that the most
+** recent commit spent in the [sqlite3_wal_hook()] callback after the
+** transaction was written to the log.  This includes any checkpoint run
+** by [sqlite3_wal_autocheckpoint()].)^  ^The highwater mark is the longest
+** such stall.
 ** </dd>
+**
+** ^(<dt>SQLITE_DBSTATUS_STMTCACHE_HIT</dt>
+** <dd>This parameter returns the number of [chromium_sqlite3_prepare()] calls
+** with the [CHROMIUM_SQLITE_PREPARE_CACHED] flag that returned a statement
+** from the [statement cache] instead of compiling the SQL.
+** Only the high-water value is meaningful;
+** the current value is always zero.)^
+**
+** ^(<dt>SQLITE_DBSTATUS_STMTCACHE_MISS</dt>
+** <dd>This parameter returns the number of [chromium_sqlite3_prepare()] calls
+** with the [CHROMIUM_SQLITE_PREPARE_CACHED] flag that compiled a new statement.
+** Only the high-water value is meaningful;
+** the current value is always zero.)^
+**
+** ^(<dt>SQLITE_DBSTATUS_STMTCACHE_SAVED</dt>
+** <dd>This parameter returns an estimate of the number of microseconds of
+** SQL compilation avoided by the [statement cache].  Each hit counts the
+** average time taken by the compilations counted by
+** SQLITE_DBSTATUS_STMTCACHE_MISS, measured using the clock of the [VFS].
+** Only the high-water value is meaningful;
+** the current value is always zero.)^
 ** </dl>
 */
 #define SQLITE_DBSTATUS_LOOKASIDE_USED       0
@@ -5630,6 +5809,12 @@ SQLITE_API int sqlite3_db_status(sqlite3*, int op, int *pCur, int *pHiwtr, int r
 #define SQLITE_DBSTATUS_LOOKASIDE_MISS_SIZE  5
 #define SQLITE_DBSTATUS_LOOKASIDE_MISS_FULL  6
 #define SQLITE_DBSTATUS_MAX                  6   /* Largest defined DBSTATUS */
+#define SQLITE_DBSTATUS_WAL_SIZE          1000
+#define SQLITE_DBSTATUS_CKPT_LAG          1001
+#define SQLITE_DBSTATUS_CKPT_STALL        1002
+#define SQLITE_DBSTATUS_STMTCACHE_HIT     1003
+#define SQLITE_DBSTATUS_STMTCACHE_MISS    1004
+#define SQLITE_DBSTATUS_STMTCACHE_SAVED   1005
 
 
 /*
@@ -6284,6 +6469,44 @@ SQLITE_API void *sqlite3_wal_hook(
 */
 SQLITE_API int sqlite3_wal_autocheckpoint(sqlite3 *db, int N);
 
+/*
+** CAPI3REF: Configure a background checkpoint
+**
+** ^The [sqlite3_wal_background_checkpoint(D,N,B)] interface is a wrapper
+** around [sqlite3_wal_hook()] that causes any database on
+** [database connection] D to be [checkpointed] by a worker thread
+** after committing a transaction if there are N or more frames in the
+** [write-ahead log] file.  ^The commit returns without waiting for the
+** checkpoint.  ^Passing zero or a negative value as N disables automatic
+** checkpoints entirely.
+**
+** ^The worker thread runs the checkpoint using its own connection to the
+** database file, as a series of [SQLITE_CHECKPOINT_PASSIVE | passive]
+** checkpoints that each copy at most B frames into the database file.
+** ^If B is zero or negative, [SQLITE_DEFAULT_CHECKPOINT_BATCH] (100)
+** frames are copied at a time.  ^The worker never waits for readers; it
+** stops when the whole log has been copied or when readers prevent it
+** from making progress, and resumes after the next commit that finds
+** N or more frames in the log.
+**
+** ^Worker threads are only available in [threadsafe] builds on unix.
+** ^Otherwise, for databases in [locking_mode | EXCLUSIVE locking mode],
+** or if the worker thread cannot be started, the checkpoint is run
+** before the commit returns, as if by [sqlite3_wal_autocheckpoint()].
+**
+** ^The callback registered by this function replaces any existing callback
+** registered using [sqlite3_wal_hook()] or [sqlite3_wal_autocheckpoint()].
+** ^Replacing the callback, or closing the database connection, stops the
+** worker thread after any checkpoint step in progress has finished.
+**
+** ^The [wal_background_checkpoint pragma] can be used to invoke this
+** interface from SQL.  ^The size of the log, the number of frames not yet
+** checkpointed and the time spent by commits in checkpoints are reported
+** by [sqlite3_db_status()] with [SQLITE_DBSTATUS_WAL_SIZE],
+** [SQLITE_DBSTATUS_CKPT_LAG] and [SQLITE_DBSTATUS_CKPT_STALL].
+*/
+SQLITE_API int sqlite3_wal_background_checkpoint(sqlite3 *db, int N, int B);
+
 /*
 ** CAPI3REF: Checkpoint a database
 **
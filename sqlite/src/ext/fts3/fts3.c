@@ -2240,12 +2240,18 @@ static void fts3SegReaderCursorFree(Fts3SegReaderCursor *pSegcsr){
 ** is non-zero, then the returned list is in the same format as is stored 
 ** in the database without the found length specifier at the start of on-disk
 ** doclists.
+**
+** If aDocid is not NULL, it points to a sorted array of nDocid docids. Only
+** docids that are present in this array are included in the returned
+** doclist.
 */
 static int fts3TermSelect(
   Fts3Table *p,                   /* Virtual table handle */
   Fts3PhraseToken *pTok,          /* Token to query for */
   int iColumn,                    /* Column to query (or -ve for all columns) */
   int isReqPos,                   /* True to include position lists in output */
+  const sqlite3_int64 *aDocid,    /* Docid filter, or NULL */
+  int nDocid,                     /* Number of entries in aDocid[] */
   int *pnOut,                     /* OUT: Size of buffer at *ppOut */
   char **ppOut                    /* OUT: Malloced result buffer */
 ){
@@ -2265,6 +2271,8 @@ static int fts3TermSelect(
   filter.iCol = iColumn;
   filter.zTerm = pTok->z;
   filter.nTerm = pTok->n;
+  filter.aDocid = aDocid;
+  filter.nDocid = nDocid;
 
   rc = sqlite3Fts3SegReaderStart(p, pSegcsr, &filter);
   while( SQLITE_OK==rc
@@ -2326,6 +2334,40 @@ static int fts3DoclistCountDocids(int isPoslist, char *aList, int nList){
   return nDoc;
 }
 
+/*
+** Decode the bare doclist in buffer aList[] (size nList bytes), which
+** contains nDoc docids, into an array of docids allocated using
+** sqlite3_malloc(). If successful, set *paOut to point to the array and
+** *pnOut to the number of docids in it, and return SQLITE_OK. Otherwise,
+** return SQLITE_NOMEM.
+*/
+static int fts3DoclistToArray(
+  char *aList,                    /* Bare doclist */
+  int nList,                      /* Size of aList[] in bytes */
+  int nDoc,                       /* Number of docids in aList[] */
+  sqlite3_int64 **paOut,          /* OUT: Array of docids */
+  int *pnOut                      /* OUT: Number of entries in *paOut */
+){
+  sqlite3_int64 *aOut;            /* Output array */
+  char *p = aList;                /* Input cursor */
+  char *pEnd = &aList[nList];     /* Pointer to one byte after EOF */
+  sqlite3_int64 iDocid = 0;       /* Current docid */
+  int i = 0;                      /* Number of entries in aOut[] */
+
+  aOut = (sqlite3_int64 *)sqlite3_malloc(sizeof(sqlite3_int64) * nDoc);
+  if( !aOut ) return SQLITE_NOMEM;
+  while( p<pEnd && i<nDoc ){
+    sqlite3_int64 iDelta;
+    p += sqlite3Fts3GetVarint(p, &iDelta);
+    iDocid += iDelta;
+    aOut[i++] = iDocid;
+  }
+
+  *paOut = aOut;
+  *pnOut = i;
+  return SQLITE_OK;
+}
+
 /*
 ** Call sqlite3Fts3DeferToken() for each token in the expression pExpr.
 */
@@ -2472,7 +2514,11 @@ static int fts3PhraseSelect(
       rc = fts3DeferredTermSelect(pTok->pDeferred, isTermPos, &nList, &pList);
     }else{
       if( pTok->pSegcsr ){
-        rc = fts3TermSelect(p, pTok, iCol, isTermPos, &nList, &pList);
+        const sqlite3_int64 *aFilter = 0;
+        if( pCsr->eEvalmode==FTS3_EVAL_FILTER ) aFilter = pCsr->aDocFilter;
+        rc = fts3TermSelect(p, pTok, iCol, isTermPos, 
+            aFilter, pCsr->nDocFilter, &nList, &pList
+        );
       }
       pTok->bFulltext = 1;
     }
@@ -2838,7 +2884,25 @@ static int fts3EvalExpr(
             rc = fts3DeferExpression(p, p->pExpr);
             break;
           }else{
+            /* Once the first doclist has been loaded, only docids that
+            ** appear in it can match. Use them as a docid filter while
+            ** loading the doclists of the remaining expressions, so that
+            ** the entries for other docids are skipped as the segments are
+            ** read instead of being merged and then discarded.  */
+            sqlite3_int64 *aFilter = p->aDocFilter;
+            int nFilter = p->nDocFilter;
+            sqlite3_int64 *aDocid = 0;
+            if( ii>0 && nDoc>0 ){
+              rc = fts3DoclistToArray(
+                  aRet, nRet, nDoc, &aDocid, &p->nDocFilter
+              );
+              if( rc!=SQLITE_OK ) break;
+              p->aDocFilter = aDocid;
+            }
             rc = fts3EvalExpr(p, pBest->pExpr, &aNew, &nNew, 0);
+            p->aDocFilter = aFilter;
+            p->nDocFilter = nFilter;
+            sqlite3_free(aDocid);
             if( rc!=SQLITE_OK ) break;
             pBest->pExpr = 0;
             if( ii==0 ){
@@ -30,6 +30,15 @@
 */
 #define FTS3_MERGE_COUNT 16
 
+/*
+** If automatic merging is enabled (see the 'automerge=N' command), full
+** levels are merged incrementally after each write, within the configured
+** budget, instead of as soon as they fill. A level that is not merged in
+** this way is only merged synchronously once it holds this many times
+** FTS3_MERGE_COUNT segments.
+*/
+#define FTS3_MERGE_BACKSTOP 4
+
 /*
 ** This is the maximum amount of data (in bytes) to store in the 
 ** Fts3Table.pendingTerms hash table. Normally, the hash table is
@@ -128,12 +137,13 @@ struct Fts3Table {
   /* Precompiled statements used by the implementation. Each of these 
   ** statements is run and reset within a single virtual table API call. 
   */
-  sqlite3_stmt *aStmt[24];
+  sqlite3_stmt *aStmt[25];
 
   char *zReadExprlist;
   char *zWriteExprlist;
 
   int nNodeSize;                  /* Soft limit for node size */
+  int nAutoMerge;                 /* Blocks to merge per write, or 0 */
   u8 bHasStat;                    /* True if %_stat table exists */
   u8 bHasDocsize;                 /* True if %_docsize table exists */
   int nPgsz;                      /* Page size for host database */
@@ -172,6 +182,8 @@ struct Fts3Cursor {
   char *aDoclist;                 /* List of docids for full-text queries */
   int nDoclist;                   /* Size of buffer at aDoclist */
   int eEvalmode;                  /* An FTS3_EVAL_XX constant */
+  sqlite3_int64 *aDocFilter;      /* Sorted array of docids that may match */
+  int nDocFilter;                 /* Number of entries in aDocFilter[] */
   int nRowAvg;                    /* Average size of database rows, in pages */
 
   int isMatchinfoNeeded;          /* True when aMatchinfo[] needs filling in */
@@ -325,6 +337,8 @@ struct Fts3SegFilter {
   int nTerm;
   int iCol;
   int flags;
+  const sqlite3_int64 *aDocid;    /* If not NULL, only return these docids */
+  int nDocid;                     /* Number of entries in aDocid[] */
 };
 
 struct Fts3SegReaderCursor {
@@ -186,6 +186,7 @@ struct SegmentNode {
 #define SQL_SELECT_DOCSIZE            21
 #define SQL_SELECT_DOCTOTAL           22
 #define SQL_REPLACE_DOCTOTAL          23
+#define SQL_SELECT_FULL_LEVELS        24
 
 /*
 ** This function is used to obtain an SQLite prepared statement handle
@@ -235,6 +236,12 @@ static int fts3SqlStmt(
 /* 21 */  "SELECT size FROM %Q.'%q_docsize' WHERE docid=?",
 /* 22 */  "SELECT value FROM %Q.'%q_stat' WHERE id=0",
 /* 23 */  "REPLACE INTO %Q.'%q_stat' VALUES(0,?)",
+
+          /* Return the levels with at least ? segments, and their sizes. */
+/* 24 */  "SELECT level, sum(CASE WHEN start_block=0 THEN 1 "
+                                 "ELSE end_block-start_block+1 END) "
+            "FROM %Q.'%q_segdir' GROUP BY level HAVING count(*)>=? "
+            "ORDER BY level ASC",
   };
   int rc = SQLITE_OK;
   sqlite3_stmt *pStmt;
@@ -786,7 +793,9 @@ static int fts3SegmentMerge(Fts3Table *, int);
 **
 ** However, if there are already FTS3_MERGE_COUNT indexes at the requested
 ** level, they are merged into a single level (iLevel+1) segment and the 
-** allocated index is 0.
+** allocated index is 0. If automatic merging is enabled, full levels are
+** left for fts3IncrMerge() and are only merged here once they hold
+** FTS3_MERGE_BACKSTOP times that many indexes.
 **
 ** If successful, *piIdx is set to the allocated index slot and SQLITE_OK
 ** returned. Otherwise, an SQLite error code is returned.
@@ -812,7 +821,9 @@ static int fts3AllocateSegdirIdx(Fts3Table *p, int iLevel, int *piIdx){
     ** segment and allocate (newly freed) index 0 at level iLevel. Otherwise,
     ** if iNext is less than FTS3_MERGE_COUNT, allocate index iNext.
     */
-    if( iNext>=FTS3_MERGE_COUNT ){
+    int nMax = FTS3_MERGE_COUNT;
+    if( p->nAutoMerge>0 ) nMax *= FTS3_MERGE_BACKSTOP;
+    if( iNext>=nMax ){
       rc = fts3SegmentMerge(p, iLevel);
       *piIdx = 0;
     }else{
@@ -2025,6 +2036,42 @@ static void fts3ColumnFilter(
   *pnList = nList;
 }
 
+/*
+** Return the index of the first entry in sorted array aDocid[] (size
+** nDocid) at or after index iStart that is not smaller than iDocid, or
+** nDocid if there is no such entry. The entries are probed at doubling
+** distances from iStart before a binary search, so that a series of
+** calls with increasing iDocid values costs little more than a single
+** pass through the array, but a long run of entries may be skipped in
+** logarithmic time.
+*/
+static int fts3DocidSeek(
+  const sqlite3_int64 *aDocid,    /* Sorted array of docids */
+  int nDocid,                     /* Number of entries in aDocid[] */
+  int iStart,                     /* Index to begin search at */
+  sqlite3_int64 iDocid            /* Docid to search for */
+){
+  int iLo = iStart;               /* aDocid[iLo-1] is less than iDocid */
+  int iHi = iStart;               /* aDocid[iHi] is not less than iDocid */
+  int nStep = 1;
+
+  while( iHi<nDocid && aDocid[iHi]<iDocid ){
+    iLo = iHi+1;
+    iHi += nStep;
+    nStep *= 2;
+  }
+  if( iHi>nDocid ) iHi = nDocid;
+  while( iLo<iHi ){
+    int iMid = (iLo+iHi)/2;
+    if( aDocid[iMid]<iDocid ){
+      iLo = iMid+1;
+    }else{
+      iHi = iMid;
+    }
+  }
+  return iHi;
+}
+
 int sqlite3Fts3SegReaderStart(
   Fts3Table *p,                   /* Virtual table handle */
   Fts3SegReaderCursor *pCsr,      /* Cursor object */
@@ -2121,6 +2168,7 @@ int sqlite3Fts3SegReaderStep(
     }
 
     assert( isIgnoreEmpty || (isRequirePos && !isColFilter) );
+    assert( isIgnoreEmpty || pFilter->aDocid==0 );
     if( nMerge==1 && !isIgnoreEmpty ){
       pCsr->aDoclist = apSegment[0]->aDoclist;
       pCsr->nDoclist = apSegment[0]->nDoclist;
@@ -2128,6 +2176,7 @@ int sqlite3Fts3SegReaderStep(
     }else{
       int nDoclist = 0;           /* Size of doclist */
       sqlite3_int64 iPrev = 0;    /* Previous docid stored in doclist */
+      int iFilter = 0;            /* Current index in pFilter->aDocid[] */
 
       /* The current term of the first nMerge entries in the array
       ** of Fts3SegReader objects is the same. The doclists must be merged
@@ -2143,6 +2192,32 @@ int sqlite3Fts3SegReaderStep(
         int nList;
         int nByte;
         sqlite3_int64 iDocid = apSegment[0]->iDocid;
+
+        /* If there is a docid filter, advance it to the first entry that is
+        ** not smaller than iDocid. Once the filter is exhausted the rest of
+        ** each doclist can be ignored. If the filter entry is larger than
+        ** iDocid, skip each segment's doclist forward to it without
+        ** merging the docids in between.  */
+        if( pFilter->aDocid ){
+          sqlite3_int64 iNext;
+          iFilter = fts3DocidSeek(pFilter->aDocid, pFilter->nDocid, 
+              iFilter, iDocid
+          );
+          if( iFilter>=pFilter->nDocid ) break;
+          iNext = pFilter->aDocid[iFilter];
+          if( iNext>iDocid ){
+            for(i=0; i<nMerge; i++){
+              Fts3SegReader *pSeg = apSegment[i];
+              if( pSeg->pOffsetList==0 || pSeg->iDocid>=iNext ) break;
+              do {
+                fts3SegReaderNextDocid(pSeg, 0, 0);
+              }while( pSeg->pOffsetList && pSeg->iDocid<iNext );
+            }
+            fts3SegReaderSort(apSegment, nMerge, i, fts3SegReaderDoclistCmp);
+            continue;
+          }
+        }
+
         fts3SegReaderNextDocid(apSegment[0], &pList, &nList);
         j = 1;
         while( j<nMerge
@@ -2280,11 +2355,60 @@ static int fts3SegmentMerge(Fts3Table *p, int iLevel){
 }
 
 
+/*
+** Merge full levels, that is levels with FTS3_MERGE_COUNT or more segments,
+** each into a single segment of the next level. Levels are merged lowest
+** first, so that the cost of merging a level is always paid by the writes
+** that filled it, and the new segment may in turn fill the next level.
+**
+** Up to nBlock blocks of segment data are merged. If isStrict is true, a
+** level is only merged if it fits in what remains of this budget, so that
+** large levels are left for an explicit 'merge=N' command or, eventually,
+** the synchronous merge in fts3AllocateSegdirIdx(). Otherwise, merging
+** continues until at least nBlock blocks have been merged or there are no
+** full levels left.
+*/
+static int fts3IncrMerge(Fts3Table *p, int nBlock, int isStrict){
+  int rc = SQLITE_OK;
+  int nRem = nBlock;              /* Blocks left in budget */
+
+  while( rc==SQLITE_OK && nRem>0 ){
+    sqlite3_stmt *pStmt;
+    int iLevel = -1;              /* Level to merge, or -1 */
+    int nSize = 0;                /* Size of level iLevel in blocks */
+
+    rc = fts3SqlStmt(p, SQL_SELECT_FULL_LEVELS, &pStmt, 0);
+    if( rc!=SQLITE_OK ) break;
+    sqlite3_bind_int(pStmt, 1, FTS3_MERGE_COUNT);
+    while( SQLITE_ROW==sqlite3_step(pStmt) ){
+      nSize = sqlite3_column_int(pStmt, 1);
+      if( !isStrict || nSize<=nRem ){
+        iLevel = sqlite3_column_int(pStmt, 0);
+        break;
+      }
+    }
+    rc = sqlite3_reset(pStmt);
+    if( rc!=SQLITE_OK || iLevel<0 ) break;
+
+    rc = fts3SegmentMerge(p, iLevel);
+    nRem -= nSize;
+  }
+
+  return rc;
+}
+
 /* 
-** Flush the contents of pendingTerms to a level 0 segment.
+** Flush the contents of pendingTerms to a level 0 segment. If automatic
+** merging is enabled and a segment was written, spend the configured
+** budget merging full levels.
 */
 int sqlite3Fts3PendingTermsFlush(Fts3Table *p){
-  return fts3SegmentMerge(p, FTS3_SEGCURSOR_PENDING);
+  int isFlush = (fts3HashCount(&p->pendingTerms)>0);
+  int rc = fts3SegmentMerge(p, FTS3_SEGCURSOR_PENDING);
+  if( rc==SQLITE_OK && isFlush && p->nAutoMerge>0 ){
+    rc = fts3IncrMerge(p, p->nAutoMerge, 1);
+  }
+  return rc;
 }
 
 /*
@@ -2440,8 +2564,20 @@ static void fts3UpdateDocTotals(
 **
 **   "INSERT INTO tbl(tbl) VALUES(<expr>)"
 **
-** Argument pVal contains the result of <expr>. Currently the only 
-** meaningful value to insert is the text 'optimize'.
+** Argument pVal contains the result of <expr>. The following values are
+** meaningful:
+**
+**   'optimize'     Merge all segments into a single segment.
+**
+**   'automerge=N'  Instead of merging a level as soon as it fills, merge
+**                  up to N blocks of full levels after each segment is
+**                  written. Setting N to 0 restores the default behaviour.
+**                  This setting applies to the current connection only.
+**
+**   'merge=N'      Merge full levels until at least N blocks have been
+**                  merged. This is intended to be run when the database
+**                  is idle, or from a second connection, to do the work
+**                  deferred by 'automerge=N'.
 */
 static int fts3SpecialInsert(Fts3Table *p, sqlite3_value *pVal){
   int rc;                         /* Return Code */
@@ -2457,6 +2593,21 @@ static int fts3SpecialInsert(Fts3Table *p, sqlite3_value *pVal){
     }else{
       sqlite3Fts3PendingTermsClear(p);
     }
+  }else if( nVal>10 && 0==sqlite3_strnicmp(zVal, "automerge=", 10) ){
+    int nBlock = atoi(&zVal[10]);
+    if( nBlock<0 ){
+      rc = SQLITE_ERROR;
+    }else{
+      p->nAutoMerge = nBlock;
+      rc = SQLITE_OK;
+    }
+  }else if( nVal>6 && 0==sqlite3_strnicmp(zVal, "merge=", 6) ){
+    int nBlock = atoi(&zVal[6]);
+    if( nBlock<=0 ){
+      rc = SQLITE_ERROR;
+    }else{
+      rc = fts3IncrMerge(p, nBlock, 0);
+    }
 #ifdef SQLITE_TEST
   }else if( nVal>9 && 0==sqlite3_strnicmp(zVal, "nodesize=", 9) ){
     p->nNodeSize = atoi(&zVal[9]);
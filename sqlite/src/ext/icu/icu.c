@@ -26,6 +26,11 @@
 **
 **   * An implementation of the LIKE operator that uses ICU to 
 **     provide case-independent matching.
+**
+** LIKE, upper() and lower() check whether their UTF-8 arguments are
+** plain ASCII first.  If they are, the ASCII case mapping gives the same
+** answer as ICU, so the work is done directly on the UTF-8 bytes without
+** calling into ICU or converting the text to UTF-16.
 */
 
 #if !defined(SQLITE_CORE) || defined(SQLITE_ENABLE_ICU)
@@ -37,6 +42,11 @@
 #include <unicode/ucol.h>
 
 #include <assert.h>
+#include <string.h>
+#if defined(__SSE2__) && defined(__GNUC__)
+# include <emmintrin.h>
+# define ICU_USE_SSE2 1
+#endif
 
 #ifndef SQLITE_CORE
   #include "sqlite3ext.h"
@@ -60,6 +70,132 @@ static void xFree(void *p){
   sqlite3_free(p);
 }
 
+/*
+** Return true if the n bytes at z are all 7-bit ASCII characters other
+** than 0x00.  Such text is handled by the ASCII fast paths below, on
+** which ICU case folding and case mapping (in the default locale) agree
+** with the simple mapping of 'A'-'Z' to 'a'-'z'.
+*/
+static int icuIsAscii(const uint8_t *z, int n){
+  int i = 0;
+#ifdef ICU_USE_SSE2
+  const __m128i vZero = _mm_setzero_si128();
+  for(; i+16<=n; i+=16){
+    __m128i v = _mm_loadu_si128((const __m128i*)&z[i]);
+    if( _mm_movemask_epi8(_mm_or_si128(v, _mm_cmpeq_epi8(v, vZero))) ){
+      return 0;
+    }
+  }
+#else
+  for(; i+8<=n; i+=8){
+    /* Test 8 bytes at a time for a set high bit or a zero byte. */
+    uint64_t w;
+    memcpy(&w, &z[i], 8);
+    if( (w | ((w - 0x0101010101010101ULL) & ~w)) & 0x8080808080808080ULL ){
+      return 0;
+    }
+  }
+#endif
+  for(; i<n; i++){
+    if( z[i]==0 || z[i]>=0x80 ) return 0;
+  }
+  return 1;
+}
+
+#define icuAsciiFold(c) ((c)>='A' && (c)<='Z' ? (c)+0x20 : (c))
+
+/*
+** Return a pointer to the first byte in the range z..zEnd-1 that is
+** equal to the lower-case ASCII character c when folded to lower case,
+** or zEnd if there is no such byte.
+*/
+static const uint8_t *icuAsciiFind(
+  const uint8_t *z,          /* Start of range to search */
+  const uint8_t *zEnd,       /* First byte past the end of the range */
+  uint8_t c                  /* Character to look for, already folded */
+){
+  uint8_t cUpper = (c>='a' && c<='z') ? c-0x20 : c;
+#ifdef ICU_USE_SSE2
+  const __m128i vLower = _mm_set1_epi8((char)c);
+  const __m128i vUpper = _mm_set1_epi8((char)cUpper);
+  while( zEnd-z>=16 ){
+    __m128i v = _mm_loadu_si128((const __m128i*)z);
+    int m = _mm_movemask_epi8(
+        _mm_or_si128(_mm_cmpeq_epi8(v, vLower), _mm_cmpeq_epi8(v, vUpper))
+    );
+    if( m ) return &z[__builtin_ctz(m)];
+    z += 16;
+  }
+#endif
+  while( z<zEnd && *z!=c && *z!=cUpper ) z++;
+  return z;
+}
+
+/*
+** This is the version of icuLikeCompare() used when the pattern, the
+** string and the escape character are all ASCII.  The string is the
+** zEnd-zString bytes at zString.
+**
+** When a "%" is followed by an ordinary character, only the positions
+** in the string at which that character appears can begin a match, so
+** icuAsciiFind() is used to skip directly from one to the next instead
+** of trying the rest of the pattern at every position.  This makes
+** patterns like '%term%' a scan of the string rather than a sequence
+** of failed comparisons.
+*/
+static int icuAsciiLikeCompare(
+  const uint8_t *zPattern,   /* LIKE pattern */
+  const uint8_t *zString,    /* The string to compare against */
+  const uint8_t *zEnd,       /* First byte past the end of zString */
+  const int cEsc             /* The escape character, or 0 */
+){
+  int prevEscape = 0;     /* True if the previous character was cEsc */
+  uint8_t c;
+
+  while( (c = *(zPattern++))!=0 ){
+    if( !prevEscape && c=='%' ){
+      while( (c=*zPattern)=='%' || c=='_' ){
+        if( c=='_' ){
+          if( zString==zEnd ) return 0;
+          zString++;
+        }
+        zPattern++;
+      }
+      if( c==0 ) return 1;
+
+      if( c!=cEsc ){
+        c = icuAsciiFold(c);
+        while( (zString = icuAsciiFind(zString, zEnd, c))<zEnd ){
+          if( icuAsciiLikeCompare(zPattern, zString, zEnd, cEsc) ) return 1;
+          zString++;
+        }
+        return 0;
+      }
+      while( zString<zEnd ){
+        if( icuAsciiLikeCompare(zPattern, zString, zEnd, cEsc) ) return 1;
+        zString++;
+      }
+      return 0;
+
+    }else if( !prevEscape && c=='_' ){
+      if( zString==zEnd ) return 0;
+      zString++;
+
+    }else if( !prevEscape && c==cEsc ){
+      prevEscape = 1;
+
+    }else{
+      if( zString==zEnd || icuAsciiFold(*zString)!=icuAsciiFold(c) ){
+        return 0;
+      }
+      zString++;
+      prevEscape = 0;
+    }
+  }
+
+  return zString==zEnd;
+}
+
 /*
 ** Compare two UTF-8 strings for equality where the first string is
 ** a "LIKE" expression. Return true (1) if they are the same and 
@@ -191,7 +327,13 @@ static void icuLikeFunc(
   }
 
   if( zA && zB ){
-    sqlite3_result_int(context, icuLikeCompare(zA, zB, uEsc));
+    int nA = sqlite3_value_bytes(argv[0]);
+    int nB = sqlite3_value_bytes(argv[1]);
+    if( uEsc<0x80 && icuIsAscii(zA, nA) && icuIsAscii(zB, nB) ){
+      sqlite3_result_int(context, icuAsciiLikeCompare(zA, zB, &zB[nB], uEsc));
+    }else{
+      sqlite3_result_int(context, icuLikeCompare(zA, zB, uEsc));
+    }
   }
 }
 
@@ -364,6 +506,53 @@ static void icuCaseFunc16(sqlite3_context *p, int nArg, sqlite3_value **apArg){
   sqlite3_result_text16(p, zOutput, -1, xFree);
 }
 
+/*
+** The version of upper() and lower() registered for UTF-8.  If the input
+** is ASCII and no locale is specified, the result is computed directly
+** from the UTF-8 text.  Otherwise, icuCaseFunc16() is used.
+*/
+static void icuCaseFunc8(sqlite3_context *p, int nArg, sqlite3_value **apArg){
+  const uint8_t *zInput;
+  const char *zLocale = 0;
+
+  assert(nArg==1 || nArg==2);
+  if( nArg==2 ){
+    zLocale = (const char *)sqlite3_value_text(apArg[1]);
+  }
+
+  zInput = sqlite3_value_text(apArg[0]);
+  if( !zInput ){
+    return;
+  }
+
+  if( zLocale==0 || zLocale[0]==0 ){
+    int nInput = sqlite3_value_bytes(apArg[0]);
+    if( icuIsAscii(zInput, nInput) ){
+      char *zOutput = sqlite3_malloc(nInput+1);
+      int i;
+      if( !zOutput ){
+        sqlite3_result_error_nomem(p);
+        return;
+      }
+      if( sqlite3_user_data(p) ){
+        for(i=0; i<nInput; i++){
+          uint8_t c = zInput[i];
+          zOutput[i] = (c>='a' && c<='z') ? c-0x20 : c;
+        }
+      }else{
+        for(i=0; i<nInput; i++){
+          zOutput[i] = icuAsciiFold(zInput[i]);
+        }
+      }
+      zOutput[nInput] = 0;
+      sqlite3_result_text(p, zOutput, nInput, xFree);
+      return;
+    }
+  }
+
+  icuCaseFunc16(p, nArg, apArg);
+}
+
 /*
 ** Collation sequence destructor function. The pCtx argument points to
 ** a UCollator structure previously allocated using ucol_open().
@@ -463,10 +652,10 @@ int sqlite3IcuInit(sqlite3 *db){
     {"upper",  1, SQLITE_UTF16, (void*)1, icuCaseFunc16},
     {"upper",  2, SQLITE_UTF16, (void*)1, icuCaseFunc16},
 
-    {"lower",  1, SQLITE_UTF8,         0, icuCaseFunc16},
-    {"lower",  2, SQLITE_UTF8,         0, icuCaseFunc16},
-    {"upper",  1, SQLITE_UTF8,  (void*)1, icuCaseFunc16},
-    {"upper",  2, SQLITE_UTF8,  (void*)1, icuCaseFunc16},
+    {"lower",  1, SQLITE_UTF8,         0, icuCaseFunc8},
+    {"lower",  2, SQLITE_UTF8,         0, icuCaseFunc8},
+    {"upper",  1, SQLITE_UTF8,  (void*)1, icuCaseFunc8},
+    {"upper",  2, SQLITE_UTF8,  (void*)1, icuCaseFunc8},
 
     {"like",   2, SQLITE_UTF8,         0, icuLikeFunc},
     {"like",   3, SQLITE_UTF8,         0, icuLikeFunc},
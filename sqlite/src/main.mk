@@ -65,8 +65,9 @@ LIBOBJ+= alter.o analyze.o attach.o auth.o \
          random.o resolve.o rowset.o rtree.o select.o status.o \
          table.o tokenize.o trigger.o \
          update.o util.o vacuum.o \
-         vdbe.o vdbeapi.o vdbeaux.o vdbeblob.o vdbemem.o vdbetrace.o \
-         wal.o walker.o where.o utf.o vtab.o
+         vdbe.o vdbeapi.o vdbeaux.o vdbeblob.o vdbemem.o vdbesort.o \
+         vdbeprof.o vdbetrace.o \
+         wal.o walcache.o walckpt.o walker.o where.o utf.o vtab.o
 
 
 LIBOBJ += fts2.o \
@@ -161,11 +162,15 @@ SRC = \
   $(TOP)/src/vdbeaux.c \
   $(TOP)/src/vdbeblob.c \
   $(TOP)/src/vdbemem.c \
+  $(TOP)/src/vdbeprof.c \
+  $(TOP)/src/vdbesort.c \
   $(TOP)/src/vdbetrace.c \
   $(TOP)/src/vdbeInt.h \
   $(TOP)/src/vtab.c \
   $(TOP)/src/wal.c \
   $(TOP)/src/wal.h \
+  $(TOP)/src/walcache.c \
+  $(TOP)/src/walckpt.c \
   $(TOP)/src/walker.c \
   $(TOP)/src/where.c
 
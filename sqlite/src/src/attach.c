@@ -144,6 +144,7 @@ static void attachFunc(
     sqlite3PagerLockingMode(pPager, db->dfltLockMode);
     sqlite3BtreeSecureDelete(aNew->pBt,
                              sqlite3BtreeSecureDelete(db->aDb[0].pBt,-1) );
+    sqlite3BtreeSetMmapLimit(aNew->pBt, db->szMmap);
   }
   aNew->safety_level = 3;
   aNew->zName = sqlite3DbStrDup(db, zName);
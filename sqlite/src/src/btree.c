@@ -1527,24 +1527,29 @@ static MemPage *btreePageFromDbPage(DbPage *pDbPage, Pgno pgno, BtShared *pBt){
 ** Get a page from the pager.  Initialize the MemPage.pBt and
 ** MemPage.aData elements if needed.
 **
-** If the noContent flag is set, it means that we do not care about
-** the content of the page at this time.  So do not go to the disk
-** to fetch the content.  Just fill in the content with zeros for now.
+** If the PAGER_ACQUIRE_NOCONTENT flag is set, it means that we do not
+** care about the content of the page at this time.  So do not go to the
+** disk to fetch the content.  Just fill in the content with zeros for now.
 ** If in the future we call sqlite3PagerWrite() on this page, that
 ** means we have started to be concerned about content and the disk
 ** read should occur at that point.
+**
+** If the PAGER_ACQUIRE_READONLY flag is set, the caller promises never to
+** write to the page, so the pager may return a memory mapped page.
 */
 static int btreeGetPage(
   BtShared *pBt,       /* The btree */
   Pgno pgno,           /* Number of the page to fetch */
   MemPage **ppPage,    /* Return the page in this parameter */
-  int noContent        /* Do not load page content if true */
+  int flags            /* PAGER_ACQUIRE_NOCONTENT or PAGER_ACQUIRE_READONLY */
 ){
   int rc;
   DbPage *pDbPage;
 
+  assert( flags==0 || flags==PAGER_ACQUIRE_NOCONTENT 
+       || flags==PAGER_ACQUIRE_READONLY );
   assert( sqlite3_mutex_held(pBt->mutex) );
-  rc = sqlite3PagerAcquire(pBt->pPager, pgno, (DbPage**)&pDbPage, noContent);
+  rc = sqlite3PagerAcquire(pBt->pPager, pgno, (DbPage**)&pDbPage, flags);
   if( rc ) return rc;
   *ppPage = btreePageFromDbPage(pDbPage, pgno, pBt);
   return SQLITE_OK;
@@ -1585,11 +1590,15 @@ u32 sqlite3BtreeLastPage(Btree *p){
 **
 ** If an error occurs, then the value *ppPage is set to is undefined. It
 ** may remain unchanged, or it may be set to an invalid value.
+**
+** If bReadonly is true, the page is only going to be read, so it may
+** be returned as a memory mapped page (see PAGER_ACQUIRE_READONLY).
 */
 static int getAndInitPage(
   BtShared *pBt,          /* The database file */
   Pgno pgno,           /* Number of the page to get */
-  MemPage **ppPage     /* Write the page pointer here */
+  MemPage **ppPage,    /* Write the page pointer here */
+  int bReadonly        /* True if a read-only (mmap) page is ok */
 ){
   int rc;
   assert( sqlite3_mutex_held(pBt->mutex) );
@@ -1597,7 +1606,7 @@ static int getAndInitPage(
   if( pgno>btreePagecount(pBt) ){
     rc = SQLITE_CORRUPT_BKPT;
   }else{
-    rc = btreeGetPage(pBt, pgno, ppPage, 0);
+    rc = btreeGetPage(pBt, pgno, ppPage, bReadonly?PAGER_ACQUIRE_READONLY:0);
     if( rc==SQLITE_OK ){
       rc = btreeInitPage(*ppPage);
       if( rc!=SQLITE_OK ){
@@ -2087,6 +2096,19 @@ int sqlite3BtreeSetCacheSize(Btree *p, int mxPage){
   return SQLITE_OK;
 }
 
+/*
+** Change the limit on the amount of the database file that may be
+** memory mapped.
+*/
+int sqlite3BtreeSetMmapLimit(Btree *p, sqlite3_int64 szMmap){
+  BtShared *pBt = p->pBt;
+  assert( sqlite3_mutex_held(p->db->mutex) );
+  sqlite3BtreeEnter(p);
+  sqlite3PagerSetMmapLimit(pBt->pPager, szMmap);
+  sqlite3BtreeLeave(p);
+  return SQLITE_OK;
+}
+
 /*
 ** Change the way data is synced to disk in order to increase or decrease
 ** how well the database resists damage due to OS crashes and power
@@ -3518,6 +3540,25 @@ void sqlite3BtreeCursorZero(BtCursor *p){
   memset(p, 0, offsetof(BtCursor, iPage));
 }
 
+/*
+** Put write cursor pCur into bulk-load mode, or take it out of bulk-load
+** mode if nFill is zero.
+**
+** In bulk-load mode, an entry appended to the right-hand end of a page
+** whose parent page points to it with the right-child pointer (as happens
+** when rowids or index keys are inserted in ascending order) is moved to
+** a new page once the page is nFill percent full. The full page is left
+** as it is instead of being rebalanced with its siblings, so that the
+** tree is built from the left, one page at a time, without rewriting
+** the pages it has already filled. See balance_bulk().
+*/
+void sqlite3BtreeCursorBulkLoad(BtCursor *pCur, int nFill){
+  assert( cursorHoldsMutex(pCur) );
+  assert( nFill==0 || (nFill>=50 && nFill<=100) );
+  assert( nFill==0 || pCur->wrFlag );
+  pCur->nBulkFill = (u8)nFill;
+}
+
 /*
 ** Set the cached rowid value of every cursor in the same database file
 ** as pCur and having the same root page number as pCur.  The value is
@@ -3927,7 +3968,9 @@ static int accessPayload(
         */
         DbPage *pDbPage;
         int a = amt;
-        rc = sqlite3PagerGet(pBt->pPager, nextPage, &pDbPage);
+        rc = sqlite3PagerAcquire(pBt->pPager, nextPage, &pDbPage,
+            (eOp==0 ? PAGER_ACQUIRE_READONLY : 0)
+        );
         if( rc==SQLITE_OK ){
           aPayload = sqlite3PagerGetData(pDbPage);
           nextPage = get4byte(aPayload);
@@ -4111,7 +4154,7 @@ static int moveToChild(BtCursor *pCur, u32 newPgno){
   if( pCur->iPage>=(BTCURSOR_MAX_DEPTH-1) ){
     return SQLITE_CORRUPT_BKPT;
   }
-  rc = getAndInitPage(pBt, newPgno, &pNewPage);
+  rc = getAndInitPage(pBt, newPgno, &pNewPage, pCur->wrFlag==0);
   if( rc ) return rc;
   pCur->apPage[i+1] = pNewPage;
   pCur->aiIdx[i+1] = 0;
@@ -4215,7 +4258,8 @@ static int moveToRoot(BtCursor *pCur){
     }
     pCur->iPage = 0;
   }else{
-    rc = getAndInitPage(pBt, pCur->pgnoRoot, &pCur->apPage[0]);
+    rc = getAndInitPage(pBt, pCur->pgnoRoot, &pCur->apPage[0],
+                        pCur->wrFlag==0);
     if( rc!=SQLITE_OK ){
       pCur->eState = CURSOR_INVALID;
       return rc;
@@ -4410,6 +4454,7 @@ int sqlite3BtreeMovetoUnpacked(
   int *pRes                /* Write search results here */
 ){
   int rc;
+  RecordCompare xRecordCompare = 0;  /* Compares cells against pIdxKey */
 
   assert( cursorHoldsMutex(pCur) );
   assert( sqlite3_mutex_held(pCur->pBtree->db->mutex) );
@@ -4431,6 +4476,7 @@ int sqlite3BtreeMovetoUnpacked(
     }
   }
 
+  pCur->pBtree->nSeek++;
   rc = moveToRoot(pCur);
   if( rc ){
     return rc;
@@ -4444,6 +4490,9 @@ int sqlite3BtreeMovetoUnpacked(
     return SQLITE_OK;
   }
   assert( pCur->apPage[0]->intKey || pIdxKey );
+  if( pIdxKey ){
+    xRecordCompare = sqlite3VdbeFindCompare(pIdxKey);
+  }
   for(;;){
     int lwr, upr;
     Pgno chldPg;
@@ -4502,13 +4551,13 @@ int sqlite3BtreeMovetoUnpacked(
           /* This branch runs if the record-size field of the cell is a
           ** single byte varint and the record fits entirely on the main
           ** b-tree page.  */
-          c = sqlite3VdbeRecordCompare(nCell, (void*)&pCell[1], pIdxKey);
+          c = xRecordCompare(nCell, (void*)&pCell[1], pIdxKey);
         }else if( !(pCell[1] & 0x80) 
           && (nCell = ((nCell&0x7f)<<7) + pCell[1])<=pPage->maxLocal
         ){
           /* The record-size field is a 2 byte varint and the record 
           ** fits entirely on the main b-tree page.  */
-          c = sqlite3VdbeRecordCompare(nCell, (void*)&pCell[2], pIdxKey);
+          c = xRecordCompare(nCell, (void*)&pCell[2], pIdxKey);
         }else{
           /* The record flows over onto one or more overflow pages. In
           ** this case the whole cell needs to be parsed, a buffer allocated
@@ -4528,7 +4577,7 @@ int sqlite3BtreeMovetoUnpacked(
             sqlite3_free(pCellKey);
             goto moveto_finish;
           }
-          c = sqlite3VdbeRecordCompare(nCell, pCellKey, pIdxKey);
+          c = xRecordCompare(nCell, pCellKey, pIdxKey);
           sqlite3_free(pCellKey);
         }
       }
@@ -5683,6 +5732,146 @@ static int balance_quick(MemPage *pParent, MemPage *pPage, u8 *pSpace){
 }
 #endif /* SQLITE_OMIT_QUICKBALANCE */
 
+/*
+** Return the number of bytes that a cursor in bulk-load mode leaves free
+** on each page it fills.
+*/
+static int bulkReserve(BtCursor *pCur){
+  assert( pCur->nBulkFill>=50 && pCur->nBulkFill<=100 );
+  return pCur->pBt->usableSize * (100 - pCur->nBulkFill) / 100;
+}
+
+/*
+** Return true if appending a cell of sz bytes to page pPage would leave
+** less than nReserve bytes of free space on it, in which case a cursor
+** in bulk-load mode appends the cell to a new page instead. Pages with
+** fewer than two cells are never considered full, as balance_bulk()
+** needs at least one cell to leave behind on the page.
+*/
+static int bulkPageFull(MemPage *pPage, int sz, int nReserve){
+  return pPage->nCell>=2 && sz+2>pPage->nFree-nReserve;
+}
+
+/*
+** Return true if the iPage'th page of cursor pCur is the right-child of
+** its parent page, or is the root page, so that balance() may pass it
+** to balance_bulk() once it overflows.
+*/
+static int bulkRightEdge(BtCursor *pCur, int iPage){
+  return pCur->pgnoRoot!=1
+      && (iPage==0 || pCur->aiIdx[iPage-1]==pCur->apPage[iPage-1]->nCell);
+}
+
+/*
+** This version of balance() is used instead of balance_quick() and
+** balance_nonroot() by cursors in bulk-load mode (see
+** sqlite3BtreeCursorBulkLoad()). It handles both table and index
+** b-trees, and both leaf and interior pages.
+**
+** pPage must have a single overflow entry which is also the right-most
+** entry on the page, and it must be the right-child of pParent. A new
+** page is allocated to the right of pPage and the overflow cell is
+** moved to it. pPage itself is not rebalanced: if it is a leaf of a
+** table b-tree, the divider cell inserted into pParent is made from the
+** largest key on pPage, as in balance_quick(). Otherwise the right-most
+** cell of pPage is removed from it and becomes the divider (and, on an
+** interior page, its child becomes the right-child of pPage), so that
+** each key is still stored exactly once.
+**
+** If the divider does not fit on pParent, or would leave less than
+** nReserve bytes free on it, it is stored as an overflow cell of pParent
+** in buffer pSpace, which must be at least pageSize bytes in size. The
+** caller balances pParent next. The caller passes zero for nReserve if
+** pParent is not itself a right-child, as balance_bulk() could not be
+** used to split it early.
+*/
+static int balance_bulk(
+  MemPage *pParent,               /* Parent page of pPage */
+  MemPage *pPage,                 /* Page with an overflow cell on the end */
+  u8 *pSpace,                     /* Space for the new divider cell */
+  int nReserve                    /* Bytes to leave free on pParent */
+){
+  BtShared *const pBt = pPage->pBt;    /* B-Tree Database */
+  MemPage *pNew = 0;                   /* Newly allocated page */
+  Pgno pgnoNew;                        /* Page number of pNew */
+  u8 *pCell = pPage->aOvfl[0].pCell;   /* Cell to move to pNew */
+  u16 szCell = cellSizePtr(pPage, pCell);
+  int szDivider;                       /* Size of divider cell in pSpace */
+  int rc;                              /* Return Code */
+
+  assert( sqlite3_mutex_held(pBt->mutex) );
+  assert( sqlite3PagerIswriteable(pParent->pDbPage) );
+  assert( pPage->nOverflow==1 && pPage->aOvfl[0].idx==pPage->nCell );
+  assert( pPage->nCell>=2 );
+  assert( pParent->nOverflow==0 );
+
+  rc = sqlite3PagerWrite(pPage->pDbPage);
+  if( rc==SQLITE_OK ){
+    rc = allocateBtreePage(pBt, &pNew, &pgnoNew, 0, 0);
+  }
+  if( rc ) return rc;
+
+  TRACE(("BALANCE: bulk append to %d from %d\n", pgnoNew, pPage->pgno));
+
+  /* Copy the overflow cell to the new page. An interior page inherits
+  ** the right-child pointer of pPage.  */
+  assert( sqlite3PagerIswriteable(pNew->pDbPage) );
+  zeroPage(pNew, pPage->aData[pPage->hdrOffset]);
+  assemblePage(pNew, 1, &pCell, &szCell);
+  if( !pPage->leaf ){
+    memcpy(&pNew->aData[pNew->hdrOffset+8],
+           &pPage->aData[pPage->hdrOffset+8], 4);
+  }
+
+  /* Create the divider cell in pSpace, leaving room for the 4-byte page
+  ** number of pPage at the start of it.  */
+  if( pPage->hasData ){
+    CellInfo info;
+    btreeParseCellPtr(pPage, findCell(pPage, pPage->nCell-1), &info);
+    szDivider = 4 + putVarint(&pSpace[4], info.nKey);
+  }else{
+    int iLast = pPage->nCell-1;
+    u8 *pLast = findCell(pPage, iLast);
+    int szLast = cellSizePtr(pPage, pLast);
+    if( pPage->leaf ){
+      memcpy(&pSpace[4], pLast, szLast);
+      szDivider = szLast + 4;
+    }else{
+      memcpy(pSpace, pLast, szLast);
+      szDivider = szLast;
+      memcpy(&pPage->aData[pPage->hdrOffset+8], pLast, 4);
+    }
+    dropCell(pPage, iLast, szLast, &rc);
+  }
+
+  /* If this is an auto-vacuum database, update the pointer map entries
+  ** for the new page and for the pages that it now holds pointers to.
+  ** Any overflow pages belonging to the divider cell are taken care of
+  ** when it is written to pParent (or, if it overflows pParent, to
+  ** whichever page it is eventually stored on).  */
+  if( ISAUTOVACUUM ){
+    ptrmapPut(pBt, pgnoNew, PTRMAP_BTREE, pParent->pgno, &rc);
+    if( rc==SQLITE_OK ){
+      rc = setChildPtrmaps(pNew);
+    }
+  }
+
+  /* Append the divider cell to pParent and make the new page its
+  ** right-child.  */
+  if( rc==SQLITE_OK && bulkPageFull(pParent, szDivider, nReserve) ){
+    put4byte(pSpace, pPage->pgno);
+    pParent->aOvfl[0].pCell = pSpace;
+    pParent->aOvfl[0].idx = pParent->nCell;
+    pParent->nOverflow = 1;
+  }else{
+    insertCell(pParent, pParent->nCell, pSpace, szDivider, 0, pPage->pgno, &rc);
+  }
+  put4byte(&pParent->aData[pParent->hdrOffset+8], pgnoNew);
+
+  releasePage(pNew);
+  return rc;
+}
+
 #if 0
 /*
 ** This function does not contribute anything to the operation of SQLite.
@@ -5910,7 +6099,7 @@ static int balance_nonroot(
   }
   pgno = get4byte(pRight);
   while( 1 ){
-    rc = getAndInitPage(pBt, pgno, &apOld[i]);
+    rc = getAndInitPage(pBt, pgno, &apOld[i], 0);
     if( rc ){
       memset(apOld, 0, (i+1)*sizeof(MemPage*));
       goto balance_cleanup;
@@ -6507,6 +6696,7 @@ static int balance(BtCursor *pCur){
   const int nMin = pCur->pBt->usableSize * 2 / 3;
   u8 aBalanceQuickSpace[13];
   u8 *pFree = 0;
+  int bBulk = 0;                 /* True after a call to balance_bulk() */
 
   TESTONLY( int balance_quick_called = 0 );
   TESTONLY( int balance_deeper_called = 0 );
@@ -6533,14 +6723,43 @@ static int balance(BtCursor *pCur){
       }else{
         break;
       }
-    }else if( pPage->nOverflow==0 && pPage->nFree<=nMin ){
+    }else if( pPage->nOverflow==0 && (pPage->nFree<=nMin || bBulk) ){
+      /* A page that has just had a divider appended to it by
+      ** balance_bulk() is left underfull. It is the page that the next
+      ** divider will be appended to.  */
       break;
     }else{
       MemPage * const pParent = pCur->apPage[iPage-1];
       int const iIdx = pCur->aiIdx[iPage-1];
 
       rc = sqlite3PagerWrite(pParent->pDbPage);
-      if( rc==SQLITE_OK ){
+      if( rc==SQLITE_OK && pCur->nBulkFill
+       && pPage->nOverflow==1
+       && pPage->aOvfl[0].idx==pPage->nCell
+       && pPage->nCell>=2
+       && pParent->pgno!=1
+       && pParent->nCell==iIdx
+      ){
+        /* The cursor is in bulk-load mode and a cell has been appended
+        ** to the right-most child of pParent. Call balance_bulk() to move
+        ** it to a new right-hand sibling of pPage. If the divider cell
+        ** overflows pParent, it is stored in the pSpace buffer until
+        ** the next iteration of the do-loop has balanced pParent, in the
+        ** same way as for balance_nonroot() below.  */
+        u8 *pSpace = sqlite3PageMalloc(pCur->pBt->pageSize);
+        if( pSpace==0 ){
+          rc = SQLITE_NOMEM;
+        }else{
+          int nReserve = bulkRightEdge(pCur, iPage-1) ? bulkReserve(pCur) : 0;
+          rc = balance_bulk(pParent, pPage, pSpace, nReserve);
+        }
+        if( pFree ){
+          sqlite3PageFree(pFree);
+        }
+        pFree = pSpace;
+        bBulk = 1;
+      }else if( rc==SQLITE_OK ){
+        bBulk = 0;
 #ifndef SQLITE_OMIT_QUICKBALANCE
         if( pPage->hasData
          && pPage->nOverflow==1
@@ -6734,7 +6953,20 @@ int sqlite3BtreeInsert(
   }else{
     assert( pPage->leaf );
   }
-  insertCell(pPage, idx, newCell, szNew, 0, 0, &rc);
+  if( pCur->nBulkFill && loc && idx==pPage->nCell
+   && bulkRightEdge(pCur, pCur->iPage)
+   && bulkPageFull(pPage, szNew, bulkReserve(pCur))
+  ){
+    /* The cursor is in bulk-load mode and the new cell is being appended
+    ** to a page that has reached its fill factor. Store it as an overflow
+    ** cell so that balance() moves it to a new page.  */
+    assert( pPage->nOverflow==0 );
+    pPage->aOvfl[0].pCell = newCell;
+    pPage->aOvfl[0].idx = (u16)idx;
+    pPage->nOverflow = 1;
+  }else{
+    insertCell(pPage, idx, newCell, szNew, 0, 0, &rc);
+  }
   assert( rc!=SQLITE_OK || pPage->nCell>0 || pPage->nOverflow>0 );
 
   /* If no error has occured and pPage has an overflow cell, call balance() 
@@ -7065,7 +7297,7 @@ static int clearDatabasePage(
     return SQLITE_CORRUPT_BKPT;
   }
 
-  rc = getAndInitPage(pBt, pgno, &pPage);
+  rc = getAndInitPage(pBt, pgno, &pPage, 0);
   if( rc ) return rc;
   for(i=0; i<pPage->nCell; i++){
     pCell = findCell(pPage, i);
@@ -7397,6 +7629,15 @@ Pager *sqlite3BtreePager(Btree *p){
   return p->pBt->pPager;
 }
 
+/*
+** Return the number of times cursors belonging to Btree p have searched
+** the b-tree from its root page for a key.  The count wraps around on
+** overflow.
+*/
+u32 sqlite3BtreeSeekCount(Btree *p){
+  return p->nSeek;
+}
+
 #ifndef SQLITE_OMIT_INTEGRITY_CHECK
 /*
 ** Append a message to the error message string.
@@ -7598,6 +7839,7 @@ static int checkTreePage(
   if( iPage==0 ) return 0;
   if( checkRef(pCheck, iPage, zParentContext) ) return 0;
   if( (rc = btreeGetPage(pBt, (Pgno)iPage, &pPage, 0))!=0 ){
+    if( rc==SQLITE_NOMEM || rc==SQLITE_IOERR_NOMEM ) pCheck->mallocFailed = 1;
     checkAppendMsg(pCheck, zContext,
        "unable to get the page. error code=%d", rc);
     return 0;
@@ -156,6 +156,10 @@ SQLITE_WSD struct Sqlite3Config sqlite3Config = {
    0,                         /* nPage */
    0,                         /* mxParserStack */
    0,                         /* sharedCacheEnabled */
+   SQLITE_DEFAULT_MMAP_SIZE,  /* szMmap */
+   SQLITE_MAX_MMAP_SIZE,      /* mxMmap */
+   SQLITE_SORTER_PMASZ,       /* szPma */
+   SQLITE_DEFAULT_WALCACHE_SIZE, /* szWalCache */
    /* All the rest should always be initialized to zero */
    0,                         /* isInit */
    0,                         /* inProgress */
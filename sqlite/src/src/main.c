@@ -189,6 +189,10 @@ int sqlite3_initialize(void){
     sqlite3RegisterGlobalFunctions();
     if( sqlite3GlobalConfig.isPCacheInit==0 ){
       rc = sqlite3PcacheInitialize();
+      if( rc==SQLITE_OK ){
+        rc = sqlite3WalCacheInitialize();
+        if( rc!=SQLITE_OK ) sqlite3PcacheShutdown();
+      }
     }
     if( rc==SQLITE_OK ){
       sqlite3GlobalConfig.isPCacheInit = 1;
@@ -252,6 +256,7 @@ int sqlite3_shutdown(void){
     sqlite3GlobalConfig.isInit = 0;
   }
   if( sqlite3GlobalConfig.isPCacheInit ){
+    sqlite3WalCacheShutdown();
     sqlite3PcacheShutdown();
     sqlite3GlobalConfig.isPCacheInit = 0;
   }
@@ -426,6 +431,30 @@ int sqlite3_config(int op, ...){
       break;
     }
 
+    case SQLITE_CONFIG_MMAP_SIZE: {
+      sqlite3_int64 szMmap = va_arg(ap, sqlite3_int64);
+      sqlite3_int64 mxMmap = va_arg(ap, sqlite3_int64);
+      if( mxMmap<0 || mxMmap>SQLITE_MAX_MMAP_SIZE ){
+        mxMmap = SQLITE_MAX_MMAP_SIZE;
+      }
+      sqlite3GlobalConfig.mxMmap = mxMmap;
+      if( szMmap<0 ) szMmap = SQLITE_DEFAULT_MMAP_SIZE;
+      if( szMmap>mxMmap ) szMmap = mxMmap;
+      sqlite3GlobalConfig.szMmap = szMmap;
+      break;
+    }
+
+    case SQLITE_CONFIG_WALCACHE: {
+      sqlite3_int64 szWalCache = va_arg(ap, sqlite3_int64);
+      sqlite3GlobalConfig.szWalCache = szWalCache>0 ? szWalCache : 0;
+      break;
+    }
+
+    case SQLITE_CONFIG_PMASZ: {
+      sqlite3GlobalConfig.szPma = va_arg(ap, unsigned int);
+      break;
+    }
+
     default: {
       rc = SQLITE_ERROR;
       break;
@@ -521,6 +550,21 @@ int sqlite3_db_config(sqlite3 *db, int op, ...){
       rc = setupLookaside(db, pBuf, sz, cnt);
       break;
     }
+    case SQLITE_DBCONFIG_STMT_CACHE: {
+      int nMax = va_arg(ap, int);
+      int *pRes = va_arg(ap, int*);
+      sqlite3_mutex_enter(db->mutex);
+      if( nMax>=0 ){
+        db->stmtCache.nMax = nMax;
+        sqlite3VdbeCacheTrim(db, nMax);
+      }
+      if( pRes ){
+        *pRes = db->stmtCache.nMax;
+      }
+      sqlite3_mutex_leave(db->mutex);
+      rc = SQLITE_OK;
+      break;
+    }
     default: {
       static const struct {
         int op;      /* The opcode */
@@ -687,6 +731,9 @@ int sqlite3_close(sqlite3 *db){
   }
   sqlite3_mutex_enter(db->mutex);
 
+  /* Finalize the idle statements held by the statement cache. */
+  sqlite3VdbeCacheTrim(db, 0);
+
   /* Force xDestroy calls on all virtual tables */
   sqlite3ResetInternalSchema(db, -1);
 
@@ -721,6 +768,10 @@ int sqlite3_close(sqlite3 *db){
   /* Free any outstanding Savepoint structures. */
   sqlite3CloseSavepoints(db);
 
+  /* Stop the background checkpointer, if any, before the databases it
+  ** checkpoints are closed. */
+  sqlite3_wal_hook(db, 0, 0);
+
   for(j=0; j<db->nDb; j++){
     struct Db *pDb = &db->aDb[j];
     if( pDb->pBt ){
@@ -773,6 +824,7 @@ int sqlite3_close(sqlite3 *db){
   }
   sqlite3HashClear(&db->aModule);
 #endif
+  sqlite3StmtProfileClose(db);
 
   sqlite3Error(db, SQLITE_OK, 0); /* Deallocates any cached error strings. */
   if( db->pErr ){
@@ -1354,9 +1406,42 @@ int sqlite3_wal_autocheckpoint(sqlite3 *db, int nFrame){
   return SQLITE_OK;
 }
 
+/*
+** Configure an sqlite3_wal_hook() callback to checkpoint a database on
+** a background thread after committing a transaction if there are nFrame
+** or more frames in the log file.  Each step of the checkpoint copies at
+** most nBatch frames into the database file.  Passing zero or a negative
+** value as the nFrame parameter disables automatic checkpoints entirely.
+**
+** Like sqlite3_wal_autocheckpoint(), this replaces any existing callback
+** registered using sqlite3_wal_hook().
+*/
+int sqlite3_wal_background_checkpoint(sqlite3 *db, int nFrame, int nBatch){
+#ifdef SQLITE_OMIT_WAL
+  UNUSED_PARAMETER(db);
+  UNUSED_PARAMETER(nFrame);
+  UNUSED_PARAMETER(nBatch);
+#else
+  if( nFrame>0 ){
+    void *pCkpt;
+    if( nBatch<=0 ) nBatch = SQLITE_DEFAULT_CHECKPOINT_BATCH;
+    pCkpt = sqlite3WalCkptCreate(db, nFrame, nBatch);
+    if( pCkpt==0 ) return SQLITE_NOMEM;
+    sqlite3_wal_hook(db, sqlite3WalCkptHook, pCkpt);
+  }else{
+    sqlite3_wal_hook(db, 0, 0);
+  }
+#endif
+  return SQLITE_OK;
+}
+
 /*
 ** Register a callback to be invoked each time a transaction is written
 ** into the write-ahead-log by this database connection.
+**
+** If the callback being replaced is a background checkpointer registered
+** by sqlite3_wal_background_checkpoint(), its worker thread is stopped
+** and the checkpointer freed.
 */
 void *sqlite3_wal_hook(
   sqlite3 *db,                    /* Attach the hook to this db handle */
@@ -1367,6 +1452,10 @@ void *sqlite3_wal_hook(
   void *pRet;
   sqlite3_mutex_enter(db->mutex);
   pRet = db->pWalArg;
+  if( db->xWalCallback==sqlite3WalCkptHook ){
+    sqlite3WalCkptDestroy(pRet);
+    pRet = 0;
+  }
   db->xWalCallback = xCallback;
   db->pWalArg = pArg;
   sqlite3_mutex_leave(db->mutex);
@@ -1701,6 +1790,7 @@ static const int aHardLimit[] = {
   SQLITE_MAX_LIKE_PATTERN_LENGTH,
   SQLITE_MAX_VARIABLE_NUMBER,
   SQLITE_MAX_TRIGGER_DEPTH,
+  SQLITE_MAX_WORKER_THREADS,
 };
 
 /*
@@ -1736,6 +1826,9 @@ static const int aHardLimit[] = {
 #if SQLITE_MAX_TRIGGER_DEPTH<1
 # error SQLITE_MAX_TRIGGER_DEPTH must be at least 1
 #endif
+#if SQLITE_MAX_WORKER_THREADS<0 || SQLITE_MAX_WORKER_THREADS>50
+# error SQLITE_MAX_WORKER_THREADS must be between 0 and 50
+#endif
 
 
 /*
@@ -1769,7 +1862,8 @@ int sqlite3_limit(sqlite3 *db, int limitId, int newLimit){
                                                SQLITE_MAX_LIKE_PATTERN_LENGTH );
   assert( aHardLimit[SQLITE_LIMIT_VARIABLE_NUMBER]==SQLITE_MAX_VARIABLE_NUMBER);
   assert( aHardLimit[SQLITE_LIMIT_TRIGGER_DEPTH]==SQLITE_MAX_TRIGGER_DEPTH );
-  assert( SQLITE_LIMIT_TRIGGER_DEPTH==(SQLITE_N_LIMIT-1) );
+  assert( aHardLimit[SQLITE_LIMIT_WORKER_THREADS]==SQLITE_MAX_WORKER_THREADS );
+  assert( SQLITE_LIMIT_WORKER_THREADS==(SQLITE_N_LIMIT-1) );
 
 
   if( limitId<0 || limitId>=SQLITE_N_LIMIT ){
@@ -1881,9 +1975,11 @@ static int openDatabase(
 
   assert( sizeof(db->aLimit)==sizeof(aHardLimit) );
   memcpy(db->aLimit, aHardLimit, sizeof(db->aLimit));
+  db->aLimit[SQLITE_LIMIT_WORKER_THREADS] = SQLITE_DEFAULT_WORKER_THREADS;
   db->autoCommit = 1;
   db->nextAutovac = -1;
   db->nextPagesize = 0;
+  db->szMmap = sqlite3GlobalConfig.szMmap;
   db->flags |= SQLITE_ShortColNames | SQLITE_AutoIndex | SQLITE_EnableTrigger
 #if SQLITE_DEFAULT_FILE_FORMAT<4
                  | SQLITE_LegacyFileFmt
@@ -2008,6 +2104,12 @@ static int openDatabase(
   }
 #endif
 
+#if !defined(SQLITE_OMIT_STMT_PROFILE) && !defined(SQLITE_OMIT_VIRTUALTABLE)
+  if( !db->mallocFailed && rc==SQLITE_OK ){
+    rc = sqlite3StmtProfileInit(db);
+  }
+#endif
+
   sqlite3Error(db, rc, 0);
 
   /* -DSQLITE_DEFAULT_LOCKING_MODE=1 makes EXCLUSIVE the default locking
@@ -2025,6 +2127,7 @@ static int openDatabase(
                         sqlite3GlobalConfig.nLookaside);
 
   sqlite3_wal_autocheckpoint(db, SQLITE_DEFAULT_WAL_AUTOCHECKPOINT);
+  db->stmtCache.nMax = SQLITE_DEFAULT_STMT_CACHE_SIZE;
 
 opendb_out:
   if( db ){
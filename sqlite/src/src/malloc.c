@@ -22,7 +22,11 @@
 */
 int sqlite3_release_memory(int n){
 #ifdef SQLITE_ENABLE_MEMORY_MANAGEMENT
-  return sqlite3PcacheReleaseMemory(n);
+  int nFree = sqlite3PcacheReleaseMemory(n);
+  if( n<0 || nFree<n ){
+    nFree += sqlite3WalCacheReleaseMemory(n<0 ? -1 : n-nFree);
+  }
+  return nFree;
 #else
   /* IMPLEMENTATION-OF: R-34391-24921 The sqlite3_release_memory() routine
   ** is a no-op returning zero if SQLite is not compiled with
@@ -666,12 +666,17 @@ struct Pager {
   int pageSize;               /* Number of bytes in a page */
   Pgno mxPgno;                /* Maximum allowed size of the database */
   i64 journalSizeLimit;       /* Size limit for persistent journal files */
+  u8 bUseFetch;               /* True to use xFetch() */
+  int nMmapOut;               /* Number of mmap and shared pages outstanding */
+  sqlite3_int64 szMmap;       /* Desired maximum mmap size */
+  PgHdr *pMmapFreelist;       /* List of free mmap page headers (pDirty) */
   char *zFilename;            /* Name of the database file */
   char *zJournal;             /* Name of the journal file */
   int (*xBusyHandler)(void*); /* Function to call when busy */
   void *pBusyHandlerArg;      /* Context argument for xBusyHandler */
+  int nCkptBatch;             /* Max frames per checkpoint, or 0 for all */
+  u32 aStat[3];               /* Cache hits, misses and bytes read */
 #ifdef SQLITE_TEST
-  int nHit, nMiss;            /* Cache hits and missing */
   int nRead, nWrite;          /* Database pages read/written */
 #endif
   void (*xReiniter)(DbPage*); /* Call this routine when reloading pages */
@@ -775,6 +780,27 @@ static const unsigned char aJournalMagic[] = {
 */
 #define isOpen(pFd) ((pFd)->pMethods)
 
+/*
+** The macro USEFETCH is true if we are allowed to use the xFetch and xUnfetch
+** interfaces to access the database using memory-mapped I/O.
+*/
+#if SQLITE_MAX_MMAP_SIZE>0
+# define USEFETCH(x) ((x)->bUseFetch)
+#else
+# define USEFETCH(x) 0
+#endif
+
+/*
+** The macro PAGER_MAPPAGES is true if the pager may return read-only page
+** objects that are not part of the page cache.  These are used both for
+** memory-mapped pages and for pages from the shared WAL page cache.
+*/
+#if SQLITE_MAX_MMAP_SIZE>0 || !defined(SQLITE_OMIT_WAL)
+# define PAGER_MAPPAGES 1
+#else
+# define PAGER_MAPPAGES 0
+#endif
+
 /*
 ** Return true if this pager uses a write-ahead log instead of the usual
 ** rollback journal. Otherwise false.
@@ -2786,17 +2812,21 @@ end_playback:
 ** pPg->pData. A shared lock or greater must be held on the database
 ** file before this function is called.
 **
+** If parameter iFrame is non-zero, then it is the frame of the 
+** write-ahead log (as returned by sqlite3WalFindFrame()) that contains
+** the current version of the page. Otherwise, the page is read from the
+** database file itself.
+**
 ** If page 1 is read, then the value of Pager.dbFileVers[] is set to
 ** the value read from the database file.
 **
 ** If an IO error occurs, then the IO error is returned to the caller.
 ** Otherwise, SQLITE_OK is returned.
 */
-static int readDbPage(PgHdr *pPg){
+static int readDbPage(PgHdr *pPg, u32 iFrame){
   Pager *pPager = pPg->pPager; /* Pager object associated with page pPg */
   Pgno pgno = pPg->pgno;       /* Page number to read */
   int rc = SQLITE_OK;          /* Return code */
-  int isInWal = 0;             /* True if page is in log file */
   int pgsz = pPager->pageSize; /* Number of bytes to read */
 
   assert( pPager->eState>=PAGER_READER && !MEMDB );
@@ -2808,11 +2838,10 @@ static int readDbPage(PgHdr *pPg){
     return SQLITE_OK;
   }
 
-  if( pagerUseWal(pPager) ){
+  if( iFrame ){
     /* Try to pull the page from the write-ahead log. */
-    rc = sqlite3WalRead(pPager->pWal, pgno, &isInWal, pgsz, pPg->pData);
-  }
-  if( rc==SQLITE_OK && !isInWal ){
+    rc = sqlite3WalReadFrame(pPager->pWal, iFrame, pgsz, pPg->pData);
+  }else{
     i64 iOffset = (pgno-1)*(i64)pPager->pageSize;
     rc = sqlite3OsRead(pPager->fd, pPg->pData, pgsz, iOffset);
     if( rc==SQLITE_IOERR_SHORT_READ ){
@@ -2842,6 +2871,7 @@ static int readDbPage(PgHdr *pPg){
   }
   CODEC1(pPager, pPg->pData, pgno, 3, rc = SQLITE_NOMEM);
 
+  if( rc==SQLITE_OK ) pPager->aStat[PAGER_STAT_READ] += pgsz;
   PAGER_INCR(sqlite3_pager_readdb_count);
   PAGER_INCR(pPager->nRead);
   IOTRACE(("PGIN %p %d\n", pPager, pgno));
@@ -2896,7 +2926,11 @@ static int pagerUndoCallback(void *pCtx, Pgno iPg){
     if( sqlite3PcachePageRefcount(pPg)==1 ){
       sqlite3PcacheDrop(pPg);
     }else{
-      rc = readDbPage(pPg);
+      u32 iFrame = 0;
+      rc = sqlite3WalFindFrame(pPager->pWal, pPg->pgno, &iFrame);
+      if( rc==SQLITE_OK ){
+        rc = readDbPage(pPg, iFrame);
+      }
       if( rc==SQLITE_OK ){
         pPager->xReiniter(pPg);
       }
@@ -3031,6 +3065,7 @@ static int pagerBeginReadTransaction(Pager *pPager){
   rc = sqlite3WalBeginReadTransaction(pPager->pWal, &changed);
   if( rc!=SQLITE_OK || changed ){
     pager_reset(pPager);
+    if( USEFETCH(pPager) ) sqlite3OsUnfetch(pPager->fd, 0, 0);
   }
 
   return rc;
@@ -3294,6 +3329,192 @@ void sqlite3PagerSetCachesize(Pager *pPager, int mxPage){
   sqlite3PcacheSetCachesize(pPager->pPCache, mxPage);
 }
 
+/*
+** Invoke SQLITE_FCNTL_MMAP_SIZE based on the current value of szMmap.
+** Memory mapped reads are only used if the VFS supports xFetch (version 3
+** io methods or later) and no codec is attached to the pager, since a 
+** codec must be able to transform the page content in place. They are
+** also disabled for "PRAGMA omit_readlock" connections, as without a 
+** read lock the file may be truncated underneath the mapping.
+*/
+static void pagerFixMaplimit(Pager *pPager){
+#if SQLITE_MAX_MMAP_SIZE>0
+  sqlite3_file *fd = pPager->fd;
+  if( isOpen(fd) && fd->pMethods->iVersion>=3 ){
+    sqlite3_int64 sz;
+    pPager->bUseFetch = (pPager->szMmap>0 && !pPager->noReadlock);
+#ifdef SQLITE_HAS_CODEC
+    if( pPager->xCodec ) pPager->bUseFetch = 0;
+#endif
+    sz = pPager->szMmap;
+    sqlite3OsFileControl(pPager->fd, SQLITE_FCNTL_MMAP_SIZE, &sz);
+  }
+#endif
+}
+
+/*
+** Change the maximum size of any memory mapping made of the database file.
+*/
+void sqlite3PagerSetMmapLimit(Pager *pPager, sqlite3_int64 szMmap){
+  pPager->szMmap = szMmap;
+  pagerFixMaplimit(pPager);
+}
+
+#if PAGER_MAPPAGES
+/*
+** Release the content pData of page pgno, which was obtained from xFetch()
+** or, if flags includes PGHDR_SHARED, from the shared WAL page cache.
+*/
+static void pagerReleaseMapData(
+  Pager *pPager,                  /* Pager object */
+  Pgno pgno,                      /* Page number */
+  int flags,                      /* PGHDR_MMAP, possibly with PGHDR_SHARED */
+  void *pData                     /* Page content to release */
+){
+#ifndef SQLITE_OMIT_WAL
+  if( flags & PGHDR_SHARED ){
+    sqlite3WalCacheRelease(pData);
+    return;
+  }
+#endif
+  assert( pPager->fd->pMethods->iVersion>=3 );
+  sqlite3OsUnfetch(pPager->fd, (i64)(pgno-1)*pPager->pageSize, pData);
+}
+
+/*
+** Obtain a reference to a memory mapped page object for page number pgno. 
+** The new object will use the pointer pData, obtained from xFetch() or,
+** if flags includes PGHDR_SHARED, from the shared WAL page cache.
+** If successful, set *ppPage to point to the new page reference
+** and return SQLITE_OK. Otherwise, return an SQLite error code and set
+** *ppPage to zero.
+**
+** Page references obtained by calling this function should be released
+** by calling pagerReleaseMapPage().
+*/
+static int pagerAcquireMapPage(
+  Pager *pPager,                  /* Pager object */
+  Pgno pgno,                      /* Page number */
+  void *pData,                    /* xFetch()'d or shared data for this page */
+  int flags,                      /* PGHDR_MMAP, possibly with PGHDR_SHARED */
+  PgHdr **ppPage                  /* OUT: Acquired page object */
+){
+  PgHdr *p;                       /* Memory mapped page to return */
+
+  assert( flags==PGHDR_MMAP || flags==(PGHDR_MMAP|PGHDR_SHARED) );
+  if( pPager->pMmapFreelist ){
+    *ppPage = p = pPager->pMmapFreelist;
+    pPager->pMmapFreelist = p->pDirty;
+    p->pDirty = 0;
+    p->nRef = 1;
+    memset(p->pExtra, 0, pPager->nExtra);
+  }else{
+    *ppPage = p = (PgHdr *)sqlite3MallocZero(sizeof(PgHdr) + pPager->nExtra);
+    if( p==0 ){
+      pagerReleaseMapData(pPager, pgno, flags, pData);
+      return SQLITE_NOMEM;
+    }
+    p->pExtra = (void *)&p[1];
+    p->nRef = 1;
+    p->pPager = pPager;
+  }
+
+  assert( p->pExtra==(void *)&p[1] );
+  assert( p->pCache==0 );
+  assert( p->pPager==pPager );
+  assert( p->nRef==1 );
+
+  p->flags = (u16)flags;
+  p->pgno = pgno;
+  p->pData = pData;
+  pPager->nMmapOut++;
+
+  return SQLITE_OK;
+}
+
+/*
+** Release a reference to page pPg. pPg must have been returned by an 
+** earlier call to pagerAcquireMapPage().
+*/
+static void pagerReleaseMapPage(PgHdr *pPg){
+  Pager *pPager = pPg->pPager;
+  pPager->nMmapOut--;
+  pPg->pDirty = pPager->pMmapFreelist;
+  pPager->pMmapFreelist = pPg;
+  pagerReleaseMapData(pPager, pPg->pgno, pPg->flags, pPg->pData);
+}
+
+/*
+** Free all PgHdr objects stored in the Pager.pMmapFreelist list.
+*/
+static void pagerFreeMapHdrs(Pager *pPager){
+  PgHdr *p;
+  PgHdr *pNext;
+  for(p=pPager->pMmapFreelist; p; p=pNext){
+    pNext = p->pDirty;
+    sqlite3_free(p);
+  }
+}
+#else
+# define pagerFreeMapHdrs(x)
+#endif /* PAGER_MAPPAGES */
+
+#ifndef SQLITE_OMIT_WAL
+/*
+** Obtain a read-only reference to page pgno from the shared WAL page
+** cache.  If the page is not already cached, it is read from frame iFrame
+** of the WAL, or from the database file if iFrame is zero, and added to
+** the shared cache.  If successful, set *ppPage to the new page reference
+** and return SQLITE_OK.
+**
+** If the shared cache is not in use for this database, or if the page
+** cannot be added to it, set *ppPage to zero and return SQLITE_OK.  The
+** caller then reads the page into the private page cache as usual.  If
+** an IO error occurs, an error code is returned.
+*/
+static int pagerAcquireSharedPage(
+  Pager *pPager,                  /* Pager object */
+  Pgno pgno,                      /* Page number */
+  u32 iFrame,                     /* Frame containing page, or 0 */
+  PgHdr **ppPage                  /* OUT: Acquired page object */
+){
+  int pgsz = pPager->pageSize;    /* Number of bytes to read */
+  WalCacheKey key;                /* Shared cache key for this page */
+  void *pData;                    /* Shared page content */
+  int rc = SQLITE_OK;             /* Return code */
+
+  *ppPage = 0;
+  if( !sqlite3WalCachePageKey(pPager->pWal, iFrame, &key) ) return SQLITE_OK;
+
+  pData = sqlite3WalCacheFetch(pgno, &key, pgsz);
+  if( pData ){
+    pPager->aStat[PAGER_STAT_HIT]++;
+  }else{
+    pData = sqlite3WalCacheAlloc(pgno, &key, pgsz);
+    if( pData==0 ) return SQLITE_OK;
+    if( iFrame ){
+      rc = sqlite3WalReadFrame(pPager->pWal, iFrame, pgsz, (u8*)pData);
+    }else{
+      rc = sqlite3OsRead(pPager->fd, pData, pgsz, (pgno-1)*(i64)pgsz);
+      if( rc==SQLITE_IOERR_SHORT_READ ){
+        rc = SQLITE_OK;
+      }
+    }
+    if( rc!=SQLITE_OK ){
+      sqlite3WalCacheDiscard(pData);
+      return rc;
+    }
+    pPager->aStat[PAGER_STAT_MISS]++;
+    pPager->aStat[PAGER_STAT_READ] += pgsz;
+    PAGER_INCR(sqlite3_pager_readdb_count);
+    PAGER_INCR(pPager->nRead);
+    IOTRACE(("PGIN %p %d\n", pPager, pgno));
+    pData = sqlite3WalCacheInsert(pData);
+  }
+  return pagerAcquireMapPage(pPager, pgno, pData, PGHDR_MMAP|PGHDR_SHARED, ppPage);
+}
+#endif /* SQLITE_OMIT_WAL */
+
 /*
 ** Adjust the robustness of the database to damage due to OS crashes
 ** or power failures by changing the number of syncs()s when writing
@@ -3771,6 +3992,8 @@ int sqlite3PagerClose(Pager *pPager){
   enable_simulated_io_errors();
   PAGERTRACE(("CLOSE %d\n", PAGERID(pPager)));
   IOTRACE(("CLOSE %p\n", pPager))
+  assert( pPager->nMmapOut==0 );
+  pagerFreeMapHdrs(pPager);
   sqlite3OsClose(pPager->jfd);
   sqlite3OsClose(pPager->fd);
   sqlite3PageFree(pTmp);
@@ -4523,6 +4746,8 @@ int sqlite3PagerOpen(
   pPager->journalSizeLimit = SQLITE_DEFAULT_JOURNAL_SIZE_LIMIT;
   assert( isOpen(pPager->fd) || tempFile );
   setSectorSize(pPager);
+  pPager->szMmap = sqlite3GlobalConfig.szMmap;
+  pagerFixMaplimit(pPager);
   if( !useJournal ){
     pPager->journalMode = PAGER_JOURNALMODE_OFF;
   }else if( memDb ){
@@ -4858,6 +5083,16 @@ int sqlite3PagerSharedLock(Pager *pPager){
 
       if( memcmp(pPager->dbFileVers, dbFileVers, sizeof(dbFileVers))!=0 ){
         pager_reset(pPager);
+
+        /* Unmap the database file. It is possible that external processes
+        ** may have truncated the database file and then extended it back
+        ** to its original size while this process was not holding a lock.
+        ** In this case there may exist a Pager.pMap mapping that appears
+        ** to be the right size but is not actually valid. Avoid this
+        ** possibility by unmapping the db here. */
+        if( USEFETCH(pPager) ){
+          sqlite3OsUnfetch(pPager->fd, 0, 0);
+        }
       }
     }
 
@@ -4899,7 +5134,7 @@ int sqlite3PagerSharedLock(Pager *pPager){
 ** nothing to rollback, so this routine is a no-op.
 */ 
 static void pagerUnlockIfUnused(Pager *pPager){
-  if( (sqlite3PcacheRefCount(pPager->pPCache)==0) ){
+  if( pPager->nMmapOut==0 && (sqlite3PcacheRefCount(pPager->pPCache)==0) ){
     pagerUnlockAndRollback(pPager);
   }
 }
@@ -4926,8 +5161,9 @@ static void pagerUnlockIfUnused(Pager *pPager){
 ** actual disk read occurs. In this case the memory image of the 
 ** page is initialized to all zeros. 
 **
-** If noContent is true, it means that we do not care about the contents
-** of the page. This occurs in two seperate scenarios:
+** If the PAGER_ACQUIRE_NOCONTENT bit is set in flags, it means that we
+** do not care about the contents of the page. This occurs in two seperate
+** scenarios:
 **
 **   a) When reading a free-list leaf page from the database, and
 **
@@ -4935,14 +5171,21 @@ static void pagerUnlockIfUnused(Pager *pPager){
 **      a new page into the cache to be filled with the data read
 **      from the savepoint journal.
 **
-** If noContent is true, then the data returned is zeroed instead of
-** being read from the database. Additionally, the bits corresponding
+** If PAGER_ACQUIRE_NOCONTENT is set, then the data returned is zeroed
+** instead of being read from the database. Additionally, the bits corresponding
 ** to pgno in Pager.pInJournal (bitvec of pages already written to the
 ** journal file) and the PagerSavepoint.pInSavepoint bitvecs of any open
 ** savepoints are set. This means if the page is made writable at any
 ** point in the future, using a call to sqlite3PagerWrite(), its contents
 ** will not be journaled. This saves IO.
 **
+** If the PAGER_ACQUIRE_READONLY bit is set in flags, the caller promises
+** not to call sqlite3PagerWrite() on the returned page. In that case the
+** page may be returned as a pointer directly into a memory mapping of the
+** database file (see SQLITE_FCNTL_MMAP_SIZE) instead of being copied into
+** the page cache. Such pages are never returned for page 1, or while a
+** codec is attached to the pager.
+**
 ** The acquisition might fail for several reasons.  In all cases,
 ** an appropriate error code is returned and *ppPage is set to NULL.
 **
@@ -4958,13 +5201,37 @@ int sqlite3PagerAcquire(
   Pager *pPager,      /* The pager open on the database file */
   Pgno pgno,          /* Page number to fetch */
   DbPage **ppPage,    /* Write a pointer to the page here */
-  int noContent       /* Do not bother reading content from disk if true */
+  int flags           /* PAGER_ACQUIRE_XXX flags */
 ){
-  int rc;
-  PgHdr *pPg;
+  int rc = SQLITE_OK;
+  PgHdr *pPg = 0;
+  u32 iFrame = 0;                 /* Frame to read from WAL file */
+  const int noContent = (flags & PAGER_ACQUIRE_NOCONTENT);
+
+  /* It is acceptable to use a read-only (mmap) page for any page except
+  ** page 1 if there is no write-transaction open or the ACQUIRE_READONLY
+  ** flag was specified by the caller. And so long as the db is not a 
+  ** temporary or in-memory database.  */
+  const int bMmapOk = (pgno!=1 && USEFETCH(pPager)
+   && (pPager->eState==PAGER_READER || (flags & PAGER_ACQUIRE_READONLY))
+#ifdef SQLITE_HAS_CODEC
+   && pPager->xCodec==0
+#endif
+  );
+
+  /* Pages from the shared WAL page cache may be used under the same
+  ** conditions, except that no write-transaction may be open at all.  The
+  ** shared cache must never see frames that have not been committed.  */
+  const int bSharedOk = (pgno!=1 && pagerUseWal(pPager)
+   && pPager->eState==PAGER_READER && !pPager->noReadlock
+#ifdef SQLITE_HAS_CODEC
+   && pPager->xCodec==0
+#endif
+  );
 
   assert( pPager->eState>=PAGER_READER );
   assert( assert_pager_state(pPager) );
+  assert( noContent==0 || (bMmapOk==0 && bSharedOk==0) );
 
   if( pgno==0 ){
     return SQLITE_CORRUPT_BKPT;
@@ -4975,6 +5242,58 @@ int sqlite3PagerAcquire(
   if( pPager->errCode!=SQLITE_OK ){
     rc = pPager->errCode;
   }else{
+
+    if( (bMmapOk || bSharedOk) && pgno<=pPager->dbSize ){
+      if( pagerUseWal(pPager) ){
+        rc = sqlite3WalFindFrame(pPager->pWal, pgno, &iFrame);
+        if( rc!=SQLITE_OK ) goto pager_acquire_err;
+      }
+
+#if SQLITE_MAX_MMAP_SIZE>0
+      if( bMmapOk && iFrame==0 ){
+        void *pData = 0;
+
+        rc = sqlite3OsFetch(pPager->fd, 
+            (i64)(pgno-1) * pPager->pageSize, pPager->pageSize, &pData
+        );
+
+        if( rc==SQLITE_OK && pData ){
+          /* If a write-transaction is open, the page cache may hold a
+          ** newer version of this page than the database file. Prefer
+          ** the cached copy in that case.  */
+          if( pPager->eState>PAGER_READER ){
+            (void)sqlite3PcacheFetch(pPager->pPCache, pgno, 0, &pPg);
+          }
+          if( pPg==0 ){
+            rc = pagerAcquireMapPage(pPager, pgno, pData, PGHDR_MMAP, &pPg);
+          }else{
+            sqlite3OsUnfetch(pPager->fd, (i64)(pgno-1)*pPager->pageSize, pData);
+          }
+          if( pPg ){
+            assert( rc==SQLITE_OK );
+            pPager->aStat[PAGER_STAT_HIT]++;
+            *ppPage = pPg;
+            return SQLITE_OK;
+          }
+        }
+        if( rc!=SQLITE_OK ){
+          goto pager_acquire_err;
+        }
+      }
+#endif
+
+#ifndef SQLITE_OMIT_WAL
+      if( bSharedOk ){
+        rc = pagerAcquireSharedPage(pPager, pgno, iFrame, &pPg);
+        if( rc!=SQLITE_OK ) goto pager_acquire_err;
+        if( pPg ){
+          *ppPage = pPg;
+          return SQLITE_OK;
+        }
+      }
+#endif
+    }
+
     rc = sqlite3PcacheFetch(pPager->pPCache, pgno, 1, ppPage);
   }
 
@@ -4992,14 +5311,14 @@ int sqlite3PagerAcquire(
     /* In this case the pcache already contains an initialized copy of
     ** the page. Return without further ado.  */
     assert( pgno<=PAGER_MAX_PGNO && pgno!=PAGER_MJ_PGNO(pPager) );
-    PAGER_INCR(pPager->nHit);
+    pPager->aStat[PAGER_STAT_HIT]++;
     return SQLITE_OK;
 
   }else{
     /* The pager cache has created a new page. Its content needs to 
     ** be initialized.  */
 
-    PAGER_INCR(pPager->nMiss);
+    pPager->aStat[PAGER_STAT_MISS]++;
     pPg = *ppPage;
     pPg->pPager = pPager;
 
@@ -5034,8 +5353,12 @@ int sqlite3PagerAcquire(
       memset(pPg->pData, 0, pPager->pageSize);
       IOTRACE(("ZERO %p %d\n", pPager, pgno));
     }else{
+      if( pagerUseWal(pPager) && bMmapOk==0 && bSharedOk==0 ){
+        rc = sqlite3WalFindFrame(pPager->pWal, pgno, &iFrame);
+        if( rc!=SQLITE_OK ) goto pager_acquire_err;
+      }
       assert( pPg->pPager==pPager );
-      rc = readDbPage(pPg);
+      rc = readDbPage(pPg, iFrame);
       if( rc!=SQLITE_OK ){
         goto pager_acquire_err;
       }
@@ -5088,7 +5411,17 @@ DbPage *sqlite3PagerLookup(Pager *pPager, Pgno pgno){
 void sqlite3PagerUnref(DbPage *pPg){
   if( pPg ){
     Pager *pPager = pPg->pPager;
-    sqlite3PcacheRelease(pPg);
+#if PAGER_MAPPAGES
+    if( pPg->flags & PGHDR_MMAP ){
+      assert( pPg->nRef>0 );
+      if( --pPg->nRef==0 ){
+        pagerReleaseMapPage(pPg);
+      }
+    }else
+#endif
+    {
+      sqlite3PcacheRelease(pPg);
+    }
     pagerUnlockIfUnused(pPager);
   }
 }
@@ -5317,6 +5650,7 @@ static int pager_write(PgHdr *pPg){
        || pPager->eState==PAGER_WRITER_DBMOD
   );
   assert( assert_pager_state(pPager) );
+  assert( (pPg->flags & PGHDR_MMAP)==0 );
 
   /* If an error has been previously detected, report the same error
   ** again. This should not happen, but the check provides robustness. */
@@ -5455,6 +5789,7 @@ int sqlite3PagerWrite(DbPage *pDbPage){
   Pager *pPager = pPg->pPager;
   Pgno nPagePerSector = (pPager->sectorSize/pPager->pageSize);
 
+  assert( (pPg->flags & PGHDR_MMAP)==0 );
   assert( pPager->eState>=PAGER_WRITER_LOCKED );
   assert( pPager->eState!=PAGER_ERROR );
   assert( assert_pager_state(pPager) );
@@ -6092,8 +6427,8 @@ int *sqlite3PagerStats(Pager *pPager){
   a[3] = pPager->eState==PAGER_OPEN ? -1 : (int) pPager->dbSize;
   a[4] = pPager->eState;
   a[5] = pPager->errCode;
-  a[6] = pPager->nHit;
-  a[7] = pPager->nMiss;
+  a[6] = pPager->aStat[PAGER_STAT_HIT];
+  a[7] = pPager->aStat[PAGER_STAT_MISS];
   a[8] = 0;  /* Used to be pPager->nOvfl */
   a[9] = pPager->nRead;
   a[10] = pPager->nWrite;
@@ -6108,6 +6443,20 @@ int sqlite3PagerIsMemdb(Pager *pPager){
   return MEMDB;
 }
 
+/*
+** Return one of the running totals kept by pager pPager: the number of
+** page requests satisfied without reading from the database file or WAL
+** (PAGER_STAT_HIT), the number that were not (PAGER_STAT_MISS) and the
+** number of bytes read (PAGER_STAT_READ).  Pages served from the memory
+** mapping or the shared WAL page cache count as hits.  The totals wrap
+** around on overflow, so callers should only use the difference between
+** two values.
+*/
+u32 sqlite3PagerCacheStat(Pager *pPager, int eStat){
+  assert( eStat>=0 && eStat<ArraySize(pPager->aStat) );
+  return pPager->aStat[eStat];
+}
+
 /*
 ** Check that there are at least nSavepoint savepoints open. If there are
 ** currently less than nSavepoints open, then open one or more savepoints
@@ -6299,6 +6648,7 @@ void sqlite3PagerSetCodec(
   pPager->xCodecFree = xCodecFree;
   pPager->pCodec = pCodec;
   pagerReportSize(pPager);
+  pagerFixMaplimit(pPager);
 }
 void *sqlite3PagerGetCodec(Pager *pPager){
   return pPager->pCodec;
@@ -6666,17 +7016,34 @@ int sqlite3PagerCheckpoint(Pager *pPager, int eMode, int *pnLog, int *pnCkpt){
   if( pPager->pWal ){
     rc = sqlite3WalCheckpoint(pPager->pWal, eMode,
         pPager->xBusyHandler, pPager->pBusyHandlerArg,
-        pPager->ckptSyncFlags, pPager->pageSize, (u8 *)pPager->pTmpSpace,
-        pnLog, pnCkpt
+        pPager->ckptSyncFlags, pPager->nCkptBatch, pPager->pageSize,
+        (u8 *)pPager->pTmpSpace, pnLog, pnCkpt
     );
   }
   return rc;
 }
 
+/*
+** Limit the number of frames copied into the database file by each
+** subsequent call to sqlite3PagerCheckpoint() to nBatch.  Zero or a
+** negative value removes the limit.
+*/
+void sqlite3PagerCheckpointBatch(Pager *pPager, int nBatch){
+  pPager->nCkptBatch = nBatch>0 ? nBatch : 0;
+}
+
 int sqlite3PagerWalCallback(Pager *pPager){
   return sqlite3WalCallback(pPager->pWal);
 }
 
+/*
+** Return the number of frames in the WAL file that have not yet been
+** checkpointed, or zero if the pager is not in WAL mode.
+*/
+int sqlite3PagerWalBacklog(Pager *pPager){
+  return sqlite3WalBacklog(pPager->pWal);
+}
+
 /*
 ** Return true if the underlying VFS for the given pager supports the
 ** primitives necessary for write-ahead logging.
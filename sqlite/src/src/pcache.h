@@ -51,6 +51,9 @@ struct PgHdr {
 #define PGHDR_NEED_READ         0x008  /* Content is unread */
 #define PGHDR_REUSE_UNLIKELY    0x010  /* A hint that reuse is unlikely */
 #define PGHDR_DONT_WRITE        0x020  /* Do not write content to disk */
+#define PGHDR_MMAP              0x040  /* This is an mmap page object */
+#define PGHDR_SHARED            0x080  /* Content is from the shared WAL
+                                       ** page cache (also sets PGHDR_MMAP) */
 
 /* Initialize and shutdown the page cache subsystem */
 int sqlite3PcacheInitialize(void);
@@ -701,6 +701,91 @@ void sqlite3Pragma(
     }
   }else
 
+  /*
+  **  PRAGMA [database.]mmap_size(N)
+  **
+  ** Used to set the maximum number of bytes of the database file that
+  ** will be accessed using memory-mapped I/O.  If N is negative, the
+  ** compile-time (or SQLITE_CONFIG_MMAP_SIZE) default is used.  If N is
+  ** zero, memory-mapped I/O is disabled.  If no database name is given,
+  ** the limit applies to all attached databases and to databases
+  ** attached later.  The first form returns the current limit, which
+  ** may be smaller than requested if it exceeds SQLITE_MAX_MMAP_SIZE.
+  */
+  if( sqlite3StrICmp(zLeft,"mmap_size")==0 ){
+    sqlite3_int64 sz;
+    int rc;
+#if SQLITE_MAX_MMAP_SIZE>0
+    assert( sqlite3SchemaMutexHeld(db, iDb, 0) );
+    if( zRight ){
+      int ii;
+      sqlite3Atoi64(zRight, &sz, sqlite3Strlen30(zRight), SQLITE_UTF8);
+      if( sz<0 ) sz = sqlite3GlobalConfig.szMmap;
+      if( pId2->n==0 ) db->szMmap = sz;
+      for(ii=db->nDb-1; ii>=0; ii--){
+        if( db->aDb[ii].pBt && (ii==iDb || pId2->n==0) ){
+          sqlite3BtreeSetMmapLimit(db->aDb[ii].pBt, sz);
+        }
+      }
+    }
+    sz = -1;
+    rc = sqlite3_file_control(db, zDb, SQLITE_FCNTL_MMAP_SIZE, &sz);
+#else
+    sz = 0;
+    rc = SQLITE_OK;
+#endif
+    if( rc==SQLITE_OK ){
+      returnSingleInt(pParse, "mmap_size", sz);
+    }else if( rc!=SQLITE_NOTFOUND ){
+      pParse->nErr++;
+      pParse->rc = rc;
+    }
+  }else
+
+  /*
+  **   PRAGMA threads
+  **   PRAGMA threads = N
+  **
+  ** Configure the maximum number of worker threads that the external
+  ** merge sorter may use to sort and write out runs in the background.
+  ** The value is clamped to SQLITE_MAX_WORKER_THREADS.  Zero means that
+  ** all sorting is done by the thread that calls sqlite3_step().
+  */
+  if( sqlite3StrICmp(zLeft, "threads")==0 ){
+    if( zRight ){
+      sqlite3_limit(db, SQLITE_LIMIT_WORKER_THREADS, sqlite3Atoi(zRight));
+    }
+    returnSingleInt(pParse, "threads",
+                    sqlite3_limit(db, SQLITE_LIMIT_WORKER_THREADS, -1));
+  }else
+
+  /*
+  **   PRAGMA bulk_load
+  **   PRAGMA bulk_load = N
+  **
+  ** While N is non-zero, tables and indexes written by this connection
+  ** are bulk-loaded: when an entry is appended to the right-hand edge of
+  ** a b-tree (as by inserts in ascending rowid order, CREATE INDEX,
+  ** INSERT INTO ... SELECT * and VACUUM), pages are filled to N percent
+  ** and a new page started, instead of being rebalanced with their
+  ** siblings.  N is clamped to the range 50 to 100.  Zero, the default,
+  ** turns bulk-loading off.
+  */
+  if( sqlite3StrICmp(zLeft, "bulk_load")==0 ){
+    if( zRight ){
+      int n = sqlite3Atoi(zRight);
+      if( n<=0 ){
+        n = 0;
+      }else if( n<50 ){
+        n = 50;
+      }else if( n>100 ){
+        n = 100;
+      }
+      db->nBulkFill = (u8)n;
+    }
+    returnSingleInt(pParse, "bulk_load", db->nBulkFill);
+  }else
+
   /*
   **   PRAGMA temp_store
   **   PRAGMA temp_store = "default"|"memory"|"file"
@@ -1385,6 +1470,27 @@ void sqlite3Pragma(
   }else
 #endif /* SQLITE_OMIT_COMPILEOPTION_DIAGS */
 
+#ifndef SQLITE_OMIT_STMT_PROFILE
+  /*
+  **   PRAGMA stmt_profile
+  **   PRAGMA stmt_profile = N
+  **
+  ** While N is non-zero, this connection records the number of times each
+  ** VDBE instruction is executed and the time it takes, along with page
+  ** cache and b-tree statistics, for up to N distinct SQL statements.
+  ** The records are read (and deleted) through the stmt_profile virtual
+  ** table.  Zero, the default, stops recording without discarding the
+  ** records already made.
+  */
+  if( sqlite3StrICmp(zLeft, "stmt_profile")==0 ){
+    if( zRight ){
+      int n = sqlite3Atoi(zRight);
+      db->nStmtProfile = n>0 ? n : 0;
+    }
+    returnSingleInt(pParse, "stmt_profile", db->nStmtProfile);
+  }else
+#endif /* SQLITE_OMIT_STMT_PROFILE */
+
 #ifndef SQLITE_OMIT_WAL
   /*
   **   PRAGMA [database.]wal_checkpoint = passive|full|restart
@@ -1428,6 +1534,23 @@ void sqlite3Pragma(
        db->xWalCallback==sqlite3WalDefaultHook ? 
            SQLITE_PTR_TO_INT(db->pWalArg) : 0);
   }else
+
+  /*
+  **   PRAGMA wal_background_checkpoint
+  **   PRAGMA wal_background_checkpoint = N
+  **
+  ** Configure a database connection to checkpoint a database on a
+  ** background thread after accumulating N frames in the log.  Or query
+  ** for the current value of N.
+  */
+  if( sqlite3StrICmp(zLeft, "wal_background_checkpoint")==0 ){
+    if( zRight ){
+      sqlite3_wal_background_checkpoint(db, sqlite3Atoi(zRight), 0);
+    }
+    returnSingleInt(pParse, "wal_background_checkpoint", 
+       db->xWalCallback==sqlite3WalCkptHook ? 
+           sqlite3WalCkptFrames(db->pWalArg) : 0);
+  }else
 #endif
 
 #if defined(SQLITE_DEBUG) || defined(SQLITE_TEST)
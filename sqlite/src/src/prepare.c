@@ -776,6 +776,73 @@ int sqlite3_prepare_v2(
 }
 
 
+/*
+** Prepare a statement using the statement cache of connection db.  If
+** the cache holds an idle statement compiled from the first SQL statement
+** in zSql, return it.  Otherwise compile a new statement and mark it so
+** that sqlite3_finalize() returns it to the cache.
+*/
+static int sqlite3CachedPrepare(
+  sqlite3 *db,              /* Database handle. */
+  const char *zSql,         /* UTF-8 encoded SQL statement. */
+  int nBytes,               /* Length of zSql in bytes. */
+  sqlite3_stmt **ppStmt,    /* OUT: A pointer to the prepared statement */
+  const char **pzTail       /* OUT: End of parsed string */
+){
+  int rc = SQLITE_OK;
+  Vdbe *p;
+  assert( ppStmt!=0 );
+  *ppStmt = 0;
+  if( !sqlite3SafetyCheckOk(db) ){
+    return SQLITE_MISUSE_BKPT;
+  }
+  sqlite3_mutex_enter(db->mutex);
+  p = sqlite3VdbeCacheFind(db, zSql, nBytes, pzTail);
+  if( p ){
+    *ppStmt = (sqlite3_stmt*)p;
+  }else{
+    sqlite3_int64 iStart = 0;
+    sqlite3_int64 iEnd = 0;
+    sqlite3OsCurrentTimeInt64(db->pVfs, &iStart);
+    rc = sqlite3LockAndPrepare(db, zSql, nBytes, 1, 0, ppStmt, pzTail);
+    p = (Vdbe*)*ppStmt;
+    if( p && sqlite3_sql(*ppStmt) ){
+      StmtCache *pCache = &db->stmtCache;
+      sqlite3OsCurrentTimeInt64(db->pVfs, &iEnd);
+      sqlite3VdbeSetCached(p);
+      pCache->nMiss++;
+      if( iEnd>=iStart ){
+        pCache->nCompile++;
+        pCache->iCompileTime += iEnd - iStart;
+      }
+    }
+  }
+  sqlite3_mutex_leave(db->mutex);
+  return rc;
+}
+
+/*
+** The same as sqlite3_prepare_v2() except that it takes a mask of
+** CHROMIUM_SQLITE_PREPARE_* flags.
+*/
+int chromium_sqlite3_prepare(
+  sqlite3 *db,              /* Database handle. */
+  const char *zSql,         /* UTF-8 encoded SQL statement. */
+  int nBytes,               /* Length of zSql in bytes. */
+  unsigned int prepFlags,   /* Zero or more CHROMIUM_SQLITE_PREPARE_* flags */
+  sqlite3_stmt **ppStmt,    /* OUT: A pointer to the prepared statement */
+  const char **pzTail       /* OUT: End of parsed string */
+){
+  int rc;
+  if( prepFlags & CHROMIUM_SQLITE_PREPARE_CACHED ){
+    rc = sqlite3CachedPrepare(db,zSql,nBytes,ppStmt,pzTail);
+  }else{
+    rc = sqlite3LockAndPrepare(db,zSql,nBytes,1,0,ppStmt,pzTail);
+  }
+  assert( rc==SQLITE_OK || ppStmt==0 || *ppStmt==0 );  /* VERIFY: F13021 */
+  return rc;
+}
+
 #ifndef SQLITE_OMIT_UTF16
 /*
 ** Compile the UTF-16 encoded SQL statement zSql into a statement handle.
@@ -623,6 +623,8 @@ typedef struct RowSet RowSet;
 typedef struct Savepoint Savepoint;
 typedef struct Select Select;
 typedef struct SrcList SrcList;
+typedef struct StmtCache StmtCache;
+typedef struct StmtProfiler StmtProfiler;
 typedef struct StrAccum StrAccum;
 typedef struct Table Table;
 typedef struct TableLock TableLock;
@@ -724,7 +726,7 @@ struct Schema {
 ** The number of different kinds of things that can be limited
 ** using the sqlite3_limit() interface.
 */
-#define SQLITE_N_LIMIT (SQLITE_LIMIT_TRIGGER_DEPTH+1)
+#define SQLITE_N_LIMIT (SQLITE_LIMIT_WORKER_THREADS+1)
 
 /*
 ** Lookaside malloc is a set of fixed-size buffers that can be used
@@ -761,6 +763,29 @@ struct LookasideSlot {
   LookasideSlot *pNext;    /* Next buffer in the list of free buffers */
 };
 
+/*
+** The StmtCache structure holds the statements prepared with the
+** CHROMIUM_SQLITE_PREPARE_CACHED flag that the application has finalized, so
+** that a later chromium_sqlite3_prepare() of the same SQL text can return one
+** of them instead of compiling the SQL again.  The idle statements are linked
+** by Vdbe.pCacheNext and Vdbe.pCachePrev, most recently used first.
+**
+** The time spent compiling statements for the cache is measured with the
+** millisecond VFS clock.  Each hit adds the average compile time so far to
+** iSaved, the estimate reported by SQLITE_DBSTATUS_STMTCACHE_SAVED.
+*/
+struct StmtCache {
+  int nMax;               /* Maximum number of idle statements to keep */
+  int nStmt;              /* Number of idle statements in the list */
+  Vdbe *pFirst;           /* Most recently used idle statement */
+  Vdbe *pLast;            /* Least recently used idle statement */
+  int nHit;               /* Prepares satisfied from the cache */
+  int nMiss;              /* Prepares that compiled a new statement */
+  int nCompile;           /* Number of compilations timed in iCompileTime */
+  i64 iCompileTime;       /* Total time spent compiling, in ms */
+  i64 iSaved;             /* Estimated compile time saved, in us */
+};
+
 /*
 ** A hash table for function definitions.
 **
@@ -812,6 +837,8 @@ struct sqlite3 {
   signed char nextAutovac;      /* Autovac setting after VACUUM if >=0 */
   u8 suppressErr;               /* Do not issue error messages if true */
   int nextPagesize;             /* Pagesize after VACUUM if >0 */
+  i64 szMmap;                   /* Default mmap_size setting */
+  u8 nBulkFill;                 /* Fill factor for PRAGMA bulk_load, or 0 */
   int nTable;                   /* Number of tables in the database */
   CollSeq *pDfltColl;           /* The default collating sequence (BINARY) */
   i64 lastRowid;                /* ROWID of most recent insert (see above) */
@@ -845,6 +872,7 @@ struct sqlite3 {
 #ifndef SQLITE_OMIT_WAL
   int (*xWalCallback)(void *, sqlite3 *, const char *, int);
   void *pWalArg;
+  int aWalStat[3][2];           /* WAL_SIZE, CKPT_LAG and CKPT_STALL status */
 #endif
   void(*xCollNeeded)(void*,sqlite3*,int eTextRep,const char*);
   void(*xCollNeeded16)(void*,sqlite3*,int eTextRep,const void*);
@@ -857,6 +885,11 @@ struct sqlite3 {
     double notUsed1;            /* Spacer */
   } u1;
   Lookaside lookaside;          /* Lookaside malloc configuration */
+  StmtCache stmtCache;          /* Idle cached statements */
+#ifndef SQLITE_OMIT_STMT_PROFILE
+  int nStmtProfile;             /* Value of PRAGMA stmt_profile */
+  StmtProfiler *pStmtProfiler;  /* Statement profiles, or NULL */
+#endif
 #ifndef SQLITE_OMIT_AUTHORIZATION
   int (*xAuth)(void*,int,const char*,const char*,const char*,const char*);
                                 /* Access authorization function */
@@ -2057,6 +2090,7 @@ struct Select {
 #define SF_UsesEphemeral   0x0008  /* Uses the OpenEphemeral opcode */
 #define SF_Expanded        0x0010  /* sqlite3SelectExpand() called on this */
 #define SF_HasTypeInfo     0x0020  /* FROM subqueries have Table metadata */
+#define SF_UseSorter       0x0040  /* Sort using a sorter */
 
 
 /*
@@ -2437,6 +2471,10 @@ struct Sqlite3Config {
   int nPage;                        /* Number of pages in pPage[] */
   int mxParserStack;                /* maximum depth of the parser stack */
   int sharedCacheEnabled;           /* true if shared-cache mode enabled */
+  sqlite3_int64 szMmap;             /* mmap() space per open file */
+  sqlite3_int64 mxMmap;             /* Maximum value for szMmap */
+  u32 szPma;                        /* Minimum sorter PMA size, in pages */
+  sqlite3_int64 szWalCache;         /* Shared WAL page cache budget, in bytes */
   /* The above might be initialized to non-zero.  The following need to always
   ** initially be zero, however. */
   int isInit;                       /* True after initialization has finished */
@@ -2621,6 +2659,19 @@ int sqlite3StatusValue(int);
 void sqlite3StatusAdd(int, int);
 void sqlite3StatusSet(int, int);
 
+#ifndef SQLITE_OMIT_WAL
+  int sqlite3WalCacheInitialize(void);
+  void sqlite3WalCacheShutdown(void);
+#else
+# define sqlite3WalCacheInitialize() SQLITE_OK
+# define sqlite3WalCacheShutdown()
+#endif
+#if defined(SQLITE_ENABLE_MEMORY_MANAGEMENT) && !defined(SQLITE_OMIT_WAL)
+  int sqlite3WalCacheReleaseMemory(int);
+#else
+# define sqlite3WalCacheReleaseMemory(X) 0
+#endif
+
 #ifndef SQLITE_OMIT_FLOATING_POINT
   int sqlite3IsNaN(double);
 #else
@@ -3084,6 +3135,18 @@ VTable *sqlite3GetVTable(sqlite3*, Table*);
 const char *sqlite3JournalModename(int);
 int sqlite3Checkpoint(sqlite3*, int, int, int*, int*);
 int sqlite3WalDefaultHook(void*,sqlite3*,const char*,int);
+void *sqlite3WalCkptCreate(sqlite3*,int,int);
+void sqlite3WalCkptDestroy(void*);
+int sqlite3WalCkptFrames(void*);
+int sqlite3WalCkptHook(void*,sqlite3*,const char*,int);
+#ifndef SQLITE_OMIT_STMT_PROFILE
+  void sqlite3StmtProfileClose(sqlite3*);
+# ifndef SQLITE_OMIT_VIRTUALTABLE
+  int sqlite3StmtProfileInit(sqlite3*);
+# endif
+#else
+# define sqlite3StmtProfileClose(X)
+#endif
 
 /* Declarations for functions in fkey.c. All of these are replaced by
 ** no-op macros if OMIT_FOREIGN_KEY is defined. In this case no foreign
@@ -116,6 +116,78 @@
 # define SQLITE_DEFAULT_WAL_AUTOCHECKPOINT  1000
 #endif
 
+/*
+** The default number of frames copied into the database file by each
+** step of a background checkpoint (see sqlite3_wal_background_checkpoint()).
+*/
+#ifndef SQLITE_DEFAULT_CHECKPOINT_BATCH
+# define SQLITE_DEFAULT_CHECKPOINT_BATCH  100
+#endif
+
+/*
+** The default maximum number of idle statements kept by the statement
+** cache of each database connection (see CHROMIUM_SQLITE_PREPARE_CACHED).
+*/
+#ifndef SQLITE_DEFAULT_STMT_CACHE_SIZE
+# define SQLITE_DEFAULT_STMT_CACHE_SIZE  16
+#endif
+
+/*
+** The maximum number of bytes of a database file that may be memory
+** mapped for reading (SQLITE_MAX_MMAP_SIZE), and the default value of
+** PRAGMA mmap_size (SQLITE_DEFAULT_MMAP_SIZE).  Memory-mapped I/O is only
+** implemented by the unix VFS, so the maximum defaults to zero on other
+** platforms.  The default of zero means that memory mapping is off unless
+** it is enabled at runtime.
+*/
+#ifndef SQLITE_MAX_MMAP_SIZE
+# if defined(__linux__) || (defined(__APPLE__) && defined(__MACH__))
+#   define SQLITE_MAX_MMAP_SIZE 0x7fff0000  /* 2147418112 */
+# else
+#   define SQLITE_MAX_MMAP_SIZE 0
+# endif
+#endif
+#ifndef SQLITE_DEFAULT_MMAP_SIZE
+# define SQLITE_DEFAULT_MMAP_SIZE 0
+#endif
+#if SQLITE_DEFAULT_MMAP_SIZE>SQLITE_MAX_MMAP_SIZE
+# undef SQLITE_DEFAULT_MMAP_SIZE
+# define SQLITE_DEFAULT_MMAP_SIZE SQLITE_MAX_MMAP_SIZE
+#endif
+
+/*
+** The maximum number of auxiliary threads that the external merge sorter
+** may use to sort and write out runs (SQLITE_MAX_WORKER_THREADS), and the
+** default value of PRAGMA threads (SQLITE_DEFAULT_WORKER_THREADS).  Worker
+** threads are only used by threadsafe builds on unix.
+**
+** SQLITE_SORTER_PMASZ is the default minimum amount of memory, in pages,
+** that the sorter accumulates before sorting it and writing it out to a
+** temporary file.  See also SQLITE_CONFIG_PMASZ.
+*/
+#ifndef SQLITE_MAX_WORKER_THREADS
+# define SQLITE_MAX_WORKER_THREADS 8
+#endif
+#ifndef SQLITE_DEFAULT_WORKER_THREADS
+# define SQLITE_DEFAULT_WORKER_THREADS 0
+#endif
+#if SQLITE_DEFAULT_WORKER_THREADS>SQLITE_MAX_WORKER_THREADS
+# undef SQLITE_DEFAULT_WORKER_THREADS
+# define SQLITE_DEFAULT_WORKER_THREADS SQLITE_MAX_WORKER_THREADS
+#endif
+#ifndef SQLITE_SORTER_PMASZ
+# define SQLITE_SORTER_PMASZ 250
+#endif
+
+/*
+** The default amount of memory, in bytes, that the process-wide shared
+** page cache for WAL databases may use.  Zero disables the shared cache.
+** See also SQLITE_CONFIG_WALCACHE.
+*/
+#ifndef SQLITE_DEFAULT_WALCACHE_SIZE
+# define SQLITE_DEFAULT_WALCACHE_SIZE 0
+#endif
+
 /*
 ** The maximum number of attached databases.  This must be between 0
 ** and 62.  The upper bound on 62 is because a 64-bit integer bitmap
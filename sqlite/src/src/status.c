@@ -21,8 +21,8 @@
 */
 typedef struct sqlite3StatType sqlite3StatType;
 static SQLITE_WSD struct sqlite3StatType {
-  int nowValue[10];         /* Current value */
-  int mxValue[10];          /* Maximum value */
+  int nowValue[11];         /* Current value */
+  int mxValue[11];          /* Maximum value */
 } sqlite3Stat = { {0,}, {0,} };
 
 
@@ -132,6 +132,60 @@ int sqlite3_db_status(
       break;
     }
 
+    /*
+    ** The WAL statistics are updated by doWalCallbacks() each time a
+    ** transaction is committed to a WAL database.
+    */
+    case SQLITE_DBSTATUS_WAL_SIZE:
+    case SQLITE_DBSTATUS_CKPT_LAG:
+    case SQLITE_DBSTATUS_CKPT_STALL: {
+#ifndef SQLITE_OMIT_WAL
+      int *aStat = db->aWalStat[op - SQLITE_DBSTATUS_WAL_SIZE];
+      testcase( op==SQLITE_DBSTATUS_WAL_SIZE );
+      testcase( op==SQLITE_DBSTATUS_CKPT_LAG );
+      testcase( op==SQLITE_DBSTATUS_CKPT_STALL );
+      assert( (op-SQLITE_DBSTATUS_WAL_SIZE)<ArraySize(db->aWalStat) );
+      *pCurrent = aStat[0];
+      *pHighwater = aStat[1];
+      if( resetFlag ){
+        aStat[1] = aStat[0];
+      }
+#else
+      *pCurrent = 0;
+      *pHighwater = 0;
+#endif
+      break;
+    }
+
+    /*
+    ** Statement cache counters, updated by chromium_sqlite3_prepare() when
+    ** it is called with the CHROMIUM_SQLITE_PREPARE_CACHED flag.
+    */
+    case SQLITE_DBSTATUS_STMTCACHE_HIT:
+    case SQLITE_DBSTATUS_STMTCACHE_MISS: {
+      StmtCache *pCache = &db->stmtCache;
+      int *pCount;
+      testcase( op==SQLITE_DBSTATUS_STMTCACHE_HIT );
+      testcase( op==SQLITE_DBSTATUS_STMTCACHE_MISS );
+      pCount = (op==SQLITE_DBSTATUS_STMTCACHE_HIT) ? &pCache->nHit
+                                                     : &pCache->nMiss;
+      *pCurrent = 0;
+      *pHighwater = *pCount;
+      if( resetFlag ){
+        *pCount = 0;
+      }
+      break;
+    }
+    case SQLITE_DBSTATUS_STMTCACHE_SAVED: {
+      i64 iSaved = db->stmtCache.iSaved;
+      *pCurrent = 0;
+      *pHighwater = iSaved>0x7fffffff ? 0x7fffffff : (int)iSaved;
+      if( resetFlag ){
+        db->stmtCache.iSaved = 0;
+      }
+      break;
+    }
+
     /* 
     ** Return an approximation for the amount of memory currently used
     ** by all pagers associated with the given database connection.  The
@@ -1023,6 +1023,51 @@ static int test_config_memstatus(
   return TCL_OK;
 }
 
+/*
+** Usage:    sqlite3_config_pmasz  NPAGE
+**
+** Set the minimum sorter PMA size using SQLITE_CONFIG_PMASZ.
+*/
+static int test_config_pmasz(
+  void * clientData,
+  Tcl_Interp *interp,
+  int objc,
+  Tcl_Obj *CONST objv[]
+){
+  int nPage, rc;
+  if( objc!=2 ){
+    Tcl_WrongNumArgs(interp, 1, objv, "NPAGE");
+    return TCL_ERROR;
+  }
+  if( Tcl_GetIntFromObj(interp, objv[1], &nPage) ) return TCL_ERROR;
+  rc = sqlite3_config(SQLITE_CONFIG_PMASZ, (unsigned int)nPage);
+  Tcl_SetObjResult(interp, Tcl_NewIntObj(rc));
+  return TCL_OK;
+}
+
+/*
+** Usage:    sqlite3_config_walcache  NBYTE
+**
+** Set the shared WAL page cache budget using SQLITE_CONFIG_WALCACHE.
+*/
+static int test_config_walcache(
+  void * clientData,
+  Tcl_Interp *interp,
+  int objc,
+  Tcl_Obj *CONST objv[]
+){
+  Tcl_WideInt nByte;
+  int rc;
+  if( objc!=2 ){
+    Tcl_WrongNumArgs(interp, 1, objv, "NBYTE");
+    return TCL_ERROR;
+  }
+  if( Tcl_GetWideIntFromObj(interp, objv[1], &nByte) ) return TCL_ERROR;
+  rc = sqlite3_config(SQLITE_CONFIG_WALCACHE, (sqlite3_int64)nByte);
+  Tcl_SetObjResult(interp, Tcl_NewIntObj(rc));
+  return TCL_OK;
+}
+
 /*
 ** Usage:    sqlite3_config_lookaside  SIZE  COUNT
 **
@@ -1094,6 +1139,39 @@ static int test_db_config_lookaside(
   return TCL_OK;
 }
 
+/*
+** Usage:    sqlite3_db_config_stmt_cache  CONNECTION  N
+**
+** Set the maximum number of idle statements kept by the statement cache
+** of CONNECTION to N, or leave it unchanged if N is negative.  Return the
+** new maximum.
+*/
+static int test_db_config_stmt_cache(
+  void * clientData,
+  Tcl_Interp *interp,
+  int objc,
+  Tcl_Obj *CONST objv[]
+){
+  int rc;
+  int nMax;
+  int nRes = -1;
+  sqlite3 *db;
+  int getDbPointer(Tcl_Interp*, const char*, sqlite3**);
+  if( objc!=3 ){
+    Tcl_WrongNumArgs(interp, 1, objv, "CONNECTION N");
+    return TCL_ERROR;
+  }
+  if( getDbPointer(interp, Tcl_GetString(objv[1]), &db) ) return TCL_ERROR;
+  if( Tcl_GetIntFromObj(interp, objv[2], &nMax) ) return TCL_ERROR;
+  rc = sqlite3_db_config(db, SQLITE_DBCONFIG_STMT_CACHE, nMax, &nRes);
+  if( rc!=SQLITE_OK ){
+    Tcl_AppendResult(interp, "sqlite3_db_config failed", (char*)0);
+    return TCL_ERROR;
+  }
+  Tcl_SetObjResult(interp, Tcl_NewIntObj(nRes));
+  return TCL_OK;
+}
+
 /*
 ** Usage:
 **
@@ -1241,6 +1319,7 @@ static int test_status(
     { "SQLITE_STATUS_SCRATCH_SIZE",        SQLITE_STATUS_SCRATCH_SIZE        },
     { "SQLITE_STATUS_PARSER_STACK",        SQLITE_STATUS_PARSER_STACK        },
     { "SQLITE_STATUS_MALLOC_COUNT",        SQLITE_STATUS_MALLOC_COUNT        },
+    { "SQLITE_STATUS_WALCACHE_USED",       SQLITE_STATUS_WALCACHE_USED       },
   };
   Tcl_Obj *pResult;
   if( objc!=3 ){
@@ -1296,7 +1375,13 @@ static int test_db_status(
     { "STMT_USED",           SQLITE_DBSTATUS_STMT_USED           },
     { "LOOKASIDE_HIT",       SQLITE_DBSTATUS_LOOKASIDE_HIT       },
     { "LOOKASIDE_MISS_SIZE", SQLITE_DBSTATUS_LOOKASIDE_MISS_SIZE },
-    { "LOOKASIDE_MISS_FULL", SQLITE_DBSTATUS_LOOKASIDE_MISS_FULL }
+    { "LOOKASIDE_MISS_FULL", SQLITE_DBSTATUS_LOOKASIDE_MISS_FULL },
+    { "WAL_SIZE",            SQLITE_DBSTATUS_WAL_SIZE            },
+    { "CKPT_LAG",            SQLITE_DBSTATUS_CKPT_LAG            },
+    { "CKPT_STALL",          SQLITE_DBSTATUS_CKPT_STALL          },
+    { "STMTCACHE_HIT",       SQLITE_DBSTATUS_STMTCACHE_HIT       },
+    { "STMTCACHE_MISS",      SQLITE_DBSTATUS_STMTCACHE_MISS      },
+    { "STMTCACHE_SAVED",     SQLITE_DBSTATUS_STMTCACHE_SAVED     }
   };
   Tcl_Obj *pResult;
   if( objc!=4 ){
@@ -1421,8 +1506,11 @@ int Sqlitetest_malloc_Init(Tcl_Interp *interp){
      { "sqlite3_config_heap",        test_config_heap              ,0 },
      { "sqlite3_config_memstatus",   test_config_memstatus         ,0 },
      { "sqlite3_config_lookaside",   test_config_lookaside         ,0 },
+     { "sqlite3_config_pmasz",       test_config_pmasz             ,0 },
+     { "sqlite3_config_walcache",    test_config_walcache          ,0 },
      { "sqlite3_config_error",       test_config_error             ,0 },
      { "sqlite3_db_config_lookaside",test_db_config_lookaside      ,0 },
+     { "sqlite3_db_config_stmt_cache",test_db_config_stmt_cache    ,0 },
      { "sqlite3_dump_memsys3",       test_dump_memsys3             ,3 },
      { "sqlite3_dump_memsys5",       test_dump_memsys3             ,5 },
      { "sqlite3_install_memsys3",    test_install_memsys3          ,0 },
@@ -464,6 +464,40 @@ static void registerTrace(FILE *out, int iReg, Mem *p){
 
 #endif
 
+#ifndef SQLITE_OMIT_STMT_PROFILE
+/*
+** Return the clock used to time VDBE instructions for PRAGMA stmt_profile:
+** the CPU time-stamp counter on x86 processors, or a monotonic clock in
+** nanoseconds on other unix systems.  Where neither is available the
+** instructions are counted but not timed.
+*/
+#if defined(__GNUC__) && (defined(__i386__) || defined(__x86_64__))
+static u64 vdbeProfileClock(void){
+  unsigned int lo, hi;
+  __asm__ __volatile__ ("rdtsc" : "=a" (lo), "=d" (hi));
+  return (u64)hi << 32 | lo;
+}
+#elif defined(_MSC_VER) && (defined(_M_IX86) || defined(_M_X64))
+#include <intrin.h>
+static u64 vdbeProfileClock(void){
+  return (u64)__rdtsc();
+}
+#elif SQLITE_OS_UNIX
+#include <time.h>
+static u64 vdbeProfileClock(void){
+#ifdef CLOCK_MONOTONIC
+  struct timespec sNow;
+  if( clock_gettime(CLOCK_MONOTONIC, &sNow)==0 ){
+    return (u64)sNow.tv_sec*1000000000 + sNow.tv_nsec;
+  }
+#endif
+  return 0;
+}
+#else
+# define vdbeProfileClock() ((u64)0)
+#endif
+#endif /* SQLITE_OMIT_STMT_PROFILE */
+
 /*
 ** The CHECK_FOR_INTERRUPT macro defined here looks to see if the
 ** sqlite3_interrupt() routine has been called.  If it has been, then
@@ -567,11 +601,23 @@ int sqlite3VdbeExec(
 #ifdef VDBE_PROFILE
   u64 start;                 /* CPU clock count at start of opcode */
   int origPc;                /* Program counter at start of opcode */
+#endif
+#ifndef SQLITE_OMIT_STMT_PROFILE
+  VdbeOpProfile *aOpProf;    /* Per-instruction counters, or NULL */
+  u64 iProfStart = 0;        /* vdbeProfileClock() at start of opcode */
+  int iProfPc = 0;           /* Instruction of main program being timed */
 #endif
   /*** INSERT STACK UNION HERE ***/
 
   assert( p->magic==VDBE_MAGIC_RUN );  /* sqlite3_step() verifies this */
   sqlite3VdbeEnter(p);
+#ifndef SQLITE_OMIT_STMT_PROFILE
+  aOpProf = 0;
+  if( p->pProf ){
+    sqlite3VdbeProfileEnter(p);
+    aOpProf = p->pProf->aOp;
+  }
+#endif
   if( p->rc==SQLITE_NOMEM ){
     /* This happens if a malloc() inside a call to sqlite3_column_text() or
     ** sqlite3_column_text16() failed.  */
@@ -605,6 +651,20 @@ int sqlite3VdbeExec(
 #ifdef VDBE_PROFILE
     origPc = pc;
     start = sqlite3Hwtime();
+#endif
+#ifndef SQLITE_OMIT_STMT_PROFILE
+    if( aOpProf ){
+      p->pProf->aStat[VDBE_PROF_STEP]++;
+      if( p->pFrame ){
+        VdbeFrame *pFrame;
+        for(pFrame=p->pFrame; pFrame->pParent; pFrame=pFrame->pParent);
+        iProfPc = pFrame->pc;
+      }else{
+        iProfPc = pc;
+        aOpProf[pc].nExec++;
+      }
+      iProfStart = vdbeProfileClock();
+    }
 #endif
     pOp = &aOp[pc];
 
@@ -3004,7 +3064,8 @@ case OP_VerifyCookie: {
 **
 ** This instruction works just like OpenRead except that it opens the cursor
 ** in read/write mode.  For a given table, there can be one or more read-only
-** cursors or a single read/write cursor but not both.
+** cursors or a single read/write cursor but not both.  If PRAGMA bulk_load
+** is set, the cursor is opened in bulk-load mode.
 **
 ** See also OpenRead.
 */
@@ -3083,6 +3144,9 @@ case OP_OpenWrite: {
     pCur->pCursor = 0;
     rc = SQLITE_OK;
   }
+  if( wrFlag && db->nBulkFill && pCur->pCursor ){
+    sqlite3BtreeCursorBulkLoad(pCur->pCursor, db->nBulkFill);
+  }
 
   /* Set the VdbeCursor.isTable and isIndex variables. Previous versions of
   ** SQLite used to check if the root-page flags were sane at this point
@@ -3165,6 +3229,32 @@ case OP_OpenEphemeral: {
   break;
 }
 
+/* Opcode: SorterOpen P1 P2 * P4 *
+**
+** This opcode works like OP_OpenEphemeral except that it opens
+** a transient index that is specifically designed to sort large
+** tables using an external merge-sort algorithm.  Keys are added
+** using OP_SorterInsert and read back in order using OP_SorterSort,
+** OP_SorterNext and OP_SorterData.
+*/
+case OP_SorterOpen: {
+#ifndef SQLITE_OMIT_MERGE_SORT
+  VdbeCursor *pCx;
+
+  assert( pOp->p1>=0 );
+  assert( pOp->p4type==P4_KEYINFO );
+  pCx = allocateCursor(p, pOp->p1, pOp->p2, -1, 0);
+  if( pCx==0 ) goto no_mem;
+  pCx->pKeyInfo = pOp->p4.pKeyInfo;
+  pCx->pKeyInfo->enc = ENC(p->db);
+  pCx->isIndex = 1;
+  pCx->nullRow = 1;
+  rc = sqlite3VdbeSorterInit(db, pCx);
+  if( rc==SQLITE_NOMEM ) goto no_mem;
+#endif
+  break;
+}
+
 /* Opcode: OpenPseudo P1 P2 P3 * *
 **
 ** Open a new cursor that points to a fake table that contains a single
@@ -3520,6 +3610,32 @@ case OP_Found: {        /* jump, in3 */
   break;
 }
 
+/* Opcode: SorterCompare P1 P2 P3 * *
+**
+** P1 is a sorter cursor used to build a UNIQUE index and register P3
+** holds the previous key read from the sorter.  If the current sorter
+** key is equal to the key in register P3 (ignoring the trailing rowid
+** of each), fall through to the next instruction.  Otherwise, jump to
+** P2.  Keys that contain NULL values are never considered equal.
+*/
+case OP_SorterCompare: {    /* jump, in3 */
+#ifndef SQLITE_OMIT_MERGE_SORT
+  VdbeCursor *pC;
+  int res;
+
+  pC = p->apCsr[pOp->p1];
+  assert( pC!=0 && pC->pSorter!=0 );
+  pIn3 = &aMem[pOp->p3];
+  assert( pIn3->flags & MEM_Blob );
+  res = 0;
+  rc = sqlite3VdbeSorterCompare(pC, pIn3, &res);
+  if( res ){
+    pc = pOp->p2-1;
+  }
+#endif
+  break;
+}
+
 /* Opcode: IsUnique P1 P2 P3 P4 *
 **
 ** Cursor P1 is open on an index b-tree - that is to say, a btree which
@@ -4094,6 +4210,25 @@ case OP_RowData: {
   break;
 }
 
+/* Opcode: SorterData P1 P2 * * *
+**
+** Write into register P2 the current sorter data for sorter cursor P1.
+*/
+case OP_SorterData: {
+#ifndef SQLITE_OMIT_MERGE_SORT
+  VdbeCursor *pC;
+
+  pOut = &aMem[pOp->p2];
+  memAboutToChange(p, pOut);
+  pC = p->apCsr[pOp->p1];
+  assert( pC!=0 && pC->pSorter!=0 );
+  rc = sqlite3VdbeSorterRowkey(pC, pOut);
+  if( rc==SQLITE_NOMEM ) goto no_mem;
+  UPDATE_MAX_BLOBSIZE(pOut);
+#endif
+  break;
+}
+
 /* Opcode: Rowid P1 P2 * * *
 **
 ** Store in register P2 an integer which is the key of the table entry that
@@ -4194,6 +4329,37 @@ case OP_Last: {        /* jump */
 }
 
 
+/* Opcode: SorterSort P1 P2 * * *
+**
+** Sort the keys written to sorter cursor P1 using OP_SorterInsert and
+** rewind the sorter so that the next use of OP_SorterData refers to the
+** smallest key.  If the sorter is empty, jump immediately to P2.
+*/
+case OP_SorterSort: {    /* jump */
+#ifndef SQLITE_OMIT_MERGE_SORT
+  VdbeCursor *pC;
+  int res;
+
+#ifdef SQLITE_TEST
+  sqlite3_sort_count++;
+  sqlite3_search_count--;
+#endif
+  p->aCounter[SQLITE_STMTSTATUS_SORT-1]++;
+  assert( pOp->p1>=0 && pOp->p1<p->nCursor );
+  pC = p->apCsr[pOp->p1];
+  assert( pC!=0 && pC->pSorter!=0 );
+  res = 1;
+  rc = sqlite3VdbeSorterRewind(db, pC, &res);
+  if( rc==SQLITE_NOMEM ) goto no_mem;
+  pC->nullRow = (u8)res;
+  assert( pOp->p2>0 && pOp->p2<p->nOp );
+  if( res ){
+    pc = pOp->p2 - 1;
+  }
+#endif
+  break;
+}
+
 /* Opcode: Sort P1 P2 * * *
 **
 ** This opcode does exactly the same thing as OP_Rewind except that
@@ -4307,6 +4473,35 @@ case OP_Next: {        /* jump */
   break;
 }
 
+/* Opcode: SorterNext P1 P2 * * *
+**
+** Advance sorter cursor P1 to the next key.  If there are no more keys
+** then fall through to the following instruction.  Otherwise, jump
+** immediately to P2.
+*/
+case OP_SorterNext: {    /* jump */
+#ifndef SQLITE_OMIT_MERGE_SORT
+  VdbeCursor *pC;
+  int res;
+
+  CHECK_FOR_INTERRUPT;
+  assert( pOp->p1>=0 && pOp->p1<p->nCursor );
+  pC = p->apCsr[pOp->p1];
+  assert( pC!=0 && pC->pSorter!=0 );
+  res = 1;
+  rc = sqlite3VdbeSorterNext(db, pC, &res);
+  if( rc==SQLITE_NOMEM ) goto no_mem;
+  pC->nullRow = (u8)res;
+  if( res==0 ){
+    pc = pOp->p2 - 1;
+#ifdef SQLITE_TEST
+    sqlite3_search_count++;
+#endif
+  }
+#endif
+  break;
+}
+
 /* Opcode: IdxInsert P1 P2 P3 * P5
 **
 ** Register P2 holds a SQL index key made using the
@@ -4347,6 +4542,29 @@ case OP_IdxInsert: {        /* in2 */
   break;
 }
 
+/* Opcode: SorterInsert P1 P2 * * *
+**
+** Register P2 holds an SQL index key made using the MakeRecord
+** instruction.  This opcode adds the key to sorter cursor P1.
+*/
+case OP_SorterInsert: {    /* in2 */
+#ifndef SQLITE_OMIT_MERGE_SORT
+  VdbeCursor *pC;
+
+  assert( pOp->p1>=0 && pOp->p1<p->nCursor );
+  pC = p->apCsr[pOp->p1];
+  assert( pC!=0 && pC->pSorter!=0 );
+  pIn2 = &aMem[pOp->p2];
+  assert( pIn2->flags & MEM_Blob );
+  rc = ExpandBlob(pIn2);
+  if( rc==SQLITE_OK ){
+    rc = sqlite3VdbeSorterWrite(db, pC, pIn2);
+  }
+  if( rc==SQLITE_NOMEM ) goto no_mem;
+#endif
+  break;
+}
+
 /* Opcode: IdxDelete P1 P2 P3 * *
 **
 ** The content of P3 registers starting at register P2 form
@@ -5898,6 +6116,12 @@ default: {          /* This is really OP_Noop and OP_Explain */
 #endif
     }
 #endif
+#ifndef SQLITE_OMIT_STMT_PROFILE
+    if( aOpProf ){
+      aOpProf[iProfPc].nCycle += vdbeProfileClock() - iProfStart;
+      iProfStart = 0;
+    }
+#endif
 
     /* The following code adds nothing to the actual functionality
     ** of the program.  It is only here for testing and debugging.
@@ -5941,6 +6165,16 @@ vdbe_error_halt:
   ** release the mutexes on btrees that were acquired at the
   ** top. */
 vdbe_return:
+#ifndef SQLITE_OMIT_STMT_PROFILE
+  if( aOpProf ){
+    /* Instructions that jump here (OP_ResultRow, OP_Halt and errors) are
+    ** not timed by the code at the bottom of the loop. */
+    if( iProfStart ){
+      aOpProf[iProfPc].nCycle += vdbeProfileClock() - iProfStart;
+    }
+    sqlite3VdbeProfileLeave(p, rc);
+  }
+#endif
   sqlite3VdbeLeave(p);
   return rc;
 
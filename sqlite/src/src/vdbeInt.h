@@ -30,6 +30,9 @@ typedef struct VdbeOp Op;
 */
 typedef unsigned char Bool;
 
+/* Opaque type used by code in vdbesort.c */
+typedef struct VdbeSorter VdbeSorter;
+
 /*
 ** A cursor is a pointer into a single BTree within a database file.
 ** The cursor can seek to a BTree entry with a particular key, or
@@ -80,6 +83,7 @@ struct VdbeCursor {
   u32 *aType;           /* Type values for all entries in the record */
   u32 *aOffset;         /* Cached offsets to the start of each columns data */
   u8 *aRow;             /* Data for the current row, if all on one page */
+  VdbeSorter *pSorter;  /* Sorter object for OP_SorterOpen cursors */
 };
 typedef struct VdbeCursor VdbeCursor;
 
@@ -250,6 +254,49 @@ struct sqlite3_context {
   CollSeq *pColl;       /* Collating sequence */
 };
 
+#ifndef SQLITE_OMIT_STMT_PROFILE
+/*
+** While PRAGMA stmt_profile is enabled, each run of a statement is timed
+** and counted in a VdbeProfile object (see vdbeprof.c).  When the
+** statement is reset, the totals are added to the profile kept for its
+** SQL text by the database connection.
+**
+** The aStat[] array is indexed by the VDBE_PROF_* values below.  The
+** aBase[] array holds the b-tree seek count and the page cache
+** statistics (VDBE_PROF_SEEK through VDBE_PROF_READ) of all attached
+** databases at the start of the current call to sqlite3VdbeExec().
+**
+** Instructions run by trigger sub-programs are counted in aStat[] and
+** charged to the OP_Program instruction of the main program in aOp[].
+*/
+#define VDBE_PROF_ROW        0    /* Rows returned */
+#define VDBE_PROF_STEP       1    /* VDBE instructions executed */
+#define VDBE_PROF_CYCLE      2    /* Clock ticks spent in the VDBE */
+#define VDBE_PROF_SEEK       3    /* B-tree searches */
+#define VDBE_PROF_HIT        4    /* Page cache hits */
+#define VDBE_PROF_MISS       5    /* Page cache misses */
+#define VDBE_PROF_READ       6    /* Bytes read from database and WAL files */
+#define VDBE_PROF_FULLSCAN   7    /* SQLITE_STMTSTATUS_FULLSCAN_STEP */
+#define VDBE_PROF_SORT       8    /* SQLITE_STMTSTATUS_SORT */
+#define VDBE_PROF_AUTOINDEX  9    /* SQLITE_STMTSTATUS_AUTOINDEX */
+#define VDBE_PROF_N          10
+
+typedef struct VdbeOpProfile VdbeOpProfile;
+struct VdbeOpProfile {
+  u64 nExec;              /* Number of times the instruction was executed */
+  u64 nCycle;             /* Clock ticks spent executing it */
+};
+
+typedef struct VdbeProfile VdbeProfile;
+struct VdbeProfile {
+  u64 aStat[VDBE_PROF_N]; /* Totals for the current run */
+  u32 aBase[4];           /* Seek and cache totals on entry to VdbeExec() */
+  int aCounter[3];        /* Vdbe.aCounter[] at the start of the run */
+  int nOp;                /* Number of entries in aOp[] */
+  VdbeOpProfile aOp[1];   /* One entry for each instruction (Vdbe.aOp[]) */
+};
+#endif /* SQLITE_OMIT_STMT_PROFILE */
+
 /*
 ** An instance of the virtual machine.  This structure contains the complete
 ** state of the virtual machine.
@@ -301,17 +348,24 @@ struct Vdbe {
   u8 usesStmtJournal;     /* True if uses a statement journal */
   u8 readOnly;            /* True for read-only statements */
   u8 isPrepareV2;         /* True if prepared with prepare_v2() */
+  u8 isCached;            /* True if prepared for the stmtCache */
+  u8 inStmtCache;         /* True while idle in the db->stmtCache list */
   int nChange;            /* Number of db changes made since last reset */
   yDbMask btreeMask;      /* Bitmask of db->aDb[] entries referenced */
   yDbMask lockMask;       /* Subset of btreeMask that requires a lock */
   int iStatement;         /* Statement number (or 0 if has not opened stmt) */
   int aCounter[3];        /* Counters used by sqlite3_stmt_status() */
+#ifndef SQLITE_OMIT_STMT_PROFILE
+  VdbeProfile *pProf;     /* Counters for PRAGMA stmt_profile, or NULL */
+#endif
 #ifndef SQLITE_OMIT_TRACE
   i64 startTime;          /* Time when query started - used for profiling */
 #endif
   i64 nFkConstraint;      /* Number of imm. FK constraints this VM */
   i64 nStmtDefCons;       /* Number of def. constraints when stmt started */
   char *zSql;             /* Text of the SQL statement that generated this */
+  Vdbe *pCacheNext;       /* Next (less recently used) idle cached statement */
+  Vdbe *pCachePrev;       /* Previous idle cached statement */
   void *pFree;            /* Free this when deleting the vdbe */
 #ifdef SQLITE_DEBUG
   FILE *trace;            /* Write an execution trace here, if not NULL */
@@ -400,12 +454,31 @@ void sqlite3VdbeMemStoreType(Mem *pMem);
 void sqlite3VdbeMemPrepareToChange(Vdbe*,Mem*);
 #endif
 
+#ifndef SQLITE_OMIT_STMT_PROFILE
+void sqlite3VdbeProfileBegin(Vdbe*);
+void sqlite3VdbeProfileEnter(Vdbe*);
+void sqlite3VdbeProfileLeave(Vdbe*, int);
+void sqlite3VdbeProfileEnd(Vdbe*);
+#endif
+
 #ifndef SQLITE_OMIT_FOREIGN_KEY
 int sqlite3VdbeCheckFk(Vdbe *, int);
 #else
 # define sqlite3VdbeCheckFk(p,i) 0
 #endif
 
+#ifndef SQLITE_OMIT_MERGE_SORT
+int sqlite3VdbeSorterInit(sqlite3 *, VdbeCursor *);
+void sqlite3VdbeSorterClose(sqlite3 *, VdbeCursor *);
+int sqlite3VdbeSorterWrite(sqlite3 *, const VdbeCursor *, Mem *);
+int sqlite3VdbeSorterRewind(sqlite3 *, const VdbeCursor *, int *);
+int sqlite3VdbeSorterNext(sqlite3 *, const VdbeCursor *, int *);
+int sqlite3VdbeSorterRowkey(const VdbeCursor *, Mem *);
+int sqlite3VdbeSorterCompare(const VdbeCursor *, Mem *, int *);
+#else
+# define sqlite3VdbeSorterClose(Y,Z)
+#endif
+
 int sqlite3VdbeMemTranslate(Mem*, u8);
 #ifdef SQLITE_DEBUG
   void sqlite3VdbePrintSql(Vdbe*);
@@ -79,7 +79,11 @@ int sqlite3_finalize(sqlite3_stmt *pStmt){
     mutex = v->db->mutex;
 #endif
     sqlite3_mutex_enter(mutex);
-    rc = sqlite3VdbeFinalize(v);
+    if( v->isCached ){
+      rc = sqlite3VdbeCacheRelease(v);
+    }else{
+      rc = sqlite3VdbeFinalize(v);
+    }
     rc = sqlite3ApiExit(db, rc);
     sqlite3_mutex_leave(mutex);
   }
@@ -308,9 +312,22 @@ void sqlite3_result_error_nomem(sqlite3_context *pCtx){
   pCtx->s.db->mallocFailed = 1;
 }
 
+#ifndef SQLITE_OMIT_WAL
+/*
+** Set the current value of one of the sqlite3.aWalStat[] entries reported
+** by sqlite3_db_status(), and raise its highwater mark if required.
+*/
+static void walStatSet(int *aStat, int iValue){
+  aStat[0] = iValue;
+  if( iValue>aStat[1] ) aStat[1] = iValue;
+}
+#endif
+
 /*
 ** This function is called after a transaction has been committed. It 
 ** invokes callbacks registered with sqlite3_wal_hook() as required.
+** It also records the size of the log, the number of frames not yet
+** checkpointed and the time spent in the callback, for sqlite3_db_status().
 */
 static int doWalCallbacks(sqlite3 *db){
   int rc = SQLITE_OK;
@@ -319,9 +336,19 @@ static int doWalCallbacks(sqlite3 *db){
   for(i=0; i<db->nDb; i++){
     Btree *pBt = db->aDb[i].pBt;
     if( pBt ){
-      int nEntry = sqlite3PagerWalCallback(sqlite3BtreePager(pBt));
+      Pager *pPager = sqlite3BtreePager(pBt);
+      int nEntry = sqlite3PagerWalCallback(pPager);
+      if( nEntry>0 ){
+        walStatSet(db->aWalStat[0], nEntry);
+        walStatSet(db->aWalStat[1], sqlite3PagerWalBacklog(pPager));
+      }
       if( db->xWalCallback && nEntry>0 && rc==SQLITE_OK ){
+        sqlite3_int64 iStart = 0;
+        sqlite3_int64 iEnd = 0;
+        sqlite3OsCurrentTimeInt64(db->pVfs, &iStart);
         rc = db->xWalCallback(db->pWalArg, db, db->aDb[i].zName, nEntry);
+        sqlite3OsCurrentTimeInt64(db->pVfs, &iEnd);
+        walStatSet(db->aWalStat[2], iEnd>iStart ? (int)(iEnd-iStart) : 0);
       }
     }
   }
@@ -400,6 +427,12 @@ static int sqlite3Step(Vdbe *p){
     }
 #endif
 
+#ifndef SQLITE_OMIT_STMT_PROFILE
+    if( (db->nStmtProfile || p->pProf) && !db->init.busy && !p->explain ){
+      sqlite3VdbeProfileBegin(p);
+    }
+#endif
+
     db->activeVdbeCnt++;
     if( p->readOnly==0 ) db->writeVdbeCnt++;
     p->pc = 0;
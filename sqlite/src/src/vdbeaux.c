@@ -88,6 +88,155 @@ void sqlite3VdbeSwap(Vdbe *pA, Vdbe *pB){
   pA->zSql = pB->zSql;
   pB->zSql = zTmp;
   pB->isPrepareV2 = pA->isPrepareV2;
+  pB->isCached = pA->isCached;
+#ifndef SQLITE_OMIT_STMT_PROFILE
+  /* Discard the profile of the run that found the schema had changed.
+  ** The statement is run again from the start with the new program. */
+  sqlite3_free(pA->pProf);
+  sqlite3_free(pB->pProf);
+  pA->pProf = pB->pProf = 0;
+#endif
+}
+
+/*
+** Mark statement p as prepared with CHROMIUM_SQLITE_PREPARE_CACHED, so that
+** sqlite3_finalize() hands it to sqlite3VdbeCacheRelease().
+*/
+void sqlite3VdbeSetCached(Vdbe *p){
+  assert( p->zSql && p->isPrepareV2 );
+  p->isCached = 1;
+}
+
+/*
+** Remove idle statement p from the statement cache of its connection.
+*/
+static void vdbeCacheUnlink(Vdbe *p){
+  StmtCache *pCache = &p->db->stmtCache;
+  assert( p->inStmtCache );
+  if( p->pCachePrev ){
+    p->pCachePrev->pCacheNext = p->pCacheNext;
+  }else{
+    pCache->pFirst = p->pCacheNext;
+  }
+  if( p->pCacheNext ){
+    p->pCacheNext->pCachePrev = p->pCachePrev;
+  }else{
+    pCache->pLast = p->pCachePrev;
+  }
+  p->pCacheNext = p->pCachePrev = 0;
+  p->inStmtCache = 0;
+  pCache->nStmt--;
+}
+
+/*
+** If the SQL text zCached, saved by a statement prepared with
+** CHROMIUM_SQLITE_PREPARE_CACHED, is the first SQL statement in the nBytes
+** bytes (or nul-terminated string, if nBytes is negative) at zSql, return its
+** length.  Otherwise return 0.
+**
+** The saved text runs up to and including the ';' that ends the
+** statement, if any.  If there was no ';', the statement ran to the end
+** of its input, so zSql must end at the same point.
+*/
+static int vdbeCacheMatch(const char *zCached, const char *zSql, int nBytes){
+  int i;
+  for(i=0; zCached[i]; i++){
+    if( i==nBytes || zCached[i]!=zSql[i] ) return 0;
+  }
+  if( i>0 && zCached[i-1]==';' ) return i;
+  if( i==nBytes || zSql[i]==0 ) return i;
+  return 0;
+}
+
+/*
+** Search the statement cache of connection db for an idle statement
+** compiled from the first SQL statement in zSql.  If one is found, remove
+** it from the cache, set *pzTail to point to the end of that statement
+** in zSql and return it.  Otherwise return NULL.  Statements that have
+** expired, for example because the schema has changed, are finalized
+** as they are found.
+*/
+Vdbe *sqlite3VdbeCacheFind(
+  sqlite3 *db,              /* Database handle */
+  const char *zSql,         /* UTF-8 encoded SQL statement */
+  int nBytes,               /* Length of zSql in bytes, or -1 */
+  const char **pzTail       /* OUT: End of the statement in zSql */
+){
+  StmtCache *pCache = &db->stmtCache;
+  Vdbe *p;
+  Vdbe *pNext;
+  assert( sqlite3_mutex_held(db->mutex) );
+  for(p=pCache->pFirst; p; p=pNext){
+    int n = vdbeCacheMatch(p->zSql, zSql, nBytes);
+    pNext = p->pCacheNext;
+    if( n ){
+      vdbeCacheUnlink(p);
+      if( p->expired ){
+        sqlite3VdbeFinalize(p);
+        continue;
+      }
+      pCache->nHit++;
+      if( pCache->nCompile ){
+        pCache->iSaved += pCache->iCompileTime*1000/pCache->nCompile;
+      }
+      if( pzTail ) *pzTail = &zSql[n];
+      return p;
+    }
+  }
+  return 0;
+}
+
+/*
+** Finalize the least recently used idle statements in the statement cache
+** of connection db until no more than nKeep remain.
+*/
+void sqlite3VdbeCacheTrim(sqlite3 *db, int nKeep){
+  StmtCache *pCache = &db->stmtCache;
+  assert( sqlite3_mutex_held(db->mutex) );
+  while( pCache->nStmt>nKeep ){
+    Vdbe *p = pCache->pLast;
+    vdbeCacheUnlink(p);
+    sqlite3VdbeFinalize(p);
+  }
+}
+
+/*
+** This is called by sqlite3_finalize() for a statement prepared with
+** CHROMIUM_SQLITE_PREPARE_CACHED.  Unless the statement is already idle in the
+** cache, it is reset, its bindings are cleared and it is added to the
+** cache as the most recently used statement instead of being deleted.
+** The return value is the same as that of sqlite3VdbeFinalize().
+*/
+int sqlite3VdbeCacheRelease(Vdbe *p){
+  sqlite3 *db = p->db;
+  StmtCache *pCache = &db->stmtCache;
+  int rc = SQLITE_OK;
+  int i;
+
+  assert( p->isCached );
+  assert( sqlite3_mutex_held(db->mutex) );
+  if( p->inStmtCache ){
+    vdbeCacheUnlink(p);
+  }else if( pCache->nMax>0 && !p->expired && !p->expmask && !db->mallocFailed ){
+    rc = sqlite3VdbeReset(p);
+    sqlite3VdbeMakeReady(p, -1, 0, 0, 0, 0, 0);
+    for(i=0; i<p->nVar; i++){
+      sqlite3VdbeMemRelease(&p->aVar[i]);
+      p->aVar[i].flags = MEM_Null;
+    }
+    p->pCacheNext = pCache->pFirst;
+    if( pCache->pFirst ){
+      pCache->pFirst->pCachePrev = p;
+    }else{
+      pCache->pLast = p;
+    }
+    pCache->pFirst = p;
+    p->inStmtCache = 1;
+    pCache->nStmt++;
+    sqlite3VdbeCacheTrim(db, pCache->nMax);
+    return rc;
+  }
+  return sqlite3VdbeFinalize(p);
 }
 
 #ifdef SQLITE_DEBUG
@@ -1536,6 +1685,7 @@ void sqlite3VdbeFreeCursor(Vdbe *p, VdbeCursor *pCx){
   if( pCx==0 ){
     return;
   }
+  sqlite3VdbeSorterClose(p->db, pCx);
   if( pCx->pBt ){
     sqlite3BtreeClose(pCx->pBt);
     /* The pCx->pCursor will be close automatically, if it exists, by
@@ -2328,6 +2478,11 @@ int sqlite3VdbeReset(Vdbe *p){
 
   /* Save profiling information from this VDBE run.
   */
+#ifndef SQLITE_OMIT_STMT_PROFILE
+  if( p->pProf ){
+    sqlite3VdbeProfileEnd(p);
+  }
+#endif
 #ifdef VDBE_PROFILE
   {
     FILE *out = fopen("vdbe_profile.out", "a");
@@ -2408,6 +2563,9 @@ void sqlite3VdbeDeleteObject(sqlite3 *db, Vdbe *p){
   sqlite3DbFree(db, p->aColName);
   sqlite3DbFree(db, p->zSql);
   sqlite3DbFree(db, p->pFree);
+#ifndef SQLITE_OMIT_STMT_PROFILE
+  sqlite3_free(p->pProf);
+#endif
   sqlite3DbFree(db, p);
 }
 
@@ -3006,7 +3164,178 @@ int sqlite3VdbeRecordCompare(
   }
   return rc;
 }
- 
+
+/*
+** Read the header of record {nKey1, aKey1} as far as the serial type of
+** the first field.  Set *pType to the serial type and *pOff to the offset
+** of the first field's content and return non-zero.  Return zero if the
+** record has no first field that sqlite3VdbeRecordCompare() would look
+** at, or if the first field overruns the record (which only happens if
+** the database is corrupt).  The caller then uses the general routine.
+*/
+static int vdbeRecordFirstField(
+  int nKey1, const u8 *aKey1,   /* Left key */
+  const UnpackedRecord *pPKey2, /* Right key */
+  u32 *pType,                   /* OUT: Serial type of first field */
+  u32 *pOff                     /* OUT: Offset of first field content */
+){
+  u32 szHdr1;                   /* Size of the header in bytes */
+  u32 nHdr1;                    /* Bytes of header that are compared */
+  u32 idx1;                     /* Offset of first serial type */
+  if( nKey1<2 ) return 0;
+  idx1 = getVarint32(aKey1, szHdr1);
+  if( szHdr1<=idx1 || szHdr1>(u32)nKey1 ) return 0;
+  nHdr1 = szHdr1;
+  if( pPKey2->flags & UNPACKED_IGNORE_ROWID ) nHdr1--;
+  if( idx1>=nHdr1 ) return 0;
+  getVarint32(&aKey1[idx1], *pType);
+  if( *pType==10 || *pType==11 ) return 0;
+  if( (u64)szHdr1 + sqlite3VdbeSerialTypeLen(*pType)>(u64)nKey1 ) return 0;
+  *pOff = szHdr1;
+  return 1;
+}
+
+/*
+** Return the value pKeyInfo would give the result of comparing the first
+** fields of two keys that compare as c using the default (ASC) order.
+*/
+#define vdbeRecordFirstOrder(pKeyInfo, c) \
+  (((pKeyInfo)->nField>0 && (pKeyInfo)->aSortOrder \
+      && (pKeyInfo)->aSortOrder[0]) ? -(c) : (c))
+
+/*
+** This is a version of sqlite3VdbeRecordCompare() for use when the first
+** field of pPKey2 is an integer.  The first field of {nKey1, pKey1} is
+** compared directly from the record, without decoding the rest of the
+** header into Mem structures.  If the first fields are equal, or if the
+** first field of key1 is a real, the general routine is used instead.
+*/
+static int vdbeRecordCompareInt(
+  int nKey1, const void *pKey1, /* Left key */
+  UnpackedRecord *pPKey2        /* Right key */
+){
+  const u8 *aKey1 = (const u8*)pKey1;
+  u32 serial_type;
+  u32 d1;
+  const u8 *buf;
+  i64 v;
+  int rc;
+
+  if( !vdbeRecordFirstField(nKey1, aKey1, pPKey2, &serial_type, &d1) ){
+    return sqlite3VdbeRecordCompare(nKey1, pKey1, pPKey2);
+  }
+  buf = &aKey1[d1];
+  switch( serial_type ){
+    case 0:   /* NULL is less than any integer */
+      return vdbeRecordFirstOrder(pPKey2->pKeyInfo, -1);
+    case 1:
+      v = (signed char)buf[0];
+      break;
+    case 2:
+      v = (((signed char)buf[0])<<8) | buf[1];
+      break;
+    case 3:
+      v = (((signed char)buf[0])<<16) | (buf[1]<<8) | buf[2];
+      break;
+    case 4:
+      v = (buf[0]<<24) | (buf[1]<<16) | (buf[2]<<8) | buf[3];
+      break;
+    case 5: {
+      u64 x = (((signed char)buf[0])<<8) | buf[1];
+      u32 y = (buf[2]<<24) | (buf[3]<<16) | (buf[4]<<8) | buf[5];
+      x = (x<<32) | y;
+      v = *(i64*)&x;
+      break;
+    }
+    case 6: {
+      u64 x = (buf[0]<<24) | (buf[1]<<16) | (buf[2]<<8) | buf[3];
+      u32 y = (buf[4]<<24) | (buf[5]<<16) | (buf[6]<<8) | buf[7];
+      x = (x<<32) | y;
+      v = *(i64*)&x;
+      break;
+    }
+    case 7:   /* Compare reals using the general routine */
+      return sqlite3VdbeRecordCompare(nKey1, pKey1, pPKey2);
+    case 8:
+    case 9:
+      v = serial_type-8;
+      break;
+    default:  /* Text and blobs are greater than any integer */
+      return vdbeRecordFirstOrder(pPKey2->pKeyInfo, 1);
+  }
+  if( v==pPKey2->aMem[0].u.i ){
+    return sqlite3VdbeRecordCompare(nKey1, pKey1, pPKey2);
+  }
+  rc = v<pPKey2->aMem[0].u.i ? -1 : 1;
+  return vdbeRecordFirstOrder(pPKey2->pKeyInfo, rc);
+}
+
+/*
+** This is a version of sqlite3VdbeRecordCompare() for use when the first
+** field of pPKey2 is a string that uses the BINARY collating sequence.
+** The first field of {nKey1, pKey1} is compared using memcmp() directly
+** from the record.  If the first fields are equal, the general routine
+** is used to compare the remaining fields.
+*/
+static int vdbeRecordCompareString(
+  int nKey1, const void *pKey1, /* Left key */
+  UnpackedRecord *pPKey2        /* Right key */
+){
+  const u8 *aKey1 = (const u8*)pKey1;
+  const Mem *pMem2 = &pPKey2->aMem[0];
+  u32 serial_type;
+  u32 d1;
+  int rc;
+
+  if( !vdbeRecordFirstField(nKey1, aKey1, pPKey2, &serial_type, &d1) ){
+    return sqlite3VdbeRecordCompare(nKey1, pKey1, pPKey2);
+  }
+  if( serial_type<12 ){
+    rc = -1;              /* NULL and numbers are less than text */
+  }else if( !(serial_type & 0x01) ){
+    rc = 1;               /* Blobs are greater than text */
+  }else{
+    int n1 = (serial_type-13)/2;
+    rc = memcmp(&aKey1[d1], pMem2->z, n1<pMem2->n ? n1 : pMem2->n);
+    if( rc==0 ){
+      rc = n1 - pMem2->n;
+      if( rc==0 ){
+        return sqlite3VdbeRecordCompare(nKey1, pKey1, pPKey2);
+      }
+    }
+    rc = rc<0 ? -1 : 1;
+  }
+  return vdbeRecordFirstOrder(pPKey2->pKeyInfo, rc);
+}
+
+/*
+** Return a pointer to a function that compares keys in the same way as
+** sqlite3VdbeRecordCompare() but is faster for the right key pPKey2.
+** Integer and BINARY text first fields have specialized comparators.
+** Callers that compare one unpacked key against many records, such as
+** the b-tree descent in sqlite3BtreeMovetoUnpacked(), should call this
+** once and use the returned function for every comparison.
+*/
+RecordCompare sqlite3VdbeFindCompare(UnpackedRecord *p){
+  if( p->nField>0 && (p->flags & UNPACKED_PREFIX_SEARCH)==0 ){
+    const Mem *pMem = &p->aMem[0];
+    int flags = pMem->flags & (MEM_Null|MEM_Int|MEM_Real|MEM_Str|MEM_Blob);
+    if( flags==MEM_Int ){
+      return vdbeRecordCompareInt;
+    }
+    if( flags==MEM_Str && (pMem->flags & MEM_Zero)==0 ){
+      KeyInfo *pKeyInfo = p->pKeyInfo;
+      CollSeq *pColl = pKeyInfo->nField>0 ? pKeyInfo->aColl[0] : 0;
+      if( pColl==0
+       || (pColl->type==SQLITE_COLL_BINARY && pColl->enc==pKeyInfo->enc)
+      ){
+        return vdbeRecordCompareString;
+      }
+    }
+  }
+  return sqlite3VdbeRecordCompare;
+}
+
 
 /*
 ** pCur points at an index entry created using the OP_MakeRecord opcode.
@@ -0,0 +1,752 @@
+/*
+** 2011 September 12
+**
+** The author disclaims copyright to this source code.  In place of
+** a legal notice, here is a blessing:
+**
+**    May you do good and not evil.
+**    May you find forgiveness for yourself and forgive others.
+**    May you share freely, never taking more than you give.
+**
+*************************************************************************
+**
+** This file contains the statement profiler enabled by PRAGMA
+** stmt_profile, and the "stmt_profile" virtual table used to read the
+** profiles it records.
+**
+** While the pragma is set to a non-zero value N, each run of a statement
+** (from the first call to sqlite3_step() until the statement is reset) is
+** counted in a VdbeProfile object attached to the VM: the number of times
+** each instruction is executed and the clock ticks spent on it, rows
+** returned, b-tree searches, page cache hits and misses and bytes read
+** from the database files.  When the statement is reset, the totals are
+** added to the StmtProfile object for its SQL text, which lives until it
+** is deleted through the virtual table or the connection is closed.  At
+** most N distinct SQL statements are profiled; runs of other statements
+** are not counted once that many have been recorded.
+**
+** The page cache and b-tree counters are maintained by the pager and
+** b-tree layers for each attached database at all times.  The profiler
+** only samples them as sqlite3VdbeExec() is entered and left, so a
+** statement is charged for the work done by any statements it runs
+** itself (for example from within a user function).  In shared-cache
+** mode, the pager counters also include work done by other connections
+** that share the cache, if they run at the same time.
+**
+** The profiles are read using a virtual table:
+**
+**     CREATE VIRTUAL TABLE temp.prof USING stmt_profile;
+**     SELECT sql, runs, cycles, fullscan_steps FROM temp.prof
+**      ORDER BY cycles DESC;
+**
+** which has one row for each SQL statement.  Created with the argument
+** "opcodes", the table has one row for each instruction of each profiled
+** program instead.  Deleting a row from a statement table discards the
+** profile of that statement.
+*/
+#include "sqliteInt.h"
+#include "vdbeInt.h"
+
+#ifndef SQLITE_OMIT_STMT_PROFILE
+
+typedef struct StmtProfile StmtProfile;
+typedef struct StmtProfileOp StmtProfileOp;
+
+/*
+** One instruction of a profiled program, and its totals for all runs.
+*/
+struct StmtProfileOp {
+  u8 opcode;                  /* Copy of VdbeOp.opcode */
+  int p1, p2, p3;             /* Copies of VdbeOp.p1, p2 and p3 */
+  u64 nExec;                  /* Total VdbeOpProfile.nExec */
+  u64 nCycle;                 /* Total VdbeOpProfile.nCycle */
+};
+
+/*
+** The profile of a single SQL statement.
+**
+** If the statement is recompiled, for example because the schema has
+** changed, the per-instruction totals in aOp[] are discarded and
+** restarted for the new program the first time it is run.  The totals
+** in aStat[] are kept.
+*/
+struct StmtProfile {
+  char *zSql;                 /* SQL text (the key) */
+  int nSql;                   /* Length of zSql in bytes */
+  unsigned int iHash;         /* Hash of zSql */
+  i64 iId;                    /* Rowid of this profile in stmt_profile */
+  i64 nRun;                   /* Number of runs recorded */
+  u64 aStat[VDBE_PROF_N];     /* Totals for all runs */
+  int nOp;                    /* Number of entries in aOp[] */
+  StmtProfileOp *aOp;         /* Instructions of the most recent program */
+  StmtProfile *pNext;         /* Next profile, in order of creation */
+  StmtProfile *pHashNext;     /* Next profile in the same hash bucket */
+};
+
+/*
+** The profiles recorded by a database connection (sqlite3.pStmtProfiler).
+*/
+struct StmtProfiler {
+  int nProfile;               /* Number of profiles in the list */
+  int nHash;                  /* Number of buckets in aHash[] */
+  StmtProfile **aHash;        /* Hash table of profiles */
+  StmtProfile *pFirst;        /* Oldest profile */
+  StmtProfile *pLast;         /* Newest profile */
+  i64 iNextId;                /* Rowid for the next profile created */
+};
+
+/*
+** Hash SQL text.  Unlike the hash tables in hash.c, SQL text is case
+** sensitive, as it may contain string literals.
+*/
+static unsigned int profileHash(const char *z, int n){
+  unsigned int h = 0;
+  while( n-- > 0 ){
+    h = (h<<3) ^ h ^ (u8)*(z++);
+  }
+  return h;
+}
+
+/*
+** Return the profile of SQL statement zSql, or NULL if there is none.
+*/
+static StmtProfile *profileFind(StmtProfiler *pProfiler, const char *zSql){
+  StmtProfile *pEntry;
+  int nSql;
+  unsigned int iHash;
+  if( pProfiler==0 || pProfiler->nHash==0 ) return 0;
+  nSql = sqlite3Strlen30(zSql);
+  iHash = profileHash(zSql, nSql);
+  for(pEntry=pProfiler->aHash[iHash % pProfiler->nHash];
+      pEntry;
+      pEntry=pEntry->pHashNext
+  ){
+    if( pEntry->iHash==iHash && pEntry->nSql==nSql
+     && memcmp(pEntry->zSql, zSql, nSql)==0
+    ){
+      return pEntry;
+    }
+  }
+  return 0;
+}
+
+/*
+** Create a new profile for SQL statement zSql and add it to the
+** profiler of connection db.  Return NULL if a malloc fails.
+*/
+static StmtProfile *profileCreate(sqlite3 *db, const char *zSql){
+  StmtProfiler *pProfiler = db->pStmtProfiler;
+  StmtProfile *pEntry;
+  int nSql = sqlite3Strlen30(zSql);
+
+  if( pProfiler==0 ){
+    pProfiler = (StmtProfiler *)sqlite3MallocZero(sizeof(StmtProfiler));
+    if( pProfiler==0 ) return 0;
+    pProfiler->iNextId = 1;
+    db->pStmtProfiler = pProfiler;
+  }
+
+  /* Grow the hash table so that it has at least as many buckets as there
+  ** are profiles.  */
+  if( pProfiler->nProfile>=pProfiler->nHash ){
+    int nNew = pProfiler->nHash ? pProfiler->nHash*2 : 64;
+    StmtProfile **aNew;
+    StmtProfile *p;
+    aNew = (StmtProfile **)sqlite3MallocZero(nNew*sizeof(StmtProfile*));
+    if( aNew==0 ) return 0;
+    for(p=pProfiler->pFirst; p; p=p->pNext){
+      int iBucket = p->iHash % nNew;
+      p->pHashNext = aNew[iBucket];
+      aNew[iBucket] = p;
+    }
+    sqlite3_free(pProfiler->aHash);
+    pProfiler->aHash = aNew;
+    pProfiler->nHash = nNew;
+  }
+
+  pEntry = (StmtProfile *)sqlite3MallocZero(sizeof(StmtProfile) + nSql + 1);
+  if( pEntry==0 ) return 0;
+  pEntry->zSql = (char *)&pEntry[1];
+  memcpy(pEntry->zSql, zSql, nSql+1);
+  pEntry->nSql = nSql;
+  pEntry->iHash = profileHash(zSql, nSql);
+  pEntry->iId = pProfiler->iNextId++;
+  pEntry->pHashNext = pProfiler->aHash[pEntry->iHash % pProfiler->nHash];
+  pProfiler->aHash[pEntry->iHash % pProfiler->nHash] = pEntry;
+  if( pProfiler->pLast ){
+    pProfiler->pLast->pNext = pEntry;
+  }else{
+    pProfiler->pFirst = pEntry;
+  }
+  pProfiler->pLast = pEntry;
+  pProfiler->nProfile++;
+  return pEntry;
+}
+
+/*
+** Remove profile pEntry from the profiler of connection db and free it.
+*/
+static void profileDelete(sqlite3 *db, StmtProfile *pEntry){
+  StmtProfiler *pProfiler = db->pStmtProfiler;
+  StmtProfile **pp;
+
+  for(pp=&pProfiler->aHash[pEntry->iHash % pProfiler->nHash];
+      *pp!=pEntry;
+      pp=&(*pp)->pHashNext
+  );
+  *pp = pEntry->pHashNext;
+
+  if( pProfiler->pFirst==pEntry ){
+    pProfiler->pFirst = pEntry->pNext;
+    if( pProfiler->pLast==pEntry ) pProfiler->pLast = 0;
+  }else{
+    StmtProfile *pPrev = pProfiler->pFirst;
+    while( pPrev->pNext!=pEntry ) pPrev = pPrev->pNext;
+    pPrev->pNext = pEntry->pNext;
+    if( pProfiler->pLast==pEntry ) pProfiler->pLast = pPrev;
+  }
+  pProfiler->nProfile--;
+
+  sqlite3_free(pEntry->aOp);
+  sqlite3_free(pEntry);
+}
+
+/*
+** Free all profiles recorded by connection db.  This is called by
+** sqlite3_close().
+*/
+void sqlite3StmtProfileClose(sqlite3 *db){
+  StmtProfiler *pProfiler = db->pStmtProfiler;
+  if( pProfiler ){
+    StmtProfile *pEntry;
+    StmtProfile *pNext;
+    for(pEntry=pProfiler->pFirst; pEntry; pEntry=pNext){
+      pNext = pEntry->pNext;
+      sqlite3_free(pEntry->aOp);
+      sqlite3_free(pEntry);
+    }
+    sqlite3_free(pProfiler->aHash);
+    sqlite3_free(pProfiler);
+    db->pStmtProfiler = 0;
+  }
+}
+
+/*
+** Write the total b-tree search count and page cache statistics of all
+** databases attached to connection db to a[0] through a[3], in the order
+** of the VDBE_PROF_SEEK to VDBE_PROF_READ values.
+*/
+static void profileTotals(sqlite3 *db, u32 *a){
+  int i;
+  memset(a, 0, sizeof(u32)*4);
+  for(i=0; i<db->nDb; i++){
+    Btree *pBt = db->aDb[i].pBt;
+    if( pBt ){
+      Pager *pPager = sqlite3BtreePager(pBt);
+      a[0] += sqlite3BtreeSeekCount(pBt);
+      a[1] += sqlite3PagerCacheStat(pPager, PAGER_STAT_HIT);
+      a[2] += sqlite3PagerCacheStat(pPager, PAGER_STAT_MISS);
+      a[3] += sqlite3PagerCacheStat(pPager, PAGER_STAT_READ);
+    }
+  }
+}
+
+/*
+** This is called by sqlite3_step() when VM p starts a new run, if
+** PRAGMA stmt_profile is set or p was profiled during its last run.
+** Prepare p->pProf to count the run, or free it if the run is not to be
+** profiled.
+*/
+void sqlite3VdbeProfileBegin(Vdbe *p){
+  sqlite3 *db = p->db;
+  VdbeProfile *pProf = p->pProf;
+  int nByte = sizeof(VdbeProfile) + (p->nOp-1)*sizeof(VdbeOpProfile);
+
+  if( db->nStmtProfile==0 || p->zSql==0 || p->nOp==0
+   || (profileFind(db->pStmtProfiler, p->zSql)==0
+       && db->pStmtProfiler && db->pStmtProfiler->nProfile>=db->nStmtProfile)
+  ){
+    sqlite3_free(pProf);
+    p->pProf = 0;
+    return;
+  }
+
+  if( pProf==0 ){
+    /* If this allocation fails the run is simply not profiled. */
+    sqlite3BeginBenignMalloc();
+    pProf = (VdbeProfile *)sqlite3Malloc(nByte);
+    sqlite3EndBenignMalloc();
+    if( pProf==0 ) return;
+    p->pProf = pProf;
+  }
+  assert( sqlite3MallocSize(pProf)>=nByte );
+  memset(pProf, 0, nByte);
+  pProf->nOp = p->nOp;
+  memcpy(pProf->aCounter, p->aCounter, sizeof(pProf->aCounter));
+}
+
+/*
+** Called as sqlite3VdbeExec() starts executing VM p, which is being
+** profiled.
+*/
+void sqlite3VdbeProfileEnter(Vdbe *p){
+  profileTotals(p->db, p->pProf->aBase);
+}
+
+/*
+** Called as sqlite3VdbeExec() returns rc after executing VM p, which is
+** being profiled.  Add the b-tree and pager activity since the call to
+** sqlite3VdbeProfileEnter() to the totals for the current run.
+*/
+void sqlite3VdbeProfileLeave(Vdbe *p, int rc){
+  VdbeProfile *pProf = p->pProf;
+  u32 aNow[4];
+  int i;
+
+  profileTotals(p->db, aNow);
+  for(i=0; i<4; i++){
+    pProf->aStat[VDBE_PROF_SEEK+i] += (u32)(aNow[i] - pProf->aBase[i]);
+  }
+  if( rc==SQLITE_ROW ){
+    pProf->aStat[VDBE_PROF_ROW]++;
+  }
+}
+
+/*
+** Called by sqlite3VdbeReset() when the run of VM p that was profiled is
+** over.  Add the totals for the run to the profile of p's SQL statement.
+*/
+void sqlite3VdbeProfileEnd(Vdbe *p){
+  sqlite3 *db = p->db;
+  VdbeProfile *pProf = p->pProf;
+  StmtProfile *pEntry;
+  int i;
+
+  if( pProf->aStat[VDBE_PROF_STEP]==0 ) return;
+  assert( p->zSql && pProf->nOp==p->nOp );
+
+  sqlite3BeginBenignMalloc();
+  pEntry = profileFind(db->pStmtProfiler, p->zSql);
+  if( pEntry==0 ){
+    pEntry = profileCreate(db, p->zSql);
+  }
+
+  /* If the statement has been recompiled since it was last profiled,
+  ** start again with the instructions of the new program.  */
+  if( pEntry ){
+    int bNew = (pEntry->nOp!=p->nOp);
+    for(i=0; bNew==0 && i<p->nOp; i++){
+      StmtProfileOp *pOp = &pEntry->aOp[i];
+      bNew = (pOp->opcode!=p->aOp[i].opcode || pOp->p1!=p->aOp[i].p1
+           || pOp->p2!=p->aOp[i].p2 || pOp->p3!=p->aOp[i].p3);
+    }
+    if( bNew ){
+      StmtProfileOp *aOp;
+      aOp = (StmtProfileOp *)sqlite3MallocZero(p->nOp*sizeof(StmtProfileOp));
+      sqlite3_free(pEntry->aOp);
+      pEntry->aOp = aOp;
+      pEntry->nOp = aOp ? p->nOp : 0;
+      for(i=0; i<pEntry->nOp; i++){
+        aOp[i].opcode = p->aOp[i].opcode;
+        aOp[i].p1 = p->aOp[i].p1;
+        aOp[i].p2 = p->aOp[i].p2;
+        aOp[i].p3 = p->aOp[i].p3;
+      }
+    }
+  }
+  sqlite3EndBenignMalloc();
+
+  if( pEntry ){
+    for(i=0; i<pEntry->nOp; i++){
+      pEntry->aOp[i].nExec += pProf->aOp[i].nExec;
+      pEntry->aOp[i].nCycle += pProf->aOp[i].nCycle;
+      pProf->aStat[VDBE_PROF_CYCLE] += pProf->aOp[i].nCycle;
+    }
+
+    /* The sqlite3_stmt_status() counters may have been reset during the
+    ** run.  If so, count from zero.  */
+    for(i=0; i<3; i++){
+      int iStart = pProf->aCounter[i];
+      if( iStart>p->aCounter[i] ) iStart = 0;
+      pProf->aStat[VDBE_PROF_FULLSCAN+i] += p->aCounter[i] - iStart;
+    }
+
+    for(i=0; i<VDBE_PROF_N; i++){
+      pEntry->aStat[i] += pProf->aStat[i];
+    }
+    pEntry->nRun++;
+  }
+  pProf->aStat[VDBE_PROF_STEP] = 0;
+}
+
+#ifndef SQLITE_OMIT_VIRTUALTABLE
+
+/*
+** The stmt_profile virtual table.
+**
+** The columns of the table depend on whether it has one row for each
+** statement or one row for each instruction.  The rowid of a statement
+** row is a number that identifies the profile.  The rowid of an
+** instruction row is the row number.
+*/
+#define PROF_SCHEMA_STMT                                                    \
+  "CREATE TABLE xx("                                                        \
+  "  sql TEXT,              /* Text of SQL statement */"                    \
+  "  runs INTEGER,          /* Number of runs profiled */"                  \
+  "  rows INTEGER,          /* Rows returned */"                            \
+  "  vm_steps INTEGER,      /* VDBE instructions executed */"               \
+  "  cycles INTEGER,        /* Clock ticks spent in the VDBE */"            \
+  "  seeks INTEGER,         /* B-tree searches */"                          \
+  "  cache_hits INTEGER,    /* Page cache hits */"                          \
+  "  cache_misses INTEGER,  /* Page cache misses */"                        \
+  "  bytes_read INTEGER,    /* Bytes read from database and WAL files */"   \
+  "  fullscan_steps INTEGER,/* SQLITE_STMTSTATUS_FULLSCAN_STEP */"          \
+  "  sorts INTEGER,         /* SQLITE_STMTSTATUS_SORT */"                   \
+  "  autoindexes INTEGER    /* SQLITE_STMTSTATUS_AUTOINDEX */"              \
+  ");"
+
+#define PROF_SCHEMA_OPCODES                                                 \
+  "CREATE TABLE xx("                                                        \
+  "  sql TEXT,              /* Text of SQL statement */"                    \
+  "  addr INTEGER,          /* Address of instruction */"                   \
+  "  opcode TEXT,           /* Name of opcode */"                           \
+  "  p1 INTEGER,            /* P1 operand */"                               \
+  "  p2 INTEGER,            /* P2 operand */"                               \
+  "  p3 INTEGER,            /* P3 operand */"                               \
+  "  count INTEGER,         /* Number of times executed */"                 \
+  "  cycles INTEGER         /* Clock ticks spent executing it */"           \
+  ");"
+
+typedef struct ProfTable ProfTable;
+typedef struct ProfCursor ProfCursor;
+
+struct ProfTable {
+  sqlite3_vtab base;
+  sqlite3 *db;                    /* Connection that owns the profiles */
+  int bOpcodes;                   /* True for one row per instruction */
+};
+
+/*
+** A cursor iterates through a copy of the profiles taken by xFilter, as
+** the profiles may be changed or deleted while it is open.
+*/
+struct ProfCursor {
+  sqlite3_vtab_cursor base;
+  int nProfile;                   /* Number of profiles in aProfile[] */
+  StmtProfile *aProfile;          /* Copy of the profiles */
+  int iProfile;                   /* Current entry in aProfile[] */
+  int iOp;                        /* Current instruction (opcodes only) */
+  i64 iRowid;                     /* Rowid of current row (opcodes only) */
+};
+
+/*
+** Connect to or create a stmt_profile virtual table.
+*/
+static int profConnect(
+  sqlite3 *db,
+  void *pAux,
+  int argc, const char *const*argv,
+  sqlite3_vtab **ppVtab,
+  char **pzErr
+){
+  ProfTable *pTab;
+  int bOpcodes = 0;
+  int rc;
+
+  UNUSED_PARAMETER(pAux);
+  if( argc>4 || (argc==4 && sqlite3StrICmp(argv[3], "opcodes")!=0) ){
+    *pzErr = sqlite3_mprintf("stmt_profile: unknown argument");
+    return SQLITE_ERROR;
+  }
+  bOpcodes = (argc==4);
+
+  rc = sqlite3_declare_vtab(db,
+      bOpcodes ? PROF_SCHEMA_OPCODES : PROF_SCHEMA_STMT
+  );
+  if( rc!=SQLITE_OK ) return rc;
+
+  pTab = (ProfTable *)sqlite3_malloc(sizeof(ProfTable));
+  if( pTab==0 ) return SQLITE_NOMEM;
+  memset(pTab, 0, sizeof(ProfTable));
+  pTab->db = db;
+  pTab->bOpcodes = bOpcodes;
+  *ppVtab = &pTab->base;
+  return SQLITE_OK;
+}
+
+/*
+** Disconnect from or destroy a stmt_profile virtual table.
+*/
+static int profDisconnect(sqlite3_vtab *pVtab){
+  sqlite3_free(pVtab);
+  return SQLITE_OK;
+}
+
+/*
+** There is no way to use an index on a stmt_profile table.  Every query
+** is a full scan.
+*/
+static int profBestIndex(sqlite3_vtab *tab, sqlite3_index_info *pIdxInfo){
+  ProfTable *pTab = (ProfTable *)tab;
+  StmtProfiler *pProfiler = pTab->db->pStmtProfiler;
+  pIdxInfo->estimatedCost = pProfiler ? (double)pProfiler->nProfile : 1.0;
+  if( pTab->bOpcodes ) pIdxInfo->estimatedCost *= 50.0;
+  return SQLITE_OK;
+}
+
+/*
+** Open a new stmt_profile cursor.
+*/
+static int profOpen(sqlite3_vtab *pVTab, sqlite3_vtab_cursor **ppCursor){
+  ProfCursor *pCsr;
+  UNUSED_PARAMETER(pVTab);
+  pCsr = (ProfCursor *)sqlite3_malloc(sizeof(ProfCursor));
+  if( pCsr==0 ) return SQLITE_NOMEM;
+  memset(pCsr, 0, sizeof(ProfCursor));
+  *ppCursor = &pCsr->base;
+  return SQLITE_OK;
+}
+
+/*
+** Free the copy of the profiles held by cursor pCsr.
+*/
+static void profCursorReset(ProfCursor *pCsr){
+  int i;
+  for(i=0; i<pCsr->nProfile; i++){
+    sqlite3_free(pCsr->aProfile[i].zSql);
+    sqlite3_free(pCsr->aProfile[i].aOp);
+  }
+  sqlite3_free(pCsr->aProfile);
+  pCsr->aProfile = 0;
+  pCsr->nProfile = 0;
+  pCsr->iProfile = 0;
+  pCsr->iOp = 0;
+  pCsr->iRowid = 0;
+}
+
+/*
+** Close a stmt_profile cursor.
+*/
+static int profClose(sqlite3_vtab_cursor *pCursor){
+  ProfCursor *pCsr = (ProfCursor *)pCursor;
+  profCursorReset(pCsr);
+  sqlite3_free(pCsr);
+  return SQLITE_OK;
+}
+
+/*
+** Skip over profiles with no instructions, if this cursor iterates
+** through instructions.
+*/
+static void profSkipEmpty(ProfCursor *pCsr){
+  ProfTable *pTab = (ProfTable *)pCsr->base.pVtab;
+  if( pTab->bOpcodes ){
+    while( pCsr->iProfile<pCsr->nProfile
+        && pCsr->iOp>=pCsr->aProfile[pCsr->iProfile].nOp
+    ){
+      pCsr->iProfile++;
+      pCsr->iOp = 0;
+    }
+  }
+}
+
+/*
+** Copy the profiles recorded by the connection into the cursor and move
+** to the first row.
+*/
+static int profFilter(
+  sqlite3_vtab_cursor *pCursor,
+  int idxNum, const char *idxStr,
+  int argc, sqlite3_value **argv
+){
+  ProfCursor *pCsr = (ProfCursor *)pCursor;
+  ProfTable *pTab = (ProfTable *)pCursor->pVtab;
+  StmtProfiler *pProfiler = pTab->db->pStmtProfiler;
+  StmtProfile *pEntry;
+
+  UNUSED_PARAMETER(idxNum);
+  UNUSED_PARAMETER(idxStr);
+  UNUSED_PARAMETER(argc);
+  UNUSED_PARAMETER(argv);
+
+  profCursorReset(pCsr);
+  if( pProfiler==0 || pProfiler->nProfile==0 ) return SQLITE_OK;
+
+  pCsr->aProfile = (StmtProfile *)sqlite3_malloc(
+      pProfiler->nProfile*sizeof(StmtProfile)
+  );
+  if( pCsr->aProfile==0 ) return SQLITE_NOMEM;
+  for(pEntry=pProfiler->pFirst; pEntry; pEntry=pEntry->pNext){
+    StmtProfile *pCopy = &pCsr->aProfile[pCsr->nProfile++];
+    *pCopy = *pEntry;
+    pCopy->aOp = 0;
+    pCopy->pNext = pCopy->pHashNext = 0;
+    pCopy->zSql = sqlite3_mprintf("%s", pEntry->zSql);
+    if( pCopy->zSql==0 ) return SQLITE_NOMEM;
+    if( pTab->bOpcodes && pEntry->nOp ){
+      int nByte = pEntry->nOp*sizeof(StmtProfileOp);
+      pCopy->aOp = (StmtProfileOp *)sqlite3_malloc(nByte);
+      if( pCopy->aOp==0 ) return SQLITE_NOMEM;
+      memcpy(pCopy->aOp, pEntry->aOp, nByte);
+    }else{
+      pCopy->nOp = 0;
+    }
+  }
+  assert( pCsr->nProfile==pProfiler->nProfile );
+
+  profSkipEmpty(pCsr);
+  pCsr->iRowid = 1;
+  return SQLITE_OK;
+}
+
+/*
+** Move a stmt_profile cursor to the next row.
+*/
+static int profNext(sqlite3_vtab_cursor *pCursor){
+  ProfCursor *pCsr = (ProfCursor *)pCursor;
+  ProfTable *pTab = (ProfTable *)pCursor->pVtab;
+  if( pTab->bOpcodes ){
+    pCsr->iOp++;
+    pCsr->iRowid++;
+    profSkipEmpty(pCsr);
+  }else{
+    pCsr->iProfile++;
+  }
+  return SQLITE_OK;
+}
+
+static int profEof(sqlite3_vtab_cursor *pCursor){
+  ProfCursor *pCsr = (ProfCursor *)pCursor;
+  return pCsr->iProfile>=pCsr->nProfile;
+}
+
+static int profColumn(
+  sqlite3_vtab_cursor *pCursor,
+  sqlite3_context *ctx,
+  int i
+){
+  ProfCursor *pCsr = (ProfCursor *)pCursor;
+  ProfTable *pTab = (ProfTable *)pCursor->pVtab;
+  StmtProfile *pEntry = &pCsr->aProfile[pCsr->iProfile];
+
+  if( i==0 ){
+    sqlite3_result_text(ctx, pEntry->zSql, -1, SQLITE_TRANSIENT);
+  }else if( pTab->bOpcodes ){
+    StmtProfileOp *pOp = &pEntry->aOp[pCsr->iOp];
+    switch( i ){
+      case 1:                     /* addr */
+        sqlite3_result_int(ctx, pCsr->iOp);
+        break;
+      case 2:                     /* opcode */
+#if !defined(SQLITE_OMIT_EXPLAIN) || !defined(NDEBUG) \
+ || defined(VDBE_PROFILE) || defined(SQLITE_DEBUG)
+        sqlite3_result_text(ctx, sqlite3OpcodeName(pOp->opcode), -1,
+                            SQLITE_STATIC);
+#else
+        sqlite3_result_int(ctx, pOp->opcode);
+#endif
+        break;
+      case 3:                     /* p1 */
+        sqlite3_result_int(ctx, pOp->p1);
+        break;
+      case 4:                     /* p2 */
+        sqlite3_result_int(ctx, pOp->p2);
+        break;
+      case 5:                     /* p3 */
+        sqlite3_result_int(ctx, pOp->p3);
+        break;
+      case 6:                     /* count */
+        sqlite3_result_int64(ctx, (i64)pOp->nExec);
+        break;
+      default:                    /* cycles */
+        assert( i==7 );
+        sqlite3_result_int64(ctx, (i64)pOp->nCycle);
+        break;
+    }
+  }else if( i==1 ){               /* runs */
+    sqlite3_result_int64(ctx, pEntry->nRun);
+  }else{
+    /* The remaining columns are in the same order as aStat[]. */
+    assert( i>=2 && i<2+VDBE_PROF_N );
+    sqlite3_result_int64(ctx, (i64)pEntry->aStat[i-2]);
+  }
+  return SQLITE_OK;
+}
+
+static int profRowid(sqlite3_vtab_cursor *pCursor, sqlite_int64 *pRowid){
+  ProfCursor *pCsr = (ProfCursor *)pCursor;
+  ProfTable *pTab = (ProfTable *)pCursor->pVtab;
+  if( pTab->bOpcodes ){
+    *pRowid = pCsr->iRowid;
+  }else{
+    *pRowid = pCsr->aProfile[pCsr->iProfile].iId;
+  }
+  return SQLITE_OK;
+}
+
+/*
+** The only change that may be made to a stmt_profile table is to DELETE
+** rows from a table with one row per statement, which discards the
+** profiles of those statements.
+*/
+static int profUpdate(
+  sqlite3_vtab *pVtab,
+  int argc,
+  sqlite3_value **argv,
+  sqlite_int64 *pRowid
+){
+  ProfTable *pTab = (ProfTable *)pVtab;
+  StmtProfiler *pProfiler = pTab->db->pStmtProfiler;
+  StmtProfile *pEntry;
+  i64 iId;
+
+  UNUSED_PARAMETER(pRowid);
+  if( argc!=1 || pTab->bOpcodes ){
+    sqlite3_free(pVtab->zErrMsg);
+    pVtab->zErrMsg = sqlite3_mprintf(
+        "rows may only be deleted from a stmt_profile table"
+    );
+    return SQLITE_ERROR;
+  }
+  iId = sqlite3_value_int64(argv[0]);
+  for(pEntry=(pProfiler ? pProfiler->pFirst : 0); pEntry; pEntry=pEntry->pNext){
+    if( pEntry->iId==iId ){
+      profileDelete(pTab->db, pEntry);
+      break;
+    }
+  }
+  return SQLITE_OK;
+}
+
+/*
+** Register the stmt_profile virtual table module with connection db.
+** This is called as each connection is opened.
+*/
+int sqlite3StmtProfileInit(sqlite3 *db){
+  static sqlite3_module stmt_profile_module = {
+    0,                            /* iVersion */
+    profConnect,                  /* xCreate */
+    profConnect,                  /* xConnect */
+    profBestIndex,                /* xBestIndex */
+    profDisconnect,               /* xDisconnect */
+    profDisconnect,               /* xDestroy */
+    profOpen,                     /* xOpen - open a cursor */
+    profClose,                    /* xClose - close a cursor */
+    profFilter,                   /* xFilter - configure scan constraints */
+    profNext,                     /* xNext - advance a cursor */
+    profEof,                      /* xEof - check for end of scan */
+    profColumn,                   /* xColumn - read data */
+    profRowid,                    /* xRowid - read data */
+    profUpdate,                   /* xUpdate */
+    0,                            /* xBegin */
+    0,                            /* xSync */
+    0,                            /* xCommit */
+    0,                            /* xRollback */
+    0,                            /* xFindMethod */
+    0,                            /* xRename */
+  };
+  return sqlite3_create_module(db, "stmt_profile", &stmt_profile_module, 0);
+}
+
+#endif /* SQLITE_OMIT_VIRTUALTABLE */
+#endif /* SQLITE_OMIT_STMT_PROFILE */
@@ -0,0 +1,1115 @@
+/*
+** 2011 September 1
+**
+** The author disclaims copyright to this source code.  In place of
+** a legal notice, here is a blessing:
+**
+**    May you do good and not evil.
+**    May you find forgiveness for yourself and forgive others.
+**    May you share freely, never taking more than you give.
+**
+*************************************************************************
+**
+** This file contains code for the VdbeSorter object, used in concert with
+** a VdbeCursor to sort large numbers of keys (as may be required, for
+** example, by CREATE INDEX statements or by SELECT statements with
+** ORDER BY clauses that cannot be satisfied using indexes).
+**
+** Keys are accumulated in memory in a linked list.  When the list grows
+** larger than the memory budget of the sorter, it is sorted and written
+** to a temporary file as a "Packed Memory Array" (PMA).  Once all keys
+** have been added, the PMAs are merged together, SORTER_MAX_MERGE_COUNT
+** at a time, until few enough remain that they can be merged in a single
+** pass while the keys are read back by the VM.  If no PMAs were written,
+** the in-memory list is simply sorted and returned.
+**
+** A PMA consists of a varint containing the size of the PMA in bytes (not
+** including the varint itself), followed by the keys in sorted order.
+** Each key is stored as a varint containing the size of the key in bytes
+** followed by the key itself.
+**
+** If "PRAGMA threads" is set to a non-zero value, lists are sorted and
+** written to disk by worker threads while the VM continues to add keys.
+** Each worker writes its PMAs to its own temporary file.
+*/
+
+#include "sqliteInt.h"
+#include "vdbeInt.h"
+
+#ifndef SQLITE_OMIT_MERGE_SORT
+
+/*
+** Worker threads are only used by threadsafe builds on unix.
+*/
+#if SQLITE_THREADSAFE && SQLITE_OS_UNIX && SQLITE_MAX_WORKER_THREADS>0
+# define SORTER_THREADS 1
+# include <pthread.h>
+#else
+# define SORTER_THREADS 0
+#endif
+
+/*
+** The maximum number of PMAs merged in a single pass.  This must be a
+** power of two.
+*/
+#define SORTER_MAX_MERGE_COUNT 16
+
+/*
+** Hard upper bound on the memory budget of a single sorter, in bytes.
+*/
+#define SORTER_MAX_PMASZ (1<<29)
+
+#ifndef MIN
+# define MIN(x,y) ((x)<(y)?(x):(y))
+#endif
+
+typedef struct SorterRecord SorterRecord;
+typedef struct SorterPma SorterPma;
+typedef struct SorterTask SorterTask;
+typedef struct SorterIter SorterIter;
+typedef struct SorterMerger SorterMerger;
+typedef struct FileWriter FileWriter;
+
+/*
+** A key held in memory.  The nVal bytes of key data immediately follow
+** this structure in the same allocation.  Records are allocated using
+** sqlite3Malloc() (not the lookaside allocator) so that they may be freed
+** by a worker thread.
+*/
+struct SorterRecord {
+  int nVal;                       /* Size of the key in bytes */
+  SorterRecord *pNext;            /* Next key in list */
+};
+#define SRVAL(p) ((void*)((SorterRecord*)(p) + 1))
+
+/*
+** The location of a PMA within a temporary file.
+*/
+struct SorterPma {
+  sqlite3_file *pFd;              /* File containing the PMA */
+  i64 iOff;                       /* Offset of the PMA within pFd */
+  i64 nByte;                      /* Size of the PMA, including its header */
+};
+
+/*
+** A buffered writer used to write PMAs sequentially to a temporary file.
+** Writes are aligned to multiples of the buffer size where possible.
+*/
+struct FileWriter {
+  int eFWErr;                     /* Non-zero if in an error state */
+  u8 *aBuffer;                    /* Write buffer */
+  int nBuffer;                    /* Size of aBuffer[] in bytes */
+  int iBufStart;                  /* First byte of aBuffer[] to write */
+  int iBufEnd;                    /* Last byte of aBuffer[] to write */
+  i64 iWriteOff;                  /* File offset of aBuffer[0] */
+  sqlite3_file *pFd;              /* File to write to */
+};
+
+/*
+** A task sorts a list of keys and writes it to a temporary file as a PMA.
+** There is one task for each worker thread, or a single task that is
+** always run by the calling thread if worker threads are not in use.
+**
+** While a worker thread is running (bRunning is true) the thread that
+** owns the sorter does not access the pList, aBuffer or aSpace fields of
+** the task.  The owner waits for the worker using vdbeSorterJoin()
+** before starting another job on the same task.
+*/
+struct SorterTask {
+  VdbeSorter *pSorter;            /* Sorter that owns this task */
+  char *aSpace;                   /* Space used to unpack keys */
+  int szSpace;                    /* Size of aSpace[] in bytes */
+  UnpackedRecord *pUnpacked;      /* Most recently unpacked key */
+  u8 *aBuffer;                    /* Write buffer for PMAs */
+  sqlite3_file *pFd;              /* Temporary file PMAs are written to */
+  i64 iEof;                       /* End of the last PMA queued for pFd */
+  SorterRecord *pList;            /* Keys to sort and write out */
+  i64 nList;                      /* Size of pList in PMA format */
+  i64 iOff;                       /* Offset within pFd to write pList to */
+  int rc;                         /* Error code from a worker thread */
+#if SORTER_THREADS
+  int bRunning;                   /* True while a worker thread is running */
+  pthread_t tid;                  /* The worker thread, if bRunning */
+#endif
+};
+
+/*
+** An iterator reads the keys of a single PMA in order.  pFd is set to
+** NULL once the iterator has reached the end of the PMA.
+*/
+struct SorterIter {
+  sqlite3_file *pFd;              /* File being read, or NULL at EOF */
+  i64 iReadOff;                   /* File offset of the next byte to read */
+  i64 iEof;                       /* First byte past the end of the PMA */
+  u8 *aBuffer;                    /* Read buffer */
+  int nBuffer;                    /* Size of aBuffer[] in bytes */
+  int nBufData;                   /* Bytes of valid data in aBuffer[] */
+  int iBufPos;                    /* Offset of next unread byte in aBuffer[] */
+  u8 *aAlloc;                     /* Space for keys that span buffers */
+  int nAlloc;                     /* Size of aAlloc[] in bytes */
+  u8 *aKey;                       /* Current key */
+  int nKey;                       /* Size of aKey in bytes */
+};
+
+/*
+** A merger combines the output of up to SORTER_MAX_MERGE_COUNT iterators.
+**
+** aTree[] is a tournament tree.  Each entry aTree[i] for 1<=i<nTree holds
+** the index of the iterator with the smaller current key of its two
+** children.  The children of entry i are entries 2*i and 2*i+1, except
+** that the children of entries nTree/2 and greater are the iterators
+** themselves.  So aTree[1] is always the index of the iterator with the
+** smallest current key.  An iterator at EOF compares larger than any key.
+*/
+struct SorterMerger {
+  int nTree;                      /* Number of aIter[] entries (power of 2) */
+  int *aTree;                     /* Tournament tree */
+  SorterIter *aIter;              /* Iterators being merged */
+};
+
+/*
+** Main sorter structure.  A single instance of this is allocated for
+** each sorter cursor created by the VDBE.
+*/
+struct VdbeSorter {
+  int pgsz;                       /* Page size of the main database */
+  int mnPmaSize;                  /* Minimum PMA size, in bytes */
+  int mxPmaSize;                  /* Memory budget.  0 means never spill */
+  int nMemory;                    /* Memory used by pRecord, in bytes */
+  i64 nInMemory;                  /* Size of pRecord in PMA format */
+  SorterRecord *pRecord;          /* Keys accumulated in memory */
+  KeyInfo *pKeyInfo;              /* Copy of the cursor KeyInfo, db==0 */
+  int nTask;                      /* Number of entries in aTask[] */
+  int iTask;                      /* Task to use for the next flush */
+  int bThreads;                   /* True to run tasks in worker threads */
+  SorterTask *aTask;              /* Tasks used to write PMAs */
+  int nPma;                       /* Number of entries in aPma[] */
+  int nPmaAlloc;                  /* Allocated size of aPma[] */
+  SorterPma *aPma;                /* All PMAs written so far */
+  sqlite3_file *pMergeFd;         /* File written by the last merge pass */
+  SorterMerger *pMerger;          /* Merger used to read back keys */
+};
+
+/*
+** Free the list of records passed as the only argument.
+*/
+static void vdbeSorterRecordFree(SorterRecord *pRecord){
+  SorterRecord *p;
+  SorterRecord *pNext;
+  for(p=pRecord; p; p=pNext){
+    pNext = p->pNext;
+    sqlite3_free(p);
+  }
+}
+
+/*
+** Compare key1 (buffer pKey1, size nKey1 bytes) with key2 (buffer pKey2,
+** size nKey2 bytes) and return a value less than, equal to or greater
+** than zero as key1 is smaller than, equal to or larger than key2.
+**
+** If pKey2 is NULL, then key2 is the key most recently unpacked into
+** the space belonging to task pTask.  Since the merge routines compare
+** each key against several others in turn, this saves unpacking the
+** same key repeatedly.
+*/
+static int vdbeSorterCompare(
+  SorterTask *pTask,              /* Task owning the unpacked-record space */
+  const void *pKey1, int nKey1,   /* Left side of comparison */
+  const void *pKey2, int nKey2    /* Right side of comparison */
+){
+  if( pKey2 ){
+    pTask->pUnpacked = sqlite3VdbeRecordUnpack(pTask->pSorter->pKeyInfo,
+        nKey2, pKey2, pTask->aSpace, pTask->szSpace
+    );
+    assert( pTask->pUnpacked );
+    assert( (pTask->pUnpacked->flags & UNPACKED_NEED_FREE)==0 );
+  }
+  return sqlite3VdbeRecordCompare(nKey1, pKey1, pTask->pUnpacked);
+}
+
+/*
+** Merge the two sorted lists p1 and p2 into a single list.  Set *ppOut
+** to point to the head of the merged list.
+*/
+static void vdbeSorterMerge(
+  SorterTask *pTask,              /* Task owning the unpacked-record space */
+  SorterRecord *p1,               /* First list to merge */
+  SorterRecord *p2,               /* Second list to merge */
+  SorterRecord **ppOut            /* OUT: Head of merged list */
+){
+  SorterRecord *pFinal = 0;
+  SorterRecord **pp = &pFinal;
+  void *pVal2 = p2 ? SRVAL(p2) : 0;
+
+  while( p1 && p2 ){
+    int res;
+    res = vdbeSorterCompare(pTask, SRVAL(p1), p1->nVal, pVal2, p2->nVal);
+    if( res<=0 ){
+      *pp = p1;
+      pp = &p1->pNext;
+      p1 = p1->pNext;
+      pVal2 = 0;
+    }else{
+      *pp = p2;
+      pp = &p2->pNext;
+      p2 = p2->pNext;
+      if( p2==0 ) break;
+      pVal2 = SRVAL(p2);
+    }
+  }
+  *pp = p1 ? p1 : p2;
+  *ppOut = pFinal;
+}
+
+/*
+** Sort the linked list of records headed at *ppList using a bottom-up
+** merge sort.
+*/
+static void vdbeSorterSort(SorterTask *pTask, SorterRecord **ppList){
+  int i;
+  SorterRecord *p = *ppList;
+  SorterRecord *aSlot[64];
+
+  memset(aSlot, 0, sizeof(aSlot));
+  while( p ){
+    SorterRecord *pNext = p->pNext;
+    p->pNext = 0;
+    for(i=0; aSlot[i]; i++){
+      vdbeSorterMerge(pTask, p, aSlot[i], &p);
+      aSlot[i] = 0;
+    }
+    aSlot[i] = p;
+    p = pNext;
+  }
+
+  p = 0;
+  for(i=0; i<64; i++){
+    vdbeSorterMerge(pTask, p, aSlot[i], &p);
+  }
+  *ppList = p;
+}
+
+/*
+** Initialize a FileWriter to write to file pFd, starting at offset
+** iStart, using buffer aBuffer (nBuffer bytes in size).
+*/
+static void fileWriterInit(
+  FileWriter *p,
+  sqlite3_file *pFd,
+  u8 *aBuffer,
+  int nBuffer,
+  i64 iStart
+){
+  memset(p, 0, sizeof(FileWriter));
+  p->aBuffer = aBuffer;
+  p->nBuffer = nBuffer;
+  p->iBufEnd = p->iBufStart = (int)(iStart % nBuffer);
+  p->iWriteOff = iStart - p->iBufStart;
+  p->pFd = pFd;
+}
+
+/*
+** Write nData bytes of data to the file-write object.
+*/
+static void fileWriterWrite(FileWriter *p, const u8 *pData, int nData){
+  int nRem = nData;
+  while( nRem>0 && p->eFWErr==0 ){
+    int nCopy = nRem;
+    if( nCopy>(p->nBuffer - p->iBufEnd) ){
+      nCopy = p->nBuffer - p->iBufEnd;
+    }
+    memcpy(&p->aBuffer[p->iBufEnd], &pData[nData-nRem], nCopy);
+    p->iBufEnd += nCopy;
+    if( p->iBufEnd==p->nBuffer ){
+      p->eFWErr = sqlite3OsWrite(p->pFd,
+          &p->aBuffer[p->iBufStart], p->iBufEnd - p->iBufStart,
+          p->iWriteOff + p->iBufStart
+      );
+      p->iBufStart = p->iBufEnd = 0;
+      p->iWriteOff += p->nBuffer;
+    }
+    assert( p->iBufEnd<p->nBuffer );
+    nRem -= nCopy;
+  }
+}
+
+/*
+** Write value iVal encoded as a varint to the file-write object.
+*/
+static void fileWriterWriteVarint(FileWriter *p, u64 iVal){
+  int nByte;
+  u8 aByte[10];
+  nByte = sqlite3PutVarint(aByte, iVal);
+  fileWriterWrite(p, aByte, nByte);
+}
+
+/*
+** Flush any buffered data to disk.  Set *piEof to the offset of the byte
+** immediately following the last byte written and return SQLITE_OK, or
+** return an SQLite error code if an error occurred at any point.
+*/
+static int fileWriterFinish(FileWriter *p, i64 *piEof){
+  if( p->eFWErr==0 && p->iBufEnd>p->iBufStart ){
+    p->eFWErr = sqlite3OsWrite(p->pFd,
+        &p->aBuffer[p->iBufStart], p->iBufEnd - p->iBufStart,
+        p->iWriteOff + p->iBufStart
+    );
+  }
+  *piEof = p->iWriteOff + p->iBufEnd;
+  return p->eFWErr;
+}
+
+/*
+** Sort the list of keys attached to task pTask and write it to the
+** task's temporary file at offset pTask->iOff.  The keys are freed as
+** they are written.  This function may be called from a worker thread.
+*/
+static int vdbeSorterListToPMA(SorterTask *pTask){
+  VdbeSorter *pSorter = pTask->pSorter;
+  FileWriter writer;
+  SorterRecord *p;
+  SorterRecord *pNext;
+  i64 iEof;
+  int rc;
+
+  vdbeSorterSort(pTask, &pTask->pList);
+  fileWriterInit(&writer, pTask->pFd, pTask->aBuffer, pSorter->pgsz,
+                 pTask->iOff);
+  fileWriterWriteVarint(&writer, pTask->nList);
+  for(p=pTask->pList; p; p=pNext){
+    pNext = p->pNext;
+    fileWriterWriteVarint(&writer, p->nVal);
+    fileWriterWrite(&writer, SRVAL(p), p->nVal);
+    sqlite3_free(p);
+  }
+  pTask->pList = 0;
+  rc = fileWriterFinish(&writer, &iEof);
+  assert( rc!=SQLITE_OK
+       || iEof==pTask->iOff+sqlite3VarintLen(pTask->nList)+pTask->nList );
+  return rc;
+}
+
+#if SORTER_THREADS
+/*
+** Entry point for worker threads.
+*/
+static void *vdbeSorterThreadMain(void *pCtx){
+  SorterTask *pTask = (SorterTask*)pCtx;
+  pTask->rc = vdbeSorterListToPMA(pTask);
+  return 0;
+}
+#endif
+
+/*
+** Wait for the worker thread running task pTask, if any, to finish.
+** Return the error code reported by the worker.
+*/
+static int vdbeSorterJoin(SorterTask *pTask){
+#if SORTER_THREADS
+  if( pTask->bRunning ){
+    pthread_join(pTask->tid, 0);
+    pTask->bRunning = 0;
+  }
+#endif
+  return pTask->rc;
+}
+
+/*
+** Wait for all worker threads belonging to sorter pSorter to finish.
+*/
+static int vdbeSorterJoinAll(VdbeSorter *pSorter){
+  int rc = SQLITE_OK;
+  int i;
+  for(i=0; i<pSorter->nTask; i++){
+    int rc2 = vdbeSorterJoin(&pSorter->aTask[i]);
+    if( rc==SQLITE_OK ) rc = rc2;
+  }
+  return rc;
+}
+
+/*
+** Open a temporary file for use by the sorter.
+*/
+static int vdbeSorterOpenTempFile(sqlite3 *db, sqlite3_file **ppFile){
+  int dummy;
+  return sqlite3OsOpenMalloc(db->pVfs, 0, ppFile,
+      SQLITE_OPEN_TEMP_JOURNAL |
+      SQLITE_OPEN_READWRITE    | SQLITE_OPEN_CREATE |
+      SQLITE_OPEN_EXCLUSIVE    | SQLITE_OPEN_DELETEONCLOSE, &dummy
+  );
+}
+
+/*
+** Hand the list of keys currently held in memory to the next task, which
+** sorts it and writes it out as a new PMA.  If worker threads are in use
+** the work is done in the background and this function returns as soon
+** as the thread has been started.  Otherwise, or if the thread cannot be
+** started, the work is done before returning.
+*/
+static int vdbeSorterFlush(sqlite3 *db, VdbeSorter *pSorter){
+  SorterTask *pTask;
+  SorterPma *pPma;
+  int rc;
+
+  pTask = &pSorter->aTask[pSorter->iTask];
+  pSorter->iTask = (pSorter->iTask + 1) % pSorter->nTask;
+
+  rc = vdbeSorterJoin(pTask);
+  if( rc==SQLITE_OK && pTask->pFd==0 ){
+    rc = vdbeSorterOpenTempFile(db, &pTask->pFd);
+    assert( rc!=SQLITE_OK || pTask->pFd );
+  }
+  if( rc==SQLITE_OK && pTask->aBuffer==0 ){
+    pTask->aBuffer = (u8*)sqlite3Malloc(pSorter->pgsz);
+    if( pTask->aBuffer==0 ) rc = SQLITE_NOMEM;
+  }
+  if( rc==SQLITE_OK && pSorter->nPma>=pSorter->nPmaAlloc ){
+    int nNew = pSorter->nPmaAlloc ? pSorter->nPmaAlloc*2 : 16;
+    SorterPma *aNew;
+    aNew = sqlite3DbRealloc(db, pSorter->aPma, nNew*sizeof(SorterPma));
+    if( aNew==0 ){
+      rc = SQLITE_NOMEM;
+    }else{
+      pSorter->aPma = aNew;
+      pSorter->nPmaAlloc = nNew;
+    }
+  }
+  if( rc!=SQLITE_OK ) return rc;
+
+  /* The size of the new PMA is already known, so its location can be
+  ** recorded (and space in the file reserved for it) before it is
+  ** written.  This way only the task itself touches the file contents. */
+  pPma = &pSorter->aPma[pSorter->nPma++];
+  pPma->pFd = pTask->pFd;
+  pPma->iOff = pTask->iEof;
+  pPma->nByte = sqlite3VarintLen(pSorter->nInMemory) + pSorter->nInMemory;
+  pTask->iOff = pTask->iEof;
+  pTask->iEof += pPma->nByte;
+
+  pTask->pList = pSorter->pRecord;
+  pTask->nList = pSorter->nInMemory;
+  pSorter->pRecord = 0;
+  pSorter->nInMemory = 0;
+  pSorter->nMemory = 0;
+
+#if SORTER_THREADS
+  if( pSorter->bThreads ){
+    if( pthread_create(&pTask->tid, 0, vdbeSorterThreadMain, pTask)==0 ){
+      pTask->bRunning = 1;
+      return SQLITE_OK;
+    }
+  }
+#endif
+  return vdbeSorterListToPMA(pTask);
+}
+
+/*
+** Free all memory belonging to iterator pIter and zero it.
+*/
+static void vdbeSorterIterZero(SorterIter *pIter){
+  sqlite3_free(pIter->aBuffer);
+  sqlite3_free(pIter->aAlloc);
+  memset(pIter, 0, sizeof(SorterIter));
+}
+
+/*
+** Read the next block of the PMA into the read buffer of iterator p.
+** Reads are aligned to multiples of the buffer size.
+*/
+static int vdbeSorterIterFill(SorterIter *p){
+  int nRead;
+  int rc;
+  if( p->iReadOff>=p->iEof ) return SQLITE_CORRUPT_BKPT;
+  nRead = p->nBuffer - (int)(p->iReadOff % p->nBuffer);
+  if( nRead>p->iEof - p->iReadOff ){
+    nRead = (int)(p->iEof - p->iReadOff);
+  }
+  rc = sqlite3OsRead(p->pFd, p->aBuffer, nRead, p->iReadOff);
+  p->iBufPos = 0;
+  p->nBufData = (rc==SQLITE_OK ? nRead : 0);
+  return rc;
+}
+
+/*
+** Read the next nByte bytes of data from the PMA p.  If successful, set
+** *ppOut to point to a buffer containing the data and return SQLITE_OK.
+** The buffer remains valid until the next call to this function for the
+** same iterator.
+*/
+static int vdbeSorterIterRead(SorterIter *p, int nByte, u8 **ppOut){
+  int nCopied;
+  int rc;
+
+  if( p->iBufPos==p->nBufData ){
+    rc = vdbeSorterIterFill(p);
+    if( rc!=SQLITE_OK ) return rc;
+  }
+  if( nByte<=p->nBufData-p->iBufPos ){
+    *ppOut = &p->aBuffer[p->iBufPos];
+    p->iBufPos += nByte;
+    p->iReadOff += nByte;
+    return SQLITE_OK;
+  }
+
+  /* The requested data spans more than one buffer.  Assemble it in the
+  ** aAlloc[] space. */
+  if( p->nAlloc<nByte ){
+    u8 *aNew;
+    int nNew = p->nAlloc ? p->nAlloc : 128;
+    while( nNew<nByte ) nNew = nNew*2;
+    aNew = sqlite3Realloc(p->aAlloc, nNew);
+    if( !aNew ) return SQLITE_NOMEM;
+    p->nAlloc = nNew;
+    p->aAlloc = aNew;
+  }
+  nCopied = 0;
+  while( nCopied<nByte ){
+    int nCopy;
+    if( p->iBufPos==p->nBufData ){
+      rc = vdbeSorterIterFill(p);
+      if( rc!=SQLITE_OK ) return rc;
+    }
+    nCopy = nByte - nCopied;
+    if( nCopy>p->nBufData-p->iBufPos ) nCopy = p->nBufData - p->iBufPos;
+    memcpy(&p->aAlloc[nCopied], &p->aBuffer[p->iBufPos], nCopy);
+    p->iBufPos += nCopy;
+    p->iReadOff += nCopy;
+    nCopied += nCopy;
+  }
+  *ppOut = p->aAlloc;
+  return SQLITE_OK;
+}
+
+/*
+** Read a varint from the PMA p and store its value in *pnOut.
+*/
+static int vdbeSorterIterVarint(SorterIter *p, u64 *pnOut){
+  if( p->nBufData-p->iBufPos>=9 ){
+    int n = sqlite3GetVarint(&p->aBuffer[p->iBufPos], pnOut);
+    p->iBufPos += n;
+    p->iReadOff += n;
+  }else{
+    u8 aVarint[16];
+    u8 *a;
+    int i = 0;
+    do{
+      int rc = vdbeSorterIterRead(p, 1, &a);
+      if( rc!=SQLITE_OK ) return rc;
+      aVarint[(i++)&0xf] = a[0];
+    }while( (a[0]&0x80)!=0 );
+    sqlite3GetVarint(aVarint, pnOut);
+  }
+  return SQLITE_OK;
+}
+
+/*
+** Advance iterator pIter to the next key in its PMA.  If there are no
+** more keys, zero the iterator (which sets pIter->pFd to NULL).
+*/
+static int vdbeSorterIterNext(SorterIter *pIter){
+  u64 nRec = 0;
+  int rc;
+
+  if( pIter->iReadOff>=pIter->iEof ){
+    vdbeSorterIterZero(pIter);
+    return SQLITE_OK;
+  }
+  rc = vdbeSorterIterVarint(pIter, &nRec);
+  if( rc==SQLITE_OK ){
+    pIter->nKey = (int)nRec;
+    rc = vdbeSorterIterRead(pIter, (int)nRec, &pIter->aKey);
+  }
+  return rc;
+}
+
+/*
+** Initialize iterator pIter to read the PMA described by pPma and load
+** its first key.  Set *pnByte to the size of the PMA content (the value
+** stored in the PMA header).
+*/
+static int vdbeSorterIterInit(
+  VdbeSorter *pSorter,            /* Sorter object */
+  const SorterPma *pPma,          /* PMA to read */
+  SorterIter *pIter,              /* Iterator to initialize */
+  i64 *pnByte                     /* OUT: Size of PMA content */
+){
+  u64 nByte = 0;
+  int rc;
+
+  assert( pIter->aBuffer==0 );
+  pIter->pFd = pPma->pFd;
+  pIter->iReadOff = pPma->iOff;
+  pIter->iEof = pPma->iOff + pPma->nByte;
+  pIter->nBuffer = pSorter->pgsz;
+  pIter->aBuffer = (u8*)sqlite3Malloc(pIter->nBuffer);
+  if( !pIter->aBuffer ) return SQLITE_NOMEM;
+
+  rc = vdbeSorterIterVarint(pIter, &nByte);
+  if( rc==SQLITE_OK && pIter->iReadOff+(i64)nByte!=pIter->iEof ){
+    rc = SQLITE_CORRUPT_BKPT;
+  }
+  *pnByte = (i64)nByte;
+  if( rc==SQLITE_OK ){
+    rc = vdbeSorterIterNext(pIter);
+  }
+  return rc;
+}
+
+/*
+** Recompute entry iOut of the tournament tree of merger p.
+*/
+static void vdbeSorterDoCompare(
+  VdbeSorter *pSorter,            /* Sorter object */
+  SorterMerger *p,                /* Merger object */
+  int iOut                        /* Entry of aTree[] to update */
+){
+  int i1;
+  int i2;
+  int iRes;
+  SorterIter *p1;
+  SorterIter *p2;
+
+  assert( iOut<p->nTree && iOut>0 );
+  if( iOut>=(p->nTree/2) ){
+    i1 = (iOut - p->nTree/2) * 2;
+    i2 = i1 + 1;
+  }else{
+    i1 = p->aTree[iOut*2];
+    i2 = p->aTree[iOut*2+1];
+  }
+  p1 = &p->aIter[i1];
+  p2 = &p->aIter[i2];
+
+  if( p1->pFd==0 ){
+    iRes = i2;
+  }else if( p2->pFd==0 ){
+    iRes = i1;
+  }else{
+    int res = vdbeSorterCompare(&pSorter->aTask[0],
+        p1->aKey, p1->nKey, p2->aKey, p2->nKey
+    );
+    iRes = (res<=0) ? i1 : i2;
+  }
+  p->aTree[iOut] = iRes;
+}
+
+/*
+** Free a merger object and all of its iterators.
+*/
+static void vdbeSorterMergerFree(sqlite3 *db, SorterMerger *p){
+  if( p ){
+    int i;
+    for(i=0; i<p->nTree; i++){
+      vdbeSorterIterZero(&p->aIter[i]);
+    }
+    sqlite3DbFree(db, p);
+  }
+}
+
+/*
+** Allocate a merger for the nPma PMAs in array aPma[], which must contain
+** no more than SORTER_MAX_MERGE_COUNT entries.  *ppOut is set to point to
+** the new merger even if an error occurs, so that the caller may free
+** it.  *pnByte is set to the total size of the content of the PMAs.
+*/
+static int vdbeSorterMergerInit(
+  sqlite3 *db,                    /* Database handle */
+  VdbeSorter *pSorter,            /* Sorter object */
+  const SorterPma *aPma,          /* PMAs to merge */
+  int nPma,                       /* Number of entries in aPma[] */
+  SorterMerger **ppOut,           /* OUT: New merger object */
+  i64 *pnByte                     /* OUT: Total size of PMA content */
+){
+  SorterMerger *p;
+  int rc = SQLITE_OK;
+  int nByte;
+  int N = 2;
+  int i;
+
+  assert( nPma>0 && nPma<=SORTER_MAX_MERGE_COUNT );
+  while( N<nPma ) N += N;
+  nByte = ROUND8(sizeof(SorterMerger)) + N*(sizeof(SorterIter)+sizeof(int));
+  *ppOut = p = (SorterMerger*)sqlite3DbMallocZero(db, nByte);
+  if( !p ) return SQLITE_NOMEM;
+  p->aIter = (SorterIter*)&((u8*)p)[ROUND8(sizeof(SorterMerger))];
+  p->aTree = (int*)&p->aIter[N];
+  p->nTree = N;
+
+  *pnByte = 0;
+  for(i=0; i<nPma && rc==SQLITE_OK; i++){
+    i64 nPmaByte = 0;
+    rc = vdbeSorterIterInit(pSorter, &aPma[i], &p->aIter[i], &nPmaByte);
+    *pnByte += nPmaByte;
+  }
+  for(i=N-1; rc==SQLITE_OK && i>0; i--){
+    vdbeSorterDoCompare(pSorter, p, i);
+  }
+  return rc;
+}
+
+/*
+** Advance merger p to the next key.
+*/
+static int vdbeSorterMergerNext(VdbeSorter *pSorter, SorterMerger *p){
+  int iPrev = p->aTree[1];
+  int rc;
+  int i;
+
+  rc = vdbeSorterIterNext(&p->aIter[iPrev]);
+  for(i=(p->nTree+iPrev)/2; rc==SQLITE_OK && i>0; i=i/2){
+    vdbeSorterDoCompare(pSorter, p, i);
+  }
+  return rc;
+}
+
+/*
+** Merge the PMAs of sorter pSorter in groups of SORTER_MAX_MERGE_COUNT,
+** writing the results to a new temporary file.  The files containing the
+** input PMAs are closed once the pass is complete.
+*/
+static int vdbeSorterMergePass(sqlite3 *db, VdbeSorter *pSorter){
+  sqlite3_file *pOut = 0;
+  SorterPma *aNew;
+  int nNew = 0;
+  int nAlloc;
+  u8 *aBuffer = 0;
+  i64 iOff = 0;
+  int rc;
+  int i;
+
+  nAlloc = (pSorter->nPma + SORTER_MAX_MERGE_COUNT - 1)/SORTER_MAX_MERGE_COUNT;
+  aNew = (SorterPma*)sqlite3DbMallocZero(db, nAlloc*sizeof(SorterPma));
+  if( !aNew ) return SQLITE_NOMEM;
+  rc = vdbeSorterOpenTempFile(db, &pOut);
+  if( rc==SQLITE_OK ){
+    aBuffer = (u8*)sqlite3Malloc(pSorter->pgsz);
+    if( !aBuffer ) rc = SQLITE_NOMEM;
+  }
+
+  for(i=0; rc==SQLITE_OK && i<pSorter->nPma; i+=SORTER_MAX_MERGE_COUNT){
+    SorterMerger *pMerger = 0;
+    i64 nByte = 0;
+    int n = pSorter->nPma - i;
+    if( n>SORTER_MAX_MERGE_COUNT ) n = SORTER_MAX_MERGE_COUNT;
+
+    rc = vdbeSorterMergerInit(db, pSorter, &pSorter->aPma[i], n,
+                              &pMerger, &nByte);
+    if( rc==SQLITE_OK ){
+      FileWriter writer;
+      i64 iEof = 0;
+      int rc2;
+
+      fileWriterInit(&writer, pOut, aBuffer, pSorter->pgsz, iOff);
+      fileWriterWriteVarint(&writer, nByte);
+      while( rc==SQLITE_OK ){
+        SorterIter *pIter = &pMerger->aIter[pMerger->aTree[1]];
+        if( pIter->pFd==0 ) break;
+        fileWriterWriteVarint(&writer, pIter->nKey);
+        fileWriterWrite(&writer, pIter->aKey, pIter->nKey);
+        rc = vdbeSorterMergerNext(pSorter, pMerger);
+      }
+      rc2 = fileWriterFinish(&writer, &iEof);
+      if( rc==SQLITE_OK ) rc = rc2;
+      aNew[nNew].pFd = pOut;
+      aNew[nNew].iOff = iOff;
+      aNew[nNew].nByte = iEof - iOff;
+      nNew++;
+      iOff = iEof;
+    }
+    vdbeSorterMergerFree(db, pMerger);
+  }
+  sqlite3_free(aBuffer);
+
+  if( rc==SQLITE_OK ){
+    if( pSorter->pMergeFd ){
+      sqlite3OsCloseFree(pSorter->pMergeFd);
+    }else{
+      for(i=0; i<pSorter->nTask; i++){
+        SorterTask *pTask = &pSorter->aTask[i];
+        if( pTask->pFd ){
+          sqlite3OsCloseFree(pTask->pFd);
+          pTask->pFd = 0;
+          pTask->iEof = 0;
+        }
+      }
+    }
+    pSorter->pMergeFd = pOut;
+    sqlite3DbFree(db, pSorter->aPma);
+    pSorter->aPma = aNew;
+    pSorter->nPma = nNew;
+    pSorter->nPmaAlloc = nAlloc;
+  }else{
+    if( pOut ) sqlite3OsCloseFree(pOut);
+    sqlite3DbFree(db, aNew);
+  }
+  return rc;
+}
+
+/*
+** Initialize the temporary index cursor just opened as a sorter cursor.
+*/
+int sqlite3VdbeSorterInit(sqlite3 *db, VdbeCursor *pCsr){
+  VdbeSorter *pSorter;
+  KeyInfo *pKeyInfo = pCsr->pKeyInfo;
+  int szKeyInfo;
+  int szSpace;
+  int nWorker = 0;
+  int nTask;
+  int i;
+
+  assert( pKeyInfo && pKeyInfo->nField>0 );
+#if SORTER_THREADS
+  if( sqlite3GlobalConfig.bCoreMutex ){
+    nWorker = db->aLimit[SQLITE_LIMIT_WORKER_THREADS];
+  }
+#endif
+  nTask = nWorker>0 ? nWorker : 1;
+  szKeyInfo = sizeof(KeyInfo) + (pKeyInfo->nField-1)*sizeof(CollSeq*);
+  szSpace = ROUND8(sizeof(UnpackedRecord))
+          + sizeof(Mem)*(pKeyInfo->nField+1) + 8;
+
+  pSorter = (VdbeSorter*)sqlite3DbMallocZero(db,
+      ROUND8(sizeof(VdbeSorter)) + ROUND8(nTask*sizeof(SorterTask)) + szKeyInfo
+  );
+  pCsr->pSorter = pSorter;
+  if( pSorter==0 ) return SQLITE_NOMEM;
+
+  pSorter->aTask = (SorterTask*)&((u8*)pSorter)[ROUND8(sizeof(VdbeSorter))];
+  pSorter->pKeyInfo = (KeyInfo*)&((u8*)pSorter->aTask)[
+      ROUND8(nTask*sizeof(SorterTask))
+  ];
+  memcpy(pSorter->pKeyInfo, pKeyInfo, szKeyInfo);
+  /* Keys may be compared by worker threads, which must not use the
+  ** database handle. */
+  pSorter->pKeyInfo->db = 0;
+  pSorter->nTask = nTask;
+  pSorter->bThreads = (nWorker>0);
+  pSorter->pgsz = sqlite3BtreeGetPageSize(db->aDb[0].pBt);
+  for(i=0; i<nTask; i++){
+    SorterTask *pTask = &pSorter->aTask[i];
+    pTask->pSorter = pSorter;
+    pTask->szSpace = szSpace;
+    pTask->aSpace = (char*)sqlite3Malloc(szSpace);
+    if( pTask->aSpace==0 ) return SQLITE_NOMEM;
+  }
+
+  if( !sqlite3TempInMemory(db) ){
+    i64 mxCache;
+    u32 szPma = sqlite3GlobalConfig.szPma;
+    if( szPma<1 ) szPma = 1;
+    pSorter->mnPmaSize = (int)MIN((i64)szPma*pSorter->pgsz, SORTER_MAX_PMASZ);
+    mxCache = db->aDb[0].pSchema->cache_size;
+    if( mxCache<(i64)szPma ) mxCache = szPma;
+    pSorter->mxPmaSize = (int)MIN(mxCache*pSorter->pgsz, SORTER_MAX_PMASZ);
+  }
+  return SQLITE_OK;
+}
+
+/*
+** Free any cursor components allocated by sqlite3VdbeSorterXXX routines.
+*/
+void sqlite3VdbeSorterClose(sqlite3 *db, VdbeCursor *pCsr){
+  VdbeSorter *pSorter = pCsr->pSorter;
+  if( pSorter ){
+    int i;
+    vdbeSorterJoinAll(pSorter);
+    for(i=0; i<pSorter->nTask; i++){
+      SorterTask *pTask = &pSorter->aTask[i];
+      vdbeSorterRecordFree(pTask->pList);
+      if( pTask->pFd ) sqlite3OsCloseFree(pTask->pFd);
+      sqlite3_free(pTask->aBuffer);
+      sqlite3_free(pTask->aSpace);
+    }
+    vdbeSorterMergerFree(db, pSorter->pMerger);
+    if( pSorter->pMergeFd ) sqlite3OsCloseFree(pSorter->pMergeFd);
+    vdbeSorterRecordFree(pSorter->pRecord);
+    sqlite3DbFree(db, pSorter->aPma);
+    sqlite3DbFree(db, pSorter);
+    pCsr->pSorter = 0;
+  }
+}
+
+/*
+** Add a record to the sorter.
+*/
+int sqlite3VdbeSorterWrite(sqlite3 *db, const VdbeCursor *pCsr, Mem *pVal){
+  VdbeSorter *pSorter = pCsr->pSorter;
+  SorterRecord *pNew;
+  int nReq;
+  int rc = SQLITE_OK;
+
+  assert( pSorter );
+  assert( pSorter->pMerger==0 );
+  nReq = sizeof(SorterRecord) + pVal->n;
+  pNew = (SorterRecord*)sqlite3Malloc(nReq);
+  if( pNew==0 ) return SQLITE_NOMEM;
+  memcpy(SRVAL(pNew), pVal->z, pVal->n);
+  pNew->nVal = pVal->n;
+  pNew->pNext = pSorter->pRecord;
+  pSorter->pRecord = pNew;
+  pSorter->nInMemory += sqlite3VarintLen(pVal->n) + pVal->n;
+  pSorter->nMemory += nReq;
+
+  /* See if the contents of the sorter should now be written out. They
+  ** are written out when either of the following are true:
+  **
+  **   * The total memory allocated for the in-memory list is greater
+  **     than the memory budget (mxPmaSize), or
+  **
+  **   * The total memory allocated for the in-memory list is greater
+  **     than (mnPmaSize) and sqlite3HeapNearlyFull() returns true.
+  */
+  if( pSorter->mxPmaSize>0 && (
+        (pSorter->nMemory>pSorter->mxPmaSize)
+     || (pSorter->nMemory>pSorter->mnPmaSize && sqlite3HeapNearlyFull())
+  )){
+    rc = vdbeSorterFlush(db, pSorter);
+  }
+  return rc;
+}
+
+/*
+** Once the sorter has been populated, this function is called to prepare
+** for iterating through its contents in sorted order.
+*/
+int sqlite3VdbeSorterRewind(sqlite3 *db, const VdbeCursor *pCsr, int *pbEof){
+  VdbeSorter *pSorter = pCsr->pSorter;
+  int rc = SQLITE_OK;
+  int rc2;
+  i64 nByte = 0;
+
+  assert( pSorter );
+  assert( pSorter->pMerger==0 );
+
+  /* If no data has been written to disk, then do not do so now. Instead,
+  ** sort the in-memory list.  */
+  if( pSorter->nPma==0 ){
+    vdbeSorterSort(&pSorter->aTask[0], &pSorter->pRecord);
+    *pbEof = !pSorter->pRecord;
+    return SQLITE_OK;
+  }
+
+  /* Write the current in-memory list to a PMA and wait for any worker
+  ** threads to finish. */
+  if( pSorter->pRecord ){
+    rc = vdbeSorterFlush(db, pSorter);
+  }
+  rc2 = vdbeSorterJoinAll(pSorter);
+  if( rc==SQLITE_OK ) rc = rc2;
+
+  /* Merge PMAs together until there are few enough to merge in a single
+  ** pass as the keys are read back. */
+  while( rc==SQLITE_OK && pSorter->nPma>SORTER_MAX_MERGE_COUNT ){
+    rc = vdbeSorterMergePass(db, pSorter);
+  }
+  if( rc==SQLITE_OK ){
+    rc = vdbeSorterMergerInit(db, pSorter, pSorter->aPma, pSorter->nPma,
+                              &pSorter->pMerger, &nByte);
+  }
+  if( rc==SQLITE_OK ){
+    SorterMerger *p = pSorter->pMerger;
+    *pbEof = (p->aIter[p->aTree[1]].pFd==0);
+  }
+  return rc;
+}
+
+/*
+** Advance to the next element in the sorter.
+*/
+int sqlite3VdbeSorterNext(sqlite3 *db, const VdbeCursor *pCsr, int *pbEof){
+  VdbeSorter *pSorter = pCsr->pSorter;
+  int rc = SQLITE_OK;
+
+  UNUSED_PARAMETER(db);
+  if( pSorter->pMerger ){
+    SorterMerger *p = pSorter->pMerger;
+    rc = vdbeSorterMergerNext(pSorter, p);
+    *pbEof = (p->aIter[p->aTree[1]].pFd==0);
+  }else{
+    SorterRecord *pFree = pSorter->pRecord;
+    pSorter->pRecord = pFree->pNext;
+    sqlite3_free(pFree);
+    *pbEof = !pSorter->pRecord;
+  }
+  return rc;
+}
+
+/*
+** Return a pointer to a buffer owned by the sorter that contains the
+** current key.
+*/
+static void *vdbeSorterRowkey(
+  const VdbeSorter *pSorter,      /* Sorter object */
+  int *pnKey                      /* OUT: Size of current key in bytes */
+){
+  void *pKey;
+  if( pSorter->pMerger ){
+    SorterIter *pIter;
+    pIter = &pSorter->pMerger->aIter[ pSorter->pMerger->aTree[1] ];
+    *pnKey = pIter->nKey;
+    pKey = pIter->aKey;
+  }else{
+    *pnKey = pSorter->pRecord->nVal;
+    pKey = SRVAL(pSorter->pRecord);
+  }
+  return pKey;
+}
+
+/*
+** Copy the current sorter key into the memory cell pOut.
+*/
+int sqlite3VdbeSorterRowkey(const VdbeCursor *pCsr, Mem *pOut){
+  VdbeSorter *pSorter = pCsr->pSorter;
+  void *pKey;
+  int nKey;
+
+  pKey = vdbeSorterRowkey(pSorter, &nKey);
+  if( sqlite3VdbeMemGrow(pOut, nKey, 0) ){
+    return SQLITE_NOMEM;
+  }
+  pOut->n = nKey;
+  MemSetTypeFlag(pOut, MEM_Blob);
+  memcpy(pOut->z, pKey, nKey);
+  return SQLITE_OK;
+}
+
+/*
+** Compare the key in memory cell pVal with the key that the sorter cursor
+** passed as the first argument currently points to.  For the purposes of
+** the comparison, ignore the rowid field at the end of each record.
+**
+** If an error occurs, return an SQLite error code (i.e. SQLITE_NOMEM).
+** Otherwise, set *pRes to a negative, zero or positive value if the
+** key in pVal is smaller than, equal to or larger than the current sorter
+** key.  Keys that contain NULL values never compare equal.
+*/
+int sqlite3VdbeSorterCompare(
+  const VdbeCursor *pCsr,         /* Sorter cursor */
+  Mem *pVal,                      /* Value to compare to current sorter key */
+  int *pRes                       /* OUT: Result of comparison */
+){
+  VdbeSorter *pSorter = pCsr->pSorter;
+  KeyInfo *pKeyInfo = pSorter->pKeyInfo;
+  UnpackedRecord *r2;
+  void *pKey;
+  int nKey;
+  int i;
+
+  pKey = vdbeSorterRowkey(pSorter, &nKey);
+  r2 = sqlite3VdbeRecordUnpack(pKeyInfo, nKey, pKey,
+      pSorter->aTask[0].aSpace, pSorter->aTask[0].szSpace
+  );
+  assert( r2 && (r2->flags & UNPACKED_NEED_FREE)==0 );
+  if( r2->nField>pKeyInfo->nField ) r2->nField = pKeyInfo->nField;
+  for(i=0; i<r2->nField; i++){
+    if( r2->aMem[i].flags & MEM_Null ){
+      *pRes = -1;
+      return SQLITE_OK;
+    }
+  }
+  r2->flags |= UNPACKED_PREFIX_MATCH;
+  *pRes = sqlite3VdbeRecordCompare(pVal->n, pVal->z, r2);
+  return SQLITE_OK;
+}
+
+#endif /* #ifndef SQLITE_OMIT_MERGE_SORT */
@@ -423,6 +423,7 @@ struct Wal {
   WalIndexHdr hdr;           /* Wal-index header for current transaction */
   const char *zWalName;      /* Name of WAL file */
   u32 nCkpt;                 /* Checkpoint sequence counter in the wal-header */
+  WalCacheFile *pCacheFile;  /* Handle for the shared page cache, or NULL */
 #ifdef SQLITE_DEBUG
   u8 lockError;              /* True if a locking error has occurred */
 #endif
@@ -1064,6 +1065,12 @@ static int walIndexRecover(Wal *pWal){
   }
   WALTRACE(("WAL%p: recovery begin...\n", pWal));
 
+  /* Recovery may find a WAL file with the same header as one seen before
+  ** but different content, for example if the files were replaced while
+  ** the database was superlocked.  So pages cached in the shared WAL page
+  ** cache before this point must not be used again.  */
+  sqlite3WalCacheNewGeneration(pWal->pCacheFile);
+
   memset(&pWal->hdr, 0, sizeof(WalIndexHdr));
 
   rc = sqlite3OsFileSize(pWal->pWalFd, &nSize);
@@ -1281,6 +1288,9 @@ int sqlite3WalOpen(
     sqlite3OsClose(pRet->pWalFd);
     sqlite3_free(pRet);
   }else{
+    if( !bNoShm ){
+      pRet->pCacheFile = sqlite3WalCacheOpen(zWalName);
+    }
     *ppWal = pRet;
     WALTRACE(("WAL%d: opened\n", pRet));
   }
@@ -1623,6 +1633,7 @@ static int walCheckpoint(
   int (*xBusyCall)(void*),        /* Function to call when busy */
   void *pBusyArg,                 /* Context argument for xBusyHandler */
   int sync_flags,                 /* Flags for OsSync() (or 0) */
+  u32 nBatch,                     /* Max frames to backfill, or 0 for all */
   u8 *zBuf                        /* Temporary buffer to use */
 ){
   int rc;                         /* Return code */
@@ -1658,6 +1669,16 @@ static int walCheckpoint(
   */
   mxSafeFrame = pWal->hdr.mxFrame;
   mxPage = pWal->hdr.nPage;
+
+  /* If nBatch is non-zero, backfill at most nBatch frames.  Stopping short
+  ** of the end of the log is safe for the same reason as stopping at the
+  ** read-mark of an active reader: frames between nBackfill and mxFrame
+  ** are still found in the log by readers, and the log is not restarted
+  ** until all of it has been backfilled. */
+  if( nBatch && mxSafeFrame-pInfo->nBackfill>nBatch ){
+    mxSafeFrame = pInfo->nBackfill + nBatch;
+  }
+
   for(i=1; i<WAL_NREADER; i++){
     u32 y = pInfo->aReadMark[i];
     if( mxSafeFrame>y ){
@@ -1787,13 +1808,14 @@ int sqlite3WalClose(
         pWal->exclusiveMode = WAL_EXCLUSIVE_MODE;
       }
       rc = sqlite3WalCheckpoint(
-          pWal, SQLITE_CHECKPOINT_PASSIVE, 0, 0, sync_flags, nBuf, zBuf, 0, 0
+          pWal, SQLITE_CHECKPOINT_PASSIVE, 0, 0, sync_flags, 0, nBuf, zBuf, 0, 0
       );
       if( rc==SQLITE_OK ){
         isDelete = 1;
       }
     }
 
+    sqlite3WalCacheClose(pWal->pCacheFile);
     walIndexClose(pWal, isDelete);
     sqlite3OsClose(pWal->pWalFd);
     if( isDelete ){
@@ -2205,19 +2227,17 @@ void sqlite3WalEndReadTransaction(Wal *pWal){
 }
 
 /*
-** Read a page from the WAL, if it is present in the WAL and if the 
-** current read transaction is configured to use the WAL.  
+** Search the wal file for page pgno. If found, set *piRead to the frame that
+** contains the page. Otherwise, if pgno is not in the wal file, set *piRead
+** to zero.
 **
-** The *pInWal is set to 1 if the requested page is in the WAL and
-** has been loaded.  Or *pInWal is set to 0 if the page was not in 
-** the WAL and needs to be read out of the database.
+** Return SQLITE_OK if successful, or an error code if an error occurs. If an
+** error does occur, the final value of *piRead is undefined.
 */
-int sqlite3WalRead(
+int sqlite3WalFindFrame(
   Wal *pWal,                      /* WAL handle */
   Pgno pgno,                      /* Database page number to read data for */
-  int *pInWal,                    /* OUT: True if data is read from WAL */
-  int nOut,                       /* Size of buffer pOut in bytes */
-  u8 *pOut                        /* Buffer to write page data to */
+  u32 *piRead                     /* OUT: Frame number (or zero) */
 ){
   u32 iRead = 0;                  /* If !=0, WAL frame to return data from */
   u32 iLast = pWal->hdr.mxFrame;  /* Last page in WAL for this reader */
@@ -2233,7 +2253,7 @@ int sqlite3WalRead(
   ** WAL were empty.
   */
   if( iLast==0 || pWal->readLock==0 ){
-    *pInWal = 0;
+    *piRead = 0;
     return SQLITE_OK;
   }
 
@@ -2304,26 +2324,32 @@ int sqlite3WalRead(
   }
 #endif
 
-  /* If iRead is non-zero, then it is the log frame number that contains the
-  ** required page. Read and return data from the log file.
-  */
-  if( iRead ){
-    int sz;
-    i64 iOffset;
-    sz = pWal->hdr.szPage;
-    sz = (pWal->hdr.szPage&0xfe00) + ((pWal->hdr.szPage&0x0001)<<16);
-    testcase( sz<=32768 );
-    testcase( sz>=65536 );
-    iOffset = walFrameOffset(iRead, sz) + WAL_FRAME_HDRSIZE;
-    *pInWal = 1;
-    /* testcase( IS_BIG_INT(iOffset) ); // requires a 4GiB WAL */
-    return sqlite3OsRead(pWal->pWalFd, pOut, nOut, iOffset);
-  }
-
-  *pInWal = 0;
+  *piRead = iRead;
   return SQLITE_OK;
 }
 
+/*
+** Read the contents of frame iRead from the wal file into buffer pOut
+** (which is nOut bytes in size). Return SQLITE_OK if successful, or an
+** error code otherwise.
+*/
+int sqlite3WalReadFrame(
+  Wal *pWal,                      /* WAL handle */
+  u32 iRead,                      /* Frame to read */
+  int nOut,                       /* Size of buffer pOut in bytes */
+  u8 *pOut                        /* Buffer to write page data to */
+){
+  int sz;
+  i64 iOffset;
+  sz = pWal->hdr.szPage;
+  sz = (pWal->hdr.szPage&0xfe00) + ((pWal->hdr.szPage&0x0001)<<16);
+  testcase( sz<=32768 );
+  testcase( sz>=65536 );
+  iOffset = walFrameOffset(iRead, sz) + WAL_FRAME_HDRSIZE;
+  /* testcase( IS_BIG_INT(iOffset) ); // requires a 4GiB WAL */
+  return sqlite3OsRead(pWal->pWalFd, pOut, nOut, iOffset);
+}
+
 
 /* 
 ** Return the size of the database in pages (or zero, if unknown).
@@ -2735,6 +2761,7 @@ int sqlite3WalCheckpoint(
   int (*xBusy)(void*),            /* Function to call when busy */
   void *pBusyArg,                 /* Context argument for xBusyHandler */
   int sync_flags,                 /* Flags to sync db file with (or 0) */
+  int nBatch,                     /* Max frames to backfill, or 0 for all */
   int nBuf,                       /* Size of temporary buffer */
   u8 *zBuf,                       /* Temporary buffer to use */
   int *pnLog,                     /* OUT: Number of frames in WAL */
@@ -2786,7 +2813,8 @@ int sqlite3WalCheckpoint(
     if( pWal->hdr.mxFrame && walPagesize(pWal)!=nBuf ){
       rc = SQLITE_CORRUPT_BKPT;
     }else{
-      rc = walCheckpoint(pWal, eMode2, xBusy, pBusyArg, sync_flags, zBuf);
+      rc = walCheckpoint(pWal, eMode2, xBusy, pBusyArg, sync_flags,
+                         (u32)nBatch, zBuf);
     }
 
     /* If no error occurred, set the output variables. */
@@ -2828,6 +2856,20 @@ int sqlite3WalCallback(Wal *pWal){
   return (int)ret;
 }
 
+/*
+** Return the number of frames in the log, as of the current snapshot of
+** connection pWal, that have not yet been backfilled into the database
+** file.  This is only used for reporting, so no locks are taken to read
+** the backfill counter.
+*/
+int sqlite3WalBacklog(Wal *pWal){
+  u32 nBackfill;
+  if( pWal==0 || pWal->nWiData==0 || pWal->apWiData[0]==0 ) return 0;
+  nBackfill = walCkptInfo(pWal)->nBackfill;
+  if( nBackfill>=pWal->hdr.mxFrame ) return 0;
+  return (int)(pWal->hdr.mxFrame - nBackfill);
+}
+
 /*
 ** This function is called to change the WAL subsystem into or out
 ** of locking_mode=EXCLUSIVE.
@@ -2898,4 +2940,46 @@ int sqlite3WalHeapMemory(Wal *pWal){
   return (pWal && pWal->exclusiveMode==WAL_HEAPMEMORY_MODE );
 }
 
+/*
+** Fill in *pKey with the shared page cache key for a page read from
+** frame iFrame of the current snapshot, or from the database file if
+** iFrame is zero.  Return true if successful, or false if the shared
+** page cache is not in use for this WAL.
+**
+** A database page that is not in the WAL snapshot of a reader can only
+** be modified in the database file by a checkpoint, which increases
+** nBackfill, or after the WAL is restarted, which changes the salts.
+** So the salts and the value of nBackfill identify the version of a page
+** read from the database file:
+**
+**   * A connection holding WAL_READ_LOCK(0) prevents checkpoints, and
+**     nBackfill was equal to its mxFrame when the read lock was taken.
+**     It uses mxFrame, since the WAL may be restarted (resetting
+**     nBackfill to zero) while it continues to read the database file.
+**
+**   * nBackfill never exceeds the mxFrame of a connection holding any
+**     other read lock, and such a connection prevents the WAL from being
+**     restarted.  So frames backfilled while it reads cannot be for a
+**     page it reads from the database file, and the current value of
+**     nBackfill may be used.
+*/
+int sqlite3WalCachePageKey(Wal *pWal, u32 iFrame, WalCacheKey *pKey){
+  assert( pWal->readLock>=0 );
+  if( pWal->pCacheFile==0 ) return 0;
+  memset(pKey, 0, sizeof(WalCacheKey));
+  pKey->pFile = pWal->pCacheFile;
+  pKey->iGeneration = sqlite3WalCacheGeneration(pWal->pCacheFile);
+  pKey->iFrame = iFrame;
+  pKey->aSalt[0] = pWal->hdr.aSalt[0];
+  pKey->aSalt[1] = pWal->hdr.aSalt[1];
+  if( iFrame ){
+    pKey->nBackfill = 0;
+  }else if( pWal->readLock==0 ){
+    pKey->nBackfill = pWal->hdr.mxFrame;
+  }else{
+    pKey->nBackfill = walCkptInfo(pWal)->nBackfill;
+  }
+  return 1;
+}
+
 #endif /* #ifndef SQLITE_OMIT_WAL */
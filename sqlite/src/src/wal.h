@@ -24,7 +24,8 @@
 # define sqlite3WalClose(w,x,y,z)                0
 # define sqlite3WalBeginReadTransaction(y,z)     0
 # define sqlite3WalEndReadTransaction(z)
-# define sqlite3WalRead(v,w,x,y,z)               0
+# define sqlite3WalFindFrame(x,y,z)              0
+# define sqlite3WalReadFrame(w,x,y,z)            0
 # define sqlite3WalDbsize(y)                     0
 # define sqlite3WalBeginWriteTransaction(y)      0
 # define sqlite3WalEndWriteTransaction(x)        0
@@ -32,10 +33,12 @@
 # define sqlite3WalSavepoint(y,z)
 # define sqlite3WalSavepointUndo(y,z)            0
 # define sqlite3WalFrames(u,v,w,x,y,z)           0
-# define sqlite3WalCheckpoint(r,s,t,u,v,w,x,y,z) 0
+# define sqlite3WalCheckpoint(q,r,s,t,u,v,w,x,y,z) 0
 # define sqlite3WalCallback(z)                   0
+# define sqlite3WalBacklog(z)                    0
 # define sqlite3WalExclusiveMode(y,z)            0
 # define sqlite3WalHeapMemory(z)                 0
+# define sqlite3WalCachePageKey(x,y,z)           0
 #else
 
 #define WAL_SAVEPOINT_NDATA 4
@@ -60,7 +63,8 @@ int sqlite3WalBeginReadTransaction(Wal *pWal, int *);
 void sqlite3WalEndReadTransaction(Wal *pWal);
 
 /* Read a page from the write-ahead log, if it is present. */
-int sqlite3WalRead(Wal *pWal, Pgno pgno, int *pInWal, int nOut, u8 *pOut);
+int sqlite3WalFindFrame(Wal *, Pgno, u32 *);
+int sqlite3WalReadFrame(Wal *, u32, int, u8 *);
 
 /* If the WAL is not empty, return the size of the database. */
 Pgno sqlite3WalDbsize(Wal *pWal);
@@ -90,6 +94,7 @@ int sqlite3WalCheckpoint(
   int (*xBusy)(void*),            /* Function to call when busy */
   void *pBusyArg,                 /* Context argument for xBusyHandler */
   int sync_flags,                 /* Flags to sync db file with (or 0) */
+  int nBatch,                     /* Max frames to backfill, or 0 for all */
   int nBuf,                       /* Size of buffer nBuf */
   u8 *zBuf,                       /* Temporary buffer to use */
   int *pnLog,                     /* OUT: Number of frames in WAL */
@@ -103,6 +108,11 @@ int sqlite3WalCheckpoint(
 */
 int sqlite3WalCallback(Wal *pWal);
 
+/* Return the number of frames in the WAL that have not yet been copied
+** into the database file by a checkpoint.
+*/
+int sqlite3WalBacklog(Wal *pWal);
+
 /* Tell the wal layer that an EXCLUSIVE lock has been obtained (or released)
 ** by the pager layer on the database file.
 */
@@ -114,5 +124,32 @@ int sqlite3WalExclusiveMode(Wal *pWal, int op);
 */
 int sqlite3WalHeapMemory(Wal *pWal);
 
+/* The shared WAL page cache (see walcache.c).  Pages are identified by
+** the page number and a WalCacheKey, which is filled in for a page read
+** from frame iFrame (or from the database file if iFrame is zero) by
+** sqlite3WalCachePageKey().  That routine returns false if pages of this
+** WAL may not be shared.
+*/
+typedef struct WalCacheFile WalCacheFile;
+typedef struct WalCacheKey WalCacheKey;
+struct WalCacheKey {
+  WalCacheFile *pFile;            /* WAL file the page belongs to */
+  u32 iGeneration;                /* Incremented each time the WAL is recovered */
+  u32 iFrame;                     /* Frame read from, or 0 for the db file */
+  u32 aSalt[2];                   /* Salt values from the WAL header */
+  u32 nBackfill;                  /* Frames backfilled if iFrame==0, else 0 */
+};
+int sqlite3WalCachePageKey(Wal *pWal, u32 iFrame, WalCacheKey *pKey);
+
+WalCacheFile *sqlite3WalCacheOpen(const char *zName);
+void sqlite3WalCacheClose(WalCacheFile*);
+void sqlite3WalCacheNewGeneration(WalCacheFile*);
+u32 sqlite3WalCacheGeneration(WalCacheFile*);
+void *sqlite3WalCacheFetch(Pgno, const WalCacheKey*, int szPage);
+void *sqlite3WalCacheAlloc(Pgno, const WalCacheKey*, int szPage);
+void *sqlite3WalCacheInsert(void *pData);
+void sqlite3WalCacheDiscard(void *pData);
+void sqlite3WalCacheRelease(void *pData);
+
 #endif /* ifndef SQLITE_OMIT_WAL */
 #endif /* _WAL_H_ */
@@ -0,0 +1,589 @@
+/*
+** 2011 August 22
+**
+** The author disclaims copyright to this source code.  In place of
+** a legal notice, here is a blessing:
+**
+**    May you do good and not evil.
+**    May you find forgiveness for yourself and forgive others.
+**    May you share freely, never taking more than you give.
+**
+*************************************************************************
+**
+** This file implements a process-wide, read-only cache of database pages
+** that is shared by all connections to the same WAL mode database file.
+**
+** Normally each connection has its own page cache, so when many
+** connections read the same database each of them holds its own copy of
+** the hot pages.  With the shared cache enabled (SQLITE_CONFIG_WALCACHE),
+** a connection that has no write transaction open looks for a page here
+** before going to disk, and the page content it returns is used directly
+** (the pager wraps it in a read-only page object, just as it does for
+** memory mapped pages).
+**
+** Within a single WAL file the content of a frame never changes once it
+** has been committed, and the content of a database page that has no
+** frame in a reader's snapshot only changes when a checkpoint copies new
+** frames into the database file.  So each cached page is identified by:
+**
+**   * the file it belongs to (the name of the WAL file),
+**   * a generation number that is incremented each time the wal-index
+**     of the file is recovered, since the WAL and database files may
+**     have been replaced when that happens,
+**   * the page number,
+**   * the WAL frame it was read from, or zero if it was read from the
+**     database file,
+**   * the two salt values from the WAL header, which change each time
+**     the WAL is restarted, and
+**   * for pages read from the database file, the number of frames that
+**     had been backfilled into the database when the page was read.
+**
+** Entries that are no longer current are never returned to a reader,
+** they simply age out of the LRU list.  There is no explicit invalidation.
+**
+** The cache is divided into WALCACHE_NSHARD shards, chosen by page
+** number, each with its own mutex, hash table, LRU list of unpinned
+** entries and an equal share of the memory budget.
+*/
+#ifndef SQLITE_OMIT_WAL
+
+#include "wal.h"
+
+/*
+** Number of independently locked shards the cache is divided into.
+*/
+#ifndef WALCACHE_NSHARD
+# define WALCACHE_NSHARD 16
+#endif
+
+typedef struct WalCachePage WalCachePage;
+typedef struct WalCacheShard WalCacheShard;
+
+/*
+** One of these objects is allocated for each distinct WAL file that is
+** open by one or more connections in the process.  Entries in the cache
+** refer to the file using a pointer to this object.
+*/
+struct WalCacheFile {
+  char *zName;                    /* Name of the WAL file */
+  int nRef;                       /* Number of Wal objects using this file */
+  u32 iGeneration;                /* Current generation of cached pages */
+  WalCacheFile *pNext;            /* Next file in walcache.pFileList */
+};
+
+/*
+** Each cached page is an instance of the following object.  The page
+** content follows the header, beginning at WALCACHE_DATA(p).
+**
+** An entry with nRef>0 is pinned by one or more readers.  Unpinned
+** entries are linked into the LRU list of their shard.  The most
+** recently used entry is at the head of the list.
+*/
+struct WalCachePage {
+  WalCacheKey key;                /* Identity of the cached content */
+  Pgno pgno;                      /* Page number */
+  int szPage;                     /* Size of the page content in bytes */
+  int nRef;                       /* Number of outstanding references */
+  u8 isHashed;                    /* True once inserted into apHash[] */
+  WalCachePage *pHashNext;        /* Next entry in the same hash bucket */
+  WalCachePage *pLruNext;         /* Next (older) entry in the LRU list */
+  WalCachePage *pLruPrev;         /* Previous (newer) entry in the LRU list */
+};
+
+#define WALCACHE_HDRSIZE  ROUND8(sizeof(WalCachePage))
+#define WALCACHE_DATA(p)  ((void*)&((u8*)(p))[WALCACHE_HDRSIZE])
+#define WALCACHE_PAGE(d)  ((WalCachePage*)&((u8*)(d))[-WALCACHE_HDRSIZE])
+
+/*
+** A shard of the cache.  All fields are protected by the shard mutex.
+*/
+struct WalCacheShard {
+  sqlite3_mutex *mutex;           /* Mutex protecting this shard */
+  WalCachePage **apHash;          /* Hash table of entries */
+  unsigned int nHash;             /* Number of slots in apHash[] */
+  unsigned int nPage;             /* Number of entries in apHash[] */
+  WalCachePage *pLruHead;         /* Most recently unpinned entry */
+  WalCachePage *pLruTail;         /* Least recently unpinned entry */
+  i64 nByte;                      /* Bytes allocated or reserved */
+};
+
+/*
+** Global data used by this module.  The mutex protects the list of open
+** files and the SQLITE_STATUS_WALCACHE_USED counter.  It is never held
+** while a shard mutex is being acquired.
+*/
+static SQLITE_WSD struct WalCacheGlobal {
+  sqlite3_mutex *mutex;                  /* Mutex for pFileList and status */
+  WalCacheFile *pFileList;               /* List of open files */
+  WalCacheShard aShard[WALCACHE_NSHARD]; /* The shards */
+} walcache_g;
+
+#define walcache (GLOBAL(struct WalCacheGlobal, walcache_g))
+
+/*
+** Return the hash of page pgno of file pFile.  The shard is selected
+** using the low-order bits of the hash and the hash table slot within
+** the shard using the remaining bits.
+*/
+static unsigned int walCacheHash(WalCacheFile *pFile, Pgno pgno){
+  return (unsigned int)pgno*0x9e3779b1u
+       ^ ((unsigned int)SQLITE_PTR_TO_INT(pFile)>>4);
+}
+static WalCacheShard *walCacheShard(unsigned int h){
+  return &walcache.aShard[h % WALCACHE_NSHARD];
+}
+static unsigned int walCacheSlot(WalCacheShard *pShard, unsigned int h){
+  return (h / WALCACHE_NSHARD) % pShard->nHash;
+}
+
+/*
+** Return the amount of memory each shard may use.
+*/
+static i64 walCacheShardLimit(void){
+  return sqlite3GlobalConfig.szWalCache / WALCACHE_NSHARD;
+}
+
+/*
+** Adjust the SQLITE_STATUS_WALCACHE_USED counter by nByte bytes.
+*/
+static void walCacheStatusAdd(i64 nByte){
+  sqlite3_mutex_enter(walcache.mutex);
+  sqlite3StatusAdd(SQLITE_STATUS_WALCACHE_USED, (int)nByte);
+  sqlite3_mutex_leave(walcache.mutex);
+}
+
+/*
+** Remove entry p from the LRU list of shard pShard.
+*/
+static void walCacheLruRemove(WalCacheShard *pShard, WalCachePage *p){
+  assert( sqlite3_mutex_held(pShard->mutex) );
+  if( p->pLruPrev ){
+    p->pLruPrev->pLruNext = p->pLruNext;
+  }else{
+    pShard->pLruHead = p->pLruNext;
+  }
+  if( p->pLruNext ){
+    p->pLruNext->pLruPrev = p->pLruPrev;
+  }else{
+    pShard->pLruTail = p->pLruPrev;
+  }
+  p->pLruNext = p->pLruPrev = 0;
+}
+
+/*
+** Remove unpinned entry p from the hash table and LRU list of pShard and
+** free it.  Return the number of bytes released.
+*/
+static int walCacheEvict(WalCacheShard *pShard, WalCachePage *p){
+  WalCachePage **pp;
+  unsigned int h = walCacheHash(p->key.pFile, p->pgno);
+  int nFree = WALCACHE_HDRSIZE + p->szPage;
+
+  assert( sqlite3_mutex_held(pShard->mutex) );
+  assert( p->nRef==0 && p->isHashed );
+  walCacheLruRemove(pShard, p);
+  for(pp=&pShard->apHash[walCacheSlot(pShard, h)]; *pp!=p; pp=&(*pp)->pHashNext);
+  *pp = p->pHashNext;
+  pShard->nPage--;
+  pShard->nByte -= nFree;
+  sqlite3_free(p);
+  return nFree;
+}
+
+/*
+** Evict unpinned entries from the tail of the LRU list of pShard until
+** at least nReq bytes have been released or the list is empty.  If nReq
+** is negative, all unpinned entries are evicted.  Return the number of
+** bytes released.
+*/
+static int walCacheEvictLru(WalCacheShard *pShard, i64 nReq){
+  int nFree = 0;
+  while( (nReq<0 || nFree<nReq) && pShard->pLruTail ){
+    nFree += walCacheEvict(pShard, pShard->pLruTail);
+  }
+  return nFree;
+}
+
+/*
+** Grow the hash table of pShard so that it has at least as many slots as
+** there are entries.  Failure to allocate a new table is harmless, the
+** old one continues to be used.
+**
+** The shard mutex is released while the new table is allocated, as the
+** allocation may call sqlite3_release_memory().
+*/
+static void walCacheResizeHash(WalCacheShard *pShard){
+  WalCachePage **apNew;
+  unsigned int nNew;
+  unsigned int i;
+
+  assert( sqlite3_mutex_held(pShard->mutex) );
+  nNew = pShard->nHash*2;
+  if( nNew<256 ) nNew = 256;
+
+  sqlite3_mutex_leave(pShard->mutex);
+  sqlite3BeginBenignMalloc();
+  apNew = (WalCachePage **)sqlite3_malloc(sizeof(WalCachePage *)*nNew);
+  sqlite3EndBenignMalloc();
+  sqlite3_mutex_enter(pShard->mutex);
+
+  if( apNew && nNew<=pShard->nHash ){
+    /* Another thread grew the table while the mutex was released. */
+    sqlite3_free(apNew);
+  }else if( apNew ){
+    memset(apNew, 0, sizeof(WalCachePage *)*nNew);
+    for(i=0; i<pShard->nHash; i++){
+      WalCachePage *p;
+      WalCachePage *pNext = pShard->apHash[i];
+      while( (p = pNext)!=0 ){
+        unsigned int h = walCacheHash(p->key.pFile, p->pgno);
+        pNext = p->pHashNext;
+        p->pHashNext = apNew[(h / WALCACHE_NSHARD) % nNew];
+        apNew[(h / WALCACHE_NSHARD) % nNew] = p;
+      }
+    }
+    sqlite3_free(pShard->apHash);
+    pShard->apHash = apNew;
+    pShard->nHash = nNew;
+  }
+}
+
+/*
+** Search pShard for the entry with key pKey.  Return it, or NULL if there
+** is no such entry.
+*/
+static WalCachePage *walCacheFind(
+  WalCacheShard *pShard,
+  unsigned int h,
+  Pgno pgno,
+  const WalCacheKey *pKey,
+  int szPage
+){
+  WalCachePage *p = 0;
+  assert( sqlite3_mutex_held(pShard->mutex) );
+  if( pShard->nHash ){
+    for(p=pShard->apHash[walCacheSlot(pShard, h)]; p; p=p->pHashNext){
+      if( p->pgno==pgno
+       && p->szPage==szPage
+       && memcmp(&p->key, pKey, sizeof(WalCacheKey))==0
+      ){
+        break;
+      }
+    }
+  }
+  return p;
+}
+
+/*
+** Initialize and shut down the shared WAL page cache.  These routines
+** are called by sqlite3_initialize() and sqlite3_shutdown().  Nothing is
+** allocated unless the cache is enabled.
+*/
+int sqlite3WalCacheInitialize(void){
+  int i;
+  memset(&walcache, 0, sizeof(walcache));
+  if( sqlite3GlobalConfig.szWalCache>0 && sqlite3GlobalConfig.bCoreMutex ){
+    walcache.mutex = sqlite3MutexAlloc(SQLITE_MUTEX_FAST);
+    if( walcache.mutex==0 ) return SQLITE_NOMEM;
+    for(i=0; i<WALCACHE_NSHARD; i++){
+      walcache.aShard[i].mutex = sqlite3MutexAlloc(SQLITE_MUTEX_FAST);
+      if( walcache.aShard[i].mutex==0 ){
+        sqlite3WalCacheShutdown();
+        return SQLITE_NOMEM;
+      }
+    }
+  }
+  return SQLITE_OK;
+}
+void sqlite3WalCacheShutdown(void){
+  int i;
+  assert( walcache.pFileList==0 );
+  for(i=0; i<WALCACHE_NSHARD; i++){
+    WalCacheShard *pShard = &walcache.aShard[i];
+    assert( pShard->nPage==0 );
+    sqlite3_free(pShard->apHash);
+    sqlite3_mutex_free(pShard->mutex);
+  }
+  sqlite3_mutex_free(walcache.mutex);
+  memset(&walcache, 0, sizeof(walcache));
+}
+
+/*
+** Return a handle for the WAL file zName, to be used as part of the keys
+** of pages read from it.  Return NULL if the shared cache is disabled or
+** if a malloc fails.  Each successful call must be matched by a call to
+** sqlite3WalCacheClose().
+*/
+WalCacheFile *sqlite3WalCacheOpen(const char *zName){
+  WalCacheFile *pFile;
+  WalCacheFile *pNew;
+  int nName = sqlite3Strlen30(zName);
+
+  if( sqlite3GlobalConfig.szWalCache<=0 ) return 0;
+
+  /* Allocate the new object before entering the mutex, as the allocation
+  ** may call sqlite3_release_memory(), which also uses the mutex. */
+  sqlite3BeginBenignMalloc();
+  pNew = (WalCacheFile *)sqlite3MallocZero(sizeof(WalCacheFile) + nName + 1);
+  sqlite3EndBenignMalloc();
+
+  sqlite3_mutex_enter(walcache.mutex);
+  for(pFile=walcache.pFileList; pFile; pFile=pFile->pNext){
+    if( strcmp(pFile->zName, zName)==0 ) break;
+  }
+  if( pFile==0 && pNew ){
+    pFile = pNew;
+    pNew = 0;
+    pFile->zName = (char *)&pFile[1];
+    memcpy(pFile->zName, zName, nName+1);
+    pFile->pNext = walcache.pFileList;
+    walcache.pFileList = pFile;
+  }
+  if( pFile ) pFile->nRef++;
+  sqlite3_mutex_leave(walcache.mutex);
+
+  sqlite3_free(pNew);
+  return pFile;
+}
+
+/*
+** Release a handle obtained from sqlite3WalCacheOpen().  When the last
+** handle on a file is released, all cached pages of the file are freed.
+** They cannot be pinned at this point, as only connections that have the
+** file open may hold references to its pages.
+*/
+void sqlite3WalCacheClose(WalCacheFile *pFile){
+  int bLast = 0;
+  if( pFile==0 ) return;
+
+  sqlite3_mutex_enter(walcache.mutex);
+  if( --pFile->nRef==0 ){
+    WalCacheFile **pp;
+    for(pp=&walcache.pFileList; *pp!=pFile; pp=&(*pp)->pNext);
+    *pp = pFile->pNext;
+    bLast = 1;
+  }
+  sqlite3_mutex_leave(walcache.mutex);
+
+  if( bLast ){
+    i64 nFree = 0;
+    int i;
+    for(i=0; i<WALCACHE_NSHARD; i++){
+      WalCacheShard *pShard = &walcache.aShard[i];
+      unsigned int j;
+      sqlite3_mutex_enter(pShard->mutex);
+      for(j=0; j<pShard->nHash; j++){
+        WalCachePage *p = pShard->apHash[j];
+        while( p ){
+          WalCachePage *pNext = p->pHashNext;
+          if( p->key.pFile==pFile ){
+            nFree += walCacheEvict(pShard, p);
+          }
+          p = pNext;
+        }
+      }
+      sqlite3_mutex_leave(pShard->mutex);
+    }
+    if( nFree ) walCacheStatusAdd(-nFree);
+    sqlite3_free(pFile);
+  }
+}
+
+/*
+** Start a new generation of cached pages for file pFile.  Pages cached
+** with an earlier generation are never returned by sqlite3WalCacheFetch()
+** again.  This is called when the wal-index of the file is recovered.
+**
+** The generation is read without the mutex by sqlite3WalCacheGeneration().
+** A reader that sees the old value may still find or add pages of the old
+** generation, but only while it continues to use a snapshot from before
+** the recovery.
+*/
+void sqlite3WalCacheNewGeneration(WalCacheFile *pFile){
+  if( pFile ){
+    sqlite3_mutex_enter(walcache.mutex);
+    pFile->iGeneration++;
+    sqlite3_mutex_leave(walcache.mutex);
+  }
+}
+u32 sqlite3WalCacheGeneration(WalCacheFile *pFile){
+  return pFile->iGeneration;
+}
+
+/*
+** Look up page pgno with key pKey.  If it is present, pin it and return a
+** pointer to its szPage bytes of content.  Otherwise return NULL.
+*/
+void *sqlite3WalCacheFetch(Pgno pgno, const WalCacheKey *pKey, int szPage){
+  unsigned int h = walCacheHash(pKey->pFile, pgno);
+  WalCacheShard *pShard = walCacheShard(h);
+  WalCachePage *p;
+
+  sqlite3_mutex_enter(pShard->mutex);
+  p = walCacheFind(pShard, h, pgno, pKey, szPage);
+  if( p ){
+    if( p->nRef==0 ) walCacheLruRemove(pShard, p);
+    p->nRef++;
+  }
+  sqlite3_mutex_leave(pShard->mutex);
+  return p ? WALCACHE_DATA(p) : 0;
+}
+
+/*
+** Allocate a buffer for page pgno with key pKey, making room for it by
+** evicting unpinned pages of the same shard if required.  The caller
+** fills the buffer with the page content and then passes it to either
+** sqlite3WalCacheInsert() or, if the content could not be read,
+** sqlite3WalCacheDiscard().
+**
+** NULL is returned if the page does not fit in the memory budget or if
+** a malloc fails.  The caller should then read the page into its own
+** private cache instead.
+*/
+void *sqlite3WalCacheAlloc(Pgno pgno, const WalCacheKey *pKey, int szPage){
+  unsigned int h = walCacheHash(pKey->pFile, pgno);
+  WalCacheShard *pShard = walCacheShard(h);
+  int nByte = WALCACHE_HDRSIZE + szPage;
+  i64 mxByte = walCacheShardLimit();
+  int nFree = 0;
+  WalCachePage *p = 0;
+
+  /* Reserve space for the new page within the budget of the shard. The
+  ** allocation itself is made without holding the mutex, as it may call
+  ** sqlite3_release_memory(). */
+  sqlite3_mutex_enter(pShard->mutex);
+  if( pShard->nByte+nByte>mxByte ){
+    nFree = walCacheEvictLru(pShard, pShard->nByte+nByte-mxByte);
+  }
+  if( pShard->nByte+nByte<=mxByte ){
+    pShard->nByte += nByte;
+    sqlite3_mutex_leave(pShard->mutex);
+    sqlite3BeginBenignMalloc();
+    p = (WalCachePage *)sqlite3Malloc(nByte);
+    sqlite3EndBenignMalloc();
+    if( p==0 ){
+      sqlite3_mutex_enter(pShard->mutex);
+      pShard->nByte -= nByte;
+      sqlite3_mutex_leave(pShard->mutex);
+    }
+  }else{
+    sqlite3_mutex_leave(pShard->mutex);
+  }
+
+  if( p ){
+    memset(p, 0, sizeof(WalCachePage));
+    p->key = *pKey;
+    p->pgno = pgno;
+    p->szPage = szPage;
+    p->nRef = 1;
+    nFree -= nByte;
+  }
+  if( nFree ) walCacheStatusAdd(-nFree);
+  return p ? WALCACHE_DATA(p) : 0;
+}
+
+/*
+** Free a buffer returned by sqlite3WalCacheAlloc() without adding it to
+** the cache.
+*/
+void sqlite3WalCacheDiscard(void *pData){
+  WalCachePage *p = WALCACHE_PAGE(pData);
+  unsigned int h = walCacheHash(p->key.pFile, p->pgno);
+  WalCacheShard *pShard = walCacheShard(h);
+  int nByte = WALCACHE_HDRSIZE + p->szPage;
+
+  assert( p->isHashed==0 && p->nRef==1 );
+  sqlite3_mutex_enter(pShard->mutex);
+  pShard->nByte -= nByte;
+  sqlite3_mutex_leave(pShard->mutex);
+  sqlite3_free(p);
+  walCacheStatusAdd(-nByte);
+}
+
+/*
+** Add a buffer returned by sqlite3WalCacheAlloc() and filled in by the
+** caller to the cache.  The new entry is pinned.  If another connection
+** added the same page in the meantime, the buffer is freed and the
+** existing entry is pinned and returned instead.
+*/
+void *sqlite3WalCacheInsert(void *pData){
+  WalCachePage *p = WALCACHE_PAGE(pData);
+  unsigned int h = walCacheHash(p->key.pFile, p->pgno);
+  WalCacheShard *pShard = walCacheShard(h);
+  WalCachePage *pOther;
+
+  assert( p->isHashed==0 && p->nRef==1 );
+  sqlite3_mutex_enter(pShard->mutex);
+  if( pShard->nPage>=pShard->nHash ) walCacheResizeHash(pShard);
+  pOther = walCacheFind(pShard, h, p->pgno, &p->key, p->szPage);
+  if( pOther ){
+    if( pOther->nRef==0 ) walCacheLruRemove(pShard, pOther);
+    pOther->nRef++;
+  }else{
+    if( pShard->nHash ){
+      unsigned int iSlot = walCacheSlot(pShard, h);
+      p->pHashNext = pShard->apHash[iSlot];
+      pShard->apHash[iSlot] = p;
+      p->isHashed = 1;
+      pShard->nPage++;
+    }
+  }
+  sqlite3_mutex_leave(pShard->mutex);
+
+  if( pOther ){
+    sqlite3WalCacheDiscard(pData);
+    return WALCACHE_DATA(pOther);
+  }
+  return pData;
+}
+
+/*
+** Release a reference to page content returned by sqlite3WalCacheFetch()
+** or sqlite3WalCacheInsert().
+*/
+void sqlite3WalCacheRelease(void *pData){
+  WalCachePage *p = WALCACHE_PAGE(pData);
+  unsigned int h = walCacheHash(p->key.pFile, p->pgno);
+  WalCacheShard *pShard = walCacheShard(h);
+
+  if( p->isHashed==0 ){
+    /* The hash table could not be allocated when this page was inserted,
+    ** so it was never shared.  Free it now. */
+    sqlite3WalCacheDiscard(pData);
+    return;
+  }
+  sqlite3_mutex_enter(pShard->mutex);
+  assert( p->nRef>0 );
+  if( --p->nRef==0 ){
+    p->pLruNext = pShard->pLruHead;
+    if( pShard->pLruHead ){
+      pShard->pLruHead->pLruPrev = p;
+    }else{
+      pShard->pLruTail = p;
+    }
+    pShard->pLruHead = p;
+  }
+  sqlite3_mutex_leave(pShard->mutex);
+}
+
+#ifdef SQLITE_ENABLE_MEMORY_MANAGEMENT
+/*
+** Free up to nReq bytes of memory held by unpinned pages.  Return the
+** number of bytes actually freed.  This routine is called by
+** sqlite3_release_memory().
+*/
+int sqlite3WalCacheReleaseMemory(int nReq){
+  int nFree = 0;
+  int i;
+  for(i=0; i<WALCACHE_NSHARD && (nReq<0 || nFree<nReq); i++){
+    WalCacheShard *pShard = &walcache.aShard[i];
+    sqlite3_mutex_enter(pShard->mutex);
+    nFree += walCacheEvictLru(pShard, nReq<0 ? -1 : nReq-nFree);
+    sqlite3_mutex_leave(pShard->mutex);
+  }
+  if( nFree ) walCacheStatusAdd(-nFree);
+  return nFree;
+}
+#endif /* SQLITE_ENABLE_MEMORY_MANAGEMENT */
+
+#endif /* #ifndef SQLITE_OMIT_WAL */
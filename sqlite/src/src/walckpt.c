@@ -0,0 +1,308 @@
+/*
+** 2011 August 22
+**
+** The author disclaims copyright to this source code.  In place of
+** a legal notice, here is a blessing:
+**
+**    May you do good and not evil.
+**    May you find forgiveness for yourself and forgive others.
+**    May you share freely, never taking more than you give.
+**
+*************************************************************************
+**
+** This file contains the background checkpointer configured by
+** sqlite3_wal_background_checkpoint().
+**
+** Like the callback registered by sqlite3_wal_autocheckpoint(), the
+** background checkpointer is an sqlite3_wal_hook() callback that is
+** invoked after each commit with the number of frames in the WAL file.
+** Instead of running the checkpoint before the commit returns, it hands
+** the database to a worker thread and returns immediately.
+**
+** The worker thread opens its own private connection to the database file
+** and runs a series of PASSIVE checkpoints on it, each of which copies at
+** most nBatch frames into the database file (see walCheckpoint()).  The
+** locks required by a checkpoint are released between batches, and a
+** PASSIVE checkpoint never waits for readers, so the thread only makes
+** as much progress as the readers of the database allow.  It stops when
+** the whole WAL file has been backfilled, when a batch makes no progress
+** or when an error occurs, and then waits for the next commit.
+**
+** Worker threads are only used by threadsafe builds on unix.  Otherwise,
+** or if the thread cannot be started, the checkpoint is run synchronously
+** in the hook, exactly as sqlite3_wal_autocheckpoint() would.
+**
+** The WAL file can only be restarted by a writer once all of it has been
+** backfilled, so if transactions are committed faster than the worker
+** can copy them the WAL file keeps growing.  To bound it, once the WAL
+** holds WALCKPT_BACKSTOP times the configured number of frames the hook
+** also runs a checkpoint synchronously, stalling the writer until the
+** worker has caught up.
+*/
+#include "sqliteInt.h"
+
+#ifndef SQLITE_OMIT_WAL
+
+#if SQLITE_THREADSAFE && SQLITE_OS_UNIX
+# define WALCKPT_THREADS 1
+# include <pthread.h>
+#else
+# define WALCKPT_THREADS 0
+#endif
+
+/*
+** Checkpoint synchronously once the WAL is this many times larger than
+** the size at which a background checkpoint is started.
+*/
+#define WALCKPT_BACKSTOP 4
+
+typedef struct WalCkpt WalCkpt;
+typedef struct WalCkptDb WalCkptDb;
+
+/*
+** A database file checkpointed by the worker thread.  A WalCkpt object
+** may be asked to checkpoint the main database and any attached WAL
+** databases of its connection, so it keeps a list of these.
+*/
+struct WalCkptDb {
+  char *zFile;                    /* Full path of the database file */
+  int bPending;                   /* True if a checkpoint is requested */
+  WalCkptDb *pNext;               /* Next database in WalCkpt.pDb list */
+};
+
+/*
+** The background checkpointer belonging to a single database connection.
+** A pointer to this object is the sqlite3.pWalArg of a connection whose
+** sqlite3.xWalCallback is sqlite3WalCkptHook().
+**
+** The mutex protects the pDb list and the bStop and bRunning flags.  The
+** WalCkptDb.zFile strings are not modified once the object is on the list,
+** so the worker may use them without holding the mutex.
+*/
+struct WalCkpt {
+  sqlite3_vfs *pVfs;              /* VFS used to open private connections */
+  int nFrame;                     /* Checkpoint when the WAL is this large */
+  int nBatch;                     /* Frames to copy per checkpoint step */
+  WalCkptDb *pDb;                 /* Databases known to this checkpointer */
+#if WALCKPT_THREADS
+  pthread_mutex_t mutex;          /* Mutex protecting the fields below */
+  pthread_cond_t cond;            /* Signalled when there is work or bStop */
+  pthread_t tid;                  /* The worker thread, if bRunning */
+  int bRunning;                   /* True once the worker thread is started */
+  int bStop;                      /* Set to ask the worker thread to exit */
+#endif
+};
+
+#if WALCKPT_THREADS
+/*
+** Return true if the worker thread has been asked to stop.
+*/
+static int walCkptStopping(WalCkpt *p){
+  int bStop;
+  pthread_mutex_lock(&p->mutex);
+  bStop = p->bStop;
+  pthread_mutex_unlock(&p->mutex);
+  return bStop;
+}
+
+/*
+** Checkpoint database file zFile in batches of p->nBatch frames, using a
+** private connection that is opened for the purpose and closed again
+** afterwards, so that it does not hold a lock on the database file while
+** the checkpointer is idle.
+*/
+static void walCkptRun(WalCkpt *p, const char *zFile){
+  sqlite3 *db = 0;
+  int rc;
+
+  rc = sqlite3_open_v2(zFile, &db,
+      SQLITE_OPEN_READWRITE | SQLITE_OPEN_NOMUTEX | SQLITE_OPEN_PRIVATECACHE,
+      p->pVfs->zName
+  );
+  if( rc==SQLITE_OK ){
+    /* Read the database header so that the pager opens the WAL file. */
+    rc = sqlite3_exec(db, "PRAGMA schema_version", 0, 0, 0);
+  }
+  if( rc==SQLITE_OK ){
+    int nPrev = -1;
+    sqlite3PagerCheckpointBatch(sqlite3BtreePager(db->aDb[0].pBt), p->nBatch);
+    while( !walCkptStopping(p) ){
+      int nLog = 0;
+      int nCkpt = 0;
+      rc = sqlite3_wal_checkpoint_v2(db, "main", SQLITE_CHECKPOINT_PASSIVE,
+                                     &nLog, &nCkpt);
+      if( rc!=SQLITE_OK || nCkpt>=nLog || nCkpt<=nPrev ) break;
+      nPrev = nCkpt;
+    }
+  }
+  sqlite3_close(db);
+}
+
+/*
+** Entry point for the worker thread.  Wait for databases to be marked as
+** pending, and checkpoint each of them, until asked to stop.
+*/
+static void *walCkptThreadMain(void *pCtx){
+  WalCkpt *p = (WalCkpt*)pCtx;
+  pthread_mutex_lock(&p->mutex);
+  while( !p->bStop ){
+    WalCkptDb *pDb;
+    for(pDb=p->pDb; pDb && pDb->bPending==0; pDb=pDb->pNext);
+    if( pDb==0 ){
+      pthread_cond_wait(&p->cond, &p->mutex);
+    }else{
+      pDb->bPending = 0;
+      pthread_mutex_unlock(&p->mutex);
+      walCkptRun(p, pDb->zFile);
+      pthread_mutex_lock(&p->mutex);
+    }
+  }
+  pthread_mutex_unlock(&p->mutex);
+  return 0;
+}
+
+/*
+** Ask the worker thread to checkpoint database file zFile, starting the
+** thread if it is not already running.  Return SQLITE_OK if the request
+** was queued, or an error code if the caller should run the checkpoint
+** itself.
+*/
+static int walCkptSchedule(WalCkpt *p, const char *zFile){
+  WalCkptDb *pDb;
+  int rc = SQLITE_OK;
+
+  pthread_mutex_lock(&p->mutex);
+  for(pDb=p->pDb; pDb && strcmp(pDb->zFile, zFile); pDb=pDb->pNext);
+  if( pDb==0 ){
+    int nFile = sqlite3Strlen30(zFile);
+    pDb = (WalCkptDb*)sqlite3MallocZero(sizeof(WalCkptDb) + nFile + 1);
+    if( pDb==0 ){
+      rc = SQLITE_NOMEM;
+    }else{
+      pDb->zFile = (char*)&pDb[1];
+      memcpy(pDb->zFile, zFile, nFile+1);
+      pDb->pNext = p->pDb;
+      p->pDb = pDb;
+    }
+  }
+  if( rc==SQLITE_OK && p->bRunning==0 ){
+    if( pthread_create(&p->tid, 0, walCkptThreadMain, p)==0 ){
+      p->bRunning = 1;
+    }else{
+      rc = SQLITE_ERROR;
+    }
+  }
+  if( rc==SQLITE_OK ){
+    pDb->bPending = 1;
+    pthread_cond_signal(&p->cond);
+  }
+  pthread_mutex_unlock(&p->mutex);
+  return rc;
+}
+#endif /* WALCKPT_THREADS */
+
+/*
+** Allocate a new background checkpointer for connection db.  Return a
+** pointer to it, or NULL if a malloc fails.  The object is freed by
+** sqlite3WalCkptDestroy().
+*/
+void *sqlite3WalCkptCreate(sqlite3 *db, int nFrame, int nBatch){
+  WalCkpt *p;
+  assert( nFrame>0 && nBatch>0 );
+  p = (WalCkpt*)sqlite3MallocZero(sizeof(WalCkpt));
+  if( p ){
+    p->pVfs = db->pVfs;
+    p->nFrame = nFrame;
+    p->nBatch = nBatch;
+#if WALCKPT_THREADS
+    pthread_mutex_init(&p->mutex, 0);
+    pthread_cond_init(&p->cond, 0);
+#endif
+  }
+  return (void*)p;
+}
+
+/*
+** Stop the worker thread of the background checkpointer passed as the
+** only argument, waiting for any checkpoint step that is in progress to
+** finish, and free the object.
+*/
+void sqlite3WalCkptDestroy(void *pArg){
+  WalCkpt *p = (WalCkpt*)pArg;
+  WalCkptDb *pDb;
+  WalCkptDb *pNext;
+#if WALCKPT_THREADS
+  int bRunning;
+  pthread_mutex_lock(&p->mutex);
+  p->bStop = 1;
+  bRunning = p->bRunning;
+  pthread_cond_signal(&p->cond);
+  pthread_mutex_unlock(&p->mutex);
+  if( bRunning ){
+    pthread_join(p->tid, 0);
+  }
+  pthread_cond_destroy(&p->cond);
+  pthread_mutex_destroy(&p->mutex);
+#endif
+  for(pDb=p->pDb; pDb; pDb=pNext){
+    pNext = pDb->pNext;
+    sqlite3_free(pDb);
+  }
+  sqlite3_free(p);
+}
+
+/*
+** Return the WAL size, in frames, at which the background checkpointer
+** passed as the only argument starts a checkpoint.
+*/
+int sqlite3WalCkptFrames(void *pArg){
+  return ((WalCkpt*)pArg)->nFrame;
+}
+
+/*
+** The sqlite3_wal_hook() callback registered by
+** sqlite3_wal_background_checkpoint().  If the WAL file of database zDb
+** holds at least WalCkpt.nFrame frames, schedule a checkpoint of it on
+** the worker thread.
+**
+** Databases in locking_mode=EXCLUSIVE cannot be opened by the worker's
+** private connection, so they are always checkpointed synchronously, as
+** are databases whose WAL has grown past the backstop.
+*/
+int sqlite3WalCkptHook(
+  void *pClientData,     /* Pointer to the WalCkpt object */
+  sqlite3 *db,           /* Connection */
+  const char *zDb,       /* Database */
+  int nFrame             /* Size of WAL */
+){
+  WalCkpt *p = (WalCkpt*)pClientData;
+  int rc = SQLITE_ERROR;
+
+  if( nFrame<p->nFrame ) return SQLITE_OK;
+#if WALCKPT_THREADS
+  if( nFrame/WALCKPT_BACKSTOP<p->nFrame ){
+    int iDb = sqlite3FindDbName(db, zDb);
+    Btree *pBt = iDb>=0 ? db->aDb[iDb].pBt : 0;
+    if( pBt ){
+      Pager *pPager = sqlite3BtreePager(pBt);
+      const char *zFile = sqlite3BtreeGetFilename(pBt);
+      if( zFile && zFile[0]
+       && sqlite3PagerLockingMode(pPager, PAGER_LOCKINGMODE_QUERY)
+            ==PAGER_LOCKINGMODE_NORMAL
+      ){
+        sqlite3BeginBenignMalloc();
+        rc = walCkptSchedule(p, zFile);
+        sqlite3EndBenignMalloc();
+      }
+    }
+  }
+#endif
+  if( rc!=SQLITE_OK ){
+    sqlite3BeginBenignMalloc();
+    sqlite3_wal_checkpoint(db, zDb);
+    sqlite3EndBenignMalloc();
+  }
+  return SQLITE_OK;
+}
+
+#endif /* SQLITE_OMIT_WAL */
@@ -139,7 +139,7 @@ proc copy_file {filename} {
   section_comment "Begin file $tail"
   set in [open $filename r]
   set varpattern {^[a-zA-Z][a-zA-Z_0-9 *]+(sqlite3[_a-zA-Z0-9]+)(\[|;| =)}
-  set declpattern {[a-zA-Z][a-zA-Z_0-9 ]+ \**(sqlite3[_a-zA-Z0-9]+)\(}
+  set declpattern {[a-zA-Z][a-zA-Z_0-9 ]+ \**((?:chromium_)?sqlite3[_a-zA-Z0-9]+)\(}
   if {[file extension $filename]==".h"} {
     set declpattern " *$declpattern"
   }
@@ -169,7 +169,7 @@ proc copy_file {filename} {
       if {[regexp $declpattern $line all funcname]} {
         # Add the SQLITE_PRIVATE or SQLITE_API keyword before functions.
         # so that linkage can be modified at compile-time.
-        if {[regexp {^sqlite3_} $funcname]} {
+        if {[regexp {^(chromium_)?sqlite3_} $funcname]} {
           puts $out "SQLITE_API $line"
         } else {
           puts $out "SQLITE_PRIVATE $line"
@@ -246,6 +246,7 @@ foreach file {
    rowset.c
    pager.c
    wal.c
+   walcache.c
 
    btmutex.c
    btree.c
@@ -255,6 +256,8 @@ foreach file {
    vdbeaux.c
    vdbeapi.c
    vdbetrace.c
+   vdbesort.c
+   vdbeprof.c
    vdbe.c
    vdbeblob.c
    journal.c
@@ -292,6 +295,7 @@ foreach file {
 
    main.c
    notify.c
+   walckpt.c
 
    recover.c
 
@@ -63,7 +63,7 @@ close $in
 # Set up patterns for recognizing API declarations.
 #
 set varpattern {^[a-zA-Z][a-zA-Z_0-9 *]+sqlite3_[_a-zA-Z0-9]+(\[|;| =)}
-set declpattern {^ *[a-zA-Z][a-zA-Z_0-9 ]+ \**sqlite3_[_a-zA-Z0-9]+\(}
+set declpattern {^ *[a-zA-Z][a-zA-Z_0-9 ]+ \**(chromium_)?sqlite3_[_a-zA-Z0-9]+\(}
 
 # Process the src/sqlite.h.in ext/rtree/sqlite3rtree.h files.
 #
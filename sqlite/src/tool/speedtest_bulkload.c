@@ -0,0 +1,287 @@
+/*
+** Performance test for "PRAGMA bulk_load" in SQLite.
+**
+** This program imports rows into a table with an INTEGER PRIMARY KEY
+** and an index on a column whose values increase with the rowid, in
+** ascending rowid order and in transactions of -batch rows, as an
+** application importing data from another store would.  It then times
+** CREATE INDEX on a column of pseudo-random keys, a copy of the table
+** using "INSERT INTO ... SELECT *", and a VACUUM.  This is done once
+** with bulk-loading disabled and once with "PRAGMA bulk_load" set to
+** the fill factor given by the -fill option.
+**
+** For each step the real, user and system times are reported, along
+** with the number of bytes written to the database and journal files
+** (read from /proc/self/io, where available).  The final size of the
+** database and the time taken by a full scan of each index are also
+** reported.
+**
+** To compile this program, first compile the SQLite library separately
+** with full optimizations.  For example:
+**
+**     gcc -c -O2 sqlite3.c
+**
+** Then link against this program:
+**
+**     gcc -O2 speedtest_bulkload.c sqlite3.o -ldl -lpthread
+**
+** And run it with the name of a scratch database file:
+**
+**     ./a.out [options] test.db
+**
+** The default of 500,000 rows produces a database of roughly 150MB.
+*/
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <sys/time.h>
+#include <sys/times.h>
+
+#include "sqlite3.h"
+
+/*
+** Return the current wall-clock time in microseconds.
+*/
+static sqlite_uint64 timeOfDay(void){
+  struct timeval sNow;
+  gettimeofday(&sNow, 0);
+  return (sqlite_uint64)sNow.tv_sec*1000000 + sNow.tv_usec;
+}
+
+/*
+** Return the number of bytes this process has passed to write() and
+** similar system calls, or -1 if this is not known.
+*/
+static sqlite3_int64 bytesWritten(void){
+  sqlite3_int64 nByte = -1;
+  char zLine[100];
+  FILE *pIo = fopen("/proc/self/io", "r");
+  if( pIo ){
+    while( fgets(zLine, sizeof(zLine), pIo) ){
+      if( strncmp(zLine, "wchar:", 6)==0 ){
+        nByte = atoll(&zLine[6]);
+        break;
+      }
+    }
+    fclose(pIo);
+  }
+  return nByte;
+}
+
+/*
+** Run a statement that returns no rows.  Exit on error.
+*/
+static void execOrDie(sqlite3 *db, const char *zSql){
+  char *zErr = 0;
+  if( sqlite3_exec(db, zSql, 0, 0, &zErr)!=SQLITE_OK ){
+    fprintf(stderr, "SQL error: %s\n%s\n", zErr, zSql);
+    exit(1);
+  }
+}
+
+/*
+** Prepare a statement.  Exit on error.
+*/
+static sqlite3_stmt *prepareOrDie(sqlite3 *db, const char *zSql){
+  sqlite3_stmt *pStmt = 0;
+  if( sqlite3_prepare_v2(db, zSql, -1, &pStmt, 0)!=SQLITE_OK ){
+    fprintf(stderr, "SQL error: %s\n%s\n", sqlite3_errmsg(db), zSql);
+    exit(1);
+  }
+  return pStmt;
+}
+
+/*
+** Return the integer value returned by a single-row query.
+*/
+static sqlite3_int64 queryInt(sqlite3 *db, const char *zSql){
+  sqlite3_stmt *pStmt = prepareOrDie(db, zSql);
+  sqlite3_int64 iVal = 0;
+  if( sqlite3_step(pStmt)==SQLITE_ROW ){
+    iVal = sqlite3_column_int64(pStmt, 0);
+  }
+  sqlite3_finalize(pStmt);
+  return iVal;
+}
+
+/*
+** Timings for one step of the test.
+*/
+typedef struct Sample Sample;
+struct Sample {
+  sqlite_uint64 iTime;        /* timeOfDay() */
+  sqlite3_int64 nWrite;       /* bytesWritten() */
+  struct tms sTms;            /* times() */
+};
+
+static void takeSample(Sample *p){
+  times(&p->sTms);
+  p->nWrite = bytesWritten();
+  p->iTime = timeOfDay();
+}
+
+/*
+** Print the timings and the amount of data written between the sample
+** in pStart and now.
+*/
+static void reportStep(const char *zLabel, Sample *pStart){
+  double rTick = (double)sysconf(_SC_CLK_TCK);
+  Sample sEnd;
+  takeSample(&sEnd);
+  printf("  %-20s %8.3f real %8.3f user %8.3f sys", zLabel,
+         (sEnd.iTime - pStart->iTime)/1000000.0,
+         (sEnd.sTms.tms_utime - pStart->sTms.tms_utime)/rTick,
+         (sEnd.sTms.tms_stime - pStart->sTms.tms_stime)/rTick);
+  if( pStart->nWrite>=0 && sEnd.nWrite>=0 ){
+    printf(" %9.1f MB written", (sEnd.nWrite - pStart->nWrite)/1048576.0);
+  }
+  printf("\n");
+}
+
+/*
+** Import nRow rows into a new database, then build and copy the table
+** and VACUUM the result, with PRAGMA bulk_load set to nFill.
+*/
+static void runImport(
+  const char *zFile,          /* Database to use */
+  int nRow,                   /* Number of rows to import */
+  int nBatch,                 /* Rows per transaction */
+  int nFill                   /* Value for PRAGMA bulk_load */
+){
+  sqlite3 *db;
+  sqlite3_stmt *pIns;
+  sqlite3_stmt *pScan;
+  char zSql[64];
+  Sample sStart;
+  int i;
+  static const char *azScan[] = {
+    "SELECT count(*) FROM t1 INDEXED BY i1time WHERE time>0",
+    "SELECT count(*) FROM t1 INDEXED BY i1key WHERE key>''",
+    "SELECT count(*) FROM t1 WHERE rowid>0",
+  };
+
+  unlink(zFile);
+  sqlite3_open(zFile, &db);
+  execOrDie(db, "PRAGMA synchronous=OFF; PRAGMA cache_size=4000");
+  sqlite3_snprintf(sizeof(zSql), zSql, "PRAGMA bulk_load=%d", nFill);
+  execOrDie(db, zSql);
+  printf("bulk_load=%d (actual %d)\n", nFill,
+         (int)queryInt(db, "PRAGMA bulk_load"));
+
+  execOrDie(db, "CREATE TABLE t1(id INTEGER PRIMARY KEY, time INTEGER,"
+                "  key TEXT, data BLOB);"
+                "CREATE INDEX i1time ON t1(time);");
+  pIns = prepareOrDie(db, "INSERT INTO t1 VALUES(?, ?, ?, randomblob(?))");
+  takeSample(&sStart);
+  execOrDie(db, "BEGIN");
+  for(i=1; i<=nRow; i++){
+    char zKey[40];
+    unsigned int h = (unsigned)(i*2654435761u);
+    sqlite3_snprintf(sizeof(zKey), zKey, "%08x-%08x-%d",
+                     h, h*2246822519u, i%1000);
+    sqlite3_bind_int(pIns, 1, i);
+    sqlite3_bind_int64(pIns, 2, (sqlite3_int64)1300000000000 + i*1000);
+    sqlite3_bind_text(pIns, 3, zKey, -1, SQLITE_TRANSIENT);
+    sqlite3_bind_int(pIns, 4, 100 + (i%7)*30);
+    sqlite3_step(pIns);
+    if( sqlite3_reset(pIns)!=SQLITE_OK ){
+      fprintf(stderr, "SQL error: %s\n", sqlite3_errmsg(db));
+      exit(1);
+    }
+    if( (i%nBatch)==0 ){
+      execOrDie(db, "COMMIT; BEGIN");
+    }
+  }
+  execOrDie(db, "COMMIT");
+  sqlite3_finalize(pIns);
+  reportStep("import:", &sStart);
+
+  takeSample(&sStart);
+  execOrDie(db, "CREATE INDEX i1key ON t1(key)");
+  reportStep("CREATE INDEX:", &sStart);
+
+  takeSample(&sStart);
+  execOrDie(db, "CREATE TABLE t2(id INTEGER PRIMARY KEY, time INTEGER,"
+                "  key TEXT, data BLOB);"
+                "CREATE INDEX i2time ON t2(time);"
+                "CREATE INDEX i2key ON t2(key);"
+                "INSERT INTO t2 SELECT * FROM t1;");
+  reportStep("INSERT ... SELECT:", &sStart);
+  execOrDie(db, "DROP TABLE t2");
+
+  takeSample(&sStart);
+  execOrDie(db, "VACUUM");
+  reportStep("VACUUM:", &sStart);
+  printf("  database size:       %8.1f MB\n",
+         queryInt(db, "PRAGMA page_count")
+             * queryInt(db, "PRAGMA page_size") / 1048576.0);
+
+  /* Time a scan of each b-tree, starting with an empty page cache. */
+  for(i=0; i<(int)(sizeof(azScan)/sizeof(azScan[0])); i++){
+    sqlite3_int64 nCount;
+    sqlite3_close(db);
+    sqlite3_open(zFile, &db);
+    pScan = prepareOrDie(db, azScan[i]);
+    takeSample(&sStart);
+    sqlite3_step(pScan);
+    nCount = sqlite3_column_int64(pScan, 0);
+    sqlite3_finalize(pScan);
+    reportStep(i==0 ? "scan i1time:" : i==1 ? "scan i1key:" : "scan t1:",
+               &sStart);
+    if( nCount!=nRow ){
+      fprintf(stderr, "scan returned %lld rows, expected %d\n", nCount, nRow);
+      exit(1);
+    }
+  }
+  if( sqlite3_exec(db, "PRAGMA quick_check", 0, 0, 0)!=SQLITE_OK ){
+    fprintf(stderr, "quick_check failed: %s\n", sqlite3_errmsg(db));
+    exit(1);
+  }
+  sqlite3_close(db);
+}
+
+int main(int argc, char **argv){
+  const char *zArgv0 = argv[0];
+  int nRow = 500000;
+  int nBatch = 1000;
+  int nFill = 100;
+
+  while( argc>2 ){
+    if( argc>3 && strcmp(argv[1], "-rows")==0 ){
+      nRow = atoi(argv[2]);
+      argv += 2;
+      argc -= 2;
+      continue;
+    }
+    if( argc>3 && strcmp(argv[1], "-batch")==0 ){
+      nBatch = atoi(argv[2]);
+      argv += 2;
+      argc -= 2;
+      continue;
+    }
+    if( argc>3 && strcmp(argv[1], "-fill")==0 ){
+      nFill = atoi(argv[2]);
+      argv += 2;
+      argc -= 2;
+      continue;
+    }
+    break;
+  }
+
+  if( argc!=2 || nRow<=0 || nBatch<=0 ){
+    fprintf(stderr, "Usage: %s [options] FILENAME\n"
+              "Times an import with and without PRAGMA bulk_load\n"
+              "\toptions:\n"
+              "\t-rows <n> : number of rows to import\n"
+              "\t-batch <n> : rows per transaction\n"
+              "\t-fill <n> : PRAGMA bulk_load value for the second run\n",
+              zArgv0);
+    exit(1);
+  }
+
+  printf("SQLite version: %d\n", sqlite3_libversion_number());
+  runImport(argv[1], nRow, nBatch, 0);
+  if( nFill>0 ) runImport(argv[1], nRow, nBatch, nFill);
+  return 0;
+}
@@ -0,0 +1,404 @@
+/*
+** Performance test for FTS3 index maintenance and AND queries.
+**
+** This program builds an FTS3 index resembling the full-text index of a
+** web browser's history: one row per visited page, with the url, title
+** and a short extract of the body text of the page.  Words are drawn
+** from a vocabulary with a Zipf distribution.  Pages are added a few at
+** a time, each batch in its own transaction, as they would be while
+** browsing, and the time taken by each transaction is recorded.  Then
+** a series of AND queries, some with a prefix term as typed into an
+** address bar, are run against the index.
+**
+** Use the -automerge option to have the index built using the
+** 'automerge=N' command, which defers the merging of full levels so that
+** no single write pays for a large merge.  Compare the worst case
+** transaction times with those of a build without it.
+**
+** To compile this program, first compile the SQLite library separately
+** with full optimizations.  For example:
+**
+**     gcc -c -O2 -DSQLITE_ENABLE_FTS3 sqlite3.c
+**
+** Then link against this program:
+**
+**     gcc -O2 speedtest_fts3.c sqlite3.o -ldl -lpthread
+**
+** And run it with the name of a scratch database file:
+**
+**     ./a.out [options] test.db
+**
+** Use -reuse to run the queries of several builds of the library
+** against the same database file.
+*/
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <sys/time.h>
+#include <sys/times.h>
+
+#include "sqlite3.h"
+
+/*
+** Return the current wall-clock time in microseconds.
+*/
+static sqlite_uint64 timeOfDay(void){
+  struct timeval sNow;
+  gettimeofday(&sNow, 0);
+  return (sqlite_uint64)sNow.tv_sec*1000000 + sNow.tv_usec;
+}
+
+/*
+** Run a statement that returns no rows.  Exit on error.
+*/
+static void execOrDie(sqlite3 *db, const char *zSql){
+  char *zErr = 0;
+  if( sqlite3_exec(db, zSql, 0, 0, &zErr)!=SQLITE_OK ){
+    fprintf(stderr, "SQL error: %s\n%s\n", zErr, zSql);
+    exit(1);
+  }
+}
+
+/*
+** Prepare a statement.  Exit on error.
+*/
+static sqlite3_stmt *prepareOrDie(sqlite3 *db, const char *zSql){
+  sqlite3_stmt *pStmt = 0;
+  if( sqlite3_prepare_v2(db, zSql, -1, &pStmt, 0)!=SQLITE_OK ){
+    fprintf(stderr, "SQL error: %s\n%s\n", sqlite3_errmsg(db), zSql);
+    exit(1);
+  }
+  return pStmt;
+}
+
+/*
+** Open a connection to zFile.  Exit on error.
+*/
+static sqlite3 *openOrDie(const char *zFile){
+  sqlite3 *db = 0;
+  if( sqlite3_open(zFile, &db)!=SQLITE_OK ){
+    fprintf(stderr, "cannot open %s: %s\n", zFile, sqlite3_errmsg(db));
+    exit(1);
+  }
+  return db;
+}
+
+/*
+** A vocabulary of nWord words.  Word i (starting from 0) is drawn with a
+** probability proportional to 1/(i+1).
+*/
+typedef struct Vocab Vocab;
+struct Vocab {
+  int nWord;                  /* Number of words */
+  double *aCum;               /* Cumulative probability of words 0..i */
+  unsigned int iRand;         /* State of the random number generator */
+};
+
+static unsigned int vocabRandom(Vocab *p){
+  p->iRand = p->iRand*1103515245 + 12345;
+  return p->iRand>>8;
+}
+
+static void vocabInit(Vocab *p, int nWord, unsigned int iSeed){
+  double rSum = 0.0;
+  int i;
+  p->nWord = nWord;
+  p->aCum = (double *)malloc(sizeof(double)*nWord);
+  p->iRand = iSeed;
+  for(i=0; i<nWord; i++){
+    rSum += 1.0/(i+1);
+    p->aCum[i] = rSum;
+  }
+  for(i=0; i<nWord; i++){
+    p->aCum[i] /= rSum;
+  }
+}
+
+/*
+** Return the index of a word chosen at random.
+*/
+static int vocabChoose(Vocab *p){
+  double r = (vocabRandom(p) & 0xffffff)/(double)0x1000000;
+  int iLo = 0;
+  int iHi = p->nWord-1;
+  while( iLo<iHi ){
+    int iMid = (iLo+iHi)/2;
+    if( p->aCum[iMid]<r ){
+      iLo = iMid+1;
+    }else{
+      iHi = iMid;
+    }
+  }
+  return iLo;
+}
+
+/*
+** Write the text of word iWord to zBuf.  Words are made of lower case
+** letters, so that prefixes of them are shared as in natural text.
+*/
+static int vocabWord(int iWord, char *zBuf){
+  static const char zCons[] = "bcdfghklmnprstvw";
+  static const char zVowel[] = "aeiou";
+  int n = 0;
+  iWord++;
+  do{
+    zBuf[n++] = zCons[iWord%16];
+    iWord /= 16;
+    zBuf[n++] = zVowel[iWord%5];
+    iWord /= 5;
+  }while( iWord>0 );
+  zBuf[n] = 0;
+  return n;
+}
+
+/*
+** Append nWord random words to zBuf, separated by zSep.
+*/
+static int appendWords(Vocab *p, char *zBuf, int nWord, const char *zSep){
+  int n = 0;
+  int i;
+  for(i=0; i<nWord; i++){
+    if( i>0 ){
+      memcpy(&zBuf[n], zSep, strlen(zSep));
+      n += strlen(zSep);
+    }
+    n += vocabWord(vocabChoose(p), &zBuf[n]);
+  }
+  zBuf[n] = 0;
+  return n;
+}
+
+static int cmpTime(const void *a, const void *b){
+  sqlite_uint64 x = *(const sqlite_uint64 *)a;
+  sqlite_uint64 y = *(const sqlite_uint64 *)b;
+  return x<y ? -1 : x>y;
+}
+
+/*
+** Create the test database and index nDoc pages, nBatch pages per
+** transaction.  If nAutoMerge is greater than zero, the index is
+** built with 'automerge=N' set to that value.
+*/
+static void createDb(
+  const char *zFile,
+  int nDoc,
+  int nBatch,
+  int nAutoMerge,
+  Vocab *pVocab
+){
+  sqlite3 *db;
+  sqlite3_stmt *pIns;
+  sqlite3_stmt *pSeg;
+  sqlite_uint64 *aTime;
+  sqlite_uint64 iTotal = 0;
+  int nTxn = (nDoc+nBatch-1)/nBatch;
+  int iTxn;
+  int iDoc = 0;
+  char zSql[200];
+
+  unlink(zFile);
+  db = openOrDie(zFile);
+  execOrDie(db, "PRAGMA synchronous=OFF;"
+                "CREATE VIRTUAL TABLE pages USING fts3(url, title, body);");
+  if( nAutoMerge>0 ){
+    sqlite3_snprintf(sizeof(zSql), zSql,
+        "INSERT INTO pages(pages) VALUES('automerge=%d')", nAutoMerge);
+    execOrDie(db, zSql);
+  }
+
+  aTime = (sqlite_uint64 *)malloc(sizeof(sqlite_uint64)*nTxn);
+  pIns = prepareOrDie(db,
+      "INSERT INTO pages(docid, url, title, body) VALUES(?, ?, ?, ?)");
+  for(iTxn=0; iTxn<nTxn; iTxn++){
+    sqlite_uint64 iStart = timeOfDay();
+    int i;
+    execOrDie(db, "BEGIN");
+    for(i=0; i<nBatch && iDoc<nDoc; i++){
+      char zUrl[200];
+      char zTitle[200];
+      char zBody[2000];
+      int n;
+      iDoc++;
+      memcpy(zUrl, "http://www.", 11);
+      n = 11;
+      n += appendWords(pVocab, &zUrl[n], 1, "");
+      memcpy(&zUrl[n], ".com/", 5);
+      n += 5;
+      appendWords(pVocab, &zUrl[n], 2, "/");
+      appendWords(pVocab, zTitle, 3 + vocabRandom(pVocab)%8, " ");
+      appendWords(pVocab, zBody, 20 + vocabRandom(pVocab)%100, " ");
+      sqlite3_bind_int(pIns, 1, iDoc);
+      sqlite3_bind_text(pIns, 2, zUrl, -1, SQLITE_STATIC);
+      sqlite3_bind_text(pIns, 3, zTitle, -1, SQLITE_STATIC);
+      sqlite3_bind_text(pIns, 4, zBody, -1, SQLITE_STATIC);
+      sqlite3_step(pIns);
+      if( sqlite3_reset(pIns)!=SQLITE_OK ){
+        fprintf(stderr, "SQL error: %s\n", sqlite3_errmsg(db));
+        exit(1);
+      }
+    }
+    execOrDie(db, "COMMIT");
+    aTime[iTxn] = timeOfDay() - iStart;
+    iTotal += aTime[iTxn];
+  }
+  sqlite3_finalize(pIns);
+
+  qsort(aTime, nTxn, sizeof(sqlite_uint64), cmpTime);
+  printf("indexing (%d pages, %d per transaction, automerge=%d):\n",
+         nDoc, nBatch, nAutoMerge);
+  printf("  %-22s %9.3f s\n", "total:", iTotal/1000000.0);
+  printf("  %-22s %9.3f ms\n", "mean transaction:", iTotal/1000.0/nTxn);
+  printf("  %-22s %9.3f ms\n", "99th percentile:",
+         aTime[(nTxn-1)*99/100]/1000.0);
+  printf("  %-22s %9.3f ms\n", "99.9th percentile:",
+         aTime[(nTxn-1)*999/1000]/1000.0);
+  printf("  %-22s %9.3f ms\n", "worst transaction:", aTime[nTxn-1]/1000.0);
+  free(aTime);
+
+  pSeg = prepareOrDie(db,
+      "SELECT level, count(*) FROM pages_segdir GROUP BY level");
+  printf("  %-22s", "segments per level:");
+  while( sqlite3_step(pSeg)==SQLITE_ROW ){
+    printf(" %d:%d", sqlite3_column_int(pSeg, 0), sqlite3_column_int(pSeg, 1));
+  }
+  printf("\n");
+  sqlite3_finalize(pSeg);
+  sqlite3_close(db);
+}
+
+/*
+** Run nQuery queries of nTerm terms each.  The first term is one of the
+** 50 most common words, the others are less common words chosen
+** uniformly from the next 10000.  If bPrefix is true, the last term is a
+** prefix query on the first three letters of a word, as seen while a
+** query is being typed.
+*/
+static void runQueries(
+  sqlite3 *db,
+  const char *zLabel,
+  int nQuery,
+  int nTerm,
+  int bPrefix,
+  Vocab *pVocab
+){
+  sqlite3_stmt *pStmt;
+  sqlite_uint64 iStart, iElapse;
+  struct tms tmsStart, tmsEnd;
+  double rTick = (double)sysconf(_SC_CLK_TCK);
+  sqlite3_int64 nRow = 0;
+  sqlite3_int64 iSum = 0;
+  int i;
+
+  pStmt = prepareOrDie(db, "SELECT docid FROM pages WHERE pages MATCH ?");
+  times(&tmsStart);
+  iStart = timeOfDay();
+  for(i=0; i<nQuery; i++){
+    char zQuery[200];
+    int n = 0;
+    int j;
+    n += vocabWord(vocabRandom(pVocab)%50, &zQuery[n]);
+    for(j=1; j<nTerm; j++){
+      int nWord;
+      zQuery[n++] = ' ';
+      nWord = vocabWord(50 + vocabRandom(pVocab)%10000, &zQuery[n]);
+      if( bPrefix && j==nTerm-1 && nWord>3 ){
+        nWord = 3;
+        zQuery[n+nWord++] = '*';
+      }
+      n += nWord;
+    }
+    sqlite3_bind_text(pStmt, 1, zQuery, n, SQLITE_STATIC);
+    while( sqlite3_step(pStmt)==SQLITE_ROW ){
+      nRow++;
+      iSum += sqlite3_column_int64(pStmt, 0);
+    }
+    if( sqlite3_reset(pStmt)!=SQLITE_OK ){
+      fprintf(stderr, "SQL error: %s\n", sqlite3_errmsg(db));
+      exit(1);
+    }
+  }
+  iElapse = timeOfDay() - iStart;
+  times(&tmsEnd);
+  sqlite3_finalize(pStmt);
+
+  printf("  %-22s %9.3f real %9.3f user %9.0f queries/s\n", zLabel,
+         iElapse/1000000.0,
+         (tmsEnd.tms_utime - tmsStart.tms_utime)/rTick,
+         nQuery*1000000.0/(double)(iElapse ? iElapse : 1));
+  printf("  %-22s %9lld rows (checksum %lld)\n", "", nRow, iSum);
+}
+
+int main(int argc, char **argv){
+  const char *zArgv0 = argv[0];
+  int nDoc = 200000;
+  int nBatch = 10;
+  int nAutoMerge = 0;
+  int nQuery = 2000;
+  int bReuse = 0;
+  Vocab vocab;
+  sqlite3 *db;
+
+  while( argc>2 ){
+    if( argc>3 && strcmp(argv[1], "-pages")==0 ){
+      nDoc = atoi(argv[2]);
+      argv += 2;
+      argc -= 2;
+      continue;
+    }
+    if( argc>3 && strcmp(argv[1], "-batch")==0 ){
+      nBatch = atoi(argv[2]);
+      argv += 2;
+      argc -= 2;
+      continue;
+    }
+    if( argc>3 && strcmp(argv[1], "-automerge")==0 ){
+      nAutoMerge = atoi(argv[2]);
+      argv += 2;
+      argc -= 2;
+      continue;
+    }
+    if( argc>3 && strcmp(argv[1], "-queries")==0 ){
+      nQuery = atoi(argv[2]);
+      argv += 2;
+      argc -= 2;
+      continue;
+    }
+    if( strcmp(argv[1], "-reuse")==0 ){
+      bReuse = 1;
+      argv++;
+      argc--;
+      continue;
+    }
+    break;
+  }
+
+  if( argc!=2 || nDoc<=0 || nBatch<=0 || nAutoMerge<0 || nQuery<=0 ){
+    fprintf(stderr, "Usage: %s [options] FILENAME\n"
+              "Times the indexing of and AND queries on an FTS3 index\n"
+              "\toptions:\n"
+              "\t-pages <n> : number of pages to index\n"
+              "\t-batch <n> : number of pages indexed per transaction\n"
+              "\t-automerge <n> : build the index with 'automerge=n'\n"
+              "\t-queries <n> : number of queries of each kind to run\n"
+              "\t-reuse : do not rebuild an existing database\n",
+              zArgv0);
+    exit(1);
+  }
+
+  printf("SQLite version: %d\n", sqlite3_libversion_number());
+  vocabInit(&vocab, 50000, 1);
+  if( !bReuse || access(argv[1], F_OK)!=0 ){
+    createDb(argv[1], nDoc, nBatch, nAutoMerge, &vocab);
+  }
+
+  db = openOrDie(argv[1]);
+  printf("queries:\n");
+  vocab.iRand = 2;
+  runQueries(db, "two terms:", nQuery, 2, 0, &vocab);
+  runQueries(db, "three terms:", nQuery, 3, 0, &vocab);
+  runQueries(db, "two terms, prefix:", nQuery, 2, 1, &vocab);
+  sqlite3_close(db);
+  free(vocab.aCum);
+  return 0;
+}
@@ -0,0 +1,244 @@
+/*
+** Performance test for index key comparisons in SQLite.
+**
+** This program builds a database containing a single table with an
+** integer column and a text column, each with its own index, then times
+** point lookups and short range scans on both indexes.  These workloads
+** are dominated by the binary search in sqlite3BtreeMovetoUnpacked(),
+** which compares the search key against index cells.
+**
+** To compile this program, first compile the SQLite library separately
+** with full optimizations.  For example:
+**
+**     gcc -c -O2 -DSQLITE_THREADSAFE=0 sqlite3.c
+**
+** Then link against this program:
+**
+**     gcc -O2 speedtest_keycmp.c sqlite3.o -ldl -lpthread
+**
+** And run it with the name of a scratch database file:
+**
+**     ./a.out [options] test.db
+**
+** Use -reuse to run several builds of the library against the same
+** database file.
+*/
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <sys/time.h>
+#include <sys/times.h>
+
+#include "sqlite3.h"
+
+/*
+** Return the current wall-clock time in microseconds.
+*/
+static sqlite_uint64 timeOfDay(void){
+  struct timeval sNow;
+  gettimeofday(&sNow, 0);
+  return (sqlite_uint64)sNow.tv_sec*1000000 + sNow.tv_usec;
+}
+
+/*
+** Run a statement that returns no rows.  Exit on error.
+*/
+static void execOrDie(sqlite3 *db, const char *zSql){
+  char *zErr = 0;
+  if( sqlite3_exec(db, zSql, 0, 0, &zErr)!=SQLITE_OK ){
+    fprintf(stderr, "SQL error: %s\n%s\n", zErr, zSql);
+    exit(1);
+  }
+}
+
+/*
+** Prepare a statement.  Exit on error.
+*/
+static sqlite3_stmt *prepareOrDie(sqlite3 *db, const char *zSql){
+  sqlite3_stmt *pStmt = 0;
+  if( sqlite3_prepare_v2(db, zSql, -1, &pStmt, 0)!=SQLITE_OK ){
+    fprintf(stderr, "SQL error: %s\n%s\n", sqlite3_errmsg(db), zSql);
+    exit(1);
+  }
+  return pStmt;
+}
+
+/*
+** Write the text key for row i into zBuf.  Keys share a common prefix so
+** that comparisons have to look past the first few bytes.
+*/
+static void textKey(char *zBuf, int nBuf, int i){
+  sqlite3_snprintf(nBuf, zBuf, "customer-%08x-%d",
+                   (unsigned)(i*2654435761u), i%97);
+}
+
+/*
+** Create the test database containing nRow rows.
+*/
+static void createDb(const char *zFile, int nRow){
+  sqlite3 *db;
+  sqlite3_stmt *pIns;
+  int i;
+
+  unlink(zFile);
+  if( sqlite3_open(zFile, &db)!=SQLITE_OK ){
+    fprintf(stderr, "cannot open %s\n", zFile);
+    exit(1);
+  }
+  execOrDie(db, "PRAGMA journal_mode=OFF;"
+                "PRAGMA synchronous=OFF;"
+                "CREATE TABLE t1(a INTEGER, b TEXT, c);"
+                "BEGIN");
+  pIns = prepareOrDie(db, "INSERT INTO t1 VALUES(?, ?, ?)");
+  for(i=1; i<=nRow; i++){
+    char zText[40];
+    textKey(zText, sizeof(zText), i);
+    sqlite3_bind_int64(pIns, 1, (sqlite3_int64)(i*2654435761u));
+    sqlite3_bind_text(pIns, 2, zText, -1, SQLITE_TRANSIENT);
+    sqlite3_bind_int(pIns, 3, i);
+    sqlite3_step(pIns);
+    sqlite3_reset(pIns);
+  }
+  sqlite3_finalize(pIns);
+  execOrDie(db, "COMMIT;"
+                "CREATE INDEX i1 ON t1(a);"
+                "CREATE INDEX i2 ON t1(b);");
+  sqlite3_close(db);
+}
+
+/*
+** Print the timings accumulated between the two samples.
+*/
+static void reportTime(
+  const char *zLabel,
+  sqlite_uint64 iElapse,
+  struct tms *pStart,
+  struct tms *pEnd
+){
+  double rTick = (double)sysconf(_SC_CLK_TCK);
+  printf("  %-22s %9.3f real %9.3f user %9.3f sys\n", zLabel,
+         iElapse/1000000.0,
+         (pEnd->tms_utime - pStart->tms_utime)/rTick,
+         (pEnd->tms_stime - pStart->tms_stime)/rTick);
+}
+
+/*
+** Run nLookup lookups using pStmt.  If bText is true the statement is
+** bound to text keys, otherwise to integer keys.  Return the sum of
+** the first result column of every row returned.
+*/
+static sqlite3_int64 runLookups(
+  const char *zLabel,
+  sqlite3_stmt *pStmt,
+  int bText,
+  int nRow,
+  int nLookup
+){
+  sqlite_uint64 iStart;
+  sqlite3_int64 nSum = 0;
+  struct tms tmsStart, tmsEnd;
+  unsigned int r = 1;
+  int i;
+
+  times(&tmsStart);
+  iStart = timeOfDay();
+  for(i=0; i<nLookup; i++){
+    int iRow;
+    r = r*1103515245 + 12345;
+    iRow = 1 + (r>>8)%nRow;
+    if( bText ){
+      char zText[40];
+      textKey(zText, sizeof(zText), iRow);
+      sqlite3_bind_text(pStmt, 1, zText, -1, SQLITE_TRANSIENT);
+    }else{
+      sqlite3_bind_int64(pStmt, 1, (sqlite3_int64)(iRow*2654435761u));
+    }
+    while( sqlite3_step(pStmt)==SQLITE_ROW ){
+      nSum += sqlite3_column_int64(pStmt, 0);
+    }
+    sqlite3_reset(pStmt);
+  }
+  times(&tmsEnd);
+  reportTime(zLabel, timeOfDay() - iStart, &tmsStart, &tmsEnd);
+  return nSum;
+}
+
+int main(int argc, char **argv){
+  const char *zArgv0 = argv[0];
+  int nRow = 1000000;
+  int nLookup = 1000000;
+  int bReuse = 0;
+  sqlite3 *db;
+  sqlite3_stmt *pStmt;
+  sqlite3_int64 nSum = 0;
+
+  while( argc>2 ){
+    if( argc>3 && strcmp(argv[1], "-rows")==0 ){
+      nRow = atoi(argv[2]);
+      argv += 2;
+      argc -= 2;
+      continue;
+    }
+    if( argc>3 && strcmp(argv[1], "-lookups")==0 ){
+      nLookup = atoi(argv[2]);
+      argv += 2;
+      argc -= 2;
+      continue;
+    }
+    if( strcmp(argv[1], "-reuse")==0 ){
+      bReuse = 1;
+      argv++;
+      argc--;
+      continue;
+    }
+    break;
+  }
+
+  if( argc!=2 || nRow<=0 || nLookup<=0 ){
+    fprintf(stderr, "Usage: %s [options] FILENAME\n"
+              "Times index point lookups and range scans\n"
+              "\toptions:\n"
+              "\t-rows <n> : number of rows in the test table\n"
+              "\t-lookups <n> : number of lookups of each kind\n"
+              "\t-reuse : do not rebuild an existing database\n",
+              zArgv0);
+    exit(1);
+  }
+
+  printf("SQLite version: %d\n", sqlite3_libversion_number());
+  if( !bReuse || access(argv[1], F_OK)!=0 ){
+    createDb(argv[1], nRow);
+  }
+  sqlite3_open(argv[1], &db);
+  /* Use a cache large enough to hold the whole database, so that the
+  ** timings measure CPU spent searching pages rather than I/O. */
+  execOrDie(db, "PRAGMA cache_size=200000");
+  /* Hold a single read transaction open so that each lookup does not
+  ** have to take and release a file lock. */
+  execOrDie(db, "BEGIN");
+  execOrDie(db, "SELECT count(*) FROM t1 WHERE a>0 AND b>''");
+
+  pStmt = prepareOrDie(db, "SELECT rowid FROM t1 WHERE a=?");
+  nSum += runLookups("integer point lookup:", pStmt, 0, nRow, nLookup);
+  sqlite3_finalize(pStmt);
+
+  pStmt = prepareOrDie(db,
+      "SELECT rowid FROM t1 WHERE a>=? ORDER BY a LIMIT 10");
+  nSum += runLookups("integer range scan:", pStmt, 0, nRow, nLookup/10);
+  sqlite3_finalize(pStmt);
+
+  pStmt = prepareOrDie(db, "SELECT rowid FROM t1 WHERE b=?");
+  nSum += runLookups("text point lookup:", pStmt, 1, nRow, nLookup);
+  sqlite3_finalize(pStmt);
+
+  pStmt = prepareOrDie(db,
+      "SELECT rowid FROM t1 WHERE b>=? ORDER BY b LIMIT 10");
+  nSum += runLookups("text range scan:", pStmt, 1, nRow, nLookup/10);
+  sqlite3_finalize(pStmt);
+
+  printf("  Checksum: %lld\n", nSum);
+  execOrDie(db, "COMMIT");
+  sqlite3_close(db);
+  return 0;
+}
@@ -0,0 +1,294 @@
+/*
+** Performance test for LIKE, upper() and lower() with the ICU extension.
+**
+** This program builds a table of rows holding a few kilobytes of text
+** each, made of pseudo-random words, then times full scans that evaluate
+** "LIKE '%term%'" and other patterns against every row, and scans that
+** compute upper() and lower() of every row.
+**
+** The same tests are then run against a second table containing the
+** same text with one non-ASCII character added to each row.  The ICU
+** extension handles ASCII text without calling into ICU, so the first
+** set of timings shows the ASCII fast path and the second shows the
+** full ICU implementation.
+**
+** To compile this program, first compile the SQLite library separately
+** with full optimizations and with ICU enabled.  For example:
+**
+**     gcc -c -O2 -DSQLITE_ENABLE_ICU sqlite3.c
+**
+** Then link against this program:
+**
+**     gcc -O2 speedtest_like.c sqlite3.o -licui18n -licuuc -ldl -lpthread
+**
+** And run it with the name of a scratch database file:
+**
+**     ./a.out [options] test.db
+*/
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <sys/time.h>
+
+#include "sqlite3.h"
+
+/*
+** Return the current wall-clock time in microseconds.
+*/
+static sqlite_uint64 timeOfDay(void){
+  struct timeval sNow;
+  gettimeofday(&sNow, 0);
+  return (sqlite_uint64)sNow.tv_sec*1000000 + sNow.tv_usec;
+}
+
+/*
+** Run a statement that returns no rows.  Exit on error.
+*/
+static void execOrDie(sqlite3 *db, const char *zSql){
+  char *zErr = 0;
+  if( sqlite3_exec(db, zSql, 0, 0, &zErr)!=SQLITE_OK ){
+    fprintf(stderr, "SQL error: %s\n%s\n", zErr, zSql);
+    exit(1);
+  }
+}
+
+/*
+** Prepare a statement.  Exit on error.
+*/
+static sqlite3_stmt *prepareOrDie(sqlite3 *db, const char *zSql){
+  sqlite3_stmt *pStmt = 0;
+  if( sqlite3_prepare_v2(db, zSql, -1, &pStmt, 0)!=SQLITE_OK ){
+    fprintf(stderr, "SQL error: %s\n%s\n", sqlite3_errmsg(db), zSql);
+    exit(1);
+  }
+  return pStmt;
+}
+
+/*
+** Return the integer value returned by a single-row query.
+*/
+static sqlite3_int64 queryInt(sqlite3 *db, const char *zSql){
+  sqlite3_stmt *pStmt = prepareOrDie(db, zSql);
+  sqlite3_int64 iVal = 0;
+  if( sqlite3_step(pStmt)==SQLITE_ROW ){
+    iVal = sqlite3_column_int64(pStmt, 0);
+  }
+  sqlite3_finalize(pStmt);
+  return iVal;
+}
+
+/*
+** Words used to build the text of each row.
+*/
+static const char *azWord[] = {
+  "the", "quick", "brown", "fox", "jumps", "over", "lazy", "dog",
+  "Lorem", "ipsum", "dolor", "sit", "amet", "consectetur", "adipiscing",
+  "elit", "sed", "do", "eiusmod", "tempor", "incididunt", "ut", "labore",
+  "et", "dolore", "magna", "aliqua", "Enim", "ad", "minim", "veniam",
+  "quis", "nostrud", "exercitation", "ullamco", "laboris", "nisi",
+  "aliquip", "ex", "ea", "commodo", "consequat", "Duis", "aute", "irure",
+  "in", "reprehenderit", "voluptate", "velit", "esse", "cillum", "fugiat",
+  "nulla", "pariatur", "Excepteur", "sint", "occaecat", "cupidatat",
+};
+
+/*
+** Fill table zTab with nRow rows of about nByte bytes of text each.  One
+** row in nMatch contains the word "needle".  If zExtra is not NULL, it
+** is appended to the text of every row.
+*/
+static void fillTable(
+  sqlite3 *db,
+  const char *zTab,
+  int nRow,
+  int nByte,
+  int nMatch,
+  const char *zExtra
+){
+  char *zText = malloc(nByte + 64);
+  char *zSql;
+  sqlite3_stmt *pIns;
+  unsigned int iRand = 1;
+  int i;
+
+  zSql = sqlite3_mprintf("CREATE TABLE %s(id INTEGER PRIMARY KEY, body TEXT)",
+                         zTab);
+  execOrDie(db, zSql);
+  sqlite3_free(zSql);
+  zSql = sqlite3_mprintf("INSERT INTO %s VALUES(?, ?)", zTab);
+  pIns = prepareOrDie(db, zSql);
+  sqlite3_free(zSql);
+
+  execOrDie(db, "BEGIN");
+  for(i=1; i<=nRow; i++){
+    int n = 0;
+    while( n<nByte ){
+      const char *zWord;
+      iRand = iRand*1103515245 + 12345;
+      zWord = azWord[(iRand>>16) % (sizeof(azWord)/sizeof(azWord[0]))];
+      n += sprintf(&zText[n], "%s ", zWord);
+    }
+    if( (i%nMatch)==0 ){
+      memcpy(&zText[n/2], "needle", 6);
+    }
+    if( zExtra ){
+      n += sprintf(&zText[n], "%s", zExtra);
+    }
+    sqlite3_bind_int(pIns, 1, i);
+    sqlite3_bind_text(pIns, 2, zText, n, SQLITE_STATIC);
+    sqlite3_step(pIns);
+    if( sqlite3_reset(pIns)!=SQLITE_OK ){
+      fprintf(stderr, "SQL error: %s\n", sqlite3_errmsg(db));
+      exit(1);
+    }
+  }
+  execOrDie(db, "COMMIT");
+  sqlite3_finalize(pIns);
+  free(zText);
+}
+
+/*
+** Run query zSql, which returns a single integer, nRep times.  Report
+** the shortest time taken and the rate at which table text was
+** scanned.
+*/
+static void timeQuery(
+  sqlite3 *db,
+  const char *zLabel,
+  const char *zSql,
+  sqlite3_int64 nText,        /* Bytes of text scanned by the query */
+  int nRep
+){
+  sqlite3_stmt *pStmt = prepareOrDie(db, zSql);
+  sqlite_uint64 iBest = 0;
+  sqlite3_int64 iRes = 0;
+  int i;
+
+  for(i=0; i<nRep; i++){
+    sqlite_uint64 iStart = timeOfDay();
+    sqlite_uint64 iElapsed;
+    if( sqlite3_step(pStmt)==SQLITE_ROW ){
+      iRes = sqlite3_column_int64(pStmt, 0);
+    }
+    if( sqlite3_reset(pStmt)!=SQLITE_OK ){
+      fprintf(stderr, "SQL error: %s\n%s\n", sqlite3_errmsg(db), zSql);
+      exit(1);
+    }
+    iElapsed = timeOfDay() - iStart;
+    if( i==0 || iElapsed<iBest ) iBest = iElapsed;
+  }
+  sqlite3_finalize(pStmt);
+
+  printf("  %-28s %9.3f s %9.1f MB/s  (result %lld)\n", zLabel,
+         iBest/1000000.0,
+         iBest ? (nText/1048576.0)/(iBest/1000000.0) : 0.0, iRes);
+}
+
+/*
+** Time each of the test queries against table zTab.
+*/
+static void runQueries(sqlite3 *db, const char *zTab, int nRep){
+  static const struct {
+    const char *zLabel;
+    const char *zWhere;
+  } aQuery[] = {
+    { "LIKE '%needle%':",      "body LIKE '%needle%'" },
+    { "LIKE '%NEEDLE%':",      "body LIKE '%NEEDLE%'" },
+    { "LIKE '%zzz%' (none):",  "body LIKE '%zzz%'" },
+    { "LIKE '%quick%dog%':",   "body LIKE '%quick%dog%'" },
+    { "LIKE 'the%':",          "body LIKE 'the%'" },
+    { "LIKE '%e_dle%':",       "body LIKE '%e_dle%'" },
+  };
+  char *zSql;
+  sqlite3_int64 nText;
+  int i;
+
+  zSql = sqlite3_mprintf("SELECT sum(length(CAST(body AS BLOB))) FROM %s",
+                         zTab);
+  nText = queryInt(db, zSql);
+  sqlite3_free(zSql);
+
+  for(i=0; i<(int)(sizeof(aQuery)/sizeof(aQuery[0])); i++){
+    zSql = sqlite3_mprintf("SELECT count(*) FROM %s WHERE %s",
+                           zTab, aQuery[i].zWhere);
+    timeQuery(db, aQuery[i].zLabel, zSql, nText, nRep);
+    sqlite3_free(zSql);
+  }
+
+  zSql = sqlite3_mprintf("SELECT sum(length(upper(body))) FROM %s", zTab);
+  timeQuery(db, "upper():", zSql, nText, nRep);
+  sqlite3_free(zSql);
+  zSql = sqlite3_mprintf("SELECT sum(length(lower(body))) FROM %s", zTab);
+  timeQuery(db, "lower():", zSql, nText, nRep);
+  sqlite3_free(zSql);
+}
+
+int main(int argc, char **argv){
+  const char *zArgv0 = argv[0];
+  sqlite3 *db;
+  int nRow = 20000;
+  int nByte = 4000;
+  int nMatch = 100;
+  int nRep = 3;
+
+  while( argc>2 ){
+    if( argc>3 && strcmp(argv[1], "-rows")==0 ){
+      nRow = atoi(argv[2]);
+      argv += 2;
+      argc -= 2;
+      continue;
+    }
+    if( argc>3 && strcmp(argv[1], "-size")==0 ){
+      nByte = atoi(argv[2]);
+      argv += 2;
+      argc -= 2;
+      continue;
+    }
+    if( argc>3 && strcmp(argv[1], "-match")==0 ){
+      nMatch = atoi(argv[2]);
+      argv += 2;
+      argc -= 2;
+      continue;
+    }
+    if( argc>3 && strcmp(argv[1], "-repeat")==0 ){
+      nRep = atoi(argv[2]);
+      argv += 2;
+      argc -= 2;
+      continue;
+    }
+    break;
+  }
+
+  if( argc!=2 || nRow<=0 || nByte<=0 || nMatch<=0 || nRep<=0 ){
+    fprintf(stderr, "Usage: %s [options] FILENAME\n"
+              "Times LIKE, upper() and lower() on ASCII and non-ASCII text\n"
+              "\toptions:\n"
+              "\t-rows <n> : number of rows in each table\n"
+              "\t-size <n> : bytes of text in each row\n"
+              "\t-match <n> : one row in <n> matches '%%needle%%'\n"
+              "\t-repeat <n> : time the best of <n> runs of each query\n",
+              zArgv0);
+    exit(1);
+  }
+
+  unlink(argv[1]);
+  if( sqlite3_open(argv[1], &db)!=SQLITE_OK ){
+    fprintf(stderr, "Cannot open %s: %s\n", argv[1], sqlite3_errmsg(db));
+    exit(1);
+  }
+  execOrDie(db, "PRAGMA synchronous=OFF; PRAGMA cache_size=100000");
+  if( sqlite3_exec(db, "SELECT icu_load_collation('en_US', 'x')", 0, 0, 0) ){
+    fprintf(stderr, "warning: SQLite was not compiled with SQLITE_ENABLE_ICU\n");
+  }
+  fillTable(db, "ascii", nRow, nByte, nMatch, 0);
+  fillTable(db, "mixed", nRow, nByte, nMatch, "caf\xc3\xa9");
+
+  printf("SQLite version: %d\n", sqlite3_libversion_number());
+  printf("ASCII text (fast path):\n");
+  runQueries(db, "ascii", nRep);
+  printf("Text with non-ASCII characters (ICU):\n");
+  runQueries(db, "mixed", nRep);
+
+  sqlite3_close(db);
+  return 0;
+}
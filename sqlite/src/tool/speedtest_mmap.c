@@ -0,0 +1,233 @@
+/*
+** Performance test for memory-mapped I/O in SQLite.
+**
+** This program builds a database containing a single table with an
+** integer primary key, an indexed text column and a blob payload, then
+** runs the same read-heavy workload against it twice: once with
+** "PRAGMA mmap_size=0" (every page is read using pread()) and once with
+** memory-mapped I/O enabled.  The workload consists of full table scans,
+** index range scans and random point lookups.
+**
+** To compile this program, first compile the SQLite library separately
+** with full optimizations.  For example:
+**
+**     gcc -c -O2 -DSQLITE_THREADSAFE=0 sqlite3.c
+**
+** Then link against this program:
+**
+**     gcc -O2 speedtest_mmap.c sqlite3.o -ldl -lpthread
+**
+** And run it with the name of a scratch database file:
+**
+**     ./a.out [options] test.db
+**
+** Memory-mapped I/O is only implemented by the unix VFS, so this program
+** is only expected to build on unix-like systems.
+*/
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <sys/time.h>
+#include <sys/times.h>
+
+#include "sqlite3.h"
+
+/*
+** Return the current wall-clock time in microseconds.
+*/
+static sqlite_uint64 timeOfDay(void){
+  struct timeval sNow;
+  gettimeofday(&sNow, 0);
+  return (sqlite_uint64)sNow.tv_sec*1000000 + sNow.tv_usec;
+}
+
+/*
+** Run a statement that returns no rows.  Exit on error.
+*/
+static void execOrDie(sqlite3 *db, const char *zSql){
+  char *zErr = 0;
+  if( sqlite3_exec(db, zSql, 0, 0, &zErr)!=SQLITE_OK ){
+    fprintf(stderr, "SQL error: %s\n%s\n", zErr, zSql);
+    exit(1);
+  }
+}
+
+/*
+** Prepare a statement.  Exit on error.
+*/
+static sqlite3_stmt *prepareOrDie(sqlite3 *db, const char *zSql){
+  sqlite3_stmt *pStmt = 0;
+  if( sqlite3_prepare_v2(db, zSql, -1, &pStmt, 0)!=SQLITE_OK ){
+    fprintf(stderr, "SQL error: %s\n%s\n", sqlite3_errmsg(db), zSql);
+    exit(1);
+  }
+  return pStmt;
+}
+
+/*
+** Create the test database containing nRow rows.
+*/
+static void createDb(const char *zFile, int nRow, int bWal){
+  sqlite3 *db;
+  sqlite3_stmt *pIns;
+  int i;
+
+  unlink(zFile);
+  if( sqlite3_open(zFile, &db)!=SQLITE_OK ){
+    fprintf(stderr, "cannot open %s\n", zFile);
+    exit(1);
+  }
+  if( bWal ) execOrDie(db, "PRAGMA journal_mode=WAL");
+  execOrDie(db, "CREATE TABLE t1(a INTEGER PRIMARY KEY, b TEXT, c BLOB);"
+                "CREATE INDEX i1 ON t1(b);"
+                "BEGIN");
+  pIns = prepareOrDie(db, "INSERT INTO t1 VALUES(?, ?, randomblob(?))");
+  for(i=1; i<=nRow; i++){
+    char zText[32];
+    sqlite3_snprintf(sizeof(zText), zText, "%08x", (unsigned)(i*2654435761u));
+    sqlite3_bind_int(pIns, 1, i);
+    sqlite3_bind_text(pIns, 2, zText, -1, SQLITE_TRANSIENT);
+    sqlite3_bind_int(pIns, 3, 100 + (i%7)*50);
+    sqlite3_step(pIns);
+    sqlite3_reset(pIns);
+  }
+  sqlite3_finalize(pIns);
+  execOrDie(db, "COMMIT");
+  sqlite3_close(db);
+}
+
+/*
+** Run the read workload once with the given mmap_size setting and
+** print the elapsed time.
+*/
+static void runReads(
+  const char *zFile,          /* Database to read */
+  sqlite3_int64 szMmap,       /* Value for PRAGMA mmap_size */
+  int nRow,                   /* Number of rows in t1 */
+  int nIter                   /* Number of times to repeat the workload */
+){
+  sqlite3 *db;
+  sqlite3_stmt *pScan, *pRange, *pPoint, *pMmap;
+  sqlite_uint64 iStart, iElapse;
+  sqlite3_int64 nSum = 0;
+  sqlite3_int64 szActual = 0;
+  unsigned int r = 1;
+  char zSql[64];
+  int i, j;
+  double rTick = (double)sysconf(_SC_CLK_TCK);
+  struct tms tmsStart, tmsEnd;
+
+  sqlite3_open(zFile, &db);
+  /* Keep the page cache small so that the workload is dominated by
+  ** reads from the database file rather than by cache hits. */
+  execOrDie(db, "PRAGMA cache_size=10");
+  sqlite3_snprintf(sizeof(zSql), zSql, "PRAGMA mmap_size=%lld", szMmap);
+  pMmap = prepareOrDie(db, zSql);
+  if( sqlite3_step(pMmap)==SQLITE_ROW ){
+    szActual = sqlite3_column_int64(pMmap, 0);
+  }
+  sqlite3_finalize(pMmap);
+
+  pScan = prepareOrDie(db, "SELECT sum(length(c)) FROM t1");
+  pRange = prepareOrDie(db,
+      "SELECT count(*) FROM t1 WHERE b BETWEEN ? AND ?||'~'");
+  pPoint = prepareOrDie(db, "SELECT length(c) FROM t1 WHERE a=?");
+
+  times(&tmsStart);
+  iStart = timeOfDay();
+  for(i=0; i<nIter; i++){
+    while( sqlite3_step(pScan)==SQLITE_ROW ){
+      nSum += sqlite3_column_int64(pScan, 0);
+    }
+    sqlite3_reset(pScan);
+    for(j=0; j<100; j++){
+      char zLo[8];
+      r = r*1103515245 + 12345;
+      sqlite3_snprintf(sizeof(zLo), zLo, "%02x", (r>>16)&0xff);
+      sqlite3_bind_text(pRange, 1, zLo, -1, SQLITE_TRANSIENT);
+      sqlite3_bind_text(pRange, 2, zLo, -1, SQLITE_TRANSIENT);
+      while( sqlite3_step(pRange)==SQLITE_ROW ){
+        nSum += sqlite3_column_int64(pRange, 0);
+      }
+      sqlite3_reset(pRange);
+    }
+    for(j=0; j<nRow; j++){
+      r = r*1103515245 + 12345;
+      sqlite3_bind_int(pPoint, 1, 1 + (r>>8)%nRow);
+      while( sqlite3_step(pPoint)==SQLITE_ROW ){
+        nSum += sqlite3_column_int64(pPoint, 0);
+      }
+      sqlite3_reset(pPoint);
+    }
+  }
+  iElapse = timeOfDay() - iStart;
+  times(&tmsEnd);
+
+  sqlite3_finalize(pScan);
+  sqlite3_finalize(pRange);
+  sqlite3_finalize(pPoint);
+  sqlite3_close(db);
+
+  printf("mmap_size=%-12lld (actual %lld)\n", szMmap, szActual);
+  printf("  Checksum:              %15lld\n", nSum);
+  printf("  Total real time:       %15.3f secs\n", iElapse/1000000.0);
+  printf("  Total user CPU time:   %15.3f secs\n",
+         (tmsEnd.tms_utime - tmsStart.tms_utime)/rTick);
+  printf("  Total system CPU time: %15.3f secs\n",
+         (tmsEnd.tms_stime - tmsStart.tms_stime)/rTick);
+}
+
+int main(int argc, char **argv){
+  const char *zArgv0 = argv[0];
+  int nRow = 100000;
+  int nIter = 5;
+  int bWal = 0;
+  sqlite3_int64 szMmap = 268435456;
+
+  while( argc>2 ){
+    if( argc>3 && strcmp(argv[1], "-rows")==0 ){
+      nRow = atoi(argv[2]);
+      argv += 2;
+      argc -= 2;
+      continue;
+    }
+    if( argc>3 && strcmp(argv[1], "-iterations")==0 ){
+      nIter = atoi(argv[2]);
+      argv += 2;
+      argc -= 2;
+      continue;
+    }
+    if( argc>3 && strcmp(argv[1], "-mmap")==0 ){
+      szMmap = atoll(argv[2]);
+      argv += 2;
+      argc -= 2;
+      continue;
+    }
+    if( strcmp(argv[1], "-wal")==0 ){
+      bWal = 1;
+      argv++;
+      argc--;
+      continue;
+    }
+    break;
+  }
+
+  if( argc!=2 || nRow<=0 ){
+    fprintf(stderr, "Usage: %s [options] FILENAME\n"
+              "Compares pread() and mmap() read performance\n"
+              "\toptions:\n"
+              "\t-rows <n> : number of rows in the test table\n"
+              "\t-iterations <n> : number of times to run the workload\n"
+              "\t-mmap <bytes> : mmap_size to use for the mmap run\n"
+              "\t-wal : use a WAL mode database\n",
+              zArgv0);
+    exit(1);
+  }
+
+  printf("SQLite version: %d\n", sqlite3_libversion_number());
+  createDb(argv[1], nRow, bWal);
+  runReads(argv[1], 0, nRow, nIter);
+  runReads(argv[1], szMmap, nRow, nIter);
+  return 0;
+}
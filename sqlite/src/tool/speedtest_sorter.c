@@ -0,0 +1,224 @@
+/*
+** Performance test for the external merge sorter in SQLite.
+**
+** This program builds a database containing a single table with an
+** integer primary key, a text column holding pseudo-random keys and a
+** blob payload.  It then times CREATE INDEX on the text column and a
+** full "ORDER BY" scan of the table, once with "PRAGMA threads=0" and
+** once with the number of worker threads given by the -threads option.
+**
+** To compile this program, first compile the SQLite library separately
+** with full optimizations.  For example:
+**
+**     gcc -c -O2 sqlite3.c
+**
+** Then link against this program:
+**
+**     gcc -O2 speedtest_sorter.c sqlite3.o -ldl -lpthread
+**
+** And run it with the name of a scratch database file:
+**
+**     ./a.out [options] test.db
+**
+** To measure the older code path that builds indexes and sorts using
+** an ephemeral b-tree, compile the library with -DSQLITE_OMIT_MERGE_SORT
+** and run the same command.  The default of 2 million rows produces a
+** database of roughly 400MB.
+*/
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <sys/time.h>
+#include <sys/times.h>
+
+#include "sqlite3.h"
+
+/*
+** Return the current wall-clock time in microseconds.
+*/
+static sqlite_uint64 timeOfDay(void){
+  struct timeval sNow;
+  gettimeofday(&sNow, 0);
+  return (sqlite_uint64)sNow.tv_sec*1000000 + sNow.tv_usec;
+}
+
+/*
+** Run a statement that returns no rows.  Exit on error.
+*/
+static void execOrDie(sqlite3 *db, const char *zSql){
+  char *zErr = 0;
+  if( sqlite3_exec(db, zSql, 0, 0, &zErr)!=SQLITE_OK ){
+    fprintf(stderr, "SQL error: %s\n%s\n", zErr, zSql);
+    exit(1);
+  }
+}
+
+/*
+** Prepare a statement.  Exit on error.
+*/
+static sqlite3_stmt *prepareOrDie(sqlite3 *db, const char *zSql){
+  sqlite3_stmt *pStmt = 0;
+  if( sqlite3_prepare_v2(db, zSql, -1, &pStmt, 0)!=SQLITE_OK ){
+    fprintf(stderr, "SQL error: %s\n%s\n", sqlite3_errmsg(db), zSql);
+    exit(1);
+  }
+  return pStmt;
+}
+
+/*
+** Create the test database containing nRow rows.
+*/
+static void createDb(const char *zFile, int nRow){
+  sqlite3 *db;
+  sqlite3_stmt *pIns;
+  int i;
+
+  unlink(zFile);
+  if( sqlite3_open(zFile, &db)!=SQLITE_OK ){
+    fprintf(stderr, "cannot open %s\n", zFile);
+    exit(1);
+  }
+  execOrDie(db, "PRAGMA journal_mode=OFF;"
+                "PRAGMA synchronous=OFF;"
+                "CREATE TABLE t1(a INTEGER PRIMARY KEY, b TEXT, c BLOB);"
+                "BEGIN");
+  pIns = prepareOrDie(db, "INSERT INTO t1 VALUES(?, ?, randomblob(?))");
+  for(i=1; i<=nRow; i++){
+    char zText[40];
+    unsigned int h = (unsigned)(i*2654435761u);
+    sqlite3_snprintf(sizeof(zText), zText, "%08x-%08x-%d",
+                     h, h*2246822519u, i%1000);
+    sqlite3_bind_int(pIns, 1, i);
+    sqlite3_bind_text(pIns, 2, zText, -1, SQLITE_TRANSIENT);
+    sqlite3_bind_int(pIns, 3, 100 + (i%7)*20);
+    sqlite3_step(pIns);
+    sqlite3_reset(pIns);
+  }
+  sqlite3_finalize(pIns);
+  execOrDie(db, "COMMIT");
+  sqlite3_close(db);
+}
+
+/*
+** Print the timings accumulated between the two samples.
+*/
+static void reportTime(
+  const char *zLabel,
+  sqlite_uint64 iElapse,
+  struct tms *pStart,
+  struct tms *pEnd
+){
+  double rTick = (double)sysconf(_SC_CLK_TCK);
+  printf("  %-22s %9.3f real %9.3f user %9.3f sys\n", zLabel,
+         iElapse/1000000.0,
+         (pEnd->tms_utime - pStart->tms_utime)/rTick,
+         (pEnd->tms_stime - pStart->tms_stime)/rTick);
+}
+
+/*
+** Time CREATE INDEX and an ORDER BY scan using nThread worker threads.
+*/
+static void runSorts(
+  const char *zFile,          /* Database to use */
+  int nThread,                /* Value for PRAGMA threads */
+  int nCache                  /* Value for PRAGMA cache_size */
+){
+  sqlite3 *db;
+  sqlite3_stmt *pSort;
+  sqlite_uint64 iStart;
+  sqlite3_int64 nSum = 0;
+  char zSql[64];
+  struct tms tmsStart, tmsEnd;
+
+  sqlite3_open(zFile, &db);
+  execOrDie(db, "PRAGMA journal_mode=OFF; PRAGMA synchronous=OFF");
+  sqlite3_snprintf(sizeof(zSql), zSql, "PRAGMA cache_size=%d", nCache);
+  execOrDie(db, zSql);
+  sqlite3_snprintf(sizeof(zSql), zSql, "PRAGMA threads=%d", nThread);
+  execOrDie(db, zSql);
+  printf("threads=%d (actual %d) cache_size=%d\n", nThread,
+         sqlite3_limit(db, SQLITE_LIMIT_WORKER_THREADS, -1), nCache);
+
+  times(&tmsStart);
+  iStart = timeOfDay();
+  execOrDie(db, "CREATE INDEX i1 ON t1(b)");
+  times(&tmsEnd);
+  reportTime("CREATE INDEX:", timeOfDay() - iStart, &tmsStart, &tmsEnd);
+  execOrDie(db, "DROP INDEX i1");
+
+  pSort = prepareOrDie(db, "SELECT b, length(c) FROM t1 ORDER BY b");
+  times(&tmsStart);
+  iStart = timeOfDay();
+  while( sqlite3_step(pSort)==SQLITE_ROW ){
+    nSum += sqlite3_column_int64(pSort, 1);
+  }
+  times(&tmsEnd);
+  reportTime("SELECT ... ORDER BY:", timeOfDay() - iStart, &tmsStart, &tmsEnd);
+  printf("  Checksum: %lld\n", nSum);
+  sqlite3_finalize(pSort);
+  sqlite3_close(db);
+}
+
+int main(int argc, char **argv){
+  const char *zArgv0 = argv[0];
+  int nRow = 2000000;
+  int nThread = 4;
+  int nCache = 2000;
+  int bReuse = 0;
+
+  while( argc>2 ){
+    if( argc>3 && strcmp(argv[1], "-rows")==0 ){
+      nRow = atoi(argv[2]);
+      argv += 2;
+      argc -= 2;
+      continue;
+    }
+    if( argc>3 && strcmp(argv[1], "-threads")==0 ){
+      nThread = atoi(argv[2]);
+      argv += 2;
+      argc -= 2;
+      continue;
+    }
+    if( argc>3 && strcmp(argv[1], "-cache")==0 ){
+      nCache = atoi(argv[2]);
+      argv += 2;
+      argc -= 2;
+      continue;
+    }
+    if( argc>3 && strcmp(argv[1], "-pmasz")==0 ){
+      sqlite3_config(SQLITE_CONFIG_PMASZ, (unsigned int)atoi(argv[2]));
+      argv += 2;
+      argc -= 2;
+      continue;
+    }
+    if( strcmp(argv[1], "-reuse")==0 ){
+      bReuse = 1;
+      argv++;
+      argc--;
+      continue;
+    }
+    break;
+  }
+
+  if( argc!=2 || nRow<=0 ){
+    fprintf(stderr, "Usage: %s [options] FILENAME\n"
+              "Times CREATE INDEX and ORDER BY on a large table\n"
+              "\toptions:\n"
+              "\t-rows <n> : number of rows in the test table\n"
+              "\t-threads <n> : worker threads for the second run\n"
+              "\t-cache <n> : PRAGMA cache_size (sorter memory budget)\n"
+              "\t-pmasz <n> : SQLITE_CONFIG_PMASZ value in pages\n"
+              "\t-reuse : do not rebuild an existing database\n",
+              zArgv0);
+    exit(1);
+  }
+
+  printf("SQLite version: %d\n", sqlite3_libversion_number());
+  if( !bReuse || access(argv[1], F_OK)!=0 ){
+    createDb(argv[1], nRow);
+  }
+  runSorts(argv[1], 0, nCache);
+  if( nThread>0 ) runSorts(argv[1], nThread, nCache);
+  return 0;
+}
@@ -0,0 +1,332 @@
+/*
+** Performance test for the shared WAL page cache in SQLite.
+**
+** This program builds a WAL mode database containing a single table with
+** an integer primary key and a text payload.  Before each run, part of
+** the table is rewritten so that some of the pages are read from the WAL
+** file.  It then starts several threads, each with its own connection to
+** the database, that perform random point lookups on a hot subset of the
+** table.  The run is done once with only the private page cache of each
+** connection and once with the shared cache enabled by
+** SQLITE_CONFIG_WALCACHE, and the lookup rate and memory usage of each run
+** are reported.
+**
+** To compile this program, first compile the SQLite library separately
+** with full optimizations.  For example:
+**
+**     gcc -c -O2 sqlite3.c
+**
+** Then link against this program:
+**
+**     gcc -O2 speedtest_walcache.c sqlite3.o -ldl -lpthread
+**
+** And run it with the name of a scratch database file:
+**
+**     ./a.out [options] test.db
+**
+** Memory mapping is disabled on all connections, so that pages read
+** from the database file are also shared.  Use -reuse to run several
+** builds of the library against the same database file.
+*/
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/time.h>
+#include <sys/times.h>
+
+#include "sqlite3.h"
+
+/*
+** Return the current wall-clock time in microseconds.
+*/
+static sqlite_uint64 timeOfDay(void){
+  struct timeval sNow;
+  gettimeofday(&sNow, 0);
+  return (sqlite_uint64)sNow.tv_sec*1000000 + sNow.tv_usec;
+}
+
+/*
+** Run a statement that returns no rows.  Exit on error.
+*/
+static void execOrDie(sqlite3 *db, const char *zSql){
+  char *zErr = 0;
+  if( sqlite3_exec(db, zSql, 0, 0, &zErr)!=SQLITE_OK ){
+    fprintf(stderr, "SQL error: %s\n%s\n", zErr, zSql);
+    exit(1);
+  }
+}
+
+/*
+** Prepare a statement.  Exit on error.
+*/
+static sqlite3_stmt *prepareOrDie(sqlite3 *db, const char *zSql){
+  sqlite3_stmt *pStmt = 0;
+  if( sqlite3_prepare_v2(db, zSql, -1, &pStmt, 0)!=SQLITE_OK ){
+    fprintf(stderr, "SQL error: %s\n%s\n", sqlite3_errmsg(db), zSql);
+    exit(1);
+  }
+  return pStmt;
+}
+
+/*
+** Open a connection to zFile.  Exit on error.
+*/
+static sqlite3 *openOrDie(const char *zFile){
+  sqlite3 *db = 0;
+  if( sqlite3_open(zFile, &db)!=SQLITE_OK ){
+    fprintf(stderr, "cannot open %s: %s\n", zFile, sqlite3_errmsg(db));
+    exit(1);
+  }
+  sqlite3_busy_timeout(db, 10000);
+  return db;
+}
+
+/*
+** Create the test database containing nRow rows.
+*/
+static void createDb(const char *zFile, int nRow){
+  sqlite3 *db;
+  sqlite3_stmt *pIns;
+  int i;
+  char zSql[200];
+
+  unlink(zFile);
+  sqlite3_snprintf(sizeof(zSql), zSql, "%s-wal", zFile);
+  unlink(zSql);
+  db = openOrDie(zFile);
+  execOrDie(db, "PRAGMA synchronous=OFF;"
+                "PRAGMA journal_mode=WAL;"
+                "PRAGMA wal_autocheckpoint=0;"
+                "CREATE TABLE t1(a INTEGER PRIMARY KEY, b TEXT);"
+                "BEGIN");
+  pIns = prepareOrDie(db, "INSERT INTO t1 VALUES(?, ?)");
+  for(i=1; i<=nRow; i++){
+    char zText[120];
+    sqlite3_snprintf(sizeof(zText), zText,
+        "%08x-%08x-%08x-%08x-%08x-%08x-%08x-%08x-%08x-%08x",
+        i, i*3, i*5, i*7, i*11, i*13, i*17, i*19, i*23, i*29);
+    sqlite3_bind_int(pIns, 1, i);
+    sqlite3_bind_text(pIns, 2, zText, -1, SQLITE_TRANSIENT);
+    sqlite3_step(pIns);
+    sqlite3_reset(pIns);
+  }
+  sqlite3_finalize(pIns);
+  execOrDie(db, "COMMIT");
+  sqlite3_close(db);
+}
+
+/*
+** Parameters and results for a single reader thread.
+*/
+typedef struct Reader Reader;
+struct Reader {
+  const char *zFile;          /* Database to open */
+  sqlite3 *db;                /* Connection used by this thread */
+  int iSeed;                  /* Seed for the random row numbers */
+  int nHot;                   /* Look up rows 1..nHot */
+  int nLookup;                /* Number of lookups to do */
+  int nPerTxn;                /* Lookups per read transaction */
+  sqlite3_int64 nByte;        /* OUT: total bytes of text read */
+};
+
+/*
+** Body of a reader thread.
+*/
+static void *readerMain(void *pArg){
+  Reader *p = (Reader *)pArg;
+  sqlite3_stmt *pStmt;
+  unsigned int r = (unsigned int)p->iSeed;
+  int i;
+
+  pStmt = prepareOrDie(p->db, "SELECT b FROM t1 WHERE a=?");
+  for(i=0; i<p->nLookup; i++){
+    if( (i % p->nPerTxn)==0 ){
+      if( i>0 ) execOrDie(p->db, "COMMIT");
+      execOrDie(p->db, "BEGIN");
+    }
+    r = r*1103515245 + 12345;
+    sqlite3_bind_int(pStmt, 1, 1 + (r>>8)%p->nHot);
+    while( sqlite3_step(pStmt)==SQLITE_ROW ){
+      p->nByte += sqlite3_column_bytes(pStmt, 0);
+    }
+    sqlite3_reset(pStmt);
+  }
+  execOrDie(p->db, "COMMIT");
+  sqlite3_finalize(pStmt);
+  return 0;
+}
+
+/*
+** Run nThread readers concurrently, each doing nLookup lookups using a
+** connection with a cache_size of nCache pages, and report the results.
+*/
+static void runReaders(
+  const char *zLabel,
+  const char *zFile,
+  int nThread,
+  int nCache,
+  int nHot,
+  int nLookup
+){
+  sqlite3 *dbWal;
+  Reader *aReader;
+  pthread_t *aThread;
+  sqlite_uint64 iStart, iElapse;
+  struct tms tmsStart, tmsEnd;
+  double rTick = (double)sysconf(_SC_CLK_TCK);
+  sqlite3_int64 nByte = 0;
+  int mem, memHi, wal, walHi;
+  char zSql[100];
+  int i;
+
+  /* Rewrite every tenth row with wal_autocheckpoint disabled, so that the
+  ** pages holding those rows are read from the WAL file.  The connection
+  ** is held open until the run is finished, so that the WAL file is not
+  ** checkpointed and deleted when the readers close their connections. */
+  dbWal = openOrDie(zFile);
+  execOrDie(dbWal, "PRAGMA wal_autocheckpoint=0;"
+                   "UPDATE t1 SET b=b WHERE a%10==0;");
+
+  aReader = (Reader *)calloc(nThread, sizeof(Reader));
+  aThread = (pthread_t *)calloc(nThread, sizeof(pthread_t));
+  sqlite3_snprintf(sizeof(zSql), zSql,
+      "PRAGMA cache_size=%d; PRAGMA mmap_size=0", nCache);
+  for(i=0; i<nThread; i++){
+    aReader[i].zFile = zFile;
+    aReader[i].db = openOrDie(zFile);
+    aReader[i].iSeed = i+1;
+    aReader[i].nHot = nHot;
+    aReader[i].nLookup = nLookup;
+    aReader[i].nPerTxn = 1000;
+    execOrDie(aReader[i].db, zSql);
+  }
+  sqlite3_status(SQLITE_STATUS_MEMORY_USED, &mem, &memHi, 1);
+
+  times(&tmsStart);
+  iStart = timeOfDay();
+  for(i=0; i<nThread; i++){
+    pthread_create(&aThread[i], 0, readerMain, &aReader[i]);
+  }
+  for(i=0; i<nThread; i++){
+    pthread_join(aThread[i], 0);
+    nByte += aReader[i].nByte;
+  }
+  iElapse = timeOfDay() - iStart;
+  times(&tmsEnd);
+
+  sqlite3_status(SQLITE_STATUS_MEMORY_USED, &mem, &memHi, 0);
+  sqlite3_status(SQLITE_STATUS_WALCACHE_USED, &wal, &walHi, 0);
+  printf("%s\n", zLabel);
+  printf("  %-22s %9.3f real %9.3f user %9.3f sys\n", "lookups:",
+         iElapse/1000000.0,
+         (tmsEnd.tms_utime - tmsStart.tms_utime)/rTick,
+         (tmsEnd.tms_stime - tmsStart.tms_stime)/rTick);
+  printf("  %-22s %9.0f lookups/s\n", "throughput:",
+         (double)nThread*nLookup*1000000.0/(double)(iElapse ? iElapse : 1));
+  printf("  %-22s %9.1f MB now %9.1f MB max\n", "memory used:",
+         mem/1048576.0, memHi/1048576.0);
+  printf("  %-22s %9.1f MB now %9.1f MB max\n", "shared cache used:",
+         wal/1048576.0, walHi/1048576.0);
+  printf("  %-22s %lld\n", "Checksum:", nByte);
+
+  for(i=0; i<nThread; i++){
+    sqlite3_close(aReader[i].db);
+  }
+  sqlite3_close(dbWal);
+  free(aThread);
+  free(aReader);
+}
+
+int main(int argc, char **argv){
+  const char *zArgv0 = argv[0];
+  int nRow = 200000;
+  int nHot = 50000;
+  int nThread = 8;
+  int nCache = 2000;
+  int nLookup = 200000;
+  sqlite3_int64 szWalCache = 64*1024*1024;
+  int bReuse = 0;
+  char zLabel[100];
+
+  while( argc>2 ){
+    if( argc>3 && strcmp(argv[1], "-rows")==0 ){
+      nRow = atoi(argv[2]);
+      argv += 2;
+      argc -= 2;
+      continue;
+    }
+    if( argc>3 && strcmp(argv[1], "-hot")==0 ){
+      nHot = atoi(argv[2]);
+      argv += 2;
+      argc -= 2;
+      continue;
+    }
+    if( argc>3 && strcmp(argv[1], "-threads")==0 ){
+      nThread = atoi(argv[2]);
+      argv += 2;
+      argc -= 2;
+      continue;
+    }
+    if( argc>3 && strcmp(argv[1], "-cache")==0 ){
+      nCache = atoi(argv[2]);
+      argv += 2;
+      argc -= 2;
+      continue;
+    }
+    if( argc>3 && strcmp(argv[1], "-lookups")==0 ){
+      nLookup = atoi(argv[2]);
+      argv += 2;
+      argc -= 2;
+      continue;
+    }
+    if( argc>3 && strcmp(argv[1], "-walcache")==0 ){
+      szWalCache = atoll(argv[2]);
+      argv += 2;
+      argc -= 2;
+      continue;
+    }
+    if( strcmp(argv[1], "-reuse")==0 ){
+      bReuse = 1;
+      argv++;
+      argc--;
+      continue;
+    }
+    break;
+  }
+
+  if( argc!=2 || nRow<=0 || nThread<=0 || nLookup<=0 || szWalCache<=0 ){
+    fprintf(stderr, "Usage: %s [options] FILENAME\n"
+              "Times concurrent point lookups with and without the shared\n"
+              "WAL page cache\n"
+              "\toptions:\n"
+              "\t-rows <n> : number of rows in the test table\n"
+              "\t-hot <n> : lookups are on rows 1..n\n"
+              "\t-threads <n> : number of reader threads and connections\n"
+              "\t-cache <n> : cache_size of each connection, in pages\n"
+              "\t-lookups <n> : number of lookups done by each thread\n"
+              "\t-walcache <n> : shared cache budget in bytes\n"
+              "\t-reuse : do not rebuild an existing database\n",
+              zArgv0);
+    exit(1);
+  }
+  if( nHot<=0 || nHot>nRow ) nHot = nRow;
+
+  printf("SQLite version: %d\n", sqlite3_libversion_number());
+  printf("%d threads, %d lookups each on %d of %d rows, cache_size=%d\n",
+         nThread, nLookup, nHot, nRow, nCache);
+  if( !bReuse || access(argv[1], F_OK)!=0 ){
+    createDb(argv[1], nRow);
+  }
+
+  runReaders("private page caches:", argv[1], nThread, nCache, nHot, nLookup);
+
+  sqlite3_shutdown();
+  sqlite3_config(SQLITE_CONFIG_WALCACHE, szWalCache);
+  sqlite3_initialize();
+  sqlite3_snprintf(sizeof(zLabel), zLabel,
+      "shared WAL page cache (%lld byte budget):", szWalCache);
+  runReaders(zLabel, argv[1], nThread, nCache, nHot, nLookup);
+  return 0;
+}